@@ -573,21 +573,15 @@ flow_ip_addr_get_sockaddr (FlowIPAddr *ip_addr, FlowSockaddr *dest_sa, gint port
 gboolean
 flow_ip_addr_set_sockaddr (FlowIPAddr *ip_addr, FlowSockaddr *sa)
 {
-  gchar    *addr_str;
-  gboolean  result;
+  FlowAddrFamily family;
 
   g_return_val_if_fail (sa != NULL, FALSE);
 
-  /* FIXME: This isn't ideal performance-wise */
-
-  addr_str = flow_sockaddr_to_string (sa);
-  if (!addr_str)
+  family = flow_sockaddr_get_family (sa);
+  if (family != FLOW_ADDR_FAMILY_IPV4 && family != FLOW_ADDR_FAMILY_IPV6)
     return FALSE;
 
-  result = flow_ip_addr_set_string (ip_addr, addr_str);
-  g_free (addr_str);
-
-  return result;
+  return flow_ip_addr_set_raw (ip_addr, flow_sockaddr_get_addr (sa), flow_sockaddr_get_addr_len (sa));
 }
 
 static void
@@ -655,6 +649,66 @@ flow_ip_service_set_sockaddr (FlowIPService *ip_service, FlowSockaddr *sa)
   return TRUE;
 }
 
+gboolean
+flow_ip_endpoint_get_sockaddr (const FlowIPEndpoint *endpoint, FlowSockaddr *dest_sa)
+{
+  g_return_val_if_fail (endpoint != NULL, FALSE);
+  g_return_val_if_fail (dest_sa != NULL, FALSE);
+
+  if (endpoint->family == FLOW_IP_ADDR_IPV4)
+  {
+    struct sockaddr_in in_sa = { 0 };
+
+    in_sa.sin_family = AF_INET;
+    in_sa.sin_port   = g_htons (endpoint->port);
+    memcpy (&in_sa.sin_addr, endpoint->addr, 4);
+    memcpy (dest_sa, &in_sa, sizeof (in_sa));
+    return TRUE;
+  }
+
+#ifdef HAVE_IPV6
+
+  if (endpoint->family == FLOW_IP_ADDR_IPV6)
+  {
+    struct sockaddr_in6 in6_sa = { 0 };
+
+    in6_sa.sin6_family = AF_INET6;
+    in6_sa.sin6_port   = g_htons (endpoint->port);
+    memcpy (&in6_sa.sin6_addr, endpoint->addr, 16);
+    memcpy (dest_sa, &in6_sa, sizeof (in6_sa));
+    return TRUE;
+  }
+
+#endif
+
+  return FALSE;
+}
+
+gboolean
+flow_ip_endpoint_set_sockaddr (FlowIPEndpoint *endpoint, FlowSockaddr *sa)
+{
+  FlowAddrFamily family;
+
+  g_return_val_if_fail (endpoint != NULL, FALSE);
+  g_return_val_if_fail (sa != NULL, FALSE);
+
+  memset (endpoint, 0, sizeof (FlowIPEndpoint));
+
+  family = flow_sockaddr_get_family (sa);
+
+  if (family == FLOW_ADDR_FAMILY_IPV4)
+    endpoint->family = FLOW_IP_ADDR_IPV4;
+  else if (family == FLOW_ADDR_FAMILY_IPV6)
+    endpoint->family = FLOW_IP_ADDR_IPV6;
+  else
+    return FALSE;
+
+  memcpy (endpoint->addr, flow_sockaddr_get_addr (sa), flow_sockaddr_get_addr_len (sa));
+  endpoint->port = g_ntohs (flow_sockaddr_get_port (sa));
+
+  return TRUE;
+}
+
 void
 flow_close_file_fd (gint fd)
 {
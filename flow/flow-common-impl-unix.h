@@ -74,6 +74,7 @@
 
 #include <glib.h>
 #include <flow-ip-service.h>
+#include <flow-ip-endpoint.h>
 
 #define FLOW_WAKEUP_PIPE_INVALID { { -1, -1 } }
 
@@ -130,6 +131,9 @@ gboolean          flow_ip_addr_set_sockaddr      (FlowIPAddr *ip_addr, FlowSocka
 gboolean          flow_ip_service_get_sockaddr   (FlowIPService *ip_service, FlowSockaddr *dest_sa, gint addr_index) G_GNUC_INTERNAL;
 gboolean          flow_ip_service_set_sockaddr   (FlowIPService *ip_service, FlowSockaddr *sa) G_GNUC_INTERNAL;
 
+gboolean          flow_ip_endpoint_get_sockaddr  (const FlowIPEndpoint *endpoint, FlowSockaddr *dest_sa) G_GNUC_INTERNAL;
+gboolean          flow_ip_endpoint_set_sockaddr  (FlowIPEndpoint *endpoint, FlowSockaddr *sa) G_GNUC_INTERNAL;
+
 void              flow_close_socket_fd           (gint fd) G_GNUC_INTERNAL;
 void              flow_close_file_fd             (gint fd) G_GNUC_INTERNAL;
 void              flow_close_pipe_fd             (gint fd) G_GNUC_INTERNAL;
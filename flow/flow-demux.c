@@ -26,9 +26,21 @@
 #include "flow-util.h"
 #include "flow-gobject-util.h"
 
+/* Channel IDs are looked up in a direct-indexed table as long as they're
+ * reasonably dense, i.e. below this limit or twice the number of channels,
+ * whichever is higher. Sparse IDs fall back to a hash table. */
+#define DENSE_CHANNEL_ID_MIN_LIMIT 256
+
+/* Max number of consecutive broadcast packets to collect before pushing */
+#define BROADCAST_BATCH_MAX 32
+
 struct _FlowDemuxPrivate
 {
   FlowInputPad *current_output_pad;
+  guint current_channel_id;
+  gboolean have_current_channel;
+  guint n_channels;
+  GPtrArray *pads_by_dense_channel_id;
   GHashTable *pads_by_channel_id;
 };
 
@@ -60,6 +72,9 @@ flow_demux_init (FlowDemux *demux)
   FlowDemuxPrivate *priv = demux->priv;
 
   priv->current_output_pad = NULL;
+  priv->have_current_channel = FALSE;
+  priv->n_channels = 0;
+  priv->pads_by_dense_channel_id = g_ptr_array_new ();
   priv->pads_by_channel_id = g_hash_table_new (g_direct_hash, g_direct_equal);
 }
 
@@ -78,9 +93,84 @@ flow_demux_finalize (FlowDemux *demux)
 {
   FlowDemuxPrivate *priv = demux->priv;
   
+  g_ptr_array_free (priv->pads_by_dense_channel_id, TRUE);
   g_hash_table_destroy (priv->pads_by_channel_id);
 }
 
+static inline FlowInputPad *
+lookup_channel (FlowDemuxPrivate *priv, guint channel_id)
+{
+  if G_LIKELY (channel_id < priv->pads_by_dense_channel_id->len)
+    return g_ptr_array_index (priv->pads_by_dense_channel_id, channel_id);
+
+  if (g_hash_table_size (priv->pads_by_channel_id) == 0)
+    return NULL;
+
+  return g_hash_table_lookup (priv->pads_by_channel_id, GUINT_TO_POINTER (channel_id));
+}
+
+static void
+grow_dense_table (FlowDemuxPrivate *priv, guint min_len, guint max_len)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  guint len;
+
+  for (len = MAX (priv->pads_by_dense_channel_id->len, 16); len < min_len; len *= 2)
+    ;
+
+  len = MIN (len, max_len);
+  g_ptr_array_set_size (priv->pads_by_dense_channel_id, len);
+
+  /* Move sparse entries that are now covered by the table */
+
+  g_hash_table_iter_init (&iter, priv->pads_by_channel_id);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+  {
+    guint channel_id = GPOINTER_TO_UINT (key);
+
+    if (channel_id < len)
+    {
+      g_ptr_array_index (priv->pads_by_dense_channel_id, channel_id) = value;
+      g_hash_table_iter_remove (&iter);
+    }
+  }
+}
+
+static void
+push_broadcast_batch (FlowElement *element, FlowPacket **batch, guint n_packets)
+{
+  FlowPad *last_pad = NULL;
+  guint i, j;
+
+  /* Push the whole batch to one pad at a time. The last pad gets the
+   * references we're holding. */
+
+  for (i = 0; i < element->output_pads->len; i++)
+  {
+    FlowPad *pad = g_ptr_array_index (element->output_pads, i);
+
+    if (!pad)
+      continue;
+
+    if (last_pad)
+    {
+      for (j = 0; j < n_packets; j++)
+        flow_pad_push (last_pad, flow_packet_ref (batch [j]));
+    }
+
+    last_pad = pad;
+  }
+
+  for (j = 0; j < n_packets; j++)
+  {
+    if (last_pad)
+      flow_pad_push (last_pad, batch [j]);
+    else
+      flow_packet_unref (batch [j]);
+  }
+}
+
 /* Public API */
 
 /**
@@ -107,7 +197,23 @@ flow_demux_add_channel (FlowDemux *demux, guint channel_id)
   priv = (FlowDemuxPrivate *) demux->priv;
 
   pad = flow_splitter_add_output_pad (FLOW_SPLITTER (demux));
-  g_hash_table_insert (priv->pads_by_channel_id, GUINT_TO_POINTER (channel_id), pad);
+  priv->n_channels++;
+
+  if (channel_id >= priv->pads_by_dense_channel_id->len)
+  {
+    guint max_len = MAX (DENSE_CHANNEL_ID_MIN_LIMIT, priv->n_channels * 2);
+
+    if (channel_id < max_len)
+      grow_dense_table (priv, channel_id + 1, max_len);
+  }
+
+  if (channel_id < priv->pads_by_dense_channel_id->len)
+    g_ptr_array_index (priv->pads_by_dense_channel_id, channel_id) = pad;
+  else
+    g_hash_table_insert (priv->pads_by_channel_id, GUINT_TO_POINTER (channel_id), pad);
+
+  /* The current channel may have been remapped */
+  priv->have_current_channel = FALSE;
   
   return pad;
 }
@@ -119,6 +225,8 @@ flow_demux_process_input (FlowElement *element, FlowPad *input_pad)
   FlowDemux *demux = FLOW_DEMUX (element);
   FlowDemuxPrivate *priv = demux->priv;
   FlowPacketQueue *packet_queue = flow_pad_get_packet_queue (input_pad);
+  FlowPacket *batch [BROADCAST_BATCH_MAX];
+  guint n_batched = 0;
   FlowPacket *packet;
   
   while ((packet = flow_packet_queue_pop_packet (packet_queue)) != NULL)
@@ -134,31 +242,43 @@ flow_demux_process_input (FlowElement *element, FlowPad *input_pad)
       {
         FlowMuxEvent *event = FLOW_MUX_EVENT (object);
         guint channel_id = flow_mux_event_get_channel_id (event);
-        priv->current_output_pad = g_hash_table_lookup (priv->pads_by_channel_id,
-                                                        GUINT_TO_POINTER (channel_id));
+
+        if (!priv->have_current_channel || channel_id != priv->current_channel_id)
+        {
+          priv->current_output_pad = lookup_channel (priv, channel_id);
+          priv->current_channel_id = channel_id;
+          priv->have_current_channel = TRUE;
+        }
+
         flow_packet_unref (packet);
       }
       else
       {
-        int i;
-        
-        /* broadcast packet */
-        for (i = 1; i < element->output_pads->len; i++)
+        /* Broadcast packet; collect consecutive ones and push them in one go */
+        batch [n_batched++] = packet;
+
+        if (n_batched == BROADCAST_BATCH_MAX)
         {
-          FlowPad *pad = g_ptr_array_index (element->output_pads, i);
-          flow_pad_push (pad, flow_packet_ref (packet));
+          push_broadcast_batch (element, batch, n_batched);
+          n_batched = 0;
         }
-        if (element->output_pads->len > 0)
-          flow_pad_push (g_ptr_array_index (element->output_pads, 0), packet);
       }
     }
     else /* Buffer */
     {
+      if (n_batched > 0)
+      {
+        push_broadcast_batch (element, batch, n_batched);
+        n_batched = 0;
+      }
+
       if (priv->current_output_pad == NULL)
         flow_packet_unref (packet);
       else
         flow_pad_push (FLOW_PAD (priv->current_output_pad), packet);
     }
   }
-}
 
+  if (n_batched > 0)
+    push_broadcast_batch (element, batch, n_batched);
+}
@@ -59,3 +59,9 @@ flow_ssh_domain_quark (void)
 {
   return g_quark_from_static_string (FLOW_SSH_DOMAIN);
 }
+
+GQuark
+flow_tls_domain_quark (void)
+{
+  return g_quark_from_static_string (FLOW_TLS_DOMAIN);
+}
@@ -35,6 +35,7 @@ G_BEGIN_DECLS
 #define FLOW_SOCKET_DOMAIN "flow-socket"
 #define FLOW_LOOKUP_DOMAIN "flow-lookup"
 #define FLOW_SSH_DOMAIN    "flow-ssh"
+#define FLOW_TLS_DOMAIN    "flow-tls"
 
 #define FLOW_STREAM_DOMAIN_QUARK flow_stream_domain_quark ()
 #define FLOW_FILE_DOMAIN_QUARK   flow_file_domain_quark ()
@@ -42,6 +43,7 @@ G_BEGIN_DECLS
 #define FLOW_SOCKET_DOMAIN_QUARK flow_socket_domain_quark ()
 #define FLOW_LOOKUP_DOMAIN_QUARK flow_lookup_domain_quark ()
 #define FLOW_SSH_DOMAIN_QUARK    flow_ssh_domain_quark ()
+#define FLOW_TLS_DOMAIN_QUARK    flow_tls_domain_quark ()
 
 typedef enum
 {
@@ -97,7 +99,9 @@ typedef enum
   FLOW_SOCKET_CONNECTION_RESET,
   FLOW_SOCKET_NETWORK_UNREACHABLE,
   FLOW_SOCKET_ACCEPT_ERROR,
-  FLOW_SOCKET_OVERSIZED_PACKET
+  FLOW_SOCKET_OVERSIZED_PACKET,
+  FLOW_SOCKET_OPTIONS_SET,
+  FLOW_SOCKET_OPTIONS_FAILED
 }
 FlowSocketEventCode;
 
@@ -116,12 +120,19 @@ typedef enum
 }
 FlowSshEventCode;
 
+typedef enum
+{
+  FLOW_TLS_BAD_CREDENTIALS
+}
+FlowTlsEventCode;
+
 GQuark flow_stream_domain_quark (void);
 GQuark flow_file_domain_quark   (void);
 GQuark flow_exec_domain_quark   (void);
 GQuark flow_socket_domain_quark (void);
 GQuark flow_lookup_domain_quark (void);
 GQuark flow_ssh_domain_quark    (void);
+GQuark flow_tls_domain_quark    (void);
 
 G_END_DECLS
 
@@ -0,0 +1,295 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* flow-ip-endpoint.c - Compact IP address and port value.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+
+#include "config.h"
+
+#include <string.h>
+#include "flow-ip-endpoint.h"
+
+static gint
+get_addr_len (FlowIPAddrFamily family)
+{
+  return family == FLOW_IP_ADDR_IPV6 ? 16 : 4;
+}
+
+/**
+ * flow_ip_endpoint_clear:
+ * @endpoint: A #FlowIPEndpoint.
+ *
+ * Resets @endpoint to an invalid address with port 0.
+ **/
+void
+flow_ip_endpoint_clear (FlowIPEndpoint *endpoint)
+{
+  g_return_if_fail (endpoint != NULL);
+
+  memset (endpoint, 0, sizeof (FlowIPEndpoint));
+}
+
+/**
+ * flow_ip_endpoint_set_ip_addr:
+ * @endpoint: A #FlowIPEndpoint.
+ * @ip_addr:  A #FlowIPAddr.
+ * @port:     A port number.
+ *
+ * Sets @endpoint to the address in @ip_addr and the given port.
+ *
+ * Return value: %TRUE if @ip_addr is a valid address.
+ **/
+gboolean
+flow_ip_endpoint_set_ip_addr (FlowIPEndpoint *endpoint, FlowIPAddr *ip_addr, gint port)
+{
+  g_return_val_if_fail (endpoint != NULL, FALSE);
+  g_return_val_if_fail (FLOW_IS_IP_ADDR (ip_addr), FALSE);
+
+  memset (endpoint, 0, sizeof (FlowIPEndpoint));
+
+  if (!flow_ip_addr_is_valid (ip_addr))
+    return FALSE;
+
+  /* Unused bytes are zero in FlowIPAddr too */
+
+  memcpy (endpoint->addr, ip_addr->addr, 16);
+  endpoint->family = ip_addr->family;
+  endpoint->port   = port;
+
+  return TRUE;
+}
+
+/**
+ * flow_ip_endpoint_set_ip_service:
+ * @endpoint:   A #FlowIPEndpoint.
+ * @ip_service: A #FlowIPService.
+ *
+ * Sets @endpoint to the first address and the port of @ip_service.
+ *
+ * Return value: %TRUE if @ip_service has a valid address.
+ **/
+gboolean
+flow_ip_endpoint_set_ip_service (FlowIPEndpoint *endpoint, FlowIPService *ip_service)
+{
+  FlowIPAddr *ip_addr;
+  gboolean    result;
+
+  g_return_val_if_fail (endpoint != NULL, FALSE);
+  g_return_val_if_fail (FLOW_IS_IP_SERVICE (ip_service), FALSE);
+
+  ip_addr = flow_ip_service_get_nth_address (ip_service, 0);
+  if (!ip_addr)
+  {
+    memset (endpoint, 0, sizeof (FlowIPEndpoint));
+    return FALSE;
+  }
+
+  result = flow_ip_endpoint_set_ip_addr (endpoint, ip_addr, flow_ip_service_get_port (ip_service));
+  g_object_unref (ip_addr);
+
+  return result;
+}
+
+/**
+ * flow_ip_endpoint_to_ip_addr:
+ * @endpoint: A #FlowIPEndpoint.
+ *
+ * Creates a #FlowIPAddr holding the address of @endpoint.
+ *
+ * Return value: A new #FlowIPAddr.
+ **/
+FlowIPAddr *
+flow_ip_endpoint_to_ip_addr (const FlowIPEndpoint *endpoint)
+{
+  FlowIPAddr *ip_addr;
+
+  g_return_val_if_fail (endpoint != NULL, NULL);
+
+  ip_addr = flow_ip_addr_new ();
+
+  if (endpoint->family != FLOW_IP_ADDR_INVALID)
+    flow_ip_addr_set_raw (ip_addr, endpoint->addr, get_addr_len (endpoint->family));
+
+  return ip_addr;
+}
+
+/**
+ * flow_ip_endpoint_to_ip_service:
+ * @endpoint: A #FlowIPEndpoint.
+ *
+ * Creates a #FlowIPService holding the address and port of @endpoint.
+ *
+ * Return value: A new #FlowIPService.
+ **/
+FlowIPService *
+flow_ip_endpoint_to_ip_service (const FlowIPEndpoint *endpoint)
+{
+  FlowIPService *ip_service;
+
+  g_return_val_if_fail (endpoint != NULL, NULL);
+
+  ip_service = flow_ip_service_new ();
+
+  if (endpoint->family != FLOW_IP_ADDR_INVALID)
+  {
+    FlowIPAddr *ip_addr;
+
+    ip_addr = flow_ip_endpoint_to_ip_addr (endpoint);
+    flow_ip_service_add_address (ip_service, ip_addr);
+    g_object_unref (ip_addr);
+  }
+
+  flow_ip_service_set_port (ip_service, endpoint->port);
+
+  return ip_service;
+}
+
+FlowIPAddrFamily
+flow_ip_endpoint_get_family (const FlowIPEndpoint *endpoint)
+{
+  g_return_val_if_fail (endpoint != NULL, FLOW_IP_ADDR_INVALID);
+
+  return endpoint->family;
+}
+
+gint
+flow_ip_endpoint_get_port (const FlowIPEndpoint *endpoint)
+{
+  g_return_val_if_fail (endpoint != NULL, 0);
+
+  return endpoint->port;
+}
+
+/**
+ * flow_ip_endpoint_get_string:
+ * @endpoint: A #FlowIPEndpoint.
+ *
+ * Formats @endpoint as "address:port", with IPv6 addresses in brackets.
+ *
+ * Return value: A newly allocated string, or %NULL if @endpoint is invalid.
+ **/
+gchar *
+flow_ip_endpoint_get_string (const FlowIPEndpoint *endpoint)
+{
+  FlowIPAddr *ip_addr;
+  gchar      *addr_str;
+  gchar      *str;
+
+  g_return_val_if_fail (endpoint != NULL, NULL);
+
+  if (endpoint->family == FLOW_IP_ADDR_INVALID)
+    return NULL;
+
+  ip_addr  = flow_ip_endpoint_to_ip_addr (endpoint);
+  addr_str = flow_ip_addr_get_string (ip_addr);
+  g_object_unref (ip_addr);
+
+  if (endpoint->family == FLOW_IP_ADDR_IPV6)
+    str = g_strdup_printf ("[%s]:%d", addr_str, endpoint->port);
+  else
+    str = g_strdup_printf ("%s:%d", addr_str, endpoint->port);
+
+  g_free (addr_str);
+  return str;
+}
+
+/**
+ * flow_ip_endpoint_hash:
+ * @endpoint: A #FlowIPEndpoint.
+ *
+ * Hashes the address, family and port of @endpoint. Suitable for use
+ * with #GHashTable together with flow_ip_endpoint_equal ().
+ *
+ * Return value: A hash value.
+ **/
+guint
+flow_ip_endpoint_hash (gconstpointer endpoint)
+{
+  const FlowIPEndpoint *ep = endpoint;
+  guint32               words [4];
+  guint32               h;
+  gint                  i;
+
+  memcpy (words, ep->addr, 16);
+
+  h = ((guint32) ep->family << 16) ^ ep->port;
+
+  for (i = 0; i < 4; i++)
+  {
+    h ^= words [i];
+    h *= 0x9e3779b1;
+    h ^= h >> 15;
+  }
+
+  return h;
+}
+
+gboolean
+flow_ip_endpoint_equal (gconstpointer endpoint_a, gconstpointer endpoint_b)
+{
+  return memcmp (endpoint_a, endpoint_b, sizeof (FlowIPEndpoint)) == 0 ? TRUE : FALSE;
+}
+
+/**
+ * flow_ip_endpoint_compare:
+ * @endpoint_a: A #FlowIPEndpoint.
+ * @endpoint_b: A #FlowIPEndpoint.
+ *
+ * Orders endpoints by family, then address, then port.
+ *
+ * Return value: Negative, zero or positive, as for strcmp ().
+ **/
+gint
+flow_ip_endpoint_compare (gconstpointer endpoint_a, gconstpointer endpoint_b)
+{
+  const FlowIPEndpoint *a = endpoint_a;
+  const FlowIPEndpoint *b = endpoint_b;
+  gint                  result;
+
+  if (a->family != b->family)
+    return a->family < b->family ? -1 : 1;
+
+  result = memcmp (a->addr, b->addr, 16);
+  if (result != 0)
+    return result;
+
+  if (a->port != b->port)
+    return a->port < b->port ? -1 : 1;
+
+  return 0;
+}
+
+/**
+ * flow_ip_endpoint_addr_equal:
+ * @endpoint_a: A #FlowIPEndpoint.
+ * @endpoint_b: A #FlowIPEndpoint.
+ *
+ * Compares the addresses of two endpoints, ignoring their ports.
+ *
+ * Return value: %TRUE if the addresses are the same.
+ **/
+gboolean
+flow_ip_endpoint_addr_equal (const FlowIPEndpoint *endpoint_a, const FlowIPEndpoint *endpoint_b)
+{
+  return (endpoint_a->family == endpoint_b->family &&
+          !memcmp (endpoint_a->addr, endpoint_b->addr, 16)) ? TRUE : FALSE;
+}
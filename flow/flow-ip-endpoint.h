@@ -0,0 +1,66 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* flow-ip-endpoint.h - Compact IP address and port value.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+
+#ifndef _FLOW_IP_ENDPOINT_H
+#define _FLOW_IP_ENDPOINT_H
+
+#include <flow/flow-ip-addr.h>
+#include <flow/flow-ip-service.h>
+
+G_BEGIN_DECLS
+
+/* A plain value that can be copied, compared and hashed without
+ * allocating. Use it as a hash table key or to track peers on hot paths,
+ * and convert to FlowIPAddr or FlowIPService at API boundaries. */
+
+typedef struct
+{
+  guint8  addr [16];  /* Network byte order; IPv4 uses the first 4 bytes */
+  guint8  family;     /* FlowIPAddrFamily */
+  guint8  reserved;   /* Always zero */
+  guint16 port;       /* Host byte order */
+}
+FlowIPEndpoint;
+
+void              flow_ip_endpoint_clear           (FlowIPEndpoint *endpoint);
+
+gboolean          flow_ip_endpoint_set_ip_addr     (FlowIPEndpoint *endpoint, FlowIPAddr *ip_addr, gint port);
+gboolean          flow_ip_endpoint_set_ip_service  (FlowIPEndpoint *endpoint, FlowIPService *ip_service);
+
+FlowIPAddr       *flow_ip_endpoint_to_ip_addr      (const FlowIPEndpoint *endpoint);
+FlowIPService    *flow_ip_endpoint_to_ip_service   (const FlowIPEndpoint *endpoint);
+
+FlowIPAddrFamily  flow_ip_endpoint_get_family      (const FlowIPEndpoint *endpoint);
+gint              flow_ip_endpoint_get_port        (const FlowIPEndpoint *endpoint);
+gchar            *flow_ip_endpoint_get_string      (const FlowIPEndpoint *endpoint);
+
+guint             flow_ip_endpoint_hash            (gconstpointer endpoint);
+gboolean          flow_ip_endpoint_equal           (gconstpointer endpoint_a, gconstpointer endpoint_b);
+gint              flow_ip_endpoint_compare         (gconstpointer endpoint_a, gconstpointer endpoint_b);
+gboolean          flow_ip_endpoint_addr_equal      (const FlowIPEndpoint *endpoint_a, const FlowIPEndpoint *endpoint_b);
+
+G_END_DECLS
+
+#endif /* _FLOW_IP_ENDPOINT_H */
@@ -68,6 +68,54 @@ eai_to_gerror (gint eai)
   return g_error_new_literal (FLOW_LOOKUP_DOMAIN_QUARK, event_code, gai_strerror (eai));
 }
 
+static void
+init_addrinfo_hints (struct addrinfo *hints)
+{
+  memset (hints, 0, sizeof (struct addrinfo));
+  hints->ai_socktype = SOCK_STREAM;
+  hints->ai_family   = AF_UNSPEC;
+#ifdef AI_ADDRCONFIG
+  hints->ai_flags    = AI_ADDRCONFIG;
+#else
+  hints->ai_flags    = 0;
+#endif
+}
+
+static GList *
+addr_list_from_addrinfo (const gchar *name, struct addrinfo *res)
+{
+  GList           *addr_list = NULL;
+  struct addrinfo *i;
+
+  for (i = res; i != NULL; i = i->ai_next)
+  {
+    FlowIPAddr     *ip_addr;
+    FlowAddrFamily  family;
+
+    family = flow_addr_family_from_af (i->ai_family);
+
+    if (family != FLOW_ADDR_FAMILY_IPV4 &&
+        family != FLOW_ADDR_FAMILY_IPV6)
+    {
+      DEBUG (g_print (G_STRLOC ": [%s] Got non-IP addr.\n", name));
+      continue;
+    }
+
+    ip_addr = flow_ip_addr_new ();
+
+    if (!flow_ip_addr_set_sockaddr (ip_addr, (FlowSockaddr *) i->ai_addr))
+    {
+      DEBUG (g_print (G_STRLOC ": [%s] Couldn't set sockaddr.\n", name));
+      g_object_unref (ip_addr);
+      continue;
+    }
+
+    addr_list = g_list_prepend (addr_list, ip_addr);
+  }
+
+  return addr_list;
+}
+
 static GList *
 flow_ip_resolver_impl_lookup_by_name (const gchar *name, GError **error)
 {
@@ -77,14 +125,7 @@ flow_ip_resolver_impl_lookup_by_name (const gchar *name, GError **error)
   gint             attempts  = 0;
   gint             rv;
 
-  memset (&hints, 0, sizeof (struct addrinfo));
-  hints.ai_socktype = SOCK_STREAM;
-  hints.ai_family   = AF_UNSPEC;
-#ifdef AI_ADDRCONFIG
-  hints.ai_flags    = AI_ADDRCONFIG;
-#else
-  hints.ai_flags    = 0;
-#endif
+  init_addrinfo_hints (&hints);
 
   do
   {
@@ -95,33 +136,7 @@ flow_ip_resolver_impl_lookup_by_name (const gchar *name, GError **error)
 
   if (rv == 0)
   {
-    struct addrinfo *i;
-
-    for (i = res; i != NULL; i = i->ai_next)
-    {
-      FlowIPAddr     *ip_addr;
-      FlowAddrFamily  family;
-
-      family = flow_addr_family_from_af (i->ai_family);
-
-      if (family != FLOW_ADDR_FAMILY_IPV4 &&
-          family != FLOW_ADDR_FAMILY_IPV6)
-      {
-        DEBUG (g_print (G_STRLOC ": [%s] Got non-IP addr.\n", name));
-        continue;
-      }
-
-      ip_addr = flow_ip_addr_new ();
-
-      if (!flow_ip_addr_set_sockaddr (ip_addr, (FlowSockaddr *) i->ai_addr))
-      {
-        DEBUG (g_print (G_STRLOC ": [%s] Couldn't set sockaddr.\n", name));
-        g_object_unref (ip_addr);
-        continue;
-      }
-
-      addr_list = g_list_prepend (addr_list, ip_addr);
-    }
+    addr_list = addr_list_from_addrinfo (name, res);
   }
   else
   {
@@ -305,3 +320,158 @@ flow_ip_resolver_impl_lookup_by_addr (FlowIPAddr *ip_addr, GError **error)
 }
 
 #endif
+
+#ifdef HAVE_GETADDRINFO_A
+
+/* Resolves names with up to max_in_flight getaddrinfo_a () requests
+ * outstanding at any time. A new request is submitted as soon as one
+ * completes, so the total time is bounded by the slowest names rather than
+ * the sum of all of them. */
+static void
+flow_ip_resolver_impl_lookup_by_names (gchar **names, guint n_names, guint max_in_flight,
+                                       GList **results, GError **errors)
+{
+  struct addrinfo   hints;
+  struct gaicb     *reqs;
+  struct gaicb    **window;
+  guint            *attempts;
+  guint             n_window     = 0;
+  guint             next         = 0;
+  gint              queue_result = 0;
+
+  init_addrinfo_hints (&hints);
+
+  reqs     = g_new0 (struct gaicb, n_names);
+  window   = g_new (struct gaicb *, max_in_flight);
+  attempts = g_new0 (guint, n_names);
+
+  for ( ; ; )
+  {
+    guint first_new = n_window;
+    guint i;
+
+    /* Refill the window */
+
+    while (n_window < max_in_flight && next < n_names)
+    {
+      reqs [next].ar_name    = names [next];
+      reqs [next].ar_request = &hints;
+      window [n_window++] = &reqs [next++];
+    }
+
+    /* If some requests couldn't be queued, we find out below */
+
+    if (n_window > first_new)
+    {
+      queue_result = getaddrinfo_a (GAI_NOWAIT, &window [first_new], n_window - first_new, NULL);
+
+      if (queue_result != 0)
+      {
+        DEBUG (g_print (G_STRLOC ": Could not queue lookups: %s.\n", gai_strerror (queue_result)));
+      }
+    }
+
+    if (n_window == 0)
+      break;
+
+    gai_suspend ((const struct gaicb * const *) window, n_window, NULL);
+
+    /* Collect finished requests */
+
+    for (i = 0; i < n_window; )
+    {
+      struct gaicb *req = window [i];
+      guint         n   = req - reqs;
+      gint          rv;
+
+      rv = gai_error (req);
+      if (rv == EAI_INPROGRESS)
+      {
+        i++;
+        continue;
+      }
+
+      /* A request that was never queued looks like a success with no
+       * result. Report why queuing failed instead. */
+
+      if (rv == 0 && !req->ar_result)
+        rv = queue_result != 0 ? queue_result : EAI_SYSTEM;
+
+      if (rv == EAI_AGAIN && ++attempts [n] < MAX_LOOKUP_ATTEMPTS)
+      {
+        req->ar_result = NULL;
+        queue_result = getaddrinfo_a (GAI_NOWAIT, &window [i], 1, NULL);
+        i++;
+        continue;
+      }
+
+      if (rv == 0)
+      {
+        results [n] = addr_list_from_addrinfo (names [n], req->ar_result);
+      }
+      else
+      {
+        errors [n] = eai_to_gerror (rv);
+
+        DEBUG (g_print (G_STRLOC ": [%s] Lookup returned error %d - %s.\n", names [n], rv, gai_strerror (rv)));
+      }
+
+      if (req->ar_result)
+        freeaddrinfo (req->ar_result);
+
+      window [i] = window [--n_window];
+    }
+  }
+
+  g_free (attempts);
+  g_free (window);
+  g_free (reqs);
+}
+
+#else
+
+typedef struct
+{
+  gchar  **names;
+  GList  **results;
+  GError **errors;
+}
+NamesJob;
+
+static void
+lookup_nth_name (gpointer n_ptr, NamesJob *job)
+{
+  guint n = GPOINTER_TO_UINT (n_ptr) - 1;
+
+  job->results [n] = flow_ip_resolver_impl_lookup_by_name (job->names [n], &job->errors [n]);
+}
+
+/* Without getaddrinfo_a (), run the blocking lookups on a temporary pool
+ * of max_in_flight threads. */
+static void
+flow_ip_resolver_impl_lookup_by_names (gchar **names, guint n_names, guint max_in_flight,
+                                       GList **results, GError **errors)
+{
+  NamesJob     job;
+  GThreadPool *pool;
+  guint        i;
+
+  job.names   = names;
+  job.results = results;
+  job.errors  = errors;
+
+  pool = g_thread_pool_new ((GFunc) lookup_nth_name, &job, MIN (max_in_flight, n_names), FALSE, NULL);
+
+  for (i = 0; i < n_names; i++)
+  {
+    if (pool)
+      g_thread_pool_push (pool, GUINT_TO_POINTER (i + 1), NULL);
+    else
+      lookup_nth_name (GUINT_TO_POINTER (i + 1), &job);
+  }
+
+  if (pool)
+    g_thread_pool_free (pool, FALSE, TRUE);
+}
+
+#endif
@@ -22,6 +22,8 @@
  * Authors: Hans Petter Jansson <hpj@copyleft.no>
  */
 
+#define _GNU_SOURCE
+
 #include "config.h"
 
 #include <stdlib.h>
@@ -42,6 +44,15 @@
 
 #define ID_BITS 24
 
+/* Cache defaults. getaddrinfo () doesn't tell us the record TTLs, so
+ * we apply our own. */
+#define CACHE_SIZE_DEFAULT    256
+#define POSITIVE_TTL_DEFAULT  60
+#define NEGATIVE_TTL_DEFAULT  10
+
+/* Default limit on concurrent lookups in a batch */
+#define BATCH_IN_FLIGHT_DEFAULT 32
+
 /* --- FlowIPResolver private data --- */
 
 struct _FlowIPResolverPrivate
@@ -51,8 +62,48 @@ struct _FlowIPResolverPrivate
   GHashTable  *lookup_table;
 
   guint        next_lookup_id;
+
+  /* Forward lookup cache. Entries are keyed by lowercased name and kept
+   * in LRU order, most recent first. */
+
+  GHashTable  *cache_table;
+  GQueue       cache_lru;
+  guint        cache_size;
+  guint        positive_ttl;
+  guint        negative_ttl;
+
+  /* Forward lookups in progress, by lowercased name. Later requests for
+   * the same name wait for these instead of starting their own. */
+
+  GHashTable  *pending_table;
+
+  guint64      n_hits;
+  guint64      n_misses;
+  guint64      n_joined;
 };
 
+typedef struct
+{
+  gchar            *name;
+  GList            *results;               /* FlowIPAddr */
+  GError           *error;
+  gint64            expire_time;
+  GList            *lru_link;
+}
+CacheEntry;
+
+typedef struct
+{
+  gchar                 **names;           /* NULL-terminated */
+  guint                   n_names;
+  guint                   max_in_flight;
+  GList                 **results;         /* FlowIPAddr, one list per name */
+  GError                **errors;          /* One per name */
+  gboolean               *is_resolved;     /* TRUE if answered from cache */
+  FlowIPBatchLookupFunc  *user_func;
+}
+Batch;
+
 typedef struct
 {
   FlowIPResolver   *resolver;              /* Resolver we belong to */
@@ -61,6 +112,7 @@ typedef struct
   guint             is_reverse : 1;        /* TRUE if we're translating IP -> name */
   guint             is_running : 1;        /* TRUE if thread picked it up */
   guint             is_wanted  : 1;        /* TRUE unless cancelled */
+  guint             is_batch   : 1;        /* TRUE if arg is a (Batch *) */
 
   gpointer          arg;                   /* (gchar *), or (FlowIPAddr *) on reverse lookup */
   GList            *results;
@@ -69,6 +121,9 @@ typedef struct
   GMainContext     *dispatch_context;      /* Main context to dispatch result in */
   FlowIPLookupFunc *user_func;             /* Callback */
   gpointer          user_data;             /* Callback data */
+
+  gchar            *cache_key;             /* Set on forward lookups that went to a thread */
+  GSList           *followers;             /* Lookups of the same name waiting on us */
 }
 Lookup;
 
@@ -76,6 +131,8 @@ Lookup;
 
 static GList *flow_ip_resolver_impl_lookup_by_name (const gchar *name, GError **error);
 static GList *flow_ip_resolver_impl_lookup_by_addr (FlowIPAddr *ip_addr, GError **error);
+static void   flow_ip_resolver_impl_lookup_by_names (gchar **names, guint n_names, guint max_in_flight,
+                                                     GList **results, GError **errors);
 
 /* Select an implementation */
 #include "flow-ip-resolver-impl-unix.c"
@@ -104,6 +161,165 @@ free_deep_list (GList *list)
   g_list_free (list);
 }
 
+static GList *
+copy_object_list (GList *list)
+{
+  GList *l;
+
+  list = g_list_copy (list);
+
+  for (l = list; l; l = g_list_next (l))
+    g_object_ref (l->data);
+
+  return list;
+}
+
+/* --- Cache --- */
+
+/* Called with mutex held */
+static void
+cache_remove_entry (FlowIPResolver *resolver, CacheEntry *entry)
+{
+  FlowIPResolverPrivate *priv = resolver->priv;
+
+  g_hash_table_remove (priv->cache_table, entry->name);
+  g_queue_delete_link (&priv->cache_lru, entry->lru_link);
+
+  free_object_list (entry->results);
+  g_clear_error (&entry->error);
+  g_free (entry->name);
+  g_slice_free (CacheEntry, entry);
+}
+
+/* Called with mutex held */
+static void
+cache_trim (FlowIPResolver *resolver)
+{
+  FlowIPResolverPrivate *priv = resolver->priv;
+
+  while (priv->cache_lru.length > priv->cache_size)
+    cache_remove_entry (resolver, g_queue_peek_tail (&priv->cache_lru));
+}
+
+/* Called with mutex held. Returns TRUE if the name was found, and fills in
+ * copies of the results. */
+static gboolean
+cache_lookup (FlowIPResolver *resolver, const gchar *cache_key, GList **results_out, GError **error_out)
+{
+  FlowIPResolverPrivate *priv = resolver->priv;
+  CacheEntry            *entry;
+
+  entry = g_hash_table_lookup (priv->cache_table, cache_key);
+  if (!entry)
+    return FALSE;
+
+  if (g_get_monotonic_time () >= entry->expire_time)
+  {
+    cache_remove_entry (resolver, entry);
+    return FALSE;
+  }
+
+  /* Move to front of LRU */
+
+  g_queue_unlink (&priv->cache_lru, entry->lru_link);
+  g_queue_push_head_link (&priv->cache_lru, entry->lru_link);
+
+  *results_out = copy_object_list (entry->results);
+  *error_out   = entry->error ? g_error_copy (entry->error) : NULL;
+  return TRUE;
+}
+
+/* Called with mutex held */
+static void
+cache_store (FlowIPResolver *resolver, const gchar *cache_key, GList *results, GError *error)
+{
+  FlowIPResolverPrivate *priv = resolver->priv;
+  CacheEntry            *entry;
+  guint                  ttl;
+
+  if (error)
+  {
+    /* Temporary failures are worth retrying right away */
+
+    if (error->domain != FLOW_LOOKUP_DOMAIN_QUARK ||
+        error->code == FLOW_LOOKUP_TEMPORARY_SERVER_FAILURE)
+      return;
+
+    ttl = priv->negative_ttl;
+  }
+  else
+  {
+    ttl = priv->positive_ttl;
+  }
+
+  if (priv->cache_size == 0 || ttl == 0)
+    return;
+
+  entry = g_hash_table_lookup (priv->cache_table, cache_key);
+  if (entry)
+    cache_remove_entry (resolver, entry);
+
+  entry = g_slice_new (CacheEntry);
+  entry->name        = g_strdup (cache_key);
+  entry->results     = copy_object_list (results);
+  entry->error       = error ? g_error_copy (error) : NULL;
+  entry->expire_time = g_get_monotonic_time () + (gint64) ttl * G_USEC_PER_SEC;
+
+  g_queue_push_head (&priv->cache_lru, entry);
+  entry->lru_link = priv->cache_lru.head;
+  g_hash_table_insert (priv->cache_table, entry->name, entry);
+
+  cache_trim (resolver);
+}
+
+/* Called with mutex held */
+static void
+cache_clear (FlowIPResolver *resolver)
+{
+  FlowIPResolverPrivate *priv = resolver->priv;
+
+  while (priv->cache_lru.length > 0)
+    cache_remove_entry (resolver, g_queue_peek_head (&priv->cache_lru));
+}
+
+/* --- Lookups --- */
+
+static Batch *
+batch_new (const gchar * const *names, guint max_in_flight, FlowIPBatchLookupFunc *user_func)
+{
+  Batch *batch;
+
+  batch = g_slice_new (Batch);
+
+  batch->names         = g_strdupv ((gchar **) names);
+  batch->n_names       = g_strv_length (batch->names);
+  batch->max_in_flight = max_in_flight;
+  batch->results       = g_new0 (GList *, batch->n_names);
+  batch->errors        = g_new0 (GError *, batch->n_names);
+  batch->is_resolved   = g_new0 (gboolean, batch->n_names);
+  batch->user_func     = user_func;
+
+  return batch;
+}
+
+static void
+batch_free (Batch *batch)
+{
+  guint i;
+
+  for (i = 0; i < batch->n_names; i++)
+  {
+    free_object_list (batch->results [i]);
+    g_clear_error (&batch->errors [i]);
+  }
+
+  g_free (batch->results);
+  g_free (batch->errors);
+  g_free (batch->is_resolved);
+  g_strfreev (batch->names);
+  g_slice_free (Batch, batch);
+}
+
 static void
 destroy_lookup (Lookup *lookup)
 {
@@ -117,7 +333,11 @@ destroy_lookup (Lookup *lookup)
 
   /* Free memory */
 
-  if (lookup->is_reverse)
+  if (lookup->is_batch)
+  {
+    batch_free (lookup->arg);
+  }
+  else if (lookup->is_reverse)
   {
     g_object_unref (lookup->arg);
     free_deep_list (lookup->results);
@@ -129,6 +349,7 @@ destroy_lookup (Lookup *lookup)
   }
 
   g_clear_error (&lookup->error);
+  g_free (lookup->cache_key);
   g_free (lookup);
 }
 
@@ -152,7 +373,17 @@ dispatch_lookup (Lookup *lookup)
   g_object_ref (resolver);
   g_mutex_lock (&priv->mutex);
 
-  if (lookup->is_wanted)
+  if (lookup->is_wanted && lookup->is_batch)
+  {
+    Batch *batch = lookup->arg;
+
+    g_mutex_unlock (&priv->mutex);
+
+    batch->user_func (batch->names, batch->results, batch->errors, lookup->user_data);
+
+    g_mutex_lock (&priv->mutex);
+  }
+  else if (lookup->is_wanted)
   {
     gboolean  is_reverse;
     GList    *arg_list = NULL;
@@ -194,22 +425,179 @@ compare_ipv4_before_ipv6 (FlowIPAddr *addr_a, FlowIPAddr *addr_b)
   return 1;
 }
 
+/* Queues the result of a lookup for dispatch in its main context. Must be
+ * called without the mutex held, since dropping the context may destroy
+ * the lookup. */
+static void
+queue_dispatch (Lookup *lookup)
+{
+  GMainContext *dispatch_context = lookup->dispatch_context;
+
+  flow_idle_add_full (dispatch_context, G_PRIORITY_DEFAULT_IDLE,
+                      (GSourceFunc) dispatch_lookup, lookup,
+                      (GDestroyNotify) lock_and_destroy_lookup);
+
+  /* If dispatch_context's thread exited, the event will never be dispatched,
+   * so we release our ref here. The destroy notification will be called and
+   * the lookup's resources freed. */
+  g_main_context_unref (dispatch_context);
+}
+
+/* Called with mutex held. Caches the result of a forward lookup and hands
+ * copies to any lookups that were waiting for the same name. Returns the
+ * list of followers, which must be dispatched after releasing the mutex. */
+static GSList *
+finish_forward_lookup (FlowIPResolver *resolver, Lookup *lookup)
+{
+  FlowIPResolverPrivate *priv = resolver->priv;
+  GSList                *followers;
+  GSList                *l;
+
+  if (!lookup->cache_key)
+    return NULL;
+
+  if (g_hash_table_lookup (priv->pending_table, lookup->cache_key) == lookup)
+    g_hash_table_remove (priv->pending_table, lookup->cache_key);
+
+  if (lookup->is_running)
+    cache_store (resolver, lookup->cache_key, lookup->results, lookup->error);
+
+  followers = lookup->followers;
+  lookup->followers = NULL;
+
+  for (l = followers; l; l = g_slist_next (l))
+  {
+    Lookup *follower = l->data;
+
+    follower->results = copy_object_list (lookup->results);
+    follower->error   = lookup->error ? g_error_copy (lookup->error) : NULL;
+  }
+
+  return followers;
+}
+
+static void
+do_batch_lookup (Lookup *lookup, FlowIPResolver *resolver)
+{
+  FlowIPResolverPrivate  *priv  = resolver->priv;
+  Batch                  *batch = lookup->arg;
+  gchar                 **names;
+  GList                 **results;
+  GError                **errors;
+  guint                  *slot;
+  GHashTable             *unique;
+  guint                   n = 0;
+  guint                   i;
+
+  g_mutex_lock (&priv->mutex);
+
+  if (!lookup->is_wanted)
+  {
+    g_main_context_unref (lookup->dispatch_context);
+    destroy_lookup (lookup);
+    g_mutex_unlock (&priv->mutex);
+    return;
+  }
+
+  lookup->is_running = TRUE;
+  g_mutex_unlock (&priv->mutex);
+
+  /* Resolve the names that weren't in the cache, all in one go. Each name
+   * is looked up once, however many times it was asked for; slot maps
+   * batch entries to lookups. */
+
+  names   = g_new (gchar *, batch->n_names);
+  results = g_new0 (GList *, batch->n_names);
+  errors  = g_new0 (GError *, batch->n_names);
+  slot    = g_new (guint, batch->n_names);
+  unique  = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  for (i = 0; i < batch->n_names; i++)
+  {
+    gchar    *cache_key;
+    gpointer  n_ptr;
+
+    if (batch->is_resolved [i])
+      continue;
+
+    cache_key = g_ascii_strdown (batch->names [i], -1);
+
+    if (g_hash_table_lookup_extended (unique, cache_key, NULL, &n_ptr))
+    {
+      slot [i] = GPOINTER_TO_UINT (n_ptr);
+      g_free (cache_key);
+      continue;
+    }
+
+    g_hash_table_insert (unique, cache_key, GUINT_TO_POINTER (n));
+    names [n] = batch->names [i];
+    slot [i] = n++;
+  }
+
+  g_hash_table_destroy (unique);
+
+  flow_ip_resolver_impl_lookup_by_names (names, n, batch->max_in_flight, results, errors);
+
+  g_mutex_lock (&priv->mutex);
+
+  for (i = 0; i < n; i++)
+  {
+    gchar *cache_key = g_ascii_strdown (names [i], -1);
+
+    results [i] = g_list_sort (results [i], (GCompareFunc) compare_ipv4_before_ipv6);
+    cache_store (resolver, cache_key, results [i], errors [i]);
+    g_free (cache_key);
+  }
+
+  for (i = 0; i < batch->n_names; i++)
+  {
+    if (batch->is_resolved [i])
+      continue;
+
+    batch->results [i] = copy_object_list (results [slot [i]]);
+    batch->errors [i]  = errors [slot [i]] ? g_error_copy (errors [slot [i]]) : NULL;
+  }
+
+  g_mutex_unlock (&priv->mutex);
+
+  for (i = 0; i < n; i++)
+  {
+    free_object_list (results [i]);
+    g_clear_error (&errors [i]);
+  }
+
+  g_free (slot);
+  g_free (errors);
+  g_free (results);
+  g_free (names);
+
+  queue_dispatch (lookup);
+}
+
 static void
 do_lookup (Lookup *lookup, FlowIPResolver *resolver)
 {
   FlowIPResolverPrivate *priv = resolver->priv;
+  GSList                *followers;
+
+  if (lookup->is_batch)
+  {
+    do_batch_lookup (lookup, resolver);
+    return;
+  }
 
   g_mutex_lock (&priv->mutex);
 
-  if (lookup->is_wanted)
+  /* Run the lookup if anyone still wants the result, even if it's just
+   * other lookups that joined this one */
+
+  if (lookup->is_wanted || lookup->followers)
   {
-    GMainContext *dispatch_context;
     gboolean      is_reverse;
     gpointer      arg;
 
     lookup->is_running = TRUE;
 
-    dispatch_context = lookup->dispatch_context;
     is_reverse       = lookup->is_reverse;
     arg              = lookup->arg;
 
@@ -229,23 +617,52 @@ do_lookup (Lookup *lookup, FlowIPResolver *resolver)
       lookup->results = g_list_sort (lookup->results, (GCompareFunc) compare_ipv4_before_ipv6);
     }
 
-    flow_idle_add_full (dispatch_context, G_PRIORITY_DEFAULT_IDLE,
-                        (GSourceFunc) dispatch_lookup, lookup,
-                        (GDestroyNotify) lock_and_destroy_lookup);
+    g_mutex_lock (&priv->mutex);
+    followers = finish_forward_lookup (resolver, lookup);
+    g_mutex_unlock (&priv->mutex);
+
+    g_slist_foreach (followers, (GFunc) queue_dispatch, NULL);
+    g_slist_free (followers);
 
-    /* If dispatch_context's thread exited, the event will never be dispatched,
-     * so we release our ref here. The destroy notification will be called and
-     * the lookup's resources freed. */
-    g_main_context_unref (dispatch_context);
+    /* Still dispatched if it was cancelled meanwhile; dispatch_lookup ()
+     * checks is_wanted */
+    queue_dispatch (lookup);
   }
   else
   {
+    finish_forward_lookup (resolver, lookup);
     g_main_context_unref (lookup->dispatch_context);
     destroy_lookup (lookup);
     g_mutex_unlock (&priv->mutex);
   }
 }
 
+/* Called with mutex held */
+static guint
+register_lookup (FlowIPResolver *resolver, Lookup *lookup)
+{
+  FlowIPResolverPrivate *priv = resolver->priv;
+
+  /* Assign an ID that is not 0 and not in use */
+
+  for ( ; ; priv->next_lookup_id++)
+  {
+    priv->next_lookup_id %= (1 << ID_BITS);
+    if (!priv->next_lookup_id)
+      continue;
+
+    if (!g_hash_table_lookup (priv->lookup_table, GUINT_TO_POINTER (priv->next_lookup_id)))
+      break;
+  }
+
+  lookup->id = priv->next_lookup_id;
+
+  /* Insert in lookup table */
+  g_hash_table_insert (priv->lookup_table, GUINT_TO_POINTER (lookup->id), lookup);
+
+  return lookup->id;
+}
+
 static guint
 create_lookup (FlowIPResolver *resolver, gboolean is_reverse, gpointer arg,
                FlowIPLookupFunc *user_func, gpointer user_data)
@@ -269,22 +686,43 @@ create_lookup (FlowIPResolver *resolver, gboolean is_reverse, gpointer arg,
 
   g_mutex_lock (&priv->mutex);
 
-  /* Assign an ID that is not 0 and not in use */
+  id = register_lookup (resolver, lookup);
 
-  for ( ; ; priv->next_lookup_id++)
+  if (!is_reverse)
   {
-    priv->next_lookup_id %= (1 << ID_BITS);
-    if (!priv->next_lookup_id)
-      continue;
+    gchar  *cache_key = g_ascii_strdown (arg, -1);
+    Lookup *leader;
 
-    if (!g_hash_table_lookup (priv->lookup_table, GUINT_TO_POINTER (priv->next_lookup_id)))
-      break;
-  }
+    if (cache_lookup (resolver, cache_key, &lookup->results, &lookup->error))
+    {
+      /* Answer from cache. The callback is still invoked from the main
+       * loop, so callers see the same behavior either way. */
 
-  id = lookup->id = priv->next_lookup_id;
+      priv->n_hits++;
+      g_mutex_unlock (&priv->mutex);
 
-  /* Insert in lookup table */
-  g_hash_table_insert (priv->lookup_table, GUINT_TO_POINTER (id), lookup);
+      g_free (cache_key);
+      queue_dispatch (lookup);
+      return id;
+    }
+
+    leader = g_hash_table_lookup (priv->pending_table, cache_key);
+    if (leader)
+    {
+      /* Piggyback on the lookup that's already in progress */
+
+      priv->n_joined++;
+      leader->followers = g_slist_prepend (leader->followers, lookup);
+      g_mutex_unlock (&priv->mutex);
+
+      g_free (cache_key);
+      return id;
+    }
+
+    priv->n_misses++;
+    lookup->cache_key = cache_key;
+    g_hash_table_insert (priv->pending_table, cache_key, lookup);
+  }
 
   /* Queue request */
   g_thread_pool_push (priv->thread_pool, lookup, NULL);
@@ -294,9 +732,137 @@ create_lookup (FlowIPResolver *resolver, gboolean is_reverse, gpointer arg,
   return id;
 }
 
+static guint
+create_batch_lookup (FlowIPResolver *resolver, Batch *batch, gpointer user_data)
+{
+  FlowIPResolverPrivate *priv = resolver->priv;
+  Lookup                *lookup;
+  guint                  n_resolved = 0;
+  guint                  id;
+  guint                  i;
+
+  lookup = g_new0 (Lookup, 1);
+
+  lookup->resolver         = resolver;
+  lookup->is_batch         = TRUE;
+  lookup->is_wanted        = TRUE;
+  lookup->arg              = batch;
+  lookup->dispatch_context = g_main_context_ref (flow_get_main_context_for_current_thread ());
+  lookup->user_data        = user_data;
+
+  g_mutex_lock (&priv->mutex);
+
+  id = register_lookup (resolver, lookup);
+
+  /* Take what we can from the cache. Batches don't join lookups in
+   * progress; the remaining names are all resolved by one worker. */
+
+  for (i = 0; i < batch->n_names; i++)
+  {
+    gchar *cache_key = g_ascii_strdown (batch->names [i], -1);
+
+    if (cache_lookup (resolver, cache_key, &batch->results [i], &batch->errors [i]))
+    {
+      batch->is_resolved [i] = TRUE;
+      n_resolved++;
+    }
+
+    g_free (cache_key);
+  }
+
+  priv->n_hits   += n_resolved;
+  priv->n_misses += batch->n_names - n_resolved;
+
+  if (n_resolved == batch->n_names)
+  {
+    g_mutex_unlock (&priv->mutex);
+    queue_dispatch (lookup);
+    return id;
+  }
+
+  g_thread_pool_push (priv->thread_pool, lookup, NULL);
+
+  g_mutex_unlock (&priv->mutex);
+
+  return id;
+}
+
 /* --- FlowIPResolver properties --- */
 
+static guint
+flow_ip_resolver_get_cache_size_internal (FlowIPResolver *ip_resolver)
+{
+  FlowIPResolverPrivate *priv = ip_resolver->priv;
+
+  return priv->cache_size;
+}
+
+static void
+flow_ip_resolver_set_cache_size_internal (FlowIPResolver *ip_resolver, guint cache_size)
+{
+  FlowIPResolverPrivate *priv = ip_resolver->priv;
+
+  g_mutex_lock (&priv->mutex);
+  priv->cache_size = cache_size;
+  cache_trim (ip_resolver);
+  g_mutex_unlock (&priv->mutex);
+}
+
+static guint
+flow_ip_resolver_get_positive_ttl_internal (FlowIPResolver *ip_resolver)
+{
+  FlowIPResolverPrivate *priv = ip_resolver->priv;
+
+  return priv->positive_ttl;
+}
+
+static void
+flow_ip_resolver_set_positive_ttl_internal (FlowIPResolver *ip_resolver, guint positive_ttl)
+{
+  FlowIPResolverPrivate *priv = ip_resolver->priv;
+
+  g_mutex_lock (&priv->mutex);
+  priv->positive_ttl = positive_ttl;
+  g_mutex_unlock (&priv->mutex);
+}
+
+static guint
+flow_ip_resolver_get_negative_ttl_internal (FlowIPResolver *ip_resolver)
+{
+  FlowIPResolverPrivate *priv = ip_resolver->priv;
+
+  return priv->negative_ttl;
+}
+
+static void
+flow_ip_resolver_set_negative_ttl_internal (FlowIPResolver *ip_resolver, guint negative_ttl)
+{
+  FlowIPResolverPrivate *priv = ip_resolver->priv;
+
+  g_mutex_lock (&priv->mutex);
+  priv->negative_ttl = negative_ttl;
+  g_mutex_unlock (&priv->mutex);
+}
+
 FLOW_GOBJECT_PROPERTIES_BEGIN (flow_ip_resolver)
+FLOW_GOBJECT_PROPERTY_INT     (G_TYPE_UINT, "cache-size", "Cache size",
+                               "Maximum number of names to remember (0 disables caching)",
+                               G_PARAM_READWRITE,
+                               flow_ip_resolver_get_cache_size_internal,
+                               flow_ip_resolver_set_cache_size_internal,
+                               0, G_MAXUINT, CACHE_SIZE_DEFAULT)
+FLOW_GOBJECT_PROPERTY_INT     (G_TYPE_UINT, "positive-ttl", "Positive TTL",
+                               "Seconds to remember successful lookups",
+                               G_PARAM_READWRITE,
+                               flow_ip_resolver_get_positive_ttl_internal,
+                               flow_ip_resolver_set_positive_ttl_internal,
+                               0, G_MAXUINT, POSITIVE_TTL_DEFAULT)
+FLOW_GOBJECT_PROPERTY_INT     (G_TYPE_UINT, "negative-ttl", "Negative TTL",
+                               "Seconds to remember names that don't exist",
+                               G_PARAM_READWRITE,
+                               flow_ip_resolver_get_negative_ttl_internal,
+                               flow_ip_resolver_set_negative_ttl_internal,
+                               0, G_MAXUINT, NEGATIVE_TTL_DEFAULT)
 FLOW_GOBJECT_PROPERTIES_END   ()
 
 /* --- FlowIPResolver definition --- */
@@ -324,6 +890,14 @@ flow_ip_resolver_init (FlowIPResolver *ip_resolver)
 
   g_mutex_init (&priv->mutex);
   priv->lookup_table = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  priv->cache_table   = g_hash_table_new (g_str_hash, g_str_equal);
+  priv->pending_table = g_hash_table_new (g_str_hash, g_str_equal);
+  g_queue_init (&priv->cache_lru);
+
+  priv->cache_size   = CACHE_SIZE_DEFAULT;
+  priv->positive_ttl = POSITIVE_TTL_DEFAULT;
+  priv->negative_ttl = NEGATIVE_TTL_DEFAULT;
 }
 
 static void
@@ -346,6 +920,10 @@ flow_ip_resolver_finalize (FlowIPResolver *ip_resolver)
   g_thread_pool_free (priv->thread_pool,
                       TRUE /* immediate (ignore queue) */,
                       TRUE /* wait (for workers to finish) */);
+  cache_clear (ip_resolver);
+  g_hash_table_destroy (priv->cache_table);
+  g_hash_table_destroy (priv->pending_table);
+
   g_mutex_clear (&priv->mutex);
   g_hash_table_destroy (priv->lookup_table);
 }
@@ -390,6 +968,40 @@ flow_ip_resolver_resolve_ip_addr (FlowIPResolver *resolver, FlowIPAddr *addr,
   return create_lookup (resolver, TRUE, addr, func, data);
 }
 
+/**
+ * flow_ip_resolver_resolve_names:
+ * @resolver:      A #FlowIPResolver.
+ * @names:         A %NULL-terminated array of names to resolve.
+ * @max_in_flight: Maximum number of names to resolve concurrently, or 0 for
+ *                 the default.
+ * @func:          Function to call when all names have been resolved.
+ * @data:          User data for @func.
+ *
+ * Resolves a list of names concurrently, calling @func once in the current
+ * thread's main context when all of them are done. @func receives the names
+ * along with one address list and one error per name, in the same order.
+ * These belong to the resolver and are freed when @func returns.
+ *
+ * Names found in the cache are answered from it, and the results of the
+ * rest are added to it. The returned ID can be passed to
+ * flow_ip_resolver_cancel_resolution ().
+ *
+ * Return value: A lookup ID.
+ **/
+guint
+flow_ip_resolver_resolve_names (FlowIPResolver *resolver, const gchar * const *names, guint max_in_flight,
+                                FlowIPBatchLookupFunc *func, gpointer data)
+{
+  g_return_val_if_fail (FLOW_IS_IP_RESOLVER (resolver), 0);
+  g_return_val_if_fail (names != NULL, 0);
+  g_return_val_if_fail (func != NULL, 0);
+
+  if (max_in_flight == 0)
+    max_in_flight = BATCH_IN_FLIGHT_DEFAULT;
+
+  return create_batch_lookup (resolver, batch_new (names, max_in_flight, func), data);
+}
+
 void
 flow_ip_resolver_cancel_resolution (FlowIPResolver *resolver, guint lookup_id)
 {
@@ -409,3 +1021,50 @@ flow_ip_resolver_cancel_resolution (FlowIPResolver *resolver, guint lookup_id)
 
   g_mutex_unlock (&priv->mutex);
 }
+
+/**
+ * flow_ip_resolver_clear_cache:
+ * @resolver: A #FlowIPResolver.
+ *
+ * Forgets all cached lookup results, so subsequent requests go to the
+ * system resolver.
+ **/
+void
+flow_ip_resolver_clear_cache (FlowIPResolver *resolver)
+{
+  FlowIPResolverPrivate *priv;
+
+  g_return_if_fail (FLOW_IS_IP_RESOLVER (resolver));
+
+  priv = resolver->priv;
+
+  g_mutex_lock (&priv->mutex);
+  cache_clear (resolver);
+  g_mutex_unlock (&priv->mutex);
+}
+
+/**
+ * flow_ip_resolver_get_cache_stats:
+ * @resolver:  A #FlowIPResolver.
+ * @stats_out: Return location for the statistics.
+ *
+ * Gets counts of name lookups answered from the cache, sent to the system
+ * resolver, and merged into an identical lookup that was already in
+ * progress. Reverse lookups are not cached and not counted.
+ **/
+void
+flow_ip_resolver_get_cache_stats (FlowIPResolver *resolver, FlowIPResolverCacheStats *stats_out)
+{
+  FlowIPResolverPrivate *priv;
+
+  g_return_if_fail (FLOW_IS_IP_RESOLVER (resolver));
+  g_return_if_fail (stats_out != NULL);
+
+  priv = resolver->priv;
+
+  g_mutex_lock (&priv->mutex);
+  stats_out->hits   = priv->n_hits;
+  stats_out->misses = priv->n_misses;
+  stats_out->joined = priv->n_joined;
+  g_mutex_unlock (&priv->mutex);
+}
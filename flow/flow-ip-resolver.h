@@ -28,6 +28,15 @@
 #include <flow/flow-ip-addr.h>
 
 typedef void (FlowIPLookupFunc) (GList *addr_list, GList *name_list, GError *error, gpointer data);
+typedef void (FlowIPBatchLookupFunc) (gchar **names, GList **addr_lists, GError **errors, gpointer data);
+
+typedef struct
+{
+  guint64 hits;
+  guint64 misses;
+  guint64 joined;
+}
+FlowIPResolverCacheStats;
 
 #define FLOW_TYPE_IP_RESOLVER            (flow_ip_resolver_get_type ())
 #define FLOW_IP_RESOLVER(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), FLOW_TYPE_IP_RESOLVER, FlowIPResolver))
@@ -71,6 +80,12 @@ guint           flow_ip_resolver_resolve_name       (FlowIPResolver *resolver, c
                                                      FlowIPLookupFunc *func, gpointer data);
 guint           flow_ip_resolver_resolve_ip_addr    (FlowIPResolver *resolver, FlowIPAddr *addr,
                                                      FlowIPLookupFunc *func, gpointer data);
+guint           flow_ip_resolver_resolve_names      (FlowIPResolver *resolver, const gchar * const *names,
+                                                     guint max_in_flight,
+                                                     FlowIPBatchLookupFunc *func, gpointer data);
 void            flow_ip_resolver_cancel_resolution  (FlowIPResolver *resolver, guint lookup_id);
 
+void            flow_ip_resolver_clear_cache        (FlowIPResolver *resolver);
+void            flow_ip_resolver_get_cache_stats    (FlowIPResolver *resolver, FlowIPResolverCacheStats *stats_out);
+
 #endif /* _FLOW_IP_RESOLVER_H */
@@ -28,11 +28,21 @@
 #include "flow-gobject-util.h"
 #include "flow-util.h"
 
+/* Upper bound on cached channel switch packets, in case the peer uses
+ * lots of different channel IDs */
+#define MAX_CACHED_EVENT_PACKETS 4096
+
 struct _FlowMuxDeserializerPrivate
 {
   guint32 size_left;
   FlowMuxHeaderOps ops;
   gpointer ops_user_data;
+
+  /* Channel switch packets, keyed by channel ID. They are immutable, so
+   * we can push a new reference each time instead of constructing them. */
+  GHashTable *event_packets;
+  FlowPacket *last_event_packet;
+  guint last_channel_id;
 };
 
 FLOW_GOBJECT_PROPERTIES_BEGIN (flow_mux_deserializer)
@@ -41,6 +51,8 @@ FLOW_GOBJECT_PROPERTIES_END   ()
 FLOW_GOBJECT_MAKE_IMPL        (flow_mux_deserializer, FlowMuxDeserializer, FLOW_TYPE_SIMPLEX_ELEMENT, 0)
 
 static void flow_mux_deserializer_process_input (FlowElement *element, FlowPad *input_pad);
+static gboolean pop_header (FlowMuxDeserializer *deserializer, FlowPacketQueue *packet_queue,
+                            guchar *hdr_buffer, guint hdr_size, guint *channel_id, guint32 *size);
 
 
 
@@ -65,6 +77,9 @@ flow_mux_deserializer_init (FlowMuxDeserializer *mux_deserializer)
   priv->size_left = 0;
   priv->ops = flow_mux_serializer_default_ops;
   priv->ops_user_data = NULL;
+  priv->event_packets = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                               NULL, (GDestroyNotify) flow_packet_unref);
+  priv->last_event_packet = NULL;
 }
 
 static void
@@ -80,6 +95,71 @@ flow_mux_deserializer_dispose (FlowMuxDeserializer *deserializer)
 static void
 flow_mux_deserializer_finalize (FlowMuxDeserializer *deserializer)
 {
+  FlowMuxDeserializerPrivate *priv = deserializer->priv;
+
+  g_hash_table_destroy (priv->event_packets);
+}
+
+static FlowPacket *
+get_event_packet (FlowMuxDeserializer *deserializer, guint channel_id)
+{
+  FlowMuxDeserializerPrivate *priv = deserializer->priv;
+  FlowPacket *packet;
+
+  if (priv->last_event_packet && priv->last_channel_id == channel_id)
+    return flow_packet_ref (priv->last_event_packet);
+
+  packet = g_hash_table_lookup (priv->event_packets, GUINT_TO_POINTER (channel_id));
+  if (!packet)
+  {
+    if (g_hash_table_size (priv->event_packets) >= MAX_CACHED_EVENT_PACKETS)
+      g_hash_table_remove_all (priv->event_packets);
+
+    packet = flow_packet_new_take_object (flow_mux_event_new (channel_id), 0);
+    g_hash_table_insert (priv->event_packets, GUINT_TO_POINTER (channel_id), packet);
+  }
+
+  priv->last_event_packet = packet;
+  priv->last_channel_id = channel_id;
+
+  return flow_packet_ref (packet);
+}
+
+static gboolean
+pop_header (FlowMuxDeserializer *deserializer, FlowPacketQueue *packet_queue,
+            guchar *hdr_buffer, guint hdr_size, guint *channel_id, guint32 *size)
+{
+  FlowMuxDeserializerPrivate *priv = deserializer->priv;
+  const guchar *p = hdr_buffer;
+  gint len;
+
+  if (!priv->ops.unpack)
+  {
+    if (!flow_packet_queue_pop_bytes_exact (packet_queue, hdr_buffer, hdr_size))
+      return FALSE;
+
+    priv->ops.parse (hdr_buffer, channel_id, size, priv->ops_user_data);
+    return TRUE;
+  }
+
+  len = flow_packet_queue_peek_bytes (packet_queue, hdr_buffer, hdr_size);
+
+  if (!priv->ops.unpack (&p, hdr_buffer + len, channel_id, size, priv->ops_user_data))
+  {
+    if (len == hdr_size)
+    {
+      /* We have the maximum header length and still can't parse it. Drop
+       * the data up to the next object rather than stalling forever. */
+      g_warning ("FlowMuxDeserializer: Corrupt variable-length header; dropping data.");
+      flow_packet_queue_pop_bytes (packet_queue, NULL,
+                                   flow_packet_queue_get_length_data_bytes (packet_queue));
+    }
+
+    return FALSE;
+  }
+
+  flow_packet_queue_pop_bytes (packet_queue, NULL, p - hdr_buffer);
+  return TRUE;
 }
 
 static void
@@ -88,12 +168,13 @@ flow_mux_deserializer_process_input (FlowElement *element, FlowPad *input_pad)
   FlowMuxDeserializerPrivate *priv = FLOW_MUX_DESERIALIZER (element)->priv;
   FlowPacketQueue *packet_queue = flow_pad_get_packet_queue (input_pad);
   FlowPacket *packet;
+  gint offset;
   guint hdr_size = priv->ops.get_size (priv->ops_user_data);
   guchar *hdr_buffer = g_alloca (hdr_size);
   FlowPad *output_pad = FLOW_PAD (flow_simplex_element_get_output_pad (
                                           FLOW_SIMPLEX_ELEMENT (element)));
   
-  while (flow_packet_queue_peek_packet (packet_queue, &packet, NULL))
+  while (flow_packet_queue_peek_packet (packet_queue, &packet, &offset))
   {
     gboolean forward_packet = TRUE;
     
@@ -101,7 +182,7 @@ flow_mux_deserializer_process_input (FlowElement *element, FlowPad *input_pad)
     {
       forward_packet = FALSE;
     }
-    else if (packet->format == FLOW_PACKET_FORMAT_OBJECT)
+    else if (flow_packet_get_format (packet) == FLOW_PACKET_FORMAT_OBJECT)
     {
       /* Pass on */
     }
@@ -110,30 +191,37 @@ flow_mux_deserializer_process_input (FlowElement *element, FlowPad *input_pad)
       guint channel_id;
       guint32 size;
       
-      if (!flow_packet_queue_pop_bytes_exact (packet_queue, hdr_buffer, hdr_size))
+      if (!pop_header (FLOW_MUX_DESERIALIZER (element), packet_queue, hdr_buffer, hdr_size,
+                       &channel_id, &size))
         break;
 
-      priv->ops.parse (hdr_buffer, &channel_id, &size, priv->ops_user_data);
       priv->size_left = size;
 
-      flow_pad_push (output_pad,
-                     flow_packet_new_take_object (flow_mux_event_new (channel_id), 0));
+      flow_pad_push (output_pad, get_event_packet (FLOW_MUX_DESERIALIZER (element), channel_id));
       continue; /* no packet to forward or free */
     }
     else
     {
-      if (priv->size_left < packet->size)
+      guint available = flow_packet_get_size (packet) - offset;
+
+      if (priv->size_left < available)
       {
-        guchar *buffer = g_malloc (priv->size_left);
-        gboolean success = flow_packet_queue_pop_bytes_exact (packet_queue, buffer, priv->size_left);
-        g_assert (success);
-        packet = flow_packet_new (FLOW_PACKET_FORMAT_BUFFER, buffer, priv->size_left);
+        /* The frame ends inside this packet. Forward a slice referencing
+         * the frame's part of the data, and leave the rest queued. */
+
+        FlowPacket *slice = flow_packet_new_slice (packet, offset, priv->size_left);
+
+        flow_packet_queue_pop_bytes (packet_queue, NULL, priv->size_left);
         priv->size_left = 0;
+
+        flow_pad_push (output_pad, slice);
+        continue;
       }
-      else
-        priv->size_left -= packet->size;
+
+      priv->size_left -= available;
     }
     
+    /* If we're at an offset into the packet, this returns a slice */
     packet = flow_packet_queue_pop_packet (packet_queue);
     if (forward_packet)
       flow_pad_push (output_pad, packet);
@@ -150,6 +238,32 @@ flow_mux_deserializer_new (void)
   return g_object_new (FLOW_TYPE_MUX_DESERIALIZER, NULL);
 }
 
+/**
+ * flow_mux_deserializer_set_header_ops:
+ * @deserializer:  A #FlowMuxDeserializer.
+ * @ops:           Header operations to use, e.g. &flow_mux_serializer_varint_ops.
+ * @ops_user_data: User data to pass to the operations.
+ *
+ * Selects the frame header format expected by @deserializer. It must match
+ * the format used by the peer's #FlowMuxSerializer.
+ **/
+void
+flow_mux_deserializer_set_header_ops (FlowMuxDeserializer *deserializer,
+                                      const FlowMuxHeaderOps *ops,
+                                      gpointer ops_user_data)
+{
+  FlowMuxDeserializerPrivate *priv;
+
+  g_return_if_fail (FLOW_IS_MUX_DESERIALIZER (deserializer));
+  g_return_if_fail (ops != NULL);
+  g_return_if_fail (ops->get_size != NULL);
+  g_return_if_fail (ops->unpack != NULL || ops->parse != NULL);
+
+  priv = deserializer->priv;
+  priv->ops = *ops;
+  priv->ops_user_data = ops_user_data;
+}
+
 gint
 flow_mux_deserializer_get_header_size (FlowMuxDeserializer *deserializer)
 {
@@ -166,5 +280,34 @@ flow_mux_deserializer_unparse_header (FlowMuxDeserializer *deserializer,
 {
   FlowMuxDeserializerPrivate *priv = deserializer->priv;
 
+  g_return_if_fail (priv->ops.unparse != NULL);
+
   priv->ops.unparse (hdr, channel_id, size, priv->ops_user_data);
 }
+
+/**
+ * flow_mux_deserializer_pack_header:
+ * @deserializer: A #FlowMuxDeserializer.
+ * @hdr:          Buffer of at least flow_mux_deserializer_get_header_size () bytes.
+ * @channel_id:   Channel ID to write.
+ * @size:         Payload size to write.
+ *
+ * Writes a frame header in the format @deserializer expects. Works for both
+ * fixed and variable-length formats.
+ *
+ * Return value: Number of bytes written to @hdr.
+ **/
+guint
+flow_mux_deserializer_pack_header (FlowMuxDeserializer *deserializer,
+                                   guint8 *hdr,
+                                   guint channel_id,
+                                   guint32 size)
+{
+  FlowMuxDeserializerPrivate *priv = deserializer->priv;
+
+  if (priv->ops.pack)
+    return priv->ops.pack (channel_id, size, hdr, priv->ops_user_data) - hdr;
+
+  priv->ops.unparse (hdr, channel_id, size, priv->ops_user_data);
+  return priv->ops.get_size (priv->ops_user_data);
+}
@@ -24,6 +24,7 @@
 #define _FLOW_MUX_DESERIALIZER_H
 
 #include <flow/flow-simplex-element.h>
+#include <flow/flow-mux-serializer.h>
 
 G_BEGIN_DECLS
 
@@ -58,9 +59,15 @@ GType flow_mux_deserializer_get_type (void) G_GNUC_CONST;
 
 FlowMuxDeserializer        *flow_mux_deserializer_new (void);
 
+void flow_mux_deserializer_set_header_ops (FlowMuxDeserializer *deserializer,
+                                           const FlowMuxHeaderOps *ops,
+                                           gpointer ops_user_data);
+
 gint flow_mux_deserializer_get_header_size (FlowMuxDeserializer *deserializer);
 void flow_mux_deserializer_unparse_header (FlowMuxDeserializer *deserializer,
                                            guint8 *hdr, guint channel_id, guint32 size);
+guint flow_mux_deserializer_pack_header (FlowMuxDeserializer *deserializer,
+                                         guint8 *hdr, guint channel_id, guint32 size);
 
 G_END_DECLS
 
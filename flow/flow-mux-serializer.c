@@ -25,6 +25,7 @@
 #include "flow-mux-serializer.h"
 #include "flow-mux-event.h"
 #include "flow-gobject-util.h"
+#include "flow-pack-util.h"
 #include "flow-util.h"
 
 struct _FlowMuxSerializerPrivate
@@ -44,12 +45,20 @@ FLOW_GOBJECT_MAKE_IMPL        (flow_mux_serializer, FlowMuxSerializer, FLOW_TYPE
 
 #define FLOW_MUX_HEADER_SIZE 6
 
+/* Two varints of at most 5 bytes each */
+#define FLOW_MUX_VARINT_HEADER_MAX_SIZE 10
+
 static void flow_mux_serializer_process_input (FlowElement *element, FlowPad *input_pad);
 static guint flow_mux_hdr_get_size (gpointer user_data);
 static void flow_mux_hdr_parse (const guint8 *buffer, guint *channel_id, guint32 *size,
                                 gpointer user_data);
 static void flow_mux_hdr_unparse (guint8 *buffer, guint channel_id, guint32 size,
                                   gpointer user_data);
+static guint flow_mux_varint_hdr_get_size (gpointer user_data);
+static guint8 *flow_mux_varint_hdr_pack (guint channel_id, guint32 size, guint8 *buf_out,
+                                         gpointer user_data);
+static gboolean flow_mux_varint_hdr_unpack (const guint8 **buf_ptr_inout, const guint8 *buf_end,
+                                            guint *channel_id, guint32 *size, gpointer user_data);
 
 
 
@@ -72,6 +81,12 @@ FlowMuxHeaderOps flow_mux_serializer_default_ops = {
   .unparse = flow_mux_hdr_unparse
 };
 
+FlowMuxHeaderOps flow_mux_serializer_varint_ops = {
+  .get_size = flow_mux_varint_hdr_get_size,
+  .pack = flow_mux_varint_hdr_pack,
+  .unpack = flow_mux_varint_hdr_unpack
+};
+
 static void
 flow_mux_serializer_init (FlowMuxSerializer *mux_serializer)
 {
@@ -115,7 +130,12 @@ flow_mux_serializer_flush (FlowMuxSerializer *serializer)
     guint8 *buffer = g_alloca (size);
     FlowPacket *header;
 
-    priv->ops.unparse (buffer, priv->channel_id, priv->packets_size, priv->ops_user_data);
+    if (priv->ops.pack)
+      size = priv->ops.pack (priv->channel_id, priv->packets_size, buffer,
+                             priv->ops_user_data) - buffer;
+    else
+      priv->ops.unparse (buffer, priv->channel_id, priv->packets_size, priv->ops_user_data);
+
     header = flow_packet_new (FLOW_PACKET_FORMAT_BUFFER, buffer, size);
     flow_pad_push (output_pad, header);
   }
@@ -211,6 +231,40 @@ flow_mux_hdr_unparse (guint8 *buffer, guint channel_id, guint32 size,
   *((guint32 *)data) = g_htonl(size); data += 4;
 }
 
+/* The varint header stores the channel ID and payload size as LEB128
+ * varints. It costs 2 bytes for small frames on low channels, and allows
+ * the full 32-bit channel ID range. */
+
+static guint
+flow_mux_varint_hdr_get_size (gpointer user_data)
+{
+  return FLOW_MUX_VARINT_HEADER_MAX_SIZE;
+}
+
+static guint8 *
+flow_mux_varint_hdr_pack (guint channel_id, guint32 size, guint8 *buf_out,
+                          gpointer user_data)
+{
+  buf_out = flow_pack_uint32 (channel_id, buf_out);
+  return flow_pack_uint32 (size, buf_out);
+}
+
+static gboolean
+flow_mux_varint_hdr_unpack (const guint8 **buf_ptr_inout, const guint8 *buf_end,
+                            guint *channel_id, guint32 *size, gpointer user_data)
+{
+  const guint8 *p = *buf_ptr_inout;
+  guint32 id;
+
+  if (!flow_unpack_uint32 (&p, buf_end, &id) ||
+      !flow_unpack_uint32 (&p, buf_end, size))
+    return FALSE;
+
+  *channel_id = id;
+  *buf_ptr_inout = p;
+  return TRUE;
+}
+
 /* Public API */
 
 FlowMuxSerializer *
@@ -219,6 +273,42 @@ flow_mux_serializer_new (void)
   return g_object_new (FLOW_TYPE_MUX_SERIALIZER, NULL);
 }
 
+/**
+ * flow_mux_serializer_set_header_ops:
+ * @serializer:    A #FlowMuxSerializer.
+ * @ops:           Header operations to use, e.g. &flow_mux_serializer_varint_ops.
+ * @ops_user_data: User data to pass to the operations.
+ *
+ * Selects the frame header format written by @serializer. The peer's
+ * #FlowMuxDeserializer must be set up with the same operations. This should
+ * be done before any data is processed.
+ **/
+void
+flow_mux_serializer_set_header_ops (FlowMuxSerializer *serializer,
+                                    const FlowMuxHeaderOps *ops,
+                                    gpointer ops_user_data)
+{
+  FlowMuxSerializerPrivate *priv;
+
+  g_return_if_fail (FLOW_IS_MUX_SERIALIZER (serializer));
+  g_return_if_fail (ops != NULL);
+  g_return_if_fail (ops->get_size != NULL);
+  g_return_if_fail (ops->pack != NULL || ops->unparse != NULL);
+
+  priv = serializer->priv;
+  priv->ops = *ops;
+  priv->ops_user_data = ops_user_data;
+}
+
+/**
+ * flow_mux_serializer_get_header_size:
+ * @serializer: A #FlowMuxSerializer.
+ *
+ * Gets the size of a frame header. For variable-length header formats,
+ * this is the maximum size.
+ *
+ * Return value: Header size in bytes.
+ **/
 guint
 flow_mux_serializer_get_header_size (FlowMuxSerializer *serializer)
 {
@@ -235,5 +325,42 @@ flow_mux_serializer_parse_header (FlowMuxSerializer *serializer,
 {
   FlowMuxSerializerPrivate *priv = serializer->priv;
 
+  g_return_if_fail (priv->ops.parse != NULL);
+
   priv->ops.parse (hdr, channel_id, size, priv->ops_user_data);
 }
+
+/**
+ * flow_mux_serializer_unpack_header:
+ * @serializer:    A #FlowMuxSerializer.
+ * @hdr_ptr_inout: Pointer to the start of the header. Advanced past the
+ *                 header on success.
+ * @hdr_end:       End of the available data.
+ * @channel_id:    Return location for the channel ID.
+ * @size:          Return location for the payload size.
+ *
+ * Parses a frame header in either a fixed or a variable-length format.
+ *
+ * Return value: %TRUE if a complete header was available, %FALSE otherwise.
+ **/
+gboolean
+flow_mux_serializer_unpack_header (FlowMuxSerializer *serializer,
+                                   const guint8 **hdr_ptr_inout,
+                                   const guint8 *hdr_end,
+                                   guint *channel_id,
+                                   guint32 *size)
+{
+  FlowMuxSerializerPrivate *priv = serializer->priv;
+  guint hdr_size;
+
+  if (priv->ops.unpack)
+    return priv->ops.unpack (hdr_ptr_inout, hdr_end, channel_id, size, priv->ops_user_data);
+
+  hdr_size = priv->ops.get_size (priv->ops_user_data);
+  if (hdr_end < *hdr_ptr_inout + hdr_size)
+    return FALSE;
+
+  priv->ops.parse (*hdr_ptr_inout, channel_id, size, priv->ops_user_data);
+  *hdr_ptr_inout += hdr_size;
+  return TRUE;
+}
@@ -60,19 +60,35 @@ struct _FlowMuxHeaderOps
   guint (*get_size) (gpointer user_data);
   void  (*parse)    (const guint8 *buffer, guint *channel_id, guint32 *size, gpointer user_data);
   void  (*unparse)  (guint8 *buffer, guint channel_id, guint32 size, gpointer user_data);
+
+  /* Optional; set these for variable-length headers. If present, they are used
+   * instead of parse/unparse, and get_size returns the maximum header size. */
+  guint8  *(*pack)   (guint channel_id, guint32 size, guint8 *buf_out, gpointer user_data);
+  gboolean (*unpack) (const guint8 **buf_ptr_inout, const guint8 *buf_end,
+                      guint *channel_id, guint32 *size, gpointer user_data);
 };
 
 GType flow_mux_serializer_get_type (void) G_GNUC_CONST;
 
 FlowMuxSerializer        *flow_mux_serializer_new (void);
 
+void  flow_mux_serializer_set_header_ops (FlowMuxSerializer *serializer,
+                                          const FlowMuxHeaderOps *ops,
+                                          gpointer ops_user_data);
+
 guint flow_mux_serializer_get_header_size (FlowMuxSerializer *serializer);
 void  flow_mux_serializer_parse_header (FlowMuxSerializer *serializer,
                                         const guint8 *hdr,
                                         guint *channel_id,
                                         guint32 *size);
+gboolean flow_mux_serializer_unpack_header (FlowMuxSerializer *serializer,
+                                            const guint8 **hdr_ptr_inout,
+                                            const guint8 *hdr_end,
+                                            guint *channel_id,
+                                            guint32 *size);
 
 extern FlowMuxHeaderOps flow_mux_serializer_default_ops;
+extern FlowMuxHeaderOps flow_mux_serializer_varint_ops;
 
 G_END_DECLS
 
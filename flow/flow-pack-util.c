@@ -27,6 +27,10 @@
 #include <string.h>
 #include "flow-pack-util.h"
 
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
 guchar *
 flow_pack_uint64 (guint64 n_in, guchar *buf_out)
 {
@@ -162,10 +166,21 @@ gboolean
 flow_unpack_uint32_from_iter (FlowPacketByteIter *iter, guint32 *n_out)
 {
   guchar buf [5];
-  const guchar *p = buf;
+  const guchar *span;
+  const guchar *p;
   gint len;
 
+  span = flow_packet_byte_iter_peek_span (iter, &len);
+  p = span;
+
+  if (span && flow_unpack_uint32 (&p, span + len, n_out))
+  {
+    flow_packet_byte_iter_advance (iter, p - span);
+    return TRUE;
+  }
+
   len = flow_packet_byte_iter_peek (iter, buf, 5);
+  p = buf;
 
   if (flow_unpack_uint32 (&p, buf + len, n_out))
   {
@@ -180,10 +195,21 @@ gboolean
 flow_unpack_uint64_from_iter (FlowPacketByteIter *iter, guint64 *n_out)
 {
   guchar buf [9];
-  const guchar *p = buf;
+  const guchar *span;
+  const guchar *p;
   gint len;
 
+  span = flow_packet_byte_iter_peek_span (iter, &len);
+  p = span;
+
+  if (span && flow_unpack_uint64 (&p, span + len, n_out))
+  {
+    flow_packet_byte_iter_advance (iter, p - span);
+    return TRUE;
+  }
+
   len = flow_packet_byte_iter_peek (iter, buf, 9);
+  p = buf;
 
   if (flow_unpack_uint64 (&p, buf + len, n_out))
   {
@@ -198,11 +224,22 @@ gboolean
 flow_unpack_string_from_iter (FlowPacketByteIter *iter, gchar **string_out)
 {
   guchar buf [5];
-  const guchar *p = buf;
+  const guchar *span;
+  const guchar *p;
   gint len;
   guint32 n;
 
+  span = flow_packet_byte_iter_peek_span (iter, &len);
+  p = span;
+
+  if (span && flow_unpack_string (&p, span + len, string_out))
+  {
+    flow_packet_byte_iter_advance (iter, p - span);
+    return TRUE;
+  }
+
   len = flow_packet_byte_iter_peek (iter, buf, 5);
+  p = buf;
 
   if (!flow_unpack_uint32 (&p, buf + len, &n))
     return FALSE;
@@ -219,3 +256,345 @@ flow_unpack_string_from_iter (FlowPacketByteIter *iter, gchar **string_out)
 
   return TRUE;
 }
+
+/* --- Bulk codecs --- */
+
+/* Counts the run of single-byte varints (bytes without the continuation
+ * bit) at the start of a buffer. This is the common case for arrays of
+ * small integers, and can be checked many bytes at a time. */
+static inline guint
+count_single_byte_run (const guchar *buf_in, guint len)
+{
+  guint n = 0;
+
+#ifdef __SSE2__
+  while (n + 16 <= len)
+  {
+    __m128i v = _mm_loadu_si128 ((const __m128i *) (buf_in + n));
+
+    if (_mm_movemask_epi8 (v))
+      break;
+
+    n += 16;
+  }
+#endif
+
+  while (n + 8 <= len)
+  {
+    guint64 w;
+
+    memcpy (&w, buf_in + n, 8);
+    if (w & G_GUINT64_CONSTANT (0x8080808080808080))
+      break;
+
+    n += 8;
+  }
+
+  while (n < len && !(buf_in [n] & 0x80))
+    n++;
+
+  return n;
+}
+
+/**
+ * flow_pack_uint32_array:
+ * @n_in:       Array of integers to pack.
+ * @n_elements: Number of elements in @n_in.
+ * @buf_out:    Buffer to pack into. Must hold at least
+ *              @n_elements * %FLOW_PACK_UINT32_MAX_SIZE bytes.
+ *
+ * Packs an array of integers in the format used by flow_pack_uint32 ().
+ *
+ * Return value: A pointer to the byte following the packed data.
+ **/
+guchar *
+flow_pack_uint32_array (const guint32 *n_in, guint n_elements, guchar *buf_out)
+{
+  guint i;
+
+  for (i = 0; i < n_elements; i++)
+  {
+    guint32 n = n_in [i];
+
+    if (n < 0x80)
+    {
+      *(buf_out++) = n;
+      continue;
+    }
+
+    buf_out = flow_pack_uint32 (n, buf_out);
+  }
+
+  return buf_out;
+}
+
+/**
+ * flow_unpack_uint32_array:
+ * @buf_ptr_inout: Pointer to the data to unpack. Advanced past the consumed data.
+ * @buf_end:       End of the data.
+ * @n_out:         Array to store unpacked integers in.
+ * @n_max:         Maximum number of integers to unpack.
+ *
+ * Unpacks up to @n_max integers packed with flow_pack_uint32 () or
+ * flow_pack_uint32_array (). Stops early if the data runs out or an
+ * integer is malformed.
+ *
+ * Return value: The number of integers unpacked.
+ **/
+guint
+flow_unpack_uint32_array (const guchar **buf_ptr_inout, const guchar *buf_end,
+                          guint32 *n_out, guint n_max)
+{
+  const guchar *buf_in = *buf_ptr_inout;
+  guint i = 0;
+
+  while (i < n_max && buf_in < buf_end)
+  {
+    if (!(*buf_in & 0x80))
+    {
+      guint run = count_single_byte_run (buf_in, MIN ((gsize) (buf_end - buf_in), n_max - i));
+      guint j;
+
+      for (j = 0; j < run; j++)
+        n_out [i + j] = buf_in [j];
+
+      i += run;
+      buf_in += run;
+      continue;
+    }
+
+    if (!flow_unpack_uint32 (&buf_in, buf_end, &n_out [i]))
+      break;
+
+    i++;
+  }
+
+  *buf_ptr_inout = buf_in;
+  return i;
+}
+
+/**
+ * flow_pack_uint64_array:
+ * @n_in:       Array of integers to pack.
+ * @n_elements: Number of elements in @n_in.
+ * @buf_out:    Buffer to pack into. Must hold at least
+ *              @n_elements * %FLOW_PACK_UINT64_MAX_SIZE bytes.
+ *
+ * Packs an array of integers in the format used by flow_pack_uint64 ().
+ *
+ * Return value: A pointer to the byte following the packed data.
+ **/
+guchar *
+flow_pack_uint64_array (const guint64 *n_in, guint n_elements, guchar *buf_out)
+{
+  guint i;
+
+  for (i = 0; i < n_elements; i++)
+  {
+    guint64 n = n_in [i];
+
+    if (n < 0x80)
+    {
+      *(buf_out++) = n;
+      continue;
+    }
+
+    buf_out = flow_pack_uint64 (n, buf_out);
+  }
+
+  return buf_out;
+}
+
+/**
+ * flow_unpack_uint64_array:
+ * @buf_ptr_inout: Pointer to the data to unpack. Advanced past the consumed data.
+ * @buf_end:       End of the data.
+ * @n_out:         Array to store unpacked integers in.
+ * @n_max:         Maximum number of integers to unpack.
+ *
+ * Unpacks up to @n_max integers packed with flow_pack_uint64 () or
+ * flow_pack_uint64_array (). Stops early if the data runs out.
+ *
+ * Return value: The number of integers unpacked.
+ **/
+guint
+flow_unpack_uint64_array (const guchar **buf_ptr_inout, const guchar *buf_end,
+                          guint64 *n_out, guint n_max)
+{
+  const guchar *buf_in = *buf_ptr_inout;
+  guint i = 0;
+
+  while (i < n_max && buf_in < buf_end)
+  {
+    if (!(*buf_in & 0x80))
+    {
+      guint run = count_single_byte_run (buf_in, MIN ((gsize) (buf_end - buf_in), n_max - i));
+      guint j;
+
+      for (j = 0; j < run; j++)
+        n_out [i + j] = buf_in [j];
+
+      i += run;
+      buf_in += run;
+      continue;
+    }
+
+    if (!flow_unpack_uint64 (&buf_in, buf_end, &n_out [i]))
+      break;
+
+    i++;
+  }
+
+  *buf_ptr_inout = buf_in;
+  return i;
+}
+
+/**
+ * flow_pack_string_array:
+ * @strings_in: Array of nul-terminated strings to pack.
+ * @n_elements: Number of elements in @strings_in.
+ * @buf_out:    Buffer to pack into.
+ *
+ * Packs an array of strings in the format used by flow_pack_string ().
+ *
+ * Return value: A pointer to the byte following the packed data.
+ **/
+guchar *
+flow_pack_string_array (const gchar * const *strings_in, guint n_elements, guchar *buf_out)
+{
+  guint i;
+
+  for (i = 0; i < n_elements; i++)
+    buf_out = flow_pack_string (strings_in [i], buf_out);
+
+  return buf_out;
+}
+
+/**
+ * flow_unpack_string_array:
+ * @buf_ptr_inout: Pointer to the data to unpack. Advanced past the consumed data.
+ * @buf_end:       End of the data.
+ * @strings_out:   Array to store newly allocated strings in.
+ * @n_max:         Maximum number of strings to unpack.
+ *
+ * Unpacks up to @n_max strings packed with flow_pack_string () or
+ * flow_pack_string_array ().
+ *
+ * Return value: The number of strings unpacked.
+ **/
+guint
+flow_unpack_string_array (const guchar **buf_ptr_inout, const guchar *buf_end,
+                          gchar **strings_out, guint n_max)
+{
+  guint i;
+
+  for (i = 0; i < n_max; i++)
+  {
+    if (!flow_unpack_string (buf_ptr_inout, buf_end, &strings_out [i]))
+      break;
+  }
+
+  return i;
+}
+
+/**
+ * flow_unpack_uint32_array_from_iter:
+ * @iter:  A #FlowPacketByteIter.
+ * @n_out: Array to store unpacked integers in.
+ * @n_max: Maximum number of integers to unpack.
+ *
+ * Like flow_unpack_uint32_array (), but reads from a packet queue. Data
+ * that is contiguous in a packet is decoded in place; only integers
+ * straddling packet boundaries are copied.
+ *
+ * Return value: The number of integers unpacked.
+ **/
+guint
+flow_unpack_uint32_array_from_iter (FlowPacketByteIter *iter, guint32 *n_out, guint n_max)
+{
+  guint i = 0;
+
+  while (i < n_max)
+  {
+    const guchar *span;
+    const guchar *p;
+    gint len;
+
+    span = flow_packet_byte_iter_peek_span (iter, &len);
+    if (!span)
+      break;
+
+    p = span;
+    i += flow_unpack_uint32_array (&p, span + len, n_out + i, n_max - i);
+    flow_packet_byte_iter_advance (iter, p - span);
+
+    if (i == n_max || !flow_unpack_uint32_from_iter (iter, &n_out [i]))
+      break;
+
+    i++;
+  }
+
+  return i;
+}
+
+/**
+ * flow_unpack_uint64_array_from_iter:
+ * @iter:  A #FlowPacketByteIter.
+ * @n_out: Array to store unpacked integers in.
+ * @n_max: Maximum number of integers to unpack.
+ *
+ * Like flow_unpack_uint64_array (), but reads from a packet queue.
+ *
+ * Return value: The number of integers unpacked.
+ **/
+guint
+flow_unpack_uint64_array_from_iter (FlowPacketByteIter *iter, guint64 *n_out, guint n_max)
+{
+  guint i = 0;
+
+  while (i < n_max)
+  {
+    const guchar *span;
+    const guchar *p;
+    gint len;
+
+    span = flow_packet_byte_iter_peek_span (iter, &len);
+    if (!span)
+      break;
+
+    p = span;
+    i += flow_unpack_uint64_array (&p, span + len, n_out + i, n_max - i);
+    flow_packet_byte_iter_advance (iter, p - span);
+
+    if (i == n_max || !flow_unpack_uint64_from_iter (iter, &n_out [i]))
+      break;
+
+    i++;
+  }
+
+  return i;
+}
+
+/**
+ * flow_unpack_string_array_from_iter:
+ * @iter:        A #FlowPacketByteIter.
+ * @strings_out: Array to store newly allocated strings in.
+ * @n_max:       Maximum number of strings to unpack.
+ *
+ * Like flow_unpack_string_array (), but reads from a packet queue.
+ *
+ * Return value: The number of strings unpacked.
+ **/
+guint
+flow_unpack_string_array_from_iter (FlowPacketByteIter *iter, gchar **strings_out, guint n_max)
+{
+  guint i;
+
+  for (i = 0; i < n_max; i++)
+  {
+    if (!flow_unpack_string_from_iter (iter, &strings_out [i]))
+      break;
+  }
+
+  return i;
+}
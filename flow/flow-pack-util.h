@@ -41,6 +41,25 @@ gboolean        flow_unpack_uint32_from_iter (FlowPacketByteIter *iter, guint32
 gboolean        flow_unpack_uint64_from_iter (FlowPacketByteIter *iter, guint64 *n_out);
 gboolean        flow_unpack_string_from_iter (FlowPacketByteIter *iter, gchar **string_out);
 
+/* Worst-case packed sizes, for sizing buffers passed to the array packers */
+
+#define FLOW_PACK_UINT32_MAX_SIZE 5
+#define FLOW_PACK_UINT64_MAX_SIZE 10
+
+guchar         *flow_pack_uint32_array (const guint32 *n_in, guint n_elements, guchar *buf_out);
+guint           flow_unpack_uint32_array (const guchar **buf_ptr_inout, const guchar *buf_end,
+                                          guint32 *n_out, guint n_max);
+guchar         *flow_pack_uint64_array (const guint64 *n_in, guint n_elements, guchar *buf_out);
+guint           flow_unpack_uint64_array (const guchar **buf_ptr_inout, const guchar *buf_end,
+                                          guint64 *n_out, guint n_max);
+guchar         *flow_pack_string_array (const gchar * const *strings_in, guint n_elements, guchar *buf_out);
+guint           flow_unpack_string_array (const guchar **buf_ptr_inout, const guchar *buf_end,
+                                          gchar **strings_out, guint n_max);
+
+guint           flow_unpack_uint32_array_from_iter (FlowPacketByteIter *iter, guint32 *n_out, guint n_max);
+guint           flow_unpack_uint64_array_from_iter (FlowPacketByteIter *iter, guint64 *n_out, guint n_max);
+guint           flow_unpack_string_array_from_iter (FlowPacketByteIter *iter, gchar **strings_out, guint n_max);
+
 G_END_DECLS
 
 #endif  /* _FLOW_PACK_UTIL_H */
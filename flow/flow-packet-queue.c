@@ -162,7 +162,6 @@ consolidate_partial_packet (FlowPacketQueue *packet_queue)
 {
   FlowPacket *packet;
   FlowPacket *new_packet;
-  guint8     *data;
 
   if (packet_queue->packet_position == 0)
     return;
@@ -170,10 +169,8 @@ consolidate_partial_packet (FlowPacketQueue *packet_queue)
   packet = peek_packet (packet_queue);
   g_assert (flow_packet_get_format (packet) == FLOW_PACKET_FORMAT_BUFFER);
 
-  data = flow_packet_get_data (packet) + packet_queue->packet_position;
-
-  new_packet = flow_packet_new (FLOW_PACKET_FORMAT_BUFFER, data,
-                                flow_packet_get_size (packet) - packet_queue->packet_position);
+  new_packet = flow_packet_new_slice (packet, packet_queue->packet_position,
+                                      flow_packet_get_size (packet) - packet_queue->packet_position);
   flow_packet_unref (packet);
 
   if (packet_queue->first_packet == packet)
@@ -413,14 +410,13 @@ flow_packet_queue_pop_packet (FlowPacketQueue *packet_queue)
   }
 
   /* We're at an odd intra-packet position. Need to fake a packet. This will only happen
-   * if the user mixes calls to pop_packet() and pop_bytes(). */
+   * if the user mixes calls to pop_packet() and pop_bytes(). The new packet is a slice
+   * referencing the original's data, so nothing gets copied. */
 
   g_assert (packet_format == FLOW_PACKET_FORMAT_BUFFER);
 
   new_packet_len = packet_len - packet_queue->packet_position;
-  new_packet = flow_packet_new (FLOW_PACKET_FORMAT_BUFFER,
-                                (guint8 *) flow_packet_get_data (packet) + packet_queue->packet_position,
-                                new_packet_len);
+  new_packet = flow_packet_new_slice (packet, packet_queue->packet_position, new_packet_len);
 
   flow_packet_unref (packet);
   packet_queue->packet_position = 0;
@@ -504,6 +500,46 @@ flow_packet_queue_pop_bytes_exact (FlowPacketQueue *packet_queue, gpointer dest,
   return TRUE;
 }
 
+/**
+ * flow_packet_queue_peek_bytes:
+ * @packet_queue: A packet queue.
+ * @dest:         A pointer at which to store the data.
+ * @n_max:        Maximum number of bytes to copy.
+ * 
+ * Copies up to @n_max bytes from the head of @packet_queue without
+ * removing them. Like flow_packet_queue_pop_bytes_exact (), this will
+ * not span packets that aren't of format #FLOW_PACKET_FORMAT_BUFFER.
+ * 
+ * Return value: The number of bytes copied.
+ **/
+gint
+flow_packet_queue_peek_bytes (FlowPacketQueue *packet_queue, gpointer dest, gint n_max)
+{
+  FlowPacketIter packet_iter = NULL;
+  gint           offset = packet_queue->packet_position;
+  gint           n = 0;
+
+  g_return_val_if_fail (FLOW_IS_PACKET_QUEUE (packet_queue), 0);
+  g_return_val_if_fail (dest != NULL, 0);
+  g_return_val_if_fail (n_max >= 0, 0);
+
+  while (n < n_max && flow_packet_iter_next (packet_queue, &packet_iter))
+  {
+    FlowPacket *packet = flow_packet_iter_peek_packet (packet_queue, &packet_iter);
+    gint        len;
+
+    if (flow_packet_get_format (packet) != FLOW_PACKET_FORMAT_BUFFER)
+      break;
+
+    len = MIN (n_max - n, (gint) flow_packet_get_size (packet) - offset);
+    memcpy ((guint8 *) dest + n, (guint8 *) flow_packet_get_data (packet) + offset, len);
+    n += len;
+    offset = 0;
+  }
+
+  return n;
+}
+
 gboolean
 flow_packet_queue_peek_packet (FlowPacketQueue *packet_queue, FlowPacket **packet_out, gint *offset_out)
 {
@@ -1078,6 +1114,79 @@ flow_packet_byte_iter_advance (FlowPacketByteIter *byte_iter, gint n_max)
   return n;
 }
 
+/**
+ * flow_packet_byte_iter_peek_span:
+ * @byte_iter: A byte iterator.
+ * @len_out:   Return location for the length of the span.
+ * 
+ * Gets a pointer to the bytes following @byte_iter that are stored
+ * contiguously in a single packet, letting the caller read them in place
+ * instead of copying them out. Use flow_packet_byte_iter_advance () to move
+ * past any bytes consumed.
+ * 
+ * Return value: A pointer to packet data, or %NULL if there are no more bytes.
+ **/
+const guint8 *
+flow_packet_byte_iter_peek_span (FlowPacketByteIter *byte_iter, gint *len_out)
+{
+  FlowPacketQueue *packet_queue;
+  GList *l;
+  gint packet_position;
+
+  g_return_val_if_fail (byte_iter != NULL, NULL);
+  g_return_val_if_fail (FLOW_IS_PACKET_QUEUE (byte_iter->packet_queue), NULL);
+  g_return_val_if_fail (len_out != NULL, NULL);
+
+  packet_queue = byte_iter->packet_queue;
+  l = byte_iter->packet_l;
+  packet_position = byte_iter->packet_position;
+
+  for (;;)
+  {
+    FlowPacket *packet;
+    GList *m;
+
+    if (l)
+    {
+      packet = l->data;
+    }
+    else
+    {
+      packet = packet_queue->first_packet;
+      if (!packet)
+      {
+        l = packet_queue->queue->head;
+        if (l)
+          packet = l->data;
+      }
+    }
+
+    if (!packet)
+      break;
+
+    if (flow_packet_get_format (packet) == FLOW_PACKET_FORMAT_BUFFER &&
+        packet_position < (gint) flow_packet_get_size (packet))
+    {
+      *len_out = flow_packet_get_size (packet) - packet_position;
+      return (const guint8 *) flow_packet_get_data (packet) + packet_position;
+    }
+
+    if (l)
+      m = g_list_next (l);
+    else
+      m = packet_queue->queue->head;
+
+    if (!m)
+      break;
+
+    packet_position = 0;
+    l = m;
+  }
+
+  *len_out = 0;
+  return NULL;
+}
+
 void
 flow_packet_byte_iter_drop_preceding_data (FlowPacketByteIter *byte_iter)
 {
@@ -93,6 +93,7 @@ void              flow_packet_queue_push_packet_to_head    (FlowPacketQueue *pac
 FlowPacket       *flow_packet_queue_pop_packet             (FlowPacketQueue *packet_queue);
 gint              flow_packet_queue_pop_bytes              (FlowPacketQueue *packet_queue, gpointer dest, gint n_max);
 gboolean          flow_packet_queue_pop_bytes_exact        (FlowPacketQueue *packet_queue, gpointer dest, gint n);
+gint              flow_packet_queue_peek_bytes             (FlowPacketQueue *packet_queue, gpointer dest, gint n_max);
 
 gboolean          flow_packet_queue_peek_packet            (FlowPacketQueue *packet_queue,
                                                             FlowPacket **packet_out, gint *offset_out);
@@ -115,6 +116,7 @@ gint              flow_packet_byte_iter_get_remaining_bytes (FlowPacketByteIter
 gint              flow_packet_byte_iter_peek                (FlowPacketByteIter *byte_iter, gpointer dest, gint n_max);
 gint              flow_packet_byte_iter_pop                 (FlowPacketByteIter *byte_iter, gpointer dest, gint n_max);
 gint              flow_packet_byte_iter_advance             (FlowPacketByteIter *byte_iter, gint n_max);
+const guint8     *flow_packet_byte_iter_peek_span           (FlowPacketByteIter *byte_iter, gint *len_out);
 void              flow_packet_byte_iter_drop_preceding_data (FlowPacketByteIter *byte_iter);
 
 G_END_DECLS
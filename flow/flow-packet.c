@@ -30,6 +30,18 @@
 #define DATA_ALIGN_TO      (sizeof (gpointer))
 #define PACKET_HEADER_SIZE (((sizeof (FlowPacket) + DATA_ALIGN_TO - 1) / DATA_ALIGN_TO) * DATA_ALIGN_TO)
 
+/* A slice packet's body holds a reference to the packet that owns the
+ * data, and a pointer into that data. */
+
+typedef struct
+{
+  FlowPacket *parent;
+  guint8     *data;
+}
+FlowPacketSlice;
+
+#define PACKET_SLICE(packet) ((FlowPacketSlice *) ((guint8 *) (packet) + PACKET_HEADER_SIZE))
+
 #if GLIB_MAJOR_VERSION >= 2 && GLIB_MINOR_VERSION >= 10
 # define packet_alloc(size)        g_slice_alloc (size)
 # define packet_free(packet, size) g_slice_free1 (size, packet)
@@ -78,6 +90,7 @@ flow_packet_new (FlowPacketFormat format, gpointer data, guint size)
 
   packet            = packet_alloc (PACKET_HEADER_SIZE + body_size);
   packet->format    = format;
+  packet->is_slice  = FALSE;
   packet->size      = size;
   packet->ref_count = 1;
 
@@ -114,6 +127,7 @@ flow_packet_alloc_for_data (guint size, gpointer *data_ptr_out)
 
   packet            = packet_alloc (PACKET_HEADER_SIZE + size);
   packet->format    = FLOW_PACKET_FORMAT_BUFFER;
+  packet->is_slice  = FALSE;
   packet->size      = size;
   packet->ref_count = 1;
 
@@ -141,6 +155,7 @@ flow_packet_new_take_object (gpointer object, guint size)
 
   packet            = packet_alloc (PACKET_HEADER_SIZE + sizeof (gpointer));
   packet->format    = FLOW_PACKET_FORMAT_OBJECT;
+  packet->is_slice  = FALSE;
   packet->size      = size;
   packet->ref_count = 1;
 
@@ -150,6 +165,59 @@ flow_packet_new_take_object (gpointer object, guint size)
   return packet;
 }
 
+/**
+ * flow_packet_new_slice:
+ * @packet: A packet of format #FLOW_PACKET_FORMAT_BUFFER.
+ * @offset: Offset of the slice in @packet's data, in bytes.
+ * @size:   Size of the slice, in bytes.
+ * 
+ * Creates a new buffer packet whose data is a sub-range of @packet's data.
+ * The data is not copied; instead the new packet holds a reference to the
+ * packet that owns it. Very small slices are copied, since that's no more
+ * expensive and avoids pinning a large buffer.
+ * 
+ * The slice's data must be treated as read-only.
+ * 
+ * Return value: A new #FlowPacket.
+ **/
+FlowPacket *
+flow_packet_new_slice (FlowPacket *packet, guint offset, guint size)
+{
+  FlowPacket      *slice_packet;
+  FlowPacketSlice *slice;
+  guint8          *data;
+
+  g_return_val_if_fail (packet != NULL, NULL);
+  g_return_val_if_fail (packet->format == FLOW_PACKET_FORMAT_BUFFER, NULL);
+  g_return_val_if_fail (offset + size <= packet->size, NULL);
+
+  if (offset == 0 && size == packet->size)
+    return flow_packet_ref (packet);
+
+  data = (guint8 *) flow_packet_get_data (packet) + offset;
+
+  if (size <= sizeof (FlowPacketSlice))
+    return flow_packet_new (FLOW_PACKET_FORMAT_BUFFER, data, size);
+
+  /* Always reference the packet that owns the data, so slices of slices
+   * don't form chains */
+
+  if (packet->is_slice)
+    packet = PACKET_SLICE (packet)->parent;
+
+  slice_packet            = packet_alloc (PACKET_HEADER_SIZE + sizeof (FlowPacketSlice));
+  slice_packet->format    = FLOW_PACKET_FORMAT_BUFFER;
+  slice_packet->is_slice  = TRUE;
+  slice_packet->size      = size;
+  slice_packet->ref_count = 1;
+
+  slice         = PACKET_SLICE (slice_packet);
+  slice->parent = flow_packet_ref (packet);
+  slice->data   = data;
+
+  return slice_packet;
+}
+
 FlowPacket *
 flow_packet_copy (FlowPacket *packet)
 {
@@ -160,6 +228,9 @@ flow_packet_copy (FlowPacket *packet)
   switch (packet->format)
   {
     case FLOW_PACKET_FORMAT_BUFFER:
+      if (packet->is_slice)
+        return flow_packet_new (FLOW_PACKET_FORMAT_BUFFER, PACKET_SLICE (packet)->data, packet->size);
+
       packet_copy = packet_alloc (PACKET_HEADER_SIZE + packet->size);
       memcpy (packet_copy, packet, PACKET_HEADER_SIZE + packet->size);
       break;
@@ -192,7 +263,15 @@ free_packet (FlowPacket *packet)
   switch (packet->format)
   {
     case FLOW_PACKET_FORMAT_BUFFER:
-      packet_free (packet, PACKET_HEADER_SIZE + packet->size);
+      if (packet->is_slice)
+      {
+        flow_packet_unref (PACKET_SLICE (packet)->parent);
+        packet_free (packet, PACKET_HEADER_SIZE + sizeof (FlowPacketSlice));
+      }
+      else
+      {
+        packet_free (packet, PACKET_HEADER_SIZE + packet->size);
+      }
       break;
 
     case FLOW_PACKET_FORMAT_OBJECT:
@@ -305,7 +384,10 @@ flow_packet_get_data (FlowPacket *packet)
   switch (packet->format)
   {
     case FLOW_PACKET_FORMAT_BUFFER:
-      data = (guint8 *) packet + PACKET_HEADER_SIZE;
+      if (packet->is_slice)
+        data = PACKET_SLICE (packet)->data;
+      else
+        data = (guint8 *) packet + PACKET_HEADER_SIZE;
       break;
 
     case FLOW_PACKET_FORMAT_OBJECT:
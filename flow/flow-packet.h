@@ -29,7 +29,7 @@
 
 G_BEGIN_DECLS
 
-#define FLOW_PACKET_MAX_SIZE (1 << 29)
+#define FLOW_PACKET_MAX_SIZE ((1 << 29) - 1)
 
 typedef enum
 {
@@ -45,7 +45,8 @@ struct _FlowPacket
   /*< private >*/
 
   guint format          :  2;
-  guint size            : 30;
+  guint is_slice        :  1;
+  guint size            : 29;
   gint ref_count;
 };
 
@@ -53,6 +54,7 @@ FlowPacket       *flow_packet_new             (FlowPacketFormat format, gpointer
 FlowPacket       *flow_packet_new_take_object (gpointer object, guint size);
 FlowPacket       *flow_packet_alloc_for_data  (guint size, gpointer *data_ptr_out);
 FlowPacket       *flow_packet_copy            (FlowPacket *packet);
+FlowPacket       *flow_packet_new_slice       (FlowPacket *packet, guint offset, guint size);
 
 FlowPacket       *flow_packet_ref             (FlowPacket *packet);
 void              flow_packet_unref           (FlowPacket *packet);
@@ -24,6 +24,9 @@
 
 #include "config.h"
 #include "flow-serializable.h"
+#include "flow-pack-util.h"
+
+#include <string.h>  /* memcpy, memmove, strlen */
 
 G_DEFINE_INTERFACE (FlowSerializable, flow_serializable, G_TYPE_OBJECT)
 
@@ -33,6 +36,41 @@ flow_serializable_default_init (FlowSerializableInterface *iface)
   /* Install properties here */
 }
 
+/* Runs serialization steps until the implementation is done. When using a
+ * sink, the same buffer is reused across steps, so small steps are
+ * coalesced into as few packets as possible. */
+static void
+serialize_remaining (FlowSerializable *serializable, FlowSerializableInterface *iface,
+                     FlowPad *target_pad, gpointer context)
+{
+  FlowPacketQueue *packet_queue;
+
+  packet_queue = flow_pad_ensure_packet_queue (target_pad);
+
+  if (iface->serialize_to_sink)
+  {
+    FlowSerializeSink sink;
+
+    flow_serialize_sink_init (&sink, packet_queue);
+
+    while (iface->serialize_to_sink (serializable, &sink, context))
+    {
+      /* Only pushes anything if the sink flushed on its own */
+      if (flow_packet_queue_get_length_packets (packet_queue) > 0)
+        flow_pad_push (target_pad, NULL);
+    }
+
+    flow_serialize_sink_finish (&sink);
+  }
+  else
+  {
+    while (iface->serialize_step (serializable, packet_queue, context))
+      flow_pad_push (target_pad, NULL);
+  }
+
+  flow_pad_push (target_pad, NULL);
+}
+
 gpointer
 flow_serializable_serialize_begin (FlowSerializable *serializable)
 {
@@ -60,10 +98,23 @@ flow_serializable_serialize_step (FlowSerializable *serializable, FlowPad *targe
 
   iface = FLOW_SERIALIZABLE_GET_IFACE (serializable);
 
-  if (!iface->serialize_step)
+  if (iface->serialize_to_sink)
+  {
+    FlowSerializeSink sink;
+
+    flow_serialize_sink_init (&sink, flow_pad_ensure_packet_queue (target_pad));
+    call_again = iface->serialize_to_sink (serializable, &sink, context);
+    flow_serialize_sink_finish (&sink);
+  }
+  else if (iface->serialize_step)
+  {
+    call_again = iface->serialize_step (serializable, flow_pad_ensure_packet_queue (target_pad), context);
+  }
+  else
+  {
     return FALSE;
+  }
 
-  call_again = iface->serialize_step (serializable, flow_pad_ensure_packet_queue (target_pad), context);
   flow_pad_push (target_pad, NULL);
 
   if (call_again)
@@ -80,22 +131,16 @@ flow_serializable_serialize_finish (FlowSerializable *serializable, FlowPad *tar
                                     gpointer context)
 {
   FlowSerializableInterface *iface;
-  FlowPacketQueue *packet_queue;
 
   g_return_if_fail (FLOW_IS_SERIALIZABLE (serializable));
   g_return_if_fail (FLOW_IS_PAD (target_pad));
 
   iface = FLOW_SERIALIZABLE_GET_IFACE (serializable);
 
-  if (!iface->serialize_step)
+  if (!iface->serialize_step && !iface->serialize_to_sink)
     return;
 
-  packet_queue = flow_pad_ensure_packet_queue (target_pad);
-
-  while (iface->serialize_step (serializable, packet_queue, context))
-    flow_pad_push (target_pad, NULL);
-
-  flow_pad_push (target_pad, NULL);
+  serialize_remaining (serializable, iface, target_pad, context);
 
   if (iface->destroy_serialize_context)
     iface->destroy_serialize_context (serializable, context);
@@ -119,25 +164,19 @@ flow_serializable_serialize_all (FlowSerializable *serializable, FlowPad *target
 {
   FlowSerializableInterface *iface;
   gpointer context = NULL;
-  FlowPacketQueue *packet_queue;
 
   g_return_if_fail (FLOW_IS_SERIALIZABLE (serializable));
   g_return_if_fail (FLOW_IS_PAD (target_pad));
 
   iface = FLOW_SERIALIZABLE_GET_IFACE (serializable);
 
-  if (!iface->serialize_step)
+  if (!iface->serialize_step && !iface->serialize_to_sink)
     return;
 
-  packet_queue = flow_pad_ensure_packet_queue (target_pad);
-
   if (iface->create_serialize_context)
     context = iface->create_serialize_context (serializable);
 
-  while (iface->serialize_step (serializable, packet_queue, context))
-    flow_pad_push (target_pad, NULL);
-
-  flow_pad_push (target_pad, NULL);
+  serialize_remaining (serializable, iface, target_pad, context);
 
   if (iface->destroy_serialize_context)
     iface->destroy_serialize_context (serializable, context);
@@ -173,7 +212,18 @@ flow_serializable_deserialize_step (GType type, FlowPacketQueue *packet_queue, g
   klass = g_type_class_peek (type);
   iface = g_type_interface_peek (klass, FLOW_TYPE_SERIALIZABLE);
 
-  if (!iface->deserialize_step)
+  if (iface->deserialize_from_source)
+  {
+    FlowDeserializeSource source;
+
+    flow_deserialize_source_init (&source, packet_queue);
+    result = iface->deserialize_from_source (&source, context, &my_serializable_out, error);
+  }
+  else if (iface->deserialize_step)
+  {
+    result = iface->deserialize_step (packet_queue, context, &my_serializable_out, error);
+  }
+  else
   {
     if (iface->destroy_deserialize_context)
       iface->destroy_deserialize_context (context);
@@ -182,8 +232,6 @@ flow_serializable_deserialize_step (GType type, FlowPacketQueue *packet_queue, g
     return FALSE;
   }
 
-  result = iface->deserialize_step (packet_queue, context, &my_serializable_out, error);
-
   if (my_serializable_out)
   {
     *serializable_out = my_serializable_out;
@@ -217,3 +265,504 @@ flow_serializable_error_quark (void)
 {
   return g_quark_from_static_string ("flow-serializable-error-quark");
 }
+
+/* --- FlowSerializeSink --- */
+
+/**
+ * flow_serialize_sink_init:
+ * @sink:         An uninitialized #FlowSerializeSink, typically on the stack.
+ * @packet_queue: The #FlowPacketQueue that flushed packets will be appended to.
+ *
+ * Prepares @sink for writing. Data written to the sink is accumulated in a
+ * contiguous buffer and only turned into packets when the sink is flushed,
+ * either explicitly or because the buffer grew past
+ * %FLOW_SERIALIZE_SINK_FLUSH_SIZE. Small objects therefore cost a single
+ * packet allocation, regardless of how many fields they have.
+ *
+ * Call flow_serialize_sink_finish () when done.
+ **/
+void
+flow_serialize_sink_init (FlowSerializeSink *sink, FlowPacketQueue *packet_queue)
+{
+  g_return_if_fail (sink != NULL);
+  g_return_if_fail (FLOW_IS_PACKET_QUEUE (packet_queue));
+
+  sink->packet_queue = packet_queue;
+  sink->buffer       = sink->inline_buffer;
+  sink->len          = 0;
+  sink->alloc_len    = FLOW_SERIALIZE_SINK_INLINE_SIZE;
+}
+
+/**
+ * flow_serialize_sink_finish:
+ * @sink: A #FlowSerializeSink.
+ *
+ * Flushes any buffered data and frees the resources held by @sink. The sink
+ * can be reused after calling flow_serialize_sink_init () on it again.
+ **/
+void
+flow_serialize_sink_finish (FlowSerializeSink *sink)
+{
+  g_return_if_fail (sink != NULL);
+
+  flow_serialize_sink_flush (sink);
+
+  if (sink->buffer != sink->inline_buffer)
+    g_free (sink->buffer);
+
+  sink->buffer    = sink->inline_buffer;
+  sink->alloc_len = FLOW_SERIALIZE_SINK_INLINE_SIZE;
+}
+
+/**
+ * flow_serialize_sink_flush:
+ * @sink: A #FlowSerializeSink.
+ *
+ * Appends buffered data to the sink's packet queue as a single, exactly
+ * sized packet.
+ **/
+void
+flow_serialize_sink_flush (FlowSerializeSink *sink)
+{
+  g_return_if_fail (sink != NULL);
+
+  if (sink->len == 0)
+    return;
+
+  flow_packet_queue_push_packet (sink->packet_queue,
+                                 flow_packet_new (FLOW_PACKET_FORMAT_BUFFER, sink->buffer, sink->len));
+  sink->len = 0;
+}
+
+/**
+ * flow_serialize_sink_get_length:
+ * @sink: A #FlowSerializeSink.
+ *
+ * Returns the number of bytes currently buffered in @sink.
+ *
+ * Return value: Number of unflushed bytes.
+ **/
+guint
+flow_serialize_sink_get_length (FlowSerializeSink *sink)
+{
+  g_return_val_if_fail (sink != NULL, 0);
+
+  return sink->len;
+}
+
+/**
+ * flow_serialize_sink_reserve:
+ * @sink: A #FlowSerializeSink.
+ * @n:    Number of bytes to reserve.
+ *
+ * Makes sure there are at least @n contiguous bytes available at the end of
+ * the sink's buffer, and returns a pointer to them. The caller may write up
+ * to @n bytes there, and must then call flow_serialize_sink_commit () with
+ * the number of bytes actually written. The pointer is invalidated by any
+ * other call on @sink.
+ *
+ * Return value: A pointer to writable memory.
+ **/
+guint8 *
+flow_serialize_sink_reserve (FlowSerializeSink *sink, guint n)
+{
+  guint needed;
+
+  g_return_val_if_fail (sink != NULL, NULL);
+  g_return_val_if_fail (n <= FLOW_PACKET_MAX_SIZE, NULL);
+
+  if (sink->len > 0 && sink->len + n > FLOW_SERIALIZE_SINK_FLUSH_SIZE)
+    flow_serialize_sink_flush (sink);
+
+  needed = sink->len + n;
+
+  if (needed > sink->alloc_len)
+  {
+    guint alloc_len = sink->alloc_len;
+
+    while (alloc_len < needed)
+      alloc_len *= 2;
+
+    if (sink->buffer == sink->inline_buffer)
+    {
+      sink->buffer = g_malloc (alloc_len);
+      memcpy (sink->buffer, sink->inline_buffer, sink->len);
+    }
+    else
+    {
+      sink->buffer = g_realloc (sink->buffer, alloc_len);
+    }
+
+    sink->alloc_len = alloc_len;
+  }
+
+  return sink->buffer + sink->len;
+}
+
+/**
+ * flow_serialize_sink_commit:
+ * @sink: A #FlowSerializeSink.
+ * @n:    Number of bytes written.
+ *
+ * Marks @n bytes written to memory obtained from flow_serialize_sink_reserve ()
+ * as valid.
+ **/
+void
+flow_serialize_sink_commit (FlowSerializeSink *sink, guint n)
+{
+  g_return_if_fail (sink != NULL);
+  g_return_if_fail (sink->len + n <= sink->alloc_len);
+
+  sink->len += n;
+}
+
+/**
+ * flow_serialize_sink_write:
+ * @sink: A #FlowSerializeSink.
+ * @src:  Data to write.
+ * @n:    Number of bytes to write.
+ *
+ * Appends @n bytes from @src to @sink. Writes larger than
+ * %FLOW_SERIALIZE_SINK_FLUSH_SIZE bypass the buffer.
+ **/
+void
+flow_serialize_sink_write (FlowSerializeSink *sink, gconstpointer src, guint n)
+{
+  g_return_if_fail (sink != NULL);
+  g_return_if_fail (src != NULL || n == 0);
+
+  if (n >= FLOW_SERIALIZE_SINK_FLUSH_SIZE)
+  {
+    flow_serialize_sink_flush (sink);
+
+    while (n > 0)
+    {
+      guint len = MIN (n, FLOW_PACKET_MAX_SIZE);
+
+      flow_packet_queue_push_packet (sink->packet_queue,
+                                     flow_packet_new (FLOW_PACKET_FORMAT_BUFFER, (gpointer) src, len));
+      src = (const guint8 *) src + len;
+      n -= len;
+    }
+
+    return;
+  }
+
+  memcpy (flow_serialize_sink_reserve (sink, n), src, n);
+  sink->len += n;
+}
+
+/**
+ * flow_serialize_sink_write_uint32:
+ * @sink: A #FlowSerializeSink.
+ * @n:    Value to write.
+ *
+ * Appends @n to @sink in the variable-length format used by flow_pack_uint32 ().
+ **/
+void
+flow_serialize_sink_write_uint32 (FlowSerializeSink *sink, guint32 n)
+{
+  guint8 *p;
+
+  g_return_if_fail (sink != NULL);
+
+  p = flow_serialize_sink_reserve (sink, 5);
+  sink->len += flow_pack_uint32 (n, p) - p;
+}
+
+/**
+ * flow_serialize_sink_write_uint64:
+ * @sink: A #FlowSerializeSink.
+ * @n:    Value to write.
+ *
+ * Appends @n to @sink in the variable-length format used by flow_pack_uint64 ().
+ **/
+void
+flow_serialize_sink_write_uint64 (FlowSerializeSink *sink, guint64 n)
+{
+  guint8 *p;
+
+  g_return_if_fail (sink != NULL);
+
+  p = flow_serialize_sink_reserve (sink, 10);
+  sink->len += flow_pack_uint64 (n, p) - p;
+}
+
+/**
+ * flow_serialize_sink_write_string:
+ * @sink:   A #FlowSerializeSink.
+ * @string: A nul-terminated string.
+ *
+ * Appends @string to @sink in the format used by flow_pack_string ().
+ **/
+void
+flow_serialize_sink_write_string (FlowSerializeSink *sink, const gchar *string)
+{
+  guint len;
+
+  g_return_if_fail (sink != NULL);
+  g_return_if_fail (string != NULL);
+
+  len = strlen (string);
+  flow_serialize_sink_write_uint32 (sink, len);
+  flow_serialize_sink_write (sink, string, len);
+}
+
+/**
+ * flow_serialize_sink_write_packet:
+ * @sink:   A #FlowSerializeSink.
+ * @packet: A #FlowPacket.
+ *
+ * Appends @packet to the stream. Small buffer packets are copied into the
+ * sink's buffer. Large buffer packets and object packets are queued as-is
+ * after flushing, so ordering is preserved. The caller retains ownership
+ * of @packet.
+ **/
+void
+flow_serialize_sink_write_packet (FlowSerializeSink *sink, FlowPacket *packet)
+{
+  g_return_if_fail (sink != NULL);
+  g_return_if_fail (packet != NULL);
+
+  if (flow_packet_get_format (packet) == FLOW_PACKET_FORMAT_BUFFER &&
+      flow_packet_get_size (packet) <= FLOW_SERIALIZE_SINK_INLINE_SIZE)
+  {
+    flow_serialize_sink_write (sink, flow_packet_get_data (packet), flow_packet_get_size (packet));
+    return;
+  }
+
+  flow_serialize_sink_flush (sink);
+  flow_packet_queue_push_packet (sink->packet_queue, flow_packet_ref (packet));
+}
+
+/* --- FlowDeserializeSource --- */
+
+/**
+ * flow_deserialize_source_init:
+ * @source:       An uninitialized #FlowDeserializeSource, typically on the stack.
+ * @packet_queue: The #FlowPacketQueue to read from.
+ *
+ * Prepares @source for reading. Reads are served directly from packet memory
+ * when the requested data is contiguous, and fall back to copying when it
+ * spans packets. A read that cannot be satisfied by the queued data consumes
+ * nothing, so it can be retried when more data arrives.
+ **/
+void
+flow_deserialize_source_init (FlowDeserializeSource *source, FlowPacketQueue *packet_queue)
+{
+  g_return_if_fail (source != NULL);
+  g_return_if_fail (FLOW_IS_PACKET_QUEUE (packet_queue));
+
+  source->packet_queue = packet_queue;
+}
+
+/**
+ * flow_deserialize_source_peek_span:
+ * @source:  A #FlowDeserializeSource.
+ * @len_out: Return location for the length of the span.
+ *
+ * Returns the longest run of bytes at the head of the queue that can be
+ * accessed without copying. The data remains in the queue until consumed
+ * with flow_deserialize_source_consume ().
+ *
+ * Return value: A pointer to the data, or %NULL if the queue is empty or
+ *               starts with an object packet.
+ **/
+const guint8 *
+flow_deserialize_source_peek_span (FlowDeserializeSource *source, guint *len_out)
+{
+  FlowPacket *packet;
+  gint        offset;
+
+  g_return_val_if_fail (source != NULL, NULL);
+  g_return_val_if_fail (len_out != NULL, NULL);
+
+  if (!flow_packet_queue_peek_packet (source->packet_queue, &packet, &offset) ||
+      flow_packet_get_format (packet) != FLOW_PACKET_FORMAT_BUFFER)
+  {
+    *len_out = 0;
+    return NULL;
+  }
+
+  *len_out = flow_packet_get_size (packet) - offset;
+  return (const guint8 *) flow_packet_get_data (packet) + offset;
+}
+
+/**
+ * flow_deserialize_source_consume:
+ * @source: A #FlowDeserializeSource.
+ * @n:      Number of bytes to drop.
+ *
+ * Drops @n bytes from the head of the queue.
+ **/
+void
+flow_deserialize_source_consume (FlowDeserializeSource *source, guint n)
+{
+  g_return_if_fail (source != NULL);
+
+  flow_packet_queue_pop_bytes (source->packet_queue, NULL, n);
+}
+
+/**
+ * flow_deserialize_source_read:
+ * @source: A #FlowDeserializeSource.
+ * @dest:   A pointer at which to store the data, or %NULL to discard.
+ * @n:      Number of bytes to read.
+ *
+ * Reads exactly @n bytes, as with flow_packet_queue_pop_bytes_exact ().
+ *
+ * Return value: %TRUE if the data was read, %FALSE if not enough was available.
+ **/
+gboolean
+flow_deserialize_source_read (FlowDeserializeSource *source, gpointer dest, guint n)
+{
+  g_return_val_if_fail (source != NULL, FALSE);
+
+  return flow_packet_queue_pop_bytes_exact (source->packet_queue, dest, n);
+}
+
+/**
+ * flow_deserialize_source_read_uint32:
+ * @source: A #FlowDeserializeSource.
+ * @n_out:  Return location for the value.
+ *
+ * Reads a value written with flow_serialize_sink_write_uint32 ().
+ *
+ * Return value: %TRUE if a value was read, %FALSE if more data is needed.
+ **/
+gboolean
+flow_deserialize_source_read_uint32 (FlowDeserializeSource *source, guint32 *n_out)
+{
+  const guint8 *span;
+  const guint8 *p;
+  guint8        buf [5];
+  guint         len;
+
+  g_return_val_if_fail (source != NULL, FALSE);
+  g_return_val_if_fail (n_out != NULL, FALSE);
+
+  span = flow_deserialize_source_peek_span (source, &len);
+  p = span;
+
+  if (span && flow_unpack_uint32 (&p, span + len, n_out))
+  {
+    flow_deserialize_source_consume (source, p - span);
+    return TRUE;
+  }
+
+  len = flow_packet_queue_peek_bytes (source->packet_queue, buf, sizeof (buf));
+  p = buf;
+
+  if (!flow_unpack_uint32 (&p, buf + len, n_out))
+    return FALSE;
+
+  flow_deserialize_source_consume (source, p - buf);
+  return TRUE;
+}
+
+/**
+ * flow_deserialize_source_read_uint64:
+ * @source: A #FlowDeserializeSource.
+ * @n_out:  Return location for the value.
+ *
+ * Reads a value written with flow_serialize_sink_write_uint64 ().
+ *
+ * Return value: %TRUE if a value was read, %FALSE if more data is needed.
+ **/
+gboolean
+flow_deserialize_source_read_uint64 (FlowDeserializeSource *source, guint64 *n_out)
+{
+  const guint8 *span;
+  const guint8 *p;
+  guint8        buf [9];
+  guint         len;
+
+  g_return_val_if_fail (source != NULL, FALSE);
+  g_return_val_if_fail (n_out != NULL, FALSE);
+
+  span = flow_deserialize_source_peek_span (source, &len);
+  p = span;
+
+  if (span && flow_unpack_uint64 (&p, span + len, n_out))
+  {
+    flow_deserialize_source_consume (source, p - span);
+    return TRUE;
+  }
+
+  len = flow_packet_queue_peek_bytes (source->packet_queue, buf, sizeof (buf));
+  p = buf;
+
+  if (!flow_unpack_uint64 (&p, buf + len, n_out))
+    return FALSE;
+
+  flow_deserialize_source_consume (source, p - buf);
+  return TRUE;
+}
+
+/**
+ * flow_deserialize_source_read_string:
+ * @source:     A #FlowDeserializeSource.
+ * @string_out: Return location for a newly allocated string.
+ *
+ * Reads a string written with flow_serialize_sink_write_string ().
+ * A length prefix too large to ever be satisfied is never consumed.
+ *
+ * Return value: %TRUE if a string was read, %FALSE if more data is needed.
+ **/
+gboolean
+flow_deserialize_source_read_string (FlowDeserializeSource *source, gchar **string_out)
+{
+  const guint8 *span;
+  const guint8 *p;
+  guint8        buf [5];
+  guint         len;
+  guint         hdr_len;
+  guint32       n;
+  gchar        *string;
+
+  g_return_val_if_fail (source != NULL, FALSE);
+  g_return_val_if_fail (string_out != NULL, FALSE);
+
+  span = flow_deserialize_source_peek_span (source, &len);
+  p = span;
+
+  if (span && flow_unpack_string (&p, span + len, string_out))
+  {
+    flow_deserialize_source_consume (source, p - span);
+    return TRUE;
+  }
+
+  /* Spans packets; make sure it's all there before consuming anything */
+
+  len = flow_packet_queue_peek_bytes (source->packet_queue, buf, sizeof (buf));
+  p = buf;
+
+  if (!flow_unpack_uint32 (&p, buf + len, &n))
+    return FALSE;
+
+  hdr_len = p - buf;
+
+  /* The length comes from the peer; don't let it wrap the size arithmetic */
+
+  if (n > (guint) G_MAXINT - hdr_len - 1)
+    return FALSE;
+
+  if ((guint) flow_packet_queue_get_length_data_bytes (source->packet_queue) < hdr_len + n)
+    return FALSE;
+
+  string = g_malloc (hdr_len + n + 1);
+
+  if ((guint) flow_packet_queue_peek_bytes (source->packet_queue, string, hdr_len + n) < hdr_len + n)
+  {
+    /* Interrupted by an object packet */
+    g_free (string);
+    return FALSE;
+  }
+
+  memmove (string, string + hdr_len, n);
+  string [n] = '\0';
+
+  flow_deserialize_source_consume (source, hdr_len + n);
+  *string_out = string;
+  return TRUE;
+}
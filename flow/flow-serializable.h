@@ -48,6 +48,30 @@ GType   flow_serializable_get_type          (void) G_GNUC_CONST;
 typedef struct _FlowSerializable          FlowSerializable;  /* Dummy object */
 typedef struct _FlowSerializableInterface FlowSerializableInterface;
 
+/* Bytes buffered in place before a sink spills to the heap */
+#define FLOW_SERIALIZE_SINK_INLINE_SIZE 256
+
+/* A sink holding this much data will be flushed before it grows further */
+#define FLOW_SERIALIZE_SINK_FLUSH_SIZE  65536
+
+typedef struct
+{
+  /*< private >*/
+  FlowPacketQueue *packet_queue;
+  guint8          *buffer;
+  guint            len;
+  guint            alloc_len;
+  guint8           inline_buffer [FLOW_SERIALIZE_SINK_INLINE_SIZE];
+}
+FlowSerializeSink;
+
+typedef struct
+{
+  /*< private >*/
+  FlowPacketQueue *packet_queue;
+}
+FlowDeserializeSource;
+
 struct _FlowSerializableInterface
 {
   GTypeInterface g_iface;
@@ -62,6 +86,12 @@ struct _FlowSerializableInterface
   void        (*destroy_deserialize_context) (gpointer context);
   gboolean    (*deserialize_step)            (FlowPacketQueue *packet_queue, gpointer context,
                                               FlowSerializable **serializable_out, GError **error);
+
+  /* Optional alternatives to the above, preferred when set */
+
+  gboolean    (*serialize_to_sink)           (FlowSerializable *serializable, FlowSerializeSink *sink, gpointer context);
+  gboolean    (*deserialize_from_source)     (FlowDeserializeSource *source, gpointer context,
+                                              FlowSerializable **serializable_out, GError **error);
 };
 
 gpointer          flow_serializable_serialize_begin     (FlowSerializable *serializable);
@@ -81,6 +111,26 @@ void              flow_serializable_deserialize_abort   (GType type, gpointer co
 
 GQuark            flow_serializable_error_quark         (void);
 
+void              flow_serialize_sink_init              (FlowSerializeSink *sink, FlowPacketQueue *packet_queue);
+void              flow_serialize_sink_finish            (FlowSerializeSink *sink);
+void              flow_serialize_sink_flush             (FlowSerializeSink *sink);
+guint             flow_serialize_sink_get_length        (FlowSerializeSink *sink);
+guint8           *flow_serialize_sink_reserve           (FlowSerializeSink *sink, guint n);
+void              flow_serialize_sink_commit            (FlowSerializeSink *sink, guint n);
+void              flow_serialize_sink_write             (FlowSerializeSink *sink, gconstpointer src, guint n);
+void              flow_serialize_sink_write_uint32      (FlowSerializeSink *sink, guint32 n);
+void              flow_serialize_sink_write_uint64      (FlowSerializeSink *sink, guint64 n);
+void              flow_serialize_sink_write_string      (FlowSerializeSink *sink, const gchar *string);
+void              flow_serialize_sink_write_packet      (FlowSerializeSink *sink, FlowPacket *packet);
+
+void              flow_deserialize_source_init          (FlowDeserializeSource *source, FlowPacketQueue *packet_queue);
+const guint8     *flow_deserialize_source_peek_span     (FlowDeserializeSource *source, guint *len_out);
+void              flow_deserialize_source_consume       (FlowDeserializeSource *source, guint n);
+gboolean          flow_deserialize_source_read          (FlowDeserializeSource *source, gpointer dest, guint n);
+gboolean          flow_deserialize_source_read_uint32   (FlowDeserializeSource *source, guint32 *n_out);
+gboolean          flow_deserialize_source_read_uint64   (FlowDeserializeSource *source, guint64 *n_out);
+gboolean          flow_deserialize_source_read_string   (FlowDeserializeSource *source, gchar **string_out);
+
 G_END_DECLS
 
 #endif  /* _FLOW_SERIALIZABLE_H */
@@ -58,7 +58,10 @@
 #ifndef G_PLATFORM_WIN32
 # include <unistd.h>
 # include <sys/socket.h>
+# include <sys/un.h>
 # include <sys/stat.h>
+# include <sys/mman.h>
+# include <poll.h>
 # include <netinet/in.h>
 # include <netinet/ip.h>
 # include <netinet/tcp.h>
@@ -70,6 +73,32 @@
 
 #include <time.h>
 
+#ifdef HAVE_LINUX_ERRQUEUE_H
+# include <linux/errqueue.h>
+#endif
+
+#if defined (SO_ZEROCOPY) && defined (MSG_ZEROCOPY) && defined (SO_EE_ORIGIN_ZEROCOPY)
+# define USE_MSG_ZEROCOPY 1
+#endif
+
+#ifdef HAVE_SYS_EVENTFD_H
+# include <sys/eventfd.h>
+#endif
+
+#if defined (HAVE_MEMFD_CREATE) && defined (HAVE_SYS_EVENTFD_H)
+# define USE_SHM_RING 1
+#endif
+
+/* Descriptors received over Unix domain sockets should not leak into
+ * spawned processes. Where the kernel can't mark them close-on-exec
+ * atomically, we do it right after receiving. */
+#ifdef MSG_CMSG_CLOEXEC
+# define UNIX_RECV_FLAGS MSG_CMSG_CLOEXEC
+#else
+# define UNIX_RECV_FLAGS 0
+# define UNIX_RECV_SET_CLOEXEC 1
+#endif
+
 #ifndef MSG_NOSIGNAL
 # define MSG_NOSIGNAL 0
 # ifdef SO_NOSIGPIPE
@@ -102,6 +131,48 @@
 
 #define MULTI_MSG_MAX 64
 
+/* Maximum number of pending TCP Fast Open requests on a listener, and how
+ * long a deferred-accept listener waits for a client to send data. */
+
+#define TCP_FASTOPEN_QUEUE_LEN     256
+#define TCP_DEFER_ACCEPT_TIMEOUT_S 5
+
+/* Smallest write that is sent with MSG_ZEROCOPY when it's enabled. Below
+ * this, pinning pages and handling the completion costs more than the
+ * copy it saves. */
+
+#define ZEROCOPY_MIN_BYTES 16384
+
+/* Most bytes a socket may have in flight with MSG_ZEROCOPY. Past this,
+ * writes are copied until completions catch up, so a shunt that isn't
+ * reading can't pile up references to packets it has already sent. */
+
+#define ZEROCOPY_PENDING_MAX_BYTES (4 * 1024 * 1024)
+
+/* Size of each direction of a shared memory channel. Must be a power of
+ * two. A writer that fills its ring sleeps until the reader catches up,
+ * so this is also how far a fast writer can get ahead. */
+
+#define SHM_RING_SIZE  (1 << 20)
+#define SHM_RING_MAGIC 0x466c5231  /* "FlR1" */
+
+/* Seals the creator puts on the memfd, and the peer insists on */
+#define SHM_MEMFD_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+
+/* Returned by shm_ring_get_fill () when the ring positions make no sense */
+#define SHM_RING_FILL_INVALID G_MAXUINT
+
+/* Keeps positions written by different processes on separate cache lines */
+
+#define SHM_CACHE_LINE_SIZE 64
+
+/* How often the watch thread checks on things that don't wake it up: a
+ * shared memory peer that stopped writing and may have gone away while we
+ * wait for ring space, and sockets of closed shunts with zerocopy sends
+ * still in flight */
+
+#define IDLE_POLL_INTERVAL_MS 100
+
 #ifdef G_DISABLE_ASSERT
 # define assert_non_fatal_errno(errnum, fatal_errnos) \
   G_STMT_START{ (void)0; }G_STMT_END
@@ -128,7 +199,10 @@ typedef enum
   SHUNT_TYPE_PIPE,
   SHUNT_TYPE_TCP,
   SHUNT_TYPE_TCP_LISTENER,
-  SHUNT_TYPE_UDP
+  SHUNT_TYPE_UDP,
+  SHUNT_TYPE_UNIX,
+  SHUNT_TYPE_UNIX_LISTENER,
+  SHUNT_TYPE_SHM
 }
 ShuntType;
 
@@ -206,15 +280,50 @@ typedef struct
   FlowSockaddr remote_src_sa;
   FlowSockaddr remote_dest_sa;
   gboolean remote_dest_is_valid;
+
+  /* If set, each datagram packet starts with a FlowIPEndpoint holding the
+   * peer's address, in both directions */
+  gboolean peer_tagged;
 }
 UdpShunt;
 
 typedef struct
 {
   SocketShunt socket_shunt;
+
+  guint       auto_cork : 1;  /* Cork while the write queue holds a burst */
+  guint       corked    : 1;
+  guint       nodelay_forced : 1;  /* Auto-cork turned TCP_NODELAY on; restore when done */
+  guint       zerocopy  : 1;  /* Send large buffers with MSG_ZEROCOPY */
+
+  /* Packets whose memory the kernel may still be reading from, oldest
+   * first. Each holds a ref until its last send is reported complete. */
+
+  GQueue      zerocopy_pending;
+  gsize       zerocopy_pending_bytes;
+  guint32     zerocopy_next_id;
 }
 TcpShunt;
 
+typedef struct
+{
+  FlowPacket *packet;
+  gsize       n_bytes;  /* Total sent from the packet with MSG_ZEROCOPY */
+  guint32     last_id;  /* Sequence number of the last send using the packet */
+}
+ZerocopySend;
+
+/* The socket of a closed TCP shunt that the kernel may still be sending
+ * from our packets on. The memory must not be reused until the completions
+ * arrive, so the watch thread keeps the socket open and reaps them. */
+typedef struct
+{
+  gint        fd;
+  GQueue      pending;
+  gsize       pending_bytes;
+}
+ZerocopyOrphan;
+
 typedef struct
 {
   SocketShunt socket_shunt;
@@ -222,6 +331,85 @@ typedef struct
 }
 TcpListenerShunt;
 
+typedef struct
+{
+  SocketShunt socket_shunt;
+
+  guint       seqpacket : 1;  /* Each buffer packet is one message */
+
+  /* FlowUnixFds objects whose descriptors go out with the next buffer
+   * written, oldest first. Each holds a ref. */
+
+  GQueue      pending_fds;
+}
+UnixShunt;
+
+typedef struct
+{
+  SocketShunt socket_shunt;
+  gchar      *path;       /* Unlinked on finalize; NULL if abstract or unbound */
+  guint       seqpacket : 1;
+}
+UnixListenerShunt;
+
+/* One direction of a shared memory channel: a single-producer,
+ * single-consumer byte ring. Positions are free-running and wrap
+ * naturally; only the producer moves the tail, and only the consumer
+ * moves the head. A side that runs out of work sets its waiting flag,
+ * and the other side rings its doorbell when it next makes progress.
+ * The consumer sets reader_closed when it stops reading for good. */
+typedef struct
+{
+  volatile gint head;
+  guint8        pad_0 [SHM_CACHE_LINE_SIZE - sizeof (gint)];
+  volatile gint tail;
+  guint8        pad_1 [SHM_CACHE_LINE_SIZE - sizeof (gint)];
+  volatile gint reader_waiting;
+  volatile gint writer_waiting;
+  volatile gint reader_closed;
+  guint8        pad_2 [SHM_CACHE_LINE_SIZE - 3 * sizeof (gint)];
+}
+ShmRing;
+
+/* Start of the shared mapping. The ring data follows, ring 0 first. */
+typedef struct
+{
+  guint32     magic;
+  guint32     ring_size;
+  guint8      pad [SHM_CACHE_LINE_SIZE - 2 * sizeof (guint32)];
+
+  ShmRing     rings [2];  /* [0] goes from creator to peer, [1] the other way */
+}
+ShmHeader;
+
+typedef struct
+{
+  /* Spawned processes are tracked like pipe shunts; the pipe fds are unused */
+  PipeShunt   pipe_shunt;
+
+  ShmHeader  *header;
+  gsize       map_len;
+  guint       ring_size;
+
+  ShmRing    *rx_ring;
+  guint8     *rx_data;
+  ShmRing    *tx_ring;
+  guint8     *tx_data;
+
+  gint        doorbell_fd;       /* eventfd the peer signals us on */
+  gint        peer_doorbell_fd;  /* eventfd we signal the peer on */
+
+  /* Socket connected to the peer. Nothing is sent on it; we see EOF when
+   * the peer stops writing, and it hangs up when the peer goes away. */
+  gint        hangup_fd;
+
+  guint       peer_closed : 1;
+  guint       tx_closed   : 1;  /* Peer stopped reading */
+  guint       corrupt     : 1;  /* Peer left the ring positions inconsistent */
+  guint       spawned     : 1;  /* Created by flow_shunt_impl_spawn_process_shm () */
+}
+ShmShunt;
+
 typedef struct
 {
   const gchar *domain;
@@ -237,6 +425,9 @@ typedef struct
 ErrnoMap;
 
 static gpointer socket_shunt_main (void);
+static void     close_socket_shunt_fd (FlowShunt *shunt);
+static void     shm_shunt_free_channel (ShmShunt *shm_shunt);
+static void     shm_doorbell_ring (gint fd);
 
 static GMutex          global_mutex;
 static FlowWakeupPipe  wakeup_pipe        = FLOW_WAKEUP_PIPE_INVALID;
@@ -244,6 +435,7 @@ static GThread        *watch_thread;
 static GPtrArray      *active_socket_shunts;
 static GPtrArray      *pid_shunts;
 static GArray         *active_pids;
+static GPtrArray      *zerocopy_orphans;
 static guint8         *socket_buffer      = NULL;
 static SocketMeta     *socket_meta        = NULL;
 static SocketMeta     *socket_meta_template = NULL;
@@ -583,6 +775,53 @@ static const gint tcp_connect_fatal_errnos [] =
   0
 };
 
+static const ErrnoMap unix_address_errno_map [] =
+{
+  /* Search or write permission denied on the socket path. */
+  { EACCES,        { { FLOW_SOCKET_DOMAIN, FLOW_SOCKET_ADDRESS_PROTECTED },
+                     { FLOW_STREAM_DOMAIN, FLOW_STREAM_APP_ERROR },
+                     { NULL,               -1 } } },
+
+  /* The socket path is on a read-only file system. */
+  { EROFS,         { { FLOW_SOCKET_DOMAIN, FLOW_SOCKET_ADDRESS_PROTECTED },
+                     { FLOW_STREAM_DOMAIN, FLOW_STREAM_APP_ERROR },
+                     { NULL,               -1 } } },
+
+  /* Something already exists at the path, possibly a stale socket. */
+  { EADDRINUSE,    { { FLOW_SOCKET_DOMAIN, FLOW_SOCKET_ADDRESS_IN_USE },
+                     { FLOW_STREAM_DOMAIN, FLOW_STREAM_APP_ERROR },
+                     { NULL,               -1 } } },
+
+  /* A directory in the path, or the socket itself, does not exist. */
+  { ENOENT,        { { FLOW_SOCKET_DOMAIN, FLOW_SOCKET_ADDRESS_DOES_NOT_EXIST },
+                     { FLOW_STREAM_DOMAIN, FLOW_STREAM_APP_ERROR },
+                     { NULL,               -1 } } },
+
+  /* A component of the path prefix is not a directory. */
+  { ENOTDIR,       { { FLOW_SOCKET_DOMAIN, FLOW_SOCKET_ADDRESS_DOES_NOT_EXIST },
+                     { FLOW_STREAM_DOMAIN, FLOW_STREAM_APP_ERROR },
+                     { NULL,               -1 } } },
+
+  /* No one is listening at the path. */
+  { ECONNREFUSED,  { { FLOW_SOCKET_DOMAIN, FLOW_SOCKET_CONNECTION_REFUSED },
+                     { FLOW_STREAM_DOMAIN, FLOW_STREAM_APP_ERROR },
+                     { NULL,               -1 } } },
+
+  /* The listener's backlog is full. */
+  { EAGAIN,        { { FLOW_SOCKET_DOMAIN, FLOW_SOCKET_CONNECTION_REFUSED },
+                     { FLOW_STREAM_DOMAIN, FLOW_STREAM_RESOURCE_ERROR },
+                     { NULL,               -1 } } },
+
+  /* The socket at the path is of a different type. */
+  { EPROTOTYPE,    { { FLOW_SOCKET_DOMAIN, FLOW_SOCKET_CONNECTION_REFUSED },
+                     { FLOW_STREAM_DOMAIN, FLOW_STREAM_APP_ERROR },
+                     { NULL,               -1 } } },
+
+  { 0,             { { NULL,               -1 },
+                     { NULL,               -1 },
+                     { NULL,               -1 } } }
+};
+
 static const gint tcp_shutdown_fatal_errnos [] =
 {
   EBADF,
@@ -776,6 +1015,32 @@ socket_buffer_check (FlowShunt *shunt)
   }
 }
 
+static FlowPacket *
+new_peer_tagged_packet (FlowSockaddr *sa, gconstpointer data, gint len)
+{
+  FlowPacket *packet;
+  guint8     *p;
+
+  packet = flow_packet_alloc_for_data (sizeof (FlowIPEndpoint) + len, (gpointer *) &p);
+  flow_ip_endpoint_set_sockaddr ((FlowIPEndpoint *) p, sa);
+  memcpy (p + sizeof (FlowIPEndpoint), data, len);
+
+  return packet;
+}
+
+/* Gets the destination of a peer-tagged datagram */
+static gboolean
+get_peer_tagged_sockaddr (FlowPacket *packet, FlowSockaddr *dest_sa)
+{
+  FlowIPEndpoint endpoint;
+
+  if (flow_packet_get_size (packet) < sizeof (FlowIPEndpoint))
+    return FALSE;
+
+  memcpy (&endpoint, flow_packet_get_data (packet), sizeof (FlowIPEndpoint));
+  return flow_ip_endpoint_get_sockaddr (&endpoint, dest_sa);
+}
+
 static void
 generate_simple_event (FlowShunt *shunt, const gchar *domain, gint code)
 {
@@ -785,6 +1050,41 @@ generate_simple_event (FlowShunt *shunt, const gchar *domain, gint code)
   flow_packet_queue_push_packet (shunt->read_queue, packet);
 }
 
+/* Applies options in order, stopping at the first failure, and reports the
+ * outcome on the read path */
+static void
+apply_sockopt_op (FlowShunt *shunt, gint fd, FlowSockoptOp *sockopt_op)
+{
+  guint n_options;
+  guint i;
+
+  n_options = flow_sockopt_op_get_n_options (sockopt_op);
+
+  for (i = 0; i < n_options; i++)
+  {
+    gconstpointer value;
+    gint          level;
+    gint          name;
+    guint         len;
+
+    value = flow_sockopt_op_get_nth_option (sockopt_op, i, &level, &name, &len);
+
+    if (setsockopt (fd, level, name, value, len) != 0)
+    {
+      FlowDetailedEvent *detailed_event;
+
+      detailed_event = generate_errno_event (errno, NULL);
+      flow_detailed_event_add_code (detailed_event, FLOW_SOCKET_DOMAIN, FLOW_SOCKET_OPTIONS_FAILED);
+      flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
+      flow_shunt_read_state_changed (shunt);
+      return;
+    }
+  }
+
+  generate_simple_event (shunt, FLOW_SOCKET_DOMAIN, FLOW_SOCKET_OPTIONS_SET);
+  flow_shunt_read_state_changed (shunt);
+}
+
 static void
 report_position (FlowShunt *shunt, gint64 position)
 {
@@ -837,13 +1137,14 @@ close_read_fd (FlowShunt *shunt)
     case SHUNT_TYPE_TCP_LISTENER:
     case SHUNT_TYPE_TCP:
     case SHUNT_TYPE_UDP:
+    case SHUNT_TYPE_UNIX_LISTENER:
+    case SHUNT_TYPE_UNIX:
       {
         SocketShunt *socket_shunt = (SocketShunt *) shunt;
 
         if (!shunt->can_write)
         {
-          flow_close_socket_fd (socket_shunt->fd);
-          socket_shunt->fd = -1;
+          close_socket_shunt_fd (shunt);
         }
         else if (shutdown (socket_shunt->fd, SHUT_RD) < 0)
         {
@@ -865,6 +1166,21 @@ close_read_fd (FlowShunt *shunt)
       }
       break;
 
+    case SHUNT_TYPE_SHM:
+      {
+        ShmShunt *shm_shunt = (ShmShunt *) shunt;
+
+        /* Tell the peer to stop writing, and wake it up in case it's
+         * waiting for space. The mapping is released on finalize. */
+
+        if (shm_shunt->header)
+        {
+          g_atomic_int_set (&shm_shunt->rx_ring->reader_closed, 1);
+          shm_doorbell_ring (shm_shunt->peer_doorbell_fd);
+        }
+      }
+      break;
+
     case SHUNT_TYPE_FILE:
       {
         FileShunt *file_shunt = (FileShunt *) shunt;
@@ -899,13 +1215,14 @@ close_write_fd (FlowShunt *shunt)
     case SHUNT_TYPE_TCP_LISTENER:
     case SHUNT_TYPE_TCP:
     case SHUNT_TYPE_UDP:
+    case SHUNT_TYPE_UNIX_LISTENER:
+    case SHUNT_TYPE_UNIX:
       {
         SocketShunt *socket_shunt = (SocketShunt *) shunt;
 
         if (!shunt->can_read)
         {
-          flow_close_socket_fd (socket_shunt->fd);
-          socket_shunt->fd = -1;
+          close_socket_shunt_fd (shunt);
         }
         else if (shutdown (socket_shunt->fd, SHUT_WR) < 0)
         {
@@ -925,6 +1242,21 @@ close_write_fd (FlowShunt *shunt)
       }
       break;
 
+    case SHUNT_TYPE_SHM:
+      {
+        ShmShunt *shm_shunt = (ShmShunt *) shunt;
+
+        /* The peer sees EOF once it has drained the ring */
+
+        if (shm_shunt->hangup_fd >= 0 && shutdown (shm_shunt->hangup_fd, SHUT_WR) < 0)
+        {
+          gint saved_errno = errno;
+
+          assert_non_fatal_errno (saved_errno, tcp_shutdown_fatal_errnos);
+        }
+      }
+      break;
+
     case SHUNT_TYPE_FILE:
       {
         FileShunt *file_shunt = (FileShunt *) shunt;
@@ -994,123 +1326,386 @@ tcp_socket_set_quality (gint fd, FlowQuality quality)
   }
 }
 
-/* Must be called after storing child PID */
+#if defined (TCP_CORK)
+# define TCP_CORK_OPTION TCP_CORK
+#elif defined (TCP_NOPUSH)
+# define TCP_CORK_OPTION TCP_NOPUSH
+#endif
+
 static void
-register_pipe_shunt (FlowShunt *shunt)
+tcp_shunt_set_corked (FlowShunt *shunt, gboolean corked)
 {
-  PipeShunt *pipe_shunt = (PipeShunt *) shunt;
+#ifdef TCP_CORK_OPTION
+  TcpShunt *tcp_shunt = (TcpShunt *) shunt;
+  gint      value     = corked ? 1 : 0;
 
-  g_ptr_array_add (pid_shunts, shunt);
+  if (tcp_shunt->corked == (corked ? 1 : 0) || tcp_shunt->socket_shunt.fd < 0)
+    return;
 
-  if (pipe_shunt->child_pid > 0)
-    g_array_append_val (active_pids, pipe_shunt->child_pid);
-}
+  if (setsockopt (tcp_shunt->socket_shunt.fd, IPPROTO_TCP, TCP_CORK_OPTION, &value, sizeof (value)) < 0)
+    assert_non_fatal_errno (errno, setsockopt_fatal_errnos);
 
-static void
-unregister_pipe_shunt (FlowShunt *shunt)
-{
-  g_ptr_array_remove_fast (pid_shunts, shunt);
+  tcp_shunt->corked = corked ? TRUE : FALSE;
+#endif
 }
 
-static void
-child_exited (GPid pid, gint status)
+#ifdef USE_MSG_ZEROCOPY
+
+/* Releases packets for completed sends on fd. Completions for a TCP socket
+ * are reported in order, so we only need the upper end of each range.
+ * Returns TRUE if the kernel reported that it had to copy the data. */
+static gboolean
+reap_zerocopy_completions (gint fd, GQueue *pending, gsize *pending_bytes)
 {
-  gint i;
+  gboolean copied = FALSE;
+  gint     i;
 
-  for (i = 0; i < pid_shunts->len; i++)
+  for (i = 0; i < N_LOOP_ITERATIONS_MAX && !g_queue_is_empty (pending); i++)
   {
-    FlowShunt *shunt = g_ptr_array_index (pid_shunts, i);
-    PipeShunt *pipe_shunt = (PipeShunt *) shunt;
+    struct msghdr   msg;
+    struct cmsghdr *cmsg;
+    guint8          control [128];
 
-    if (pipe_shunt->child_pid == pid)
+    memset (&msg, 0, sizeof (msg));
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof (control);
+
+    if (recvmsg (fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+      break;
+
+    for (cmsg = CMSG_FIRSTHDR (&msg); cmsg; cmsg = CMSG_NXTHDR (&msg, cmsg))
     {
-      pipe_shunt->result = status;
-      pipe_shunt->child_pid = -1;
+      struct sock_extended_err *serr;
+      ZerocopySend             *zc_send;
 
-      if (shunt->dispatched_end)
+      if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+          !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))
+        continue;
+
+      serr = (struct sock_extended_err *) CMSG_DATA (cmsg);
+      if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+        continue;
+
+      while ((zc_send = g_queue_peek_head (pending)) &&
+             (gint32) (zc_send->last_id - serr->ee_data) <= 0)
       {
-        /* FIXME: Use WEXITSTATUS only if WIFEXITED (status) is true, and report
-         * reason for termination. */
-        report_process_result (shunt, WEXITSTATUS (status));
+        g_queue_pop_head (pending);
+        *pending_bytes -= zc_send->n_bytes;
+        flow_packet_unref (zc_send->packet);
+        g_slice_free (ZerocopySend, zc_send);
       }
-      break;
+
+      if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+        copied = TRUE;
     }
   }
+
+  return copied;
 }
 
 static void
-handle_child_exits (void)
+tcp_shunt_reap_zerocopy (FlowShunt *shunt)
 {
-  gint i;
+  TcpShunt *tcp_shunt = (TcpShunt *) shunt;
 
-  /* FIXME: We could use the Linux-specific option __WNOTHREAD to only wait for
-   * children of this thread, and call waitpid() only once. */
+  if (tcp_shunt->socket_shunt.fd < 0)
+    return;
 
-  for (i = 0; i < active_pids->len; i++)
-  {
-    GPid pid = g_array_index (active_pids, GPid, i);
-    pid_t pid_out;
-    gint status;
+  /* If the kernel had to copy anyway (e.g. over loopback), we're paying
+   * for notifications and getting nothing back */
 
-    pid_out = waitpid (pid, &status, WNOHANG);
-    if (pid_out == pid)
-    {
-      child_exited (pid, status);
-      g_array_remove_index_fast (active_pids, i);
-      i--;
-    }
-  }
+  if (reap_zerocopy_completions (tcp_shunt->socket_shunt.fd,
+                                 &tcp_shunt->zerocopy_pending,
+                                 &tcp_shunt->zerocopy_pending_bytes))
+    tcp_shunt->zerocopy = FALSE;
 }
 
-static void
-handle_child_exits_signal (void)
+/* Sends part of a packet with MSG_ZEROCOPY, keeping a ref on the packet
+ * until the kernel reports that it's done with the memory. */
+static gint
+tcp_shunt_send_zerocopy (FlowShunt *shunt, FlowPacket *packet, guint8 *buffer, gint buffer_len)
 {
-  flow_wakeup_pipe_wakeup (&wakeup_pipe);
-}
+  TcpShunt     *tcp_shunt = (TcpShunt *) shunt;
+  ZerocopySend *zc_send;
+  gint          result;
 
-/* -------------------- *
- * Global init/shutdown *
- * -------------------- */
+  if (tcp_shunt->zerocopy_pending_bytes >= ZEROCOPY_PENDING_MAX_BYTES)
+    tcp_shunt_reap_zerocopy (shunt);
 
-static void
-flow_shunt_impl_init (void)
-{
-  /* For all types that are used in multiple threads, make sure they're
-   * initialized in the main thread first. Otherwise, we get a race condition
-   * which may result in two threads trying to initialize it simultaneously. */
+  if (tcp_shunt->zerocopy_pending_bytes >= ZEROCOPY_PENDING_MAX_BYTES)
+  {
+    /* Too much still in flight; copy this one */
+    return send (tcp_shunt->socket_shunt.fd, buffer, buffer_len, MSG_NOSIGNAL);
+  }
 
-  g_type_class_ref (FLOW_TYPE_DETAILED_EVENT);
-  g_type_class_ref (FLOW_TYPE_ANONYMOUS_EVENT);
-  g_type_class_ref (FLOW_TYPE_IP_SERVICE);
-  g_type_class_ref (FLOW_TYPE_POSITION);
+  result = send (tcp_shunt->socket_shunt.fd, buffer, buffer_len, MSG_NOSIGNAL | MSG_ZEROCOPY);
 
-  active_socket_shunts = g_ptr_array_new ();
-  pid_shunts = g_ptr_array_new ();
-  active_pids = g_array_new (FALSE, FALSE, sizeof (GPid));
-  socket_buffer = g_malloc (IO_BUFFER_DEFAULT_SIZE * MULTI_MSG_MAX);
-  socket_meta = g_new0 (SocketMeta, 1);
-  socket_meta_template = g_new0 (SocketMeta, 1);
-  init_socket_meta_template (IO_BUFFER_DEFAULT_SIZE);
+  if (result < 0 && errno == ENOBUFS)
+  {
+    /* Out of option memory for tracking pinned pages; copy this one */
+    return send (tcp_shunt->socket_shunt.fd, buffer, buffer_len, MSG_NOSIGNAL);
+  }
 
-  flow_wakeup_pipe_init (&wakeup_pipe);
+  if (result <= 0)
+    return result;
 
-  watch_thread = g_thread_new ("FlowShunt watch", (GThreadFunc) socket_shunt_main, NULL);
+  /* The kernel numbers zerocopy sends consecutively, starting at zero. Only
+   * sends that transfer data are counted. */
+
+  zc_send = g_queue_peek_tail (&tcp_shunt->zerocopy_pending);
+
+  if (!zc_send || zc_send->packet != packet)
+  {
+    zc_send = g_slice_new (ZerocopySend);
+    zc_send->packet  = flow_packet_ref (packet);
+    zc_send->n_bytes = 0;
+    g_queue_push_tail (&tcp_shunt->zerocopy_pending, zc_send);
+  }
+
+  zc_send->n_bytes += result;
+  zc_send->last_id = tcp_shunt->zerocopy_next_id++;
+
+  tcp_shunt->zerocopy_pending_bytes += result;
+  return result;
 }
 
-static void
-flow_shunt_impl_finalize (void)
+/* If the kernel may still be sending from our packets, hands the socket
+ * over to the watch thread, which closes it once all sends complete.
+ * Returns TRUE if it did so. */
+static gboolean
+tcp_shunt_orphan_zerocopy (FlowShunt *shunt)
 {
-  flow_wakeup_pipe_destroy (&wakeup_pipe);
+  TcpShunt       *tcp_shunt = (TcpShunt *) shunt;
+  ZerocopyOrphan *orphan;
 
-  g_ptr_array_free (active_socket_shunts, TRUE);
-  active_socket_shunts = NULL;
+  if (g_queue_is_empty (&tcp_shunt->zerocopy_pending))
+    return FALSE;
 
-  g_ptr_array_free (pid_shunts, TRUE);
-  pid_shunts = NULL;
+  tcp_shunt_reap_zerocopy (shunt);
+
+  if (g_queue_is_empty (&tcp_shunt->zerocopy_pending))
+    return FALSE;
+
+  /* Queued data still goes out, followed by FIN, like on close () */
+
+  if (shutdown (tcp_shunt->socket_shunt.fd, SHUT_RDWR) < 0)
+    assert_non_fatal_errno (errno, tcp_shutdown_fatal_errnos);
+
+  orphan = g_slice_new (ZerocopyOrphan);
+  orphan->fd            = tcp_shunt->socket_shunt.fd;
+  orphan->pending       = tcp_shunt->zerocopy_pending;
+  orphan->pending_bytes = tcp_shunt->zerocopy_pending_bytes;
+
+  g_queue_init (&tcp_shunt->zerocopy_pending);
+  tcp_shunt->zerocopy_pending_bytes = 0;
+
+  g_ptr_array_add (zerocopy_orphans, orphan);
+  flow_wakeup_pipe_wakeup (&wakeup_pipe);
+  return TRUE;
+}
+
+/* Called by the watch thread */
+static void
+reap_zerocopy_orphans (void)
+{
+  guint i;
+
+  for (i = 0; i < zerocopy_orphans->len; )
+  {
+    ZerocopyOrphan *orphan = g_ptr_array_index (zerocopy_orphans, i);
+
+    reap_zerocopy_completions (orphan->fd, &orphan->pending, &orphan->pending_bytes);
+
+    if (!g_queue_is_empty (&orphan->pending))
+    {
+      i++;
+      continue;
+    }
+
+    flow_close_socket_fd (orphan->fd);
+    g_slice_free (ZerocopyOrphan, orphan);
+    g_ptr_array_remove_index_fast (zerocopy_orphans, i);
+  }
+}
+
+/* Used on shutdown. We can't wait for the kernel, so the packets are leaked
+ * rather than freed while it may still be reading them. */
+static void
+abandon_zerocopy_orphans (void)
+{
+  guint i;
+
+  for (i = 0; i < zerocopy_orphans->len; i++)
+  {
+    ZerocopyOrphan *orphan = g_ptr_array_index (zerocopy_orphans, i);
+
+    flow_close_socket_fd (orphan->fd);
+    g_slice_free (ZerocopyOrphan, orphan);
+  }
+
+  g_ptr_array_set_size (zerocopy_orphans, 0);
+}
+
+#endif
+
+static void
+close_socket_shunt_fd (FlowShunt *shunt)
+{
+  SocketShunt *socket_shunt = (SocketShunt *) shunt;
+
+#ifdef USE_MSG_ZEROCOPY
+  if (shunt->shunt_type == SHUNT_TYPE_TCP && tcp_shunt_orphan_zerocopy (shunt))
+  {
+    socket_shunt->fd = -1;
+    return;
+  }
+#endif
+
+  flow_close_socket_fd (socket_shunt->fd);
+  socket_shunt->fd = -1;
+}
+
+static void
+tcp_shunt_free_zerocopy (FlowShunt *shunt)
+{
+  TcpShunt     *tcp_shunt = (TcpShunt *) shunt;
+  ZerocopySend *zc_send;
+
+  /* Sends still in flight went along with the socket when it was closed
+   * (see close_socket_shunt_fd ()), so the kernel is done with these */
+
+  while ((zc_send = g_queue_pop_head (&tcp_shunt->zerocopy_pending)))
+  {
+    flow_packet_unref (zc_send->packet);
+    g_slice_free (ZerocopySend, zc_send);
+  }
+}
+
+/* Must be called after storing child PID */
+static void
+register_pipe_shunt (FlowShunt *shunt)
+{
+  PipeShunt *pipe_shunt = (PipeShunt *) shunt;
+
+  g_ptr_array_add (pid_shunts, shunt);
+
+  if (pipe_shunt->child_pid > 0)
+    g_array_append_val (active_pids, pipe_shunt->child_pid);
+}
+
+static void
+unregister_pipe_shunt (FlowShunt *shunt)
+{
+  g_ptr_array_remove_fast (pid_shunts, shunt);
+}
+
+static void
+child_exited (GPid pid, gint status)
+{
+  gint i;
+
+  for (i = 0; i < pid_shunts->len; i++)
+  {
+    FlowShunt *shunt = g_ptr_array_index (pid_shunts, i);
+    PipeShunt *pipe_shunt = (PipeShunt *) shunt;
+
+    if (pipe_shunt->child_pid == pid)
+    {
+      pipe_shunt->result = status;
+      pipe_shunt->child_pid = -1;
+
+      if (shunt->dispatched_end)
+      {
+        /* FIXME: Use WEXITSTATUS only if WIFEXITED (status) is true, and report
+         * reason for termination. */
+        report_process_result (shunt, WEXITSTATUS (status));
+      }
+      break;
+    }
+  }
+}
+
+static void
+handle_child_exits (void)
+{
+  gint i;
+
+  /* FIXME: We could use the Linux-specific option __WNOTHREAD to only wait for
+   * children of this thread, and call waitpid() only once. */
+
+  for (i = 0; i < active_pids->len; i++)
+  {
+    GPid pid = g_array_index (active_pids, GPid, i);
+    pid_t pid_out;
+    gint status;
+
+    pid_out = waitpid (pid, &status, WNOHANG);
+    if (pid_out == pid)
+    {
+      child_exited (pid, status);
+      g_array_remove_index_fast (active_pids, i);
+      i--;
+    }
+  }
+}
+
+static void
+handle_child_exits_signal (void)
+{
+  flow_wakeup_pipe_wakeup (&wakeup_pipe);
+}
+
+/* -------------------- *
+ * Global init/shutdown *
+ * -------------------- */
+
+static void
+flow_shunt_impl_init (void)
+{
+  /* For all types that are used in multiple threads, make sure they're
+   * initialized in the main thread first. Otherwise, we get a race condition
+   * which may result in two threads trying to initialize it simultaneously. */
+
+  g_type_class_ref (FLOW_TYPE_DETAILED_EVENT);
+  g_type_class_ref (FLOW_TYPE_ANONYMOUS_EVENT);
+  g_type_class_ref (FLOW_TYPE_IP_SERVICE);
+  g_type_class_ref (FLOW_TYPE_POSITION);
+
+  active_socket_shunts = g_ptr_array_new ();
+  pid_shunts = g_ptr_array_new ();
+  active_pids = g_array_new (FALSE, FALSE, sizeof (GPid));
+  zerocopy_orphans = g_ptr_array_new ();
+  socket_buffer = g_malloc (IO_BUFFER_DEFAULT_SIZE * MULTI_MSG_MAX);
+  socket_meta = g_new0 (SocketMeta, 1);
+  socket_meta_template = g_new0 (SocketMeta, 1);
+  init_socket_meta_template (IO_BUFFER_DEFAULT_SIZE);
+
+  flow_wakeup_pipe_init (&wakeup_pipe);
+
+  watch_thread = g_thread_new ("FlowShunt watch", (GThreadFunc) socket_shunt_main, NULL);
+}
+
+static void
+flow_shunt_impl_finalize (void)
+{
+  flow_wakeup_pipe_destroy (&wakeup_pipe);
+
+  g_ptr_array_free (active_socket_shunts, TRUE);
+  active_socket_shunts = NULL;
+
+  g_ptr_array_free (pid_shunts, TRUE);
+  pid_shunts = NULL;
 
   g_array_free (active_pids, TRUE);
   active_pids = NULL;
 
+#ifdef USE_MSG_ZEROCOPY
+  abandon_zerocopy_orphans ();
+#endif
+
+  g_ptr_array_free (zerocopy_orphans, TRUE);
+  zerocopy_orphans = NULL;
+
   g_free (socket_buffer);
   socket_buffer = NULL;
 
@@ -1165,7 +1760,7 @@ flow_shunt_impl_destroy_shunt (FlowShunt *shunt)
   {
     g_ptr_array_remove_fast (active_socket_shunts, shunt);
 
-    if (shunt->shunt_type == SHUNT_TYPE_PIPE)
+    if (shunt->shunt_type == SHUNT_TYPE_PIPE || shunt->shunt_type == SHUNT_TYPE_SHM)
       unregister_pipe_shunt (shunt);
   }
 }
@@ -1196,6 +1791,7 @@ flow_shunt_impl_finalize_shunt (FlowShunt *shunt)
     case SHUNT_TYPE_TCP:
       {
         TcpShunt *tcp_shunt = (TcpShunt *) shunt;
+        tcp_shunt_free_zerocopy (shunt);
         g_slice_free (TcpShunt, tcp_shunt);
       }
       break;
@@ -1214,6 +1810,42 @@ flow_shunt_impl_finalize_shunt (FlowShunt *shunt)
       }
       break;
 
+    case SHUNT_TYPE_UNIX:
+      {
+        UnixShunt   *unix_shunt = (UnixShunt *) shunt;
+        FlowUnixFds *unix_fds;
+
+        while ((unix_fds = g_queue_pop_head (&unix_shunt->pending_fds)))
+          g_object_unref (unix_fds);
+
+        g_slice_free (UnixShunt, unix_shunt);
+      }
+      break;
+
+    case SHUNT_TYPE_UNIX_LISTENER:
+      {
+        UnixListenerShunt *unix_listener_shunt = (UnixListenerShunt *) shunt;
+
+        /* Remove the socket file, so the path can be bound again */
+
+        if (unix_listener_shunt->path)
+        {
+          unlink (unix_listener_shunt->path);
+          g_free (unix_listener_shunt->path);
+        }
+
+        g_slice_free (UnixListenerShunt, unix_listener_shunt);
+      }
+      break;
+
+    case SHUNT_TYPE_SHM:
+      {
+        ShmShunt *shm_shunt = (ShmShunt *) shunt;
+        shm_shunt_free_channel (shm_shunt);
+        g_slice_free (ShmShunt, shm_shunt);
+      }
+      break;
+
     default:
       g_assert_not_reached ();
       break;
@@ -1233,7 +1865,10 @@ flow_shunt_impl_need_reads (FlowShunt *shunt)
     case SHUNT_TYPE_UDP:
     case SHUNT_TYPE_TCP:
     case SHUNT_TYPE_TCP_LISTENER:
+    case SHUNT_TYPE_UNIX:
+    case SHUNT_TYPE_UNIX_LISTENER:
     case SHUNT_TYPE_PIPE:
+    case SHUNT_TYPE_SHM:
       /* Only add once to active_socket_shunts array. Therefore, check that
        * we didn't already add it for the inverse operation. */
       if (!shunt->doing_writes)
@@ -1271,7 +1906,10 @@ flow_shunt_impl_need_writes (FlowShunt *shunt)
     case SHUNT_TYPE_UDP:
     case SHUNT_TYPE_TCP:
     case SHUNT_TYPE_TCP_LISTENER:
+    case SHUNT_TYPE_UNIX:
+    case SHUNT_TYPE_UNIX_LISTENER:
     case SHUNT_TYPE_PIPE:
+    case SHUNT_TYPE_SHM:
       /* Only add once to active_socket_shunts array. Therefore, check that
        * we didn't already add it for the inverse operation. */
       if (!shunt->doing_reads)
@@ -1304,8 +1942,10 @@ flow_shunt_impl_need_writes (FlowShunt *shunt)
  * Socket and Pipe Low-level I/O *
  * ----------------------------- */
 
-static void
-tcp_listener_shunt_read (FlowShunt *shunt)
+/* Accepts one connection. Returns FALSE when there are no more connections
+ * waiting, or when we can't accept any more for now. */
+static gboolean
+tcp_listener_shunt_accept (FlowShunt *shunt)
 {
   FlowSockaddr      sa;
   guint             sa_len             = sizeof (FlowSockaddr);
@@ -1313,7 +1953,12 @@ tcp_listener_shunt_read (FlowShunt *shunt)
   SocketShunt      *socket_shunt       = (SocketShunt *) shunt;
   TcpListenerShunt *tcp_listener_shunt = (TcpListenerShunt *) shunt;
 
+#ifdef HAVE_ACCEPT4
+  /* Saves us the fcntl () round trips when draining a busy listener */
+  new_fd = accept4 (socket_shunt->fd, (struct sockaddr *) &sa, &sa_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
   new_fd = accept (socket_shunt->fd, (struct sockaddr *) &sa, &sa_len);
+#endif
 
   if G_UNLIKELY (new_fd < 0)
   {
@@ -1326,6 +1971,12 @@ tcp_listener_shunt_read (FlowShunt *shunt)
 
     saved_errno = errno;
 
+    /* The accept queue is drained, or another listener sharing the port
+     * got there first */
+
+    if (saved_errno == EAGAIN || saved_errno == EWOULDBLOCK || saved_errno == EINTR)
+      return FALSE;
+
     assert_non_fatal_errno (saved_errno, tcp_accept_fatal_errnos);
 
     /* We silently handle these errors:
@@ -1338,8 +1989,12 @@ tcp_listener_shunt_read (FlowShunt *shunt)
       detailed_event = generate_errno_event (saved_errno, tcp_accept_errno_map);
       flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
       flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
+
+      /* Likely out of descriptors; retrying right away won't help */
+      return FALSE;
     }
   }
+#ifndef HAVE_ACCEPT4
   else if (!flow_socket_set_nonblock (new_fd, TRUE))
   {
     /* Error: Could not set socket nonblock. If this happens, our implementation will
@@ -1347,6 +2002,7 @@ tcp_listener_shunt_read (FlowShunt *shunt)
 
     g_assert_not_reached ();
   }
+#endif
   else
   {
     FlowIPService      *new_ip_service;
@@ -1359,7 +2015,7 @@ tcp_listener_shunt_read (FlowShunt *shunt)
 
     new_tcp_shunt = g_slice_new0 (TcpShunt);
     new_shunt = (FlowShunt *) new_tcp_shunt;
-    flow_shunt_init_common (new_shunt, shunt->shunt_source);
+    flow_shunt_init_common (new_shunt, shunt->accept_source ? shunt->accept_source : shunt->shunt_source);
     new_shunt->shunt_type = SHUNT_TYPE_TCP;
 
     tcp_socket_set_quality (new_fd, tcp_listener_shunt->quality);
@@ -1394,62 +2050,382 @@ tcp_listener_shunt_read (FlowShunt *shunt)
     flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (anonymous_event, 0));
   }
 
-  flow_shunt_read_state_changed (shunt);
+  return TRUE;
 }
 
-#ifdef HAVE_RECVMMSG
-
-/* Efficient recvmmsg() version */
 static void
-udp_shunt_read (FlowShunt *shunt)
+tcp_listener_shunt_read (FlowShunt *shunt)
 {
-  SocketMeta *sm = socket_meta;
-  SocketShunt *socket_shunt = (SocketShunt *) shunt;
-  UdpShunt *udp_shunt = (UdpShunt *) shunt;
-  gint i = 0;
-  guint sa_len = sizeof (FlowSockaddr);
-  gint result;
-  gint saved_errno;
+  gint i;
 
-  memcpy (sm, socket_meta_template, sizeof (*sm));
+  /* Drain the accept queue, so a burst of connections costs one wakeup
+   * instead of one each */
 
-  result = recvmmsg (socket_shunt->fd,
-                     sm->msgs, MULTI_MSG_MAX,
-                     0,
-                     NULL);
-  saved_errno = errno;
+  for (i = 0; i < N_LOOP_ITERATIONS_MAX && tcp_listener_shunt_accept (shunt); i++)
+    ;
 
-  if G_LIKELY (result >= 0)
-  {
-    for (i = 0; i < result; i++)
-    {
-      struct mmsghdr *msg = &sm->msgs [i];
-      FlowPacket *packet;
+  flow_shunt_read_state_changed (shunt);
+}
 
-      /* Data */
+/* Like tcp_listener_shunt_accept (), but for Unix domain sockets. The peer
+ * has no address worth reporting, so no packet precedes the stream. */
+static gboolean
+unix_listener_shunt_accept (FlowShunt *shunt)
+{
+  SocketShunt       *socket_shunt        = (SocketShunt *) shunt;
+  UnixListenerShunt *unix_listener_shunt = (UnixListenerShunt *) shunt;
+  gint               new_fd;
 
-      /* For UDP, dispatch source address first, but only if it changed */
+#ifdef HAVE_ACCEPT4
+  new_fd = accept4 (socket_shunt->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+  new_fd = accept (socket_shunt->fd, NULL, NULL);
+#endif
 
-      if (memcmp (&udp_shunt->remote_src_sa, msg->msg_hdr.msg_name, msg->msg_hdr.msg_namelen))
-      {
-        FlowIPService *ip_service;
+  if G_UNLIKELY (new_fd < 0)
+  {
+    FlowDetailedEvent *detailed_event;
+    gint               saved_errno;
 
-        memcpy (&udp_shunt->remote_src_sa, msg->msg_hdr.msg_name, msg->msg_hdr.msg_namelen);
+    saved_errno = errno;
 
-        ip_service = flow_ip_service_new ();
-        flow_ip_service_set_sockaddr (ip_service, &udp_shunt->remote_src_sa);
+    if (saved_errno == EAGAIN || saved_errno == EWOULDBLOCK || saved_errno == EINTR)
+      return FALSE;
 
-        flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (ip_service, 0));
-      }
+    assert_non_fatal_errno (saved_errno, tcp_accept_fatal_errnos);
 
-      packet = flow_packet_new (FLOW_PACKET_FORMAT_BUFFER, sm->iovecs [i].iov_base, msg->msg_len);
-      flow_packet_queue_push_packet (shunt->read_queue, packet);
+    if (saved_errno != ECONNABORTED)
+    {
+      detailed_event = generate_errno_event (saved_errno, tcp_accept_errno_map);
+      flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
+      flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
+      return FALSE;
     }
   }
-  else if (saved_errno == EINTR
-           || saved_errno == ECONNREFUSED  /* Destination/port unreachable */
-           || saved_errno == EAGAIN
-           || saved_errno == EWOULDBLOCK)
+#ifndef HAVE_ACCEPT4
+  else if (!flow_socket_set_nonblock (new_fd, TRUE))
+  {
+    g_assert_not_reached ();
+  }
+#endif
+  else
+  {
+    FlowShunt          *new_shunt;
+    UnixShunt          *new_unix_shunt;
+    FlowAnonymousEvent *anonymous_event;
+#ifdef USE_SO_NOSIGPIPE
+    gint                on = 1;
+#endif
+
+    new_unix_shunt = g_slice_new0 (UnixShunt);
+    new_shunt = (FlowShunt *) new_unix_shunt;
+    flow_shunt_init_common (new_shunt, shunt->accept_source ? shunt->accept_source : shunt->shunt_source);
+    new_shunt->shunt_type = SHUNT_TYPE_UNIX;
+
+#ifdef USE_SO_NOSIGPIPE
+    /* For MacOS X, BSD */
+    setsockopt (new_fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof (on));
+#endif
+
+    new_unix_shunt->socket_shunt.fd = new_fd;
+    new_unix_shunt->seqpacket = unix_listener_shunt->seqpacket;
+    g_queue_init (&new_unix_shunt->pending_fds);
+
+    new_shunt->can_read  = TRUE;
+    new_shunt->can_write = TRUE;
+
+    flow_shunt_read_state_changed (new_shunt);
+    flow_shunt_write_state_changed (new_shunt);
+
+    /* Queue shunt on listener */
+
+    anonymous_event = flow_anonymous_event_new ();
+    flow_anonymous_event_set_data (anonymous_event, new_shunt);
+    flow_anonymous_event_set_destroy_notify (anonymous_event, (GDestroyNotify) flow_shunt_destroy);
+    flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (anonymous_event, 0));
+  }
+
+  return TRUE;
+}
+
+static void
+unix_listener_shunt_read (FlowShunt *shunt)
+{
+  gint i;
+
+  for (i = 0; i < N_LOOP_ITERATIONS_MAX && unix_listener_shunt_accept (shunt); i++)
+    ;
+
+  flow_shunt_read_state_changed (shunt);
+}
+
+/* Reads one chunk of stream data, or one message in seqpacket mode.
+ * Descriptors that came with it are queued in a FlowUnixFds first. */
+static void
+unix_shunt_read (FlowShunt *shunt)
+{
+  SocketShunt    *socket_shunt = (SocketShunt *) shunt;
+  UnixShunt      *unix_shunt   = (UnixShunt *) shunt;
+  union
+  {
+    struct cmsghdr align;
+    guint8         buf [CMSG_SPACE (sizeof (gint) * FLOW_UNIX_FDS_MAX)];
+  }
+  control;
+  struct msghdr   msg;
+  struct iovec    iov;
+  struct cmsghdr *cmsg;
+  FlowUnixFds    *unix_fds     = NULL;
+  gint            result;
+  gint            saved_errno;
+
+  iov.iov_base = socket_buffer;
+  iov.iov_len  = shunt->io_buffer_size;
+
+  memset (&msg, 0, sizeof (msg));
+  msg.msg_iov        = &iov;
+  msg.msg_iovlen     = 1;
+  msg.msg_control    = control.buf;
+  msg.msg_controllen = sizeof (control.buf);
+
+  errno = 0;
+  result = recvmsg (socket_shunt->fd, &msg, UNIX_RECV_FLAGS);
+  saved_errno = errno;
+
+  if (result >= 0)
+  {
+    for (cmsg = CMSG_FIRSTHDR (&msg); cmsg; cmsg = CMSG_NXTHDR (&msg, cmsg))
+    {
+      gint n_fds;
+      gint i;
+
+      if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+        continue;
+
+      n_fds = (cmsg->cmsg_len - CMSG_LEN (0)) / sizeof (gint);
+
+      for (i = 0; i < n_fds; i++)
+      {
+        gint fd;
+
+        memcpy (&fd, (guint8 *) CMSG_DATA (cmsg) + i * sizeof (gint), sizeof (gint));
+
+#ifdef UNIX_RECV_SET_CLOEXEC
+        fcntl (fd, F_SETFD, FD_CLOEXEC);
+#endif
+
+        if (!unix_fds)
+          unix_fds = flow_unix_fds_new ();
+
+        flow_unix_fds_take_fd (unix_fds, fd);
+      }
+    }
+
+    if G_UNLIKELY (msg.msg_flags & (MSG_CTRUNC | MSG_TRUNC))
+    {
+      FlowDetailedEvent *detailed_event;
+
+      /* The sender passed more descriptors than we take at once, and the
+       * kernel closed the rest, or the message didn't fit in our buffer.
+       * Either way, what we got is incomplete. */
+
+      detailed_event = flow_detailed_event_new_literal ("Oversized message");
+      flow_detailed_event_add_code (detailed_event, FLOW_SOCKET_DOMAIN, FLOW_SOCKET_OVERSIZED_PACKET);
+      flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
+
+      /* A truncated message is dropped along with its descriptors, which
+       * are closed. Stream data is still good. */
+
+      if (unix_shunt->seqpacket && (msg.msg_flags & MSG_TRUNC))
+      {
+        if (unix_fds)
+          g_object_unref (unix_fds);
+
+        flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
+        flow_shunt_read_state_changed (shunt);
+        return;
+      }
+
+      if (unix_fds)
+        flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (unix_fds, 0));
+
+      flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
+    }
+    else if (unix_fds)
+    {
+      flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (unix_fds, 0));
+    }
+  }
+
+  if G_LIKELY (result > 0)
+  {
+    FlowPacket *packet;
+
+    packet = flow_packet_new (FLOW_PACKET_FORMAT_BUFFER, socket_buffer, result);
+    flow_packet_queue_push_packet (shunt->read_queue, packet);
+  }
+  else if (saved_errno == EINTR || saved_errno == EAGAIN || saved_errno == EWOULDBLOCK)
+  {
+    /* Do nothing */
+  }
+  else
+  {
+    /* End stream */
+
+    assert_non_fatal_errno (saved_errno, tcp_recv_fatal_errnos);
+
+    g_assert (shunt->dispatched_end == FALSE);
+
+    shunt->dispatched_end = TRUE;
+
+    generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_SEGMENT_END);
+    generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_END);
+    close_read_fd (shunt);
+  }
+
+  flow_shunt_read_state_changed (shunt);
+}
+
+/* Sends a buffer, attaching the descriptors of any pending FlowUnixFds
+ * objects. They are released once the kernel has accepted them along with
+ * at least one byte of data. */
+static gint
+unix_shunt_send (FlowShunt *shunt, guint8 *buffer, gint buffer_len)
+{
+  SocketShunt    *socket_shunt = (SocketShunt *) shunt;
+  UnixShunt      *unix_shunt   = (UnixShunt *) shunt;
+  union
+  {
+    struct cmsghdr align;
+    guint8         buf [CMSG_SPACE (sizeof (gint) * FLOW_UNIX_FDS_MAX)];
+  }
+  control;
+  struct msghdr   msg;
+  struct iovec    iov;
+  struct cmsghdr *cmsg;
+  GList          *l;
+  gint            fds [FLOW_UNIX_FDS_MAX];
+  guint           n_objects    = 0;
+  gint            n_fds        = 0;
+  gint            result;
+
+  if G_LIKELY (g_queue_is_empty (&unix_shunt->pending_fds))
+    return send (socket_shunt->fd, buffer, buffer_len, MSG_NOSIGNAL);
+
+  /* Gather descriptors from as many whole objects as fit in one message */
+
+  for (l = unix_shunt->pending_fds.head; l; l = g_list_next (l))
+  {
+    FlowUnixFds *unix_fds = l->data;
+    guint        n        = flow_unix_fds_get_n_fds (unix_fds);
+    guint        i;
+
+    if (n_fds + n > FLOW_UNIX_FDS_MAX)
+      break;
+
+    for (i = 0; i < n; i++)
+    {
+      gint fd = flow_unix_fds_get_nth_fd (unix_fds, i);
+
+      if (fd >= 0)
+        fds [n_fds++] = fd;
+    }
+
+    n_objects++;
+  }
+
+  iov.iov_base = buffer;
+  iov.iov_len  = buffer_len;
+
+  memset (&msg, 0, sizeof (msg));
+  msg.msg_iov    = &iov;
+  msg.msg_iovlen = 1;
+
+  if (n_fds > 0)
+  {
+    msg.msg_control    = control.buf;
+    msg.msg_controllen = CMSG_SPACE (sizeof (gint) * n_fds);
+
+    cmsg = CMSG_FIRSTHDR (&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_RIGHTS;
+    cmsg->cmsg_len   = CMSG_LEN (sizeof (gint) * n_fds);
+    memcpy (CMSG_DATA (cmsg), fds, sizeof (gint) * n_fds);
+  }
+
+  result = sendmsg (socket_shunt->fd, &msg, MSG_NOSIGNAL);
+
+  if (result > 0)
+  {
+    /* The kernel holds its own references to the descriptors now */
+
+    while (n_objects--)
+      g_object_unref (g_queue_pop_head (&unix_shunt->pending_fds));
+  }
+
+  return result;
+}
+
+#ifdef HAVE_RECVMMSG
+
+/* Efficient recvmmsg() version */
+static void
+udp_shunt_read (FlowShunt *shunt)
+{
+  SocketMeta *sm = socket_meta;
+  SocketShunt *socket_shunt = (SocketShunt *) shunt;
+  UdpShunt *udp_shunt = (UdpShunt *) shunt;
+  gint i = 0;
+  guint sa_len = sizeof (FlowSockaddr);
+  gint result;
+  gint saved_errno;
+
+  memcpy (sm, socket_meta_template, sizeof (*sm));
+
+  result = recvmmsg (socket_shunt->fd,
+                     sm->msgs, MULTI_MSG_MAX,
+                     0,
+                     NULL);
+  saved_errno = errno;
+
+  if G_LIKELY (result >= 0)
+  {
+    for (i = 0; i < result; i++)
+    {
+      struct mmsghdr *msg = &sm->msgs [i];
+      FlowPacket *packet;
+
+      /* Data */
+
+      if (udp_shunt->peer_tagged)
+      {
+        packet = new_peer_tagged_packet (msg->msg_hdr.msg_name, sm->iovecs [i].iov_base, msg->msg_len);
+        flow_packet_queue_push_packet (shunt->read_queue, packet);
+        continue;
+      }
+
+      /* For UDP, dispatch source address first, but only if it changed */
+
+      if (memcmp (&udp_shunt->remote_src_sa, msg->msg_hdr.msg_name, msg->msg_hdr.msg_namelen))
+      {
+        FlowIPService *ip_service;
+
+        memcpy (&udp_shunt->remote_src_sa, msg->msg_hdr.msg_name, msg->msg_hdr.msg_namelen);
+
+        ip_service = flow_ip_service_new ();
+        flow_ip_service_set_sockaddr (ip_service, &udp_shunt->remote_src_sa);
+
+        flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (ip_service, 0));
+      }
+
+      packet = flow_packet_new (FLOW_PACKET_FORMAT_BUFFER, sm->iovecs [i].iov_base, msg->msg_len);
+      flow_packet_queue_push_packet (shunt->read_queue, packet);
+    }
+  }
+  else if (saved_errno == EINTR
+           || saved_errno == ECONNREFUSED  /* Destination/port unreachable */
+           || saved_errno == EAGAIN
+           || saved_errno == EWOULDBLOCK)
   {
     /* Do nothing */
   }
@@ -1500,6 +2476,13 @@ udp_shunt_read (FlowShunt *shunt)
 
       /* Data */
 
+      if (udp_shunt->peer_tagged)
+      {
+        packet = new_peer_tagged_packet (&sa, socket_buffer, result);
+        flow_packet_queue_push_packet (shunt->read_queue, packet);
+        continue;
+      }
+
       /* For UDP, dispatch source address first, but only if it changed */
 
       if (memcmp (&udp_shunt->remote_src_sa, &sa, sa_len))
@@ -1559,6 +2542,15 @@ socket_shunt_read (FlowShunt *shunt)
   if G_UNLIKELY (!shunt->dispatched_begin)
     return;
 
+#ifdef USE_MSG_ZEROCOPY
+  /* Completions make the socket readable too, so we get them here when
+   * there's nothing more to write */
+
+  if (shunt->shunt_type == SHUNT_TYPE_TCP &&
+      !g_queue_is_empty (&((TcpShunt *) shunt)->zerocopy_pending))
+    tcp_shunt_reap_zerocopy (shunt);
+#endif
+
 #else
 
   if G_UNLIKELY (!shunt->dispatched_begin)
@@ -1587,6 +2579,16 @@ socket_shunt_read (FlowShunt *shunt)
     udp_shunt_read (shunt);
     return;
   }
+  else if (shunt->shunt_type == SHUNT_TYPE_UNIX_LISTENER)
+  {
+    unix_listener_shunt_read (shunt);
+    return;
+  }
+  else if (shunt->shunt_type == SHUNT_TYPE_UNIX)
+  {
+    unix_shunt_read (shunt);
+    return;
+  }
 
   switch (shunt->shunt_type)
   {
@@ -1655,14 +2657,14 @@ socket_shunt_read (FlowShunt *shunt)
 }
 
 static FlowDetailedEvent *
-get_connect_error_from_tcp_shunt (FlowShunt *shunt)
+get_connect_error_from_socket_shunt (FlowShunt *shunt)
 {
   SocketShunt       *socket_shunt   = (SocketShunt *) shunt;
   FlowDetailedEvent *detailed_event = NULL;
   gint               err            = 0;
   guint              err_len        = sizeof (err);
 
-  g_assert (shunt->shunt_type == SHUNT_TYPE_TCP);
+  g_assert (shunt->shunt_type == SHUNT_TYPE_TCP || shunt->shunt_type == SHUNT_TYPE_UNIX);
 
   /* Was the connection attempt successful? */
 
@@ -1778,7 +2780,32 @@ udp_shunt_write (FlowShunt *shunt)
       if (flow_packet_get_format (packet) != FLOW_PACKET_FORMAT_BUFFER)
         break;
 
-      if (udp_shunt->remote_dest_is_valid)
+      if (udp_shunt->peer_tagged)
+      {
+        /* Each datagram carries its own destination, so one batch can
+         * span many peers */
+
+        if (!get_peer_tagged_sockaddr (packet, &sm->sa [i]))
+        {
+          /* Send what we have first, so the bad packet is at the head
+           * of the queue when we drop it */
+
+          if (i > 0)
+            break;
+
+          g_warning ("Attempted write of UDP datagram with no valid peer address.");
+          flow_packet_queue_drop_packet (shunt->write_queue);
+          iter = NULL;
+          continue;
+        }
+
+        sm->iovecs [i].iov_base = (guint8 *) flow_packet_get_data (packet) + sizeof (FlowIPEndpoint);
+        sm->iovecs [i].iov_len = flow_packet_get_size (packet) - sizeof (FlowIPEndpoint);
+        msg->msg_len = sm->iovecs [i].iov_len;
+        msg->msg_hdr.msg_name = &sm->sa [i];
+        msg->msg_hdr.msg_namelen = flow_sockaddr_get_len (&sm->sa [i]);
+      }
+      else if (udp_shunt->remote_dest_is_valid)
       {
         sm->iovecs [i].iov_base = flow_packet_get_data (packet);
         sm->iovecs [i].iov_len = flow_packet_get_size (packet);
@@ -1846,14 +2873,15 @@ out:
 static void
 socket_shunt_write (FlowShunt *shunt)
 {
-  gint i;
+  gboolean auto_cork;
+  gint     i;
 
   if G_UNLIKELY (!shunt->dispatched_begin)
   {
     FlowDetailedEvent *detailed_event = NULL;
 
-    if (shunt->shunt_type == SHUNT_TYPE_TCP)
-      detailed_event = get_connect_error_from_tcp_shunt (shunt);
+    if (shunt->shunt_type == SHUNT_TYPE_TCP || shunt->shunt_type == SHUNT_TYPE_UNIX)
+      detailed_event = get_connect_error_from_socket_shunt (shunt);
 
     if (!detailed_event)
     {
@@ -1893,6 +2921,19 @@ socket_shunt_write (FlowShunt *shunt)
   }
 #endif
 
+  /* In auto-cork mode, we cork the socket while there's more than one packet
+   * queued, so a burst of small writes goes out in full segments. When the
+   * queue drains or the user flushes, we uncork and the tail goes out at
+   * once, since TCP_NODELAY is also set. */
+
+  auto_cork = shunt->shunt_type == SHUNT_TYPE_TCP && ((TcpShunt *) shunt)->auto_cork;
+
+#ifdef USE_MSG_ZEROCOPY
+  if (shunt->shunt_type == SHUNT_TYPE_TCP &&
+      !g_queue_is_empty (&((TcpShunt *) shunt)->zerocopy_pending))
+    tcp_shunt_reap_zerocopy (shunt);
+#endif
+
   for (i = 0; i < N_LOOP_ITERATIONS_MAX && !shunt->was_destroyed; i++)
   {
     FlowPacket       *packet;
@@ -1905,6 +2946,10 @@ socket_shunt_write (FlowShunt *shunt)
       break;
     }
 
+    if (auto_cork && !((TcpShunt *) shunt)->corked &&
+        flow_packet_queue_get_length_packets (shunt->write_queue) > 1)
+      tcp_shunt_set_corked (shunt, TRUE);
+
     packet_format = flow_packet_get_format (packet);
 
     if G_LIKELY (packet_format == FLOW_PACKET_FORMAT_BUFFER)
@@ -1923,14 +2968,41 @@ socket_shunt_write (FlowShunt *shunt)
       {
         SocketShunt *socket_shunt = (SocketShunt *) shunt;
 
-        result = send (socket_shunt->fd, buffer, buffer_len, MSG_NOSIGNAL);
+#ifdef USE_MSG_ZEROCOPY
+        if (((TcpShunt *) shunt)->zerocopy && buffer_len >= ZEROCOPY_MIN_BYTES)
+          result = tcp_shunt_send_zerocopy (shunt, packet, buffer, buffer_len);
+        else
+#endif
+          result = send (socket_shunt->fd, buffer, buffer_len, MSG_NOSIGNAL);
+      }
+      else if (shunt->shunt_type == SHUNT_TYPE_UNIX)
+      {
+        result = unix_shunt_send (shunt, buffer, buffer_len);
       }
       else if (shunt->shunt_type == SHUNT_TYPE_UDP)
       {
         SocketShunt *socket_shunt = (SocketShunt *) shunt;
         UdpShunt    *udp_shunt    = (UdpShunt *) shunt;
 
-        if (udp_shunt->remote_dest_is_valid)
+        if (udp_shunt->peer_tagged)
+        {
+          FlowSockaddr sa;
+
+          if (get_peer_tagged_sockaddr (packet, &sa))
+          {
+            result = sendto (socket_shunt->fd, buffer + sizeof (FlowIPEndpoint),
+                             buffer_len - sizeof (FlowIPEndpoint), MSG_NOSIGNAL,
+                             (struct sockaddr *) &sa, flow_sockaddr_get_len (&sa));
+            if (result >= 0)
+              result = buffer_len;
+          }
+          else
+          {
+            g_warning ("Attempted write of UDP datagram with no valid peer address.");
+            result = buffer_len;
+          }
+        }
+        else if (udp_shunt->remote_dest_is_valid)
         {
           result = sendto (socket_shunt->fd, buffer, buffer_len, MSG_NOSIGNAL,
                            (struct sockaddr *) &udp_shunt->remote_dest_sa,
@@ -2010,6 +3082,12 @@ socket_shunt_write (FlowShunt *shunt)
       {
         FlowDetailedEvent *detailed_event = (FlowDetailedEvent *) object;
 
+        if (auto_cork && flow_detailed_event_matches (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_FLUSH))
+        {
+          /* Push out what we have; the next burst will cork again */
+          tcp_shunt_set_corked (shunt, FALSE);
+        }
+
         if (flow_detailed_event_matches (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_END) ||
             flow_detailed_event_matches (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED))
         {
@@ -2033,6 +3111,21 @@ socket_shunt_write (FlowShunt *shunt)
           }
         }
       }
+      else if (FLOW_IS_SOCKOPT_OP (object) &&
+               (shunt->shunt_type == SHUNT_TYPE_TCP || shunt->shunt_type == SHUNT_TYPE_UDP ||
+                shunt->shunt_type == SHUNT_TYPE_UNIX))
+      {
+        /* Everything queued before this has been written, so the options
+         * take effect exactly at this point in the stream */
+
+        apply_sockopt_op (shunt, ((SocketShunt *) shunt)->fd, (FlowSockoptOp *) object);
+      }
+      else if (FLOW_IS_UNIX_FDS (object) && shunt->shunt_type == SHUNT_TYPE_UNIX)
+      {
+        /* Hold on to it until there's data to carry the descriptors */
+
+        g_queue_push_tail (&((UnixShunt *) shunt)->pending_fds, g_object_ref (object));
+      }
       else if (shunt->shunt_type == SHUNT_TYPE_UDP)
       {
         SocketShunt *socket_shunt = (SocketShunt *) shunt;
@@ -2094,6 +3187,9 @@ socket_shunt_write (FlowShunt *shunt)
     }
   }
 
+  if (auto_cork && flow_packet_queue_get_length_packets (shunt->write_queue) == 0)
+    tcp_shunt_set_corked (shunt, FALSE);
+
   flow_shunt_write_state_changed (shunt);
 }
 
@@ -2109,8 +3205,8 @@ socket_shunt_exception (FlowShunt *shunt)
     shunt->dispatched_begin = TRUE;
     shunt->dispatched_end   = TRUE;
 
-    if (shunt->shunt_type == SHUNT_TYPE_TCP)
-      detailed_event = get_connect_error_from_tcp_shunt (shunt);
+    if (shunt->shunt_type == SHUNT_TYPE_TCP || shunt->shunt_type == SHUNT_TYPE_UNIX)
+      detailed_event = get_connect_error_from_socket_shunt (shunt);
 
     if (detailed_event)
     {
@@ -2139,328 +3235,331 @@ socket_shunt_exception (FlowShunt *shunt)
   flow_shunt_write_state_changed (shunt);
 }
 
-static void
-install_sigchld_handler (void)
+/* -------------------------------- *
+ * Shared Memory Ring Low-level I/O *
+ * -------------------------------- */
+
+/* The peer can write anything it likes to the mapping, so the positions
+ * are checked every time they're used. */
+static inline guint
+shm_ring_get_fill (ShmRing *ring, guint ring_size)
 {
-  struct sigaction sa;
-
-  memset (&sa, 0, sizeof (sa));
+  guint fill;
 
-  sa.sa_handler = (void (*)(int)) handle_child_exits_signal;
-  sa.sa_flags = SA_NOCLDSTOP;
+  fill = (guint) g_atomic_int_get (&ring->tail) - (guint) g_atomic_int_get (&ring->head);
+  return fill <= ring_size ? fill : SHM_RING_FILL_INVALID;
+}
 
-  sigemptyset (&sa.sa_mask);
+static void
+shm_doorbell_ring (gint fd)
+{
+  guint64 value = 1;
 
-  sigaction (SIGCHLD, &sa, NULL);
+  while (write (fd, &value, sizeof (value)) < 0 && errno == EINTR)
+    ;
 }
 
-static gpointer
-socket_shunt_main (void)
+static void
+shm_doorbell_clear (gint fd)
 {
-  flow_shunt_impl_lock ();
-
-  /* Implementation finalized? */
-  if (!flow_wakeup_pipe_is_valid (&wakeup_pipe))
-    goto out;
+  guint64 value;
 
-  for (;;)
-  {
-    fd_set  read_fds;
-    fd_set  write_fds;
-    fd_set  exception_fds;
-    gint    fd_max = flow_wakeup_pipe_get_watch_fd (&wakeup_pipe);
-    gint    result;
-    guint   i;
+  while (read (fd, &value, sizeof (value)) < 0 && errno == EINTR)
+    ;
+}
 
-    /* Clear sets */
+/* Returns TRUE if there is something to read. Otherwise, asks the writer
+ * to ring our doorbell when there is. We check again after asking, in case
+ * the writer added data before it could see the request. A corrupt ring
+ * counts as readable, so the reader gets to notice. */
+static gboolean
+shm_ring_arm_reader (ShmRing *ring, guint ring_size)
+{
+  if (shm_ring_get_fill (ring, ring_size) != 0)
+    return TRUE;
 
-    FD_ZERO (&read_fds);
-    FD_ZERO (&write_fds);
-    FD_ZERO (&exception_fds);
+  g_atomic_int_set (&ring->reader_waiting, 1);
+  return shm_ring_get_fill (ring, ring_size) != 0;
+}
 
-    /* Add wakeup pipe to set */
+/* Like shm_ring_arm_reader (), but waits for free space or for the reader
+ * to go away */
+static gboolean
+shm_ring_arm_writer (ShmRing *ring, guint ring_size)
+{
+  if (g_atomic_int_get (&ring->reader_closed) ||
+      shm_ring_get_fill (ring, ring_size) != ring_size)
+    return TRUE;
 
-    FD_SET (flow_wakeup_pipe_get_watch_fd (&wakeup_pipe), &read_fds);
+  g_atomic_int_set (&ring->writer_waiting, 1);
+  return g_atomic_int_get (&ring->reader_closed) ||
+         shm_ring_get_fill (ring, ring_size) != ring_size;
+}
 
-    /* Add other fds to sets, clean out array */
+/* Copies as much of src as fits, and returns the number of bytes copied.
+ * Returns 0 and sets tx_closed or corrupt if nothing more can be written. */
+static guint
+shm_shunt_write_to_ring (ShmShunt *shm_shunt, const guint8 *src, guint len)
+{
+  ShmRing *ring      = shm_shunt->tx_ring;
+  guint    ring_size = shm_shunt->ring_size;
+  guint    fill;
+  guint    tail;
+  guint    offset;
+  guint    chunk;
 
-    for (i = 0; i < active_socket_shunts->len; )
-    {
-      FlowShunt *shunt = g_ptr_array_index (active_socket_shunts, i);
-      gint       read_fd;
-      gint       write_fd;
+  if (shm_shunt->tx_closed || shm_shunt->corrupt)
+    return 0;
 
-      if (shunt->shunt_type == SHUNT_TYPE_PIPE)
-      {
-        PipeShunt *pipe_shunt = (PipeShunt *) shunt;
+  if (g_atomic_int_get (&ring->reader_closed))
+  {
+    shm_shunt->tx_closed = TRUE;
+    return 0;
+  }
 
-        read_fd  = pipe_shunt->read_fd;
-        write_fd = pipe_shunt->write_fd;
-      }
-      else
-      {
-        SocketShunt *socket_shunt = (SocketShunt *) shunt;
+  fill = shm_ring_get_fill (ring, ring_size);
+  if (fill == SHM_RING_FILL_INVALID)
+  {
+    shm_shunt->corrupt = TRUE;
+    return 0;
+  }
 
-        read_fd  = socket_shunt->fd;
-        write_fd = socket_shunt->fd;
-      }
+  len = MIN (len, ring_size - fill);
+  if (len == 0)
+    return 0;
 
-      if (shunt->need_reads)
-      {
-        g_assert (read_fd >= 0);
+  tail   = (guint) ring->tail;
+  offset = tail & (ring_size - 1);
+  chunk  = MIN (len, ring_size - offset);
 
-        FD_SET (read_fd, &read_fds);
-        FD_SET (read_fd, &exception_fds);
-        fd_max = MAX (fd_max, read_fd);
-      }
-      else
-      {
-        shunt->doing_reads = FALSE;
-      }
+  memcpy (shm_shunt->tx_data + offset, src, chunk);
+  memcpy (shm_shunt->tx_data, src + chunk, len - chunk);
 
-      if (shunt->need_writes)
-      {
-        g_assert (write_fd >= 0);
+  /* Publish the data before looking at the flag; see shm_ring_arm_reader () */
 
-        FD_SET (write_fd, &write_fds);
-        FD_SET (write_fd, &exception_fds);
-        fd_max = MAX (fd_max, write_fd);
-      }
-      else
-      {
-        shunt->doing_writes = FALSE;
-      }
+  g_atomic_int_set (&ring->tail, (gint) (tail + len));
 
-      if (!shunt->doing_reads && !shunt->doing_writes)
-      {
-        g_ptr_array_remove_index_fast (active_socket_shunts, i);
-        continue;
-      }
+  if (g_atomic_int_get (&ring->reader_waiting) &&
+      g_atomic_int_compare_and_exchange (&ring->reader_waiting, 1, 0))
+    shm_doorbell_ring (shm_shunt->peer_doorbell_fd);
 
-      i++;
-    }
+  return len;
+}
 
-    install_sigchld_handler ();
+/* Takes up to max_len bytes out of the ring as a packet, or returns NULL
+ * if the ring is empty or corrupt. The packet is copied straight out of the
+ * mapping, and never spans the end of the ring. */
+static FlowPacket *
+shm_shunt_read_from_ring (ShmShunt *shm_shunt, guint max_len)
+{
+  ShmRing    *ring      = shm_shunt->rx_ring;
+  guint       ring_size = shm_shunt->ring_size;
+  FlowPacket *packet;
+  guint       head;
+  guint       offset;
+  guint       len;
 
-    flow_shunt_impl_unlock ();
+  len = shm_ring_get_fill (ring, ring_size);
+  if (len == SHM_RING_FILL_INVALID)
+  {
+    shm_shunt->corrupt = TRUE;
+    return NULL;
+  }
 
-    /* --- UNLOCKED CODE BEGINS --- */
+  if (len == 0)
+    return NULL;
 
-    result = select (fd_max + 1, &read_fds, &write_fds, &exception_fds, NULL);
+  head   = (guint) ring->head;
+  offset = head & (ring_size - 1);
+  len    = MIN (len, ring_size - offset);
+  len    = MIN (len, max_len);
 
-    /* --- UNLOCKED CODE ENDS --- */
+  packet = flow_packet_new (FLOW_PACKET_FORMAT_BUFFER, shm_shunt->rx_data + offset, len);
 
-    flow_shunt_impl_lock ();
+  g_atomic_int_set (&ring->head, (gint) (head + len));
 
-    /* Implementation finalized? */
-    if (!flow_wakeup_pipe_is_valid (&wakeup_pipe))
-      break;
+  if (g_atomic_int_get (&ring->writer_waiting) &&
+      g_atomic_int_compare_and_exchange (&ring->writer_waiting, 1, 0))
+    shm_doorbell_ring (shm_shunt->peer_doorbell_fd);
 
-    /* Handle subprocess events */
+  return packet;
+}
 
-    handle_child_exits ();
+/* Called when the hangup socket is readable. We never send anything on
+ * it after setup, so this should be EOF. */
+static void
+shm_shunt_check_hangup (ShmShunt *shm_shunt)
+{
+  guint8 byte;
+  gint   result;
 
-    if (result < 1)
-    {
-      /* select () returned, but no FDs are ready. This can happen if we're
-       * interrupted by a signal. Just restart the select (). */
-      continue;
-    }
+  result = recv (shm_shunt->hangup_fd, &byte, 1, MSG_DONTWAIT);
 
-    /* Clear wakeup events */
+  if (result == 0 || (result < 0 && errno != EAGAIN && errno != EINTR))
+    shm_shunt->peer_closed = TRUE;
+}
 
-    if (FD_ISSET (flow_wakeup_pipe_get_watch_fd (&wakeup_pipe), &read_fds))
-      flow_wakeup_pipe_handle_wakeup (&wakeup_pipe);
+/* TRUE if the peer closed its end of the channel entirely, not just
+ * stopped writing. */
+static gboolean
+shm_shunt_peer_is_gone (ShmShunt *shm_shunt)
+{
+  struct pollfd pfd;
 
-    /* Process events */
+  pfd.fd      = shm_shunt->hangup_fd;
+  pfd.events  = 0;
+  pfd.revents = 0;
 
-    for (i = 0; i < active_socket_shunts->len; i++)
-    {
-      FlowShunt *shunt = g_ptr_array_index (active_socket_shunts, i);
-      gint       read_fd;
-      gint       write_fd;
+  return poll (&pfd, 1, 0) > 0 && (pfd.revents & (POLLHUP | POLLERR)) ? TRUE : FALSE;
+}
 
-      if (shunt->shunt_type == SHUNT_TYPE_PIPE)
-      {
-        PipeShunt *pipe_shunt = (PipeShunt *) shunt;
+/* For synchronous shunts. Sleeps until the doorbell rings or the peer
+ * hangs up. Returns FALSE if the peer is gone. */
+static gboolean
+shm_shunt_wait (ShmShunt *shm_shunt)
+{
+  struct pollfd pfds [2];
+  gint          result;
 
-        read_fd  = pipe_shunt->read_fd;
-        write_fd = pipe_shunt->write_fd;
-      }
-      else
-      {
-        SocketShunt *socket_shunt = (SocketShunt *) shunt;
+  pfds [0].fd      = shm_shunt->doorbell_fd;
+  pfds [0].events  = POLLIN;
+  pfds [0].revents = 0;
 
-        read_fd  = socket_shunt->fd;
-        write_fd = socket_shunt->fd;
-      }
+  /* Once we've seen EOF, only a full hangup is of interest */
 
-      if (shunt->doing_reads)
-      {
-        if (FD_ISSET (read_fd, &read_fds))
-          socket_shunt_read (shunt);
+  pfds [1].fd      = shm_shunt->hangup_fd;
+  pfds [1].events  = shm_shunt->peer_closed ? 0 : POLLIN;
+  pfds [1].revents = 0;
 
-        if (FD_ISSET (read_fd, &exception_fds))
-          socket_shunt_exception (shunt);
-      }
+  do
+  {
+    result = poll (pfds, 2, -1);
+  }
+  while (result < 0 && errno == EINTR);
 
-      if (shunt->doing_writes)
-      {
-        if (FD_ISSET (write_fd, &write_fds))
-          socket_shunt_write (shunt);
+  if (pfds [0].revents & POLLIN)
+    shm_doorbell_clear (shm_shunt->doorbell_fd);
 
-        if (FD_ISSET (write_fd, &exception_fds))
-          socket_shunt_exception (shunt);
-      }
-    }
+  if (pfds [1].revents & (POLLHUP | POLLERR))
+  {
+    shm_shunt->peer_closed = TRUE;
+    return FALSE;
   }
 
-out:
-  flow_shunt_impl_unlock ();
-  return NULL;
-}
+  if (pfds [1].revents & POLLIN)
+    shm_shunt_check_hangup (shm_shunt);
 
-/* ------------------ *
- * File Low-level I/O *
- * ------------------ */
+  return TRUE;
+}
 
-static void
-file_shunt_read (FlowShunt *shunt)
+/* Invoked by the watch thread before it sleeps. Returns TRUE if the shunt
+ * has work to do right away, in which case the thread only polls. */
+static gboolean
+shm_shunt_prepare_wait (FlowShunt *shunt)
 {
-  FileShunt    *file_shunt = (FileShunt *) shunt;
-  gint64        max_read;
-  gint          result;
-  gint          saved_errno;
-  FlowPacket   *packet;
-  gpointer      packet_data;
-  gint          fd;
+  ShmShunt *shm_shunt = (ShmShunt *) shunt;
+  gboolean  ready     = FALSE;
 
-  socket_buffer_check (shunt);
+  if (shunt->need_reads &&
+      (shm_shunt->peer_closed ||
+       shm_ring_arm_reader (shm_shunt->rx_ring, shm_shunt->ring_size)))
+    ready = TRUE;
 
-  max_read = MIN (file_shunt->read_bytes_remaining, shunt->io_buffer_size);
-  if (max_read < 1)
-  {
-    flow_shunt_read_state_changed (shunt);
-    return;
-  }
+  if (shunt->need_writes &&
+      (shm_ring_arm_writer (shm_shunt->tx_ring, shm_shunt->ring_size) ||
+       (shm_shunt->peer_closed && shm_shunt_peer_is_gone (shm_shunt))))
+    ready = TRUE;
 
-  fd = file_shunt->fd;
+  return ready;
+}
 
-  flow_shunt_impl_unlock ();
+/* The peer broke the ring protocol. There's no telling what the rings
+ * hold, so the channel is shut down in both directions. */
+static void
+shm_shunt_fail (FlowShunt *shunt)
+{
+  FlowDetailedEvent *detailed_event;
 
-  /* --- UNLOCKED CODE BEGINS --- */
+  detailed_event = generate_errno_event (EPROTO, NULL);
+  flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_APP_ERROR);
+  flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
+  flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
 
-  packet = flow_packet_alloc_for_data (max_read, &packet_data);
+  if (!shunt->dispatched_end)
+  {
+    shunt->dispatched_end = TRUE;
 
-  result = read (fd, packet_data, max_read);
-  saved_errno = errno;
+    generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_SEGMENT_END);
+    generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_END);
+  }
 
-  /* --- UNLOCKED CODE ENDS --- */
+  close_read_fd (shunt);
+  close_write_fd (shunt);
+}
 
-  flow_shunt_impl_lock ();
+static void
+shm_shunt_read (FlowShunt *shunt)
+{
+  ShmShunt *shm_shunt = (ShmShunt *) shunt;
+  gint      i;
 
-  if G_LIKELY (result > 0)
+  shunt->io_buffer_size = shunt->io_buffer_desired_size;
+
+  for (i = 0; i < N_LOOP_ITERATIONS_MAX; i++)
   {
-    /* Data */
+    FlowPacket *packet;
 
-    if (result < max_read)
-    {
-      FlowPacket *new_packet = flow_packet_new (FLOW_PACKET_FORMAT_BUFFER, packet_data, result);
-      flow_packet_unref (packet);
-      packet = new_packet;
-    }
+    packet = shm_shunt_read_from_ring (shm_shunt, shunt->io_buffer_size);
+    if (!packet)
+      break;
 
     flow_packet_queue_push_packet (shunt->read_queue, packet);
+  }
 
-    file_shunt->read_bytes_remaining -= result;
-    g_assert (file_shunt->read_bytes_remaining >= 0);
-
-    if (file_shunt->read_bytes_remaining == 0)
-    {
-      shunt->need_reads  = FALSE;
-      shunt->doing_reads = FALSE;
-      generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_SEGMENT_END);
-      flow_shunt_write_state_changed (shunt);  /* Process subsequent writes, if any */
-    }
+  if (shm_shunt->corrupt)
+  {
+    shm_shunt_fail (shunt);
+    return;
   }
-  else if (result == 0)
+
+  /* We only look at the ring after seeing EOF, so if it's empty now, the
+   * peer won't be adding anything more */
+
+  if (shm_shunt->peer_closed &&
+      shm_ring_get_fill (shm_shunt->rx_ring, shm_shunt->ring_size) == 0 &&
+      !shunt->dispatched_end)
   {
-    /* EOF: End segment */
+    PipeShunt *pipe_shunt = (PipeShunt *) shunt;
 
-    flow_packet_unref (packet);
+    /* End stream */
 
-    file_shunt->read_bytes_remaining = 0;
-    shunt->need_reads  = FALSE;
-    shunt->doing_reads = FALSE;
+    shunt->dispatched_end = TRUE;
 
     generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_SEGMENT_END);
 
-    /* Send EOF event */
-    generate_simple_event (shunt, FLOW_FILE_DOMAIN, FLOW_FILE_REACHED_END);
+    /* Only spawned processes have a result; see socket_shunt_read () */
 
-    flow_shunt_write_state_changed (shunt);  /* Process subsequent writes, if any */
+    if (shm_shunt->spawned && pipe_shunt->child_pid < 0)
+      report_process_result (shunt, WEXITSTATUS (pipe_shunt->result));
+
+    generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_END);
+    close_read_fd (shunt);
   }
-  else if (saved_errno != EINTR && saved_errno != EAGAIN)
-  {
-    FlowDetailedEvent *detailed_event;
 
-    /* I/O error */
+  flow_shunt_read_state_changed (shunt);
+}
 
-    assert_non_fatal_errno (saved_errno, file_read_fatal_errnos);
+static void
+shm_shunt_write (FlowShunt *shunt)
+{
+  ShmShunt *shm_shunt = (ShmShunt *) shunt;
+  gint      i;
 
-    flow_packet_unref (packet);
-
-    file_shunt->read_bytes_remaining = 0;
-    shunt->need_reads  = FALSE;
-    shunt->doing_reads = FALSE;
-
-    detailed_event = generate_errno_event (saved_errno, file_read_errno_map);
-    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
-    flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
-
-    generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_SEGMENT_END);
-    flow_shunt_write_state_changed (shunt);  /* Process subsequent writes, if any */
-  }
-
-  flow_shunt_read_state_changed (shunt);
-}
-
-static void
-file_shunt_handle_stream_end (FlowShunt *shunt)
-{
-  /* User requested end-of-stream */
-
-  if (!shunt->dispatched_end)
-  {
-    generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_END);
-    shunt->dispatched_end = TRUE;
-  }
-
-  close_read_fd (shunt);
-  close_write_fd (shunt);
-}
-
-static void
-file_shunt_write (FlowShunt *shunt)
-{
-  FileShunt *file_shunt = (FileShunt *) shunt;
-
-#if 0
-  if G_UNLIKELY (!shunt->dispatched_begin)
-  {
-    /* Begin stream */
-
-    shunt->dispatched_begin = TRUE;
-    generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_BEGIN);
-    flow_shunt_read_state_changed (shunt);
-  }
-#endif
-
-  while (!shunt->was_destroyed)
-  {
-    FlowPacket       *packet;
-    gint              packet_offset;
-    FlowPacketFormat  packet_format;
+  for (i = 0; i < N_LOOP_ITERATIONS_MAX && shunt->can_write; i++)
+  {
+    FlowPacket       *packet;
+    gint              packet_offset;
+    FlowPacketFormat  packet_format;
 
     if (!flow_packet_queue_peek_packet (shunt->write_queue, &packet, &packet_offset))
     {
@@ -2470,178 +3569,87 @@ file_shunt_write (FlowShunt *shunt)
 
     packet_format = flow_packet_get_format (packet);
 
-    /* If we've generated a serious error, the stream must be restarted by the user. Until
-     * we receive a restart event or a request to close the stream, drop all packets. */
-
-    if G_UNLIKELY (shunt->wait_for_restart)
-    {
-      if (packet_format == FLOW_PACKET_FORMAT_OBJECT)
-      {
-        FlowDetailedEvent *detailed_event = flow_packet_get_data (packet);
-
-        if (FLOW_IS_DETAILED_EVENT (detailed_event))
-        {
-          if (flow_detailed_event_matches (detailed_event, FLOW_FILE_DOMAIN, FLOW_FILE_RESTART))
-          {
-            shunt->wait_for_restart = FALSE;
-          }
-          else if (flow_detailed_event_matches (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_END) ||
-                   flow_detailed_event_matches (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED))
-          {
-            file_shunt_handle_stream_end (shunt);
-          }
-        }
-      }
-
-      flow_packet_queue_drop_packet (shunt->write_queue);
-      continue;
-    }
-
-    /* Handle packet */
-
     if G_LIKELY (packet_format == FLOW_PACKET_FORMAT_BUFFER)
     {
-      guint8        *buffer;
-      gint           buffer_len;
-      gint           result;
-      gint           saved_errno;
-      gint           fd;
+      guint8 *buffer;
+      guint   buffer_len;
+      guint   result;
 
       buffer = (guint8 *) flow_packet_get_data (packet) + packet_offset;
       buffer_len = flow_packet_get_size (packet) - packet_offset;
 
-      fd = file_shunt->fd;
-
-      flow_shunt_impl_unlock ();
-
-      /* --- UNLOCKED CODE BEGINS --- */
-
-      result = write (fd, buffer, buffer_len);
-      saved_errno = errno;
-
-      /* --- UNLOCKED CODE ENDS --- */
-
-      flow_shunt_impl_lock ();
+      result = shm_shunt_write_to_ring (shm_shunt, buffer, buffer_len);
 
-      if G_UNLIKELY (result < 0)
+      if (result == 0)
       {
-        FlowDetailedEvent *detailed_event;
-
-        /* Programmer error? */
-
-        assert_non_fatal_errno (saved_errno, file_write_fatal_errnos);
-
-        /* Just an interrupt? */
+        if (shm_shunt->corrupt)
+        {
+          shm_shunt_fail (shunt);
+          return;
+        }
 
-        if (saved_errno == EAGAIN || saved_errno == EINTR)
-          break;
+        if (shm_shunt->tx_closed ||
+            (shm_shunt->peer_closed && shm_shunt_peer_is_gone (shm_shunt)))
+        {
+          FlowDetailedEvent *detailed_event;
 
-        /* Dispatch error and wait for it to be acknowledged */
+          /* Broken pipe */
 
-        shunt->wait_for_restart = TRUE;
+          detailed_event = generate_errno_event (EPIPE, NULL);
+          flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_END_CONVERSE);
+          flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
 
-        detailed_event = generate_errno_event (saved_errno, file_write_errno_map);
-        flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
-        flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
+          close_write_fd (shunt);
+          flow_shunt_read_state_changed (shunt);
+        }
 
-        flow_shunt_read_state_changed (shunt);
         break;
       }
       else if (result < buffer_len)
       {
-        /* Partial write */
+        /* Partial write; the ring is full */
         flow_packet_queue_pop_bytes_exact (shunt->write_queue, NULL, result);
-        shunt->offset_changed = TRUE;
         break;
       }
       else
       {
         /* Complete write */
         flow_packet_queue_drop_packet (shunt->write_queue);
-        shunt->offset_changed = TRUE;
       }
     }
     else if (packet_format == FLOW_PACKET_FORMAT_OBJECT)
     {
-      gpointer object = flow_packet_get_data (packet);
-
-      if (FLOW_IS_POSITION (object))
-      {
-        FlowOffsetAnchor anchor;
-        gint64           offset;
-        off_t            result;
-        gint             saved_errno;
+      GObject *object = flow_packet_get_data (packet);
 
-        anchor = flow_position_get_anchor (object);
-        offset = flow_position_get_offset (object);
+      /* Other objects can't be carried across, so we drop them like
+       * pipes do */
 
-        result = lseek (file_shunt->fd, offset, anchor_to_whence (anchor));
-        saved_errno = errno;
+      if (FLOW_IS_DETAILED_EVENT (object))
+      {
+        FlowDetailedEvent *detailed_event = (FlowDetailedEvent *) object;
 
-        if (result >= 0)
-        {
-          report_position (shunt, result);
-        }
-        else
+        if (flow_detailed_event_matches (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_END) ||
+            flow_detailed_event_matches (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED))
         {
-          /* Seek failed */
-
-          /* Programmer error? */
-          assert_non_fatal_errno (saved_errno, file_seek_fatal_errnos);
-
-          /* The Linux man page doesn't mention any would-be application errors, so
-           * it's our fault somehow. */
-          g_assert_not_reached ();
+          /* User requested end-of-stream */
+          close_write_fd (shunt);
         }
-      }
-      else if (FLOW_IS_SEGMENT_REQUEST (object))
-      {
-        g_assert (file_shunt->read_bytes_remaining == 0);
-        file_shunt->read_bytes_remaining = flow_segment_request_get_length (object);
 
-        if (file_shunt->read_bytes_remaining < 0)
-          file_shunt->read_bytes_remaining = G_MAXINT64;
-
-        if (shunt->offset_changed)
+        if (flow_detailed_event_matches (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_END_CONVERSE) ||
+            flow_detailed_event_matches (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED))
         {
-          off_t result;
-          gint  saved_errno;
-
-          result = lseek (file_shunt->fd, 0, SEEK_CUR);
-          saved_errno = errno;
+          /* User wants to stop reading */
+          close_read_fd (shunt);
 
-          if (result >= 0)
-          {
-            report_position (shunt, result);
-          }
-          else
+          if (!shunt->dispatched_end)
           {
-            /* Seek failed */
-
-            /* Programmer error? */
-            assert_non_fatal_errno (saved_errno, file_seek_fatal_errnos);
+            generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_SEGMENT_END);
+            generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_END);
+            shunt->dispatched_end = TRUE;
 
-            /* The Linux man page doesn't mention any would-be application errors, so
-             * it's our fault somehow. */
-            g_assert_not_reached ();
+            flow_shunt_read_state_changed (shunt);
           }
         }
-
-        shunt->need_writes  = FALSE;
-        shunt->doing_writes = FALSE;
-
-        generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_SEGMENT_BEGIN);
-        flow_shunt_read_state_changed (shunt);
-
-        /* The next operation will be a read, so bail out of write loop */
-        flow_packet_queue_drop_packet (shunt->write_queue);
-        break;
-      }
-      else if (FLOW_IS_DETAILED_EVENT (object) &&
-               (flow_detailed_event_matches (object, FLOW_STREAM_DOMAIN, FLOW_STREAM_END) ||
-                flow_detailed_event_matches (object, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED)))
-      {
-        file_shunt_handle_stream_end (shunt);
       }
 
       flow_packet_queue_drop_packet (shunt->write_queue);
@@ -2657,621 +3665,1932 @@ file_shunt_write (FlowShunt *shunt)
 }
 
 static void
-file_shunt_open (FileShuntParams *params)
+shm_shunt_free_channel (ShmShunt *shm_shunt)
 {
-  FileShunt      *file_shunt = params->file_shunt;
-  FlowShunt      *shunt      = (FlowShunt *) file_shunt;
-  gint            flags      = 0;
-  gint            saved_errno;
-  gint            fd;
-
-  if (params->create)
-    flags |= O_CREAT;
-  if (params->destructive)
-    flags |= O_TRUNC;
-
-  if (params->proc_access & FLOW_READ_ACCESS)
-  {
-    if (params->proc_access & FLOW_WRITE_ACCESS || params->destructive || params->create)
-      flags |= O_RDWR;
-    else
-      flags |= O_RDONLY;
-  }
-  else if (params->proc_access & FLOW_WRITE_ACCESS)
+  if (shm_shunt->header)
   {
-    flags |= O_WRONLY;
+    munmap (shm_shunt->header, shm_shunt->map_len);
+    shm_shunt->header = NULL;
   }
 
-  if (flags & O_CREAT)
-  {
-    gint mode = 0;
+  if (shm_shunt->doorbell_fd >= 0)
+    close (shm_shunt->doorbell_fd);
+  if (shm_shunt->peer_doorbell_fd >= 0)
+    close (shm_shunt->peer_doorbell_fd);
+  if (shm_shunt->hangup_fd >= 0)
+    flow_close_socket_fd (shm_shunt->hangup_fd);
 
-    if (params->user_access & FLOW_READ_ACCESS)
-      mode |= S_IRUSR;
-    if (params->user_access & FLOW_WRITE_ACCESS)
-      mode |= S_IWUSR;
-    if (params->user_access & FLOW_EXECUTE_ACCESS)
-      mode |= S_IXUSR;
+  shm_shunt->doorbell_fd      = -1;
+  shm_shunt->peer_doorbell_fd = -1;
+  shm_shunt->hangup_fd        = -1;
+}
 
-    if (params->group_access & FLOW_READ_ACCESS)
-      mode |= S_IRGRP;
-    if (params->group_access & FLOW_WRITE_ACCESS)
-      mode |= S_IWGRP;
-    if (params->group_access & FLOW_EXECUTE_ACCESS)
-      mode |= S_IXGRP;
+/* Points the shunt at its halves of the mapping. The creator transmits on
+ * ring 0 and the peer on ring 1. The ring size is passed in rather than
+ * read from the header, since the other side can change it at any time. */
+static void
+shm_shunt_set_side (ShmShunt *shm_shunt, gboolean is_peer, guint ring_size)
+{
+  ShmHeader *header = shm_shunt->header;
+  guint8    *data   = (guint8 *) header + sizeof (ShmHeader);
+  gint       tx     = is_peer ? 1 : 0;
 
-    if (params->other_access & FLOW_READ_ACCESS)
-      mode |= S_IROTH;
-    if (params->other_access & FLOW_WRITE_ACCESS)
-      mode |= S_IWOTH;
-    if (params->other_access & FLOW_EXECUTE_ACCESS)
-      mode |= S_IXOTH;
+  shm_shunt->ring_size = ring_size;
 
-    flow_shunt_impl_unlock ();
-    fd = open (params->path, flags, mode);
-    flow_shunt_impl_lock ();
-  }
-  else
-  {
-    flow_shunt_impl_unlock ();
-    fd = open (params->path, flags);
-    flow_shunt_impl_lock ();
-  }
-
-  saved_errno = errno;
+  shm_shunt->tx_ring = &header->rings [tx];
+  shm_shunt->tx_data = data + tx * shm_shunt->ring_size;
+  shm_shunt->rx_ring = &header->rings [1 - tx];
+  shm_shunt->rx_data = data + (1 - tx) * shm_shunt->ring_size;
+}
 
-  file_shunt->fd = fd;
+/* Sets up the mapping, both doorbells and the hangup socket pair, with the
+ * shunt on the creator side. The peer's end of the socket pair is returned
+ * in peer_fd, and the memfd in memfd_out, which the caller must close.
+ * Returns 0 on success, or an errno value. */
+static gint
+shm_shunt_create_channel (ShmShunt *shm_shunt, gint *peer_fd, gint *memfd_out)
+{
+#ifdef USE_SHM_RING
 
-  if (fd < 0)
-  {
-    FlowDetailedEvent *detailed_event;
+  gint  memfd;
+  gint  efds [2] = { -1, -1 };
+  gint  sv [2]   = { -1, -1 };
+  gint  saved_errno;
+  gsize map_len  = sizeof (ShmHeader) + 2 * SHM_RING_SIZE;
+  void *map;
 
-    detailed_event = generate_errno_event (saved_errno, file_open_errno_map);
-    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
-    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED);
-    flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
-  }
-  else
-  {
-    shunt->can_read  = TRUE;
-    shunt->can_write = TRUE;
+  memfd = memfd_create ("flow-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (memfd < 0)
+    return errno;
 
-    generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_BEGIN);
-  }
+  /* Fix the size for good, so neither side can truncate the mapping under
+   * the other */
 
-  shunt->dispatched_begin = TRUE;
+  if (ftruncate (memfd, map_len) < 0 ||
+      fcntl (memfd, F_ADD_SEALS, SHM_MEMFD_SEALS) < 0)
+    goto error;
 
-  flow_shunt_read_state_changed (shunt);
-  flow_shunt_write_state_changed (shunt);
+  map = mmap (NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+  if (map == MAP_FAILED)
+    goto error;
 
-  g_free (params->path);
-  g_slice_free (FileShuntParams, params);
-}
+  shm_shunt->header  = map;
+  shm_shunt->map_len = map_len;
 
-static void
-file_shunt_finalize (FileShunt *file_shunt)
-{
-  flow_shunt_finalize_common ((FlowShunt *) file_shunt);
+  if ((efds [0] = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0 ||
+      (efds [1] = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+    goto error;
 
-  g_cond_clear (&file_shunt->cond);
-  g_slice_free (FileShunt, file_shunt);
-}
+#ifdef SOCK_CLOEXEC
+  if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0)
+    goto error;
+#else
+  if (socketpair (AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+    goto error;
 
-static gpointer
-file_shunt_main (FileShuntParams *params)
-{
-  FileShunt *file_shunt = params->file_shunt;
-  FlowShunt *shunt      = (FlowShunt *) file_shunt;
+  fcntl (sv [0], F_SETFD, FD_CLOEXEC);
+  fcntl (sv [1], F_SETFD, FD_CLOEXEC);
+#endif
 
-  flow_shunt_impl_lock ();
-  shunt->in_worker = TRUE;
+  /* The mapping starts out zeroed, so only the header needs filling in */
 
-  /* Tell main thread we're good to go */
-  g_cond_signal (&file_shunt->cond);
+  shm_shunt->header->magic     = SHM_RING_MAGIC;
+  shm_shunt->header->ring_size = SHM_RING_SIZE;
 
-  file_shunt_open (params);
+  shm_shunt_set_side (shm_shunt, FALSE, SHM_RING_SIZE);
 
-  while (!shunt->was_destroyed)
-  {
-    if (!shunt->need_reads)
-      shunt->doing_reads = FALSE;
-    if (!shunt->need_writes)
-      shunt->doing_writes = FALSE;
+  shm_shunt->doorbell_fd      = efds [0];
+  shm_shunt->peer_doorbell_fd = efds [1];
+  shm_shunt->hangup_fd        = sv [0];
 
-    if (!shunt->doing_reads && !shunt->doing_writes)
-    {
-      g_cond_wait (&file_shunt->cond, &global_mutex);
-      continue;
-    }
+  *peer_fd   = sv [1];
+  *memfd_out = memfd;
+  return 0;
 
-    if (shunt->need_reads)
-    {
-      file_shunt_read (shunt);
-    }
+error:
+  saved_errno = errno;
 
-    if (shunt->need_writes)
-    {
-      file_shunt_write (shunt);
-    }
+  if (shm_shunt->header)
+  {
+    munmap (shm_shunt->header, shm_shunt->map_len);
+    shm_shunt->header = NULL;
   }
 
-  /* Finalize the shunt */
-  shunt->in_worker = FALSE;
-  file_shunt_finalize (file_shunt);
+  if (efds [0] >= 0)
+    close (efds [0]);
+  if (efds [1] >= 0)
+    close (efds [1]);
 
-  flow_shunt_impl_unlock ();
+  close (memfd);
+  return saved_errno;
 
-  return NULL;
-}
+#else
 
-/* ------------ *
- * Construction *
- * ------------ */
+  return ENOSYS;
 
-static void
-child_setup (void)
-{
+#endif
 }
 
-static FileShuntParams *
-create_file_shunt_params (const gchar *path, FlowAccessMode access_mode)
+/* Invoked by the watch thread after it wakes up. Unlike sockets, we don't
+ * need the doorbell to have rung; shm_shunt_prepare_wait () may have found
+ * work already. */
+static void
+shm_shunt_dispatch (FlowShunt *shunt, fd_set *read_fds)
 {
-  FileShunt       *file_shunt;
-  FlowShunt       *shunt;
-  FileShuntParams *params;
+  ShmShunt *shm_shunt = (ShmShunt *) shunt;
 
-  file_shunt = g_slice_new0 (FileShunt);
-  shunt = (FlowShunt *) file_shunt;
+  if (FD_ISSET (shm_shunt->doorbell_fd, read_fds))
+    shm_doorbell_clear (shm_shunt->doorbell_fd);
 
-  flow_shunt_impl_lock ();
-  flow_shunt_init_common (shunt, NULL);
-  flow_shunt_impl_unlock ();
+  if (!shm_shunt->peer_closed && FD_ISSET (shm_shunt->hangup_fd, read_fds))
+    shm_shunt_check_hangup (shm_shunt);
 
-  shunt->shunt_type = SHUNT_TYPE_FILE;
+  if (shunt->doing_reads && shunt->need_reads)
+    shm_shunt_read (shunt);
 
-  file_shunt->fd      = -1;
-  g_cond_init (&file_shunt->cond);
+  if (shunt->doing_writes && shunt->need_writes)
+    shm_shunt_write (shunt);
+}
 
-  params = g_slice_new0 (FileShuntParams);
+static void
+install_sigchld_handler (void)
+{
+  struct sigaction sa;
 
-  params->file_shunt  = file_shunt;
-  params->path        = g_strdup (path);
-  params->proc_access = access_mode;
+  memset (&sa, 0, sizeof (sa));
 
-  return params;
+  sa.sa_handler = (void (*)(int)) handle_child_exits_signal;
+  sa.sa_flags = SA_NOCLDSTOP;
+
+  sigemptyset (&sa.sa_mask);
+
+  sigaction (SIGCHLD, &sa, NULL);
 }
 
-static FileShunt *
-create_file_shunt_thread (FileShuntParams *params)
+static gpointer
+socket_shunt_main (void)
 {
-  FileShunt         *file_shunt = params->file_shunt;
-  FlowShunt         *shunt = (FlowShunt *) file_shunt;
-  GThread           *thread;
-  FlowDetailedEvent *detailed_event;
-  GError            *error = NULL;
-
   flow_shunt_impl_lock ();
 
-  thread = g_thread_new ("FlowShunt file", (GThreadFunc) file_shunt_main, params);
+  /* Implementation finalized? */
+  if (!flow_wakeup_pipe_is_valid (&wakeup_pipe))
+    goto out;
 
-  if (thread)
+  for (;;)
   {
-    flow_shunt_read_state_changed (shunt);
-    flow_shunt_write_state_changed (shunt);
+    fd_set          read_fds;
+    fd_set          write_fds;
+    fd_set          exception_fds;
+    gint            fd_max     = flow_wakeup_pipe_get_watch_fd (&wakeup_pipe);
+    gboolean        shm_busy   = FALSE;
+    gboolean        idle_check = FALSE;
+    struct timeval  timeout;
+    gint            result;
+    guint           i;
 
-    g_cond_wait (&file_shunt->cond, &global_mutex);
-  }
-  else
-  {
-    detailed_event = flow_detailed_event_new_literal (error->message);
-    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_RESOURCE_ERROR);
-    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
-    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED);
+    /* Clear sets */
 
-    flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
+    FD_ZERO (&read_fds);
+    FD_ZERO (&write_fds);
+    FD_ZERO (&exception_fds);
 
-    g_clear_error (&error);
-    flow_shunt_read_state_changed (shunt);
-  }
+    /* Add wakeup pipe to set */
 
-  flow_shunt_impl_unlock ();
+    FD_SET (flow_wakeup_pipe_get_watch_fd (&wakeup_pipe), &read_fds);
 
-  return file_shunt;
-}
+    /* Add other fds to sets, clean out array */
 
-static FlowShunt *
-flow_shunt_impl_open_stdio (void)
-{
-  FlowShunt *shunt;
-  PipeShunt *pipe_shunt;
+    for (i = 0; i < active_socket_shunts->len; )
+    {
+      FlowShunt *shunt = g_ptr_array_index (active_socket_shunts, i);
+      gint       read_fd;
+      gint       write_fd;
 
-  pipe_shunt = g_slice_new0 (PipeShunt);
-  shunt = (FlowShunt *) pipe_shunt;
+      if (shunt->shunt_type == SHUNT_TYPE_SHM)
+      {
+        ShmShunt *shm_shunt = (ShmShunt *) shunt;
 
-  flow_shunt_impl_lock ();
+        /* Shared memory shunts are driven by doorbells rather than fd
+         * readiness. If one already has work, we just poll this time. */
 
-  flow_shunt_init_common (shunt, NULL);
+        if (!shunt->need_reads)
+          shunt->doing_reads = FALSE;
+        if (!shunt->need_writes)
+          shunt->doing_writes = FALSE;
 
-  shunt->shunt_type = SHUNT_TYPE_PIPE;
+        if (!shunt->doing_reads && !shunt->doing_writes)
+        {
+          g_ptr_array_remove_index_fast (active_socket_shunts, i);
+          continue;
+        }
 
-  pipe_shunt->read_fd = STDIN_FILENO;
-  flow_pipe_set_nonblock (STDIN_FILENO, TRUE);
+        if (shm_shunt_prepare_wait (shunt))
+          shm_busy = TRUE;
+        else if (shm_shunt->peer_closed && shunt->need_writes)
+          idle_check = TRUE;  /* Nothing will tell us if the peer goes away */
 
-  pipe_shunt->write_fd = STDOUT_FILENO;
-  flow_pipe_set_nonblock (STDOUT_FILENO, TRUE);
+        FD_SET (shm_shunt->doorbell_fd, &read_fds);
+        fd_max = MAX (fd_max, shm_shunt->doorbell_fd);
 
-  shunt->can_read  = TRUE;
-  shunt->can_write = TRUE;
+        if (!shm_shunt->peer_closed)
+        {
+          FD_SET (shm_shunt->hangup_fd, &read_fds);
+          fd_max = MAX (fd_max, shm_shunt->hangup_fd);
+        }
 
-  flow_shunt_read_state_changed (shunt);
-  flow_shunt_write_state_changed (shunt);
+        i++;
+        continue;
+      }
+      else if (shunt->shunt_type == SHUNT_TYPE_PIPE)
+      {
+        PipeShunt *pipe_shunt = (PipeShunt *) shunt;
 
-  flow_shunt_impl_unlock ();
+        read_fd  = pipe_shunt->read_fd;
+        write_fd = pipe_shunt->write_fd;
+      }
+      else
+      {
+        SocketShunt *socket_shunt = (SocketShunt *) shunt;
 
-  return shunt;
-}
+        read_fd  = socket_shunt->fd;
+        write_fd = socket_shunt->fd;
+      }
 
-static FlowShunt *
-flow_shunt_impl_open_file (const gchar *path, FlowAccessMode access_mode)
-{
-  FileShuntParams *params;
+      if (shunt->need_reads)
+      {
+        g_assert (read_fd >= 0);
 
-  params = create_file_shunt_params (path, access_mode);
-  return (FlowShunt *) create_file_shunt_thread (params);
-}
+        FD_SET (read_fd, &read_fds);
+        FD_SET (read_fd, &exception_fds);
+        fd_max = MAX (fd_max, read_fd);
+      }
+      else
+      {
+        shunt->doing_reads = FALSE;
+      }
 
-static FlowShunt *
-flow_shunt_impl_create_file (const gchar *path, FlowAccessMode access_mode,
-                             gboolean destructive,
-                             FlowAccessMode creation_permissions_user,
-                             FlowAccessMode creation_permissions_group,
-                             FlowAccessMode creation_permissions_other)
-{
-  FileShuntParams *params;
+      if (shunt->need_writes)
+      {
+        g_assert (write_fd >= 0);
 
-  params = create_file_shunt_params (path, access_mode);
+        FD_SET (write_fd, &write_fds);
+        FD_SET (write_fd, &exception_fds);
+        fd_max = MAX (fd_max, write_fd);
+      }
+      else
+      {
+        shunt->doing_writes = FALSE;
+      }
 
-  params->create       = TRUE;
-  params->destructive  = destructive;
-  params->user_access  = creation_permissions_user;
-  params->group_access = creation_permissions_group;
-  params->other_access = creation_permissions_other;
+      if (!shunt->doing_reads && !shunt->doing_writes)
+      {
+        g_ptr_array_remove_index_fast (active_socket_shunts, i);
+        continue;
+      }
 
-  return (FlowShunt *) create_file_shunt_thread (params);
-}
+      i++;
+    }
 
-static gpointer
-thread_shunt_main (ThreadShuntParams *params)
+#ifdef USE_MSG_ZEROCOPY
+    /* Completions don't wake us up once a socket is orphaned */
+
+    if (zerocopy_orphans->len > 0)
+    {
+      reap_zerocopy_orphans ();
+
+      if (zerocopy_orphans->len > 0)
+        idle_check = TRUE;
+    }
+#endif
+
+    install_sigchld_handler ();
+
+    flow_shunt_impl_unlock ();
+
+    /* --- UNLOCKED CODE BEGINS --- */
+
+    timeout.tv_sec  = 0;
+    timeout.tv_usec = shm_busy ? 0 : IDLE_POLL_INTERVAL_MS * 1000;
+
+    result = select (fd_max + 1, &read_fds, &write_fds, &exception_fds,
+                     shm_busy || idle_check ? &timeout : NULL);
+
+    /* --- UNLOCKED CODE ENDS --- */
+
+    flow_shunt_impl_lock ();
+
+    /* Implementation finalized? */
+    if (!flow_wakeup_pipe_is_valid (&wakeup_pipe))
+      break;
+
+    /* Handle subprocess events */
+
+    handle_child_exits ();
+
+    if (result < 1)
+    {
+      /* select () returned, but no FDs are ready. This can happen if we're
+       * interrupted by a signal, in which case we just restart the select ().
+       * If we timed out, shared memory shunts may still have work. */
+      if (!shm_busy && !idle_check)
+        continue;
+
+      FD_ZERO (&read_fds);
+      FD_ZERO (&write_fds);
+      FD_ZERO (&exception_fds);
+    }
+
+    /* Clear wakeup events */
+
+    if (FD_ISSET (flow_wakeup_pipe_get_watch_fd (&wakeup_pipe), &read_fds))
+      flow_wakeup_pipe_handle_wakeup (&wakeup_pipe);
+
+    /* Process events */
+
+    for (i = 0; i < active_socket_shunts->len; i++)
+    {
+      FlowShunt *shunt = g_ptr_array_index (active_socket_shunts, i);
+      gint       read_fd;
+      gint       write_fd;
+
+      if (shunt->shunt_type == SHUNT_TYPE_SHM)
+      {
+        shm_shunt_dispatch (shunt, &read_fds);
+        continue;
+      }
+      else if (shunt->shunt_type == SHUNT_TYPE_PIPE)
+      {
+        PipeShunt *pipe_shunt = (PipeShunt *) shunt;
+
+        read_fd  = pipe_shunt->read_fd;
+        write_fd = pipe_shunt->write_fd;
+      }
+      else
+      {
+        SocketShunt *socket_shunt = (SocketShunt *) shunt;
+
+        read_fd  = socket_shunt->fd;
+        write_fd = socket_shunt->fd;
+      }
+
+      if (shunt->doing_reads)
+      {
+        if (FD_ISSET (read_fd, &read_fds))
+          socket_shunt_read (shunt);
+
+        if (FD_ISSET (read_fd, &exception_fds))
+          socket_shunt_exception (shunt);
+      }
+
+      if (shunt->doing_writes)
+      {
+        if (FD_ISSET (write_fd, &write_fds))
+          socket_shunt_write (shunt);
+
+        if (FD_ISSET (write_fd, &exception_fds))
+          socket_shunt_exception (shunt);
+      }
+    }
+  }
+
+out:
+  flow_shunt_impl_unlock ();
+  return NULL;
+}
+
+/* ------------------ *
+ * File Low-level I/O *
+ * ------------------ */
+
+static void
+file_shunt_read (FlowShunt *shunt)
+{
+  FileShunt    *file_shunt = (FileShunt *) shunt;
+  gint64        max_read;
+  gint          result;
+  gint          saved_errno;
+  FlowPacket   *packet;
+  gpointer      packet_data;
+  gint          fd;
+
+  socket_buffer_check (shunt);
+
+  max_read = MIN (file_shunt->read_bytes_remaining, shunt->io_buffer_size);
+  if (max_read < 1)
+  {
+    flow_shunt_read_state_changed (shunt);
+    return;
+  }
+
+  fd = file_shunt->fd;
+
+  flow_shunt_impl_unlock ();
+
+  /* --- UNLOCKED CODE BEGINS --- */
+
+  packet = flow_packet_alloc_for_data (max_read, &packet_data);
+
+  result = read (fd, packet_data, max_read);
+  saved_errno = errno;
+
+  /* --- UNLOCKED CODE ENDS --- */
+
+  flow_shunt_impl_lock ();
+
+  if G_LIKELY (result > 0)
+  {
+    /* Data */
+
+    if (result < max_read)
+    {
+      FlowPacket *new_packet = flow_packet_new (FLOW_PACKET_FORMAT_BUFFER, packet_data, result);
+      flow_packet_unref (packet);
+      packet = new_packet;
+    }
+
+    flow_packet_queue_push_packet (shunt->read_queue, packet);
+
+    file_shunt->read_bytes_remaining -= result;
+    g_assert (file_shunt->read_bytes_remaining >= 0);
+
+    if (file_shunt->read_bytes_remaining == 0)
+    {
+      shunt->need_reads  = FALSE;
+      shunt->doing_reads = FALSE;
+      generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_SEGMENT_END);
+      flow_shunt_write_state_changed (shunt);  /* Process subsequent writes, if any */
+    }
+  }
+  else if (result == 0)
+  {
+    /* EOF: End segment */
+
+    flow_packet_unref (packet);
+
+    file_shunt->read_bytes_remaining = 0;
+    shunt->need_reads  = FALSE;
+    shunt->doing_reads = FALSE;
+
+    generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_SEGMENT_END);
+
+    /* Send EOF event */
+    generate_simple_event (shunt, FLOW_FILE_DOMAIN, FLOW_FILE_REACHED_END);
+
+    flow_shunt_write_state_changed (shunt);  /* Process subsequent writes, if any */
+  }
+  else if (saved_errno != EINTR && saved_errno != EAGAIN)
+  {
+    FlowDetailedEvent *detailed_event;
+
+    /* I/O error */
+
+    assert_non_fatal_errno (saved_errno, file_read_fatal_errnos);
+
+    flow_packet_unref (packet);
+
+    file_shunt->read_bytes_remaining = 0;
+    shunt->need_reads  = FALSE;
+    shunt->doing_reads = FALSE;
+
+    detailed_event = generate_errno_event (saved_errno, file_read_errno_map);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
+    flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
+
+    generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_SEGMENT_END);
+    flow_shunt_write_state_changed (shunt);  /* Process subsequent writes, if any */
+  }
+
+  flow_shunt_read_state_changed (shunt);
+}
+
+static void
+file_shunt_handle_stream_end (FlowShunt *shunt)
+{
+  /* User requested end-of-stream */
+
+  if (!shunt->dispatched_end)
+  {
+    generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_END);
+    shunt->dispatched_end = TRUE;
+  }
+
+  close_read_fd (shunt);
+  close_write_fd (shunt);
+}
+
+static void
+file_shunt_write (FlowShunt *shunt)
+{
+  FileShunt *file_shunt = (FileShunt *) shunt;
+
+#if 0
+  if G_UNLIKELY (!shunt->dispatched_begin)
+  {
+    /* Begin stream */
+
+    shunt->dispatched_begin = TRUE;
+    generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_BEGIN);
+    flow_shunt_read_state_changed (shunt);
+  }
+#endif
+
+  while (!shunt->was_destroyed)
+  {
+    FlowPacket       *packet;
+    gint              packet_offset;
+    FlowPacketFormat  packet_format;
+
+    if (!flow_packet_queue_peek_packet (shunt->write_queue, &packet, &packet_offset))
+    {
+      /* Nothing to do */
+      break;
+    }
+
+    packet_format = flow_packet_get_format (packet);
+
+    /* If we've generated a serious error, the stream must be restarted by the user. Until
+     * we receive a restart event or a request to close the stream, drop all packets. */
+
+    if G_UNLIKELY (shunt->wait_for_restart)
+    {
+      if (packet_format == FLOW_PACKET_FORMAT_OBJECT)
+      {
+        FlowDetailedEvent *detailed_event = flow_packet_get_data (packet);
+
+        if (FLOW_IS_DETAILED_EVENT (detailed_event))
+        {
+          if (flow_detailed_event_matches (detailed_event, FLOW_FILE_DOMAIN, FLOW_FILE_RESTART))
+          {
+            shunt->wait_for_restart = FALSE;
+          }
+          else if (flow_detailed_event_matches (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_END) ||
+                   flow_detailed_event_matches (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED))
+          {
+            file_shunt_handle_stream_end (shunt);
+          }
+        }
+      }
+
+      flow_packet_queue_drop_packet (shunt->write_queue);
+      continue;
+    }
+
+    /* Handle packet */
+
+    if G_LIKELY (packet_format == FLOW_PACKET_FORMAT_BUFFER)
+    {
+      guint8        *buffer;
+      gint           buffer_len;
+      gint           result;
+      gint           saved_errno;
+      gint           fd;
+
+      buffer = (guint8 *) flow_packet_get_data (packet) + packet_offset;
+      buffer_len = flow_packet_get_size (packet) - packet_offset;
+
+      fd = file_shunt->fd;
+
+      flow_shunt_impl_unlock ();
+
+      /* --- UNLOCKED CODE BEGINS --- */
+
+      result = write (fd, buffer, buffer_len);
+      saved_errno = errno;
+
+      /* --- UNLOCKED CODE ENDS --- */
+
+      flow_shunt_impl_lock ();
+
+      if G_UNLIKELY (result < 0)
+      {
+        FlowDetailedEvent *detailed_event;
+
+        /* Programmer error? */
+
+        assert_non_fatal_errno (saved_errno, file_write_fatal_errnos);
+
+        /* Just an interrupt? */
+
+        if (saved_errno == EAGAIN || saved_errno == EINTR)
+          break;
+
+        /* Dispatch error and wait for it to be acknowledged */
+
+        shunt->wait_for_restart = TRUE;
+
+        detailed_event = generate_errno_event (saved_errno, file_write_errno_map);
+        flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
+        flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
+
+        flow_shunt_read_state_changed (shunt);
+        break;
+      }
+      else if (result < buffer_len)
+      {
+        /* Partial write */
+        flow_packet_queue_pop_bytes_exact (shunt->write_queue, NULL, result);
+        shunt->offset_changed = TRUE;
+        break;
+      }
+      else
+      {
+        /* Complete write */
+        flow_packet_queue_drop_packet (shunt->write_queue);
+        shunt->offset_changed = TRUE;
+      }
+    }
+    else if (packet_format == FLOW_PACKET_FORMAT_OBJECT)
+    {
+      gpointer object = flow_packet_get_data (packet);
+
+      if (FLOW_IS_POSITION (object))
+      {
+        FlowOffsetAnchor anchor;
+        gint64           offset;
+        off_t            result;
+        gint             saved_errno;
+
+        anchor = flow_position_get_anchor (object);
+        offset = flow_position_get_offset (object);
+
+        result = lseek (file_shunt->fd, offset, anchor_to_whence (anchor));
+        saved_errno = errno;
+
+        if (result >= 0)
+        {
+          report_position (shunt, result);
+        }
+        else
+        {
+          /* Seek failed */
+
+          /* Programmer error? */
+          assert_non_fatal_errno (saved_errno, file_seek_fatal_errnos);
+
+          /* The Linux man page doesn't mention any would-be application errors, so
+           * it's our fault somehow. */
+          g_assert_not_reached ();
+        }
+      }
+      else if (FLOW_IS_SEGMENT_REQUEST (object))
+      {
+        g_assert (file_shunt->read_bytes_remaining == 0);
+        file_shunt->read_bytes_remaining = flow_segment_request_get_length (object);
+
+        if (file_shunt->read_bytes_remaining < 0)
+          file_shunt->read_bytes_remaining = G_MAXINT64;
+
+        if (shunt->offset_changed)
+        {
+          off_t result;
+          gint  saved_errno;
+
+          result = lseek (file_shunt->fd, 0, SEEK_CUR);
+          saved_errno = errno;
+
+          if (result >= 0)
+          {
+            report_position (shunt, result);
+          }
+          else
+          {
+            /* Seek failed */
+
+            /* Programmer error? */
+            assert_non_fatal_errno (saved_errno, file_seek_fatal_errnos);
+
+            /* The Linux man page doesn't mention any would-be application errors, so
+             * it's our fault somehow. */
+            g_assert_not_reached ();
+          }
+        }
+
+        shunt->need_writes  = FALSE;
+        shunt->doing_writes = FALSE;
+
+        generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_SEGMENT_BEGIN);
+        flow_shunt_read_state_changed (shunt);
+
+        /* The next operation will be a read, so bail out of write loop */
+        flow_packet_queue_drop_packet (shunt->write_queue);
+        break;
+      }
+      else if (FLOW_IS_DETAILED_EVENT (object) &&
+               (flow_detailed_event_matches (object, FLOW_STREAM_DOMAIN, FLOW_STREAM_END) ||
+                flow_detailed_event_matches (object, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED)))
+      {
+        file_shunt_handle_stream_end (shunt);
+      }
+
+      flow_packet_queue_drop_packet (shunt->write_queue);
+    }
+    else
+    {
+      /* Unknown packet format. Just drop it. */
+      flow_packet_queue_drop_packet (shunt->write_queue);
+    }
+  }
+
+  flow_shunt_write_state_changed (shunt);
+}
+
+static void
+file_shunt_open (FileShuntParams *params)
+{
+  FileShunt      *file_shunt = params->file_shunt;
+  FlowShunt      *shunt      = (FlowShunt *) file_shunt;
+  gint            flags      = 0;
+  gint            saved_errno;
+  gint            fd;
+
+  if (params->create)
+    flags |= O_CREAT;
+  if (params->destructive)
+    flags |= O_TRUNC;
+
+  if (params->proc_access & FLOW_READ_ACCESS)
+  {
+    if (params->proc_access & FLOW_WRITE_ACCESS || params->destructive || params->create)
+      flags |= O_RDWR;
+    else
+      flags |= O_RDONLY;
+  }
+  else if (params->proc_access & FLOW_WRITE_ACCESS)
+  {
+    flags |= O_WRONLY;
+  }
+
+  if (flags & O_CREAT)
+  {
+    gint mode = 0;
+
+    if (params->user_access & FLOW_READ_ACCESS)
+      mode |= S_IRUSR;
+    if (params->user_access & FLOW_WRITE_ACCESS)
+      mode |= S_IWUSR;
+    if (params->user_access & FLOW_EXECUTE_ACCESS)
+      mode |= S_IXUSR;
+
+    if (params->group_access & FLOW_READ_ACCESS)
+      mode |= S_IRGRP;
+    if (params->group_access & FLOW_WRITE_ACCESS)
+      mode |= S_IWGRP;
+    if (params->group_access & FLOW_EXECUTE_ACCESS)
+      mode |= S_IXGRP;
+
+    if (params->other_access & FLOW_READ_ACCESS)
+      mode |= S_IROTH;
+    if (params->other_access & FLOW_WRITE_ACCESS)
+      mode |= S_IWOTH;
+    if (params->other_access & FLOW_EXECUTE_ACCESS)
+      mode |= S_IXOTH;
+
+    flow_shunt_impl_unlock ();
+    fd = open (params->path, flags, mode);
+    flow_shunt_impl_lock ();
+  }
+  else
+  {
+    flow_shunt_impl_unlock ();
+    fd = open (params->path, flags);
+    flow_shunt_impl_lock ();
+  }
+
+  saved_errno = errno;
+
+  file_shunt->fd = fd;
+
+  if (fd < 0)
+  {
+    FlowDetailedEvent *detailed_event;
+
+    detailed_event = generate_errno_event (saved_errno, file_open_errno_map);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED);
+    flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
+  }
+  else
+  {
+    shunt->can_read  = TRUE;
+    shunt->can_write = TRUE;
+
+    generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_BEGIN);
+  }
+
+  shunt->dispatched_begin = TRUE;
+
+  flow_shunt_read_state_changed (shunt);
+  flow_shunt_write_state_changed (shunt);
+
+  g_free (params->path);
+  g_slice_free (FileShuntParams, params);
+}
+
+static void
+file_shunt_finalize (FileShunt *file_shunt)
+{
+  flow_shunt_finalize_common ((FlowShunt *) file_shunt);
+
+  g_cond_clear (&file_shunt->cond);
+  g_slice_free (FileShunt, file_shunt);
+}
+
+static gpointer
+file_shunt_main (FileShuntParams *params)
+{
+  FileShunt *file_shunt = params->file_shunt;
+  FlowShunt *shunt      = (FlowShunt *) file_shunt;
+
+  flow_shunt_impl_lock ();
+  shunt->in_worker = TRUE;
+
+  /* Tell main thread we're good to go */
+  g_cond_signal (&file_shunt->cond);
+
+  file_shunt_open (params);
+
+  while (!shunt->was_destroyed)
+  {
+    if (!shunt->need_reads)
+      shunt->doing_reads = FALSE;
+    if (!shunt->need_writes)
+      shunt->doing_writes = FALSE;
+
+    if (!shunt->doing_reads && !shunt->doing_writes)
+    {
+      g_cond_wait (&file_shunt->cond, &global_mutex);
+      continue;
+    }
+
+    if (shunt->need_reads)
+    {
+      file_shunt_read (shunt);
+    }
+
+    if (shunt->need_writes)
+    {
+      file_shunt_write (shunt);
+    }
+  }
+
+  /* Finalize the shunt */
+  shunt->in_worker = FALSE;
+  file_shunt_finalize (file_shunt);
+
+  flow_shunt_impl_unlock ();
+
+  return NULL;
+}
+
+/* ------------ *
+ * Construction *
+ * ------------ */
+
+static void
+child_setup (void)
+{
+}
+
+static FileShuntParams *
+create_file_shunt_params (const gchar *path, FlowAccessMode access_mode)
+{
+  FileShunt       *file_shunt;
+  FlowShunt       *shunt;
+  FileShuntParams *params;
+
+  file_shunt = g_slice_new0 (FileShunt);
+  shunt = (FlowShunt *) file_shunt;
+
+  flow_shunt_impl_lock ();
+  flow_shunt_init_common (shunt, NULL);
+  flow_shunt_impl_unlock ();
+
+  shunt->shunt_type = SHUNT_TYPE_FILE;
+
+  file_shunt->fd      = -1;
+  g_cond_init (&file_shunt->cond);
+
+  params = g_slice_new0 (FileShuntParams);
+
+  params->file_shunt  = file_shunt;
+  params->path        = g_strdup (path);
+  params->proc_access = access_mode;
+
+  return params;
+}
+
+static FileShunt *
+create_file_shunt_thread (FileShuntParams *params)
+{
+  FileShunt         *file_shunt = params->file_shunt;
+  FlowShunt         *shunt = (FlowShunt *) file_shunt;
+  GThread           *thread;
+  FlowDetailedEvent *detailed_event;
+  GError            *error = NULL;
+
+  flow_shunt_impl_lock ();
+
+  thread = g_thread_new ("FlowShunt file", (GThreadFunc) file_shunt_main, params);
+
+  if (thread)
+  {
+    flow_shunt_read_state_changed (shunt);
+    flow_shunt_write_state_changed (shunt);
+
+    g_cond_wait (&file_shunt->cond, &global_mutex);
+  }
+  else
+  {
+    detailed_event = flow_detailed_event_new_literal (error->message);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_RESOURCE_ERROR);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED);
+
+    flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
+
+    g_clear_error (&error);
+    flow_shunt_read_state_changed (shunt);
+  }
+
+  flow_shunt_impl_unlock ();
+
+  return file_shunt;
+}
+
+static FlowShunt *
+flow_shunt_impl_open_stdio (void)
+{
+  FlowShunt *shunt;
+  PipeShunt *pipe_shunt;
+
+  pipe_shunt = g_slice_new0 (PipeShunt);
+  shunt = (FlowShunt *) pipe_shunt;
+
+  flow_shunt_impl_lock ();
+
+  flow_shunt_init_common (shunt, NULL);
+
+  shunt->shunt_type = SHUNT_TYPE_PIPE;
+
+  pipe_shunt->read_fd = STDIN_FILENO;
+  flow_pipe_set_nonblock (STDIN_FILENO, TRUE);
+
+  pipe_shunt->write_fd = STDOUT_FILENO;
+  flow_pipe_set_nonblock (STDOUT_FILENO, TRUE);
+
+  shunt->can_read  = TRUE;
+  shunt->can_write = TRUE;
+
+  flow_shunt_read_state_changed (shunt);
+  flow_shunt_write_state_changed (shunt);
+
+  flow_shunt_impl_unlock ();
+
+  return shunt;
+}
+
+static FlowShunt *
+flow_shunt_impl_open_file (const gchar *path, FlowAccessMode access_mode)
+{
+  FileShuntParams *params;
+
+  params = create_file_shunt_params (path, access_mode);
+  return (FlowShunt *) create_file_shunt_thread (params);
+}
+
+static FlowShunt *
+flow_shunt_impl_create_file (const gchar *path, FlowAccessMode access_mode,
+                             gboolean destructive,
+                             FlowAccessMode creation_permissions_user,
+                             FlowAccessMode creation_permissions_group,
+                             FlowAccessMode creation_permissions_other)
+{
+  FileShuntParams *params;
+
+  params = create_file_shunt_params (path, access_mode);
+
+  params->create       = TRUE;
+  params->destructive  = destructive;
+  params->user_access  = creation_permissions_user;
+  params->group_access = creation_permissions_group;
+  params->other_access = creation_permissions_other;
+
+  return (FlowShunt *) create_file_shunt_thread (params);
+}
+
+static gpointer
+thread_shunt_main (ThreadShuntParams *params)
+{
+  ThreadShunt    *thread_shunt = params->thread_shunt;
+  FlowShunt      *shunt        = (FlowShunt *) thread_shunt;
+  FlowWorkerFunc *worker_func  = params->worker_func;
+  gpointer        worker_data  = params->worker_data;
+
+  g_slice_free (ThreadShuntParams, params);
+
+  flow_shunt_impl_lock ();
+  g_cond_signal (&thread_shunt->cond);
+  flow_shunt_impl_unlock ();
+
+  worker_func ((FlowSyncShunt *) thread_shunt, worker_data);
+
+  /* We finalize the shunt here, in the worker. But first, we have to
+   * wait for the main thread to set shunt->was_destroyed to TRUE. */
+
+  flow_shunt_impl_lock ();
+
+  while (!shunt->was_destroyed)
+    g_cond_wait (&thread_shunt->cond, &global_mutex);
+
+  flow_shunt_impl_unlock ();
+
+  g_cond_clear (&thread_shunt->cond);
+  g_slice_free (ThreadShunt, thread_shunt);
+  return NULL;
+}
+
+static FlowShunt *
+create_thread_shunt (FlowWorkerFunc func, gpointer user_data, gboolean filter_objects)
+{
+  FlowShunt         *shunt;
+  ThreadShunt       *thread_shunt;
+  ThreadShuntParams *params;
+  GThread           *thread;
+  GError            *error = NULL;
+
+  flow_shunt_impl_lock ();
+
+  thread_shunt = g_slice_new0 (ThreadShunt);
+  shunt = (FlowShunt *) thread_shunt;
+  flow_shunt_init_common (shunt, NULL);
+  shunt->shunt_type = SHUNT_TYPE_THREAD;
+
+  g_cond_init (&thread_shunt->cond);
+
+  params = g_slice_new (ThreadShuntParams);
+
+  params->thread_shunt = thread_shunt;
+  params->worker_func  = func;
+  params->worker_data  = user_data;
+
+  thread = g_thread_new ("FlowShunt thread", (GThreadFunc) thread_shunt_main, params);
+
+  if (thread)
+  {
+    shunt->can_read  = TRUE;
+    shunt->can_write = TRUE;
+
+    generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_BEGIN);
+    generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_SEGMENT_BEGIN);
+    g_cond_wait (&thread_shunt->cond, &global_mutex);
+  }
+  else
+  {
+    FlowDetailedEvent *detailed_event;
+
+    detailed_event = flow_detailed_event_new_literal (error->message);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_RESOURCE_ERROR);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED);
+
+    flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
+
+    g_clear_error (&error);
+  }
+
+  shunt->dispatched_begin = TRUE;
+
+  flow_shunt_read_state_changed (shunt);
+  flow_shunt_write_state_changed (shunt);
+
+  flow_shunt_impl_unlock ();
+
+  return shunt;
+}
+
+static FlowShunt *
+flow_shunt_impl_spawn_worker (FlowWorkerFunc func, gpointer user_data)
+{
+  return create_thread_shunt (func, user_data, FALSE);
+}
+
+static FlowShunt *
+flow_shunt_impl_spawn_process (FlowWorkerFunc func, gpointer user_data)
+{
+#ifdef G_PLATFORM_WIN32
+
+  /* On Windows, you can't fork() without also implicitly calling
+   * exec(). So we'll just have to use a thread there. See the Windows
+   * documentation on CreateProcess() for more. */
+
+  return create_thread_shunt (func, user_data, TRUE);
+
+#else
+
+  FlowShunt *shunt;
+  PipeShunt *pipe_shunt;
+  gint       saved_errno  = 0;
+  gint       up_fds [2]   = { -1, -1 };
+  gint       down_fds [2] = { -1, -1 };
+  pid_t      pid          = -1;
+
+  pipe_shunt = g_slice_new0 (PipeShunt);
+  shunt = (FlowShunt *) pipe_shunt;
+
+  flow_shunt_impl_lock ();
+  flow_shunt_init_common (shunt, NULL);
+  flow_shunt_impl_unlock ();
+
+  shunt->shunt_type = SHUNT_TYPE_PIPE;
+
+  if (pipe (up_fds) < 0)
+  {
+    /* Error: First pipe() failed */
+
+    saved_errno = errno;
+  }
+  else if (pipe (down_fds) < 0)
+  {
+    /* Error: Second pipe() failed */
+
+    saved_errno = errno;
+  }
+  else
+  {
+    pid = fork ();
+
+    if (pid == 0)
+    {
+      /* Child process */
+
+      flow_close_pipe_fd (up_fds [0]);
+      flow_close_pipe_fd (down_fds [1]);
+
+      flow_pipe_set_nonblock (down_fds [0], FALSE);
+      flow_pipe_set_nonblock (up_fds [1], FALSE);
+
+      pipe_shunt->read_fd  = down_fds [0];
+      pipe_shunt->write_fd = up_fds [1];
+
+      child_setup ();
+
+      func ((FlowSyncShunt *) pipe_shunt, user_data);
+      exit (0);
+    }
+    else if (pid > 0)
+    {
+      /* Parent process */
+
+      flow_close_pipe_fd (up_fds [1]);
+      flow_close_pipe_fd (down_fds [0]);
+
+      flow_pipe_set_nonblock (up_fds [0], TRUE);
+      flow_pipe_set_nonblock (down_fds [1], TRUE);
+
+      up_fds [1]   = -1;
+      down_fds [0] = -1;
+
+      shunt->can_read  = TRUE;
+      shunt->can_write = TRUE;
+    }
+    else
+    {
+      /* Could not fork() */
+
+      saved_errno = errno;
+    }
+  }
+
+  if (shunt->can_read)
+  {
+    /* Success */
+  }
+  else
+  {
+    FlowDetailedEvent *detailed_event;
+
+    /* Error: pipe() or fork() failed. Must be some sort of resource problem. */
+
+    if (up_fds [0] >= 0)
+      flow_close_pipe_fd (up_fds [0]);
+    if (up_fds [1] >= 0)
+      flow_close_pipe_fd (up_fds [1]);
+    if (down_fds [0] >= 0)
+      flow_close_pipe_fd (down_fds [0]);
+    if (down_fds [1] >= 0)
+      flow_close_pipe_fd (down_fds [1]);
+
+    up_fds [0] = up_fds [1] = down_fds [0] = down_fds [1] = -1;
+
+    detailed_event = generate_errno_event (saved_errno, NULL);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_RESOURCE_ERROR);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED);
+    flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
+
+    report_process_result (shunt, -1);
+  }
+
+  pipe_shunt->child_pid = pid;
+  pipe_shunt->read_fd   = up_fds [0];
+  pipe_shunt->write_fd  = down_fds [1];
+
+  flow_shunt_impl_lock ();
+
+  register_pipe_shunt (shunt);
+  flow_shunt_read_state_changed (shunt);
+  flow_shunt_write_state_changed (shunt);
+
+  flow_shunt_impl_unlock ();
+
+  return shunt;
+
+#endif
+}
+
+static FlowShunt *
+flow_shunt_impl_spawn_process_shm (FlowWorkerFunc func, gpointer user_data)
 {
-  ThreadShunt    *thread_shunt = params->thread_shunt;
-  FlowShunt      *shunt        = (FlowShunt *) thread_shunt;
-  FlowWorkerFunc *worker_func  = params->worker_func;
-  gpointer        worker_data  = params->worker_data;
+#ifdef USE_SHM_RING
 
-  g_slice_free (ThreadShuntParams, params);
+  FlowShunt *shunt;
+  ShmShunt  *shm_shunt;
+  PipeShunt *pipe_shunt;
+  gint       saved_errno;
+  gint       peer_fd = -1;
+  gint       memfd   = -1;
+  pid_t      pid     = -1;
+
+  shm_shunt = g_slice_new0 (ShmShunt);
+  pipe_shunt = (PipeShunt *) shm_shunt;
+  shunt = (FlowShunt *) shm_shunt;
 
   flow_shunt_impl_lock ();
-  g_cond_signal (&thread_shunt->cond);
+  flow_shunt_init_common (shunt, NULL);
   flow_shunt_impl_unlock ();
 
-  worker_func ((FlowSyncShunt *) thread_shunt, worker_data);
+  shunt->shunt_type = SHUNT_TYPE_SHM;
+
+  pipe_shunt->read_fd         = -1;
+  pipe_shunt->write_fd        = -1;
+  shm_shunt->doorbell_fd      = -1;
+  shm_shunt->peer_doorbell_fd = -1;
+  shm_shunt->hangup_fd        = -1;
+
+  saved_errno = shm_shunt_create_channel (shm_shunt, &peer_fd, &memfd);
+
+  if (saved_errno == 0)
+  {
+    /* The mapping is inherited across fork (); we don't need the memfd */
+
+    close (memfd);
+
+    pid = fork ();
+
+    if (pid == 0)
+    {
+      gint fd;
+
+      /* Child process: Take the peer side */
+
+      flow_close_socket_fd (shm_shunt->hangup_fd);
+      shm_shunt->hangup_fd = peer_fd;
+
+      fd = shm_shunt->doorbell_fd;
+      shm_shunt->doorbell_fd      = shm_shunt->peer_doorbell_fd;
+      shm_shunt->peer_doorbell_fd = fd;
+
+      shm_shunt_set_side (shm_shunt, TRUE, shm_shunt->ring_size);
+
+      child_setup ();
+
+      func ((FlowSyncShunt *) shm_shunt, user_data);
+      exit (0);
+    }
+    else if (pid > 0)
+    {
+      /* Parent process */
+
+      flow_close_socket_fd (peer_fd);
+
+      shm_shunt->spawned = TRUE;
+
+      shunt->can_read  = TRUE;
+      shunt->can_write = TRUE;
+
+      generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_BEGIN);
+      generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_SEGMENT_BEGIN);
+    }
+    else
+    {
+      /* Could not fork () */
+
+      saved_errno = errno;
+
+      flow_close_socket_fd (peer_fd);
+      shm_shunt_free_channel (shm_shunt);
+    }
+  }
+
+  if (!shunt->can_read)
+  {
+    FlowDetailedEvent *detailed_event;
+
+    /* Error: Setting up the channel or fork () failed. Must be some sort of
+     * resource problem. */
+
+    detailed_event = generate_errno_event (saved_errno, NULL);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_RESOURCE_ERROR);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED);
+    flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
+
+    report_process_result (shunt, -1);
+  }
+
+  shunt->dispatched_begin = TRUE;
+  pipe_shunt->child_pid = pid;
+
+  flow_shunt_impl_lock ();
+
+  register_pipe_shunt (shunt);
+  flow_shunt_read_state_changed (shunt);
+  flow_shunt_write_state_changed (shunt);
+
+  flow_shunt_impl_unlock ();
+
+  return shunt;
+
+#else
+
+  return flow_shunt_impl_spawn_process (func, user_data);
+
+#endif
+}
+
+static FlowShunt *
+flow_shunt_impl_spawn_command_line (const gchar *command_line)
+{
+  FlowShunt  *shunt;
+  PipeShunt  *pipe_shunt;
+  GError     *error = NULL;
+  gchar     **argv  = NULL;
+  GPid        pid   = -1;
+  gint        stdin_fd;
+  gint        stdout_fd;
+
+  pipe_shunt = g_slice_new0 (PipeShunt);
+  shunt = (FlowShunt *) pipe_shunt;
+
+  flow_shunt_impl_lock ();
+  flow_shunt_init_common (shunt, NULL);
+  flow_shunt_impl_unlock ();
+
+  shunt->shunt_type = SHUNT_TYPE_PIPE;
+
+  if (!g_shell_parse_argv (command_line,
+                           NULL, &argv,
+                           &error))
+  {
+    FlowDetailedEvent *detailed_event;
+
+    /* Error: Could not parse command line */
+
+    detailed_event = flow_detailed_event_new_literal (error->message);
+    flow_detailed_event_add_code (detailed_event, FLOW_EXEC_DOMAIN, FLOW_EXEC_PARSE_ERROR);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED);
+    flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
+
+    g_clear_error (&error);
+  }
+  else if (!g_spawn_async_with_pipes (NULL,                 /* cwd */
+                                      argv,
+                                      NULL,                 /* envp */
+                                      G_SPAWN_SEARCH_PATH |
+                                      G_SPAWN_DO_NOT_REAP_CHILD,  /* flags */
+                                      (GSpawnChildSetupFunc) child_setup,
+                                      NULL,                 /* user_data */
+                                      &pid,
+                                      &stdin_fd,
+                                      &stdout_fd,
+#if 0
+                                      &stderr_fd,
+#else
+                                      NULL,
+#endif
+                                      &error))
+  {
+    FlowDetailedEvent *detailed_event;
+
+    /* Error: Could not spawn child process */
+
+    detailed_event = flow_detailed_event_new_literal (error->message);
+    flow_detailed_event_add_code (detailed_event, FLOW_EXEC_DOMAIN, FLOW_EXEC_RUN_ERROR);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED);
+    flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
+
+    g_clear_error (&error);
+  }
+  else
+  {
+    /* Success */
+
+    shunt->can_read  = TRUE;
+    shunt->can_write = TRUE;
+
+    generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_BEGIN);
+    generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_SEGMENT_BEGIN);
+
+    flow_pipe_set_nonblock (stdout_fd, TRUE);
+    flow_pipe_set_nonblock (stdin_fd,  TRUE);
+#if 0
+    flow_pipe_set_nonblock (stderr_fd, TRUE);
+#endif
+
+    pipe_shunt->child_pid = pid;
+    pipe_shunt->read_fd   = stdout_fd;
+    pipe_shunt->write_fd  = stdin_fd;
+    /* TODO: The caller might want to use stderr_fd for something */
+  }
+
+  if (pid < 0)
+  {
+    pipe_shunt->child_pid = -1;
+    pipe_shunt->read_fd   = -1;
+    pipe_shunt->write_fd  = -1;
+  }
+
+  if (argv)
+    g_strfreev (argv);
+
+  flow_shunt_impl_lock ();
+
+  shunt->dispatched_begin = TRUE;
+
+  register_pipe_shunt (shunt);
+  flow_shunt_read_state_changed (shunt);
+  flow_shunt_write_state_changed (shunt);
+
+  flow_shunt_impl_unlock ();
+
+  return shunt;
+}
+
+static FlowShunt *
+flow_shunt_impl_open_tcp_listener (FlowIPService *local_service, FlowTcpListenerFlags flags)
+{
+  FlowShunt          *shunt;
+  TcpListenerShunt   *tcp_listener_shunt;
+  FlowIPAddr         *ip_addr = NULL;
+  FlowIPAddrFamily    family;
+  FlowSockaddr        sa;
+  gint                fd;
+
+  tcp_listener_shunt = g_slice_new0 (TcpListenerShunt);
+  shunt = (FlowShunt *) tcp_listener_shunt;
+
+  flow_shunt_impl_lock ();
+  flow_shunt_init_common (shunt, NULL);
+  flow_shunt_impl_unlock ();
+
+  shunt->shunt_type = SHUNT_TYPE_TCP_LISTENER;
+
+  if (local_service)
+  {
+    ip_addr = flow_ip_service_find_address (local_service, FLOW_IP_ADDR_ANY_FAMILY);
+
+    /* Don't mess with the passed-in service */
+
+    if (ip_addr)
+    {
+      /* Passed-in service provided an IP to bind to */
+
+      g_object_ref (local_service);
+    }
+    else
+    {
+      FlowIPService *new_local_service;
+
+      /* No IP; use passed-in port and quality, and bind to all interfaces */
 
-  /* We finalize the shunt here, in the worker. But first, we have to
-   * wait for the main thread to set shunt->was_destroyed to TRUE. */
+      new_local_service = flow_ip_service_new ();
+      flow_ip_service_set_port (new_local_service, flow_ip_service_get_port (local_service));
+      flow_ip_service_set_quality (new_local_service, flow_ip_service_get_quality (local_service));
 
-  flow_shunt_impl_lock ();
+      local_service = new_local_service;
+    }
+  }
+  else
+  {
+    /* No information provided; use a random, OS-assigned port, and bind to
+     * all interfaces. */
 
-  while (!shunt->was_destroyed)
-    g_cond_wait (&thread_shunt->cond, &global_mutex);
+    local_service = flow_ip_service_new ();
+  }
 
-  flow_shunt_impl_unlock ();
+  if (!ip_addr)
+  {
+    /* No IP; Bind to all interfaces, use provided port */
 
-  g_cond_clear (&thread_shunt->cond);
-  g_slice_free (ThreadShunt, thread_shunt);
-  return NULL;
-}
+    ip_addr = flow_ip_addr_new ();
+    flow_ip_addr_set_string (ip_addr, "0.0.0.0");
+    flow_ip_service_add_address (local_service, ip_addr);
+  }
 
-static FlowShunt *
-create_thread_shunt (FlowWorkerFunc func, gpointer user_data, gboolean filter_objects)
-{
-  FlowShunt         *shunt;
-  ThreadShunt       *thread_shunt;
-  ThreadShuntParams *params;
-  GThread           *thread;
-  GError            *error = NULL;
+  tcp_listener_shunt->quality = flow_ip_service_get_quality (local_service);
 
-  flow_shunt_impl_lock ();
+  family = flow_ip_addr_get_family (ip_addr);
+  tcp_listener_shunt->socket_shunt.fd = fd = socket (family == FLOW_IP_ADDR_IPV6 ? AF_INET6 : AF_INET, SOCK_STREAM, 0);
 
-  thread_shunt = g_slice_new0 (ThreadShunt);
-  shunt = (FlowShunt *) thread_shunt;
-  flow_shunt_init_common (shunt, NULL);
-  shunt->shunt_type = SHUNT_TYPE_THREAD;
+  flow_gobject_unref_clear (ip_addr);
 
-  g_cond_init (&thread_shunt->cond);
+  if (fd < 0)
+  {
+    FlowDetailedEvent *detailed_event;
+    gint               saved_errno;
 
-  params = g_slice_new (ThreadShuntParams);
+    /* Error: Could not allocate socket */
 
-  params->thread_shunt = thread_shunt;
-  params->worker_func  = func;
-  params->worker_data  = user_data;
+    saved_errno = errno;
 
-  thread = g_thread_new ("FlowShunt thread", (GThreadFunc) thread_shunt_main, params);
+    assert_non_fatal_errno (saved_errno, tcp_socket_fatal_errnos);
 
-  if (thread)
+    detailed_event = generate_errno_event (saved_errno, NULL);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_RESOURCE_ERROR);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED);
+    flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
+  }
+  else if (!flow_socket_set_nonblock (fd, TRUE))
   {
-    shunt->can_read  = TRUE;
-    shunt->can_write = TRUE;
+    /* Error: Could not set socket nonblock. If this happens, our implementation will
+     * not work as intended, so abort execution. */
 
-    generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_BEGIN);
-    generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_SEGMENT_BEGIN);
-    g_cond_wait (&thread_shunt->cond, &global_mutex);
+    g_assert_not_reached ();
   }
-  else
+  else if (!flow_ip_service_get_sockaddr (local_service, &sa, 0))
   {
     FlowDetailedEvent *detailed_event;
 
-    detailed_event = flow_detailed_event_new_literal (error->message);
-    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_RESOURCE_ERROR);
+    detailed_event = flow_detailed_event_new_literal ("Invalid address");
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_APP_ERROR);
     flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
     flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED);
-
     flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
-
-    g_clear_error (&error);
   }
+  else
+  {
+    gint on = 1;
 
-  shunt->dispatched_begin = TRUE;
+#ifndef G_PLATFORM_WIN32
+    if (setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on)) < 0)
+#else
+    if (setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, (gchar *) &on, sizeof (on)) < 0)
+#endif
+      assert_non_fatal_errno (errno, setsockopt_fatal_errnos);
 
-  flow_shunt_read_state_changed (shunt);
-  flow_shunt_write_state_changed (shunt);
+#ifdef SO_REUSEPORT
+    /* Lets several listeners bind the same address; the kernel spreads
+     * incoming connections across them */
 
-  flow_shunt_impl_unlock ();
+    if ((flags & FLOW_TCP_LISTENER_REUSE_PORT) &&
+        setsockopt (fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof (on)) < 0)
+      assert_non_fatal_errno (errno, setsockopt_fatal_errnos);
+#endif
 
-  return shunt;
-}
+#ifdef TCP_FASTOPEN
+    /* Let clients with a cookie send their first request in the SYN. The
+     * value caps the number of pending Fast Open requests. */
 
-static FlowShunt *
-flow_shunt_impl_spawn_worker (FlowWorkerFunc func, gpointer user_data)
-{
-  return create_thread_shunt (func, user_data, FALSE);
-}
+    if (flags & FLOW_TCP_LISTENER_FAST_OPEN)
+    {
+      gint qlen = TCP_FASTOPEN_QUEUE_LEN;
 
-static FlowShunt *
-flow_shunt_impl_spawn_process (FlowWorkerFunc func, gpointer user_data)
-{
-#ifdef G_PLATFORM_WIN32
+      if (setsockopt (fd, IPPROTO_TCP, TCP_FASTOPEN, &qlen, sizeof (qlen)) < 0)
+        assert_non_fatal_errno (errno, setsockopt_fatal_errnos);
+    }
+#endif
 
-  /* On Windows, you can't fork() without also implicitly calling
-   * exec(). So we'll just have to use a thread there. See the Windows
-   * documentation on CreateProcess() for more. */
+#ifdef TCP_DEFER_ACCEPT
+    /* Don't wake us up for connections until they have data to read, or
+     * until the timeout expires */
 
-  return create_thread_shunt (func, user_data, TRUE);
+    if (flags & FLOW_TCP_LISTENER_DEFER_ACCEPT)
+    {
+      gint timeout_s = TCP_DEFER_ACCEPT_TIMEOUT_S;
 
-#else
+      if (setsockopt (fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &timeout_s, sizeof (timeout_s)) < 0)
+        assert_non_fatal_errno (errno, setsockopt_fatal_errnos);
+    }
+#endif
 
-  FlowShunt *shunt;
-  PipeShunt *pipe_shunt;
-  gint       saved_errno  = 0;
-  gint       up_fds [2]   = { -1, -1 };
-  gint       down_fds [2] = { -1, -1 };
-  pid_t      pid          = -1;
+#ifdef USE_SO_NOSIGPIPE
+    /* For MacOS X, BSD */
+    setsockopt (fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof (on));
+#endif
 
-  pipe_shunt = g_slice_new0 (PipeShunt);
-  shunt = (FlowShunt *) pipe_shunt;
+    if (bind (fd, (struct sockaddr *) &sa, flow_sockaddr_get_len (&sa)) != 0)
+    {
+      FlowDetailedEvent *detailed_event;
+      gint               saved_errno;
 
-  flow_shunt_impl_lock ();
-  flow_shunt_init_common (shunt, NULL);
-  flow_shunt_impl_unlock ();
+      /* Error: Could not bind to local address */
 
-  shunt->shunt_type = SHUNT_TYPE_PIPE;
+      saved_errno = errno;
 
-  if (pipe (up_fds) < 0)
-  {
-    /* Error: First pipe() failed */
+      assert_non_fatal_errno (saved_errno, tcp_bind_fatal_errnos);
 
-    saved_errno = errno;
-  }
-  else if (pipe (down_fds) < 0)
-  {
-    /* Error: Second pipe() failed */
+      detailed_event = generate_errno_event (saved_errno, tcp_bind_errno_map);
+      flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
+      flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED);
+      flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
+    }
+    else if (listen (fd, 16) != 0)
+    {
+      FlowDetailedEvent *detailed_event;
+      gint               saved_errno;
 
-    saved_errno = errno;
+      /* Error: Could not listen */
+
+      saved_errno = errno;
+
+      assert_non_fatal_errno (saved_errno, tcp_listen_fatal_errnos);
+
+      detailed_event = generate_errno_event (saved_errno, tcp_listen_errno_map);
+      flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
+      flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED);
+      flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
+    }
+    else
+    {
+      /* Success */
+
+      shunt->can_read = TRUE;
+
+      generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_BEGIN);
+      generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_SEGMENT_BEGIN);
+    }
   }
-  else
+
+  shunt->dispatched_begin = TRUE;
+
+  if (!shunt->can_read)
   {
-    pid = fork ();
+    if (fd >= 0)
+      flow_close_socket_fd (fd);
 
-    if (pid == 0)
-    {
-      /* Child process */
+    tcp_listener_shunt->socket_shunt.fd = -1;
+  }
 
-      flow_close_pipe_fd (up_fds [0]);
-      flow_close_pipe_fd (down_fds [1]);
+  flow_shunt_impl_lock ();
+  flow_shunt_read_state_changed (shunt);
+  flow_shunt_impl_unlock ();
 
-      flow_pipe_set_nonblock (down_fds [0], FALSE);
-      flow_pipe_set_nonblock (up_fds [1], FALSE);
+  g_object_unref (local_service);
+  return shunt;
+}
 
-      pipe_shunt->read_fd  = down_fds [0];
-      pipe_shunt->write_fd = up_fds [1];
+static void
+flow_shunt_impl_set_auto_cork (FlowShunt *shunt, gboolean auto_cork)
+{
+  TcpShunt *tcp_shunt = (TcpShunt *) shunt;
+  gint      fd;
 
-      child_setup ();
+  if (shunt->shunt_type != SHUNT_TYPE_TCP)
+    return;
 
-      func ((FlowSyncShunt *) pipe_shunt, user_data);
-      exit (0);
-    }
-    else if (pid > 0)
-    {
-      /* Parent process */
+  if (tcp_shunt->auto_cork == (auto_cork ? 1 : 0))
+    return;
 
-      flow_close_pipe_fd (up_fds [1]);
-      flow_close_pipe_fd (down_fds [0]);
+  tcp_shunt->auto_cork = auto_cork ? TRUE : FALSE;
+  fd = tcp_shunt->socket_shunt.fd;
 
-      flow_pipe_set_nonblock (up_fds [0], TRUE);
-      flow_pipe_set_nonblock (down_fds [1], TRUE);
+  if (!auto_cork)
+  {
+    tcp_shunt_set_corked (shunt, FALSE);
 
-      up_fds [1]   = -1;
-      down_fds [0] = -1;
+    /* Put Nagle back the way we found it */
 
-      shunt->can_read  = TRUE;
-      shunt->can_write = TRUE;
-    }
-    else
+    if (tcp_shunt->nodelay_forced && fd >= 0)
     {
-      /* Could not fork() */
+      gint off = 0;
 
-      saved_errno = errno;
+      if (setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &off, sizeof (off)) < 0)
+        assert_non_fatal_errno (errno, setsockopt_fatal_errnos);
     }
-  }
 
-  if (shunt->can_read)
+    tcp_shunt->nodelay_forced = FALSE;
+  }
+  else if (fd >= 0)
   {
-    /* Success */
+    gint      on  = 1;
+    gint      old = 0;
+    guint     len = sizeof (old);
+
+    /* Uncorking should send the tail right away, not wait for an ACK */
+
+    if (getsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &old, &len) < 0)
+      old = 0;
+
+    if (old)
+      return;
+
+    if (setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof (on)) < 0)
+      assert_non_fatal_errno (errno, setsockopt_fatal_errnos);
+    else
+      tcp_shunt->nodelay_forced = TRUE;
   }
-  else
+}
+
+static void
+flow_shunt_impl_set_zerocopy (FlowShunt *shunt, gboolean zerocopy)
+{
+  TcpShunt *tcp_shunt = (TcpShunt *) shunt;
+
+  if (shunt->shunt_type != SHUNT_TYPE_TCP)
+    return;
+
+  /* Packets already in flight stay tracked until they complete */
+
+  tcp_shunt->zerocopy = FALSE;
+
+#ifdef USE_MSG_ZEROCOPY
+  if (zerocopy && tcp_shunt->socket_shunt.fd >= 0)
   {
-    FlowDetailedEvent *detailed_event;
+    gint on = 1;
 
-    /* Error: pipe() or fork() failed. Must be some sort of resource problem. */
+    /* Fails on kernels without support, in which case we keep copying */
 
-    if (up_fds [0] >= 0)
-      flow_close_pipe_fd (up_fds [0]);
-    if (up_fds [1] >= 0)
-      flow_close_pipe_fd (up_fds [1]);
-    if (down_fds [0] >= 0)
-      flow_close_pipe_fd (down_fds [0]);
-    if (down_fds [1] >= 0)
-      flow_close_pipe_fd (down_fds [1]);
+    if (setsockopt (tcp_shunt->socket_shunt.fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof (on)) == 0)
+      tcp_shunt->zerocopy = TRUE;
+  }
+#endif
+}
 
-    up_fds [0] = up_fds [1] = down_fds [0] = down_fds [1] = -1;
+/* Starts a non-blocking connect. With @fast_open_packet, its data goes out
+ * in the SYN if the kernel has a Fast Open cookie for the peer. Whatever
+ * isn't sent that way is queued for writing once the connection is up.
+ * Returns FALSE with errno set if the attempt could not be started. */
+static gboolean
+tcp_shunt_start_connect (FlowShunt *shunt, gint fd, FlowSockaddr *sa, FlowPacket *fast_open_packet)
+{
+#ifdef MSG_FASTOPEN
+  if (fast_open_packet)
+  {
+    gint len = flow_packet_get_size (fast_open_packet);
+    gint result;
 
-    detailed_event = generate_errno_event (saved_errno, NULL);
-    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_RESOURCE_ERROR);
-    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
-    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED);
-    flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
+    result = sendto (fd, flow_packet_get_data (fast_open_packet), len, MSG_FASTOPEN | MSG_NOSIGNAL,
+                     (struct sockaddr *) sa, flow_sockaddr_get_len (sa));
 
-    report_process_result (shunt, -1);
-  }
+    if (result >= 0 || errno == EINPROGRESS)
+    {
+      /* EINPROGRESS: No cookie yet. The SYN went out with a cookie request
+       * and no data, so we'll get a cookie for next time. */
 
-  pipe_shunt->child_pid = pid;
-  pipe_shunt->read_fd   = up_fds [0];
-  pipe_shunt->write_fd  = down_fds [1];
+      if (result < 0)
+        result = 0;
 
-  flow_shunt_impl_lock ();
+      if (result < len)
+        flow_packet_queue_push_packet (shunt->write_queue,
+                                       flow_packet_new_slice (fast_open_packet, result, len - result));
 
-  register_pipe_shunt (shunt);
-  flow_shunt_read_state_changed (shunt);
-  flow_shunt_write_state_changed (shunt);
+      return TRUE;
+    }
 
-  flow_shunt_impl_unlock ();
+    /* Anything else than Fast Open being disabled is a real error */
 
-  return shunt;
+    if (errno != EOPNOTSUPP)
+      return FALSE;
+  }
+#endif
 
+  if (fast_open_packet)
+    flow_packet_queue_push_packet (shunt->write_queue, flow_packet_ref (fast_open_packet));
+
+  if (connect (fd, (struct sockaddr *) sa, flow_sockaddr_get_len (sa)) != 0 &&
+#ifndef G_PLATFORM_WIN32
+      errno != EINPROGRESS
+#else
+      WSAGetLastError () != WSAEWOULDBLOCK
 #endif
+     )
+    return FALSE;
+
+  return TRUE;
 }
 
 static FlowShunt *
-flow_shunt_impl_spawn_command_line (const gchar *command_line)
+flow_shunt_impl_connect_to_tcp (FlowIPService *remote_service, gint local_port, FlowPacket *fast_open_packet)
 {
-  FlowShunt  *shunt;
-  PipeShunt  *pipe_shunt;
-  GError     *error = NULL;
-  gchar     **argv  = NULL;
-  GPid        pid   = -1;
-  gint        stdin_fd;
-  gint        stdout_fd;
+  FlowShunt        *shunt;
+  TcpShunt         *tcp_shunt;
+  FlowIPAddr       *ip_addr;
+  FlowIPAddrFamily  family= FLOW_IP_ADDR_IPV4;
+  FlowSockaddr      sa;
+  gint              fd;
 
-  pipe_shunt = g_slice_new0 (PipeShunt);
-  shunt = (FlowShunt *) pipe_shunt;
+  tcp_shunt = g_slice_new0 (TcpShunt);
+  shunt = (FlowShunt *) tcp_shunt;
 
   flow_shunt_impl_lock ();
   flow_shunt_init_common (shunt, NULL);
   flow_shunt_impl_unlock ();
 
-  shunt->shunt_type = SHUNT_TYPE_PIPE;
+  shunt->shunt_type = SHUNT_TYPE_TCP;
 
-  if (!g_shell_parse_argv (command_line,
-                           NULL, &argv,
-                           &error))
+  memset (&sa, 0, sizeof (sa));
+
+  ip_addr = flow_ip_service_find_address (remote_service, FLOW_IP_ADDR_ANY_FAMILY);
+  if (ip_addr)
+    family = flow_ip_addr_get_family (ip_addr);
+
+  flow_gobject_unref_clear (ip_addr);
+
+  tcp_shunt->socket_shunt.fd = fd = socket (family == FLOW_IP_ADDR_IPV6 ? AF_INET6 : AF_INET, SOCK_STREAM, 0);
+
+  if (fd < 0)
   {
     FlowDetailedEvent *detailed_event;
+    gint               saved_errno;
 
-    /* Error: Could not parse command line */
+    /* Error: Could not create socket */
 
-    detailed_event = flow_detailed_event_new_literal (error->message);
-    flow_detailed_event_add_code (detailed_event, FLOW_EXEC_DOMAIN, FLOW_EXEC_PARSE_ERROR);
+    saved_errno = errno;
+    detailed_event = generate_errno_event (saved_errno, NULL);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_RESOURCE_ERROR);
     flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
     flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED);
     flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
+  }
+  else if (!flow_socket_set_nonblock (fd, TRUE))
+  {
+    /* Error: Could not set socket nonblock. If this happens, our implementation will
+     * not work as intended, so abort execution. */
 
-    g_clear_error (&error);
+    g_assert_not_reached ();
   }
-  else if (!g_spawn_async_with_pipes (NULL,                 /* cwd */
-                                      argv,
-                                      NULL,                 /* envp */
-                                      G_SPAWN_SEARCH_PATH |
-                                      G_SPAWN_DO_NOT_REAP_CHILD,  /* flags */
-                                      (GSpawnChildSetupFunc) child_setup,
-                                      NULL,                 /* user_data */
-                                      &pid,
-                                      &stdin_fd,
-                                      &stdout_fd,
-#if 0
-                                      &stderr_fd,
-#else
-                                      NULL,
-#endif
-                                      &error))
+  else if (!flow_ip_service_get_sockaddr (remote_service, &sa, 0))
   {
     FlowDetailedEvent *detailed_event;
 
-    /* Error: Could not spawn child process */
-
-    detailed_event = flow_detailed_event_new_literal (error->message);
-    flow_detailed_event_add_code (detailed_event, FLOW_EXEC_DOMAIN, FLOW_EXEC_RUN_ERROR);
+    detailed_event = flow_detailed_event_new_literal ("Invalid address");
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_APP_ERROR);
     flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
     flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED);
     flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
+  }
+  else if (!tcp_shunt_start_connect (shunt, fd, &sa, fast_open_packet))
+  {
+    FlowDetailedEvent *detailed_event;
+    gint               saved_errno;
 
-    g_clear_error (&error);
+    /* Error: Failed to start connection attempt */
+
+    saved_errno = errno;
+
+    assert_non_fatal_errno (saved_errno, tcp_connect_fatal_errnos);
+
+    detailed_event = generate_errno_event (saved_errno, tcp_connect_errno_map);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED);
+    flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
   }
   else
   {
+    gint on = 1;
+
     /* Success */
 
-    shunt->can_read  = TRUE;
-    shunt->can_write = TRUE;
+    tcp_socket_set_quality (fd, flow_ip_service_get_quality (remote_service));
 
-    generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_BEGIN);
-    generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_SEGMENT_BEGIN);
+    if (setsockopt (fd, SOL_SOCKET, SO_OOBINLINE, &on, sizeof (on)) < 0)
+      assert_non_fatal_errno (errno, setsockopt_fatal_errnos);
 
-    flow_pipe_set_nonblock (stdout_fd, TRUE);
-    flow_pipe_set_nonblock (stdin_fd,  TRUE);
-#if 0
-    flow_pipe_set_nonblock (stderr_fd, TRUE);
+#ifdef USE_SO_NOSIGPIPE
+    /* For MacOS X, BSD */
+    setsockopt (fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof (on));
 #endif
 
-    pipe_shunt->child_pid = pid;
-    pipe_shunt->read_fd   = stdout_fd;
-    pipe_shunt->write_fd  = stdin_fd;
-    /* TODO: The caller might want to use stderr_fd for something */
+    shunt->can_read  = TRUE;
+    shunt->can_write = TRUE;
   }
 
-  if (pid < 0)
+  if (!shunt->can_read)
   {
-    pipe_shunt->child_pid = -1;
-    pipe_shunt->read_fd   = -1;
-    pipe_shunt->write_fd  = -1;
-  }
+    /* Failure: Close down resources */
 
-  if (argv)
-    g_strfreev (argv);
+    if (fd >= 0)
+    {
+      flow_close_socket_fd (fd);
+      tcp_shunt->socket_shunt.fd = -1;
+    }
+  }
 
   flow_shunt_impl_lock ();
 
-  shunt->dispatched_begin = TRUE;
-
-  register_pipe_shunt (shunt);
   flow_shunt_read_state_changed (shunt);
   flow_shunt_write_state_changed (shunt);
 
@@ -3280,85 +5599,72 @@ flow_shunt_impl_spawn_command_line (const gchar *command_line)
   return shunt;
 }
 
-static FlowShunt *
-flow_shunt_impl_open_tcp_listener (FlowIPService *local_service)
+/* Fills in a Unix domain socket address. A leading '@' selects the Linux
+ * abstract namespace. Returns FALSE if the path doesn't fit. */
+static gboolean
+unix_sockaddr_from_path (const gchar *path, struct sockaddr_un *sun, guint *sun_len)
 {
-  FlowShunt          *shunt;
-  TcpListenerShunt   *tcp_listener_shunt;
-  FlowIPAddr         *ip_addr = NULL;
-  FlowIPAddrFamily    family;
-  FlowSockaddr        sa;
-  gint                fd;
+  gsize path_len = strlen (path);
 
-  tcp_listener_shunt = g_slice_new0 (TcpListenerShunt);
-  shunt = (FlowShunt *) tcp_listener_shunt;
-
-  flow_shunt_impl_lock ();
-  flow_shunt_init_common (shunt, NULL);
-  flow_shunt_impl_unlock ();
+  if (path_len == 0 || path_len >= sizeof (sun->sun_path))
+    return FALSE;
 
-  shunt->shunt_type = SHUNT_TYPE_TCP_LISTENER;
+  memset (sun, 0, sizeof (*sun));
+  sun->sun_family = AF_UNIX;
+  memcpy (sun->sun_path, path, path_len);
 
-  if (local_service)
+#ifdef __linux__
+  if (path [0] == '@')
   {
-    ip_addr = flow_ip_service_find_address (local_service, FLOW_IP_ADDR_ANY_FAMILY);
-
-    /* Don't mess with the passed-in service */
-
-    if (ip_addr)
-    {
-      /* Passed-in service provided an IP to bind to */
-
-      g_object_ref (local_service);
-    }
-    else
-    {
-      FlowIPService *new_local_service;
-
-      /* No IP; use passed-in port and quality, and bind to all interfaces */
-
-      new_local_service = flow_ip_service_new ();
-      flow_ip_service_set_port (new_local_service, flow_ip_service_get_port (local_service));
-      flow_ip_service_set_quality (new_local_service, flow_ip_service_get_quality (local_service));
+    /* Abstract names are not NUL-terminated */
 
-      local_service = new_local_service;
-    }
+    sun->sun_path [0] = '\0';
+    *sun_len = G_STRUCT_OFFSET (struct sockaddr_un, sun_path) + path_len;
+    return TRUE;
   }
-  else
-  {
-    /* No information provided; use a random, OS-assigned port, and bind to
-     * all interfaces. */
+#endif
 
-    local_service = flow_ip_service_new ();
-  }
+  *sun_len = G_STRUCT_OFFSET (struct sockaddr_un, sun_path) + path_len + 1;
+  return TRUE;
+}
 
-  if (!ip_addr)
-  {
-    /* No IP; Bind to all interfaces, use provided port */
+static gint
+unix_socket_type_to_sock_type (FlowUnixSocketType socket_type)
+{
+  return socket_type == FLOW_UNIX_SOCKET_SEQPACKET ? SOCK_SEQPACKET : SOCK_STREAM;
+}
 
-    ip_addr = flow_ip_addr_new ();
-    flow_ip_addr_set_string (ip_addr, "0.0.0.0");
-    flow_ip_service_add_address (local_service, ip_addr);
-  }
+static FlowShunt *
+flow_shunt_impl_open_unix_listener (const gchar *path, FlowUnixSocketType socket_type)
+{
+  FlowShunt          *shunt;
+  UnixListenerShunt  *unix_listener_shunt;
+  struct sockaddr_un  sun;
+  guint               sun_len;
+  gint                fd;
 
-  tcp_listener_shunt->quality = flow_ip_service_get_quality (local_service);
+  unix_listener_shunt = g_slice_new0 (UnixListenerShunt);
+  shunt = (FlowShunt *) unix_listener_shunt;
 
-  family = flow_ip_addr_get_family (ip_addr);
-  tcp_listener_shunt->socket_shunt.fd = fd = socket (family == FLOW_IP_ADDR_IPV6 ? AF_INET6 : AF_INET, SOCK_STREAM, 0);
+  flow_shunt_impl_lock ();
+  flow_shunt_init_common (shunt, NULL);
+  flow_shunt_impl_unlock ();
 
-  flow_gobject_unref_clear (ip_addr);
+  shunt->shunt_type = SHUNT_TYPE_UNIX_LISTENER;
+  unix_listener_shunt->seqpacket = socket_type == FLOW_UNIX_SOCKET_SEQPACKET;
+
+  unix_listener_shunt->socket_shunt.fd = fd = socket (AF_UNIX, unix_socket_type_to_sock_type (socket_type), 0);
 
   if (fd < 0)
   {
     FlowDetailedEvent *detailed_event;
     gint               saved_errno;
 
-    /* Error: Could not allocate socket */
+    /* Error: Could not allocate socket. Seqpacket sockets are not
+     * supported everywhere. */
 
     saved_errno = errno;
 
-    assert_non_fatal_errno (saved_errno, tcp_socket_fatal_errnos);
-
     detailed_event = generate_errno_event (saved_errno, NULL);
     flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_RESOURCE_ERROR);
     flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
@@ -3367,54 +5673,42 @@ flow_shunt_impl_open_tcp_listener (FlowIPService *local_service)
   }
   else if (!flow_socket_set_nonblock (fd, TRUE))
   {
-    /* Error: Could not set socket nonblock. If this happens, our implementation will
-     * not work as intended, so abort execution. */
-
     g_assert_not_reached ();
   }
-  else if (!flow_ip_service_get_sockaddr (local_service, &sa, 0))
+  else if (!unix_sockaddr_from_path (path, &sun, &sun_len))
   {
     FlowDetailedEvent *detailed_event;
 
-    detailed_event = flow_detailed_event_new_literal ("Invalid address");
+    detailed_event = flow_detailed_event_new_literal ("Invalid socket path");
     flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_APP_ERROR);
     flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
     flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED);
     flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
   }
-  else
+  else if (bind (fd, (struct sockaddr *) &sun, sun_len) != 0)
   {
-    gint on = 1;
-
-#ifndef G_PLATFORM_WIN32
-    if (setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on)) < 0)
-#else
-    if (setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, (gchar *) &on, sizeof (on)) < 0)
-#endif
-      assert_non_fatal_errno (errno, setsockopt_fatal_errnos);
+    FlowDetailedEvent *detailed_event;
+    gint               saved_errno;
 
-#ifdef USE_SO_NOSIGPIPE
-    /* For MacOS X, BSD */
-    setsockopt (fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof (on));
-#endif
+    /* Error: Could not bind to path */
 
-    if (bind (fd, (struct sockaddr *) &sa, flow_sockaddr_get_len (&sa)) != 0)
-    {
-      FlowDetailedEvent *detailed_event;
-      gint               saved_errno;
+    saved_errno = errno;
 
-      /* Error: Could not bind to local address */
+    assert_non_fatal_errno (saved_errno, tcp_bind_fatal_errnos);
 
-      saved_errno = errno;
+    detailed_event = generate_errno_event (saved_errno, unix_address_errno_map);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED);
+    flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
+  }
+  else
+  {
+    /* From here on, the socket file is ours to remove */
 
-      assert_non_fatal_errno (saved_errno, tcp_bind_fatal_errnos);
+    if (sun.sun_path [0] != '\0')
+      unix_listener_shunt->path = g_strdup (path);
 
-      detailed_event = generate_errno_event (saved_errno, tcp_bind_errno_map);
-      flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
-      flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED);
-      flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
-    }
-    else if (listen (fd, 16) != 0)
+    if (listen (fd, 16) != 0)
     {
       FlowDetailedEvent *detailed_event;
       gint               saved_errno;
@@ -3448,45 +5742,37 @@ flow_shunt_impl_open_tcp_listener (FlowIPService *local_service)
     if (fd >= 0)
       flow_close_socket_fd (fd);
 
-    tcp_listener_shunt->socket_shunt.fd = -1;
+    unix_listener_shunt->socket_shunt.fd = -1;
   }
 
   flow_shunt_impl_lock ();
   flow_shunt_read_state_changed (shunt);
   flow_shunt_impl_unlock ();
 
-  g_object_unref (local_service);
   return shunt;
 }
 
 static FlowShunt *
-flow_shunt_impl_connect_to_tcp (FlowIPService *remote_service, gint local_port)
+flow_shunt_impl_connect_to_unix (const gchar *path, FlowUnixSocketType socket_type)
 {
-  FlowShunt        *shunt;
-  TcpShunt         *tcp_shunt;
-  FlowIPAddr       *ip_addr;
-  FlowIPAddrFamily  family= FLOW_IP_ADDR_IPV4;
-  FlowSockaddr      sa;
-  gint              fd;
+  FlowShunt          *shunt;
+  UnixShunt          *unix_shunt;
+  struct sockaddr_un  sun;
+  guint               sun_len;
+  gint                fd;
 
-  tcp_shunt = g_slice_new0 (TcpShunt);
-  shunt = (FlowShunt *) tcp_shunt;
+  unix_shunt = g_slice_new0 (UnixShunt);
+  shunt = (FlowShunt *) unix_shunt;
 
   flow_shunt_impl_lock ();
   flow_shunt_init_common (shunt, NULL);
   flow_shunt_impl_unlock ();
 
-  shunt->shunt_type = SHUNT_TYPE_TCP;
-
-  memset (&sa, 0, sizeof (sa));
-
-  ip_addr = flow_ip_service_find_address (remote_service, FLOW_IP_ADDR_ANY_FAMILY);
-  if (ip_addr)
-    family = flow_ip_addr_get_family (ip_addr);
-
-  flow_gobject_unref_clear (ip_addr);
+  shunt->shunt_type = SHUNT_TYPE_UNIX;
+  unix_shunt->seqpacket = socket_type == FLOW_UNIX_SOCKET_SEQPACKET;
+  g_queue_init (&unix_shunt->pending_fds);
 
-  tcp_shunt->socket_shunt.fd = fd = socket (family == FLOW_IP_ADDR_IPV6 ? AF_INET6 : AF_INET, SOCK_STREAM, 0);
+  unix_shunt->socket_shunt.fd = fd = socket (AF_UNIX, unix_socket_type_to_sock_type (socket_type), 0);
 
   if (fd < 0)
   {
@@ -3504,59 +5790,46 @@ flow_shunt_impl_connect_to_tcp (FlowIPService *remote_service, gint local_port)
   }
   else if (!flow_socket_set_nonblock (fd, TRUE))
   {
-    /* Error: Could not set socket nonblock. If this happens, our implementation will
-     * not work as intended, so abort execution. */
-
     g_assert_not_reached ();
   }
-  else if (!flow_ip_service_get_sockaddr (remote_service, &sa, 0))
+  else if (!unix_sockaddr_from_path (path, &sun, &sun_len))
   {
     FlowDetailedEvent *detailed_event;
 
-    detailed_event = flow_detailed_event_new_literal ("Invalid address");
+    detailed_event = flow_detailed_event_new_literal ("Invalid socket path");
     flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_APP_ERROR);
     flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
     flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED);
     flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
   }
-  else if (connect (fd, (struct sockaddr *) &sa, flow_sockaddr_get_len (&sa)) != 0 &&
-#ifndef G_PLATFORM_WIN32
-      errno != EINPROGRESS
-#else
-      WSAGetLastError () != WSAEWOULDBLOCK
-#endif
-     )
+  else if (connect (fd, (struct sockaddr *) &sun, sun_len) != 0 && errno != EINPROGRESS)
   {
     FlowDetailedEvent *detailed_event;
     gint               saved_errno;
 
-    /* Error: Failed to start connection attempt */
+    /* Error: Local connects complete or fail right away. EAGAIN means the
+     * listener's backlog is full, which we report rather than retry. */
 
     saved_errno = errno;
 
     assert_non_fatal_errno (saved_errno, tcp_connect_fatal_errnos);
 
-    detailed_event = generate_errno_event (saved_errno, tcp_connect_errno_map);
+    detailed_event = generate_errno_event (saved_errno, unix_address_errno_map);
     flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
     flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED);
     flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
   }
   else
   {
+#ifdef USE_SO_NOSIGPIPE
     gint on = 1;
 
-    /* Success */
-
-    tcp_socket_set_quality (fd, flow_ip_service_get_quality (remote_service));
-
-    if (setsockopt (fd, SOL_SOCKET, SO_OOBINLINE, &on, sizeof (on)) < 0)
-      assert_non_fatal_errno (errno, setsockopt_fatal_errnos);
-
-#ifdef USE_SO_NOSIGPIPE
     /* For MacOS X, BSD */
     setsockopt (fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof (on));
 #endif
 
+    /* Success; the stream begins when the socket first becomes writable */
+
     shunt->can_read  = TRUE;
     shunt->can_write = TRUE;
   }
@@ -3568,7 +5841,7 @@ flow_shunt_impl_connect_to_tcp (FlowIPService *remote_service, gint local_port)
     if (fd >= 0)
     {
       flow_close_socket_fd (fd);
-      tcp_shunt->socket_shunt.fd = -1;
+      unix_shunt->socket_shunt.fd = -1;
     }
   }
 
@@ -3582,8 +5855,291 @@ flow_shunt_impl_connect_to_tcp (FlowIPService *remote_service, gint local_port)
   return shunt;
 }
 
+/* Number of descriptors passed when a shared memory channel is opened:
+ * the memfd and the two doorbells */
+
+#define SHM_CHANNEL_N_FDS 3
+
+static FlowShunt *
+create_shm_shunt (void)
+{
+  FlowShunt *shunt;
+  ShmShunt  *shm_shunt;
+  PipeShunt *pipe_shunt;
+
+  shm_shunt = g_slice_new0 (ShmShunt);
+  pipe_shunt = (PipeShunt *) shm_shunt;
+  shunt = (FlowShunt *) shm_shunt;
+
+  flow_shunt_impl_lock ();
+  flow_shunt_init_common (shunt, NULL);
+  flow_shunt_impl_unlock ();
+
+  shunt->shunt_type = SHUNT_TYPE_SHM;
+
+  pipe_shunt->child_pid       = -1;
+  pipe_shunt->read_fd         = -1;
+  pipe_shunt->write_fd        = -1;
+  shm_shunt->doorbell_fd      = -1;
+  shm_shunt->peer_doorbell_fd = -1;
+  shm_shunt->hangup_fd        = -1;
+
+  return shunt;
+}
+
+static void
+finish_shm_channel_shunt (FlowShunt *shunt, gint saved_errno)
+{
+  if (saved_errno == 0)
+  {
+    /* Success */
+
+    shunt->can_read  = TRUE;
+    shunt->can_write = TRUE;
+
+    generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_BEGIN);
+    generate_simple_event (shunt, FLOW_STREAM_DOMAIN, FLOW_STREAM_SEGMENT_BEGIN);
+  }
+  else
+  {
+    FlowDetailedEvent *detailed_event;
+
+    shm_shunt_free_channel ((ShmShunt *) shunt);
+
+    detailed_event = generate_errno_event (saved_errno, NULL);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_RESOURCE_ERROR);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED);
+    flow_packet_queue_push_packet (shunt->read_queue, flow_packet_new_take_object (detailed_event, 0));
+  }
+
+  shunt->dispatched_begin = TRUE;
+
+  flow_shunt_impl_lock ();
+
+  flow_shunt_read_state_changed (shunt);
+  flow_shunt_write_state_changed (shunt);
+
+  flow_shunt_impl_unlock ();
+}
+
+static FlowShunt *
+flow_shunt_impl_create_shm_channel (gint *peer_fd)
+{
+  FlowShunt *shunt;
+  ShmShunt  *shm_shunt;
+  gint       saved_errno;
+  gint       memfd = -1;
+
+  shunt = create_shm_shunt ();
+  shm_shunt = (ShmShunt *) shunt;
+
+  *peer_fd = -1;
+
+  saved_errno = shm_shunt_create_channel (shm_shunt, peer_fd, &memfd);
+
+  if (saved_errno == 0)
+  {
+    union
+    {
+      struct cmsghdr align;
+      guint8         buf [CMSG_SPACE (sizeof (gint) * SHM_CHANNEL_N_FDS)];
+    }
+    control;
+    struct msghdr   msg;
+    struct iovec    iov;
+    struct cmsghdr *cmsg;
+    gint            fds [SHM_CHANNEL_N_FDS];
+    guint8          byte = 0;
+
+    /* Queue the descriptors on our end, so they're waiting for the peer
+     * when it opens the channel. The doorbells are listed from the peer's
+     * point of view: its own first. */
+
+    fds [0] = memfd;
+    fds [1] = shm_shunt->peer_doorbell_fd;
+    fds [2] = shm_shunt->doorbell_fd;
+
+    iov.iov_base = &byte;
+    iov.iov_len  = 1;
+
+    memset (&msg, 0, sizeof (msg));
+    memset (&control, 0, sizeof (control));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control.buf;
+    msg.msg_controllen = CMSG_SPACE (sizeof (fds));
+
+    cmsg = CMSG_FIRSTHDR (&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_RIGHTS;
+    cmsg->cmsg_len   = CMSG_LEN (sizeof (fds));
+    memcpy (CMSG_DATA (cmsg), fds, sizeof (fds));
+
+    if (sendmsg (shm_shunt->hangup_fd, &msg, 0) != 1)
+    {
+      saved_errno = errno;
+
+      flow_close_socket_fd (*peer_fd);
+      *peer_fd = -1;
+    }
+
+    close (memfd);
+  }
+
+  finish_shm_channel_shunt (shunt, saved_errno);
+  return shunt;
+}
+
+static FlowShunt *
+flow_shunt_impl_open_shm_channel (gint fd)
+{
+  FlowShunt *shunt;
+  ShmShunt  *shm_shunt;
+  union
+  {
+    struct cmsghdr align;
+    guint8         buf [CMSG_SPACE (sizeof (gint) * SHM_CHANNEL_N_FDS)];
+  }
+  control;
+  struct msghdr   msg;
+  struct iovec    iov;
+  struct cmsghdr *cmsg;
+  struct stat     st;
+  gint            fds [SHM_CHANNEL_N_FDS] = { -1, -1, -1 };
+  gint            saved_errno             = 0;
+  gint            result;
+  guint           ring_size               = 0;
+  guint8          byte;
+  void           *map;
+  gint            i;
+
+  shunt = create_shm_shunt ();
+  shm_shunt = (ShmShunt *) shunt;
+
+  /* We own the socket from here on, so it's released with the shunt */
+
+  shm_shunt->hangup_fd = fd;
+
+  iov.iov_base = &byte;
+  iov.iov_len  = 1;
+
+  memset (&msg, 0, sizeof (msg));
+  msg.msg_iov        = &iov;
+  msg.msg_iovlen     = 1;
+  msg.msg_control    = control.buf;
+  msg.msg_controllen = sizeof (control.buf);
+
+  /* The creator sent the descriptors before handing us the socket, so this
+   * doesn't block for long */
+
+  do
+  {
+    result = recvmsg (fd, &msg, UNIX_RECV_FLAGS);
+  }
+  while (result < 0 && errno == EINTR);
+
+  if (result < 0)
+    saved_errno = errno;
+  else if (result == 0)
+    saved_errno = EPIPE;
+
+  cmsg = CMSG_FIRSTHDR (&msg);
+
+  if (saved_errno == 0 &&
+      (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+       cmsg->cmsg_len != CMSG_LEN (sizeof (fds))))
+    saved_errno = EPROTO;
+
+  if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+  {
+    /* Take whatever we got, so we can close it again if it's wrong */
+
+    memcpy (fds, CMSG_DATA (cmsg),
+            MIN (sizeof (fds), cmsg->cmsg_len - CMSG_LEN (0)));
+
+#ifdef UNIX_RECV_SET_CLOEXEC
+    for (i = 0; i < SHM_CHANNEL_N_FDS; i++)
+    {
+      if (fds [i] >= 0)
+        fcntl (fds [i], F_SETFD, FD_CLOEXEC);
+    }
+#endif
+  }
+
+  /* Without the seals, the creator could shrink the memfd and fault us */
+
+  if (saved_errno == 0)
+  {
+#ifdef USE_SHM_RING
+    gint seals = fcntl (fds [0], F_GET_SEALS);
+
+    if (seals < 0)
+      saved_errno = errno;
+    else if ((seals & SHM_MEMFD_SEALS) != SHM_MEMFD_SEALS)
+      saved_errno = EPROTO;
+#else
+    saved_errno = ENOSYS;
+#endif
+  }
+
+  if (saved_errno == 0)
+  {
+    if (fstat (fds [0], &st) < 0)
+      saved_errno = errno;
+    else if (st.st_size < (off_t) sizeof (ShmHeader))
+      saved_errno = EPROTO;
+  }
+
+  if (saved_errno == 0)
+  {
+    map = mmap (NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fds [0], 0);
+
+    if (map == MAP_FAILED)
+    {
+      saved_errno = errno;
+    }
+    else
+    {
+      ShmHeader *header = map;
+
+      shm_shunt->header  = header;
+      shm_shunt->map_len = st.st_size;
+
+      /* Don't trust the peer's idea of the layout beyond what's mapped. The
+       * size is read exactly once, so it can't change after the check. */
+
+      ring_size = (guint) g_atomic_int_get ((volatile gint *) &header->ring_size);
+
+      if (header->magic != SHM_RING_MAGIC ||
+          ring_size == 0 ||
+          (ring_size & (ring_size - 1)) != 0 ||
+          sizeof (ShmHeader) + 2 * (gsize) ring_size != shm_shunt->map_len)
+        saved_errno = EPROTO;
+    }
+  }
+
+  if (saved_errno == 0)
+  {
+    shm_shunt_set_side (shm_shunt, TRUE, ring_size);
+
+    shm_shunt->doorbell_fd      = fds [1];
+    shm_shunt->peer_doorbell_fd = fds [2];
+    fds [1] = fds [2] = -1;
+  }
+
+  for (i = 0; i < SHM_CHANNEL_N_FDS; i++)
+  {
+    if (fds [i] >= 0)
+      close (fds [i]);
+  }
+
+  finish_shm_channel_shunt (shunt, saved_errno);
+  return shunt;
+}
+
 static FlowShunt *
-flow_shunt_impl_open_udp_port (FlowIPService *local_service)
+flow_shunt_impl_open_udp_port (FlowIPService *local_service, gboolean peer_tagged)
 {
   FlowShunt        *shunt;
   UdpShunt         *udp_shunt;
@@ -3600,6 +6156,7 @@ flow_shunt_impl_open_udp_port (FlowIPService *local_service)
   flow_shunt_impl_unlock ();
 
   shunt->shunt_type = SHUNT_TYPE_UDP;
+  udp_shunt->peer_tagged = peer_tagged;
 
   ip_addr = flow_ip_service_find_address (local_service, FLOW_IP_ADDR_ANY_FAMILY);
   if (ip_addr)
@@ -3745,6 +6302,30 @@ flow_sync_shunt_impl_try_read (FlowSyncShunt *sync_shunt, FlowPacket **packet_de
       }
       break;
 
+    case SHUNT_TYPE_SHM:
+      {
+        ShmShunt *shm_shunt = (ShmShunt *) sync_shunt;
+
+        shunt->io_buffer_size = shunt->io_buffer_desired_size;
+
+        packet = shm_shunt_read_from_ring (shm_shunt, shunt->io_buffer_size);
+
+        if (!packet && !shm_shunt->peer_closed)
+        {
+          shm_doorbell_clear (shm_shunt->doorbell_fd);
+          shm_shunt_check_hangup (shm_shunt);
+
+          /* The peer may have written more before closing */
+
+          if (shm_shunt->peer_closed)
+            packet = shm_shunt_read_from_ring (shm_shunt, shunt->io_buffer_size);
+        }
+
+        if (!packet && (shm_shunt->peer_closed || shm_shunt->corrupt))
+          still_open = FALSE;
+      }
+      break;
+
     case SHUNT_TYPE_THREAD:
       flow_shunt_impl_lock ();
 
@@ -3820,6 +6401,32 @@ flow_sync_shunt_impl_read (FlowSyncShunt *sync_shunt, FlowPacket **packet_dest)
       }
       break;
 
+    case SHUNT_TYPE_SHM:
+      {
+        ShmShunt *shm_shunt = (ShmShunt *) sync_shunt;
+
+        shunt->io_buffer_size = shunt->io_buffer_desired_size;
+
+        /* We only sleep after asking to be woken; see shm_ring_arm_reader () */
+
+        for (;;)
+        {
+          packet = shm_shunt_read_from_ring (shm_shunt, shunt->io_buffer_size);
+          if (packet)
+            break;
+
+          if (shm_shunt->peer_closed || shm_shunt->corrupt)
+          {
+            still_open = FALSE;
+            break;
+          }
+
+          if (!shm_ring_arm_reader (shm_shunt->rx_ring, shm_shunt->ring_size))
+            shm_shunt_wait (shm_shunt);
+        }
+      }
+      break;
+
     case SHUNT_TYPE_THREAD:
       {
         ThreadShunt *thread_shunt = (ThreadShunt *) sync_shunt;
@@ -3889,6 +6496,49 @@ flow_sync_shunt_impl_write (FlowSyncShunt *sync_shunt, FlowPacket *packet)
       }
       break;
 
+    case SHUNT_TYPE_SHM:
+      {
+        ShmShunt *shm_shunt = (ShmShunt *) sync_shunt;
+        guchar   *p0, *p1;
+
+        /* Objects can't be carried across; drop them like pipes would */
+
+        if (flow_packet_get_format (packet) != FLOW_PACKET_FORMAT_BUFFER)
+        {
+          flow_packet_unref (packet);
+          break;
+        }
+
+        p0 = flow_packet_get_data (packet);
+        p1 = p0 + flow_packet_get_size (packet);
+
+        while (p0 < p1)
+        {
+          guint result;
+
+          result = shm_shunt_write_to_ring (shm_shunt, p0, p1 - p0);
+
+          if (result > 0)
+          {
+            p0 += result;
+          }
+          else if (shm_shunt->tx_closed || shm_shunt->corrupt)
+          {
+            /* Peer stopped reading, or broke the ring */
+            break;
+          }
+          else if (!shm_ring_arm_writer (shm_shunt->tx_ring, shm_shunt->ring_size) &&
+                   !shm_shunt_wait (shm_shunt))
+          {
+            /* Peer went away */
+            break;
+          }
+        }
+
+        flow_packet_unref (packet);
+      }
+      break;
+
     case SHUNT_TYPE_THREAD:
       flow_shunt_impl_lock ();
       flow_packet_queue_push_packet (shunt->read_queue, packet);
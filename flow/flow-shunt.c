@@ -32,6 +32,8 @@
 #include "flow-position.h"
 #include "flow-process-result.h"
 #include "flow-segment-request.h"
+#include "flow-sockopt-op.h"
+#include "flow-unix-fds.h"
 #include "flow-gobject-util.h"
 #include "flow-util.h"
 #include "flow-shunt.h"
@@ -51,6 +53,11 @@
 
 #define MAX_DISPATCH_PACKETS 64
 
+/* Maximum number of packets to splice from a connector's input queue
+ * under one lock. */
+
+#define SPLICE_MAX_PACKETS 64
+
 typedef struct
 {
   GSource    source;
@@ -91,6 +98,7 @@ struct _FlowShunt
   guint               wait_for_restart : 1;  /* Files only; sent error, waiting for restart event */
 
   ShuntSource        *shunt_source;
+  ShuntSource        *accept_source;     /* Listeners only; where accepted shunts are dispatched */
 
   FlowPacketQueue    *read_queue;
   FlowPacketQueue    *write_queue;
@@ -150,10 +158,16 @@ static FlowShunt  *flow_shunt_impl_create_file        (const gchar *path, FlowAc
                                                       FlowAccessMode creation_permissions_other);
 static FlowShunt  *flow_shunt_impl_spawn_worker       (FlowWorkerFunc func, gpointer user_data);
 static FlowShunt  *flow_shunt_impl_spawn_process      (FlowWorkerFunc func, gpointer user_data);
+static FlowShunt  *flow_shunt_impl_spawn_process_shm  (FlowWorkerFunc func, gpointer user_data);
 static FlowShunt  *flow_shunt_impl_spawn_command_line (const gchar *command_line);
-static FlowShunt  *flow_shunt_impl_open_udp_port      (FlowIPService *local_service);
-static FlowShunt  *flow_shunt_impl_open_tcp_listener  (FlowIPService *local_service);
-static FlowShunt  *flow_shunt_impl_connect_to_tcp     (FlowIPService *remote_service, gint local_port);
+static FlowShunt  *flow_shunt_impl_open_udp_port      (FlowIPService *local_service, gboolean peer_tagged);
+static FlowShunt  *flow_shunt_impl_open_tcp_listener  (FlowIPService *local_service, FlowTcpListenerFlags flags);
+static FlowShunt  *flow_shunt_impl_connect_to_tcp     (FlowIPService *remote_service, gint local_port,
+                                                      FlowPacket *fast_open_packet);
+static FlowShunt  *flow_shunt_impl_open_unix_listener (const gchar *path, FlowUnixSocketType socket_type);
+static FlowShunt  *flow_shunt_impl_connect_to_unix    (const gchar *path, FlowUnixSocketType socket_type);
+static FlowShunt  *flow_shunt_impl_create_shm_channel (gint *peer_fd);
+static FlowShunt  *flow_shunt_impl_open_shm_channel   (gint fd);
 
 /* Notifies the implementation that one of the need_* flags went from
  * FALSE to TRUE while its corresponding doing_* flag was FALSE. The
@@ -169,6 +183,16 @@ static FlowShunt  *flow_shunt_impl_connect_to_tcp     (FlowIPService *remote_ser
 static void        flow_shunt_impl_need_reads         (FlowShunt *shunt);
 static void        flow_shunt_impl_need_writes        (FlowShunt *shunt);
 
+/* TCP shunts only: cork the socket during write bursts, uncorking when the
+ * write queue drains or a flush event is written. */
+
+static void        flow_shunt_impl_set_auto_cork      (FlowShunt *shunt, gboolean auto_cork);
+
+/* TCP shunts only: send large buffer packets with MSG_ZEROCOPY where the
+ * platform supports it. */
+
+static void        flow_shunt_impl_set_zerocopy       (FlowShunt *shunt, gboolean zerocopy);
+
 /* Synchronous shunt functions */
 
 static gboolean    flow_sync_shunt_impl_read          (FlowSyncShunt *sync_shunt, FlowPacket **packet_dest);
@@ -411,31 +435,13 @@ static GSourceFuncs shunt_source_funcs =
 };
 
 /* Assumes that caller is holding the impl lock */
-/* Must run in user's thread */
-static void
-add_shunt_to_shunt_source (FlowShunt *shunt, ShuntSource *shunt_source)
+/* Returns a borrowed source; callers must take their own references */
+static ShuntSource *
+find_shunt_source_for_context (GMainContext *main_context)
 {
-  GMainContext    *main_context;
-  GSource         *source;
-  guint            i;
-
-  if (shunt_source)
-  {
-    shunt->shunt_source = shunt_source;
-    main_context = g_source_get_context ((GSource *) shunt_source);
-
-    g_source_ref ((GSource *) shunt_source);
-    g_main_context_ref (main_context);
-    return;
-  }
-
-  main_context = flow_get_main_context_for_current_thread ();
-
-  /* It's important to ref the main context, so it won't disappear if the
-   * master thread goes away before the worker (causing errors in
-   * remove_shunt_from_shunt_source ()'s g_source_unref (). */
-
-  g_main_context_ref (main_context);
+  ShuntSource *shunt_source;
+  GSource     *source;
+  guint        i;
 
   if G_UNLIKELY (!shunt_sources)
     shunt_sources = g_ptr_array_new ();
@@ -448,11 +454,7 @@ add_shunt_to_shunt_source (FlowShunt *shunt, ShuntSource *shunt_source)
     source = g_ptr_array_index (shunt_sources, i);
 
     if (g_source_get_context (source) == main_context)
-    {
-      shunt->shunt_source = (ShuntSource *) source;
-      g_source_ref (source);
-      return;
-    }
+      return (ShuntSource *) source;
   }
 
   /* Don't have a source for this main context, so create one. */
@@ -460,8 +462,6 @@ add_shunt_to_shunt_source (FlowShunt *shunt, ShuntSource *shunt_source)
   source = g_source_new (&shunt_source_funcs, sizeof (ShuntSource));
   shunt_source = (ShuntSource *) source;
 
-  shunt->shunt_source = shunt_source;
-
   g_source_set_priority    (source, G_PRIORITY_DEFAULT_IDLE);
   g_source_set_can_recurse (source, FALSE);
   g_source_set_callback    (source, (GSourceFunc) dispatch_for_source, source, NULL);
@@ -471,22 +471,67 @@ add_shunt_to_shunt_source (FlowShunt *shunt, ShuntSource *shunt_source)
   shunt_source->dispatching_shunts = g_ptr_array_new ();
 
   g_ptr_array_add (shunt_sources, source);
+
+  /* The main context holds on to the source now */
+
+  g_source_unref (source);
+  return shunt_source;
 }
 
 /* Assumes that caller is holding the impl lock */
 static void
-remove_shunt_from_shunt_source (FlowShunt *shunt)
+ref_shunt_source (ShuntSource *shunt_source)
+{
+  GSource *source = (GSource *) shunt_source;
+
+  /* It's important to ref the main context, so it won't disappear if the
+   * master thread goes away before the worker (causing errors in
+   * unref_shunt_source ()'s g_source_unref (). */
+
+  g_source_ref (source);
+  g_main_context_ref (g_source_get_context (source));
+}
+
+/* Assumes that caller is holding the impl lock */
+static void
+unref_shunt_source (ShuntSource *shunt_source)
 {
-  ShuntSource  *shunt_source = shunt->shunt_source;
-  GSource      *source       = (GSource *) shunt_source;
+  GSource      *source = (GSource *) shunt_source;
   GMainContext *main_context;
 
   main_context = g_source_get_context (source);
-  shunt->shunt_source = NULL;
   g_source_unref (source);
   g_main_context_unref (main_context);
 }
 
+/* Assumes that caller is holding the impl lock */
+/* Must run in user's thread, unless a source is given */
+static void
+add_shunt_to_shunt_source (FlowShunt *shunt, ShuntSource *shunt_source)
+{
+  if (!shunt_source)
+    shunt_source = find_shunt_source_for_context (flow_get_main_context_for_current_thread ());
+
+  shunt->shunt_source = shunt_source;
+  ref_shunt_source (shunt_source);
+}
+
+/* Assumes that caller is holding the impl lock */
+static void
+remove_shunt_from_shunt_source (FlowShunt *shunt)
+{
+  ShuntSource *shunt_source = shunt->shunt_source;
+
+  shunt->shunt_source = NULL;
+  unref_shunt_source (shunt_source);
+
+  if (shunt->accept_source)
+  {
+    unref_shunt_source (shunt->accept_source);
+    shunt->accept_source = NULL;
+  }
+}
+
 /* ---------------- *
  * Helper Functions *
  * ---------------- */
@@ -664,6 +709,20 @@ flow_spawn_process (FlowWorkerFunc func, gpointer user_data)
   return flow_shunt_impl_spawn_process (func, user_data);
 }
 
+/* Like flow_spawn_process (), but the parent and child exchange data
+ * through a pair of ring buffers in shared memory instead of pipes. The
+ * kernel is only involved when one side has to wake the other up, so
+ * this is much faster for workers that move a lot of data. Only buffer
+ * packets and end-of-stream events are carried across. Falls back to
+ * flow_spawn_process () where shared memory rings are not supported. */
+FlowShunt *
+flow_spawn_process_shm (FlowWorkerFunc func, gpointer user_data)
+{
+  g_return_val_if_fail (func != NULL, NULL);
+
+  return flow_shunt_impl_spawn_process_shm (func, user_data);
+}
+
 FlowShunt *
 flow_spawn_command_line (const gchar *command_line)
 {
@@ -677,7 +736,18 @@ flow_open_udp_port (FlowIPService *local_service)
 {
   g_return_val_if_fail (local_service == NULL || FLOW_IS_IP_SERVICE (local_service), NULL);
 
-  return flow_shunt_impl_open_udp_port (local_service);
+  return flow_shunt_impl_open_udp_port (local_service, FALSE);
+}
+
+/* Like flow_open_udp_port (), but for talking to many peers at once. Instead
+ * of in-band FlowIPService packets, every datagram read or written is
+ * prefixed with a FlowIPEndpoint holding the peer's address. */
+FlowShunt *
+flow_open_udp_server_port (FlowIPService *local_service)
+{
+  g_return_val_if_fail (local_service == NULL || FLOW_IS_IP_SERVICE (local_service), NULL);
+
+  return flow_shunt_impl_open_udp_port (local_service, TRUE);
 }
 
 FlowShunt *
@@ -685,7 +755,28 @@ flow_open_tcp_listener (FlowIPService *local_service)
 {
   g_return_val_if_fail (local_service == NULL || FLOW_IS_IP_SERVICE (local_service), NULL);
 
-  return flow_shunt_impl_open_tcp_listener (local_service);
+  return flow_shunt_impl_open_tcp_listener (local_service, 0);
+}
+
+/* Like flow_open_tcp_listener (), but sets SO_REUSEPORT so that several
+ * listeners, typically one per thread, can share the same local service.
+ * The kernel balances incoming connections between them. */
+FlowShunt *
+flow_open_shared_tcp_listener (FlowIPService *local_service)
+{
+  g_return_val_if_fail (local_service == NULL || FLOW_IS_IP_SERVICE (local_service), NULL);
+
+  return flow_shunt_impl_open_tcp_listener (local_service, FLOW_TCP_LISTENER_REUSE_PORT);
+}
+
+/* Opens a TCP listener with socket options given by @flags. Options the
+ * platform doesn't support are ignored. */
+FlowShunt *
+flow_open_tcp_listener_full (FlowIPService *local_service, FlowTcpListenerFlags flags)
+{
+  g_return_val_if_fail (local_service == NULL || FLOW_IS_IP_SERVICE (local_service), NULL);
+
+  return flow_shunt_impl_open_tcp_listener (local_service, flags);
 }
 
 FlowShunt *
@@ -694,7 +785,73 @@ flow_connect_to_tcp (FlowIPService *remote_service, gint local_port)
   g_return_val_if_fail (FLOW_IS_IP_SERVICE (remote_service), NULL);
   g_return_val_if_fail (flow_ip_service_get_port (remote_service) > 0, NULL);
 
-  return flow_shunt_impl_connect_to_tcp (remote_service, local_port);
+  return flow_shunt_impl_connect_to_tcp (remote_service, local_port, NULL);
+}
+
+/* Like flow_connect_to_tcp (), but tries to send @first_packet's data in the
+ * SYN using TCP Fast Open, saving a round trip when the peer supports it.
+ * Any data that doesn't make it into the SYN is written once connected, so
+ * @first_packet should be followed by the rest of the stream as usual. The
+ * caller keeps its reference to @first_packet. */
+FlowShunt *
+flow_connect_to_tcp_fast_open (FlowIPService *remote_service, gint local_port, FlowPacket *first_packet)
+{
+  g_return_val_if_fail (FLOW_IS_IP_SERVICE (remote_service), NULL);
+  g_return_val_if_fail (flow_ip_service_get_port (remote_service) > 0, NULL);
+  g_return_val_if_fail (first_packet != NULL, NULL);
+  g_return_val_if_fail (flow_packet_get_format (first_packet) == FLOW_PACKET_FORMAT_BUFFER, NULL);
+
+  return flow_shunt_impl_connect_to_tcp (remote_service, local_port, first_packet);
+}
+
+/* Listens on a Unix domain socket at @path, which is created on success
+ * and unlinked when the shunt is destroyed. On Linux, a path starting
+ * with '@' names a socket in the abstract namespace instead, which is not
+ * visible in the file system. Accepted connections carry no address
+ * packet. */
+FlowShunt *
+flow_open_unix_listener (const gchar *path, FlowUnixSocketType socket_type)
+{
+  g_return_val_if_fail (path != NULL, NULL);
+
+  return flow_shunt_impl_open_unix_listener (path, socket_type);
+}
+
+/* Connects to a Unix domain socket at @path. Descriptors can be passed in
+ * either direction by writing a #FlowUnixFds ahead of some data; see
+ * flow_unix_fds_new (). With %FLOW_UNIX_SOCKET_SEQPACKET, each buffer
+ * packet is sent as one message, and messages larger than the shunt's
+ * I/O buffer size are dropped on the receiving end. */
+FlowShunt *
+flow_connect_to_unix (const gchar *path, FlowUnixSocketType socket_type)
+{
+  g_return_val_if_fail (path != NULL, NULL);
+
+  return flow_shunt_impl_connect_to_unix (path, socket_type);
+}
+
+/* Creates a shared memory channel for talking to another local process,
+ * and returns our end of it. *@peer_fd is set to a socket descriptor that
+ * must be handed to the peer, e.g. in a #FlowUnixFds or by inheritance,
+ * which then calls flow_open_shm_channel () on it. The channel works like
+ * the one set up by flow_spawn_process_shm (). Closing the descriptor
+ * without opening it ends the stream. */
+FlowShunt *
+flow_create_shm_channel (gint *peer_fd)
+{
+  g_return_val_if_fail (peer_fd != NULL, NULL);
+
+  return flow_shunt_impl_create_shm_channel (peer_fd);
+}
+
+/* Opens the peer end of a channel created by flow_create_shm_channel (),
+ * taking ownership of @fd. */
+FlowShunt *
+flow_open_shm_channel (gint fd)
+{
+  g_return_val_if_fail (fd >= 0, NULL);
+
+  return flow_shunt_impl_open_shm_channel (fd);
 }
 
 void
@@ -809,6 +966,156 @@ flow_shunt_set_write_func (FlowShunt *shunt, FlowShuntWriteFunc *write_func, gpo
   flow_shunt_impl_unlock ();
 }
 
+/* Queues packets for writing directly, bypassing the write function. This
+ * lets an element hand over a run of packets under a single lock instead
+ * of having them pulled one by one during dispatch. Packets are accepted
+ * in order until the write queue exceeds its limit or end-of-stream is
+ * seen. Nothing is accepted while the shunt is dispatching, since the
+ * write function may have packets staged that must go out first.
+ *
+ * Returns the number of packets taken; the caller keeps the rest. */
+gint
+flow_shunt_write_packets (FlowShunt *shunt, FlowPacket **packets, gint n_packets)
+{
+  gint i;
+
+  g_return_val_if_fail (shunt != NULL, 0);
+  g_return_val_if_fail (shunt->was_destroyed == FALSE, 0);
+  g_return_val_if_fail (packets != NULL || n_packets == 0, 0);
+
+  flow_shunt_impl_lock ();
+
+  if (shunt->in_dispatch || shunt->received_end)
+  {
+    flow_shunt_impl_unlock ();
+    return 0;
+  }
+
+  for (i = 0; i < n_packets &&
+              flow_packet_queue_get_length_bytes (shunt->write_queue) <= shunt->queue_limit; )
+  {
+    FlowPacket *packet = packets [i++];
+
+    flow_packet_queue_push_packet (shunt->write_queue, packet);
+
+    if G_UNLIKELY (flow_packet_get_format (packet) == FLOW_PACKET_FORMAT_OBJECT)
+    {
+      FlowDetailedEvent *detailed_event = flow_packet_get_data (packet);
+
+      if (FLOW_IS_DETAILED_EVENT (detailed_event) &&
+          flow_detailed_event_matches (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_END))
+      {
+        shunt->received_end = TRUE;
+        break;
+      }
+    }
+  }
+
+  if (i > 0)
+    flow_shunt_write_state_changed (shunt);
+
+  flow_shunt_impl_unlock ();
+  return i;
+}
+
+/* For connectors: moves leading data packets from @packet_queue straight
+ * into the shunt's write queue, taking the shunt lock once per batch.
+ * Object packets may be meant for the connector, so they are left for its
+ * write function to handle in order. */
+void
+_flow_shunt_splice_from_queue (FlowShunt *shunt, FlowPacketQueue *packet_queue)
+{
+  FlowPacket *packets [SPLICE_MAX_PACKETS];
+  gint        n_packets;
+  gint        n_written;
+  gint        n_bytes;
+  gint        i;
+
+  do
+  {
+    n_packets = SPLICE_MAX_PACKETS;
+    flow_packet_queue_peek_packets (packet_queue, packets, &n_packets);
+
+    for (i = 0; i < n_packets && flow_packet_get_format (packets [i]) == FLOW_PACKET_FORMAT_BUFFER; i++)
+      ;
+
+    if (i == 0)
+      break;
+
+    n_written = flow_shunt_write_packets (shunt, packets, i);
+
+    for (i = 0, n_bytes = 0; i < n_written; i++)
+      n_bytes += flow_packet_get_size (packets [i]);
+
+    flow_packet_queue_steal (packet_queue, n_written, n_bytes, n_bytes);
+  }
+  while (n_written == SPLICE_MAX_PACKETS);
+}
+
+/* For TCP listeners: dispatch connections accepted from now on in
+ * @main_context instead of the listener's own context. The accepted shunts
+ * are bound to that context from the start, so they can be handed to
+ * another thread without their I/O events ever waking the listener's
+ * thread. Pass %NULL to go back to the listener's context. */
+void
+flow_shunt_set_accept_context (FlowShunt *shunt, GMainContext *main_context)
+{
+  ShuntSource *shunt_source = NULL;
+
+  g_return_if_fail (shunt != NULL);
+  g_return_if_fail (shunt->was_destroyed == FALSE);
+
+  flow_shunt_impl_lock ();
+
+  if (main_context)
+  {
+    shunt_source = find_shunt_source_for_context (main_context);
+    ref_shunt_source (shunt_source);
+  }
+
+  if (shunt->accept_source)
+    unref_shunt_source (shunt->accept_source);
+
+  shunt->accept_source = shunt_source;
+
+  flow_shunt_impl_unlock ();
+}
+
+/* For TCP shunts: manage Nagle and corking from the write queue. Bursts of
+ * small packets are coalesced into full segments, and the tail of each
+ * burst goes out without delay once the queue drains or a FLOW_STREAM_FLUSH
+ * event is written. */
+void
+flow_shunt_set_auto_cork (FlowShunt *shunt, gboolean auto_cork)
+{
+  g_return_if_fail (shunt != NULL);
+  g_return_if_fail (shunt->was_destroyed == FALSE);
+
+  flow_shunt_impl_lock ();
+
+  flow_shunt_impl_set_auto_cork (shunt, auto_cork);
+
+  flow_shunt_impl_unlock ();
+}
+
+/* For TCP shunts: transmit large buffer packets without copying them into
+ * the kernel. Each such packet stays referenced until the kernel reports
+ * that it's done with it, so the packet's data must not be modified after
+ * it's written. Small packets are still copied, and the request is ignored
+ * on platforms that don't support it. */
+void
+flow_shunt_set_zerocopy (FlowShunt *shunt, gboolean zerocopy)
+{
+  g_return_if_fail (shunt != NULL);
+  g_return_if_fail (shunt->was_destroyed == FALSE);
+
+  flow_shunt_impl_lock ();
+
+  flow_shunt_impl_set_zerocopy (shunt, zerocopy);
+
+  flow_shunt_impl_unlock ();
+}
+
 guint
 flow_shunt_get_io_buffer_size (FlowShunt *shunt)
 {
@@ -41,6 +41,21 @@ typedef enum
 }
 FlowAccessMode;
 
+typedef enum
+{
+  FLOW_TCP_LISTENER_REUSE_PORT   = (1 << 0),  /* Share the port with other listeners */
+  FLOW_TCP_LISTENER_FAST_OPEN    = (1 << 1),  /* Accept data in the SYN (TCP Fast Open) */
+  FLOW_TCP_LISTENER_DEFER_ACCEPT = (1 << 2)   /* Don't accept until the client sends data */
+}
+FlowTcpListenerFlags;
+
+typedef enum
+{
+  FLOW_UNIX_SOCKET_STREAM,     /* Byte stream, like TCP */
+  FLOW_UNIX_SOCKET_SEQPACKET   /* Reliable, ordered messages; one per packet */
+}
+FlowUnixSocketType;
+
 typedef struct _FlowShunt     FlowShunt;
 typedef struct _FlowSyncShunt FlowSyncShunt;
 
@@ -56,10 +71,20 @@ FlowShunt  *flow_create_file            (const gchar *path, FlowAccessMode acces
                                          FlowAccessMode creation_permissions_other);
 FlowShunt  *flow_spawn_worker           (FlowWorkerFunc func, gpointer user_data);
 FlowShunt  *flow_spawn_process          (FlowWorkerFunc func, gpointer user_data);
+FlowShunt  *flow_spawn_process_shm      (FlowWorkerFunc func, gpointer user_data);
 FlowShunt  *flow_spawn_command_line     (const gchar *command_line);
 FlowShunt  *flow_open_udp_port          (FlowIPService *local_service);
+FlowShunt  *flow_open_udp_server_port   (FlowIPService *local_service);
 FlowShunt  *flow_open_tcp_listener      (FlowIPService *local_service);
+FlowShunt  *flow_open_shared_tcp_listener (FlowIPService *local_service);
+FlowShunt  *flow_open_tcp_listener_full (FlowIPService *local_service, FlowTcpListenerFlags flags);
 FlowShunt  *flow_connect_to_tcp         (FlowIPService *remote_service, gint local_port);
+FlowShunt  *flow_connect_to_tcp_fast_open (FlowIPService *remote_service, gint local_port,
+                                          FlowPacket *first_packet);
+FlowShunt  *flow_open_unix_listener     (const gchar *path, FlowUnixSocketType socket_type);
+FlowShunt  *flow_connect_to_unix        (const gchar *path, FlowUnixSocketType socket_type);
+FlowShunt  *flow_create_shm_channel     (gint *peer_fd);
+FlowShunt  *flow_open_shm_channel       (gint fd);
 
 void        flow_shunt_destroy          (FlowShunt *shunt);
 
@@ -70,6 +95,11 @@ void        flow_shunt_set_read_func    (FlowShunt *shunt, FlowShuntReadFunc *re
 
 void        flow_shunt_get_write_func   (FlowShunt *shunt, FlowShuntWriteFunc **write_func, gpointer *user_data);
 void        flow_shunt_set_write_func   (FlowShunt *shunt, FlowShuntWriteFunc *write_func, gpointer user_data);
+gint        flow_shunt_write_packets    (FlowShunt *shunt, FlowPacket **packets, gint n_packets);
+
+void        flow_shunt_set_accept_context (FlowShunt *shunt, GMainContext *main_context);
+void        flow_shunt_set_auto_cork    (FlowShunt *shunt, gboolean auto_cork);
+void        flow_shunt_set_zerocopy     (FlowShunt *shunt, gboolean zerocopy);
 
 guint       flow_shunt_get_io_buffer_size (FlowShunt *shunt);
 void        flow_shunt_set_io_buffer_size (FlowShunt *shunt, guint io_buffer_size);
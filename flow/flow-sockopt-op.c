@@ -0,0 +1,206 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* flow-sockopt-op.c - Operation: Set socket options.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include "flow-util.h"
+#include "flow-gobject-util.h"
+#include "flow-event.h"
+#include "flow-sockopt-op.h"
+
+typedef struct
+{
+  gint    level;
+  gint    name;
+  guint   len;
+  guint8  value [1];
+}
+SockoptEntry;
+
+/* Options may carry key material (e.g. kTLS), so don't leave it on the heap */
+static void
+sockopt_entry_free (SockoptEntry *entry)
+{
+  flow_wipe_memory (entry->value, entry->len);
+  g_free (entry);
+}
+
+/* --- FlowSockoptOp private data --- */
+
+struct _FlowSockoptOpPrivate
+{
+  GPtrArray *options;
+};
+
+/* --- FlowSockoptOp properties --- */
+
+FLOW_GOBJECT_PROPERTIES_BEGIN (flow_sockopt_op)
+FLOW_GOBJECT_PROPERTIES_END   ()
+
+/* --- FlowSockoptOp definition --- */
+
+FLOW_GOBJECT_MAKE_IMPL        (flow_sockopt_op, FlowSockoptOp, FLOW_TYPE_EVENT, 0)
+
+/* --- FlowSockoptOp implementation --- */
+
+static void
+flow_sockopt_op_update_description (FlowSockoptOp *sockopt_op)
+{
+  FlowSockoptOpPrivate *priv  = sockopt_op->priv;
+  FlowEvent            *event = FLOW_EVENT (sockopt_op);
+
+  if (event->description)
+    return;
+
+  event->description = g_strdup_printf ("Set %u socket option(s)", priv->options->len);
+}
+
+static void
+flow_sockopt_op_type_init (GType type)
+{
+}
+
+static void
+flow_sockopt_op_class_init (FlowSockoptOpClass *klass)
+{
+  FlowEventClass *event_klass = FLOW_EVENT_CLASS (klass);
+
+  event_klass->update_description = (void (*) (FlowEvent *)) flow_sockopt_op_update_description;
+}
+
+static void
+flow_sockopt_op_init (FlowSockoptOp *sockopt_op)
+{
+  FlowSockoptOpPrivate *priv = sockopt_op->priv;
+
+  priv->options = g_ptr_array_new_with_free_func ((GDestroyNotify) sockopt_entry_free);
+}
+
+static void
+flow_sockopt_op_construct (FlowSockoptOp *sockopt_op)
+{
+}
+
+static void
+flow_sockopt_op_dispose (FlowSockoptOp *sockopt_op)
+{
+}
+
+static void
+flow_sockopt_op_finalize (FlowSockoptOp *sockopt_op)
+{
+  FlowSockoptOpPrivate *priv = sockopt_op->priv;
+
+  g_ptr_array_free (priv->options, TRUE);
+}
+
+/* --- FlowSockoptOp public API --- */
+
+/**
+ * flow_sockopt_op_new:
+ *
+ * Creates a new, empty #FlowSockoptOp. Add options to it with
+ * flow_sockopt_op_add_option ().
+ *
+ * When a #FlowSockoptOp reaches a socket shunt through the write path,
+ * the options are applied with setsockopt(2) in the order they were
+ * added, after all preceding data has been written. The shunt then
+ * emits a #FlowDetailedEvent with either %FLOW_SOCKET_OPTIONS_SET or
+ * %FLOW_SOCKET_OPTIONS_FAILED on its read path. Application stops at
+ * the first option that fails.
+ *
+ * Return value: A new #FlowSockoptOp.
+ **/
+FlowSockoptOp *
+flow_sockopt_op_new (void)
+{
+  return g_object_new (FLOW_TYPE_SOCKOPT_OP, NULL);
+}
+
+/**
+ * flow_sockopt_op_add_option:
+ * @sockopt_op: A #FlowSockoptOp.
+ * @level:      Protocol level, as passed to setsockopt(2).
+ * @name:       Option name, as passed to setsockopt(2).
+ * @value:      Option value. The data is copied.
+ * @len:        Length of @value in bytes.
+ *
+ * Appends an option to be set.
+ **/
+void
+flow_sockopt_op_add_option (FlowSockoptOp *sockopt_op, gint level, gint name,
+                            gconstpointer value, guint len)
+{
+  FlowSockoptOpPrivate *priv;
+  SockoptEntry         *entry;
+
+  g_return_if_fail (FLOW_IS_SOCKOPT_OP (sockopt_op));
+  g_return_if_fail (value != NULL || len == 0);
+
+  priv = sockopt_op->priv;
+
+  entry = g_malloc (G_STRUCT_OFFSET (SockoptEntry, value) + MAX (len, 1));
+  entry->level = level;
+  entry->name  = name;
+  entry->len   = len;
+  memcpy (entry->value, value, len);
+
+  g_ptr_array_add (priv->options, entry);
+}
+
+guint
+flow_sockopt_op_get_n_options (FlowSockoptOp *sockopt_op)
+{
+  FlowSockoptOpPrivate *priv;
+
+  g_return_val_if_fail (FLOW_IS_SOCKOPT_OP (sockopt_op), 0);
+
+  priv = sockopt_op->priv;
+  return priv->options->len;
+}
+
+gconstpointer
+flow_sockopt_op_get_nth_option (FlowSockoptOp *sockopt_op, guint n,
+                                gint *level_out, gint *name_out, guint *len_out)
+{
+  FlowSockoptOpPrivate *priv;
+  SockoptEntry         *entry;
+
+  g_return_val_if_fail (FLOW_IS_SOCKOPT_OP (sockopt_op), NULL);
+
+  priv = sockopt_op->priv;
+  g_return_val_if_fail (n < priv->options->len, NULL);
+
+  entry = g_ptr_array_index (priv->options, n);
+
+  if (level_out)
+    *level_out = entry->level;
+  if (name_out)
+    *name_out = entry->name;
+  if (len_out)
+    *len_out = entry->len;
+
+  return entry->value;
+}
@@ -0,0 +1,72 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* flow-sockopt-op.h - Operation: Set socket options.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+#ifndef _FLOW_SOCKOPT_OP_H
+#define _FLOW_SOCKOPT_OP_H
+
+#include <flow/flow-event.h>
+
+#define FLOW_TYPE_SOCKOPT_OP            (flow_sockopt_op_get_type ())
+#define FLOW_SOCKOPT_OP(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), FLOW_TYPE_SOCKOPT_OP, FlowSockoptOp))
+#define FLOW_SOCKOPT_OP_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), FLOW_TYPE_SOCKOPT_OP, FlowSockoptOpClass))
+#define FLOW_IS_SOCKOPT_OP(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), FLOW_TYPE_SOCKOPT_OP))
+#define FLOW_IS_SOCKOPT_OP_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), FLOW_TYPE_SOCKOPT_OP))
+#define FLOW_SOCKOPT_OP_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), FLOW_TYPE_SOCKOPT_OP, FlowSockoptOpClass))
+GType   flow_sockopt_op_get_type        (void) G_GNUC_CONST;
+
+typedef struct _FlowSockoptOp        FlowSockoptOp;
+typedef struct _FlowSockoptOpPrivate FlowSockoptOpPrivate;
+typedef struct _FlowSockoptOpClass   FlowSockoptOpClass;
+
+struct _FlowSockoptOp
+{
+  FlowEvent   parent;
+
+  /*< private >*/
+
+  FlowSockoptOpPrivate *priv;
+};
+
+struct _FlowSockoptOpClass
+{
+  FlowEventClass parent_class;
+
+  /*< private >*/
+
+  /* Padding for future expansion */
+  void (*_pad_1) (void);
+  void (*_pad_2) (void);
+  void (*_pad_3) (void);
+  void (*_pad_4) (void);
+};
+
+FlowSockoptOp    *flow_sockopt_op_new                    (void);
+
+void              flow_sockopt_op_add_option             (FlowSockoptOp *sockopt_op, gint level, gint name,
+                                                          gconstpointer value, guint len);
+guint             flow_sockopt_op_get_n_options          (FlowSockoptOp *sockopt_op);
+gconstpointer     flow_sockopt_op_get_nth_option         (FlowSockoptOp *sockopt_op, guint n,
+                                                          gint *level_out, gint *name_out, guint *len_out);
+
+#endif /* _FLOW_SOCKOPT_OP_H */
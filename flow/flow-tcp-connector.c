@@ -26,6 +26,7 @@
 
 #include "flow-util.h"
 #include "flow-gobject-util.h"
+#include "flow-context-mgmt.h"
 #include "flow-detailed-event.h"
 #include "flow-tcp-connect-op.h"
 #include "flow-tcp-connector.h"
@@ -33,8 +34,18 @@
 #define MAX_BUFFER_PACKETS 16
 #define MAX_BUFFER_BYTES   4096
 
-static void        shunt_read  (FlowShunt *shunt, FlowPacket *packet, FlowTcpConnector *tcp_connector);
-static FlowPacket *shunt_write (FlowShunt *shunt, FlowTcpConnector *tcp_connector);
+/* Time to wait for a connection attempt before starting the next one in
+ * parallel, in milliseconds. The default comes from RFC 8305. */
+#define ATTEMPT_DELAY_MIN     10
+#define ATTEMPT_DELAY_MAX     2000
+#define ATTEMPT_DELAY_DEFAULT 250
+
+/* Implemented in flow-shunt.c */
+void _flow_shunt_splice_from_queue (FlowShunt *shunt, FlowPacketQueue *packet_queue);
+
+static void        shunt_read   (FlowShunt *shunt, FlowPacket *packet, FlowTcpConnector *tcp_connector);
+static FlowPacket *shunt_write  (FlowShunt *shunt, FlowTcpConnector *tcp_connector);
+static void        attempt_read (FlowShunt *shunt, FlowPacket *packet, FlowTcpConnector *tcp_connector);
 
 /* --- FlowTcpConnector private data --- */
 
@@ -44,11 +55,127 @@ struct _FlowTcpConnectorPrivate
   FlowTcpConnectOp *next_op;
 
   FlowShunt        *shunt;
+  gboolean          shunt_writes_unblocked;  /* Cached; avoids taking the shunt lock */
+
+  /* When the remote service has several addresses, each one gets its own
+   * shunt. The first attempt to connect becomes our shunt, and the others
+   * are destroyed. */
+
+  GSList           *attempts;
+  GQueue            pending_services;
+  FlowPacket       *last_attempt_error;
+  guint             attempt_timeout_id;
+  guint             attempt_delay;
+
+  /* With fast-open, connecting waits for one main loop iteration, so the
+   * first data written after the connect request can ride on the SYN */
+
+  gboolean          fast_open;
+  guint             fast_open_id;
+  /* With auto-cork, the shunt corks the socket while writes are queued and
+   * uncorks it when the queue drains or a flush is requested */
+
+  gboolean          auto_cork;
+  gboolean          zerocopy;
 };
 
 /* --- FlowTcpConnector properties --- */
 
+static guint
+flow_tcp_connector_get_connect_attempt_delay_internal (FlowTcpConnector *tcp_connector)
+{
+  FlowTcpConnectorPrivate *priv = tcp_connector->priv;
+
+  return priv->attempt_delay;
+}
+
+static void
+flow_tcp_connector_set_connect_attempt_delay_internal (FlowTcpConnector *tcp_connector, guint attempt_delay)
+{
+  FlowTcpConnectorPrivate *priv = tcp_connector->priv;
+
+  priv->attempt_delay = attempt_delay;
+}
+
+static gboolean
+flow_tcp_connector_get_fast_open_internal (FlowTcpConnector *tcp_connector)
+{
+  FlowTcpConnectorPrivate *priv = tcp_connector->priv;
+
+  return priv->fast_open;
+}
+
+static void
+flow_tcp_connector_set_fast_open_internal (FlowTcpConnector *tcp_connector, gboolean fast_open)
+{
+  FlowTcpConnectorPrivate *priv = tcp_connector->priv;
+
+  priv->fast_open = fast_open;
+}
+
+static gboolean
+flow_tcp_connector_get_auto_cork_internal (FlowTcpConnector *tcp_connector)
+{
+  FlowTcpConnectorPrivate *priv = tcp_connector->priv;
+
+  return priv->auto_cork;
+}
+
+static void
+flow_tcp_connector_set_auto_cork_internal (FlowTcpConnector *tcp_connector, gboolean auto_cork)
+{
+  FlowTcpConnectorPrivate *priv = tcp_connector->priv;
+
+  priv->auto_cork = auto_cork;
+
+  if (priv->shunt)
+    flow_shunt_set_auto_cork (priv->shunt, auto_cork);
+}
+
+static gboolean
+flow_tcp_connector_get_zerocopy_internal (FlowTcpConnector *tcp_connector)
+{
+  FlowTcpConnectorPrivate *priv = tcp_connector->priv;
+
+  return priv->zerocopy;
+}
+
+static void
+flow_tcp_connector_set_zerocopy_internal (FlowTcpConnector *tcp_connector, gboolean zerocopy)
+{
+  FlowTcpConnectorPrivate *priv = tcp_connector->priv;
+
+  priv->zerocopy = zerocopy;
+
+  if (priv->shunt)
+    flow_shunt_set_zerocopy (priv->shunt, zerocopy);
+}
+
 FLOW_GOBJECT_PROPERTIES_BEGIN (flow_tcp_connector)
+FLOW_GOBJECT_PROPERTY_INT     (G_TYPE_UINT, "connect-attempt-delay", "Connect attempt delay",
+                               "Milliseconds to wait for one address before also trying the next",
+                               G_PARAM_READWRITE,
+                               flow_tcp_connector_get_connect_attempt_delay_internal,
+                               flow_tcp_connector_set_connect_attempt_delay_internal,
+                               ATTEMPT_DELAY_MIN, ATTEMPT_DELAY_MAX, ATTEMPT_DELAY_DEFAULT)
+FLOW_GOBJECT_PROPERTY_BOOLEAN ("fast-open", "Fast open",
+                               "Whether to send the first data in the SYN (TCP Fast Open)",
+                               G_PARAM_READWRITE,
+                               flow_tcp_connector_get_fast_open_internal,
+                               flow_tcp_connector_set_fast_open_internal,
+                               FALSE)
+FLOW_GOBJECT_PROPERTY_BOOLEAN ("auto-cork", "Auto cork",
+                               "Whether to coalesce bursts of writes, flushing when the queue drains",
+                               G_PARAM_READWRITE,
+                               flow_tcp_connector_get_auto_cork_internal,
+                               flow_tcp_connector_set_auto_cork_internal,
+                               FALSE)
+FLOW_GOBJECT_PROPERTY_BOOLEAN ("zerocopy", "Zero-copy",
+                               "Whether to send large buffers without copying them (MSG_ZEROCOPY)",
+                               G_PARAM_READWRITE,
+                               flow_tcp_connector_get_zerocopy_internal,
+                               flow_tcp_connector_set_zerocopy_internal,
+                               FALSE)
 FLOW_GOBJECT_PROPERTIES_END   ()
 
 /* --- FlowTcpConnector definition --- */
@@ -65,6 +192,13 @@ setup_shunt (FlowTcpConnector *tcp_connector)
 
   flow_shunt_set_read_func (priv->shunt, (FlowShuntReadFunc *) shunt_read, tcp_connector);
   flow_shunt_set_write_func (priv->shunt, (FlowShuntWriteFunc *) shunt_write, tcp_connector);
+  priv->shunt_writes_unblocked = TRUE;
+
+  if (priv->auto_cork)
+    flow_shunt_set_auto_cork (priv->shunt, TRUE);
+
+  if (priv->zerocopy)
+    flow_shunt_set_zerocopy (priv->shunt, TRUE);
 
   output_pad = FLOW_PAD (flow_simplex_element_get_output_pad (FLOW_SIMPLEX_ELEMENT (tcp_connector)));
 
@@ -74,12 +208,254 @@ setup_shunt (FlowTcpConnector *tcp_connector)
   }
 }
 
+static FlowIPService *
+new_single_address_service (FlowIPService *remote_service, FlowIPAddr *ip_addr)
+{
+  FlowIPService *ip_service;
+
+  ip_service = flow_ip_service_new ();
+  flow_ip_service_add_address (ip_service, ip_addr);
+  flow_ip_service_set_port (ip_service, flow_ip_service_get_port (remote_service));
+  flow_ip_service_set_quality (ip_service, flow_ip_service_get_quality (remote_service));
+
+  return ip_service;
+}
+
+static void
+queue_attempt_services (FlowTcpConnector *tcp_connector, FlowIPService *remote_service)
+{
+  FlowTcpConnectorPrivate *priv       = tcp_connector->priv;
+  GQueue                   ipv4_addrs = G_QUEUE_INIT;
+  GQueue                   ipv6_addrs = G_QUEUE_INIT;
+  GQueue                  *first      = NULL;
+  GQueue                  *second;
+  gint                     n_addrs;
+  gint                     i;
+
+  n_addrs = flow_ip_service_get_n_addresses (remote_service);
+
+  for (i = 0; i < n_addrs; i++)
+  {
+    FlowIPAddr *ip_addr;
+    GQueue     *family_addrs;
+
+    ip_addr = flow_ip_service_get_nth_address (remote_service, i);
+    if (!ip_addr)
+      continue;
+
+    if (flow_ip_addr_get_family (ip_addr) == FLOW_IP_ADDR_IPV6)
+      family_addrs = &ipv6_addrs;
+    else
+      family_addrs = &ipv4_addrs;
+
+    if (!first)
+      first = family_addrs;
+
+    g_queue_push_tail (family_addrs, ip_addr);
+  }
+
+  if (!first)
+    return;
+
+  /* Alternate between address families, starting with the one the resolver
+   * put first (RFC 8305, section 4). */
+
+  second = (first == &ipv6_addrs) ? &ipv4_addrs : &ipv6_addrs;
+
+  while (first->length > 0 || second->length > 0)
+  {
+    FlowIPAddr *ip_addr;
+    GQueue     *swap;
+
+    ip_addr = g_queue_pop_head (first);
+    if (ip_addr)
+    {
+      g_queue_push_tail (&priv->pending_services, new_single_address_service (remote_service, ip_addr));
+      g_object_unref (ip_addr);
+    }
+
+    swap   = first;
+    first  = second;
+    second = swap;
+  }
+}
+
+static void
+cancel_attempt_timeout (FlowTcpConnector *tcp_connector)
+{
+  FlowTcpConnectorPrivate *priv = tcp_connector->priv;
+
+  if (priv->attempt_timeout_id)
+  {
+    flow_source_remove_from_current_thread (priv->attempt_timeout_id);
+    priv->attempt_timeout_id = 0;
+  }
+}
+
+static void
+cancel_attempts (FlowTcpConnector *tcp_connector)
+{
+  FlowTcpConnectorPrivate *priv = tcp_connector->priv;
+  FlowIPService           *ip_service;
+  GSList                  *l;
+
+  cancel_attempt_timeout (tcp_connector);
+
+  for (l = priv->attempts; l; l = g_slist_next (l))
+    flow_shunt_destroy (l->data);
+
+  g_slist_free (priv->attempts);
+  priv->attempts = NULL;
+
+  while ((ip_service = g_queue_pop_head (&priv->pending_services)))
+    g_object_unref (ip_service);
+
+  if (priv->last_attempt_error)
+  {
+    flow_packet_unref (priv->last_attempt_error);
+    priv->last_attempt_error = NULL;
+  }
+}
+
+static gboolean start_next_attempt (FlowTcpConnector *tcp_connector);
+
+static gboolean
+attempt_delay_expired (FlowTcpConnector *tcp_connector)
+{
+  FlowTcpConnectorPrivate *priv = tcp_connector->priv;
+
+  priv->attempt_timeout_id = 0;
+  start_next_attempt (tcp_connector);
+
+  return FALSE;
+}
+
+static gboolean
+start_next_attempt (FlowTcpConnector *tcp_connector)
+{
+  FlowTcpConnectorPrivate *priv = tcp_connector->priv;
+  FlowIPService           *ip_service;
+  FlowShunt               *shunt;
+
+  cancel_attempt_timeout (tcp_connector);
+
+  ip_service = g_queue_pop_head (&priv->pending_services);
+  if (!ip_service)
+    return FALSE;
+
+  shunt = flow_connect_to_tcp (ip_service, flow_tcp_connect_op_get_local_port (priv->op));
+  g_object_unref (ip_service);
+
+  /* Attempts have no write func until one of them wins, so nothing is taken
+   * from our input queue before we know where it's going. */
+
+  flow_shunt_set_read_func (shunt, (FlowShuntReadFunc *) attempt_read, tcp_connector);
+  priv->attempts = g_slist_prepend (priv->attempts, shunt);
+
+  if (priv->pending_services.length > 0)
+    priv->attempt_timeout_id = flow_timeout_add_to_current_thread (priv->attempt_delay,
+                                                                   (GSourceFunc) attempt_delay_expired,
+                                                                   tcp_connector);
+
+  return TRUE;
+}
+
+static void
+attempt_read (FlowShunt *shunt, FlowPacket *packet, FlowTcpConnector *tcp_connector)
+{
+  FlowTcpConnectorPrivate *priv        = tcp_connector->priv;
+  gpointer                 packet_data = flow_packet_get_data (packet);
+
+  if (flow_packet_get_format (packet) != FLOW_PACKET_FORMAT_OBJECT ||
+      !FLOW_IS_DETAILED_EVENT (packet_data))
+  {
+    flow_packet_unref (packet);
+    return;
+  }
+
+  if (flow_detailed_event_matches (packet_data, FLOW_STREAM_DOMAIN, FLOW_STREAM_BEGIN))
+  {
+    /* This attempt won. Drop the others and let it carry the stream. Any
+     * packets following this one are dispatched to shunt_read (). */
+
+    priv->attempts = g_slist_remove (priv->attempts, shunt);
+    cancel_attempts (tcp_connector);
+
+    priv->shunt = shunt;
+    setup_shunt (tcp_connector);
+    shunt_read (shunt, packet, tcp_connector);
+  }
+  else if (flow_detailed_event_matches (packet_data, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED))
+  {
+    /* This attempt failed. Move on to the next address right away, and only
+     * report failure if there are no more addresses to try. */
+
+    priv->attempts = g_slist_remove (priv->attempts, shunt);
+    flow_shunt_destroy (shunt);
+
+    if (priv->last_attempt_error)
+      flow_packet_unref (priv->last_attempt_error);
+
+    priv->last_attempt_error = packet;
+
+    if (!start_next_attempt (tcp_connector) && !priv->attempts)
+    {
+      packet = priv->last_attempt_error;
+      priv->last_attempt_error = NULL;
+
+      shunt_read (NULL, packet, tcp_connector);
+    }
+  }
+  else
+  {
+    flow_packet_unref (packet);
+  }
+}
+
+static gboolean
+fast_open_connect (FlowTcpConnector *tcp_connector)
+{
+  FlowTcpConnectorPrivate *priv = tcp_connector->priv;
+  FlowIPService           *remote_service;
+  FlowPacketQueue         *packet_queue;
+  FlowPacket              *packet = NULL;
+  FlowPad                 *input_pad;
+  gint                     local_port;
+
+  priv->fast_open_id = 0;
+
+  remote_service = flow_tcp_connect_op_get_remote_service (priv->op);
+  local_port     = flow_tcp_connect_op_get_local_port (priv->op);
+
+  input_pad    = FLOW_PAD (flow_simplex_element_get_input_pad (FLOW_SIMPLEX_ELEMENT (tcp_connector)));
+  packet_queue = flow_pad_get_packet_queue (input_pad);
+
+  /* Only data can go in the SYN; if there's none, connect as usual */
+
+  if (packet_queue &&
+      flow_packet_queue_peek_packet (packet_queue, &packet, NULL) &&
+      flow_packet_get_format (packet) == FLOW_PACKET_FORMAT_BUFFER)
+  {
+    packet = flow_packet_queue_pop_packet (packet_queue);
+    priv->shunt = flow_connect_to_tcp_fast_open (remote_service, local_port, packet);
+    flow_packet_unref (packet);
+  }
+  else
+  {
+    priv->shunt = flow_connect_to_tcp (remote_service, local_port);
+  }
+
+  setup_shunt (tcp_connector);
+  return FALSE;
+}
+
 static void
 connect_to_remote_service (FlowTcpConnector *tcp_connector)
 {
   FlowTcpConnectorPrivate *priv = tcp_connector->priv;
+  FlowIPService           *remote_service;
 
-  if (priv->shunt)
+  if (priv->shunt || priv->attempts || priv->fast_open_id)
   {
     /* We already have an active shunt. This can happen when a shunt has
      * been installed using _flow_tcp_connector_install_connected_shunt (). */
@@ -102,9 +478,29 @@ connect_to_remote_service (FlowTcpConnector *tcp_connector)
     return;
   }
 
-  priv->shunt = flow_connect_to_tcp (flow_tcp_connect_op_get_remote_service (priv->op),
-                                     flow_tcp_connect_op_get_local_port (priv->op));
-  setup_shunt (tcp_connector);
+  remote_service = flow_tcp_connect_op_get_remote_service (priv->op);
+
+  if (flow_ip_service_get_n_addresses (remote_service) > 1)
+  {
+    /* Connect to several addresses in parallel, staggered by the attempt
+     * delay, so a single unreachable address doesn't hold us up. */
+
+    queue_attempt_services (tcp_connector, remote_service);
+    start_next_attempt (tcp_connector);
+  }
+  else if (priv->fast_open)
+  {
+    /* Parallel attempts above don't use Fast Open, since data sent in
+     * the SYN can't be taken back from the attempts that lose */
+
+    priv->fast_open_id = flow_idle_add_to_current_thread ((GSourceFunc) fast_open_connect, tcp_connector);
+  }
+  else
+  {
+    priv->shunt = flow_connect_to_tcp (remote_service, flow_tcp_connect_op_get_local_port (priv->op));
+    setup_shunt (tcp_connector);
+  }
+
   flow_connector_set_state_internal (FLOW_CONNECTOR (tcp_connector), FLOW_CONNECTIVITY_CONNECTING);
 }
 
@@ -212,9 +608,10 @@ shunt_read (FlowShunt *shunt, FlowPacket *packet, FlowTcpConnector *tcp_connecto
 static FlowPacket *
 shunt_write (FlowShunt *shunt, FlowTcpConnector *tcp_connector)
 {
-  FlowPad         *input_pad;
-  FlowPacketQueue *packet_queue;
-  FlowPacket      *packet;
+  FlowTcpConnectorPrivate *priv = tcp_connector->priv;
+  FlowPad                 *input_pad;
+  FlowPacketQueue         *packet_queue;
+  FlowPacket              *packet;
 
   input_pad = FLOW_PAD (flow_simplex_element_get_input_pad (FLOW_SIMPLEX_ELEMENT (tcp_connector)));
   packet_queue = flow_pad_get_packet_queue (input_pad);
@@ -229,6 +626,7 @@ shunt_write (FlowShunt *shunt, FlowTcpConnector *tcp_connector)
 
   if (!packet_queue || flow_packet_queue_get_length_packets (packet_queue) == 0)
   {
+    priv->shunt_writes_unblocked = FALSE;
     flow_shunt_block_writes (shunt);
     return NULL;
   }
@@ -256,7 +654,7 @@ flow_tcp_connector_process_input (FlowTcpConnector *tcp_connector, FlowPad *inpu
   if (!packet_queue)
     return;
 
-  while (!priv->shunt)
+  while (!priv->shunt && !priv->attempts && !priv->fast_open_id)
   {
     FlowPacket *packet;
  
@@ -273,15 +671,22 @@ flow_tcp_connector_process_input (FlowTcpConnector *tcp_connector, FlowPad *inpu
       flow_packet_unref (packet);
   }
 
+  if (priv->shunt)
+    _flow_shunt_splice_from_queue (priv->shunt, packet_queue);
+
   if (flow_packet_queue_get_length_bytes (packet_queue) >= MAX_BUFFER_BYTES ||
       flow_packet_queue_get_length_packets (packet_queue) >= MAX_BUFFER_PACKETS)
   {
     flow_pad_block (input_pad);
   }
 
-  if (priv->shunt)
+  /* Whatever couldn't be spliced is pulled by shunt_write (). Only wake it
+   * up if it went to sleep, since that takes the shunt lock. */
+
+  if (priv->shunt && !priv->shunt_writes_unblocked &&
+      flow_packet_queue_get_length_packets (packet_queue) > 0)
   {
-    /* FIXME: The shunt's locking might be a performance liability. We could cache the state. */
+    priv->shunt_writes_unblocked = TRUE;
     flow_shunt_unblock_writes (priv->shunt);
   }
 }
@@ -322,6 +727,10 @@ flow_tcp_connector_class_init (FlowTcpConnectorClass *klass)
 static void
 flow_tcp_connector_init (FlowTcpConnector *tcp_connector)
 {
+  FlowTcpConnectorPrivate *priv = tcp_connector->priv;
+
+  g_queue_init (&priv->pending_services);
+  priv->attempt_delay = ATTEMPT_DELAY_DEFAULT;
 }
 
 static void
@@ -337,6 +746,14 @@ flow_tcp_connector_dispose (FlowTcpConnector *tcp_connector)
   flow_gobject_unref_clear (priv->op);
   flow_gobject_unref_clear (priv->next_op);
 
+  cancel_attempts (tcp_connector);
+
+  if (priv->fast_open_id)
+  {
+    flow_source_remove_from_current_thread (priv->fast_open_id);
+    priv->fast_open_id = 0;
+  }
+
   if (priv->shunt)
   {
     flow_shunt_destroy (priv->shunt);
@@ -27,17 +27,61 @@
 #include "flow-util.h"
 #include "flow-element-util.h"
 #include "flow-gobject-util.h"
+#include "flow-context-mgmt.h"
 #include "flow-tcp-io-listener.h"
 
+#define POOL_SIZE_MAX       1024
+#define POOL_REFILL_BATCH   8
+
+/* Implemented in flow-tcp-listener.c */
+FlowShunt *_flow_tcp_listener_pop_connected_shunt (FlowTcpListener *tcp_listener);
+void       _flow_tcp_listener_install_connected_shunt (FlowTcpListener *tcp_listener, FlowTcpConnector *tcp_connector,
+                                                       FlowShunt *connected_shunt);
+
 /* --- FlowTcpIOListener private data --- */
 
 struct _FlowTcpIOListenerPrivate
 {
+  /* Idle FlowTcpIOs, built ahead of time so accepting a connection only
+   * needs to install its shunt */
+
+  GQueue           pool;
+  guint            pool_size;
+  guint            pool_refill_id;
 };
 
 /* --- FlowTcpIOListener properties --- */
 
+static void schedule_pool_refill (FlowTcpIOListener *tcp_io_listener);
+
+static guint
+flow_tcp_io_listener_get_pool_size_internal (FlowTcpIOListener *tcp_io_listener)
+{
+  FlowTcpIOListenerPrivate *priv = tcp_io_listener->priv;
+
+  return priv->pool_size;
+}
+
+static void
+flow_tcp_io_listener_set_pool_size_internal (FlowTcpIOListener *tcp_io_listener, guint pool_size)
+{
+  FlowTcpIOListenerPrivate *priv = tcp_io_listener->priv;
+
+  priv->pool_size = pool_size;
+
+  while (priv->pool.length > pool_size)
+    g_object_unref (g_queue_pop_tail (&priv->pool));
+
+  schedule_pool_refill (tcp_io_listener);
+}
+
 FLOW_GOBJECT_PROPERTIES_BEGIN (flow_tcp_io_listener)
+FLOW_GOBJECT_PROPERTY_INT     (G_TYPE_UINT, "pool-size", "Pool size",
+                               "Number of idle connection objects to keep ready",
+                               G_PARAM_READWRITE,
+                               flow_tcp_io_listener_get_pool_size_internal,
+                               flow_tcp_io_listener_set_pool_size_internal,
+                               0, POOL_SIZE_MAX, 0)
 FLOW_GOBJECT_PROPERTIES_END   ()
 
 /* --- FlowTcpIOListener definition --- */
@@ -69,6 +113,17 @@ flow_tcp_io_listener_construct (FlowTcpIOListener *tcp_io_listener)
 static void
 flow_tcp_io_listener_dispose (FlowTcpIOListener *tcp_io_listener)
 {
+  FlowTcpIOListenerPrivate *priv = tcp_io_listener->priv;
+  FlowTcpIO                *tcp_io;
+
+  if (priv->pool_refill_id)
+  {
+    flow_source_remove_from_current_thread (priv->pool_refill_id);
+    priv->pool_refill_id = 0;
+  }
+
+  while ((tcp_io = g_queue_pop_head (&priv->pool)))
+    g_object_unref (tcp_io);
 }
 
 static void
@@ -76,19 +131,55 @@ flow_tcp_io_listener_finalize (FlowTcpIOListener *tcp_io_listener)
 {
 }
 
+static gboolean
+refill_pool (FlowTcpIOListener *tcp_io_listener)
+{
+  FlowTcpIOListenerPrivate *priv = tcp_io_listener->priv;
+  guint                     i;
+
+  /* Build a few at a time, so we don't hold up other sources */
+
+  for (i = 0; i < POOL_REFILL_BATCH && priv->pool.length < priv->pool_size; i++)
+    g_queue_push_tail (&priv->pool, flow_tcp_io_new ());
+
+  if (priv->pool.length < priv->pool_size)
+    return TRUE;
+
+  priv->pool_refill_id = 0;
+  return FALSE;
+}
+
+static void
+schedule_pool_refill (FlowTcpIOListener *tcp_io_listener)
+{
+  FlowTcpIOListenerPrivate *priv = tcp_io_listener->priv;
+
+  if (priv->pool_refill_id || priv->pool.length >= priv->pool_size)
+    return;
+
+  /* Refill when the listener's thread has nothing better to do */
+
+  priv->pool_refill_id = flow_idle_add_full (NULL, G_PRIORITY_LOW, (GSourceFunc) refill_pool,
+                                             tcp_io_listener, NULL);
+}
+
 static FlowTcpIO *
-setup_tcp_io (FlowElement *tcp_connector)
+setup_tcp_io (FlowTcpIOListener *tcp_io_listener, FlowShunt *connected_shunt)
 {
-  FlowTcpIO   *tcp_io;
-  FlowBin     *bin;
+  FlowTcpIOListenerPrivate *priv = tcp_io_listener->priv;
+  FlowTcpIO                *tcp_io;
 
-  tcp_io = flow_tcp_io_new ();
-  bin    = FLOW_BIN (tcp_io);
+  tcp_io = g_queue_pop_head (&priv->pool);
+  if (!tcp_io)
+    tcp_io = flow_tcp_io_new ();
 
-  /* Replace the FlowTcpConnector in tcp_io's bin */
+  schedule_pool_refill (tcp_io_listener);
 
-  flow_tcp_io_set_tcp_connector (tcp_io, FLOW_TCP_CONNECTOR (tcp_connector));
-  g_object_unref (tcp_connector);
+  /* Use the connector the FlowTcpIO already has, instead of building a
+   * separate one and swapping it in */
+
+  _flow_tcp_listener_install_connected_shunt (FLOW_TCP_LISTENER (tcp_io_listener),
+                                              flow_tcp_io_get_tcp_connector (tcp_io), connected_shunt);
 
   return tcp_io;
 }
@@ -104,21 +195,55 @@ flow_tcp_io_listener_new (void)
 FlowTcpIO *
 flow_tcp_io_listener_pop_connection (FlowTcpIOListener *tcp_io_listener)
 {
-  FlowElement *tcp_connector;
+  FlowShunt *connected_shunt;
 
   g_return_val_if_fail (FLOW_IS_TCP_IO_LISTENER (tcp_io_listener), NULL);
 
-  tcp_connector = (FlowElement *) flow_tcp_listener_pop_connection (FLOW_TCP_LISTENER (tcp_io_listener));
-  if (!tcp_connector)
+  connected_shunt = _flow_tcp_listener_pop_connected_shunt (FLOW_TCP_LISTENER (tcp_io_listener));
+  if (!connected_shunt)
     return NULL;
 
-  return setup_tcp_io (tcp_connector);
+  return setup_tcp_io (tcp_io_listener, connected_shunt);
+}
+
+/**
+ * flow_tcp_io_listener_pop_connections:
+ * @tcp_io_listener: A #FlowTcpIOListener.
+ * @tcp_ios_out:     Array to store the accepted connections in.
+ * @n_max:           Number of elements in @tcp_ios_out.
+ *
+ * Pops up to @n_max accepted connections at once. When many connections
+ * arrive together, a "new-connection" handler can drain them all in one go
+ * and ignore the remaining emissions, which will find nothing to pop.
+ *
+ * Return value: The number of connections stored in @tcp_ios_out.
+ **/
+guint
+flow_tcp_io_listener_pop_connections (FlowTcpIOListener *tcp_io_listener, FlowTcpIO **tcp_ios_out, guint n_max)
+{
+  FlowShunt *connected_shunt;
+  guint      n;
+
+  g_return_val_if_fail (FLOW_IS_TCP_IO_LISTENER (tcp_io_listener), 0);
+  g_return_val_if_fail (tcp_ios_out != NULL || n_max == 0, 0);
+
+  for (n = 0; n < n_max; n++)
+  {
+    connected_shunt = _flow_tcp_listener_pop_connected_shunt (FLOW_TCP_LISTENER (tcp_io_listener));
+    if (!connected_shunt)
+      break;
+
+    tcp_ios_out [n] = setup_tcp_io (tcp_io_listener, connected_shunt);
+  }
+
+  return n;
 }
 
 FlowTcpIO *
 flow_tcp_io_listener_sync_pop_connection (FlowTcpIOListener *tcp_io_listener)
 {
   FlowElement *tcp_connector;
+  FlowTcpIO   *tcp_io;
 
   g_return_val_if_fail (FLOW_IS_TCP_IO_LISTENER (tcp_io_listener), NULL);
 
@@ -126,5 +251,11 @@ flow_tcp_io_listener_sync_pop_connection (FlowTcpIOListener *tcp_io_listener)
   if (!tcp_connector)
     return NULL;
 
-  return setup_tcp_io (tcp_connector);
+  /* Replace the FlowTcpConnector in tcp_io's bin */
+
+  tcp_io = flow_tcp_io_new ();
+  flow_tcp_io_set_tcp_connector (tcp_io, FLOW_TCP_CONNECTOR (tcp_connector));
+  g_object_unref (tcp_connector);
+
+  return tcp_io;
 }
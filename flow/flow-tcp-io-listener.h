@@ -69,6 +69,8 @@ struct _FlowTcpIOListenerClass
 FlowTcpIOListener  *flow_tcp_io_listener_new                 (void);
 
 FlowTcpIO          *flow_tcp_io_listener_pop_connection      (FlowTcpIOListener *tcp_io_listener);
+guint               flow_tcp_io_listener_pop_connections     (FlowTcpIOListener *tcp_io_listener,
+                                                              FlowTcpIO **tcp_ios_out, guint n_max);
 FlowTcpIO          *flow_tcp_io_listener_sync_pop_connection (FlowTcpIOListener *tcp_io_listener);
 
 G_END_DECLS
@@ -0,0 +1,755 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* flow-tcp-io-pool.c - A pool of reusable TCP connections.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "flow-gobject-util.h"
+#include "flow-event-codes.h"
+#include "flow-tcp-io-pool.h"
+
+#define MAX_IDLE_PER_HOST_DEFAULT 8
+#define MAX_PER_HOST_DEFAULT      0     /* Unlimited */
+#define IDLE_TIMEOUT_DEFAULT      60    /* Seconds */
+
+/* Expired connections are pruned when the pool is used, at most this often */
+
+#define PRUNE_INTERVAL_USEC       G_USEC_PER_SEC
+
+typedef struct
+{
+  gchar     *key;
+  GQueue     idle;      /* IdleConnection; most recently released first */
+  guint      n_active;  /* Checked out or connecting */
+}
+PoolHost;
+
+typedef struct
+{
+  FlowTcpIO *tcp_io;
+  gint64     release_time;
+}
+IdleConnection;
+
+/* --- FlowTcpIOPool private data --- */
+
+struct _FlowTcpIOPoolPrivate
+{
+  GMutex      mutex;
+
+  GType       io_type;
+  GHashTable *hosts;   /* Key string -> PoolHost */
+  GHashTable *active;  /* FlowTcpIO -> PoolHost */
+  gint64      last_prune_time;
+
+  guint       max_idle_per_host;
+  guint       max_per_host;
+  guint       idle_timeout;
+};
+
+/* --- FlowTcpIOPool properties --- */
+
+static guint
+flow_tcp_io_pool_get_max_idle_per_host_internal (FlowTcpIOPool *tcp_io_pool)
+{
+  FlowTcpIOPoolPrivate *priv = tcp_io_pool->priv;
+
+  return priv->max_idle_per_host;
+}
+
+static void
+flow_tcp_io_pool_set_max_idle_per_host_internal (FlowTcpIOPool *tcp_io_pool, guint max_idle_per_host)
+{
+  FlowTcpIOPoolPrivate *priv = tcp_io_pool->priv;
+
+  g_mutex_lock (&priv->mutex);
+  priv->max_idle_per_host = max_idle_per_host;
+  g_mutex_unlock (&priv->mutex);
+}
+
+static guint
+flow_tcp_io_pool_get_max_per_host_internal (FlowTcpIOPool *tcp_io_pool)
+{
+  FlowTcpIOPoolPrivate *priv = tcp_io_pool->priv;
+
+  return priv->max_per_host;
+}
+
+static void
+flow_tcp_io_pool_set_max_per_host_internal (FlowTcpIOPool *tcp_io_pool, guint max_per_host)
+{
+  FlowTcpIOPoolPrivate *priv = tcp_io_pool->priv;
+
+  g_mutex_lock (&priv->mutex);
+  priv->max_per_host = max_per_host;
+  g_mutex_unlock (&priv->mutex);
+}
+
+static guint
+flow_tcp_io_pool_get_idle_timeout_internal (FlowTcpIOPool *tcp_io_pool)
+{
+  FlowTcpIOPoolPrivate *priv = tcp_io_pool->priv;
+
+  return priv->idle_timeout;
+}
+
+static void
+flow_tcp_io_pool_set_idle_timeout_internal (FlowTcpIOPool *tcp_io_pool, guint idle_timeout)
+{
+  FlowTcpIOPoolPrivate *priv = tcp_io_pool->priv;
+
+  g_mutex_lock (&priv->mutex);
+  priv->idle_timeout = idle_timeout;
+  g_mutex_unlock (&priv->mutex);
+}
+
+FLOW_GOBJECT_PROPERTIES_BEGIN (flow_tcp_io_pool)
+FLOW_GOBJECT_PROPERTY_INT     (G_TYPE_UINT, "max-idle-per-host", "Max idle per host",
+                               "Maximum number of idle connections to keep for each remote service",
+                               G_PARAM_READWRITE,
+                               flow_tcp_io_pool_get_max_idle_per_host_internal,
+                               flow_tcp_io_pool_set_max_idle_per_host_internal,
+                               0, G_MAXUINT, MAX_IDLE_PER_HOST_DEFAULT)
+FLOW_GOBJECT_PROPERTY_INT     (G_TYPE_UINT, "max-per-host", "Max per host",
+                               "Maximum number of connections in use for each remote service (0 is unlimited)",
+                               G_PARAM_READWRITE,
+                               flow_tcp_io_pool_get_max_per_host_internal,
+                               flow_tcp_io_pool_set_max_per_host_internal,
+                               0, G_MAXUINT, MAX_PER_HOST_DEFAULT)
+FLOW_GOBJECT_PROPERTY_INT     (G_TYPE_UINT, "idle-timeout", "Idle timeout",
+                               "Seconds to keep an idle connection (0 keeps it indefinitely)",
+                               G_PARAM_READWRITE,
+                               flow_tcp_io_pool_get_idle_timeout_internal,
+                               flow_tcp_io_pool_set_idle_timeout_internal,
+                               0, G_MAXUINT, IDLE_TIMEOUT_DEFAULT)
+FLOW_GOBJECT_PROPERTIES_END   ()
+
+/* --- FlowTcpIOPool definition --- */
+
+FLOW_GOBJECT_MAKE_IMPL        (flow_tcp_io_pool, FlowTcpIOPool, G_TYPE_OBJECT, 0)
+
+/* --- FlowTcpIOPool implementation --- */
+
+static gchar *
+generate_key (FlowIPService *remote_service)
+{
+  gchar *remote_name = NULL;
+  gchar *key;
+
+  if (flow_ip_service_have_name (remote_service))
+  {
+    remote_name = flow_ip_service_get_name (remote_service);
+  }
+  else
+  {
+    FlowIPAddr *ip_addr = flow_ip_service_get_nth_address (remote_service, 0);
+
+    if (ip_addr)
+    {
+      remote_name = flow_ip_addr_get_string (ip_addr);
+      g_object_unref (ip_addr);
+    }
+  }
+
+  key = g_strdup_printf ("%s:%d", remote_name ? remote_name : "", flow_ip_service_get_port (remote_service));
+
+  g_free (remote_name);
+  return key;
+}
+
+static void
+discard_connection (FlowTcpIO *tcp_io)
+{
+  flow_tcp_io_disconnect (tcp_io, TRUE);
+  g_object_unref (tcp_io);
+}
+
+static void
+pool_host_free (PoolHost *host)
+{
+  IdleConnection *idle_connection;
+
+  while ((idle_connection = g_queue_pop_head (&host->idle)))
+  {
+    discard_connection (idle_connection->tcp_io);
+    g_slice_free (IdleConnection, idle_connection);
+  }
+
+  g_free (host->key);
+  g_slice_free (PoolHost, host);
+}
+
+/* Called with mutex held */
+static PoolHost *
+lookup_host (FlowTcpIOPool *tcp_io_pool, FlowIPService *remote_service, gboolean create)
+{
+  FlowTcpIOPoolPrivate *priv = tcp_io_pool->priv;
+  PoolHost             *host;
+  gchar                *key;
+
+  key = generate_key (remote_service);
+  host = g_hash_table_lookup (priv->hosts, key);
+
+  if (host || !create)
+  {
+    g_free (key);
+    return host;
+  }
+
+  host = g_slice_new0 (PoolHost);
+  host->key = key;
+  g_queue_init (&host->idle);
+  g_hash_table_insert (priv->hosts, host->key, host);
+
+  return host;
+}
+
+/* Called with mutex held */
+static void
+remove_host_if_unused (FlowTcpIOPool *tcp_io_pool, PoolHost *host)
+{
+  FlowTcpIOPoolPrivate *priv = tcp_io_pool->priv;
+
+  if (host->n_active == 0 && g_queue_is_empty (&host->idle))
+    g_hash_table_remove (priv->hosts, host->key);
+}
+
+/* A connection can be handed out again only if it's still up in both
+ * directions and the previous user left nothing unread. Leftover input
+ * means an exchange was cut short, and the next user would get someone
+ * else's reply. */
+static gboolean
+connection_is_reusable (FlowTcpIO *tcp_io)
+{
+  FlowIO           *io = FLOW_IO (tcp_io);
+  FlowTcpConnector *tcp_connector;
+  FlowPacketQueue  *input_queue;
+
+  /* Pick up any end-of-stream or error that arrived while it was idle */
+
+  flow_io_check_events (io);
+
+  if (flow_tcp_io_get_connectivity (tcp_io) != FLOW_CONNECTIVITY_CONNECTED ||
+      !io->read_stream_is_open || !io->write_stream_is_open)
+    return FALSE;
+
+  tcp_connector = flow_tcp_io_get_tcp_connector (tcp_io);
+  if (!tcp_connector ||
+      flow_connector_get_state (FLOW_CONNECTOR (tcp_connector)) != FLOW_CONNECTIVITY_CONNECTED)
+    return FALSE;
+
+  input_queue = flow_user_adapter_get_input_queue (flow_io_get_user_adapter (io));
+  if (flow_packet_queue_get_length_packets (input_queue) > 0)
+    return FALSE;
+
+  return TRUE;
+}
+
+/* Called with mutex held */
+static void
+prune_idle_connections (FlowTcpIOPool *tcp_io_pool, gint64 now)
+{
+  FlowTcpIOPoolPrivate *priv = tcp_io_pool->priv;
+  GHashTableIter        iter;
+  PoolHost             *host;
+
+  if (priv->idle_timeout == 0 || now - priv->last_prune_time < PRUNE_INTERVAL_USEC)
+    return;
+
+  priv->last_prune_time = now;
+
+  g_hash_table_iter_init (&iter, priv->hosts);
+
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &host))
+  {
+    IdleConnection *idle_connection;
+
+    /* Oldest connections are at the tail */
+
+    while ((idle_connection = g_queue_peek_tail (&host->idle)) &&
+           now - idle_connection->release_time >= (gint64) priv->idle_timeout * G_USEC_PER_SEC)
+    {
+      g_queue_pop_tail (&host->idle);
+      discard_connection (idle_connection->tcp_io);
+      g_slice_free (IdleConnection, idle_connection);
+    }
+
+    if (host->n_active == 0 && g_queue_is_empty (&host->idle))
+      g_hash_table_iter_remove (&iter);
+  }
+}
+
+/* Called with mutex held. Returns a healthy idle connection, discarding any
+ * stale ones it finds on the way. */
+static FlowTcpIO *
+take_idle_connection (FlowTcpIOPool *tcp_io_pool, PoolHost *host)
+{
+  IdleConnection *idle_connection;
+  FlowTcpIO      *tcp_io = NULL;
+
+  while (!tcp_io && (idle_connection = g_queue_pop_head (&host->idle)))
+  {
+    tcp_io = idle_connection->tcp_io;
+    g_slice_free (IdleConnection, idle_connection);
+
+    if (!connection_is_reusable (tcp_io))
+    {
+      discard_connection (tcp_io);
+      tcp_io = NULL;
+    }
+  }
+
+  return tcp_io;
+}
+
+/* Invoked if a user drops a connection without releasing it to the pool */
+static void
+active_connection_finalized (FlowTcpIOPool *tcp_io_pool, FlowTcpIO *tcp_io)
+{
+  FlowTcpIOPoolPrivate *priv = tcp_io_pool->priv;
+  PoolHost             *host;
+
+  g_mutex_lock (&priv->mutex);
+
+  host = g_hash_table_lookup (priv->active, tcp_io);
+  if (host)
+  {
+    g_hash_table_remove (priv->active, tcp_io);
+    host->n_active--;
+    remove_host_if_unused (tcp_io_pool, host);
+  }
+
+  g_mutex_unlock (&priv->mutex);
+}
+
+/* Called with mutex held */
+static void
+track_active_connection (FlowTcpIOPool *tcp_io_pool, PoolHost *host, FlowTcpIO *tcp_io)
+{
+  FlowTcpIOPoolPrivate *priv = tcp_io_pool->priv;
+
+  g_hash_table_insert (priv->active, tcp_io, host);
+  g_object_weak_ref ((GObject *) tcp_io, (GWeakNotify) active_connection_finalized, tcp_io_pool);
+}
+
+/* Called with mutex held. Gives the caller an idle connection, or reserves
+ * a slot for a new one. Returns FALSE if the host is at its limit. */
+static gboolean
+check_out (FlowTcpIOPool *tcp_io_pool, FlowIPService *remote_service, PoolHost **host_out, FlowTcpIO **tcp_io_out)
+{
+  FlowTcpIOPoolPrivate *priv = tcp_io_pool->priv;
+  PoolHost             *host;
+  FlowTcpIO            *tcp_io;
+
+  prune_idle_connections (tcp_io_pool, g_get_monotonic_time ());
+
+  host = lookup_host (tcp_io_pool, remote_service, TRUE);
+  *host_out = host;
+
+  tcp_io = take_idle_connection (tcp_io_pool, host);
+  if (tcp_io)
+  {
+    host->n_active++;
+    track_active_connection (tcp_io_pool, host, tcp_io);
+    *tcp_io_out = tcp_io;
+    return TRUE;
+  }
+
+  *tcp_io_out = NULL;
+
+  if (priv->max_per_host != 0 && host->n_active >= priv->max_per_host)
+  {
+    remove_host_if_unused (tcp_io_pool, host);
+    return FALSE;
+  }
+
+  host->n_active++;
+  return TRUE;
+}
+
+static void
+flow_tcp_io_pool_type_init (GType type)
+{
+}
+
+static void
+flow_tcp_io_pool_class_init (FlowTcpIOPoolClass *klass)
+{
+  GType param_types [1];
+
+  param_types [0] = FLOW_TYPE_TCP_IO;
+
+  /* Lets the user set up each new connection (e.g. with TLS credentials)
+   * before it connects */
+
+  g_signal_newv ("new-connection",
+                 G_TYPE_FROM_CLASS (klass),
+                 G_SIGNAL_RUN_LAST | G_SIGNAL_NO_HOOKS,
+                 NULL,                                   /* Class closure */
+                 NULL, NULL,                             /* Accumulator, accu data */
+                 g_cclosure_marshal_VOID__OBJECT,        /* Marshaller */
+                 G_TYPE_NONE,                            /* Return type */
+                 1, param_types);                        /* Number of params, param types */
+}
+
+static void
+flow_tcp_io_pool_init (FlowTcpIOPool *tcp_io_pool)
+{
+  FlowTcpIOPoolPrivate *priv = tcp_io_pool->priv;
+
+  g_mutex_init (&priv->mutex);
+
+  priv->io_type           = FLOW_TYPE_TCP_IO;
+  priv->hosts             = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) pool_host_free);
+  priv->active            = g_hash_table_new (g_direct_hash, g_direct_equal);
+  priv->max_idle_per_host = MAX_IDLE_PER_HOST_DEFAULT;
+  priv->max_per_host      = MAX_PER_HOST_DEFAULT;
+  priv->idle_timeout      = IDLE_TIMEOUT_DEFAULT;
+}
+
+static void
+flow_tcp_io_pool_construct (FlowTcpIOPool *tcp_io_pool)
+{
+}
+
+static void
+flow_tcp_io_pool_dispose (FlowTcpIOPool *tcp_io_pool)
+{
+  FlowTcpIOPoolPrivate *priv = tcp_io_pool->priv;
+  GHashTableIter        iter;
+  FlowTcpIO            *tcp_io;
+
+  /* Connections still checked out belong to their users now */
+
+  g_hash_table_iter_init (&iter, priv->active);
+
+  while (g_hash_table_iter_next (&iter, (gpointer *) &tcp_io, NULL))
+    g_object_weak_unref ((GObject *) tcp_io, (GWeakNotify) active_connection_finalized, tcp_io_pool);
+
+  g_hash_table_remove_all (priv->active);
+  g_hash_table_remove_all (priv->hosts);
+}
+
+static void
+flow_tcp_io_pool_finalize (FlowTcpIOPool *tcp_io_pool)
+{
+  FlowTcpIOPoolPrivate *priv = tcp_io_pool->priv;
+
+  g_hash_table_destroy (priv->active);
+  g_hash_table_destroy (priv->hosts);
+  g_mutex_clear (&priv->mutex);
+}
+
+/* --- FlowTcpIOPool public API --- */
+
+/**
+ * flow_tcp_io_pool_new:
+ *
+ * Creates a new #FlowTcpIOPool for plain #FlowTcpIO connections.
+ *
+ * Return value: A new #FlowTcpIOPool.
+ **/
+FlowTcpIOPool *
+flow_tcp_io_pool_new (void)
+{
+  return g_object_new (FLOW_TYPE_TCP_IO_POOL, NULL);
+}
+
+/**
+ * flow_tcp_io_pool_new_for_type:
+ * @io_type: A type derived from #FlowTcpIO, e.g. #FLOW_TYPE_TLS_TCP_IO.
+ *
+ * Creates a new #FlowTcpIOPool whose connections are instances of
+ * @io_type. Connect to the #FlowTcpIOPool::new-connection signal to
+ * configure each one before it connects.
+ *
+ * Return value: A new #FlowTcpIOPool.
+ **/
+FlowTcpIOPool *
+flow_tcp_io_pool_new_for_type (GType io_type)
+{
+  FlowTcpIOPool *tcp_io_pool;
+
+  g_return_val_if_fail (g_type_is_a (io_type, FLOW_TYPE_TCP_IO), NULL);
+
+  tcp_io_pool = g_object_new (FLOW_TYPE_TCP_IO_POOL, NULL);
+  tcp_io_pool->priv->io_type = io_type;
+
+  return tcp_io_pool;
+}
+
+/**
+ * flow_tcp_io_pool_get:
+ * @tcp_io_pool:    A #FlowTcpIOPool.
+ * @remote_service: The #FlowIPService to connect to.
+ *
+ * Checks out a connection to @remote_service. An idle connection is
+ * reused if a healthy one is available. Otherwise, a new one is created
+ * and starts connecting asynchronously; it can be written to right away.
+ *
+ * The caller owns the returned reference. Hand it back with
+ * flow_tcp_io_pool_release() when the exchange is complete, so it can
+ * be reused. Unreferencing it instead closes the connection.
+ *
+ * Return value: A #FlowTcpIO, or %NULL if @remote_service already has
+ * #FlowTcpIOPool:max-per-host connections checked out.
+ **/
+FlowTcpIO *
+flow_tcp_io_pool_get (FlowTcpIOPool *tcp_io_pool, FlowIPService *remote_service)
+{
+  FlowTcpIOPoolPrivate *priv;
+  PoolHost             *host;
+  FlowTcpIO            *tcp_io;
+
+  g_return_val_if_fail (FLOW_IS_TCP_IO_POOL (tcp_io_pool), NULL);
+  g_return_val_if_fail (FLOW_IS_IP_SERVICE (remote_service), NULL);
+
+  priv = tcp_io_pool->priv;
+
+  g_mutex_lock (&priv->mutex);
+
+  if (!check_out (tcp_io_pool, remote_service, &host, &tcp_io))
+  {
+    g_mutex_unlock (&priv->mutex);
+    return NULL;
+  }
+
+  g_mutex_unlock (&priv->mutex);
+
+  if (tcp_io)
+    return tcp_io;
+
+  tcp_io = g_object_new (priv->io_type, NULL);
+  g_signal_emit_by_name (tcp_io_pool, "new-connection", tcp_io);
+  flow_tcp_io_connect (tcp_io, remote_service);
+
+  g_mutex_lock (&priv->mutex);
+  track_active_connection (tcp_io_pool, host, tcp_io);
+  g_mutex_unlock (&priv->mutex);
+
+  return tcp_io;
+}
+
+/**
+ * flow_tcp_io_pool_sync_get:
+ * @tcp_io_pool:    A #FlowTcpIOPool.
+ * @remote_service: The #FlowIPService to connect to.
+ * @error:          Location to store a #GError, or %NULL.
+ *
+ * Like flow_tcp_io_pool_get(), but if a new connection is needed, blocks
+ * until it's established.
+ *
+ * Return value: A connected #FlowTcpIO, or %NULL on failure.
+ **/
+FlowTcpIO *
+flow_tcp_io_pool_sync_get (FlowTcpIOPool *tcp_io_pool, FlowIPService *remote_service, GError **error)
+{
+  FlowTcpIOPoolPrivate *priv;
+  PoolHost             *host;
+  FlowTcpIO            *tcp_io;
+
+  g_return_val_if_fail (FLOW_IS_TCP_IO_POOL (tcp_io_pool), NULL);
+  g_return_val_if_fail (FLOW_IS_IP_SERVICE (remote_service), NULL);
+
+  priv = tcp_io_pool->priv;
+
+  g_mutex_lock (&priv->mutex);
+
+  if (!check_out (tcp_io_pool, remote_service, &host, &tcp_io))
+  {
+    gchar *key = generate_key (remote_service);
+
+    g_mutex_unlock (&priv->mutex);
+
+    g_set_error (error, FLOW_STREAM_DOMAIN_QUARK, FLOW_STREAM_RESOURCE_ERROR,
+                 "Too many connections to %s", key);
+    g_free (key);
+    return NULL;
+  }
+
+  g_mutex_unlock (&priv->mutex);
+
+  if (tcp_io)
+    return tcp_io;
+
+  tcp_io = g_object_new (priv->io_type, NULL);
+  g_signal_emit_by_name (tcp_io_pool, "new-connection", tcp_io);
+
+  if (!flow_tcp_io_sync_connect (tcp_io, remote_service, error))
+  {
+    g_object_unref (tcp_io);
+
+    g_mutex_lock (&priv->mutex);
+    host->n_active--;
+    remove_host_if_unused (tcp_io_pool, host);
+    g_mutex_unlock (&priv->mutex);
+
+    return NULL;
+  }
+
+  g_mutex_lock (&priv->mutex);
+  track_active_connection (tcp_io_pool, host, tcp_io);
+  g_mutex_unlock (&priv->mutex);
+
+  return tcp_io;
+}
+
+/**
+ * flow_tcp_io_pool_release:
+ * @tcp_io_pool: A #FlowTcpIOPool.
+ * @tcp_io:      A #FlowTcpIO obtained from @tcp_io_pool.
+ *
+ * Returns a connection to the pool, taking over the caller's reference.
+ * It's kept for reuse if it's still healthy and its host has fewer than
+ * #FlowTcpIOPool:max-idle-per-host idle connections. Otherwise, it's
+ * disconnected.
+ *
+ * Only release a connection when the last exchange on it is complete.
+ **/
+void
+flow_tcp_io_pool_release (FlowTcpIOPool *tcp_io_pool, FlowTcpIO *tcp_io)
+{
+  FlowTcpIOPoolPrivate *priv;
+  PoolHost             *host;
+  gint64                now;
+
+  g_return_if_fail (FLOW_IS_TCP_IO_POOL (tcp_io_pool));
+  g_return_if_fail (FLOW_IS_TCP_IO (tcp_io));
+
+  priv = tcp_io_pool->priv;
+
+  /* The previous user's callbacks must not fire while it's idle */
+
+  flow_io_set_read_notify (FLOW_IO (tcp_io), NULL, NULL);
+  flow_io_set_write_notify (FLOW_IO (tcp_io), NULL, NULL);
+
+  now = g_get_monotonic_time ();
+
+  g_mutex_lock (&priv->mutex);
+
+  host = g_hash_table_lookup (priv->active, tcp_io);
+  if (!host)
+  {
+    g_mutex_unlock (&priv->mutex);
+    g_warning ("Released a FlowTcpIO that was not checked out from this pool.");
+    g_object_unref (tcp_io);
+    return;
+  }
+
+  g_object_weak_unref ((GObject *) tcp_io, (GWeakNotify) active_connection_finalized, tcp_io_pool);
+  g_hash_table_remove (priv->active, tcp_io);
+  host->n_active--;
+
+  if (host->idle.length < priv->max_idle_per_host && connection_is_reusable (tcp_io))
+  {
+    IdleConnection *idle_connection = g_slice_new (IdleConnection);
+
+    idle_connection->tcp_io       = tcp_io;
+    idle_connection->release_time = now;
+    g_queue_push_head (&host->idle, idle_connection);
+  }
+  else
+  {
+    discard_connection (tcp_io);
+    remove_host_if_unused (tcp_io_pool, host);
+  }
+
+  prune_idle_connections (tcp_io_pool, now);
+
+  g_mutex_unlock (&priv->mutex);
+}
+
+/**
+ * flow_tcp_io_pool_get_n_idle:
+ * @tcp_io_pool:    A #FlowTcpIOPool.
+ * @remote_service: A #FlowIPService.
+ *
+ * Gets the number of idle connections kept for @remote_service.
+ *
+ * Return value: The number of idle connections.
+ **/
+guint
+flow_tcp_io_pool_get_n_idle (FlowTcpIOPool *tcp_io_pool, FlowIPService *remote_service)
+{
+  FlowTcpIOPoolPrivate *priv;
+  PoolHost             *host;
+  guint                 n_idle = 0;
+
+  g_return_val_if_fail (FLOW_IS_TCP_IO_POOL (tcp_io_pool), 0);
+  g_return_val_if_fail (FLOW_IS_IP_SERVICE (remote_service), 0);
+
+  priv = tcp_io_pool->priv;
+
+  g_mutex_lock (&priv->mutex);
+
+  host = lookup_host (tcp_io_pool, remote_service, FALSE);
+  if (host)
+    n_idle = host->idle.length;
+
+  g_mutex_unlock (&priv->mutex);
+  return n_idle;
+}
+
+/**
+ * flow_tcp_io_pool_clear:
+ * @tcp_io_pool: A #FlowTcpIOPool.
+ *
+ * Disconnects all idle connections. Connections that are checked out
+ * are not affected.
+ *
+ * Idle connections are otherwise expired after
+ * #FlowTcpIOPool:idle-timeout seconds, checked whenever the pool is used.
+ **/
+void
+flow_tcp_io_pool_clear (FlowTcpIOPool *tcp_io_pool)
+{
+  FlowTcpIOPoolPrivate *priv;
+  GHashTableIter        iter;
+  PoolHost             *host;
+
+  g_return_if_fail (FLOW_IS_TCP_IO_POOL (tcp_io_pool));
+
+  priv = tcp_io_pool->priv;
+
+  g_mutex_lock (&priv->mutex);
+
+  g_hash_table_iter_init (&iter, priv->hosts);
+
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &host))
+  {
+    IdleConnection *idle_connection;
+
+    while ((idle_connection = g_queue_pop_head (&host->idle)))
+    {
+      discard_connection (idle_connection->tcp_io);
+      g_slice_free (IdleConnection, idle_connection);
+    }
+
+    if (host->n_active == 0)
+      g_hash_table_iter_remove (&iter);
+  }
+
+  g_mutex_unlock (&priv->mutex);
+}
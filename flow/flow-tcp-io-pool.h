@@ -0,0 +1,80 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* flow-tcp-io-pool.h - A pool of reusable TCP connections.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+#ifndef _FLOW_TCP_IO_POOL_H
+#define _FLOW_TCP_IO_POOL_H
+
+#include <flow/flow-tcp-io.h>
+#include <flow/flow-ip-service.h>
+
+G_BEGIN_DECLS
+
+#define FLOW_TYPE_TCP_IO_POOL            (flow_tcp_io_pool_get_type ())
+#define FLOW_TCP_IO_POOL(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), FLOW_TYPE_TCP_IO_POOL, FlowTcpIOPool))
+#define FLOW_TCP_IO_POOL_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), FLOW_TYPE_TCP_IO_POOL, FlowTcpIOPoolClass))
+#define FLOW_IS_TCP_IO_POOL(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), FLOW_TYPE_TCP_IO_POOL))
+#define FLOW_IS_TCP_IO_POOL_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), FLOW_TYPE_TCP_IO_POOL))
+#define FLOW_TCP_IO_POOL_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), FLOW_TYPE_TCP_IO_POOL, FlowTcpIOPoolClass))
+GType   flow_tcp_io_pool_get_type        (void) G_GNUC_CONST;
+
+typedef struct _FlowTcpIOPool        FlowTcpIOPool;
+typedef struct _FlowTcpIOPoolPrivate FlowTcpIOPoolPrivate;
+typedef struct _FlowTcpIOPoolClass   FlowTcpIOPoolClass;
+
+struct _FlowTcpIOPool
+{
+  GObject               object;
+
+  /*< private >*/
+
+  FlowTcpIOPoolPrivate *priv;
+};
+
+struct _FlowTcpIOPoolClass
+{
+  GObjectClass parent_class;
+
+  /*< private >*/
+
+  /* Padding for future expansion */
+  void (*_pad_1) (void);
+  void (*_pad_2) (void);
+  void (*_pad_3) (void);
+  void (*_pad_4) (void);
+};
+
+FlowTcpIOPool *flow_tcp_io_pool_new          (void);
+FlowTcpIOPool *flow_tcp_io_pool_new_for_type (GType io_type);
+
+FlowTcpIO     *flow_tcp_io_pool_get          (FlowTcpIOPool *tcp_io_pool, FlowIPService *remote_service);
+FlowTcpIO     *flow_tcp_io_pool_sync_get     (FlowTcpIOPool *tcp_io_pool, FlowIPService *remote_service,
+                                              GError **error);
+void           flow_tcp_io_pool_release      (FlowTcpIOPool *tcp_io_pool, FlowTcpIO *tcp_io);
+
+guint          flow_tcp_io_pool_get_n_idle   (FlowTcpIOPool *tcp_io_pool, FlowIPService *remote_service);
+void           flow_tcp_io_pool_clear        (FlowTcpIOPool *tcp_io_pool);
+
+G_END_DECLS
+
+#endif /* _FLOW_TCP_IO_POOL_H */
@@ -36,6 +36,15 @@ void _flow_tcp_connector_install_connected_shunt (FlowTcpConnector *tcp_connecto
 
 static void shunt_read (FlowShunt *shunt, FlowPacket *packet, FlowTcpListener *tcp_listener);
 
+/* An accepted shunt on its way to the accept context */
+
+typedef struct
+{
+  FlowTcpConnector *tcp_connector;
+  FlowShunt        *shunt;
+}
+ShuntHandover;
+
 /* --- FlowTcpListener private data --- */
 
 struct _FlowTcpListenerPrivate
@@ -47,11 +56,82 @@ struct _FlowTcpListenerPrivate
 
   guint            waiting_for_pop;
   GMainLoop       *pop_loop;
+
+  gboolean         reuse_port;
+  gboolean         fast_open;
+  gboolean         defer_accept;
+  GMainContext    *accept_context;
 };
 
 /* --- FlowTcpListener properties --- */
 
+static gboolean
+flow_tcp_listener_get_reuse_port_internal (FlowTcpListener *tcp_listener)
+{
+  FlowTcpListenerPrivate *priv = tcp_listener->priv;
+
+  return priv->reuse_port;
+}
+
+static void
+flow_tcp_listener_set_reuse_port_internal (FlowTcpListener *tcp_listener, gboolean reuse_port)
+{
+  FlowTcpListenerPrivate *priv = tcp_listener->priv;
+
+  priv->reuse_port = reuse_port;
+}
+
+static gboolean
+flow_tcp_listener_get_fast_open_internal (FlowTcpListener *tcp_listener)
+{
+  FlowTcpListenerPrivate *priv = tcp_listener->priv;
+
+  return priv->fast_open;
+}
+
+static void
+flow_tcp_listener_set_fast_open_internal (FlowTcpListener *tcp_listener, gboolean fast_open)
+{
+  FlowTcpListenerPrivate *priv = tcp_listener->priv;
+
+  priv->fast_open = fast_open;
+}
+
+static gboolean
+flow_tcp_listener_get_defer_accept_internal (FlowTcpListener *tcp_listener)
+{
+  FlowTcpListenerPrivate *priv = tcp_listener->priv;
+
+  return priv->defer_accept;
+}
+
+static void
+flow_tcp_listener_set_defer_accept_internal (FlowTcpListener *tcp_listener, gboolean defer_accept)
+{
+  FlowTcpListenerPrivate *priv = tcp_listener->priv;
+
+  priv->defer_accept = defer_accept;
+}
+
 FLOW_GOBJECT_PROPERTIES_BEGIN (flow_tcp_listener)
+FLOW_GOBJECT_PROPERTY_BOOLEAN ("reuse-port", "Reuse port",
+                               "Whether other listeners may share the local service (SO_REUSEPORT)",
+                               G_PARAM_READWRITE,
+                               flow_tcp_listener_get_reuse_port_internal,
+                               flow_tcp_listener_set_reuse_port_internal,
+                               FALSE)
+FLOW_GOBJECT_PROPERTY_BOOLEAN ("fast-open", "Fast open",
+                               "Whether clients may send data in the SYN (TCP Fast Open)",
+                               G_PARAM_READWRITE,
+                               flow_tcp_listener_get_fast_open_internal,
+                               flow_tcp_listener_set_fast_open_internal,
+                               FALSE)
+FLOW_GOBJECT_PROPERTY_BOOLEAN ("defer-accept", "Defer accept",
+                               "Whether to accept connections only once the client has sent data",
+                               G_PARAM_READWRITE,
+                               flow_tcp_listener_get_defer_accept_internal,
+                               flow_tcp_listener_set_defer_accept_internal,
+                               FALSE)
 FLOW_GOBJECT_PROPERTIES_END   ()
 
 /* --- FlowTcpListener definition --- */
@@ -145,6 +225,12 @@ flow_tcp_listener_dispose (FlowTcpListener *tcp_listener)
     flow_shunt_destroy (priv->shunt);
     priv->shunt = NULL;
   }
+
+  if (priv->accept_context)
+  {
+    g_main_context_unref (priv->accept_context);
+    priv->accept_context = NULL;
+  }
 }
 
 static void
@@ -165,6 +251,63 @@ flow_tcp_listener_finalize (FlowTcpListener *tcp_listener)
   priv->connected_shunts = NULL;
 }
 
+/* For use in friend classes (e.g. FlowTcpIOListener) only. Pops an accepted
+ * shunt without wrapping it in a FlowTcpConnector, so the caller can install
+ * it in one it already has. */
+FlowShunt *
+_flow_tcp_listener_pop_connected_shunt (FlowTcpListener *tcp_listener)
+{
+  FlowTcpListenerPrivate *priv = tcp_listener->priv;
+
+  return g_queue_pop_head (priv->connected_shunts);
+}
+
+static gboolean
+install_handed_over_shunt (ShuntHandover *handover)
+{
+  _flow_tcp_connector_install_connected_shunt (handover->tcp_connector, handover->shunt);
+  handover->shunt = NULL;
+  return FALSE;
+}
+
+static void
+shunt_handover_free (ShuntHandover *handover)
+{
+  /* The context went away before we could install it */
+  if (handover->shunt)
+    flow_shunt_destroy (handover->shunt);
+
+  g_object_unref (handover->tcp_connector);
+  g_slice_free (ShuntHandover, handover);
+}
+
+/* For use in friend classes (e.g. FlowTcpIOListener) only. Installs an
+ * accepted shunt in tcp_connector. With an accept context, the shunt is
+ * already dispatching there, so it can't be touched from our thread; it's
+ * installed from that context instead, ahead of anything queued there
+ * later. Until then, the connector stays disconnected. */
+void
+_flow_tcp_listener_install_connected_shunt (FlowTcpListener *tcp_listener, FlowTcpConnector *tcp_connector,
+                                            FlowShunt *connected_shunt)
+{
+  FlowTcpListenerPrivate *priv = tcp_listener->priv;
+  ShuntHandover          *handover;
+
+  if (!priv->accept_context)
+  {
+    _flow_tcp_connector_install_connected_shunt (tcp_connector, connected_shunt);
+    return;
+  }
+
+  handover = g_slice_new (ShuntHandover);
+  handover->tcp_connector = g_object_ref (tcp_connector);
+  handover->shunt         = connected_shunt;
+
+  flow_idle_add_full (priv->accept_context, G_PRIORITY_HIGH,
+                      (GSourceFunc) install_handed_over_shunt, handover,
+                      (GDestroyNotify) shunt_handover_free);
+}
+
 static FlowTcpConnector *
 pop_connection (FlowTcpListener *tcp_listener)
 {
@@ -177,7 +320,7 @@ pop_connection (FlowTcpListener *tcp_listener)
     return NULL;
 
   tcp_connector = flow_tcp_connector_new ();
-  _flow_tcp_connector_install_connected_shunt (tcp_connector, connected_shunt);
+  _flow_tcp_listener_install_connected_shunt (tcp_listener, tcp_connector, connected_shunt);
 
   return tcp_connector;
 }
@@ -238,7 +381,15 @@ flow_tcp_listener_set_local_service (FlowTcpListener *tcp_listener, FlowIPServic
       flow_ip_service_sync_resolve (ip_service, NULL);
     }
 
-    priv->shunt = flow_open_tcp_listener (ip_service);
+    /* With "reuse-port" set, one listener can be created per thread on the
+     * same service. Each listener's shunt is dispatched in the main context
+     * of the thread that set the service, so accepting scales with the
+     * number of threads. */
+
+    priv->shunt = flow_open_tcp_listener_full (ip_service,
+                                               (priv->reuse_port   ? FLOW_TCP_LISTENER_REUSE_PORT   : 0) |
+                                               (priv->fast_open    ? FLOW_TCP_LISTENER_FAST_OPEN    : 0) |
+                                               (priv->defer_accept ? FLOW_TCP_LISTENER_DEFER_ACCEPT : 0));
 
     while ((object = flow_read_object_from_shunt (priv->shunt)))
     {
@@ -254,6 +405,10 @@ flow_tcp_listener_set_local_service (FlowTcpListener *tcp_listener, FlowIPServic
     if (flow_detailed_event_matches (object, FLOW_STREAM_DOMAIN, FLOW_STREAM_BEGIN))
     {
       priv->local_ip_service = g_object_ref (ip_service);
+
+      if (priv->accept_context)
+        flow_shunt_set_accept_context (priv->shunt, priv->accept_context);
+
       flow_shunt_set_read_func (priv->shunt, (FlowShuntReadFunc *) shunt_read, tcp_listener);
       g_object_unref (object);
     }
@@ -273,6 +428,58 @@ flow_tcp_listener_set_local_service (FlowTcpListener *tcp_listener, FlowIPServic
   return result;
 }
 
+/**
+ * flow_tcp_listener_get_accept_context:
+ * @tcp_listener: A #FlowTcpListener.
+ *
+ * Gets the main context that accepted connections are dispatched in.
+ *
+ * Return value: A #GMainContext, or %NULL if connections are dispatched in
+ * the listener's own context.
+ **/
+GMainContext *
+flow_tcp_listener_get_accept_context (FlowTcpListener *tcp_listener)
+{
+  g_return_val_if_fail (FLOW_IS_TCP_LISTENER (tcp_listener), NULL);
+
+  return tcp_listener->priv->accept_context;
+}
+
+/**
+ * flow_tcp_listener_set_accept_context:
+ * @tcp_listener: A #FlowTcpListener.
+ * @main_context: A #GMainContext, or %NULL.
+ *
+ * Makes connections accepted from now on do their I/O in @main_context,
+ * typically one run by a worker thread, instead of the listener's context.
+ * This keeps bursts of new connections from holding up established ones.
+ *
+ * Connections are still popped in the listener's thread, but they are
+ * set up in @main_context, so they only start connecting once it has
+ * run. Hand each one over to the thread running @main_context right away,
+ * and use it only from there.
+ **/
+void
+flow_tcp_listener_set_accept_context (FlowTcpListener *tcp_listener, GMainContext *main_context)
+{
+  FlowTcpListenerPrivate *priv;
+
+  g_return_if_fail (FLOW_IS_TCP_LISTENER (tcp_listener));
+
+  priv = tcp_listener->priv;
+
+  if (main_context)
+    g_main_context_ref (main_context);
+
+  if (priv->accept_context)
+    g_main_context_unref (priv->accept_context);
+
+  priv->accept_context = main_context;
+
+  if (priv->shunt)
+    flow_shunt_set_accept_context (priv->shunt, main_context);
+}
+
 FlowTcpConnector *
 flow_tcp_listener_pop_connection (FlowTcpListener *tcp_listener)
 {
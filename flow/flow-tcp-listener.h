@@ -73,6 +73,9 @@ FlowIPService    *flow_tcp_listener_get_local_service   (FlowTcpListener *tcp_li
 gboolean          flow_tcp_listener_set_local_service   (FlowTcpListener *tcp_listener, FlowIPService *ip_service,
                                                          FlowDetailedEvent **error_event);
 
+GMainContext     *flow_tcp_listener_get_accept_context  (FlowTcpListener *tcp_listener);
+void              flow_tcp_listener_set_accept_context  (FlowTcpListener *tcp_listener, GMainContext *main_context);
+
 FlowTcpConnector *flow_tcp_listener_pop_connection      (FlowTcpListener *tcp_listener);
 FlowTcpConnector *flow_tcp_listener_sync_pop_connection (FlowTcpListener *tcp_listener);
 
@@ -0,0 +1,495 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* flow-tls-credentials.c - Shared TLS credentials.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+
+#include "config.h"
+#include "flow-util.h"
+#include "flow-gobject-util.h"
+#include "flow-event-codes.h"
+#include "flow-tls-credentials.h"
+
+#include <gnutls/gnutls.h>
+#include <gnutls/ocsp.h>
+
+#include <string.h>
+#include <time.h>
+
+#define OCSP_REFRESH_INTERVAL_DEFAULT 3600
+
+/* --- FlowTlsCredentials private data --- */
+
+struct _FlowTlsCredentialsPrivate
+{
+  gnutls_certificate_credentials_t creds;
+
+  /* OCSP response cache. The refresh thread re-reads the response file
+   * periodically, and handshakes staple whatever is current. */
+
+  GMutex                           ocsp_mutex;
+  GCond                            ocsp_cond;
+  GThread                         *ocsp_thread;
+  gchar                           *ocsp_path;
+  guint                            ocsp_refresh_interval;
+  GBytes                          *ocsp_response;
+
+  guint                            ocsp_thread_stop   : 1;
+  guint                            ocsp_path_changed  : 1;
+};
+
+/* --- FlowTlsCredentials properties --- */
+
+FLOW_GOBJECT_PROPERTIES_BEGIN (flow_tls_credentials)
+FLOW_GOBJECT_PROPERTIES_END   ()
+
+/* --- FlowTlsCredentials definition --- */
+
+FLOW_GOBJECT_MAKE_IMPL        (flow_tls_credentials, FlowTlsCredentials, G_TYPE_OBJECT, 0)
+
+/* --- FlowTlsCredentials implementation --- */
+
+static void
+set_gnutls_error (GError **error, const gchar *what, gint result)
+{
+  g_set_error (error, FLOW_TLS_DOMAIN_QUARK, FLOW_TLS_BAD_CREDENTIALS,
+               "%s: %s", what, gnutls_strerror (result));
+}
+
+/* Returns TRUE if the response is well-formed, says the certificate is good,
+ * and hasn't passed its next update time. Stapling anything else would just
+ * make clients reject the handshake. */
+static gboolean
+ocsp_response_is_current (GBytes *response)
+{
+  gnutls_ocsp_resp_t ocsp_resp;
+  gnutls_datum_t     data;
+  guint              cert_status;
+  time_t             next_update;
+  gboolean           is_current = FALSE;
+
+  if (!response)
+    return FALSE;
+
+  if (gnutls_ocsp_resp_init (&ocsp_resp) != GNUTLS_E_SUCCESS)
+    return FALSE;
+
+  data.data = (guchar *) g_bytes_get_data (response, NULL);
+  data.size = g_bytes_get_size (response);
+
+  if (gnutls_ocsp_resp_import (ocsp_resp, &data) == GNUTLS_E_SUCCESS &&
+      gnutls_ocsp_resp_get_single (ocsp_resp, 0, NULL, NULL, NULL, NULL,
+                                   &cert_status, NULL, &next_update, NULL, NULL) == GNUTLS_E_SUCCESS)
+  {
+    is_current = (cert_status == GNUTLS_OCSP_CERT_GOOD &&
+                  (next_update == (time_t) -1 || next_update > time (NULL)));
+  }
+
+  gnutls_ocsp_resp_deinit (ocsp_resp);
+  return is_current;
+}
+
+static void
+load_ocsp_response (FlowTlsCredentials *tls_credentials, const gchar *path)
+{
+  FlowTlsCredentialsPrivate *priv = tls_credentials->priv;
+  GBytes                    *response = NULL;
+  GBytes                    *old_response;
+  gchar                     *contents;
+  gsize                      len;
+
+  /* Parse outside the lock; handshakes only need it for a quick ref */
+
+  if (path && g_file_get_contents (path, &contents, &len, NULL))
+  {
+    response = g_bytes_new_take (contents, len);
+
+    if (!ocsp_response_is_current (response))
+    {
+      g_bytes_unref (response);
+      response = NULL;
+    }
+  }
+
+  g_mutex_lock (&priv->ocsp_mutex);
+
+  old_response = priv->ocsp_response;
+
+  if (response || !ocsp_response_is_current (old_response))
+  {
+    /* Replace with the new response, or drop an old one that went stale */
+    priv->ocsp_response = response;
+  }
+  else
+  {
+    /* Keep serving the old response until it expires */
+    old_response = NULL;
+  }
+
+  g_mutex_unlock (&priv->ocsp_mutex);
+
+  if (old_response)
+    g_bytes_unref (old_response);
+}
+
+static gpointer
+ocsp_refresh_main (FlowTlsCredentials *tls_credentials)
+{
+  FlowTlsCredentialsPrivate *priv = tls_credentials->priv;
+
+  g_mutex_lock (&priv->ocsp_mutex);
+
+  while (!priv->ocsp_thread_stop)
+  {
+    gint64  end_time;
+    gchar  *path;
+
+    end_time = g_get_monotonic_time () + (gint64) priv->ocsp_refresh_interval * G_USEC_PER_SEC;
+
+    while (!priv->ocsp_thread_stop && !priv->ocsp_path_changed)
+    {
+      if (!g_cond_wait_until (&priv->ocsp_cond, &priv->ocsp_mutex, end_time))
+        break;
+    }
+
+    if (priv->ocsp_thread_stop)
+      break;
+
+    if (priv->ocsp_path_changed)
+    {
+      /* The new file was just loaded; start over with the new interval */
+      priv->ocsp_path_changed = FALSE;
+      continue;
+    }
+
+    path = g_strdup (priv->ocsp_path);
+
+    g_mutex_unlock (&priv->ocsp_mutex);
+    load_ocsp_response (tls_credentials, path);
+    g_free (path);
+    g_mutex_lock (&priv->ocsp_mutex);
+  }
+
+  g_mutex_unlock (&priv->ocsp_mutex);
+  return NULL;
+}
+
+static void
+stop_ocsp_thread (FlowTlsCredentials *tls_credentials)
+{
+  FlowTlsCredentialsPrivate *priv = tls_credentials->priv;
+  GThread                   *thread;
+
+  g_mutex_lock (&priv->ocsp_mutex);
+  thread = priv->ocsp_thread;
+  priv->ocsp_thread      = NULL;
+  priv->ocsp_thread_stop = TRUE;
+  g_cond_signal (&priv->ocsp_cond);
+  g_mutex_unlock (&priv->ocsp_mutex);
+
+  if (thread)
+    g_thread_join (thread);
+
+  priv->ocsp_thread_stop = FALSE;
+}
+
+/* Called by GnuTLS during server handshakes, possibly on several threads at once */
+static gint
+get_ocsp_response_for_gnutls (gnutls_session_t session, FlowTlsCredentials *tls_credentials,
+                              gnutls_datum_t *ocsp_response)
+{
+  FlowTlsCredentialsPrivate *priv = tls_credentials->priv;
+  GBytes                    *response;
+  gconstpointer              data;
+  gsize                      len;
+
+  g_mutex_lock (&priv->ocsp_mutex);
+  response = priv->ocsp_response ? g_bytes_ref (priv->ocsp_response) : NULL;
+  g_mutex_unlock (&priv->ocsp_mutex);
+
+  if (!response)
+    return GNUTLS_E_NO_CERTIFICATE_STATUS;
+
+  data = g_bytes_get_data (response, &len);
+
+  ocsp_response->data = gnutls_malloc (len);
+  ocsp_response->size = len;
+  memcpy (ocsp_response->data, data, len);
+
+  g_bytes_unref (response);
+  return GNUTLS_E_SUCCESS;
+}
+
+static void
+flow_tls_credentials_type_init (GType type)
+{
+}
+
+static void
+flow_tls_credentials_class_init (FlowTlsCredentialsClass *klass)
+{
+}
+
+static void
+flow_tls_credentials_init (FlowTlsCredentials *tls_credentials)
+{
+  FlowTlsCredentialsPrivate *priv = tls_credentials->priv;
+
+  gnutls_global_init ();
+  gnutls_certificate_allocate_credentials (&priv->creds);
+
+  g_mutex_init (&priv->ocsp_mutex);
+  g_cond_init (&priv->ocsp_cond);
+  priv->ocsp_refresh_interval = OCSP_REFRESH_INTERVAL_DEFAULT;
+}
+
+static void
+flow_tls_credentials_construct (FlowTlsCredentials *tls_credentials)
+{
+}
+
+static void
+flow_tls_credentials_dispose (FlowTlsCredentials *tls_credentials)
+{
+  stop_ocsp_thread (tls_credentials);
+}
+
+static void
+flow_tls_credentials_finalize (FlowTlsCredentials *tls_credentials)
+{
+  FlowTlsCredentialsPrivate *priv = tls_credentials->priv;
+
+  if (priv->ocsp_response)
+    g_bytes_unref (priv->ocsp_response);
+
+  g_free (priv->ocsp_path);
+  g_cond_clear (&priv->ocsp_cond);
+  g_mutex_clear (&priv->ocsp_mutex);
+
+  gnutls_certificate_free_credentials (priv->creds);
+  gnutls_global_deinit ();
+}
+
+/* --- FlowTlsCredentials public API --- */
+
+/**
+ * flow_tls_credentials_new:
+ *
+ * Creates a new, empty set of X.509 credentials. Load certificates and
+ * trust anchors into it, then hand it to any number of #FlowTlsProtocol
+ * elements or a #FlowTlsTcpIOListener. Credentials are parsed once, and
+ * sessions only take a reference to them.
+ *
+ * Credentials must be fully set up before the first session uses them.
+ *
+ * Return value: A new #FlowTlsCredentials.
+ **/
+FlowTlsCredentials *
+flow_tls_credentials_new (void)
+{
+  return g_object_new (FLOW_TYPE_TLS_CREDENTIALS, NULL);
+}
+
+/**
+ * flow_tls_credentials_add_key_pair:
+ * @tls_credentials: A #FlowTlsCredentials.
+ * @cert_path:       Path to a PEM file holding the certificate chain.
+ * @key_path:        Path to a PEM file holding the matching private key.
+ * @error:           Return location for a #GError, or %NULL.
+ *
+ * Adds a certificate and private key to present to peers. Servers need at
+ * least one. If several are added, GnuTLS picks the one matching the
+ * server name the client asks for.
+ *
+ * Return value: %TRUE on success, %FALSE if the files could not be loaded.
+ **/
+gboolean
+flow_tls_credentials_add_key_pair (FlowTlsCredentials *tls_credentials,
+                                   const gchar *cert_path, const gchar *key_path,
+                                   GError **error)
+{
+  FlowTlsCredentialsPrivate *priv;
+  gint                       result;
+
+  g_return_val_if_fail (FLOW_IS_TLS_CREDENTIALS (tls_credentials), FALSE);
+  g_return_val_if_fail (cert_path != NULL, FALSE);
+  g_return_val_if_fail (key_path != NULL, FALSE);
+
+  priv = tls_credentials->priv;
+
+  result = gnutls_certificate_set_x509_key_file (priv->creds, cert_path, key_path,
+                                                 GNUTLS_X509_FMT_PEM);
+  if (result < 0)
+  {
+    set_gnutls_error (error, cert_path, result);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/**
+ * flow_tls_credentials_add_trust_file:
+ * @tls_credentials: A #FlowTlsCredentials.
+ * @ca_path:         Path to a PEM file of CA certificates, or %NULL for the system's.
+ * @error:           Return location for a #GError, or %NULL.
+ *
+ * Adds certificate authorities to trust when verifying peers. Clients
+ * using these credentials verify the server's certificate and name
+ * against them.
+ *
+ * Return value: %TRUE on success, %FALSE if no certificates could be loaded.
+ **/
+gboolean
+flow_tls_credentials_add_trust_file (FlowTlsCredentials *tls_credentials,
+                                     const gchar *ca_path, GError **error)
+{
+  FlowTlsCredentialsPrivate *priv;
+  gint                       result;
+
+  g_return_val_if_fail (FLOW_IS_TLS_CREDENTIALS (tls_credentials), FALSE);
+
+  priv = tls_credentials->priv;
+
+  if (ca_path)
+    result = gnutls_certificate_set_x509_trust_file (priv->creds, ca_path, GNUTLS_X509_FMT_PEM);
+  else
+    result = gnutls_certificate_set_x509_system_trust (priv->creds);
+
+  if (result <= 0)
+  {
+    set_gnutls_error (error, ca_path ? ca_path : "System trust store",
+                      result < 0 ? result : GNUTLS_E_NO_CERTIFICATE_FOUND);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/**
+ * flow_tls_credentials_set_ocsp_response_file:
+ * @tls_credentials:  A #FlowTlsCredentials.
+ * @path:             Path to a DER-encoded OCSP response, or %NULL to disable stapling.
+ * @refresh_interval: Seconds between re-reads of the file, or 0 for the default of one hour.
+ *
+ * Staples an OCSP response for the server certificate to handshakes, so
+ * clients don't have to contact the CA themselves. The file is expected
+ * to be kept up to date by an external tool. It is read once immediately,
+ * and then re-read periodically on a background thread. Responses that are
+ * malformed, not "good" or past their next update time are never stapled.
+ **/
+void
+flow_tls_credentials_set_ocsp_response_file (FlowTlsCredentials *tls_credentials,
+                                             const gchar *path, guint refresh_interval)
+{
+  FlowTlsCredentialsPrivate *priv;
+
+  g_return_if_fail (FLOW_IS_TLS_CREDENTIALS (tls_credentials));
+
+  priv = tls_credentials->priv;
+
+  if (!path)
+  {
+    stop_ocsp_thread (tls_credentials);
+
+    g_mutex_lock (&priv->ocsp_mutex);
+    g_free (priv->ocsp_path);
+    priv->ocsp_path = NULL;
+    g_mutex_unlock (&priv->ocsp_mutex);
+
+    load_ocsp_response (tls_credentials, NULL);
+    gnutls_certificate_set_ocsp_status_request_function (priv->creds, NULL, NULL);
+    return;
+  }
+
+  /* Load the first response synchronously, so the very first handshakes
+   * can staple it */
+
+  load_ocsp_response (tls_credentials, path);
+
+  g_mutex_lock (&priv->ocsp_mutex);
+
+  g_free (priv->ocsp_path);
+  priv->ocsp_path             = g_strdup (path);
+  priv->ocsp_refresh_interval = refresh_interval > 0 ? refresh_interval : OCSP_REFRESH_INTERVAL_DEFAULT;
+
+  if (!priv->ocsp_thread)
+  {
+    priv->ocsp_thread = g_thread_new ("FlowTlsCredentials OCSP",
+                                      (GThreadFunc) ocsp_refresh_main, tls_credentials);
+  }
+  else
+  {
+    /* Wake the thread so it picks up the new interval */
+    priv->ocsp_path_changed = TRUE;
+    g_cond_signal (&priv->ocsp_cond);
+  }
+
+  g_mutex_unlock (&priv->ocsp_mutex);
+
+  gnutls_certificate_set_ocsp_status_request_function (priv->creds,
+                                                       (gnutls_status_request_ocsp_func) get_ocsp_response_for_gnutls,
+                                                       tls_credentials);
+}
+
+/**
+ * flow_tls_credentials_has_ocsp_response:
+ * @tls_credentials: A #FlowTlsCredentials.
+ *
+ * Checks whether a current OCSP response is cached and will be stapled
+ * to new handshakes.
+ *
+ * Return value: %TRUE if a response is available.
+ **/
+gboolean
+flow_tls_credentials_has_ocsp_response (FlowTlsCredentials *tls_credentials)
+{
+  FlowTlsCredentialsPrivate *priv;
+  gboolean                   has_response;
+
+  g_return_val_if_fail (FLOW_IS_TLS_CREDENTIALS (tls_credentials), FALSE);
+
+  priv = tls_credentials->priv;
+
+  g_mutex_lock (&priv->ocsp_mutex);
+  has_response = ocsp_response_is_current (priv->ocsp_response);
+  g_mutex_unlock (&priv->ocsp_mutex);
+
+  return has_response;
+}
+
+/**
+ * flow_tls_credentials_get_gnutls_credentials:
+ * @tls_credentials: A #FlowTlsCredentials.
+ *
+ * Gets the underlying GnuTLS credentials, for use with gnutls_credentials_set ().
+ * They remain owned by @tls_credentials.
+ *
+ * Return value: A gnutls_certificate_credentials_t.
+ **/
+gpointer
+flow_tls_credentials_get_gnutls_credentials (FlowTlsCredentials *tls_credentials)
+{
+  g_return_val_if_fail (FLOW_IS_TLS_CREDENTIALS (tls_credentials), NULL);
+
+  return tls_credentials->priv->creds;
+}
@@ -0,0 +1,84 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* flow-tls-credentials.h - Shared TLS credentials.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+
+#ifndef _FLOW_TLS_CREDENTIALS_H
+#define _FLOW_TLS_CREDENTIALS_H
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define FLOW_TYPE_TLS_CREDENTIALS            (flow_tls_credentials_get_type ())
+#define FLOW_TLS_CREDENTIALS(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), FLOW_TYPE_TLS_CREDENTIALS, FlowTlsCredentials))
+#define FLOW_TLS_CREDENTIALS_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), FLOW_TYPE_TLS_CREDENTIALS, FlowTlsCredentialsClass))
+#define FLOW_IS_TLS_CREDENTIALS(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), FLOW_TYPE_TLS_CREDENTIALS))
+#define FLOW_IS_TLS_CREDENTIALS_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), FLOW_TYPE_TLS_CREDENTIALS))
+#define FLOW_TLS_CREDENTIALS_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), FLOW_TYPE_TLS_CREDENTIALS, FlowTlsCredentialsClass))
+GType   flow_tls_credentials_get_type        (void) G_GNUC_CONST;
+
+typedef struct _FlowTlsCredentials        FlowTlsCredentials;
+typedef struct _FlowTlsCredentialsPrivate FlowTlsCredentialsPrivate;
+typedef struct _FlowTlsCredentialsClass   FlowTlsCredentialsClass;
+
+struct _FlowTlsCredentials
+{
+  GObject    parent;
+
+  /*< private >*/
+
+  FlowTlsCredentialsPrivate *priv;
+};
+
+struct _FlowTlsCredentialsClass
+{
+  GObjectClass parent_class;
+
+  /*< private >*/
+
+  /* Padding for future expansion */
+
+  void (*_pad_1) (void);
+  void (*_pad_2) (void);
+  void (*_pad_3) (void);
+  void (*_pad_4) (void);
+};
+
+G_END_DECLS
+
+FlowTlsCredentials *flow_tls_credentials_new                    (void);
+
+gboolean            flow_tls_credentials_add_key_pair           (FlowTlsCredentials *tls_credentials,
+                                                                 const gchar *cert_path, const gchar *key_path,
+                                                                 GError **error);
+gboolean            flow_tls_credentials_add_trust_file         (FlowTlsCredentials *tls_credentials,
+                                                                 const gchar *ca_path, GError **error);
+
+void                flow_tls_credentials_set_ocsp_response_file (FlowTlsCredentials *tls_credentials,
+                                                                 const gchar *path, guint refresh_interval);
+gboolean            flow_tls_credentials_has_ocsp_response      (FlowTlsCredentials *tls_credentials);
+
+gpointer            flow_tls_credentials_get_gnutls_credentials (FlowTlsCredentials *tls_credentials);
+
+#endif  /* _FLOW_TLS_CREDENTIALS_H */
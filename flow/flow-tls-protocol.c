@@ -26,11 +26,29 @@
 #include "flow-util.h"
 #include "flow-gobject-util.h"
 #include "flow-enum-types.h"
+#include "flow-context-mgmt.h"
+#include "flow-tcp-connect-op.h"
+#include "flow-sockopt-op.h"
+#include "flow-event-codes.h"
+#include "flow-tls-credentials.h"
 #include "flow-tls-protocol.h"
 
 #include <gnutls/gnutls.h>
 
 #include <errno.h>
+#include <string.h>
+
+#ifdef HAVE_KTLS
+# include <netinet/in.h>
+# include <netinet/tcp.h>
+# include <linux/tls.h>
+# ifndef SOL_TLS
+#  define SOL_TLS 282
+# endif
+# ifndef TCP_ULP
+#  define TCP_ULP 31
+# endif
+#endif
 
 #define UPSTREAM_INDEX   0
 #define DOWNSTREAM_INDEX 1
@@ -39,6 +57,23 @@
 #define MAX_PACKET_SIZE  8192
 #define DH_BITS_DEFAULT  1024
 
+#define SESSION_CACHE_SIZE_DEFAULT 1024
+
+/* Outbound record sizing. New and idle connections get records that fit
+ * in a single TCP segment, so the peer can decrypt the first bytes without
+ * waiting for a whole 16k record to arrive over a small congestion window.
+ * Once enough data has gone out, we switch to full-size records to cut
+ * per-record overhead. */
+
+#define RECORD_SIZE_MAX          16384
+#define RECORD_SIZE_SMALL        1300
+#define RECORD_RAMP_BYTES        (1024 * 1024)
+#define RECORD_IDLE_RESET_USEC   (1 * G_USEC_PER_SEC)
+
+/* Most plaintext we'll hand a worker thread in one go */
+
+#define CRYPTO_JOB_MAX_PLAINTEXT (64 * 1024)
+
 typedef enum
 {
   /* Both directions */
@@ -53,10 +88,96 @@ typedef enum
 }
 State;
 
+typedef enum
+{
+  KTLS_NONE,
+  KTLS_PENDING,  /* Keys sent downstream, waiting for the socket to accept them */
+  KTLS_TX        /* Kernel encrypts outbound records; we pass plaintext through */
+}
+KtlsState;
+
+typedef enum
+{
+  DH_PARAMS_NONE,
+  DH_PARAMS_GENERATING,
+  DH_PARAMS_READY
+}
+DhParamsState;
+
+typedef struct
+{
+  FlowTlsProtocol *tls_protocol;
+  GMainContext    *dispatch_context;
+}
+DhParamsWaiter;
+
+/* A unit of work for the crypto thread pool. While a job is in flight,
+ * the session belongs to the worker, and the element leaves its input
+ * queued. */
+
+typedef struct
+{
+  FlowTlsProtocol *tls_protocol;
+  GMainContext    *dispatch_context;
+
+  /* Filled in before the job is queued */
+
+  guint            do_handshake : 1;
+  guint            do_recv      : 1;
+  FlowPacketQueue *plaintext_in;
+
+  /* Filled in by the worker */
+
+  FlowPacketQueue *ciphertext_out;
+  FlowPacketQueue *plaintext_out;
+  gint             handshake_result;
+  gint             recv_result;
+}
+CryptoJob;
+
+/* Bounded LRU map from a key to serialized session data. Used on the
+ * server side keyed by session ID, and on the client side keyed by
+ * remote service. */
+
+typedef struct
+{
+  GMutex      mutex;
+  GHashTable *entries;  /* GBytes key -> GList link in lru */
+  GQueue      lru;      /* SessionCacheEntry, most recently used first */
+  guint       max_entries;
+  guint64     n_hits;
+  guint64     n_misses;
+}
+SessionCache;
+
+typedef struct
+{
+  GBytes *key;
+  GBytes *data;
+}
+SessionCacheEntry;
+
+static SessionCache       server_session_cache         = { .max_entries = SESSION_CACHE_SIZE_DEFAULT };
+static SessionCache       client_session_cache         = { .max_entries = SESSION_CACHE_SIZE_DEFAULT };
+static gnutls_datum_t     session_ticket_key;
+
+static GThreadPool       *crypto_pool;
+static guint              crypto_pool_max_threads;
+
+/* Anonymous credentials hold no per-session state, so all sessions share them.
+ * Server credentials are replaced, not modified, when DH parameters arrive;
+ * the old ones are kept for sessions that may still be using them. */
+
+static gnutls_anon_server_credentials_t anon_server_creds;
+static gnutls_anon_client_credentials_t anon_client_creds;
+static GSList                          *retired_anon_server_creds;
+
 static GMutex             gnutls_mutex;
 static gboolean           gnutls_is_initialized        = FALSE;
-static gboolean           gnutls_server_is_initialized = FALSE;
+static DhParamsState      gnutls_dh_parameters_state   = DH_PARAMS_NONE;
 static gnutls_dh_params_t gnutls_dh_parameters;
+static GSList            *gnutls_dh_parameters_waiters;
+static gchar             *gnutls_dh_parameters_path;
 
 /* --- FlowTlsProtocol private data --- */
 
@@ -67,14 +188,42 @@ struct _FlowTlsProtocolPrivate
 
   guint                            agent_role              : 2;
   guint                            session_initialized     : 1;
+  guint                            waiting_for_dh_params   : 1;
+  guint                            handshake_complete      : 1;
+  guint                            kernel_offload          : 1;
+  guint                            ktls_state              : 2;
+  guint                            threaded_crypto         : 1;
+  guint                            session_threaded        : 1;
 
   gnutls_session_t                 tls_session;
 
-  /* We assume that the gnutls_*_credentials_t types are just
-   * aliases for pointers. This makes it a lot less complicated
-   * for us. */
+  /* X.509 credentials, if set. Otherwise we use anonymous DH. The session
+   * holds on to the credentials it started with. */
+
+  FlowTlsCredentials              *credentials;
+  FlowTlsCredentials              *session_credentials;
+
+  /* Identifies the remote end for client session resumption */
+
+  GBytes                          *session_key;
+  gchar                           *remote_name;
+  guint                            remote_name_is_addr : 1;
+
+  /* Small writes from upstream are coalesced here before encryption */
 
-  gpointer                         creds;
+  guint8                          *record_buf;
+  guint                            record_len;
+  guint                            max_record_size;
+  guint                            record_delay;
+  guint                            record_timeout_id;
+  guint64                          record_bytes_sent;
+  gint64                           record_last_send_time;
+
+  /* With threaded crypto, GnuTLS reads from here instead of the input pad,
+   * so data can be handed to a worker without touching the pad */
+
+  FlowPacketQueue                 *ciphertext_in;
+  CryptoJob                       *crypto_job;
 };
 
 /* --- FlowTlsProtocol properties --- */
@@ -95,6 +244,70 @@ flow_tls_protocol_set_agent_role_internal (FlowTlsProtocol *tls_protocol, FlowAg
   priv->agent_role = agent_role;
 }
 
+static gboolean
+flow_tls_protocol_get_kernel_offload_internal (FlowTlsProtocol *tls_protocol)
+{
+  FlowTlsProtocolPrivate *priv = tls_protocol->priv;
+
+  return priv->kernel_offload;
+}
+
+static void
+flow_tls_protocol_set_kernel_offload_internal (FlowTlsProtocol *tls_protocol, gboolean kernel_offload)
+{
+  FlowTlsProtocolPrivate *priv = tls_protocol->priv;
+
+  priv->kernel_offload = kernel_offload ? TRUE : FALSE;
+}
+
+static guint
+flow_tls_protocol_get_max_record_size_internal (FlowTlsProtocol *tls_protocol)
+{
+  FlowTlsProtocolPrivate *priv = tls_protocol->priv;
+
+  return priv->max_record_size;
+}
+
+static void
+flow_tls_protocol_set_max_record_size_internal (FlowTlsProtocol *tls_protocol, guint max_record_size)
+{
+  FlowTlsProtocolPrivate *priv = tls_protocol->priv;
+
+  priv->max_record_size = CLAMP (max_record_size, 1, RECORD_SIZE_MAX);
+}
+
+static guint
+flow_tls_protocol_get_record_delay_internal (FlowTlsProtocol *tls_protocol)
+{
+  FlowTlsProtocolPrivate *priv = tls_protocol->priv;
+
+  return priv->record_delay;
+}
+
+static void
+flow_tls_protocol_set_record_delay_internal (FlowTlsProtocol *tls_protocol, guint record_delay)
+{
+  FlowTlsProtocolPrivate *priv = tls_protocol->priv;
+
+  priv->record_delay = record_delay;
+}
+
+static gboolean
+flow_tls_protocol_get_threaded_crypto_internal (FlowTlsProtocol *tls_protocol)
+{
+  FlowTlsProtocolPrivate *priv = tls_protocol->priv;
+
+  return priv->threaded_crypto;
+}
+
+static void
+flow_tls_protocol_set_threaded_crypto_internal (FlowTlsProtocol *tls_protocol, gboolean threaded_crypto)
+{
+  FlowTlsProtocolPrivate *priv = tls_protocol->priv;
+
+  priv->threaded_crypto = threaded_crypto ? TRUE : FALSE;
+}
+
 FLOW_GOBJECT_PROPERTIES_BEGIN (flow_tls_protocol)
 FLOW_GOBJECT_PROPERTY_ENUM    ("agent-role", "Agent role", "Agent role (server/client)",
                                G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY,
@@ -102,6 +315,30 @@ FLOW_GOBJECT_PROPERTY_ENUM    ("agent-role", "Agent role", "Agent role (server/c
                                flow_tls_protocol_set_agent_role_internal,
                                FLOW_AGENT_ROLE_CLIENT,
                                flow_agent_role_get_type)
+FLOW_GOBJECT_PROPERTY_BOOLEAN ("kernel-offload", "Kernel offload",
+                               "Whether to hand outbound encryption to the kernel after the handshake",
+                               G_PARAM_READWRITE,
+                               flow_tls_protocol_get_kernel_offload_internal,
+                               flow_tls_protocol_set_kernel_offload_internal,
+                               FALSE)
+FLOW_GOBJECT_PROPERTY_INT     (G_TYPE_UINT, "max-record-size", "Max record size",
+                               "Largest amount of plaintext to put in one TLS record",
+                               G_PARAM_READWRITE,
+                               flow_tls_protocol_get_max_record_size_internal,
+                               flow_tls_protocol_set_max_record_size_internal,
+                               1, RECORD_SIZE_MAX, RECORD_SIZE_MAX)
+FLOW_GOBJECT_PROPERTY_INT     (G_TYPE_UINT, "record-delay", "Record delay",
+                               "Milliseconds to hold a partial record waiting for more data",
+                               G_PARAM_READWRITE,
+                               flow_tls_protocol_get_record_delay_internal,
+                               flow_tls_protocol_set_record_delay_internal,
+                               0, 1000, 0)
+FLOW_GOBJECT_PROPERTY_BOOLEAN ("threaded-crypto", "Threaded crypto",
+                               "Whether to run handshakes and record crypto on worker threads",
+                               G_PARAM_READWRITE,
+                               flow_tls_protocol_get_threaded_crypto_internal,
+                               flow_tls_protocol_set_threaded_crypto_internal,
+                               FALSE)
 FLOW_GOBJECT_PROPERTIES_END   ()
 
 /* --- FlowTlsProtocol definition --- */
@@ -200,18 +437,278 @@ global_unref_gnutls (void)
   g_mutex_unlock (&gnutls_mutex);
 }
 
+/* Session cache */
+
+static void
+session_cache_entry_free (SessionCacheEntry *entry)
+{
+  g_bytes_unref (entry->key);
+  g_bytes_unref (entry->data);
+  g_slice_free (SessionCacheEntry, entry);
+}
+
+/* Called with the cache's mutex held */
+static void
+session_cache_remove_link (SessionCache *cache, GList *link)
+{
+  SessionCacheEntry *entry = link->data;
+
+  g_hash_table_remove (cache->entries, entry->key);
+  g_queue_delete_link (&cache->lru, link);
+  session_cache_entry_free (entry);
+}
+
+static void
+session_cache_store (SessionCache *cache, GBytes *key, gconstpointer data, gsize len)
+{
+  SessionCacheEntry *entry;
+  GList             *link;
+
+  g_mutex_lock (&cache->mutex);
+
+  if (!cache->entries)
+    cache->entries = g_hash_table_new (g_bytes_hash, g_bytes_equal);
+
+  link = g_hash_table_lookup (cache->entries, key);
+  if (link)
+    session_cache_remove_link (cache, link);
+
+  while (cache->lru.length > 0 && cache->lru.length >= cache->max_entries)
+    session_cache_remove_link (cache, cache->lru.tail);
+
+  if (cache->max_entries > 0)
+  {
+    entry = g_slice_new (SessionCacheEntry);
+    entry->key  = g_bytes_ref (key);
+    entry->data = g_bytes_new (data, len);
+
+    g_queue_push_head (&cache->lru, entry);
+    g_hash_table_insert (cache->entries, entry->key, cache->lru.head);
+  }
+
+  g_mutex_unlock (&cache->mutex);
+}
+
+/* Returns the data in memory allocated with gnutls_malloc (), as required
+ * by GnuTLS' retrieve callback */
+static gnutls_datum_t
+session_cache_lookup (SessionCache *cache, GBytes *key)
+{
+  gnutls_datum_t  datum = { NULL, 0 };
+  GList          *link  = NULL;
+
+  g_mutex_lock (&cache->mutex);
+
+  if (cache->entries)
+    link = g_hash_table_lookup (cache->entries, key);
+
+  if (link)
+  {
+    SessionCacheEntry *entry = link->data;
+    gconstpointer      data;
+    gsize              len;
+
+    /* Move to front */
+    g_queue_unlink (&cache->lru, link);
+    g_queue_push_head_link (&cache->lru, link);
+
+    data = g_bytes_get_data (entry->data, &len);
+    datum.data = gnutls_malloc (len);
+    datum.size = len;
+    memcpy (datum.data, data, len);
+  }
+
+  g_mutex_unlock (&cache->mutex);
+
+  return datum;
+}
+
+static void
+session_cache_remove (SessionCache *cache, GBytes *key)
+{
+  GList *link = NULL;
+
+  g_mutex_lock (&cache->mutex);
+
+  if (cache->entries)
+    link = g_hash_table_lookup (cache->entries, key);
+
+  if (link)
+    session_cache_remove_link (cache, link);
+
+  g_mutex_unlock (&cache->mutex);
+}
+
+static void
+session_cache_clear (SessionCache *cache)
+{
+  g_mutex_lock (&cache->mutex);
+
+  while (cache->lru.tail)
+    session_cache_remove_link (cache, cache->lru.tail);
+
+  g_mutex_unlock (&cache->mutex);
+}
+
+static void
+session_cache_set_max_entries (SessionCache *cache, guint max_entries)
+{
+  g_mutex_lock (&cache->mutex);
+
+  cache->max_entries = max_entries;
+
+  while (cache->lru.length > max_entries)
+    session_cache_remove_link (cache, cache->lru.tail);
+
+  g_mutex_unlock (&cache->mutex);
+}
+
+static void
+session_cache_count (SessionCache *cache, gboolean is_hit)
+{
+  g_mutex_lock (&cache->mutex);
+
+  if (is_hit)
+    cache->n_hits++;
+  else
+    cache->n_misses++;
+
+  g_mutex_unlock (&cache->mutex);
+}
+
+static gint
+store_session_for_gnutls (gpointer ptr, gnutls_datum_t key, gnutls_datum_t data)
+{
+  GBytes *key_bytes = g_bytes_new (key.data, key.size);
+
+  session_cache_store (&server_session_cache, key_bytes, data.data, data.size);
+  g_bytes_unref (key_bytes);
+  return 0;
+}
+
+static gnutls_datum_t
+retrieve_session_for_gnutls (gpointer ptr, gnutls_datum_t key)
+{
+  GBytes         *key_bytes = g_bytes_new (key.data, key.size);
+  gnutls_datum_t  datum;
+
+  datum = session_cache_lookup (&server_session_cache, key_bytes);
+  g_bytes_unref (key_bytes);
+  return datum;
+}
+
+static gint
+remove_session_for_gnutls (gpointer ptr, gnutls_datum_t key)
+{
+  GBytes *key_bytes = g_bytes_new (key.data, key.size);
+
+  session_cache_remove (&server_session_cache, key_bytes);
+  g_bytes_unref (key_bytes);
+  return 0;
+}
+
+/* Used when there's nothing to check the server's certificate against */
+static gint
+reject_certificate_for_gnutls (gnutls_session_t session)
+{
+  return GNUTLS_E_CERTIFICATE_ERROR;
+}
+
+static GBytes *
+make_session_key (FlowIPService *ip_service)
+{
+  gchar *name = NULL;
+  gchar *key;
+
+  if (flow_ip_service_have_name (ip_service))
+  {
+    name = flow_ip_service_get_name (ip_service);
+  }
+  else if (flow_ip_service_have_addresses (ip_service))
+  {
+    FlowIPAddr *ip_addr = flow_ip_service_get_nth_address (ip_service, 0);
+
+    name = flow_ip_addr_get_string (ip_addr);
+    g_object_unref (ip_addr);
+  }
+
+  if (!name)
+    return NULL;
+
+  key = g_strdup_printf ("%s:%d", name, flow_ip_service_get_port (ip_service));
+  g_free (name);
+
+  return g_bytes_new_take (key, strlen (key));
+}
+
+/* Called with gnutls_mutex held */
+static void
+initialize_session_ticket_key (void)
+{
+  if (!session_ticket_key.data)
+    gnutls_session_ticket_key_generate (&session_ticket_key);
+}
+
+static void
+store_client_session (FlowTlsProtocol *tls_protocol)
+{
+  FlowTlsProtocolPrivate *priv = tls_protocol->priv;
+  gnutls_datum_t          data;
+
+  if (!priv->session_key)
+    return;
+
+  if (gnutls_session_get_data2 (priv->tls_session, &data) != GNUTLS_E_SUCCESS)
+    return;
+
+  session_cache_store (&client_session_cache, priv->session_key, data.data, data.size);
+  gnutls_free (data.data);
+}
+
+static void
+handshake_completed (FlowTlsProtocol *tls_protocol)
+{
+  FlowTlsProtocolPrivate *priv = tls_protocol->priv;
+  gboolean                is_resumed;
+
+  priv->handshake_complete = TRUE;
+  is_resumed = gnutls_session_is_resumed (priv->tls_session);
+
+  if (priv->agent_role == FLOW_AGENT_ROLE_SERVER)
+  {
+    session_cache_count (&server_session_cache, is_resumed);
+  }
+  else if (priv->session_key)
+  {
+    session_cache_count (&client_session_cache, is_resumed);
+    store_client_session (tls_protocol);
+  }
+}
+
 /* Similar to send(2): ssize_t (*gnutls_push_func) (gnutls_transport_ptr_t, const void *, size_t) */
 static ssize_t
 send_for_gnutls (FlowTlsProtocol *tls_protocol, gconstpointer src, size_t len)
 {
-  FlowElement *element = (FlowElement *) tls_protocol;
-  FlowPad     *output_pad;
-  size_t       offset;
+  FlowTlsProtocolPrivate *priv    = tls_protocol->priv;
+  FlowElement            *element = (FlowElement *) tls_protocol;
+  FlowPad                *output_pad;
+  size_t                  offset;
+
+  /* Once the kernel owns the outbound record sequence, anything GnuTLS
+   * encrypts on its own (e.g. a key update response) would corrupt the
+   * stream. Fail the session instead. */
+
+  if G_UNLIKELY (priv->ktls_state == KTLS_TX)
+  {
+    errno = EIO;
+    return -1;
+  }
 
   output_pad = g_ptr_array_index (element->output_pads, DOWNSTREAM_INDEX);
 
   /* Split the data up into multiple packets if necessary, so memory can be
-   * freed sooner, and in smaller increments. */
+   * freed sooner, and in smaller increments. On a worker thread, we collect
+   * them for the element's thread to push. */
 
   for (offset = 0; offset < len; offset += MAX_PACKET_SIZE)
   {
@@ -223,7 +720,11 @@ send_for_gnutls (FlowTlsProtocol *tls_protocol, gconstpointer src, size_t len)
 
     packet = flow_packet_new (FLOW_PACKET_FORMAT_BUFFER,
                               (guchar *) src + offset, packet_len);
-    flow_pad_push (output_pad, packet);
+
+    if (priv->crypto_job)
+      flow_packet_queue_push_packet (priv->crypto_job->ciphertext_out, packet);
+    else
+      flow_pad_push (output_pad, packet);
   }
 
   return len;
@@ -233,13 +734,21 @@ send_for_gnutls (FlowTlsProtocol *tls_protocol, gconstpointer src, size_t len)
 static ssize_t
 recv_for_gnutls (FlowTlsProtocol *tls_protocol, gpointer dest, size_t len)
 {
+  FlowTlsProtocolPrivate *priv    = tls_protocol->priv;
   FlowElement            *element = (FlowElement *) tls_protocol;
   FlowPad                *input_pad;
   FlowPacketQueue        *packet_queue;
 
-  input_pad = g_ptr_array_index (element->input_pads, DOWNSTREAM_INDEX);
+  if (priv->session_threaded)
+  {
+    packet_queue = priv->ciphertext_in;
+  }
+  else
+  {
+    input_pad    = g_ptr_array_index (element->input_pads, DOWNSTREAM_INDEX);
+    packet_queue = flow_pad_get_packet_queue (input_pad);
+  }
 
-  packet_queue = flow_pad_get_packet_queue (input_pad);
   if (!packet_queue)
   {
     /* FIXME: We should use the following function, but it's only available
@@ -262,76 +771,498 @@ recv_for_gnutls (FlowTlsProtocol *tls_protocol, gpointer dest, size_t len)
   return len;
 }
 
-static void
-initialize_server_params (void)
+/* Called with gnutls_mutex held */
+static gboolean
+load_dh_params (void)
 {
-  g_mutex_lock (&gnutls_mutex);
+  gnutls_datum_t datum;
+  gchar         *contents;
+  gsize          len;
+  gint           result;
 
-  if (!gnutls_server_is_initialized)
-  {
-    gnutls_dh_params_init (&gnutls_dh_parameters);
-    gnutls_dh_params_generate2 (gnutls_dh_parameters, DH_BITS_DEFAULT);
+  if (!gnutls_dh_parameters_path ||
+      !g_file_get_contents (gnutls_dh_parameters_path, &contents, &len, NULL))
+    return FALSE;
+
+  datum.data = (guchar *) contents;
+  datum.size = len;
 
-    gnutls_server_is_initialized = TRUE;
+  gnutls_dh_params_init (&gnutls_dh_parameters);
+  result = gnutls_dh_params_import_pkcs3 (gnutls_dh_parameters, &datum, GNUTLS_X509_FMT_PEM);
+  g_free (contents);
+
+  if (result != GNUTLS_E_SUCCESS)
+  {
+    g_warning ("Ignoring invalid DH parameters in '%s': %s",
+               gnutls_dh_parameters_path, gnutls_strerror (result));
+    gnutls_dh_params_deinit (gnutls_dh_parameters);
+    gnutls_dh_parameters = NULL;
+    return FALSE;
   }
 
-  g_mutex_unlock (&gnutls_mutex);
+  return TRUE;
 }
 
 static void
-initialize_session (FlowTlsProtocol *tls_protocol)
+save_dh_params (gnutls_dh_params_t dh_params, const gchar *path)
 {
-  FlowTlsProtocolPrivate *priv = tls_protocol->priv;
+  gnutls_datum_t datum;
+  GError        *error = NULL;
 
-  if (priv->session_initialized)
+  if (gnutls_dh_params_export2_pkcs3 (dh_params, GNUTLS_X509_FMT_PEM, &datum) != GNUTLS_E_SUCCESS)
     return;
 
-  global_ref_gnutls ();
-
-  if (priv->agent_role == FLOW_AGENT_ROLE_SERVER)
+  if (!g_file_set_contents (path, (const gchar *) datum.data, datum.size, &error))
   {
-    initialize_server_params ();
-
-    gnutls_anon_allocate_server_credentials ((gpointer) &priv->creds);
-    gnutls_anon_set_server_dh_params (priv->creds, gnutls_dh_parameters);
+    g_warning ("Could not save DH parameters to '%s': %s", path, error->message);
+    g_clear_error (&error);
+  }
 
-    gnutls_init (&priv->tls_session, GNUTLS_SERVER);
+  gnutls_free (datum.data);
+}
 
-    gnutls_priority_set_direct (priv->tls_session, "PERFORMANCE:+ANON-ECDH:+ANON-DH", NULL);
-    gnutls_credentials_set (priv->tls_session, GNUTLS_CRD_ANON, priv->creds);
+static gboolean
+dh_params_ready (FlowTlsProtocol *tls_protocol);
 
-    gnutls_dh_set_prime_bits (priv->tls_session, DH_BITS_DEFAULT);
-  }
-  else
-  {
-    gnutls_init (&priv->tls_session, GNUTLS_CLIENT);
+/* Called with gnutls_mutex held */
+static gnutls_anon_server_credentials_t
+new_anon_server_creds (void)
+{
+  gnutls_anon_server_credentials_t creds;
 
-    gnutls_anon_allocate_client_credentials ((gpointer) &priv->creds);
-    gnutls_priority_set_direct (priv->tls_session, "PERFORMANCE:+ANON-ECDH:+ANON-DH", NULL);
-    gnutls_credentials_set (priv->tls_session, GNUTLS_CRD_ANON, priv->creds);
-  }
+  gnutls_anon_allocate_server_credentials (&creds);
 
-  gnutls_transport_set_push_function (priv->tls_session,
-                                      (gnutls_push_func) send_for_gnutls);
-  gnutls_transport_set_pull_function (priv->tls_session,
-                                      (gnutls_pull_func) recv_for_gnutls);
-  gnutls_transport_set_ptr (priv->tls_session, tls_protocol);
+  if (gnutls_dh_parameters)
+    gnutls_anon_set_server_dh_params (creds, gnutls_dh_parameters);
 
-  priv->session_initialized = TRUE;
+  return creds;
 }
 
+/* Called with gnutls_mutex held */
 static void
-finalize_session (FlowTlsProtocol *tls_protocol)
+apply_dh_params (void)
 {
-  FlowTlsProtocolPrivate *priv = tls_protocol->priv;
+  if (!anon_server_creds || !gnutls_dh_parameters)
+    return;
+
+  /* Sessions may be handshaking with the current credentials on other
+   * threads, so don't touch them */
+
+  retired_anon_server_creds = g_slist_prepend (retired_anon_server_creds, anon_server_creds);
+  anon_server_creds = new_anon_server_creds ();
+}
+
+/* Called with gnutls_mutex held */
+static void
+initialize_anon_creds (void)
+{
+  if (anon_server_creds)
+    return;
+
+  anon_server_creds = new_anon_server_creds ();
+  gnutls_anon_allocate_client_credentials (&anon_client_creds);
+}
+
+static gpointer
+generate_dh_params_main (gpointer data)
+{
+  gnutls_dh_params_t  dh_params;
+  GSList             *waiters;
+  GSList             *l;
+  gchar              *path;
+  gint                result;
+
+  /* This takes a while, so do it without holding the lock */
+
+  gnutls_dh_params_init (&dh_params);
+  result = gnutls_dh_params_generate2 (dh_params, DH_BITS_DEFAULT);
+
+  if (result != GNUTLS_E_SUCCESS)
+  {
+    /* The waiting sessions will still be able to negotiate ECDH */
+    g_warning ("Failed to generate DH parameters: %s", gnutls_strerror (result));
+    gnutls_dh_params_deinit (dh_params);
+    dh_params = NULL;
+  }
+
+  g_mutex_lock (&gnutls_mutex);
+
+  if (dh_params)
+  {
+    gnutls_dh_parameters       = dh_params;
+    gnutls_dh_parameters_state = DH_PARAMS_READY;
+    apply_dh_params ();
+  }
+  else
+  {
+    /* Try again for the next session that needs them */
+    gnutls_dh_parameters_state = DH_PARAMS_NONE;
+  }
+
+  waiters                      = gnutls_dh_parameters_waiters;
+  gnutls_dh_parameters_waiters = NULL;
+  path                         = g_strdup (gnutls_dh_parameters_path);
+
+  g_mutex_unlock (&gnutls_mutex);
+
+  if (dh_params && path)
+    save_dh_params (dh_params, path);
+
+  g_free (path);
+
+  /* Resume the handshakes that were waiting for us, each in its own context */
+
+  for (l = waiters; l; l = g_slist_next (l))
+  {
+    DhParamsWaiter *waiter = l->data;
+
+    flow_idle_add_full (waiter->dispatch_context, G_PRIORITY_DEFAULT,
+                        (GSourceFunc) dh_params_ready, waiter->tls_protocol,
+                        (GDestroyNotify) g_object_unref);
+    g_main_context_unref (waiter->dispatch_context);
+    g_slice_free (DhParamsWaiter, waiter);
+  }
+
+  g_slist_free (waiters);
+
+  global_unref_gnutls ();
+  return NULL;
+}
+
+/* Called with gnutls_mutex held */
+static void
+start_dh_params (void)
+{
+  if (gnutls_dh_parameters_state != DH_PARAMS_NONE)
+    return;
+
+  if (load_dh_params ())
+  {
+    gnutls_dh_parameters_state = DH_PARAMS_READY;
+    apply_dh_params ();
+    return;
+  }
+
+  /* The thread needs GnuTLS to stay initialized until it's done, even if
+   * our caller lets go right away. We hold gnutls_mutex, so we can't use
+   * global_ref_gnutls (); the thread drops this with global_unref_gnutls (). */
+
+  gnutls_global_init ();
+
+  gnutls_dh_parameters_state = DH_PARAMS_GENERATING;
+  g_thread_unref (g_thread_new ("FlowTlsProtocol DH", generate_dh_params_main, NULL));
+}
+
+/* Returns TRUE if DH parameters are available. If not, they're being
+ * generated, and tls_protocol will get a call to dh_params_ready () in
+ * its thread's main context when done. */
+static gboolean
+initialize_server_params (FlowTlsProtocol *tls_protocol)
+{
+  DhParamsWaiter *waiter;
+  gboolean        is_ready;
+
+  g_mutex_lock (&gnutls_mutex);
+
+  start_dh_params ();
+
+  is_ready = (gnutls_dh_parameters_state == DH_PARAMS_READY);
+
+  if (!is_ready)
+  {
+    waiter = g_slice_new (DhParamsWaiter);
+    waiter->tls_protocol     = g_object_ref (tls_protocol);
+    waiter->dispatch_context = g_main_context_ref (flow_get_main_context_for_current_thread ());
+
+    gnutls_dh_parameters_waiters = g_slist_prepend (gnutls_dh_parameters_waiters, waiter);
+  }
+
+  g_mutex_unlock (&gnutls_mutex);
+
+  return is_ready;
+}
+
+static void
+set_server_dh_params (FlowTlsProtocol *tls_protocol)
+{
+  FlowTlsProtocolPrivate *priv = tls_protocol->priv;
+  gboolean                have_dh_params;
+
+  /* Pick up the latest shared credentials; they have the parameters, if any */
+
+  g_mutex_lock (&gnutls_mutex);
+  gnutls_credentials_set (priv->tls_session, GNUTLS_CRD_ANON, anon_server_creds);
+  have_dh_params = (gnutls_dh_parameters != NULL);
+  g_mutex_unlock (&gnutls_mutex);
+
+  if (have_dh_params)
+    gnutls_dh_set_prime_bits (priv->tls_session, DH_BITS_DEFAULT);
+}
+
+static void
+initialize_session (FlowTlsProtocol *tls_protocol)
+{
+  FlowTlsProtocolPrivate *priv = tls_protocol->priv;
+
+  if (priv->session_initialized)
+    return;
+
+  global_ref_gnutls ();
+
+  g_mutex_lock (&gnutls_mutex);
+  initialize_anon_creds ();
+  g_mutex_unlock (&gnutls_mutex);
+
+  if (priv->credentials)
+    priv->session_credentials = g_object_ref (priv->credentials);
+
+  if (priv->agent_role == FLOW_AGENT_ROLE_SERVER)
+  {
+    gnutls_init (&priv->tls_session, GNUTLS_SERVER);
+
+    if (priv->session_credentials)
+    {
+      /* Certificate key exchanges use ECDHE or RSA, so no need to wait
+       * for DH parameters */
+
+      gnutls_priority_set_direct (priv->tls_session, "PERFORMANCE", NULL);
+      gnutls_credentials_set (priv->tls_session, GNUTLS_CRD_CERTIFICATE,
+                              flow_tls_credentials_get_gnutls_credentials (priv->session_credentials));
+    }
+    else
+    {
+      gnutls_priority_set_direct (priv->tls_session, "PERFORMANCE:+ANON-ECDH:+ANON-DH", NULL);
+
+      /* If the DH parameters aren't ready yet, the handshake will be
+       * postponed until they are. Credentials are set along with them. */
+
+      if (initialize_server_params (tls_protocol))
+        set_server_dh_params (tls_protocol);
+      else
+        priv->waiting_for_dh_params = TRUE;
+    }
+
+    /* Let returning clients resume by session ID or ticket */
+
+    gnutls_db_set_retrieve_function (priv->tls_session, retrieve_session_for_gnutls);
+    gnutls_db_set_store_function (priv->tls_session, store_session_for_gnutls);
+    gnutls_db_set_remove_function (priv->tls_session, remove_session_for_gnutls);
+
+    g_mutex_lock (&gnutls_mutex);
+    initialize_session_ticket_key ();
+    g_mutex_unlock (&gnutls_mutex);
+
+    gnutls_session_ticket_enable_server (priv->tls_session, &session_ticket_key);
+  }
+  else
+  {
+    gnutls_init (&priv->tls_session, GNUTLS_CLIENT);
+
+    if (priv->session_credentials)
+    {
+      gnutls_priority_set_direct (priv->tls_session, "PERFORMANCE", NULL);
+      gnutls_credentials_set (priv->tls_session, GNUTLS_CRD_CERTIFICATE,
+                              flow_tls_credentials_get_gnutls_credentials (priv->session_credentials));
+
+      /* Ask for the right certificate, and check that we got it. Server
+       * names can't be IP addresses, but certificates can list them. */
+
+      if (priv->remote_name && !priv->remote_name_is_addr)
+        gnutls_server_name_set (priv->tls_session, GNUTLS_NAME_DNS,
+                                priv->remote_name, strlen (priv->remote_name));
+
+      if (priv->remote_name)
+        gnutls_session_set_verify_cert (priv->tls_session, priv->remote_name, 0);
+      else
+        gnutls_session_set_verify_function (priv->tls_session, reject_certificate_for_gnutls);
+    }
+    else
+    {
+      gnutls_priority_set_direct (priv->tls_session, "PERFORMANCE:+ANON-ECDH:+ANON-DH", NULL);
+      gnutls_credentials_set (priv->tls_session, GNUTLS_CRD_ANON, anon_client_creds);
+    }
+
+    /* Try to resume an earlier session with the same peer */
+
+    if (priv->session_key)
+    {
+      gnutls_datum_t data = session_cache_lookup (&client_session_cache, priv->session_key);
+
+      if (data.data)
+      {
+        gnutls_session_set_data (priv->tls_session, data.data, data.size);
+        gnutls_free (data.data);
+      }
+    }
+  }
+
+  gnutls_transport_set_push_function (priv->tls_session,
+                                      (gnutls_push_func) send_for_gnutls);
+  gnutls_transport_set_pull_function (priv->tls_session,
+                                      (gnutls_pull_func) recv_for_gnutls);
+  gnutls_transport_set_ptr (priv->tls_session, tls_protocol);
+
+  priv->session_threaded = priv->threaded_crypto;
+  if (priv->session_threaded && !priv->ciphertext_in)
+    priv->ciphertext_in = flow_packet_queue_new ();
+
+  priv->session_initialized = TRUE;
+}
+
+static void
+finalize_session (FlowTlsProtocol *tls_protocol)
+{
+  FlowTlsProtocolPrivate *priv = tls_protocol->priv;
 
   if (!priv->session_initialized)
     return;
 
+  /* Servers may have sent us a new ticket after the handshake */
+
+  if (priv->agent_role == FLOW_AGENT_ROLE_CLIENT && priv->handshake_complete)
+    store_client_session (tls_protocol);
+
   gnutls_deinit (priv->tls_session);
   global_unref_gnutls ();
 
-  priv->session_initialized = FALSE;
+  if (priv->session_credentials)
+  {
+    g_object_unref (priv->session_credentials);
+    priv->session_credentials = NULL;
+  }
+
+  priv->session_initialized   = FALSE;
+  priv->waiting_for_dh_params = FALSE;
+  priv->handshake_complete    = FALSE;
+  priv->ktls_state            = KTLS_NONE;
+
+  if (priv->record_timeout_id)
+  {
+    flow_source_remove_from_current_thread (priv->record_timeout_id);
+    priv->record_timeout_id = 0;
+  }
+
+  priv->record_len            = 0;
+  priv->record_bytes_sent     = 0;
+  priv->record_last_send_time = 0;
+
+  if (priv->ciphertext_in)
+    flow_packet_queue_clear (priv->ciphertext_in);
+  priv->session_threaded      = FALSE;
+}
+
+#ifdef HAVE_KTLS
+
+/* Builds the kernel crypto state for our write direction. Returns the size
+ * of the filled-in structure, or 0 if the negotiated cipher can't be
+ * offloaded. */
+static guint
+make_ktls_crypto_info (FlowTlsProtocol *tls_protocol, gpointer crypto_info_out)
+{
+  FlowTlsProtocolPrivate *priv = tls_protocol->priv;
+  gnutls_protocol_t       version;
+  gnutls_cipher_algorithm_t cipher;
+  gnutls_datum_t          iv;
+  gnutls_datum_t          key;
+  guchar                  seq [8];
+  guint16                 tls_version;
+
+  version = gnutls_protocol_get_version (priv->tls_session);
+  if (version == GNUTLS_TLS1_2)
+    tls_version = TLS_1_2_VERSION;
+  else if (version == GNUTLS_TLS1_3)
+    tls_version = TLS_1_3_VERSION;
+  else
+    return 0;
+
+  cipher = gnutls_cipher_get (priv->tls_session);
+  if (cipher != GNUTLS_CIPHER_AES_128_GCM &&
+      cipher != GNUTLS_CIPHER_AES_256_GCM)
+    return 0;
+
+  if (gnutls_record_get_state (priv->tls_session, 0, NULL, &iv, &key, seq) != GNUTLS_E_SUCCESS)
+    return 0;
+
+  if (cipher == GNUTLS_CIPHER_AES_128_GCM)
+  {
+    struct tls12_crypto_info_aes_gcm_128 *info = crypto_info_out;
+
+    memset (info, 0, sizeof (*info));
+    info->info.version     = tls_version;
+    info->info.cipher_type = TLS_CIPHER_AES_GCM_128;
+
+    /* TLS 1.2 uses the sequence number as the explicit nonce, while
+     * TLS 1.3 derives it from the static IV */
+
+    if (version == GNUTLS_TLS1_2)
+      memcpy (info->iv, seq, TLS_CIPHER_AES_GCM_128_IV_SIZE);
+    else
+      memcpy (info->iv, iv.data + TLS_CIPHER_AES_GCM_128_SALT_SIZE, TLS_CIPHER_AES_GCM_128_IV_SIZE);
+
+    memcpy (info->salt, iv.data, TLS_CIPHER_AES_GCM_128_SALT_SIZE);
+    memcpy (info->key, key.data, TLS_CIPHER_AES_GCM_128_KEY_SIZE);
+    memcpy (info->rec_seq, seq, TLS_CIPHER_AES_GCM_128_REC_SEQ_SIZE);
+
+    return sizeof (*info);
+  }
+  else
+  {
+    struct tls12_crypto_info_aes_gcm_256 *info = crypto_info_out;
+
+    memset (info, 0, sizeof (*info));
+    info->info.version     = tls_version;
+    info->info.cipher_type = TLS_CIPHER_AES_GCM_256;
+
+    if (version == GNUTLS_TLS1_2)
+      memcpy (info->iv, seq, TLS_CIPHER_AES_GCM_256_IV_SIZE);
+    else
+      memcpy (info->iv, iv.data + TLS_CIPHER_AES_GCM_256_SALT_SIZE, TLS_CIPHER_AES_GCM_256_IV_SIZE);
+
+    memcpy (info->salt, iv.data, TLS_CIPHER_AES_GCM_256_SALT_SIZE);
+    memcpy (info->key, key.data, TLS_CIPHER_AES_GCM_256_KEY_SIZE);
+    memcpy (info->rec_seq, seq, TLS_CIPHER_AES_GCM_256_REC_SEQ_SIZE);
+
+    return sizeof (*info);
+  }
+}
+
+#endif
+
+/* Asks the socket downstream to take over outbound encryption. The request
+ * travels in-stream behind the last handshake records, and upstream stays
+ * blocked until we hear back. Returns TRUE if a request was sent. */
+static gboolean
+start_kernel_offload (FlowTlsProtocol *tls_protocol)
+{
+#ifdef HAVE_KTLS
+  FlowTlsProtocolPrivate *priv    = tls_protocol->priv;
+  FlowElement            *element = (FlowElement *) tls_protocol;
+  FlowSockoptOp          *sockopt_op;
+  struct tls12_crypto_info_aes_gcm_256 crypto_info;
+  guint                   crypto_info_len;
+
+  if (!priv->kernel_offload)
+    return FALSE;
+
+  crypto_info_len = make_ktls_crypto_info (tls_protocol, &crypto_info);
+  if (crypto_info_len == 0)
+    return FALSE;
+
+  sockopt_op = flow_sockopt_op_new ();
+  flow_sockopt_op_add_option (sockopt_op, IPPROTO_TCP, TCP_ULP, "tls", sizeof ("tls"));
+  flow_sockopt_op_add_option (sockopt_op, SOL_TLS, TLS_TX, &crypto_info, crypto_info_len);
+
+  /* Don't leave key material lying around on the stack */
+  flow_wipe_memory (&crypto_info, sizeof (crypto_info));
+
+  priv->ktls_state = KTLS_PENDING;
+  flow_pad_push (g_ptr_array_index (element->output_pads, DOWNSTREAM_INDEX),
+                 flow_packet_new_take_object (sockopt_op, 0));
+
+  return TRUE;
+#else
+  return FALSE;
+#endif
 }
 
 static void
@@ -390,6 +1321,12 @@ flow_tls_protocol_output_pad_unblocked (FlowElement *element, FlowPad *output_pa
     if (priv->from_downstream_state == STATE_OPENING)
       return;
 
+    /* Likewise, we can't tell how to send data until the kernel has accepted
+     * or rejected our keys */
+
+    if (priv->ktls_state == KTLS_PENDING)
+      return;
+
     input_index = UPSTREAM_INDEX;
   }
 
@@ -426,159 +1363,570 @@ unblock_from_downstream (FlowTlsProtocol *tls_protocol)
 {
   FlowElement *element = (FlowElement *) tls_protocol;
 
-  if (!flow_pad_is_blocked (g_ptr_array_index (element->output_pads, UPSTREAM_INDEX)))
-    flow_pad_unblock (g_ptr_array_index (element->input_pads, DOWNSTREAM_INDEX));
+  if (!flow_pad_is_blocked (g_ptr_array_index (element->output_pads, UPSTREAM_INDEX)))
+    flow_pad_unblock (g_ptr_array_index (element->input_pads, DOWNSTREAM_INDEX));
+}
+
+static void
+close_from_upstream (FlowTlsProtocol *tls_protocol, gint tls_error, gboolean generate_stream_end)
+{
+  FlowTlsProtocolPrivate *priv    = tls_protocol->priv;
+  FlowElement            *element = (FlowElement *) tls_protocol;
+  FlowDetailedEvent      *detailed_event;
+  FlowPacket             *packet;
+
+  if (priv->from_upstream_state == STATE_OPEN)
+  {
+    /* First thing, pass along a FLOW_STREAM_END and block further input */
+
+    priv->from_upstream_state = STATE_CLOSING;
+    block_from_upstream (tls_protocol);
+
+    if (generate_stream_end)
+    {
+      if (tls_error < 0)
+      {
+        detailed_event = flow_detailed_event_new_literal (gnutls_strerror (tls_error));
+        flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
+        flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_END);
+
+        packet = flow_packet_new_take_object (detailed_event, 0);
+      }
+      else
+      {
+        packet = flow_create_simple_event_packet (FLOW_STREAM_DOMAIN, FLOW_STREAM_END);
+      }
+
+      flow_pad_push (g_ptr_array_index (element->output_pads, DOWNSTREAM_INDEX), packet);
+    }
+  }
+
+  if (priv->from_upstream_state == STATE_CLOSING)
+  {
+    /* If one direction is waiting for the other to close, and it was closed,
+     * also close the first direction */
+
+    if (priv->from_downstream_state == STATE_CLOSING)
+      priv->from_downstream_state = STATE_CLOSED;
+
+    if (priv->from_downstream_state == STATE_CLOSED)
+      priv->from_upstream_state = STATE_CLOSED;
+  }
+
+  /* If we managed to close both ways, finalize the session and unblock input */
+
+  if (priv->from_upstream_state   == STATE_CLOSED &&
+      priv->from_downstream_state == STATE_CLOSED)
+  {
+    finalize_session (tls_protocol);
+    unblock_from_upstream (tls_protocol);
+    unblock_from_downstream (tls_protocol);
+  }
+}
+
+static void
+close_from_downstream (FlowTlsProtocol *tls_protocol, gint tls_error, gboolean generate_stream_end)
+{
+  FlowTlsProtocolPrivate *priv    = tls_protocol->priv;
+  FlowElement            *element = (FlowElement *) tls_protocol;
+  FlowDetailedEvent      *detailed_event;
+  FlowPacket             *packet;
+
+  if (priv->from_downstream_state == STATE_OPEN ||
+      priv->from_downstream_state == STATE_OPENING)
+  {
+    /* First thing, pass along a FLOW_STREAM_END and block further input */
+
+    priv->from_downstream_state = STATE_CLOSING;
+    block_from_downstream (tls_protocol);
+
+    if (generate_stream_end)
+    {
+      if (tls_error < 0)
+      {
+        detailed_event = flow_detailed_event_new_literal (gnutls_strerror (tls_error));
+        flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
+        flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_END);
+
+        packet = flow_packet_new_take_object (detailed_event, 0);
+      }
+      else
+      {
+        packet = flow_create_simple_event_packet (FLOW_STREAM_DOMAIN, FLOW_STREAM_END);
+      }
+
+      flow_pad_push (g_ptr_array_index (element->output_pads, UPSTREAM_INDEX), packet);
+    }
+  }
+
+  if (priv->from_downstream_state == STATE_CLOSING)
+  {
+    /* If one direction is waiting for the other to close, and it was closed,
+     * also close the first direction */
+
+    if (priv->from_upstream_state == STATE_CLOSING)
+      priv->from_upstream_state = STATE_CLOSED;
+
+    if (priv->from_upstream_state == STATE_CLOSED)
+      priv->from_downstream_state = STATE_CLOSED;
+  }
+
+  /* If we managed to close both ways, finalize the session and unblock input */
+
+  if (priv->from_upstream_state   == STATE_CLOSED &&
+      priv->from_downstream_state == STATE_CLOSED)
+  {
+    finalize_session (tls_protocol);
+    unblock_from_upstream (tls_protocol);
+    unblock_from_downstream (tls_protocol);
+  }
+}
+
+/* Returns the record size to aim for right now */
+static guint
+get_record_limit (FlowTlsProtocol *tls_protocol)
+{
+  FlowTlsProtocolPrivate *priv = tls_protocol->priv;
+
+  /* After an idle period, the TCP congestion window has likely shrunk,
+   * so start over with small records */
+
+  if (priv->record_last_send_time != 0 &&
+      g_get_monotonic_time () - priv->record_last_send_time > RECORD_IDLE_RESET_USEC)
+    priv->record_bytes_sent = 0;
+
+  if (priv->record_bytes_sent < RECORD_RAMP_BYTES)
+    return MIN (priv->max_record_size, RECORD_SIZE_SMALL);
+
+  return priv->max_record_size;
+}
+
+static void
+send_record (FlowTlsProtocol *tls_protocol, const guint8 *data, gint len)
+{
+  FlowTlsProtocolPrivate *priv = tls_protocol->priv;
+  ssize_t                 result;
+
+  while (len > 0)
+  {
+    result = gnutls_record_send (priv->tls_session, data, len);
+
+    /* Send can't fail because our helper always accepts and queues outbound data. */
+    g_assert (result > 0);
+
+    data += result;
+    len  -= result;
+
+    priv->record_bytes_sent += result;
+  }
+
+  priv->record_last_send_time = g_get_monotonic_time ();
+}
+
+static void
+flush_record (FlowTlsProtocol *tls_protocol)
+{
+  FlowTlsProtocolPrivate *priv = tls_protocol->priv;
+
+  if (priv->record_timeout_id)
+  {
+    flow_source_remove_from_current_thread (priv->record_timeout_id);
+    priv->record_timeout_id = 0;
+  }
+
+  if (priv->record_len == 0)
+    return;
+
+  send_record (tls_protocol, priv->record_buf, priv->record_len);
+  priv->record_len = 0;
+}
+
+static gboolean
+record_delay_expired (FlowTlsProtocol *tls_protocol)
+{
+  FlowTlsProtocolPrivate *priv = tls_protocol->priv;
+
+  priv->record_timeout_id = 0;
+
+  /* A worker owns the session; crypto_job_done () flushes when it's back */
+
+  if (priv->session_initialized && !priv->crypto_job)
+    flush_record (tls_protocol);
+
+  return FALSE;
+}
+
+/* Encrypts as much of the packet as makes sense now, coalescing small
+ * packets into a single record. Returns the number of bytes consumed. */
+static gint
+encrypt_from_packet (FlowTlsProtocol *tls_protocol, const guint8 *data, gint len)
+{
+  FlowTlsProtocolPrivate *priv = tls_protocol->priv;
+  guint                   limit;
+  gint                    n;
+
+  limit = get_record_limit (tls_protocol);
+
+  /* Anything staged from a previous, larger limit goes out first */
+
+  if (priv->record_len >= limit)
+    flush_record (tls_protocol);
+
+  if (priv->record_len == 0 && len >= limit)
+  {
+    /* Big enough to make a full record on its own; skip the copy */
+    send_record (tls_protocol, data, limit);
+    return limit;
+  }
+
+  if (!priv->record_buf)
+    priv->record_buf = g_malloc (RECORD_SIZE_MAX);
+
+  n = MIN (len, (gint) (limit - priv->record_len));
+  memcpy (priv->record_buf + priv->record_len, data, n);
+  priv->record_len += n;
+
+  if (priv->record_len >= limit)
+    flush_record (tls_protocol);
+
+  return n;
+}
+
+/* Called when we've run out of upstream input for now */
+static void
+finish_records (FlowTlsProtocol *tls_protocol)
+{
+  FlowTlsProtocolPrivate *priv = tls_protocol->priv;
+
+  /* Leave it to crypto_job_done () while a worker owns the session */
+
+  if (priv->record_len == 0 || priv->crypto_job)
+    return;
+
+  if (priv->record_delay == 0)
+  {
+    flush_record (tls_protocol);
+  }
+  else if (!priv->record_timeout_id)
+  {
+    priv->record_timeout_id = flow_timeout_add_to_current_thread (priv->record_delay,
+                                                                 (GSourceFunc) record_delay_expired,
+                                                                 tls_protocol);
+  }
+}
+
+static void process_input_from_upstream (FlowTlsProtocol *tls_protocol, FlowPad *input_pad);
+static void process_input_from_downstream (FlowTlsProtocol *tls_protocol, FlowPad *input_pad);
+static gboolean run_crypto_job (FlowTlsProtocol *tls_protocol);
+
+static void
+handshake_result (FlowTlsProtocol *tls_protocol, gint result)
+{
+  FlowTlsProtocolPrivate *priv = tls_protocol->priv;
+
+  if (result == 0)
+  {
+    /* Handshake done */
+
+    handshake_completed (tls_protocol);
+
+    priv->from_downstream_state = STATE_OPEN;
+
+    if (!start_kernel_offload (tls_protocol))
+      unblock_from_upstream (tls_protocol);
+
+#if 0
+    process_input_from_upstream (tls_protocol, g_ptr_array_index (element->input_pads, UPSTREAM_INDEX));
+    process_input_from_downstream (tls_protocol, g_ptr_array_index (element->input_pads, DOWNSTREAM_INDEX));
+#endif
+  }
+  else if (gnutls_error_is_fatal (result))
+  {
+    /* Protocol error */
+
+    g_print ("[%p] Handshake error\n", tls_protocol);
+
+    close_from_upstream (tls_protocol, result, TRUE);
+    close_from_downstream (tls_protocol, result, TRUE);
+  }
+}
+
+static void
+do_handshake (FlowTlsProtocol *tls_protocol)
+{
+  FlowTlsProtocolPrivate *priv = tls_protocol->priv;
+
+  if (priv->waiting_for_dh_params)
+    return;
+
+  if (priv->session_threaded)
+  {
+    run_crypto_job (tls_protocol);
+    return;
+  }
+
+  handshake_result (tls_protocol, gnutls_handshake (priv->tls_session));
+}
+
+static void
+recv_result (FlowTlsProtocol *tls_protocol, gint result)
+{
+  if (result == 0)
+  {
+    /* Got bye from remote end */
+
+    close_from_downstream (tls_protocol, 0, TRUE);
+  }
+  else if (gnutls_error_is_fatal (result))
+  {
+    /* Crypto error */
+
+    g_print ("[%p] Crypto error (from downstream)\n", tls_protocol);
+
+    close_from_downstream (tls_protocol, result, TRUE);
+  }
+}
+
+/* --- Crypto thread pool --- */
+
+/* Moves leading data packets from one queue to another, stopping at the
+ * first object or when max_bytes is reached. Returns the number of bytes
+ * moved. */
+static gint
+move_data_packets (FlowPacketQueue *src, FlowPacketQueue *dest, gint max_bytes)
+{
+  FlowPacket *packet;
+  gint        packet_offset;
+  gint        n_moved = 0;
+
+  while (n_moved < max_bytes &&
+         flow_packet_queue_peek_packet (src, &packet, &packet_offset) &&
+         flow_packet_get_format (packet) == FLOW_PACKET_FORMAT_BUFFER)
+  {
+    gint len = flow_packet_get_size (packet) - packet_offset;
+
+    if (packet_offset > 0)
+    {
+      packet = flow_packet_new (FLOW_PACKET_FORMAT_BUFFER,
+                                (guint8 *) flow_packet_get_data (packet) + packet_offset, len);
+      flow_packet_queue_drop_packet (src);
+    }
+    else
+    {
+      flow_packet_queue_pop_packet (src);
+    }
+
+    flow_packet_queue_push_packet (dest, packet);
+    n_moved += len;
+  }
+
+  return n_moved;
+}
+
+static void
+push_all_packets (FlowPacketQueue *packet_queue, FlowPad *pad)
+{
+  FlowPacket *packet;
+
+  while ((packet = flow_packet_queue_pop_packet (packet_queue)))
+    flow_pad_push (pad, packet);
+}
+
+static void
+crypto_job_free (CryptoJob *job)
+{
+  if (job->plaintext_in)
+    g_object_unref (job->plaintext_in);
+
+  g_object_unref (job->ciphertext_out);
+  g_object_unref (job->plaintext_out);
+  g_main_context_unref (job->dispatch_context);
+  g_object_unref (job->tls_protocol);
+
+  g_slice_free (CryptoJob, job);
+}
+
+/* Runs in the element's thread when the worker is done */
+static gboolean
+crypto_job_done (CryptoJob *job)
+{
+  FlowTlsProtocol        *tls_protocol = job->tls_protocol;
+  FlowTlsProtocolPrivate *priv         = tls_protocol->priv;
+  FlowElement            *element      = (FlowElement *) tls_protocol;
+
+  priv->crypto_job = NULL;
+
+  /* Records go out in the order GnuTLS produced them */
+
+  push_all_packets (job->ciphertext_out, g_ptr_array_index (element->output_pads, DOWNSTREAM_INDEX));
+
+  if (job->do_handshake)
+    handshake_result (tls_protocol, job->handshake_result);
+
+  push_all_packets (job->plaintext_out, g_ptr_array_index (element->output_pads, UPSTREAM_INDEX));
+
+  if (job->do_recv && priv->from_downstream_state == STATE_OPEN)
+    recv_result (tls_protocol, job->recv_result);
+
+  /* If the record delay ran out while the worker was busy, send what was
+   * staged before anything newer */
+
+  if (priv->record_len > 0 && !priv->record_timeout_id && priv->session_initialized)
+    flush_record (tls_protocol);
+
+  /* Pick up whatever arrived while the worker was busy */
+
+  process_input_from_upstream (tls_protocol, g_ptr_array_index (element->input_pads, UPSTREAM_INDEX));
+  process_input_from_downstream (tls_protocol, g_ptr_array_index (element->input_pads, DOWNSTREAM_INDEX));
+
+  return FALSE;
 }
 
 static void
-close_from_upstream (FlowTlsProtocol *tls_protocol, gint tls_error, gboolean generate_stream_end)
+crypto_job_run (CryptoJob *job, gpointer user_data)
 {
-  FlowTlsProtocolPrivate *priv    = tls_protocol->priv;
-  FlowElement            *element = (FlowElement *) tls_protocol;
-  FlowDetailedEvent      *detailed_event;
-  FlowPacket             *packet;
+  FlowTlsProtocol        *tls_protocol = job->tls_protocol;
+  FlowTlsProtocolPrivate *priv         = tls_protocol->priv;
 
-  if (priv->from_upstream_state == STATE_OPEN)
+  if (job->do_handshake)
   {
-    /* First thing, pass along a FLOW_STREAM_END and block further input */
+    job->handshake_result = gnutls_handshake (priv->tls_session);
 
-    priv->from_upstream_state = STATE_CLOSING;
-    block_from_upstream (tls_protocol);
+    /* Application data may have followed the last handshake message */
 
-    if (generate_stream_end)
-    {
-      if (tls_error < 0)
-      {
-        detailed_event = flow_detailed_event_new_literal (gnutls_strerror (tls_error));
-        flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
-        flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_END);
+    if (job->handshake_result == 0)
+      job->do_recv = TRUE;
+  }
 
-        packet = flow_packet_new_take_object (detailed_event, 0);
-      }
-      else
-      {
-        packet = flow_create_simple_event_packet (FLOW_STREAM_DOMAIN, FLOW_STREAM_END);
-      }
+  if (job->do_recv)
+  {
+    guint8 buf [MAX_READ];
+    gint   result;
 
-      flow_pad_push (g_ptr_array_index (element->output_pads, DOWNSTREAM_INDEX), packet);
-    }
+    while ((result = gnutls_record_recv (priv->tls_session, buf, MAX_READ)) > 0)
+      flow_packet_queue_push_packet (job->plaintext_out,
+                                     flow_packet_new (FLOW_PACKET_FORMAT_BUFFER, buf, result));
+
+    job->recv_result = result;
   }
 
-  if (priv->from_upstream_state == STATE_CLOSING)
+  if (job->plaintext_in)
   {
-    /* If one direction is waiting for the other to close, and it was closed,
-     * also close the first direction */
+    guint8 *buf = g_alloca (RECORD_SIZE_MAX);
+    gint    len;
 
-    if (priv->from_downstream_state == STATE_CLOSING)
-      priv->from_downstream_state = STATE_CLOSED;
+    /* Coalesce into records of the currently preferred size */
 
-    if (priv->from_downstream_state == STATE_CLOSED)
-      priv->from_upstream_state = STATE_CLOSED;
+    while ((len = flow_packet_queue_pop_bytes (job->plaintext_in, buf,
+                                               get_record_limit (tls_protocol))) > 0)
+      send_record (tls_protocol, buf, len);
   }
 
-  /* If we managed to close both ways, finalize the session and unblock input */
+  flow_idle_add_full (job->dispatch_context, G_PRIORITY_DEFAULT,
+                      (GSourceFunc) crypto_job_done, job,
+                      (GDestroyNotify) crypto_job_free);
+}
 
-  if (priv->from_upstream_state   == STATE_CLOSED &&
-      priv->from_downstream_state == STATE_CLOSED)
+static GThreadPool *
+get_crypto_pool (void)
+{
+  g_mutex_lock (&gnutls_mutex);
+
+  if (!crypto_pool)
   {
-    finalize_session (tls_protocol);
-    unblock_from_upstream (tls_protocol);
-    unblock_from_downstream (tls_protocol);
+    crypto_pool = g_thread_pool_new ((GFunc) crypto_job_run, NULL,
+                                     crypto_pool_max_threads > 0 ?
+                                     (gint) crypto_pool_max_threads : (gint) g_get_num_processors (),
+                                     FALSE, NULL);
   }
+
+  g_mutex_unlock (&gnutls_mutex);
+
+  return crypto_pool;
 }
 
-static void
-close_from_downstream (FlowTlsProtocol *tls_protocol, gint tls_error, gboolean generate_stream_end)
+/* Gathers pending input in both directions and hands the session to a
+ * worker. Does nothing if a job is already in flight or there's nothing
+ * to do. Returns TRUE if a job was queued. */
+static gboolean
+run_crypto_job (FlowTlsProtocol *tls_protocol)
 {
   FlowTlsProtocolPrivate *priv    = tls_protocol->priv;
   FlowElement            *element = (FlowElement *) tls_protocol;
-  FlowDetailedEvent      *detailed_event;
-  FlowPacket             *packet;
-
-  if (priv->from_downstream_state == STATE_OPEN ||
-      priv->from_downstream_state == STATE_OPENING)
+  FlowPacketQueue        *packet_queue;
+  CryptoJob              *job;
+  gboolean                do_handshake  = FALSE;
+  gboolean                do_recv       = FALSE;
+  FlowPacketQueue        *plaintext_in  = NULL;
+  gint                    n_ciphertext  = 0;
+
+  if (priv->crypto_job || !priv->session_initialized)
+    return FALSE;
+
+  packet_queue = flow_pad_get_packet_queue (g_ptr_array_index (element->input_pads, DOWNSTREAM_INDEX));
+  if (packet_queue)
+    n_ciphertext = move_data_packets (packet_queue, priv->ciphertext_in, G_MAXINT);
+
+  if (priv->from_downstream_state == STATE_OPENING)
+    do_handshake = !priv->waiting_for_dh_params;
+  else if (priv->from_downstream_state == STATE_OPEN)
+    do_recv = n_ciphertext > 0;
+
+  packet_queue = flow_pad_get_packet_queue (g_ptr_array_index (element->input_pads, UPSTREAM_INDEX));
+  if (packet_queue &&
+      priv->from_upstream_state   == STATE_OPEN &&
+      priv->from_downstream_state != STATE_OPENING &&
+      priv->ktls_state            == KTLS_NONE)
   {
-    /* First thing, pass along a FLOW_STREAM_END and block further input */
+    plaintext_in = flow_packet_queue_new ();
 
-    priv->from_downstream_state = STATE_CLOSING;
-    block_from_downstream (tls_protocol);
-
-    if (generate_stream_end)
+    if (move_data_packets (packet_queue, plaintext_in, CRYPTO_JOB_MAX_PLAINTEXT) == 0)
     {
-      if (tls_error < 0)
-      {
-        detailed_event = flow_detailed_event_new_literal (gnutls_strerror (tls_error));
-        flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR);
-        flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_END);
-
-        packet = flow_packet_new_take_object (detailed_event, 0);
-      }
-      else
-      {
-        packet = flow_create_simple_event_packet (FLOW_STREAM_DOMAIN, FLOW_STREAM_END);
-      }
-
-      flow_pad_push (g_ptr_array_index (element->output_pads, UPSTREAM_INDEX), packet);
+      g_object_unref (plaintext_in);
+      plaintext_in = NULL;
     }
   }
 
-  if (priv->from_downstream_state == STATE_CLOSING)
-  {
-    /* If one direction is waiting for the other to close, and it was closed,
-     * also close the first direction */
+  if (!do_handshake && !do_recv && !plaintext_in)
+    return FALSE;
 
-    if (priv->from_upstream_state == STATE_CLOSING)
-      priv->from_upstream_state = STATE_CLOSED;
+  /* Staged bytes precede the worker's plaintext in the stream */
 
-    if (priv->from_upstream_state == STATE_CLOSED)
-      priv->from_downstream_state = STATE_CLOSED;
-  }
+  if (plaintext_in)
+    flush_record (tls_protocol);
 
-  /* If we managed to close both ways, finalize the session and unblock input */
+  job = g_slice_new0 (CryptoJob);
+  job->tls_protocol     = g_object_ref (tls_protocol);
+  job->dispatch_context = g_main_context_ref (flow_get_main_context_for_current_thread ());
+  job->do_handshake     = do_handshake;
+  job->do_recv          = do_recv;
+  job->plaintext_in     = plaintext_in;
+  job->ciphertext_out   = flow_packet_queue_new ();
+  job->plaintext_out    = flow_packet_queue_new ();
 
-  if (priv->from_upstream_state   == STATE_CLOSED &&
-      priv->from_downstream_state == STATE_CLOSED)
-  {
-    finalize_session (tls_protocol);
-    unblock_from_upstream (tls_protocol);
-    unblock_from_downstream (tls_protocol);
-  }
+  priv->crypto_job = job;
+  g_thread_pool_push (get_crypto_pool (), job, NULL);
+  return TRUE;
 }
 
-#if 0
-static void process_input_from_upstream (FlowTlsProtocol *tls_protocol, FlowPad *input_pad);
-static void process_input_from_downstream (FlowTlsProtocol *tls_protocol, FlowPad *input_pad);
-#endif
-
-static void
-do_handshake (FlowTlsProtocol *tls_protocol)
+static gboolean
+dh_params_ready (FlowTlsProtocol *tls_protocol)
 {
   FlowTlsProtocolPrivate *priv    = tls_protocol->priv;
-  ssize_t                 result;
+  FlowElement            *element = (FlowElement *) tls_protocol;
 
-  result = gnutls_handshake (priv->tls_session);
+  if (!priv->waiting_for_dh_params)
+    return FALSE;
 
-  if (result == 0)
-  {
-    /* Handshake done */
+  priv->waiting_for_dh_params = FALSE;
+  set_server_dh_params (tls_protocol);
 
-    priv->from_downstream_state = STATE_OPEN;
-    unblock_from_upstream (tls_protocol);
+  /* Catch up on any handshake data that arrived in the meantime */
 
-#if 0
-    process_input_from_upstream (tls_protocol, g_ptr_array_index (element->input_pads, UPSTREAM_INDEX));
+  if (priv->from_downstream_state == STATE_OPENING)
     process_input_from_downstream (tls_protocol, g_ptr_array_index (element->input_pads, DOWNSTREAM_INDEX));
-#endif
-  }
-  else if (gnutls_error_is_fatal (result))
-  {
-    /* Protocol error */
 
-    g_print ("[%p] Handshake error\n", tls_protocol);
-
-    close_from_upstream (tls_protocol, result, TRUE);
-    close_from_downstream (tls_protocol, result, TRUE);
-  }
+  return FALSE;
 }
 
 static void
@@ -628,8 +1976,11 @@ process_object_from_upstream (FlowTlsProtocol *tls_protocol, FlowPacket *packet)
     {
       if (priv->from_upstream_state == STATE_OPEN)
       {
-        /* This can't fail because our "send" helper always accepts and queues outbound data */
-        gnutls_bye (priv->tls_session, GNUTLS_SHUT_WR);
+        /* This can't fail because our "send" helper always accepts and queues outbound
+         * data. With kernel offload, we no longer hold the keys to send an alert, so
+         * the peer just sees EOF. */
+        if (priv->ktls_state != KTLS_TX)
+          gnutls_bye (priv->tls_session, GNUTLS_SHUT_WR);
         close_from_upstream (tls_protocol, 0, FALSE);
       }
       else
@@ -641,7 +1992,41 @@ process_object_from_upstream (FlowTlsProtocol *tls_protocol, FlowPacket *packet)
     }
     else if (flow_detailed_event_matches (object, FLOW_STREAM_DOMAIN, FLOW_STREAM_FLUSH))
     {
-      /* GNU TLS always syncs */
+      /* Any coalesced data was sent before we got here */
+    }
+  }
+  else if (FLOW_IS_TCP_CONNECT_OP (object))
+  {
+    FlowIPService *remote_service = flow_tcp_connect_op_get_remote_service (object);
+
+    /* Remember who we're connecting to, so we can resume the session later
+     * and verify the server's certificate */
+
+    if (priv->session_key)
+      g_bytes_unref (priv->session_key);
+
+    priv->session_key = remote_service ? make_session_key (remote_service) : NULL;
+
+    g_free (priv->remote_name);
+    priv->remote_name = NULL;
+    priv->remote_name_is_addr = FALSE;
+
+    if (remote_service && flow_ip_service_have_name (remote_service))
+    {
+      priv->remote_name = flow_ip_service_get_name (remote_service);
+    }
+    else if (remote_service)
+    {
+      FlowIPAddr *ip_addr = flow_ip_service_get_nth_address (remote_service, 0);
+
+      /* Without a name, the certificate must be for the address */
+
+      if (ip_addr)
+      {
+        priv->remote_name = flow_ip_addr_get_string (ip_addr);
+        priv->remote_name_is_addr = TRUE;
+        g_object_unref (ip_addr);
+      }
     }
   }
 
@@ -698,6 +2083,23 @@ process_object_from_downstream (FlowTlsProtocol *tls_protocol, FlowPacket *packe
 
       close_from_downstream (tls_protocol, 0, FALSE);
     }
+    else if (priv->ktls_state == KTLS_PENDING &&
+             (flow_detailed_event_matches (object, FLOW_SOCKET_DOMAIN, FLOW_SOCKET_OPTIONS_SET) ||
+              flow_detailed_event_matches (object, FLOW_SOCKET_DOMAIN, FLOW_SOCKET_OPTIONS_FAILED)))
+    {
+      /* Reply to our offload request. If the kernel refused (no tls module,
+       * unsupported cipher), we just keep encrypting in userspace. */
+
+      if (flow_detailed_event_matches (object, FLOW_SOCKET_DOMAIN, FLOW_SOCKET_OPTIONS_SET))
+        priv->ktls_state = KTLS_TX;
+      else
+        priv->ktls_state = KTLS_NONE;
+
+      flow_packet_unref (packet);
+      packet = NULL;
+
+      unblock_from_upstream (tls_protocol);
+    }
   }
 
   if (packet)
@@ -707,7 +2109,8 @@ process_object_from_downstream (FlowTlsProtocol *tls_protocol, FlowPacket *packe
 static void
 process_input_from_upstream (FlowTlsProtocol *tls_protocol, FlowPad *input_pad)
 {
-  FlowTlsProtocolPrivate *priv = tls_protocol->priv;
+  FlowTlsProtocolPrivate *priv    = tls_protocol->priv;
+  FlowElement            *element = (FlowElement *) tls_protocol;
   FlowPacketQueue        *packet_queue;
   FlowPacket             *packet;
   gint                    packet_offset;
@@ -720,8 +2123,17 @@ process_input_from_upstream (FlowTlsProtocol *tls_protocol, FlowPad *input_pad)
   {
     ssize_t result;
 
+    /* The session is busy on a worker thread; we'll be called again when it's done */
+    if (priv->crypto_job)
+      break;
+
     if G_UNLIKELY (flow_packet_get_format (packet) == FLOW_PACKET_FORMAT_OBJECT)
     {
+      /* Objects are ordered with respect to data, so send what we've got.
+       * This also takes care of FLOW_STREAM_FLUSH. */
+      if (priv->session_initialized)
+        flush_record (tls_protocol);
+
       flow_packet_queue_pop_packet (packet_queue);
       process_object_from_upstream (tls_protocol, packet);
     }
@@ -732,6 +2144,37 @@ process_input_from_upstream (FlowTlsProtocol *tls_protocol, FlowPad *input_pad)
 
       g_assert_not_reached ();
     }
+    else if (priv->ktls_state == KTLS_PENDING)
+    {
+      /* Hold data until we know who's encrypting it */
+      break;
+    }
+    else if (priv->ktls_state == KTLS_TX && priv->from_upstream_state == STATE_OPEN)
+    {
+      /* The kernel frames and encrypts, so the shunt can write our buffers as-is */
+
+      if (packet_offset > 0)
+      {
+        /* GnuTLS sent part of this packet before the handover */
+        packet = flow_packet_new (FLOW_PACKET_FORMAT_BUFFER,
+                                  (guint8 *) flow_packet_get_data (packet) + packet_offset,
+                                  flow_packet_get_size (packet) - packet_offset);
+        flow_packet_queue_drop_packet (packet_queue);
+      }
+      else
+      {
+        flow_packet_queue_pop_packet (packet_queue);
+      }
+
+      flow_pad_push (g_ptr_array_index (element->output_pads, DOWNSTREAM_INDEX), packet);
+    }
+    else if (priv->session_threaded && priv->from_upstream_state == STATE_OPEN &&
+             run_crypto_job (tls_protocol))
+    {
+      /* The worker took the data. If it couldn't (e.g. the downstream
+       * half is closed), we encrypt it here instead. */
+      break;
+    }
     else if G_LIKELY (priv->from_upstream_state == STATE_OPEN)
     {
       guint8 *data;
@@ -740,21 +2183,12 @@ process_input_from_upstream (FlowTlsProtocol *tls_protocol, FlowPad *input_pad)
       len  = flow_packet_get_size (packet) - packet_offset;
       data = flow_packet_get_data (packet) + packet_offset;
 
-      result = gnutls_record_send (priv->tls_session, data, len);
+      result = encrypt_from_packet (tls_protocol, data, len);
 
       if (result == len)
-      {
         flow_packet_queue_drop_packet (packet_queue);
-      }
-      else if (result > 0)
-      {
-        flow_packet_queue_pop_bytes_exact (packet_queue, NULL, result);
-      }
       else
-      {
-        /* Send can't fail because our helper always accepts and queues outbound data. */
-        g_assert_not_reached ();
-      }
+        flow_packet_queue_pop_bytes_exact (packet_queue, NULL, result);
     }
     else if (priv->from_upstream_state == STATE_CLOSED)
     {
@@ -779,6 +2213,9 @@ process_input_from_upstream (FlowTlsProtocol *tls_protocol, FlowPad *input_pad)
     if (priv->from_upstream_state == STATE_CLOSING)
       break;
   }
+
+  if (priv->session_initialized)
+    finish_records (tls_protocol);
 }
 
 static void
@@ -797,38 +2234,42 @@ process_input_from_downstream (FlowTlsProtocol *tls_protocol, FlowPad *input_pad
   {
     ssize_t result;
 
+    /* The session is busy on a worker thread; we'll be called again when it's done */
+    if (priv->crypto_job)
+      break;
+
     if G_UNLIKELY (flow_packet_get_format (packet) == FLOW_PACKET_FORMAT_OBJECT)
     {
       flow_packet_queue_pop_packet (packet_queue);
       process_object_from_downstream (tls_protocol, packet);
     }
+    else if (priv->session_threaded && priv->from_downstream_state == STATE_OPEN &&
+             run_crypto_job (tls_protocol))
+    {
+      break;
+    }
     else if G_LIKELY (priv->from_downstream_state == STATE_OPEN)
     {
       guint8 buf [MAX_READ];
 
+      /* Threaded sessions have GnuTLS read from their own queue */
+      if (priv->session_threaded)
+        move_data_packets (packet_queue, priv->ciphertext_in, G_MAXINT);
+
       while ((result = gnutls_record_recv (priv->tls_session, buf, MAX_READ)) > 0)
       {
         packet = flow_packet_new (FLOW_PACKET_FORMAT_BUFFER, buf, result);
         flow_pad_push (g_ptr_array_index (element->output_pads, UPSTREAM_INDEX), packet);
       }
 
-      if (result == 0)
-      {
-        /* Got bye from remote end */
-
-        close_from_downstream (tls_protocol, 0, TRUE);
-      }
-      else if (gnutls_error_is_fatal (result))
-      {
-        /* Crypto error */
-
-        g_print ("[%p] Crypto error (from downstream)\n", tls_protocol);
-
-        close_from_downstream (tls_protocol, result, TRUE);
-      }
+      recv_result (tls_protocol, result);
     }
     else if (priv->from_downstream_state == STATE_OPENING)
     {
+      /* Leave handshake data queued until we have DH parameters */
+      if (priv->waiting_for_dh_params)
+        break;
+
       do_handshake (tls_protocol);
     }
     else if (priv->from_downstream_state == STATE_CLOSED)
@@ -900,6 +2341,8 @@ flow_tls_protocol_init (FlowTlsProtocol *tls_protocol)
 
   priv->from_upstream_state   = STATE_CLOSED;
   priv->from_downstream_state = STATE_CLOSED;
+
+  priv->max_record_size = RECORD_SIZE_MAX;
 }
 
 static void
@@ -915,7 +2358,21 @@ flow_tls_protocol_dispose (FlowTlsProtocol *tls_protocol)
 static void
 flow_tls_protocol_finalize (FlowTlsProtocol *tls_protocol)
 {
+  FlowTlsProtocolPrivate *priv = tls_protocol->priv;
+
   finalize_session (tls_protocol);
+
+  if (priv->session_key)
+    g_bytes_unref (priv->session_key);
+
+  if (priv->credentials)
+    g_object_unref (priv->credentials);
+
+  g_free (priv->remote_name);
+  g_free (priv->record_buf);
+
+  if (priv->ciphertext_in)
+    g_object_unref (priv->ciphertext_in);
 }
 
 /* --- FlowTlsProtocol public API --- */
@@ -925,3 +2382,169 @@ flow_tls_protocol_new (FlowAgentRole agent_role)
 {
   return g_object_new (FLOW_TYPE_TLS_PROTOCOL, "agent-role", agent_role, NULL);
 }
+
+/**
+ * flow_tls_protocol_get_credentials:
+ * @tls_protocol: A #FlowTlsProtocol.
+ *
+ * Gets the X.509 credentials used by @tls_protocol, if any.
+ *
+ * Return value: A #FlowTlsCredentials, or %NULL if anonymous key exchange is used.
+ **/
+FlowTlsCredentials *
+flow_tls_protocol_get_credentials (FlowTlsProtocol *tls_protocol)
+{
+  g_return_val_if_fail (FLOW_IS_TLS_PROTOCOL (tls_protocol), NULL);
+
+  return tls_protocol->priv->credentials;
+}
+
+/**
+ * flow_tls_protocol_set_credentials:
+ * @tls_protocol: A #FlowTlsProtocol.
+ * @tls_credentials: A #FlowTlsCredentials, or %NULL.
+ *
+ * Makes @tls_protocol authenticate with X.509 certificates instead of
+ * anonymous key exchange. The credentials are shared, not copied, so the
+ * same object can be given to any number of elements. Servers present the
+ * certificate from @tls_credentials, and clients verify the server
+ * against its trust anchors and the name of the service connected to.
+ *
+ * Takes effect from the next session.
+ **/
+void
+flow_tls_protocol_set_credentials (FlowTlsProtocol *tls_protocol, FlowTlsCredentials *tls_credentials)
+{
+  FlowTlsProtocolPrivate *priv;
+
+  g_return_if_fail (FLOW_IS_TLS_PROTOCOL (tls_protocol));
+  g_return_if_fail (tls_credentials == NULL || FLOW_IS_TLS_CREDENTIALS (tls_credentials));
+
+  priv = tls_protocol->priv;
+
+  if (tls_credentials)
+    g_object_ref (tls_credentials);
+
+  if (priv->credentials)
+    g_object_unref (priv->credentials);
+
+  priv->credentials = tls_credentials;
+}
+
+/**
+ * flow_tls_protocol_set_dh_params_file:
+ * @path: Path to a file holding PKCS #3 DH parameters in PEM format, or %NULL.
+ *
+ * Sets a file to load server DH parameters from. If the file does not exist
+ * or can't be parsed, parameters will be generated and saved to it, so
+ * subsequent runs can start serving immediately.
+ *
+ * This must be called before the first server session is started, or
+ * before flow_tls_protocol_prepare_server_params () if that is used.
+ **/
+void
+flow_tls_protocol_set_dh_params_file (const gchar *path)
+{
+  g_mutex_lock (&gnutls_mutex);
+
+  g_free (gnutls_dh_parameters_path);
+  gnutls_dh_parameters_path = g_strdup (path);
+
+  g_mutex_unlock (&gnutls_mutex);
+}
+
+/**
+ * flow_tls_protocol_prepare_server_params:
+ *
+ * Loads or starts generating the DH parameters used by server sessions,
+ * without waiting for the first connection to come in. Generation happens
+ * on a separate thread, so this returns immediately. Server handshakes that
+ * begin before the parameters are ready will be postponed until they are.
+ **/
+void
+flow_tls_protocol_prepare_server_params (void)
+{
+  global_ref_gnutls ();
+
+  g_mutex_lock (&gnutls_mutex);
+  start_dh_params ();
+  g_mutex_unlock (&gnutls_mutex);
+
+  global_unref_gnutls ();
+}
+
+/**
+ * flow_tls_protocol_set_session_cache_size:
+ * @max_entries: Maximum number of sessions to remember, or 0 to disable resumption.
+ *
+ * Sets the size of the process-wide caches used for TLS session resumption.
+ * Servers remember up to @max_entries sessions by ID, and clients remember
+ * the last session for up to @max_entries remote services. The least
+ * recently used entries are evicted first.
+ **/
+void
+flow_tls_protocol_set_session_cache_size (guint max_entries)
+{
+  session_cache_set_max_entries (&server_session_cache, max_entries);
+  session_cache_set_max_entries (&client_session_cache, max_entries);
+}
+
+/**
+ * flow_tls_protocol_clear_session_cache:
+ *
+ * Forgets all sessions, forcing full handshakes on subsequent connections.
+ **/
+void
+flow_tls_protocol_clear_session_cache (void)
+{
+  session_cache_clear (&server_session_cache);
+  session_cache_clear (&client_session_cache);
+}
+
+/**
+ * flow_tls_protocol_get_session_cache_stats:
+ * @stats_out: Return location for the statistics.
+ *
+ * Gets the number of handshakes that did and did not resume an earlier
+ * session, since the start of the process.
+ **/
+void
+flow_tls_protocol_get_session_cache_stats (FlowTlsSessionCacheStats *stats_out)
+{
+  g_return_if_fail (stats_out != NULL);
+
+  g_mutex_lock (&server_session_cache.mutex);
+  stats_out->server_hits   = server_session_cache.n_hits;
+  stats_out->server_misses = server_session_cache.n_misses;
+  g_mutex_unlock (&server_session_cache.mutex);
+
+  g_mutex_lock (&client_session_cache.mutex);
+  stats_out->client_hits   = client_session_cache.n_hits;
+  stats_out->client_misses = client_session_cache.n_misses;
+  g_mutex_unlock (&client_session_cache.mutex);
+}
+
+/**
+ * flow_tls_protocol_set_max_crypto_threads:
+ * @max_threads: Maximum number of worker threads, or 0 for one per processor.
+ *
+ * Limits the number of threads used by elements with the
+ * #FlowTlsProtocol:threaded-crypto property set. Those elements run their
+ * handshakes and record encryption on a shared pool of worker threads, and
+ * deliver the results back in their own main context, so a burst of
+ * expensive handshakes doesn't stall other I/O.
+ **/
+void
+flow_tls_protocol_set_max_crypto_threads (guint max_threads)
+{
+  g_mutex_lock (&gnutls_mutex);
+
+  crypto_pool_max_threads = max_threads;
+
+  if (crypto_pool)
+    g_thread_pool_set_max_threads (crypto_pool,
+                                   max_threads > 0 ? (gint) max_threads : (gint) g_get_num_processors (),
+                                   NULL);
+
+  g_mutex_unlock (&gnutls_mutex);
+}
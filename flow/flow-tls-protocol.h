@@ -26,6 +26,7 @@
 #define _FLOW_TLS_PROTOCOL_H
 
 #include <flow/flow-duplex-element.h>
+#include <flow/flow-tls-credentials.h>
 
 G_BEGIN_DECLS
 
@@ -44,6 +45,15 @@ typedef enum
 }
 FlowAgentRole;
 
+typedef struct
+{
+  guint64 server_hits;
+  guint64 server_misses;
+  guint64 client_hits;
+  guint64 client_misses;
+}
+FlowTlsSessionCacheStats;
+
 typedef struct _FlowTlsProtocol        FlowTlsProtocol;
 typedef struct _FlowTlsProtocolPrivate FlowTlsProtocolPrivate;
 typedef struct _FlowTlsProtocolClass   FlowTlsProtocolClass;
@@ -73,6 +83,19 @@ struct _FlowTlsProtocolClass
 
 G_END_DECLS
 
-FlowTlsProtocol *flow_tls_protocol_new (FlowAgentRole agent_role);
+FlowTlsProtocol *flow_tls_protocol_new                   (FlowAgentRole agent_role);
+
+FlowTlsCredentials *flow_tls_protocol_get_credentials    (FlowTlsProtocol *tls_protocol);
+void             flow_tls_protocol_set_credentials       (FlowTlsProtocol *tls_protocol,
+                                                          FlowTlsCredentials *tls_credentials);
+
+void             flow_tls_protocol_set_dh_params_file    (const gchar *path);
+void             flow_tls_protocol_prepare_server_params (void);
+
+void             flow_tls_protocol_set_session_cache_size  (guint max_entries);
+void             flow_tls_protocol_clear_session_cache     (void);
+void             flow_tls_protocol_get_session_cache_stats (FlowTlsSessionCacheStats *stats_out);
+
+void             flow_tls_protocol_set_max_crypto_threads  (guint max_threads);
 
 #endif  /* _FLOW_TLS_PROTOCOL_H */
@@ -32,11 +32,39 @@
 
 struct _FlowTlsTcpIOListenerPrivate
 {
+  guint               threaded_crypto : 1;
+
+  /* Shared by all accepted connections */
+
+  FlowTlsCredentials *credentials;
 };
 
 /* --- FlowTlsTcpIOListener properties --- */
 
+static gboolean
+flow_tls_tcp_io_listener_get_threaded_crypto_internal (FlowTlsTcpIOListener *tls_tcp_io_listener)
+{
+  FlowTlsTcpIOListenerPrivate *priv = tls_tcp_io_listener->priv;
+
+  return priv->threaded_crypto;
+}
+
+static void
+flow_tls_tcp_io_listener_set_threaded_crypto_internal (FlowTlsTcpIOListener *tls_tcp_io_listener,
+                                                       gboolean threaded_crypto)
+{
+  FlowTlsTcpIOListenerPrivate *priv = tls_tcp_io_listener->priv;
+
+  priv->threaded_crypto = threaded_crypto ? TRUE : FALSE;
+}
+
 FLOW_GOBJECT_PROPERTIES_BEGIN (flow_tls_tcp_io_listener)
+FLOW_GOBJECT_PROPERTY_BOOLEAN ("threaded-crypto", "Threaded crypto",
+                               "Whether accepted connections do TLS crypto on worker threads",
+                               G_PARAM_READWRITE,
+                               flow_tls_tcp_io_listener_get_threaded_crypto_internal,
+                               flow_tls_tcp_io_listener_set_threaded_crypto_internal,
+                               FALSE)
 FLOW_GOBJECT_PROPERTIES_END   ()
 
 /* --- FlowTlsTcpIOListener definition --- */
@@ -73,14 +101,19 @@ flow_tls_tcp_io_listener_dispose (FlowTlsTcpIOListener *tls_tcp_io_listener)
 static void
 flow_tls_tcp_io_listener_finalize (FlowTlsTcpIOListener *tls_tcp_io_listener)
 {
+  FlowTlsTcpIOListenerPrivate *priv = tls_tcp_io_listener->priv;
+
+  if (priv->credentials)
+    g_object_unref (priv->credentials);
 }
 
 static FlowTlsTcpIO *
-setup_tls_tcp_io (FlowElement *tcp_connector)
+setup_tls_tcp_io (FlowTlsTcpIOListener *tls_tcp_io_listener, FlowElement *tcp_connector)
 {
-  FlowTlsTcpIO *tls_tcp_io;
-  FlowBin      *bin;
-  FlowElement  *tls_protocol;
+  FlowTlsTcpIOListenerPrivate *priv = tls_tcp_io_listener->priv;
+  FlowTlsTcpIO                *tls_tcp_io;
+  FlowBin                     *bin;
+  FlowElement                 *tls_protocol;
 
   tls_tcp_io = flow_tls_tcp_io_new ();
   bin        = FLOW_BIN (tls_tcp_io);
@@ -93,6 +126,8 @@ setup_tls_tcp_io (FlowElement *tcp_connector)
   /* Replace the FlowTlsProtocol in tls_tcp_io's bin */
 
   tls_protocol = (FlowElement *) flow_tls_protocol_new (FLOW_AGENT_ROLE_SERVER);
+  g_object_set (tls_protocol, "threaded-crypto", priv->threaded_crypto, NULL);
+  flow_tls_protocol_set_credentials (FLOW_TLS_PROTOCOL (tls_protocol), priv->credentials);
   flow_tls_tcp_io_set_tls_protocol (tls_tcp_io, FLOW_TLS_PROTOCOL (tls_protocol));
   g_object_unref (tls_protocol);
 
@@ -107,6 +142,51 @@ flow_tls_tcp_io_listener_new (void)
   return g_object_new (FLOW_TYPE_TLS_TCP_IO_LISTENER, NULL);
 }
 
+/**
+ * flow_tls_tcp_io_listener_get_credentials:
+ * @tls_tcp_io_listener: A #FlowTlsTcpIOListener.
+ *
+ * Gets the credentials presented by accepted connections.
+ *
+ * Return value: A #FlowTlsCredentials, or %NULL if connections use anonymous key exchange.
+ **/
+FlowTlsCredentials *
+flow_tls_tcp_io_listener_get_credentials (FlowTlsTcpIOListener *tls_tcp_io_listener)
+{
+  g_return_val_if_fail (FLOW_IS_TLS_TCP_IO_LISTENER (tls_tcp_io_listener), NULL);
+
+  return tls_tcp_io_listener->priv->credentials;
+}
+
+/**
+ * flow_tls_tcp_io_listener_set_credentials:
+ * @tls_tcp_io_listener: A #FlowTlsTcpIOListener.
+ * @tls_credentials:     A #FlowTlsCredentials holding a server certificate, or %NULL.
+ *
+ * Sets the certificate credentials for connections accepted from now on.
+ * The credentials are loaded once and shared by all connections, so
+ * accepting a connection doesn't involve parsing or allocating them.
+ **/
+void
+flow_tls_tcp_io_listener_set_credentials (FlowTlsTcpIOListener *tls_tcp_io_listener,
+                                          FlowTlsCredentials *tls_credentials)
+{
+  FlowTlsTcpIOListenerPrivate *priv;
+
+  g_return_if_fail (FLOW_IS_TLS_TCP_IO_LISTENER (tls_tcp_io_listener));
+  g_return_if_fail (tls_credentials == NULL || FLOW_IS_TLS_CREDENTIALS (tls_credentials));
+
+  priv = tls_tcp_io_listener->priv;
+
+  if (tls_credentials)
+    g_object_ref (tls_credentials);
+
+  if (priv->credentials)
+    g_object_unref (priv->credentials);
+
+  priv->credentials = tls_credentials;
+}
+
 FlowTlsTcpIO *
 flow_tls_tcp_io_listener_pop_connection (FlowTlsTcpIOListener *tls_tcp_io_listener)
 {
@@ -118,7 +198,7 @@ flow_tls_tcp_io_listener_pop_connection (FlowTlsTcpIOListener *tls_tcp_io_listen
   if (!tcp_connector)
     return NULL;
 
-  return setup_tls_tcp_io (tcp_connector);
+  return setup_tls_tcp_io (tls_tcp_io_listener, tcp_connector);
 }
 
 FlowTlsTcpIO *
@@ -132,5 +212,5 @@ flow_tls_tcp_io_listener_sync_pop_connection (FlowTlsTcpIOListener *tls_tcp_io_l
   if (!tcp_connector)
     return NULL;
 
-  return setup_tls_tcp_io (tcp_connector);
+  return setup_tls_tcp_io (tls_tcp_io_listener, tcp_connector);
 }
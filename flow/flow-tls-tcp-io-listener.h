@@ -68,6 +68,10 @@ struct _FlowTlsTcpIOListenerClass
 
 FlowTlsTcpIOListener  *flow_tls_tcp_io_listener_new                 (void);
 
+FlowTlsCredentials    *flow_tls_tcp_io_listener_get_credentials     (FlowTlsTcpIOListener *tls_tcp_io_listener);
+void                   flow_tls_tcp_io_listener_set_credentials     (FlowTlsTcpIOListener *tls_tcp_io_listener,
+                                                                     FlowTlsCredentials *tls_credentials);
+
 FlowTlsTcpIO          *flow_tls_tcp_io_listener_pop_connection      (FlowTlsTcpIOListener *tls_tcp_io_listener);
 FlowTlsTcpIO          *flow_tls_tcp_io_listener_sync_pop_connection (FlowTlsTcpIOListener *tls_tcp_io_listener);
 
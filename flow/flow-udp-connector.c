@@ -33,6 +33,9 @@
 #define MAX_BUFFER_PACKETS (32 * 8)
 #define MAX_BUFFER_BYTES   (16384 * 8)
 
+/* Implemented in flow-shunt.c */
+void _flow_shunt_splice_from_queue (FlowShunt *shunt, FlowPacketQueue *packet_queue);
+
 static void        shunt_read  (FlowShunt *shunt, FlowPacket *packet, FlowUdpConnector *udp_connector);
 static FlowPacket *shunt_write (FlowShunt *shunt, FlowUdpConnector *udp_connector);
 
@@ -46,11 +49,36 @@ struct _FlowUdpConnectorPrivate
   FlowIPService    *remote_service;
 
   FlowShunt        *shunt;
+  gboolean          shunt_writes_unblocked;  /* Cached; avoids taking the shunt lock */
+
+  gboolean          peer_tagged;
 };
 
 /* --- FlowUdpConnector properties --- */
 
+static gboolean
+flow_udp_connector_get_peer_tagged_internal (FlowUdpConnector *udp_connector)
+{
+  FlowUdpConnectorPrivate *priv = udp_connector->priv;
+
+  return priv->peer_tagged;
+}
+
+static void
+flow_udp_connector_set_peer_tagged_internal (FlowUdpConnector *udp_connector, gboolean peer_tagged)
+{
+  FlowUdpConnectorPrivate *priv = udp_connector->priv;
+
+  priv->peer_tagged = peer_tagged;
+}
+
 FLOW_GOBJECT_PROPERTIES_BEGIN (flow_udp_connector)
+FLOW_GOBJECT_PROPERTY_BOOLEAN ("peer-tagged", "Peer tagged",
+                               "Whether each datagram is prefixed with its peer's FlowIPEndpoint",
+                               G_PARAM_READWRITE,
+                               flow_udp_connector_get_peer_tagged_internal,
+                               flow_udp_connector_set_peer_tagged_internal,
+                               FALSE)
 FLOW_GOBJECT_PROPERTIES_END   ()
 
 /* --- FlowUdpConnector definition --- */
@@ -68,6 +96,7 @@ setup_shunt (FlowUdpConnector *udp_connector)
 
   flow_shunt_set_read_func (priv->shunt, (FlowShuntReadFunc *) shunt_read, udp_connector);
   flow_shunt_set_write_func (priv->shunt, (FlowShuntWriteFunc *) shunt_write, udp_connector);
+  priv->shunt_writes_unblocked = TRUE;
 
   flow_shunt_set_io_buffer_size (priv->shunt, flow_connector_get_io_buffer_size (connector));
   flow_shunt_set_queue_limit (priv->shunt, flow_connector_get_read_queue_limit (connector));
@@ -122,7 +151,13 @@ setup_local_service (FlowUdpConnector *udp_connector)
 
   set_remote_service (udp_connector, flow_udp_connect_op_get_remote_service (priv->op));
 
-  priv->shunt = flow_open_udp_port (flow_udp_connect_op_get_local_service (priv->op));
+  /* In peer-tagged mode, the shunt takes destinations from the datagrams
+   * themselves. Takes effect on the next stream. */
+
+  if (priv->peer_tagged)
+    priv->shunt = flow_open_udp_server_port (flow_udp_connect_op_get_local_service (priv->op));
+  else
+    priv->shunt = flow_open_udp_port (flow_udp_connect_op_get_local_service (priv->op));
 
   setup_shunt (udp_connector);
   flow_connector_set_state_internal (FLOW_CONNECTOR (udp_connector), FLOW_CONNECTIVITY_CONNECTING);
@@ -130,7 +165,7 @@ setup_local_service (FlowUdpConnector *udp_connector)
   /* If a remote service was specified by the connect op, pass it along to the shunt right
    * after the STREAM_BEGIN event. */
 
-  if (priv->remote_service)
+  if (priv->remote_service && !priv->peer_tagged)
   {
     FlowInputPad    *input_pad    = flow_simplex_element_get_input_pad (FLOW_SIMPLEX_ELEMENT (udp_connector));
     FlowPacketQueue *packet_queue = flow_pad_get_packet_queue (FLOW_PAD (input_pad));
@@ -252,9 +287,10 @@ shunt_read (FlowShunt *shunt, FlowPacket *packet, FlowUdpConnector *udp_connecto
 static FlowPacket *
 shunt_write (FlowShunt *shunt, FlowUdpConnector *udp_connector)
 {
-  FlowPad         *input_pad;
-  FlowPacketQueue *packet_queue;
-  FlowPacket      *packet;
+  FlowUdpConnectorPrivate *priv = udp_connector->priv;
+  FlowPad                 *input_pad;
+  FlowPacketQueue         *packet_queue;
+  FlowPacket              *packet;
 
   input_pad = FLOW_PAD (flow_simplex_element_get_input_pad (FLOW_SIMPLEX_ELEMENT (udp_connector)));
   packet_queue = flow_pad_get_packet_queue (input_pad);
@@ -268,6 +304,7 @@ shunt_write (FlowShunt *shunt, FlowUdpConnector *udp_connector)
 
   if (!packet_queue || flow_packet_queue_get_length_packets (packet_queue) == 0)
   {
+    priv->shunt_writes_unblocked = FALSE;
     flow_shunt_block_writes (shunt);
     return NULL;
   }
@@ -312,15 +349,22 @@ flow_udp_connector_process_input (FlowUdpConnector *udp_connector, FlowPad *inpu
       flow_packet_unref (packet);
   }
 
+  if (priv->shunt)
+    _flow_shunt_splice_from_queue (priv->shunt, packet_queue);
+
   if (flow_packet_queue_get_length_bytes (packet_queue) >= MAX_BUFFER_BYTES ||
       flow_packet_queue_get_length_packets (packet_queue) >= MAX_BUFFER_PACKETS)
   {
     flow_pad_block (input_pad);
   }
 
-  if (priv->shunt)
+  /* Whatever couldn't be spliced is pulled by shunt_write (). Only wake it
+   * up if it went to sleep, since that takes the shunt lock. */
+
+  if (priv->shunt && !priv->shunt_writes_unblocked &&
+      flow_packet_queue_get_length_packets (packet_queue) > 0)
   {
-    /* FIXME: The shunt's locking might be a performance liability. We could cache the state. */
+    priv->shunt_writes_unblocked = TRUE;
     flow_shunt_unblock_writes (priv->shunt);
   }
 }
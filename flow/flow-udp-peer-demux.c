@@ -0,0 +1,360 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* flow-udp-peer-demux.c - Routes peer-tagged UDP datagrams to per-peer pads.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+
+#include "config.h"
+
+#include <string.h>
+#include "flow-util.h"
+#include "flow-gobject-util.h"
+#include "flow-udp-peer-demux.h"
+
+/* --- FlowUdpPeerDemux private data --- */
+
+struct _FlowUdpPeerDemuxPrivate
+{
+  /* FlowIPEndpoint -> FlowOutputPad. The pads are owned by the splitter. */
+  GHashTable     *pads_by_peer;
+
+  /* Datagrams tend to arrive in runs from the same peer, so remember
+   * the last lookup */
+  FlowIPEndpoint  current_peer;
+  FlowOutputPad  *current_pad;
+  gboolean        have_current_peer;
+};
+
+/* --- FlowUdpPeerDemux properties --- */
+
+FLOW_GOBJECT_PROPERTIES_BEGIN (flow_udp_peer_demux)
+FLOW_GOBJECT_PROPERTIES_END   ()
+
+/* --- FlowUdpPeerDemux definition --- */
+
+FLOW_GOBJECT_MAKE_IMPL        (flow_udp_peer_demux, FlowUdpPeerDemux, FLOW_TYPE_SPLITTER, 0)
+
+/* --- FlowUdpPeerDemux implementation --- */
+
+static void
+free_endpoint (FlowIPEndpoint *endpoint)
+{
+  g_slice_free (FlowIPEndpoint, endpoint);
+}
+
+static FlowOutputPad *
+lookup_peer (FlowUdpPeerDemux *udp_peer_demux, const FlowIPEndpoint *peer)
+{
+  FlowUdpPeerDemuxPrivate *priv = udp_peer_demux->priv;
+
+  if G_LIKELY (priv->have_current_peer && flow_ip_endpoint_equal (peer, &priv->current_peer))
+    return priv->current_pad;
+
+  priv->current_pad       = g_hash_table_lookup (priv->pads_by_peer, peer);
+  priv->current_peer      = *peer;
+  priv->have_current_peer = TRUE;
+
+  return priv->current_pad;
+}
+
+static void
+broadcast_packet (FlowElement *element, FlowPacket *packet)
+{
+  FlowPad *last_pad = NULL;
+  guint    i;
+
+  for (i = 0; i < element->output_pads->len; i++)
+  {
+    FlowPad *pad = g_ptr_array_index (element->output_pads, i);
+
+    if (!pad)
+      continue;
+
+    if (last_pad)
+      flow_pad_push (last_pad, flow_packet_ref (packet));
+
+    last_pad = pad;
+  }
+
+  if (last_pad)
+    flow_pad_push (last_pad, packet);
+  else
+    flow_packet_unref (packet);
+}
+
+static void
+flow_udp_peer_demux_process_input (FlowUdpPeerDemux *udp_peer_demux, FlowPad *input_pad)
+{
+  FlowElement     *element      = FLOW_ELEMENT (udp_peer_demux);
+  FlowPacketQueue *packet_queue = flow_pad_get_packet_queue (input_pad);
+  FlowPacket      *packet;
+
+  while ((packet = flow_packet_queue_pop_packet (packet_queue)) != NULL)
+  {
+    FlowIPEndpoint  peer;
+    FlowOutputPad  *output_pad;
+    guint           size;
+
+    if (flow_packet_get_format (packet) == FLOW_PACKET_FORMAT_OBJECT)
+    {
+      /* Stream events concern every peer */
+
+      if (!flow_handle_universal_events (element, packet))
+        broadcast_packet (element, packet);
+
+      continue;
+    }
+
+    if (!flow_udp_peer_packet_get_peer (packet, &peer))
+    {
+      flow_packet_unref (packet);
+      continue;
+    }
+
+    output_pad = lookup_peer (udp_peer_demux, &peer);
+
+    if G_UNLIKELY (!output_pad)
+    {
+      /* Give the application a chance to add the peer */
+
+      g_signal_emit_by_name (udp_peer_demux, "new-peer", &peer);
+      udp_peer_demux->priv->have_current_peer = FALSE;
+      output_pad = lookup_peer (udp_peer_demux, &peer);
+    }
+
+    if (!output_pad)
+    {
+      flow_packet_unref (packet);
+      continue;
+    }
+
+    /* Strip the address; per-peer pads get plain datagrams */
+
+    size = flow_packet_get_size (packet);
+    flow_pad_push (FLOW_PAD (output_pad),
+                   flow_packet_new_slice (packet, sizeof (FlowIPEndpoint), size - sizeof (FlowIPEndpoint)));
+    flow_packet_unref (packet);
+  }
+}
+
+static void
+flow_udp_peer_demux_type_init (GType type)
+{
+}
+
+static void
+flow_udp_peer_demux_class_init (FlowUdpPeerDemuxClass *klass)
+{
+  FlowElementClass *element_klass = (FlowElementClass *) klass;
+  GType             param_types [1] = { G_TYPE_POINTER };
+
+  element_klass->process_input = (void (*) (FlowElement *, FlowPad *)) flow_udp_peer_demux_process_input;
+
+  /* Emitted with a (const FlowIPEndpoint *) when a datagram arrives from a
+   * peer that has no pad. Handlers may call flow_udp_peer_demux_add_peer ();
+   * otherwise the datagram is dropped. */
+
+  g_signal_newv ("new-peer",
+                 G_TYPE_FROM_CLASS (klass),
+                 G_SIGNAL_RUN_LAST | G_SIGNAL_NO_HOOKS,
+                 NULL,                                   /* Class closure */
+                 NULL, NULL,                             /* Accumulator, accu data */
+                 g_cclosure_marshal_VOID__POINTER,       /* Marshaller */
+                 G_TYPE_NONE,                            /* Return type */
+                 1, param_types);                        /* Number of params, param types */
+}
+
+static void
+flow_udp_peer_demux_init (FlowUdpPeerDemux *udp_peer_demux)
+{
+  FlowUdpPeerDemuxPrivate *priv = udp_peer_demux->priv;
+
+  priv->pads_by_peer = g_hash_table_new_full (flow_ip_endpoint_hash, flow_ip_endpoint_equal,
+                                              (GDestroyNotify) free_endpoint, NULL);
+}
+
+static void
+flow_udp_peer_demux_construct (FlowUdpPeerDemux *udp_peer_demux)
+{
+}
+
+static void
+flow_udp_peer_demux_dispose (FlowUdpPeerDemux *udp_peer_demux)
+{
+}
+
+static void
+flow_udp_peer_demux_finalize (FlowUdpPeerDemux *udp_peer_demux)
+{
+  FlowUdpPeerDemuxPrivate *priv = udp_peer_demux->priv;
+
+  g_hash_table_destroy (priv->pads_by_peer);
+}
+
+/* --- FlowUdpPeerDemux public API --- */
+
+/**
+ * flow_udp_peer_demux_new:
+ *
+ * Creates a new #FlowUdpPeerDemux. Its input takes peer-tagged datagrams,
+ * as read by a #FlowUdpConnector with the "peer-tagged" property set, and
+ * each datagram is passed on to the output pad for its peer with the
+ * address removed. Other packets are passed to all output pads.
+ *
+ * Return value: A new #FlowUdpPeerDemux.
+ **/
+FlowUdpPeerDemux *
+flow_udp_peer_demux_new (void)
+{
+  return g_object_new (FLOW_TYPE_UDP_PEER_DEMUX, NULL);
+}
+
+/**
+ * flow_udp_peer_demux_add_peer:
+ * @udp_peer_demux: A #FlowUdpPeerDemux.
+ * @peer:           The peer's address and port.
+ *
+ * Adds an output pad for datagrams from @peer. If @peer already has a pad,
+ * that pad is returned.
+ *
+ * Return value: The #FlowOutputPad for @peer.
+ **/
+FlowOutputPad *
+flow_udp_peer_demux_add_peer (FlowUdpPeerDemux *udp_peer_demux, const FlowIPEndpoint *peer)
+{
+  FlowUdpPeerDemuxPrivate *priv;
+  FlowOutputPad           *output_pad;
+
+  g_return_val_if_fail (FLOW_IS_UDP_PEER_DEMUX (udp_peer_demux), NULL);
+  g_return_val_if_fail (peer != NULL, NULL);
+
+  priv = udp_peer_demux->priv;
+
+  output_pad = g_hash_table_lookup (priv->pads_by_peer, peer);
+  if (output_pad)
+    return output_pad;
+
+  output_pad = flow_splitter_add_output_pad (FLOW_SPLITTER (udp_peer_demux));
+  g_hash_table_insert (priv->pads_by_peer, g_slice_dup (FlowIPEndpoint, peer), output_pad);
+  priv->have_current_peer = FALSE;
+
+  return output_pad;
+}
+
+/**
+ * flow_udp_peer_demux_remove_peer:
+ * @udp_peer_demux: A #FlowUdpPeerDemux.
+ * @peer:           The peer's address and port.
+ *
+ * Removes the output pad for @peer. Datagrams from @peer will cause
+ * "new-peer" to be emitted again.
+ **/
+void
+flow_udp_peer_demux_remove_peer (FlowUdpPeerDemux *udp_peer_demux, const FlowIPEndpoint *peer)
+{
+  FlowUdpPeerDemuxPrivate *priv;
+  FlowOutputPad           *output_pad;
+
+  g_return_if_fail (FLOW_IS_UDP_PEER_DEMUX (udp_peer_demux));
+  g_return_if_fail (peer != NULL);
+
+  priv = udp_peer_demux->priv;
+
+  output_pad = g_hash_table_lookup (priv->pads_by_peer, peer);
+  if (!output_pad)
+    return;
+
+  g_hash_table_remove (priv->pads_by_peer, peer);
+  priv->have_current_peer = FALSE;
+
+  flow_splitter_remove_output_pad (FLOW_SPLITTER (udp_peer_demux), output_pad);
+}
+
+FlowOutputPad *
+flow_udp_peer_demux_lookup_peer (FlowUdpPeerDemux *udp_peer_demux, const FlowIPEndpoint *peer)
+{
+  g_return_val_if_fail (FLOW_IS_UDP_PEER_DEMUX (udp_peer_demux), NULL);
+  g_return_val_if_fail (peer != NULL, NULL);
+
+  return g_hash_table_lookup (udp_peer_demux->priv->pads_by_peer, peer);
+}
+
+guint
+flow_udp_peer_demux_get_n_peers (FlowUdpPeerDemux *udp_peer_demux)
+{
+  g_return_val_if_fail (FLOW_IS_UDP_PEER_DEMUX (udp_peer_demux), 0);
+
+  return g_hash_table_size (udp_peer_demux->priv->pads_by_peer);
+}
+
+/**
+ * flow_udp_peer_packet_new:
+ * @peer: The destination address and port.
+ * @data: Datagram payload.
+ * @len:  Length of @data in bytes.
+ *
+ * Creates a peer-tagged datagram packet for writing to a #FlowUdpConnector
+ * with the "peer-tagged" property set. Consecutive packets may go to
+ * different peers without breaking up send batches.
+ *
+ * Return value: A new #FlowPacket.
+ **/
+FlowPacket *
+flow_udp_peer_packet_new (const FlowIPEndpoint *peer, gconstpointer data, guint len)
+{
+  FlowPacket *packet;
+  guint8     *p;
+
+  g_return_val_if_fail (peer != NULL, NULL);
+  g_return_val_if_fail (data != NULL || len == 0, NULL);
+
+  packet = flow_packet_alloc_for_data (sizeof (FlowIPEndpoint) + len, (gpointer *) &p);
+  memcpy (p, peer, sizeof (FlowIPEndpoint));
+
+  if (len > 0)
+    memcpy (p + sizeof (FlowIPEndpoint), data, len);
+
+  return packet;
+}
+
+/**
+ * flow_udp_peer_packet_get_peer:
+ * @packet:   A peer-tagged datagram packet.
+ * @peer_out: Return location for the peer's address and port.
+ *
+ * Gets the peer a datagram was received from or is going to.
+ *
+ * Return value: %TRUE if @packet is a well-formed peer-tagged datagram.
+ **/
+gboolean
+flow_udp_peer_packet_get_peer (FlowPacket *packet, FlowIPEndpoint *peer_out)
+{
+  g_return_val_if_fail (packet != NULL, FALSE);
+  g_return_val_if_fail (peer_out != NULL, FALSE);
+
+  if (flow_packet_get_format (packet) != FLOW_PACKET_FORMAT_BUFFER ||
+      flow_packet_get_size (packet) < sizeof (FlowIPEndpoint))
+    return FALSE;
+
+  memcpy (peer_out, flow_packet_get_data (packet), sizeof (FlowIPEndpoint));
+  return TRUE;
+}
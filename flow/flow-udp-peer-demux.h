@@ -0,0 +1,81 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* flow-udp-peer-demux.h - Routes peer-tagged UDP datagrams to per-peer pads.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+
+#ifndef _FLOW_UDP_PEER_DEMUX_H
+#define _FLOW_UDP_PEER_DEMUX_H
+
+#include <flow/flow-splitter.h>
+#include <flow/flow-ip-endpoint.h>
+
+G_BEGIN_DECLS
+
+#define FLOW_TYPE_UDP_PEER_DEMUX            (flow_udp_peer_demux_get_type ())
+#define FLOW_UDP_PEER_DEMUX(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), FLOW_TYPE_UDP_PEER_DEMUX, FlowUdpPeerDemux))
+#define FLOW_UDP_PEER_DEMUX_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), FLOW_TYPE_UDP_PEER_DEMUX, FlowUdpPeerDemuxClass))
+#define FLOW_IS_UDP_PEER_DEMUX(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), FLOW_TYPE_UDP_PEER_DEMUX))
+#define FLOW_IS_UDP_PEER_DEMUX_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), FLOW_TYPE_UDP_PEER_DEMUX))
+#define FLOW_UDP_PEER_DEMUX_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), FLOW_TYPE_UDP_PEER_DEMUX, FlowUdpPeerDemuxClass))
+GType   flow_udp_peer_demux_get_type        (void) G_GNUC_CONST;
+
+typedef struct _FlowUdpPeerDemux        FlowUdpPeerDemux;
+typedef struct _FlowUdpPeerDemuxPrivate FlowUdpPeerDemuxPrivate;
+typedef struct _FlowUdpPeerDemuxClass   FlowUdpPeerDemuxClass;
+
+struct _FlowUdpPeerDemux
+{
+  FlowSplitter parent;
+
+  /*< private >*/
+
+  FlowUdpPeerDemuxPrivate *priv;
+};
+
+struct _FlowUdpPeerDemuxClass
+{
+  FlowSplitterClass parent_class;
+
+  /*< private >*/
+
+  /* Padding for future expansion */
+
+  void (*_pad_1) (void);
+  void (*_pad_2) (void);
+  void (*_pad_3) (void);
+  void (*_pad_4) (void);
+};
+
+FlowUdpPeerDemux *flow_udp_peer_demux_new           (void);
+
+FlowOutputPad    *flow_udp_peer_demux_add_peer      (FlowUdpPeerDemux *udp_peer_demux, const FlowIPEndpoint *peer);
+void              flow_udp_peer_demux_remove_peer   (FlowUdpPeerDemux *udp_peer_demux, const FlowIPEndpoint *peer);
+FlowOutputPad    *flow_udp_peer_demux_lookup_peer   (FlowUdpPeerDemux *udp_peer_demux, const FlowIPEndpoint *peer);
+guint             flow_udp_peer_demux_get_n_peers   (FlowUdpPeerDemux *udp_peer_demux);
+
+FlowPacket       *flow_udp_peer_packet_new          (const FlowIPEndpoint *peer, gconstpointer data, guint len);
+gboolean          flow_udp_peer_packet_get_peer     (FlowPacket *packet, FlowIPEndpoint *peer_out);
+
+G_END_DECLS
+
+#endif  /* _FLOW_UDP_PEER_DEMUX_H */
@@ -0,0 +1,201 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* flow-unix-connect-op.c - Operation: Connect to a Unix domain socket.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+#include "config.h"
+
+#include "flow-gobject-util.h"
+#include "flow-event.h"
+#include "flow-enum-types.h"
+#include "flow-unix-connect-op.h"
+
+/* --- FlowUnixConnectOp private data --- */
+
+struct _FlowUnixConnectOpPrivate
+{
+  gchar              *path;
+  FlowUnixSocketType  socket_type;
+};
+
+/* --- FlowUnixConnectOp properties --- */
+
+static gchar *
+flow_unix_connect_op_get_path_internal (FlowUnixConnectOp *unix_connect_op)
+{
+  FlowUnixConnectOpPrivate *priv = unix_connect_op->priv;
+
+  return g_strdup (priv->path);
+}
+
+static void
+flow_unix_connect_op_set_path_internal (FlowUnixConnectOp *unix_connect_op, const gchar *path)
+{
+  FlowUnixConnectOpPrivate *priv = unix_connect_op->priv;
+
+  g_assert (priv->path == NULL);
+  priv->path = g_strdup (path);
+}
+
+static FlowUnixSocketType
+flow_unix_connect_op_get_socket_type_internal (FlowUnixConnectOp *unix_connect_op)
+{
+  FlowUnixConnectOpPrivate *priv = unix_connect_op->priv;
+
+  return priv->socket_type;
+}
+
+static void
+flow_unix_connect_op_set_socket_type_internal (FlowUnixConnectOp *unix_connect_op, FlowUnixSocketType socket_type)
+{
+  FlowUnixConnectOpPrivate *priv = unix_connect_op->priv;
+
+  priv->socket_type = socket_type;
+}
+
+FLOW_GOBJECT_PROPERTIES_BEGIN (flow_unix_connect_op)
+FLOW_GOBJECT_PROPERTY_STRING  ("path", "Socket Path", "Path of the Unix domain socket to connect to",
+                               G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY,
+                               flow_unix_connect_op_get_path_internal,
+                               flow_unix_connect_op_set_path_internal,
+                               NULL)
+FLOW_GOBJECT_PROPERTY_ENUM    ("socket-type", "Socket Type", "Stream or seqpacket socket",
+                               G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY,
+                               flow_unix_connect_op_get_socket_type_internal,
+                               flow_unix_connect_op_set_socket_type_internal,
+                               FLOW_UNIX_SOCKET_STREAM,
+                               flow_unix_socket_type_get_type)
+FLOW_GOBJECT_PROPERTIES_END   ()
+
+/* --- FlowUnixConnectOp definition --- */
+
+FLOW_GOBJECT_MAKE_IMPL        (flow_unix_connect_op, FlowUnixConnectOp, FLOW_TYPE_EVENT, 0)
+
+/* --- FlowUnixConnectOp implementation --- */
+
+static void
+flow_unix_connect_op_update_description (FlowUnixConnectOp *unix_connect_op)
+{
+  FlowUnixConnectOpPrivate *priv  = unix_connect_op->priv;
+  FlowEvent                *event = FLOW_EVENT (unix_connect_op);
+
+  if (event->description)
+    return;
+
+  event->description = g_strdup_printf ("Connect to Unix %s socket '%s'",
+                                        priv->socket_type == FLOW_UNIX_SOCKET_SEQPACKET ? "seqpacket" : "stream",
+                                        priv->path);
+}
+
+static void
+flow_unix_connect_op_type_init (GType type)
+{
+}
+
+static void
+flow_unix_connect_op_class_init (FlowUnixConnectOpClass *klass)
+{
+  FlowEventClass *event_klass = FLOW_EVENT_CLASS (klass);
+
+  event_klass->update_description = (void (*) (FlowEvent *)) flow_unix_connect_op_update_description;
+}
+
+static void
+flow_unix_connect_op_init (FlowUnixConnectOp *unix_connect_op)
+{
+}
+
+static void
+flow_unix_connect_op_construct (FlowUnixConnectOp *unix_connect_op)
+{
+  FlowUnixConnectOpPrivate *priv = unix_connect_op->priv;
+
+  g_assert (priv->path != NULL);
+}
+
+static void
+flow_unix_connect_op_dispose (FlowUnixConnectOp *unix_connect_op)
+{
+}
+
+static void
+flow_unix_connect_op_finalize (FlowUnixConnectOp *unix_connect_op)
+{
+  FlowUnixConnectOpPrivate *priv = unix_connect_op->priv;
+
+  g_free (priv->path);
+  priv->path = NULL;
+}
+
+/* --- FlowUnixConnectOp public API --- */
+
+/**
+ * flow_unix_connect_op_new:
+ * @path:        Path of the socket to connect to. On Linux, a leading '@'
+ *               denotes a name in the abstract namespace.
+ * @socket_type: Whether to connect a stream or a seqpacket socket.
+ *
+ * Creates a new #FlowUnixConnectOp.
+ *
+ * Return value: A new #FlowUnixConnectOp.
+ **/
+FlowUnixConnectOp *
+flow_unix_connect_op_new (const gchar *path, FlowUnixSocketType socket_type)
+{
+  g_return_val_if_fail (path != NULL, NULL);
+
+  return g_object_new (FLOW_TYPE_UNIX_CONNECT_OP,
+                       "path",        path,
+                       "socket-type", socket_type,
+                       NULL);
+}
+
+/**
+ * flow_unix_connect_op_get_path:
+ * @unix_connect_op: A #FlowUnixConnectOp.
+ *
+ * Returns the path of the socket to connect to. The string belongs to
+ * @unix_connect_op, and should not be freed.
+ *
+ * Return value: The socket path.
+ **/
+const gchar *
+flow_unix_connect_op_get_path (FlowUnixConnectOp *unix_connect_op)
+{
+  FlowUnixConnectOpPrivate *priv;
+
+  g_return_val_if_fail (FLOW_IS_UNIX_CONNECT_OP (unix_connect_op), NULL);
+
+  priv = unix_connect_op->priv;
+  return priv->path;
+}
+
+FlowUnixSocketType
+flow_unix_connect_op_get_socket_type (FlowUnixConnectOp *unix_connect_op)
+{
+  FlowUnixConnectOpPrivate *priv;
+
+  g_return_val_if_fail (FLOW_IS_UNIX_CONNECT_OP (unix_connect_op), FLOW_UNIX_SOCKET_STREAM);
+
+  priv = unix_connect_op->priv;
+  return priv->socket_type;
+}
@@ -0,0 +1,70 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* flow-unix-connect-op.h - Operation: Connect to a Unix domain socket.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+#ifndef _FLOW_UNIX_CONNECT_OP_H
+#define _FLOW_UNIX_CONNECT_OP_H
+
+#include <flow/flow-event.h>
+#include <flow/flow-shunt.h>
+
+#define FLOW_TYPE_UNIX_CONNECT_OP            (flow_unix_connect_op_get_type ())
+#define FLOW_UNIX_CONNECT_OP(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), FLOW_TYPE_UNIX_CONNECT_OP, FlowUnixConnectOp))
+#define FLOW_UNIX_CONNECT_OP_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), FLOW_TYPE_UNIX_CONNECT_OP, FlowUnixConnectOpClass))
+#define FLOW_IS_UNIX_CONNECT_OP(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), FLOW_TYPE_UNIX_CONNECT_OP))
+#define FLOW_IS_UNIX_CONNECT_OP_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), FLOW_TYPE_UNIX_CONNECT_OP))
+#define FLOW_UNIX_CONNECT_OP_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), FLOW_TYPE_UNIX_CONNECT_OP, FlowUnixConnectOpClass))
+GType   flow_unix_connect_op_get_type        (void) G_GNUC_CONST;
+
+typedef struct _FlowUnixConnectOp        FlowUnixConnectOp;
+typedef struct _FlowUnixConnectOpPrivate FlowUnixConnectOpPrivate;
+typedef struct _FlowUnixConnectOpClass   FlowUnixConnectOpClass;
+
+struct _FlowUnixConnectOp
+{
+  FlowEvent   parent;
+
+  /*< private >*/
+
+  FlowUnixConnectOpPrivate *priv;
+};
+
+struct _FlowUnixConnectOpClass
+{
+  FlowEventClass parent_class;
+
+  /*< private >*/
+
+  /* Padding for future expansion */
+  void (*_pad_1) (void);
+  void (*_pad_2) (void);
+  void (*_pad_3) (void);
+  void (*_pad_4) (void);
+};
+
+FlowUnixConnectOp  *flow_unix_connect_op_new             (const gchar *path, FlowUnixSocketType socket_type);
+
+const gchar        *flow_unix_connect_op_get_path        (FlowUnixConnectOp *unix_connect_op);
+FlowUnixSocketType  flow_unix_connect_op_get_socket_type (FlowUnixConnectOp *unix_connect_op);
+
+#endif /* _FLOW_UNIX_CONNECT_OP_H */
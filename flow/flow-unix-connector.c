@@ -0,0 +1,443 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* flow-unix-connector.c - Connection-oriented origin/endpoint for Unix domain sockets.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+#include "config.h"
+
+#include "flow-util.h"
+#include "flow-gobject-util.h"
+#include "flow-detailed-event.h"
+#include "flow-unix-connect-op.h"
+#include "flow-unix-connector.h"
+
+#define MAX_BUFFER_PACKETS 16
+#define MAX_BUFFER_BYTES   4096
+
+/* Implemented in flow-shunt.c */
+void _flow_shunt_splice_from_queue (FlowShunt *shunt, FlowPacketQueue *packet_queue);
+
+static void        shunt_read   (FlowShunt *shunt, FlowPacket *packet, FlowUnixConnector *unix_connector);
+static FlowPacket *shunt_write  (FlowShunt *shunt, FlowUnixConnector *unix_connector);
+
+/* --- FlowUnixConnector private data --- */
+
+struct _FlowUnixConnectorPrivate
+{
+  FlowUnixConnectOp *op;
+  FlowUnixConnectOp *next_op;
+
+  FlowShunt         *shunt;
+  gboolean           shunt_writes_unblocked;  /* Cached; avoids taking the shunt lock */
+};
+
+/* --- FlowUnixConnector properties --- */
+
+FLOW_GOBJECT_PROPERTIES_BEGIN (flow_unix_connector)
+FLOW_GOBJECT_PROPERTIES_END   ()
+
+/* --- FlowUnixConnector definition --- */
+
+FLOW_GOBJECT_MAKE_IMPL        (flow_unix_connector, FlowUnixConnector, FLOW_TYPE_CONNECTOR, 0)
+
+/* --- FlowUnixConnector implementation --- */
+
+static void
+setup_shunt (FlowUnixConnector *unix_connector)
+{
+  FlowUnixConnectorPrivate *priv = unix_connector->priv;
+  FlowPad                  *output_pad;
+
+  flow_shunt_set_read_func (priv->shunt, (FlowShuntReadFunc *) shunt_read, unix_connector);
+  flow_shunt_set_write_func (priv->shunt, (FlowShuntWriteFunc *) shunt_write, unix_connector);
+  priv->shunt_writes_unblocked = TRUE;
+
+  output_pad = FLOW_PAD (flow_simplex_element_get_output_pad (FLOW_SIMPLEX_ELEMENT (unix_connector)));
+
+  if (flow_pad_is_blocked (output_pad))
+  {
+    flow_shunt_block_reads (priv->shunt);
+  }
+}
+
+static void
+connect_to_remote_socket (FlowUnixConnector *unix_connector)
+{
+  FlowUnixConnectorPrivate *priv = unix_connector->priv;
+
+  if (priv->shunt)
+  {
+    /* We already have an active shunt. This can happen when a shunt has
+     * been installed using _flow_unix_connector_install_connected_shunt (). */
+
+    return;
+  }
+
+  if (priv->next_op)
+  {
+    if (priv->op)
+      g_object_unref (priv->op);
+
+    priv->op = priv->next_op;
+    priv->next_op = NULL;
+  }
+
+  if (!priv->op)
+  {
+    g_warning ("FlowUnixConnector got FLOW_STREAM_BEGIN before connect op.");
+    return;
+  }
+
+  priv->shunt = flow_connect_to_unix (flow_unix_connect_op_get_path (priv->op),
+                                      flow_unix_connect_op_get_socket_type (priv->op));
+  setup_shunt (unix_connector);
+
+  flow_connector_set_state_internal (FLOW_CONNECTOR (unix_connector), FLOW_CONNECTIVITY_CONNECTING);
+}
+
+static void
+set_op (FlowUnixConnector *unix_connector, FlowUnixConnectOp *op)
+{
+  FlowUnixConnectorPrivate *priv = unix_connector->priv;
+
+  g_object_ref (op);
+
+  if (priv->next_op)
+    g_object_unref (priv->next_op);
+
+  priv->next_op = op;
+}
+
+static FlowPacket *
+handle_outbound_packet (FlowUnixConnector *unix_connector, FlowPacket *packet)
+{
+  FlowPacketFormat packet_format = flow_packet_get_format (packet);
+  gpointer         packet_data   = flow_packet_get_data (packet);
+
+  if (packet_format == FLOW_PACKET_FORMAT_OBJECT)
+  {
+    if (FLOW_IS_UNIX_CONNECT_OP (packet_data))
+    {
+      set_op (unix_connector, packet_data);
+      flow_packet_unref (packet);
+      packet = NULL;
+    }
+    else if (FLOW_IS_DETAILED_EVENT (packet_data))
+    {
+      FlowDetailedEvent *detailed_event = (FlowDetailedEvent *) packet_data;
+
+      if (flow_detailed_event_matches (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_BEGIN))
+      {
+        connect_to_remote_socket (unix_connector);
+      }
+      else if (flow_detailed_event_matches (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_END))
+      {
+        flow_connector_set_state_internal (FLOW_CONNECTOR (unix_connector), FLOW_CONNECTIVITY_DISCONNECTING);
+      }
+    }
+    else
+    {
+      flow_handle_universal_events (FLOW_ELEMENT (unix_connector), packet);
+    }
+  }
+
+  return packet;
+}
+
+static FlowPacket *
+handle_inbound_packet (FlowUnixConnector *unix_connector, FlowPacket *packet)
+{
+  FlowUnixConnectorPrivate *priv          = unix_connector->priv;
+  FlowPacketFormat          packet_format = flow_packet_get_format (packet);
+  gpointer                  packet_data   = flow_packet_get_data (packet);
+
+  if (packet_format == FLOW_PACKET_FORMAT_OBJECT)
+  {
+    if (FLOW_IS_DETAILED_EVENT (packet_data))
+    {
+      FlowDetailedEvent *detailed_event = (FlowDetailedEvent *) packet_data;
+
+      if (flow_detailed_event_matches (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_BEGIN))
+      {
+        flow_connector_set_state_internal (FLOW_CONNECTOR (unix_connector), FLOW_CONNECTIVITY_CONNECTED);
+      }
+      else if (flow_detailed_event_matches (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_END) ||
+               flow_detailed_event_matches (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED))
+      {
+        if (priv->shunt)
+        {
+          flow_shunt_destroy (priv->shunt);
+          priv->shunt = NULL;
+        }
+
+        flow_connector_set_state_internal (FLOW_CONNECTOR (unix_connector), FLOW_CONNECTIVITY_DISCONNECTED);
+      }
+    }
+    else
+    {
+      flow_handle_universal_events (FLOW_ELEMENT (unix_connector), packet);
+    }
+  }
+
+  return packet;
+}
+
+static void
+shunt_read (FlowShunt *shunt, FlowPacket *packet, FlowUnixConnector *unix_connector)
+{
+  packet = handle_inbound_packet (unix_connector, packet);
+
+  if (packet)
+  {
+    FlowPad *output_pad;
+
+    output_pad = FLOW_PAD (flow_simplex_element_get_output_pad (FLOW_SIMPLEX_ELEMENT (unix_connector)));
+    flow_pad_push (output_pad, packet);
+  }
+}
+
+static FlowPacket *
+shunt_write (FlowShunt *shunt, FlowUnixConnector *unix_connector)
+{
+  FlowUnixConnectorPrivate *priv = unix_connector->priv;
+  FlowPad                  *input_pad;
+  FlowPacketQueue          *packet_queue;
+  FlowPacket               *packet;
+
+  input_pad = FLOW_PAD (flow_simplex_element_get_input_pad (FLOW_SIMPLEX_ELEMENT (unix_connector)));
+  packet_queue = flow_pad_get_packet_queue (input_pad);
+
+  if (!packet_queue ||
+      (flow_packet_queue_get_length_packets (packet_queue) < MAX_BUFFER_PACKETS &&
+       flow_packet_queue_get_length_bytes (packet_queue) < MAX_BUFFER_BYTES))
+  {
+    flow_pad_unblock (input_pad);
+    packet_queue = flow_pad_get_packet_queue (input_pad);
+  }
+
+  if (!packet_queue || flow_packet_queue_get_length_packets (packet_queue) == 0)
+  {
+    priv->shunt_writes_unblocked = FALSE;
+    flow_shunt_block_writes (shunt);
+    return NULL;
+  }
+
+  do
+  {
+    packet = flow_packet_queue_pop_packet (packet_queue);
+    if (!packet)
+      break;
+
+    packet = handle_outbound_packet (unix_connector, packet);
+  }
+  while (!packet);
+
+  return packet;
+}
+
+static void
+flow_unix_connector_process_input (FlowUnixConnector *unix_connector, FlowPad *input_pad)
+{
+  FlowUnixConnectorPrivate *priv = unix_connector->priv;
+  FlowPacketQueue          *packet_queue;
+
+  packet_queue = flow_pad_get_packet_queue (input_pad);
+  if (!packet_queue)
+    return;
+
+  while (!priv->shunt)
+  {
+    FlowPacket *packet;
+
+    /* Not connected or connecting to anything; process input packets immediately. These
+     * packets may change the desired socket path or request beginning-of-stream, or they
+     * may be bogus data to be discarded. */
+
+    packet = flow_packet_queue_pop_packet (packet_queue);
+    if (!packet)
+      break;
+
+    packet = handle_outbound_packet (unix_connector, packet);
+    if (packet)
+      flow_packet_unref (packet);
+  }
+
+  if (priv->shunt)
+    _flow_shunt_splice_from_queue (priv->shunt, packet_queue);
+
+  if (flow_packet_queue_get_length_bytes (packet_queue) >= MAX_BUFFER_BYTES ||
+      flow_packet_queue_get_length_packets (packet_queue) >= MAX_BUFFER_PACKETS)
+  {
+    flow_pad_block (input_pad);
+  }
+
+  if (priv->shunt && !priv->shunt_writes_unblocked &&
+      flow_packet_queue_get_length_packets (packet_queue) > 0)
+  {
+    priv->shunt_writes_unblocked = TRUE;
+    flow_shunt_unblock_writes (priv->shunt);
+  }
+}
+
+static void
+flow_unix_connector_output_pad_blocked (FlowUnixConnector *unix_connector, FlowPad *output_pad)
+{
+  FlowUnixConnectorPrivate *priv = unix_connector->priv;
+
+  if (priv->shunt)
+    flow_shunt_block_reads (priv->shunt);
+}
+
+static void
+flow_unix_connector_output_pad_unblocked (FlowUnixConnector *unix_connector, FlowPad *output_pad)
+{
+  FlowUnixConnectorPrivate *priv = unix_connector->priv;
+
+  if (priv->shunt)
+    flow_shunt_unblock_reads (priv->shunt);
+}
+
+static void
+flow_unix_connector_type_init (GType type)
+{
+}
+
+static void
+flow_unix_connector_class_init (FlowUnixConnectorClass *klass)
+{
+  FlowElementClass *element_klass = (FlowElementClass *) klass;
+
+  element_klass->process_input        = (void (*) (FlowElement *, FlowPad *)) flow_unix_connector_process_input;
+  element_klass->output_pad_blocked   = (void (*) (FlowElement *, FlowPad *)) flow_unix_connector_output_pad_blocked;
+  element_klass->output_pad_unblocked = (void (*) (FlowElement *, FlowPad *)) flow_unix_connector_output_pad_unblocked;
+}
+
+static void
+flow_unix_connector_init (FlowUnixConnector *unix_connector)
+{
+}
+
+static void
+flow_unix_connector_construct (FlowUnixConnector *unix_connector)
+{
+}
+
+static void
+flow_unix_connector_dispose (FlowUnixConnector *unix_connector)
+{
+  FlowUnixConnectorPrivate *priv = unix_connector->priv;
+
+  flow_gobject_unref_clear (priv->op);
+  flow_gobject_unref_clear (priv->next_op);
+
+  if (priv->shunt)
+  {
+    flow_shunt_destroy (priv->shunt);
+    priv->shunt = NULL;
+  }
+}
+
+static void
+flow_unix_connector_finalize (FlowUnixConnector *unix_connector)
+{
+}
+
+/* --- FlowUnixConnector public API --- */
+
+FlowUnixConnector *
+flow_unix_connector_new (void)
+{
+  return g_object_new (FLOW_TYPE_UNIX_CONNECTOR, NULL);
+}
+
+/**
+ * flow_unix_connector_get_path:
+ * @unix_connector: A #FlowUnixConnector.
+ *
+ * Gets the path of the socket we're connected or connecting to. For
+ * connections accepted by a #FlowUnixListener, this is the listener's path.
+ *
+ * Return value: The socket path, or %NULL if there is none.
+ **/
+const gchar *
+flow_unix_connector_get_path (FlowUnixConnector *unix_connector)
+{
+  FlowUnixConnectorPrivate *priv;
+
+  g_return_val_if_fail (FLOW_IS_UNIX_CONNECTOR (unix_connector), NULL);
+
+  priv = unix_connector->priv;
+
+  if (!priv->op)
+    return NULL;
+
+  return flow_unix_connect_op_get_path (priv->op);
+}
+
+FlowUnixSocketType
+flow_unix_connector_get_socket_type (FlowUnixConnector *unix_connector)
+{
+  FlowUnixConnectorPrivate *priv;
+
+  g_return_val_if_fail (FLOW_IS_UNIX_CONNECTOR (unix_connector), FLOW_UNIX_SOCKET_STREAM);
+
+  priv = unix_connector->priv;
+
+  if (!priv->op)
+    return FLOW_UNIX_SOCKET_STREAM;
+
+  return flow_unix_connect_op_get_socket_type (priv->op);
+}
+
+/* For use in friend classes (e.g. FlowUnixListener) only. The op records
+ * where the connection came from, since the shunt carries no address. */
+void
+_flow_unix_connector_install_connected_shunt (FlowUnixConnector *unix_connector, FlowShunt *shunt,
+                                              FlowUnixConnectOp *op)
+{
+  FlowUnixConnectorPrivate *priv;
+  FlowConnector            *connector;
+
+  g_return_if_fail (FLOW_IS_UNIX_CONNECTOR (unix_connector));
+  g_return_if_fail (shunt != NULL);
+
+  priv = unix_connector->priv;
+
+  connector = FLOW_CONNECTOR (unix_connector);
+
+  g_assert (priv->shunt == NULL);
+  g_assert (flow_connector_get_state (connector) == FLOW_CONNECTIVITY_DISCONNECTED);
+
+  if (op)
+    g_object_ref (op);
+
+  if (priv->op)
+    g_object_unref (priv->op);
+
+  priv->op = op;
+
+  /* Set up in connecting state */
+
+  priv->shunt = shunt;
+  setup_shunt (unix_connector);
+  flow_connector_set_state_internal (connector, FLOW_CONNECTIVITY_CONNECTING);
+}
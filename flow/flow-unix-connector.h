@@ -0,0 +1,76 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* flow-unix-connector.h - Connection-oriented origin/endpoint for Unix domain sockets.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+#ifndef _FLOW_UNIX_CONNECTOR_H
+#define _FLOW_UNIX_CONNECTOR_H
+
+#include <glib-object.h>
+#include <flow-connector.h>
+#include <flow-shunt.h>
+
+G_BEGIN_DECLS
+
+#define FLOW_TYPE_UNIX_CONNECTOR            (flow_unix_connector_get_type ())
+#define FLOW_UNIX_CONNECTOR(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), FLOW_TYPE_UNIX_CONNECTOR, FlowUnixConnector))
+#define FLOW_UNIX_CONNECTOR_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), FLOW_TYPE_UNIX_CONNECTOR, FlowUnixConnectorClass))
+#define FLOW_IS_UNIX_CONNECTOR(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), FLOW_TYPE_UNIX_CONNECTOR))
+#define FLOW_IS_UNIX_CONNECTOR_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), FLOW_TYPE_UNIX_CONNECTOR))
+#define FLOW_UNIX_CONNECTOR_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), FLOW_TYPE_UNIX_CONNECTOR, FlowUnixConnectorClass))
+GType   flow_unix_connector_get_type        (void) G_GNUC_CONST;
+
+typedef struct _FlowUnixConnector        FlowUnixConnector;
+typedef struct _FlowUnixConnectorPrivate FlowUnixConnectorPrivate;
+typedef struct _FlowUnixConnectorClass   FlowUnixConnectorClass;
+
+struct _FlowUnixConnector
+{
+  FlowConnector    parent;
+
+  /*< private >*/
+
+  FlowUnixConnectorPrivate *priv;
+};
+
+struct _FlowUnixConnectorClass
+{
+  FlowConnectorClass parent_class;
+
+  /*< private >*/
+
+  /* Padding for future expansion */
+
+  void (*_pad_1) (void);
+  void (*_pad_2) (void);
+  void (*_pad_3) (void);
+  void (*_pad_4) (void);
+};
+
+FlowUnixConnector  *flow_unix_connector_new             (void);
+
+const gchar        *flow_unix_connector_get_path        (FlowUnixConnector *unix_connector);
+FlowUnixSocketType  flow_unix_connector_get_socket_type (FlowUnixConnector *unix_connector);
+
+G_END_DECLS
+
+#endif  /* _FLOW_UNIX_CONNECTOR_H */
@@ -0,0 +1,249 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* flow-unix-fds.c - File descriptors passed over a Unix domain socket.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+#include "config.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include "flow-util.h"
+#include "flow-gobject-util.h"
+#include "flow-event.h"
+#include "flow-unix-fds.h"
+
+/* --- FlowUnixFds private data --- */
+
+struct _FlowUnixFdsPrivate
+{
+  GArray *fds;
+};
+
+/* --- FlowUnixFds properties --- */
+
+FLOW_GOBJECT_PROPERTIES_BEGIN (flow_unix_fds)
+FLOW_GOBJECT_PROPERTIES_END   ()
+
+/* --- FlowUnixFds definition --- */
+
+FLOW_GOBJECT_MAKE_IMPL        (flow_unix_fds, FlowUnixFds, FLOW_TYPE_EVENT, 0)
+
+/* --- FlowUnixFds implementation --- */
+
+static void
+flow_unix_fds_update_description (FlowUnixFds *unix_fds)
+{
+  FlowUnixFdsPrivate *priv  = unix_fds->priv;
+  FlowEvent          *event = FLOW_EVENT (unix_fds);
+
+  if (event->description)
+    return;
+
+  event->description = g_strdup_printf ("Pass %u file descriptor(s)", priv->fds->len);
+}
+
+static void
+flow_unix_fds_type_init (GType type)
+{
+}
+
+static void
+flow_unix_fds_class_init (FlowUnixFdsClass *klass)
+{
+  FlowEventClass *event_klass = FLOW_EVENT_CLASS (klass);
+
+  event_klass->update_description = (void (*) (FlowEvent *)) flow_unix_fds_update_description;
+}
+
+static void
+flow_unix_fds_init (FlowUnixFds *unix_fds)
+{
+  FlowUnixFdsPrivate *priv = unix_fds->priv;
+
+  priv->fds = g_array_new (FALSE, FALSE, sizeof (gint));
+}
+
+static void
+flow_unix_fds_construct (FlowUnixFds *unix_fds)
+{
+}
+
+static void
+flow_unix_fds_dispose (FlowUnixFds *unix_fds)
+{
+}
+
+static void
+flow_unix_fds_finalize (FlowUnixFds *unix_fds)
+{
+  FlowUnixFdsPrivate *priv = unix_fds->priv;
+  guint               i;
+
+  /* Descriptors nobody stole are ours to close */
+
+  for (i = 0; i < priv->fds->len; i++)
+  {
+    gint fd = g_array_index (priv->fds, gint, i);
+
+    if (fd >= 0)
+      close (fd);
+  }
+
+  g_array_free (priv->fds, TRUE);
+}
+
+/* --- FlowUnixFds public API --- */
+
+/**
+ * flow_unix_fds_new:
+ *
+ * Creates a new, empty #FlowUnixFds. Add descriptors to it with
+ * flow_unix_fds_take_fd () or flow_unix_fds_add_fd ().
+ *
+ * When a #FlowUnixFds reaches a Unix domain socket shunt through the
+ * write path, its descriptors are sent with SCM_RIGHTS along with the
+ * next buffer packet, so it must be followed by some data. On the read
+ * path, descriptors that arrive are delivered in a #FlowUnixFds ahead of
+ * the data they came with.
+ *
+ * The descriptors are owned by the #FlowUnixFds and closed when it is
+ * finalized, unless they are stolen with flow_unix_fds_steal_nth_fd ()
+ * first.
+ *
+ * Return value: A new #FlowUnixFds.
+ **/
+FlowUnixFds *
+flow_unix_fds_new (void)
+{
+  return g_object_new (FLOW_TYPE_UNIX_FDS, NULL);
+}
+
+/**
+ * flow_unix_fds_take_fd:
+ * @unix_fds: A #FlowUnixFds.
+ * @fd:       A file descriptor.
+ *
+ * Appends @fd, taking ownership of it.
+ **/
+void
+flow_unix_fds_take_fd (FlowUnixFds *unix_fds, gint fd)
+{
+  FlowUnixFdsPrivate *priv;
+
+  g_return_if_fail (FLOW_IS_UNIX_FDS (unix_fds));
+  g_return_if_fail (fd >= 0);
+
+  priv = unix_fds->priv;
+  g_return_if_fail (priv->fds->len < FLOW_UNIX_FDS_MAX);
+
+  g_array_append_val (priv->fds, fd);
+}
+
+/**
+ * flow_unix_fds_add_fd:
+ * @unix_fds: A #FlowUnixFds.
+ * @fd:       A file descriptor.
+ *
+ * Appends a duplicate of @fd. The caller keeps ownership of @fd.
+ *
+ * Return value: %TRUE on success, %FALSE if @fd could not be duplicated.
+ **/
+gboolean
+flow_unix_fds_add_fd (FlowUnixFds *unix_fds, gint fd)
+{
+  gint new_fd;
+
+  g_return_val_if_fail (FLOW_IS_UNIX_FDS (unix_fds), FALSE);
+  g_return_val_if_fail (fd >= 0, FALSE);
+
+#ifdef F_DUPFD_CLOEXEC
+  new_fd = fcntl (fd, F_DUPFD_CLOEXEC, 0);
+#else
+  new_fd = dup (fd);
+#endif
+
+  if (new_fd < 0)
+    return FALSE;
+
+  flow_unix_fds_take_fd (unix_fds, new_fd);
+  return TRUE;
+}
+
+guint
+flow_unix_fds_get_n_fds (FlowUnixFds *unix_fds)
+{
+  FlowUnixFdsPrivate *priv;
+
+  g_return_val_if_fail (FLOW_IS_UNIX_FDS (unix_fds), 0);
+
+  priv = unix_fds->priv;
+  return priv->fds->len;
+}
+
+/**
+ * flow_unix_fds_get_nth_fd:
+ * @unix_fds: A #FlowUnixFds.
+ * @n:        Index of the descriptor.
+ *
+ * Gets a descriptor without taking ownership of it.
+ *
+ * Return value: The descriptor, or -1 if it was stolen.
+ **/
+gint
+flow_unix_fds_get_nth_fd (FlowUnixFds *unix_fds, guint n)
+{
+  FlowUnixFdsPrivate *priv;
+
+  g_return_val_if_fail (FLOW_IS_UNIX_FDS (unix_fds), -1);
+
+  priv = unix_fds->priv;
+  g_return_val_if_fail (n < priv->fds->len, -1);
+
+  return g_array_index (priv->fds, gint, n);
+}
+
+/**
+ * flow_unix_fds_steal_nth_fd:
+ * @unix_fds: A #FlowUnixFds.
+ * @n:        Index of the descriptor.
+ *
+ * Takes ownership of a descriptor away from @unix_fds, so it won't be
+ * closed along with it. Indexes of the other descriptors are unchanged.
+ *
+ * Return value: The descriptor, or -1 if it was already stolen.
+ **/
+gint
+flow_unix_fds_steal_nth_fd (FlowUnixFds *unix_fds, guint n)
+{
+  FlowUnixFdsPrivate *priv;
+  gint                fd;
+
+  g_return_val_if_fail (FLOW_IS_UNIX_FDS (unix_fds), -1);
+
+  priv = unix_fds->priv;
+  g_return_val_if_fail (n < priv->fds->len, -1);
+
+  fd = g_array_index (priv->fds, gint, n);
+  g_array_index (priv->fds, gint, n) = -1;
+
+  return fd;
+}
@@ -0,0 +1,75 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* flow-unix-fds.h - File descriptors passed over a Unix domain socket.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+#ifndef _FLOW_UNIX_FDS_H
+#define _FLOW_UNIX_FDS_H
+
+#include <flow/flow-event.h>
+
+#define FLOW_TYPE_UNIX_FDS            (flow_unix_fds_get_type ())
+#define FLOW_UNIX_FDS(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), FLOW_TYPE_UNIX_FDS, FlowUnixFds))
+#define FLOW_UNIX_FDS_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), FLOW_TYPE_UNIX_FDS, FlowUnixFdsClass))
+#define FLOW_IS_UNIX_FDS(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), FLOW_TYPE_UNIX_FDS))
+#define FLOW_IS_UNIX_FDS_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), FLOW_TYPE_UNIX_FDS))
+#define FLOW_UNIX_FDS_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), FLOW_TYPE_UNIX_FDS, FlowUnixFdsClass))
+GType   flow_unix_fds_get_type        (void) G_GNUC_CONST;
+
+/* Most descriptors that can go in one message */
+#define FLOW_UNIX_FDS_MAX 64
+
+typedef struct _FlowUnixFds        FlowUnixFds;
+typedef struct _FlowUnixFdsPrivate FlowUnixFdsPrivate;
+typedef struct _FlowUnixFdsClass   FlowUnixFdsClass;
+
+struct _FlowUnixFds
+{
+  FlowEvent   parent;
+
+  /*< private >*/
+
+  FlowUnixFdsPrivate *priv;
+};
+
+struct _FlowUnixFdsClass
+{
+  FlowEventClass parent_class;
+
+  /*< private >*/
+
+  /* Padding for future expansion */
+  void (*_pad_1) (void);
+  void (*_pad_2) (void);
+  void (*_pad_3) (void);
+  void (*_pad_4) (void);
+};
+
+FlowUnixFds      *flow_unix_fds_new                      (void);
+
+void              flow_unix_fds_take_fd                  (FlowUnixFds *unix_fds, gint fd);
+gboolean          flow_unix_fds_add_fd                   (FlowUnixFds *unix_fds, gint fd);
+guint             flow_unix_fds_get_n_fds                (FlowUnixFds *unix_fds);
+gint              flow_unix_fds_get_nth_fd               (FlowUnixFds *unix_fds, guint n);
+gint              flow_unix_fds_steal_nth_fd             (FlowUnixFds *unix_fds, guint n);
+
+#endif /* _FLOW_UNIX_FDS_H */
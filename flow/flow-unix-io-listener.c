@@ -0,0 +1,135 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* flow-unix-io-listener.c - Unix domain socket I/O listener.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+#include "config.h"
+
+#include "flow-util.h"
+#include "flow-gobject-util.h"
+#include "flow-unix-connect-op.h"
+#include "flow-unix-io-listener.h"
+
+/* Implemented in flow-unix-listener.c */
+FlowShunt *_flow_unix_listener_pop_connected_shunt (FlowUnixListener *unix_listener, FlowUnixConnectOp **op_out);
+
+/* Implemented in flow-unix-connector.c */
+void _flow_unix_connector_install_connected_shunt (FlowUnixConnector *unix_connector, FlowShunt *connected_shunt,
+                                                   FlowUnixConnectOp *op);
+
+/* --- FlowUnixIOListener private data --- */
+
+struct _FlowUnixIOListenerPrivate
+{
+};
+
+/* --- FlowUnixIOListener properties --- */
+
+FLOW_GOBJECT_PROPERTIES_BEGIN (flow_unix_io_listener)
+FLOW_GOBJECT_PROPERTIES_END   ()
+
+/* --- FlowUnixIOListener definition --- */
+
+FLOW_GOBJECT_MAKE_IMPL        (flow_unix_io_listener, FlowUnixIOListener, FLOW_TYPE_UNIX_LISTENER, 0)
+
+/* --- FlowUnixIOListener implementation --- */
+
+static void
+flow_unix_io_listener_type_init (GType type)
+{
+}
+
+static void
+flow_unix_io_listener_class_init (FlowUnixIOListenerClass *klass)
+{
+}
+
+static void
+flow_unix_io_listener_init (FlowUnixIOListener *unix_io_listener)
+{
+}
+
+static void
+flow_unix_io_listener_construct (FlowUnixIOListener *unix_io_listener)
+{
+}
+
+static void
+flow_unix_io_listener_dispose (FlowUnixIOListener *unix_io_listener)
+{
+}
+
+static void
+flow_unix_io_listener_finalize (FlowUnixIOListener *unix_io_listener)
+{
+}
+
+/* --- FlowUnixIOListener public API --- */
+
+FlowUnixIOListener *
+flow_unix_io_listener_new (void)
+{
+  return g_object_new (FLOW_TYPE_UNIX_IO_LISTENER, NULL);
+}
+
+FlowUnixIO *
+flow_unix_io_listener_pop_connection (FlowUnixIOListener *unix_io_listener)
+{
+  FlowUnixConnectOp *op;
+  FlowShunt         *connected_shunt;
+  FlowUnixIO        *unix_io;
+
+  g_return_val_if_fail (FLOW_IS_UNIX_IO_LISTENER (unix_io_listener), NULL);
+
+  connected_shunt = _flow_unix_listener_pop_connected_shunt (FLOW_UNIX_LISTENER (unix_io_listener), &op);
+  if (!connected_shunt)
+    return NULL;
+
+  /* Use the connector the FlowUnixIO already has, instead of building a
+   * separate one and swapping it in */
+
+  unix_io = flow_unix_io_new ();
+  _flow_unix_connector_install_connected_shunt (flow_unix_io_get_unix_connector (unix_io), connected_shunt, op);
+
+  return unix_io;
+}
+
+FlowUnixIO *
+flow_unix_io_listener_sync_pop_connection (FlowUnixIOListener *unix_io_listener)
+{
+  FlowElement *unix_connector;
+  FlowUnixIO  *unix_io;
+
+  g_return_val_if_fail (FLOW_IS_UNIX_IO_LISTENER (unix_io_listener), NULL);
+
+  unix_connector = (FlowElement *) flow_unix_listener_sync_pop_connection (FLOW_UNIX_LISTENER (unix_io_listener));
+  if (!unix_connector)
+    return NULL;
+
+  /* Replace the FlowUnixConnector in unix_io's bin */
+
+  unix_io = flow_unix_io_new ();
+  flow_unix_io_set_unix_connector (unix_io, FLOW_UNIX_CONNECTOR (unix_connector));
+  g_object_unref (unix_connector);
+
+  return unix_io;
+}
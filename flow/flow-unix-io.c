@@ -0,0 +1,609 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* flow-unix-io.c - A prefab I/O class for Unix domain socket connections.
+ *
+ * Copyright (C) 2006 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+#include <string.h>
+#include "config.h"
+#include "flow-element-util.h"
+#include "flow-gobject-util.h"
+#include "flow-gerror-util.h"
+#include "flow-event-codes.h"
+#include "flow-unix-connect-op.h"
+#include "flow-unix-io.h"
+
+#define UNIX_CONNECTOR_NAME "unix-connector"
+
+#define return_if_invalid_bin(unix_io) \
+  G_STMT_START { \
+    FlowUnixIOPrivate *priv = unix_io->priv; \
+\
+    if G_UNLIKELY (((FlowIO *) unix_io)->need_to_check_bin) \
+      flow_io_check_bin ((FlowIO *) unix_io); \
+\
+    if G_UNLIKELY (!priv->user_adapter || !priv->unix_connector) \
+    { \
+      g_warning (G_STRLOC ": Misconfigured bin! Need a FlowUserAdapter and a FlowUnixConnector."); \
+      return; \
+    } \
+  } G_STMT_END
+
+#define return_val_if_invalid_bin(unix_io, val) \
+  G_STMT_START { \
+    FlowUnixIOPrivate *priv = unix_io->priv; \
+\
+    if G_UNLIKELY (((FlowIO *) unix_io)->need_to_check_bin) \
+      flow_io_check_bin ((FlowIO *) unix_io); \
+\
+    if G_UNLIKELY (!priv->user_adapter || !priv->unix_connector) \
+    { \
+      g_warning (G_STRLOC ": Misconfigured bin! Need a FlowUserAdapter and a FlowUnixConnector."); \
+      return val; \
+    } \
+  } G_STMT_END
+
+#define on_error_propagate(x) \
+  G_STMT_START { \
+    if (io->error) \
+    { \
+      if (error) \
+        *error = io->error; \
+      else \
+        g_error_free (io->error); \
+\
+      io->error = NULL; \
+    } \
+  } G_STMT_END
+
+#define on_error_propagate_and_assert(x) \
+  G_STMT_START { \
+    if (io->error) \
+    { \
+      g_assert (x); \
+\
+      if (error) \
+        *error = io->error; \
+      else \
+        g_error_free (io->error); \
+\
+      io->error = NULL; \
+    } \
+  } G_STMT_END
+
+/* --- FlowUnixIO private data --- */
+
+struct _FlowUnixIOPrivate
+{
+  FlowConnectivity   connectivity;
+  FlowConnectivity   last_connectivity;
+
+  FlowUnixConnector *unix_connector;
+  FlowUserAdapter   *user_adapter;
+
+  guint              wrote_stream_begin : 1;
+};
+
+/* --- FlowUnixIO properties --- */
+
+FLOW_GOBJECT_PROPERTIES_BEGIN (flow_unix_io)
+FLOW_GOBJECT_PROPERTIES_END   ()
+
+/* --- FlowUnixIO definition --- */
+
+FLOW_GOBJECT_MAKE_IMPL        (flow_unix_io, FlowUnixIO, FLOW_TYPE_IO, 0)
+
+/* --- FlowUnixIO implementation --- */
+
+static void
+write_stream_begin (FlowUnixIO *unix_io)
+{
+  FlowUnixIOPrivate *priv = unix_io->priv;
+  FlowDetailedEvent *detailed_event;
+
+  g_assert (priv->wrote_stream_begin == FALSE);
+
+  priv->wrote_stream_begin = TRUE;
+
+  detailed_event = flow_detailed_event_new (NULL);
+  flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_BEGIN);
+
+  flow_io_write_object (FLOW_IO (unix_io), detailed_event);
+
+  g_object_unref (detailed_event);
+}
+
+static void
+write_stream_end (FlowUnixIO *unix_io, gboolean close_both_directions)
+{
+  FlowUnixIOPrivate *priv = unix_io->priv;
+  FlowDetailedEvent *detailed_event;
+
+  detailed_event = flow_detailed_event_new (NULL);
+  flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_END);
+
+  if (close_both_directions)
+    flow_detailed_event_add_code (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_END_CONVERSE);
+
+  flow_io_write_object (FLOW_IO (unix_io), detailed_event);
+
+  priv->wrote_stream_begin = FALSE;
+
+  g_object_unref (detailed_event);
+}
+
+static void
+query_remote_connectivity (FlowUnixIO *unix_io)
+{
+  FlowUnixIOPrivate *priv = unix_io->priv;
+  FlowIO            *io   = FLOW_IO (unix_io);
+  FlowConnectivity   before;
+  FlowConnectivity   after;
+
+  before = flow_connector_get_last_state (FLOW_CONNECTOR (priv->unix_connector));
+  after  = flow_connector_get_state      (FLOW_CONNECTOR (priv->unix_connector));
+
+  if (after == FLOW_CONNECTIVITY_DISCONNECTED)
+  {
+    /* When the connection is closed, we may be in a blocking write call. We have to
+     * interrupt it, or it might wait forever. Blocking reads are okay, since we'll get
+     * the end-of-stream packet back through the read pipeline. */
+
+    io->write_stream_is_open = FALSE;
+    flow_user_adapter_interrupt_output (priv->user_adapter);
+  }
+  else
+  {
+    io->read_stream_is_open  = TRUE;
+    io->write_stream_is_open = TRUE;
+  }
+}
+
+static void
+remote_connectivity_changed (FlowUnixIO *unix_io)
+{
+  return_if_invalid_bin (unix_io);
+
+  query_remote_connectivity (unix_io);
+}
+
+static void
+flow_unix_io_check_bin (FlowUnixIO *unix_io)
+{
+  FlowUnixIOPrivate *priv = unix_io->priv;
+  FlowBin           *bin  = FLOW_BIN (unix_io);
+
+  if (priv->unix_connector)
+  {
+    g_signal_handlers_disconnect_by_func (priv->unix_connector, remote_connectivity_changed, unix_io);
+  }
+
+  flow_gobject_unref_clear (priv->user_adapter);
+  flow_gobject_unref_clear (priv->unix_connector);
+
+  priv->user_adapter   = flow_io_get_user_adapter (FLOW_IO (unix_io));
+  priv->unix_connector = (FlowUnixConnector *) flow_bin_get_element (bin, UNIX_CONNECTOR_NAME);
+
+  if (priv->user_adapter)
+  {
+    if (FLOW_IS_USER_ADAPTER (priv->user_adapter))
+      g_object_ref (priv->user_adapter);
+    else
+      priv->user_adapter = NULL;
+  }
+
+  if (priv->unix_connector)
+  {
+    if (FLOW_IS_UNIX_CONNECTOR (priv->unix_connector))
+    {
+      g_object_ref (priv->unix_connector);
+      g_signal_connect_swapped (priv->unix_connector, "connectivity-changed",
+                                G_CALLBACK (remote_connectivity_changed), unix_io);
+      query_remote_connectivity (unix_io);
+    }
+    else
+      priv->unix_connector = NULL;
+  }
+}
+
+static void
+set_connectivity (FlowUnixIO *unix_io, FlowConnectivity new_connectivity)
+{
+  FlowUnixIOPrivate *priv = unix_io->priv;
+
+  if (new_connectivity == priv->connectivity)
+    return;
+
+  priv->last_connectivity = priv->connectivity;
+  priv->connectivity = new_connectivity;
+
+  g_signal_emit_by_name (unix_io, "connectivity-changed");
+}
+
+static gboolean
+check_for_errors (FlowUnixIO *unix_io, FlowDetailedEvent *detailed_event)
+{
+  FlowIO *io = FLOW_IO (unix_io);
+  GError *error;
+
+  error = flow_gerror_from_detailed_event (detailed_event, FLOW_SOCKET_DOMAIN,
+                                           FLOW_SOCKET_ADDRESS_PROTECTED,
+                                           FLOW_SOCKET_ADDRESS_IN_USE,
+                                           FLOW_SOCKET_ADDRESS_DOES_NOT_EXIST,
+                                           FLOW_SOCKET_CONNECTION_REFUSED,
+                                           FLOW_SOCKET_CONNECTION_RESET,
+                                           FLOW_SOCKET_NETWORK_UNREACHABLE,
+                                           FLOW_SOCKET_ACCEPT_ERROR,
+                                           FLOW_SOCKET_OVERSIZED_PACKET,
+                                           -1);
+
+  if (error)
+  {
+    g_clear_error (&io->error);
+    io->error = error;
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+static gboolean
+flow_unix_io_handle_input_object (FlowUnixIO *unix_io, gpointer object)
+{
+  FlowUnixIOPrivate *priv   = unix_io->priv;
+  gboolean           result = FALSE;
+
+  if (FLOW_IS_DETAILED_EVENT (object))
+  {
+    FlowDetailedEvent *detailed_event = object;
+
+    result = check_for_errors (unix_io, detailed_event);
+
+    if (flow_detailed_event_matches (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_BEGIN))
+    {
+      FlowIO *io = FLOW_IO (unix_io);
+
+      g_assert (priv->connectivity != FLOW_CONNECTIVITY_CONNECTED);
+
+      io->read_stream_is_open  = TRUE;
+      io->write_stream_is_open = TRUE;
+
+      set_connectivity (unix_io, FLOW_CONNECTIVITY_CONNECTED);
+
+      result = TRUE;
+    }
+    else if (flow_detailed_event_matches (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_END) ||
+             flow_detailed_event_matches (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED))
+    {
+      FlowIO *io = FLOW_IO (unix_io);
+
+      g_assert (priv->connectivity != FLOW_CONNECTIVITY_DISCONNECTED);
+
+      io->read_stream_is_open  = FALSE;
+      io->write_stream_is_open = FALSE;
+
+      write_stream_end (unix_io, FALSE);
+
+      set_connectivity (unix_io, FLOW_CONNECTIVITY_DISCONNECTED);
+
+      result = TRUE;
+    }
+    else if (flow_detailed_event_matches (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_SEGMENT_BEGIN) ||
+             flow_detailed_event_matches (detailed_event, FLOW_STREAM_DOMAIN, FLOW_STREAM_SEGMENT_END))
+    {
+      result = TRUE;
+    }
+  }
+
+  return result;
+}
+
+static void
+flow_unix_io_type_init (GType type)
+{
+}
+
+static void
+flow_unix_io_class_init (FlowUnixIOClass *klass)
+{
+  FlowIOClass *io_klass = FLOW_IO_CLASS (klass);
+
+  io_klass->check_bin           = (void (*) (FlowIO *)) flow_unix_io_check_bin;
+  io_klass->handle_input_object = (gboolean (*) (FlowIO *, gpointer)) flow_unix_io_handle_input_object;
+
+  g_signal_newv ("connectivity-changed",
+                 G_TYPE_FROM_CLASS (klass),
+                 G_SIGNAL_RUN_LAST | G_SIGNAL_NO_HOOKS,
+                 NULL,                                   /* Class closure */
+                 NULL, NULL,                             /* Accumulator, accu data */
+                 g_cclosure_marshal_VOID__VOID,          /* Marshaller */
+                 G_TYPE_NONE,                            /* Return type */
+                 0, NULL);                               /* Number of params, param types */
+}
+
+static void
+flow_unix_io_init (FlowUnixIO *unix_io)
+{
+  FlowUnixIOPrivate *priv = unix_io->priv;
+  FlowIO            *io   = FLOW_IO  (unix_io);
+  FlowBin           *bin  = FLOW_BIN (unix_io);
+
+  priv->user_adapter = flow_io_get_user_adapter (io);
+  g_object_ref (priv->user_adapter);
+
+  priv->unix_connector = flow_unix_connector_new ();
+  flow_bin_add_element (bin, FLOW_ELEMENT (priv->unix_connector), UNIX_CONNECTOR_NAME);
+
+  flow_connect_simplex__simplex (FLOW_SIMPLEX_ELEMENT (priv->unix_connector),
+                                 FLOW_SIMPLEX_ELEMENT (priv->user_adapter));
+  flow_connect_simplex__simplex (FLOW_SIMPLEX_ELEMENT (priv->user_adapter),
+                                 FLOW_SIMPLEX_ELEMENT (priv->unix_connector));
+
+  g_signal_connect_swapped (priv->unix_connector, "connectivity-changed",
+                            G_CALLBACK (remote_connectivity_changed), unix_io);
+
+  io->read_stream_is_open  = FALSE;
+  io->write_stream_is_open = FALSE;
+
+  priv->connectivity      = FLOW_CONNECTIVITY_DISCONNECTED;
+  priv->last_connectivity = FLOW_CONNECTIVITY_DISCONNECTED;
+}
+
+static void
+flow_unix_io_construct (FlowUnixIO *unix_io)
+{
+}
+
+static void
+flow_unix_io_dispose (FlowUnixIO *unix_io)
+{
+  FlowUnixIOPrivate *priv = unix_io->priv;
+
+  flow_gobject_unref_clear (priv->user_adapter);
+  flow_gobject_unref_clear (priv->unix_connector);
+}
+
+static void
+flow_unix_io_finalize (FlowUnixIO *unix_io)
+{
+}
+
+/* --- FlowUnixIO public API --- */
+
+FlowUnixIO *
+flow_unix_io_new (void)
+{
+  return g_object_new (FLOW_TYPE_UNIX_IO, NULL);
+}
+
+void
+flow_unix_io_connect (FlowUnixIO *unix_io, const gchar *path, FlowUnixSocketType socket_type)
+{
+  FlowUnixIOPrivate *priv;
+  FlowUnixConnectOp *op;
+  FlowIO            *io;
+
+  g_return_if_fail (FLOW_IS_UNIX_IO (unix_io));
+  g_return_if_fail (path != NULL);
+  return_if_invalid_bin (unix_io);
+
+  priv = unix_io->priv;
+
+  g_return_if_fail (priv->connectivity == FLOW_CONNECTIVITY_DISCONNECTED);
+
+  io = FLOW_IO (unix_io);
+
+  op = flow_unix_connect_op_new (path, socket_type);
+  flow_io_write_object (io, op);
+  g_object_unref (op);
+
+  write_stream_begin (unix_io);
+  set_connectivity (unix_io, FLOW_CONNECTIVITY_CONNECTING);
+}
+
+void
+flow_unix_io_disconnect (FlowUnixIO *unix_io, gboolean close_both_directions)
+{
+  FlowUnixIOPrivate *priv;
+
+  g_return_if_fail (FLOW_IS_UNIX_IO (unix_io));
+  return_if_invalid_bin (unix_io);
+
+  priv = unix_io->priv;
+
+  if (priv->connectivity == FLOW_CONNECTIVITY_DISCONNECTED ||
+      priv->connectivity == FLOW_CONNECTIVITY_DISCONNECTING)
+    return;
+
+  write_stream_end (unix_io, close_both_directions);
+
+  set_connectivity (unix_io, FLOW_CONNECTIVITY_DISCONNECTING);
+}
+
+gboolean
+flow_unix_io_sync_connect (FlowUnixIO *unix_io, const gchar *path, FlowUnixSocketType socket_type,
+                           GError **error)
+{
+  FlowUnixIOPrivate *priv;
+  FlowUnixConnectOp *op;
+  FlowIO            *io;
+
+  g_return_val_if_fail (FLOW_IS_UNIX_IO (unix_io), FALSE);
+  g_return_val_if_fail (path != NULL, FALSE);
+  return_val_if_invalid_bin (unix_io, FALSE);
+
+  priv = unix_io->priv;
+
+  g_return_val_if_fail (priv->connectivity == FLOW_CONNECTIVITY_DISCONNECTED, FALSE);
+
+  io = FLOW_IO (unix_io);
+
+  g_assert (io->error == NULL);
+
+  op = flow_unix_connect_op_new (path, socket_type);
+  flow_io_write_object (io, op);
+  g_object_unref (op);
+
+  write_stream_begin (unix_io);
+  set_connectivity (unix_io, FLOW_CONNECTIVITY_CONNECTING);
+
+  while (priv->connectivity == FLOW_CONNECTIVITY_CONNECTING)
+  {
+    flow_user_adapter_wait_for_input (priv->user_adapter);
+    flow_io_check_events (io);
+  }
+
+  if (priv->connectivity == FLOW_CONNECTIVITY_CONNECTED)
+  {
+    g_assert (io->error == NULL);
+    return TRUE;
+  }
+
+  g_assert (priv->connectivity == FLOW_CONNECTIVITY_DISCONNECTED);
+  g_assert (io->error != NULL);
+  on_error_propagate ();
+  return FALSE;
+}
+
+gboolean
+flow_unix_io_sync_disconnect (FlowUnixIO *unix_io, GError **error)
+{
+  FlowUnixIOPrivate *priv;
+  FlowIO            *io;
+  gboolean           result;
+
+  g_return_val_if_fail (FLOW_IS_UNIX_IO (unix_io), FALSE);
+  return_val_if_invalid_bin (unix_io, FALSE);
+
+  priv = unix_io->priv;
+
+  if (priv->connectivity == FLOW_CONNECTIVITY_DISCONNECTED)
+    return TRUE;
+
+  if (priv->connectivity != FLOW_CONNECTIVITY_DISCONNECTING)
+  {
+    write_stream_end (unix_io, TRUE);
+    set_connectivity (unix_io, FLOW_CONNECTIVITY_DISCONNECTING);
+  }
+
+  io = FLOW_IO (unix_io);
+
+  while (priv->connectivity == FLOW_CONNECTIVITY_DISCONNECTING)
+  {
+    flow_user_adapter_wait_for_input (priv->user_adapter);
+    flow_io_check_events (io);
+  }
+
+  result = io->error ? FALSE : TRUE;
+
+  /* We may have to report an error even though we got disconnected, if
+   * the disconnect was unclean. */
+
+  if (io->error)
+  {
+    result = FALSE;
+  }
+  else
+  {
+    g_assert (priv->connectivity == FLOW_CONNECTIVITY_DISCONNECTED);
+    result = TRUE;
+  }
+
+  on_error_propagate ();
+  return result;
+}
+
+const gchar *
+flow_unix_io_get_path (FlowUnixIO *unix_io)
+{
+  FlowUnixIOPrivate *priv;
+
+  g_return_val_if_fail (FLOW_IS_UNIX_IO (unix_io), NULL);
+  return_val_if_invalid_bin (unix_io, NULL);
+
+  priv = unix_io->priv;
+
+  if (!priv->unix_connector)
+    return NULL;
+
+  return flow_unix_connector_get_path (priv->unix_connector);
+}
+
+FlowConnectivity
+flow_unix_io_get_connectivity (FlowUnixIO *unix_io)
+{
+  FlowUnixIOPrivate *priv;
+
+  g_return_val_if_fail (FLOW_IS_UNIX_IO (unix_io), FLOW_CONNECTIVITY_DISCONNECTED);
+  return_val_if_invalid_bin (unix_io, FLOW_CONNECTIVITY_DISCONNECTED);
+
+  priv = unix_io->priv;
+
+  return priv->connectivity;
+}
+
+FlowConnectivity
+flow_unix_io_get_last_connectivity (FlowUnixIO *unix_io)
+{
+  FlowUnixIOPrivate *priv;
+
+  g_return_val_if_fail (FLOW_IS_UNIX_IO (unix_io), FLOW_CONNECTIVITY_DISCONNECTED);
+  return_val_if_invalid_bin (unix_io, FLOW_CONNECTIVITY_DISCONNECTED);
+
+  priv = unix_io->priv;
+
+  return priv->last_connectivity;
+}
+
+FlowUnixConnector *
+flow_unix_io_get_unix_connector (FlowUnixIO *unix_io)
+{
+  g_return_val_if_fail (FLOW_IS_UNIX_IO (unix_io), NULL);
+
+  return FLOW_UNIX_CONNECTOR (flow_bin_get_element (FLOW_BIN (unix_io), UNIX_CONNECTOR_NAME));
+}
+
+void
+flow_unix_io_set_unix_connector (FlowUnixIO *unix_io, FlowUnixConnector *unix_connector)
+{
+  FlowElement *old_unix_connector;
+  FlowBin     *bin;
+
+  g_return_if_fail (FLOW_IS_UNIX_IO (unix_io));
+  g_return_if_fail (FLOW_IS_UNIX_CONNECTOR (unix_connector));
+
+  bin = FLOW_BIN (unix_io);
+
+  old_unix_connector = flow_bin_get_element (bin, UNIX_CONNECTOR_NAME);
+
+  if ((FlowElement *) unix_connector == old_unix_connector)
+    return;
+
+  /* Changes to the bin will trigger an update of our internal pointers */
+
+  if (old_unix_connector)
+  {
+    flow_replace_element (old_unix_connector, (FlowElement *) unix_connector);
+    flow_bin_remove_element (bin, old_unix_connector);
+  }
+
+  flow_bin_add_element (bin, FLOW_ELEMENT (unix_connector), UNIX_CONNECTOR_NAME);
+}
@@ -0,0 +1,88 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* flow-unix-io.h - A prefab I/O class for Unix domain socket connections.
+ *
+ * Copyright (C) 2006 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+#ifndef _FLOW_UNIX_IO_H
+#define _FLOW_UNIX_IO_H
+
+#include <flow/flow-detailed-event.h>
+#include <flow/flow-io.h>
+#include <flow/flow-unix-connector.h>
+
+G_BEGIN_DECLS
+
+#define FLOW_TYPE_UNIX_IO            (flow_unix_io_get_type ())
+#define FLOW_UNIX_IO(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), FLOW_TYPE_UNIX_IO, FlowUnixIO))
+#define FLOW_UNIX_IO_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), FLOW_TYPE_UNIX_IO, FlowUnixIOClass))
+#define FLOW_IS_UNIX_IO(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), FLOW_TYPE_UNIX_IO))
+#define FLOW_IS_UNIX_IO_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), FLOW_TYPE_UNIX_IO))
+#define FLOW_UNIX_IO_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), FLOW_TYPE_UNIX_IO, FlowUnixIOClass))
+GType   flow_unix_io_get_type        (void) G_GNUC_CONST;
+
+typedef struct _FlowUnixIO        FlowUnixIO;
+typedef struct _FlowUnixIOPrivate FlowUnixIOPrivate;
+typedef struct _FlowUnixIOClass   FlowUnixIOClass;
+
+struct _FlowUnixIO
+{
+  FlowIO            parent;
+
+  /*< private >*/
+
+  FlowUnixIOPrivate *priv;
+};
+
+struct _FlowUnixIOClass
+{
+  FlowIOClass parent_class;
+
+  /*< private >*/
+
+  /* Padding for future expansion */
+
+  void (*_pad_1) (void);
+  void (*_pad_2) (void);
+  void (*_pad_3) (void);
+  void (*_pad_4) (void);
+};
+
+FlowUnixIO        *flow_unix_io_new                   (void);
+
+void               flow_unix_io_connect               (FlowUnixIO *unix_io, const gchar *path,
+                                                       FlowUnixSocketType socket_type);
+void               flow_unix_io_disconnect            (FlowUnixIO *unix_io, gboolean close_both_directions);
+
+gboolean           flow_unix_io_sync_connect          (FlowUnixIO *unix_io, const gchar *path,
+                                                       FlowUnixSocketType socket_type, GError **error);
+gboolean           flow_unix_io_sync_disconnect       (FlowUnixIO *unix_io, GError **error);
+
+const gchar       *flow_unix_io_get_path              (FlowUnixIO *unix_io);
+FlowConnectivity   flow_unix_io_get_connectivity      (FlowUnixIO *unix_io);
+FlowConnectivity   flow_unix_io_get_last_connectivity (FlowUnixIO *unix_io);
+
+FlowUnixConnector *flow_unix_io_get_unix_connector    (FlowUnixIO *io);
+void               flow_unix_io_set_unix_connector    (FlowUnixIO *io, FlowUnixConnector *unix_connector);
+
+G_END_DECLS
+
+#endif  /* _FLOW_UNIX_IO_H */
@@ -0,0 +1,405 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* flow-unix-listener.c - Unix domain socket listener.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+#include "config.h"
+
+#include "flow-util.h"
+#include "flow-gobject-util.h"
+#include "flow-enum-types.h"
+#include "flow-unix-listener.h"
+#include "flow-unix-connect-op.h"
+#include "flow-anonymous-event.h"
+#include "flow-detailed-event.h"
+#include "flow-context-mgmt.h"
+
+/* Implemented in flow-unix-connector.c */
+void _flow_unix_connector_install_connected_shunt (FlowUnixConnector *unix_connector, FlowShunt *connected_shunt,
+                                                   FlowUnixConnectOp *op);
+
+static void shunt_read (FlowShunt *shunt, FlowPacket *packet, FlowUnixListener *unix_listener);
+
+/* --- FlowUnixListener private data --- */
+
+struct _FlowUnixListenerPrivate
+{
+  FlowUnixSocketType  socket_type;
+
+  /* Describes accepted connections; shared by all of them */
+  FlowUnixConnectOp  *op;
+  FlowShunt          *shunt;
+
+  GQueue             *connected_shunts;
+
+  guint               waiting_for_pop;
+  GMainLoop          *pop_loop;
+
+  GMainContext       *accept_context;
+};
+
+/* --- FlowUnixListener properties --- */
+
+static FlowUnixSocketType
+flow_unix_listener_get_socket_type_internal (FlowUnixListener *unix_listener)
+{
+  FlowUnixListenerPrivate *priv = unix_listener->priv;
+
+  return priv->socket_type;
+}
+
+static void
+flow_unix_listener_set_socket_type_internal (FlowUnixListener *unix_listener, FlowUnixSocketType socket_type)
+{
+  FlowUnixListenerPrivate *priv = unix_listener->priv;
+
+  priv->socket_type = socket_type;
+}
+
+FLOW_GOBJECT_PROPERTIES_BEGIN (flow_unix_listener)
+FLOW_GOBJECT_PROPERTY_ENUM    ("socket-type", "Socket type",
+                               "Stream or seqpacket socket; takes effect when the path is set",
+                               G_PARAM_READWRITE,
+                               flow_unix_listener_get_socket_type_internal,
+                               flow_unix_listener_set_socket_type_internal,
+                               FLOW_UNIX_SOCKET_STREAM,
+                               flow_unix_socket_type_get_type)
+FLOW_GOBJECT_PROPERTIES_END   ()
+
+/* --- FlowUnixListener definition --- */
+
+FLOW_GOBJECT_MAKE_IMPL        (flow_unix_listener, FlowUnixListener, G_TYPE_OBJECT, 0)
+
+/* --- FlowUnixListener implementation --- */
+
+static void
+shunt_read (FlowShunt *shunt, FlowPacket *packet, FlowUnixListener *unix_listener)
+{
+  FlowUnixListenerPrivate *priv          = unix_listener->priv;
+  FlowPacketFormat         packet_format = flow_packet_get_format (packet);
+  gpointer                 packet_data   = flow_packet_get_data (packet);
+
+  if (packet_format == FLOW_PACKET_FORMAT_OBJECT)
+  {
+    if (FLOW_IS_ANONYMOUS_EVENT (packet_data))
+    {
+      FlowAnonymousEvent *anonymous_event = (FlowAnonymousEvent *) packet_data;
+      FlowShunt          *connected_shunt;
+
+      /* Take ownership of non-refcounted FlowShunt */
+
+      flow_anonymous_event_set_destroy_notify (anonymous_event, NULL);
+      connected_shunt = flow_anonymous_event_get_data (anonymous_event);
+
+      g_assert (connected_shunt != NULL);
+
+      g_queue_push_tail (priv->connected_shunts, connected_shunt);
+
+      if (priv->waiting_for_pop)
+      {
+        g_assert (priv->pop_loop != NULL);
+
+        g_main_loop_quit (priv->pop_loop);
+      }
+      else
+      {
+        g_signal_emit_by_name (unix_listener, "new-connection");
+      }
+    }
+  }
+
+  flow_packet_unref (packet);
+}
+
+static void
+flow_unix_listener_type_init (GType type)
+{
+}
+
+static void
+flow_unix_listener_class_init (FlowUnixListenerClass *klass)
+{
+  g_signal_newv ("new-connection",
+                 G_TYPE_FROM_CLASS (klass),
+                 G_SIGNAL_RUN_LAST | G_SIGNAL_NO_HOOKS,
+                 NULL,                                   /* Class closure */
+                 NULL, NULL,                             /* Accumulator, accu data */
+                 g_cclosure_marshal_VOID__VOID,          /* Marshaller */
+                 G_TYPE_NONE,                            /* Return type */
+                 0, NULL);                               /* Number of params, param types */
+}
+
+static void
+flow_unix_listener_init (FlowUnixListener *unix_listener)
+{
+  FlowUnixListenerPrivate *priv = unix_listener->priv;
+
+  priv->connected_shunts = g_queue_new ();
+}
+
+static void
+flow_unix_listener_construct (FlowUnixListener *unix_listener)
+{
+}
+
+static void
+flow_unix_listener_dispose (FlowUnixListener *unix_listener)
+{
+  FlowUnixListenerPrivate *priv = unix_listener->priv;
+
+  flow_gobject_unref_clear (priv->op);
+
+  if (priv->shunt)
+  {
+    flow_shunt_destroy (priv->shunt);
+    priv->shunt = NULL;
+  }
+
+  if (priv->accept_context)
+  {
+    g_main_context_unref (priv->accept_context);
+    priv->accept_context = NULL;
+  }
+}
+
+static void
+flow_unix_listener_finalize (FlowUnixListener *unix_listener)
+{
+  FlowUnixListenerPrivate *priv = unix_listener->priv;
+  FlowShunt               *connected_shunt;
+
+  if (priv->pop_loop)
+    g_main_loop_unref (priv->pop_loop);
+
+  while ((connected_shunt = g_queue_pop_head (priv->connected_shunts)))
+  {
+    flow_shunt_destroy (connected_shunt);
+  }
+
+  g_queue_free (priv->connected_shunts);
+  priv->connected_shunts = NULL;
+}
+
+/* For use in friend classes (e.g. FlowUnixIOListener) only. Pops an
+ * accepted shunt along with the op describing it, without wrapping it in
+ * a FlowUnixConnector. */
+FlowShunt *
+_flow_unix_listener_pop_connected_shunt (FlowUnixListener *unix_listener, FlowUnixConnectOp **op_out)
+{
+  FlowUnixListenerPrivate *priv = unix_listener->priv;
+
+  *op_out = priv->op;
+  return g_queue_pop_head (priv->connected_shunts);
+}
+
+static FlowUnixConnector *
+pop_connection (FlowUnixListener *unix_listener)
+{
+  FlowUnixListenerPrivate *priv = unix_listener->priv;
+  FlowUnixConnector       *unix_connector;
+  FlowShunt               *connected_shunt;
+
+  connected_shunt = g_queue_pop_head (priv->connected_shunts);
+  if (!connected_shunt)
+    return NULL;
+
+  unix_connector = flow_unix_connector_new ();
+  _flow_unix_connector_install_connected_shunt (unix_connector, connected_shunt, priv->op);
+
+  return unix_connector;
+}
+
+/* --- FlowUnixListener public API --- */
+
+FlowUnixListener *
+flow_unix_listener_new (void)
+{
+  return g_object_new (FLOW_TYPE_UNIX_LISTENER, NULL);
+}
+
+const gchar *
+flow_unix_listener_get_path (FlowUnixListener *unix_listener)
+{
+  FlowUnixListenerPrivate *priv;
+
+  g_return_val_if_fail (FLOW_IS_UNIX_LISTENER (unix_listener), NULL);
+
+  priv = unix_listener->priv;
+
+  if (!priv->op)
+    return NULL;
+
+  return flow_unix_connect_op_get_path (priv->op);
+}
+
+/**
+ * flow_unix_listener_set_path:
+ * @unix_listener: A #FlowUnixListener.
+ * @path:          Path to listen on, or %NULL to stop listening.
+ * @error_event:   Return location for a #FlowDetailedEvent describing a
+ *                 failure, or %NULL.
+ *
+ * Starts listening on @path, using the socket type given by the
+ * "socket-type" property. The socket file is created, and removed again
+ * when the listener stops. Nothing may exist at @path beforehand; remove
+ * stale sockets before calling this. On Linux, a @path starting with '@'
+ * names a socket in the abstract namespace instead.
+ *
+ * Return value: %TRUE on success, %FALSE if the socket could not be bound.
+ **/
+gboolean
+flow_unix_listener_set_path (FlowUnixListener *unix_listener, const gchar *path, FlowDetailedEvent **result_event)
+{
+  FlowUnixListenerPrivate *priv;
+  gboolean                 result = TRUE;
+
+  g_return_val_if_fail (FLOW_IS_UNIX_LISTENER (unix_listener), FALSE);
+
+  priv = unix_listener->priv;
+
+  flow_gobject_unref_clear (priv->op);
+
+  if (priv->shunt)
+  {
+    flow_shunt_destroy (priv->shunt);
+    priv->shunt = NULL;
+  }
+
+  /* If path is NULL, don't listen to anything */
+
+  if (path)
+  {
+    gpointer object;
+
+    priv->shunt = flow_open_unix_listener (path, priv->socket_type);
+
+    while ((object = flow_read_object_from_shunt (priv->shunt)))
+    {
+      if (FLOW_IS_DETAILED_EVENT (object))
+        break;
+
+      g_object_unref (object);
+    }
+
+    /* There must be an event describing the result of the bind */
+    g_assert (object != NULL);
+
+    if (flow_detailed_event_matches (object, FLOW_STREAM_DOMAIN, FLOW_STREAM_BEGIN))
+    {
+      priv->op = flow_unix_connect_op_new (path, priv->socket_type);
+
+      if (priv->accept_context)
+        flow_shunt_set_accept_context (priv->shunt, priv->accept_context);
+
+      flow_shunt_set_read_func (priv->shunt, (FlowShuntReadFunc *) shunt_read, unix_listener);
+      g_object_unref (object);
+    }
+    else
+    {
+      flow_shunt_destroy (priv->shunt);
+      priv->shunt = NULL;
+      result = FALSE;
+
+      if (result_event)
+        *result_event = object;
+      else
+        g_object_unref (object);
+    }
+  }
+
+  return result;
+}
+
+GMainContext *
+flow_unix_listener_get_accept_context (FlowUnixListener *unix_listener)
+{
+  g_return_val_if_fail (FLOW_IS_UNIX_LISTENER (unix_listener), NULL);
+
+  return unix_listener->priv->accept_context;
+}
+
+/**
+ * flow_unix_listener_set_accept_context:
+ * @unix_listener: A #FlowUnixListener.
+ * @main_context:  A #GMainContext, or %NULL.
+ *
+ * Makes connections accepted from now on do their I/O in @main_context.
+ * See flow_tcp_listener_set_accept_context () for details.
+ **/
+void
+flow_unix_listener_set_accept_context (FlowUnixListener *unix_listener, GMainContext *main_context)
+{
+  FlowUnixListenerPrivate *priv;
+
+  g_return_if_fail (FLOW_IS_UNIX_LISTENER (unix_listener));
+
+  priv = unix_listener->priv;
+
+  if (main_context)
+    g_main_context_ref (main_context);
+
+  if (priv->accept_context)
+    g_main_context_unref (priv->accept_context);
+
+  priv->accept_context = main_context;
+
+  if (priv->shunt)
+    flow_shunt_set_accept_context (priv->shunt, main_context);
+}
+
+FlowUnixConnector *
+flow_unix_listener_pop_connection (FlowUnixListener *unix_listener)
+{
+  g_return_val_if_fail (FLOW_IS_UNIX_LISTENER (unix_listener), NULL);
+
+  return pop_connection (unix_listener);
+}
+
+FlowUnixConnector *
+flow_unix_listener_sync_pop_connection (FlowUnixListener *unix_listener)
+{
+  FlowUnixListenerPrivate *priv;
+  FlowUnixConnector       *unix_connector;
+
+  g_return_val_if_fail (FLOW_IS_UNIX_LISTENER (unix_listener), NULL);
+
+  priv = unix_listener->priv;
+
+  priv->waiting_for_pop++;
+
+  while (!(unix_connector = pop_connection (unix_listener)))
+  {
+    if G_UNLIKELY (!priv->pop_loop)
+    {
+      GMainContext *main_context;
+
+      main_context = flow_get_main_context_for_current_thread ();
+      priv->pop_loop = g_main_loop_new (main_context, FALSE);
+    }
+
+    g_main_loop_run (priv->pop_loop);
+  }
+
+  priv->waiting_for_pop--;
+
+  return unix_connector;
+}
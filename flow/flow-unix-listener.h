@@ -0,0 +1,83 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* flow-unix-listener.h - Unix domain socket listener.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+#ifndef _FLOW_UNIX_LISTENER_H
+#define _FLOW_UNIX_LISTENER_H
+
+#include <glib-object.h>
+#include <flow-unix-connector.h>
+#include <flow-shunt.h>
+
+G_BEGIN_DECLS
+
+#define FLOW_TYPE_UNIX_LISTENER            (flow_unix_listener_get_type ())
+#define FLOW_UNIX_LISTENER(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), FLOW_TYPE_UNIX_LISTENER, FlowUnixListener))
+#define FLOW_UNIX_LISTENER_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), FLOW_TYPE_UNIX_LISTENER, FlowUnixListenerClass))
+#define FLOW_IS_UNIX_LISTENER(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), FLOW_TYPE_UNIX_LISTENER))
+#define FLOW_IS_UNIX_LISTENER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), FLOW_TYPE_UNIX_LISTENER))
+#define FLOW_UNIX_LISTENER_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), FLOW_TYPE_UNIX_LISTENER, FlowUnixListenerClass))
+GType   flow_unix_listener_get_type        (void) G_GNUC_CONST;
+
+typedef struct _FlowUnixListener        FlowUnixListener;
+typedef struct _FlowUnixListenerPrivate FlowUnixListenerPrivate;
+typedef struct _FlowUnixListenerClass   FlowUnixListenerClass;
+
+struct _FlowUnixListener
+{
+  GObject          parent;
+
+  /*< private >*/
+
+  FlowUnixListenerPrivate *priv;
+};
+
+struct _FlowUnixListenerClass
+{
+  GObjectClass parent_class;
+
+  /*< private >*/
+
+  /* Padding for future expansion */
+
+  void (*_pad_1) (void);
+  void (*_pad_2) (void);
+  void (*_pad_3) (void);
+  void (*_pad_4) (void);
+};
+
+FlowUnixListener   *flow_unix_listener_new                 (void);
+
+const gchar        *flow_unix_listener_get_path            (FlowUnixListener *unix_listener);
+gboolean            flow_unix_listener_set_path            (FlowUnixListener *unix_listener, const gchar *path,
+                                                            FlowDetailedEvent **error_event);
+
+GMainContext       *flow_unix_listener_get_accept_context  (FlowUnixListener *unix_listener);
+void                flow_unix_listener_set_accept_context  (FlowUnixListener *unix_listener, GMainContext *main_context);
+
+FlowUnixConnector  *flow_unix_listener_pop_connection      (FlowUnixListener *unix_listener);
+FlowUnixConnector  *flow_unix_listener_sync_pop_connection (FlowUnixListener *unix_listener);
+
+G_END_DECLS
+
+#endif  /* _FLOW_UNIX_LISTENER_H */
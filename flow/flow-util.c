@@ -245,3 +245,14 @@ flow_unref_and_free_object_list (GList *object_list)
 
   g_list_free (object_list);
 }
+
+/* Clears sensitive data. Unlike memset (), the stores can't be elided
+ * when the memory is about to be freed or go out of scope. */
+void
+flow_wipe_memory (gpointer mem, gsize len)
+{
+  volatile guint8 *p = mem;
+
+  while (len--)
+    *p++ = 0;
+}
@@ -45,6 +45,7 @@ guint        flow_g_ptr_array_compress             (GPtrArray *array);
 void         flow_unref_and_free_object_list       (GList *object_list);
 
 gchar       *flow_strerror                         (gint errnum);
+void         flow_wipe_memory                      (gpointer mem, gsize len);
 
 G_END_DECLS
 
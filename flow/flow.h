@@ -41,6 +41,7 @@
 #include <flow/flow-input-pad.h>
 #include <flow/flow-io.h>
 #include <flow/flow-ip-addr.h>
+#include <flow/flow-ip-endpoint.h>
 #include <flow/flow-ip-resolver.h>
 #include <flow/flow-ip-service.h>
 #include <flow/flow-joiner.h>
@@ -62,6 +63,7 @@
 #include <flow/flow-shell-op.h>
 #include <flow/flow-shunt.h>
 #include <flow/flow-simplex-element.h>
+#include <flow/flow-sockopt-op.h>
 #include <flow/flow-splitter.h>
 #include <flow/flow-ssh-connect-op.h>
 #include <flow/flow-ssh-runner.h>
@@ -70,9 +72,17 @@
 #include <flow/flow-tcp-connector.h>
 #include <flow/flow-tcp-io.h>
 #include <flow/flow-tcp-io-listener.h>
+#include <flow/flow-tcp-io-pool.h>
 #include <flow/flow-tcp-listener.h>
+#include <flow/flow-tls-credentials.h>
 #include <flow/flow-tls-protocol.h>
 #include <flow/flow-tls-tcp-io.h>
 #include <flow/flow-tls-tcp-io-listener.h>
+#include <flow/flow-unix-connect-op.h>
+#include <flow/flow-unix-connector.h>
+#include <flow/flow-unix-fds.h>
+#include <flow/flow-unix-io.h>
+#include <flow/flow-unix-io-listener.h>
+#include <flow/flow-unix-listener.h>
 #include <flow/flow-user-adapter.h>
 #include <flow/flow-util.h>
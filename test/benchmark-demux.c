@@ -0,0 +1,101 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* benchmark-demux.c - Benchmark channel switching in FlowDemux.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+#define BENCHMARK_UNIT_NAME "demux"
+
+#include "benchmark-common.c"
+
+#define CHANNEL_DOUBLINGS     13
+#define SUBTEST_SECONDS       2
+#define PACKET_SIZE           64
+
+/* Spread channel IDs out by this factor to exercise the sparse fallback */
+#if defined (BENCHMARK_SPARSE_CHANNELS)
+# define CHANNEL_ID_STRIDE    1000
+#else
+# define CHANNEL_ID_STRIDE    1
+#endif
+
+static void
+benchmark_n_channels (guint n_channels)
+{
+  FlowDemux      *demux;
+  FlowPad        *input_pad;
+  FlowPad       **output_pads;
+  FlowPacket     *packet;
+  guchar          buf [PACKET_SIZE];
+  gint            n_switches = 0;
+  guint           i;
+
+  demux = flow_demux_new ();
+  input_pad = FLOW_PAD (flow_splitter_get_input_pad (FLOW_SPLITTER (demux)));
+  output_pads = g_new (FlowPad *, n_channels);
+
+  for (i = 0; i < n_channels; i++)
+    output_pads [i] = FLOW_PAD (flow_demux_add_channel (demux, i * CHANNEL_ID_STRIDE));
+
+  memset (buf, 0, PACKET_SIZE);
+
+  benchmark_start_cpu_timer (SUBTEST_SECONDS);
+
+  while (benchmark_is_running)
+  {
+    FlowPacketQueue *packet_queue;
+    guint            channel = g_random_int_range (0, n_channels);
+
+    /* Interleave a channel switch with every data packet, and drain the
+     * unconnected output pad's queue so it doesn't grow. */
+
+    flow_pad_push (input_pad, flow_packet_new_take_object (flow_mux_event_new (channel * CHANNEL_ID_STRIDE), 0));
+    flow_pad_push (input_pad, flow_packet_new (FLOW_PACKET_FORMAT_BUFFER, buf, PACKET_SIZE));
+
+    packet_queue = flow_pad_get_packet_queue (output_pads [channel]);
+    packet = flow_packet_queue_pop_packet (packet_queue);
+
+    g_assert (packet != NULL);
+
+    flow_packet_unref (packet);
+    n_switches++;
+  }
+
+  benchmark_add_data_point (n_channels, (gdouble) n_switches / (gdouble) SUBTEST_SECONDS);
+
+  g_free (output_pads);
+  g_object_unref (demux);
+}
+
+static void
+benchmark_run (void)
+{
+  guint i;
+  guint n_channels;
+
+  benchmark_begin_data_plot ("Demux channel switching", "Channels", "Switches (1/s)");
+  benchmark_begin_data_set ();
+
+  for (i = 0, n_channels = 1; i < CHANNEL_DOUBLINGS; i++, n_channels <<= 1)
+  {
+    benchmark_n_channels (n_channels);
+  }
+}
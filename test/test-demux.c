@@ -31,8 +31,14 @@
 #define BUFFER_SIZE 4096
 #define ITERATIONS 500
 
+/* Channel i on pad i, as channels are usually numbered */
+static const guint dense_channel_ids [N_PADS] = { 0, 1, 2, 3, 4 };
+
+/* Mix of dense and sparse channel IDs */
+static const guint sparse_channel_ids [N_PADS] = { 0, 1, 2, 1000, 1 << 20 };
+
 static void
-test_run (void)
+run_demux (const guint *channel_ids)
 {
   FlowDemux *demux;
   FlowOutputPad *o_pads[N_PADS];
@@ -50,7 +56,7 @@ test_run (void)
   for (i = 0; i < N_PADS; i++)
   {
     expected_packets[i] = NULL;
-    o_pads[i] = flow_demux_add_channel (demux, i);
+    o_pads[i] = flow_demux_add_channel (demux, channel_ids[i]);
     adapters[i] = flow_user_adapter_new ();
     flow_pad_connect (FLOW_PAD (o_pads[i]),
                       FLOW_PAD (flow_simplex_element_get_input_pad (
@@ -80,7 +86,7 @@ test_run (void)
     if (last_channel_id != k)
     {
       flow_pad_push (FLOW_PAD (input_pad),
-                     flow_packet_new_take_object (flow_mux_event_new (k), 0));
+                     flow_packet_new_take_object (flow_mux_event_new (channel_ids[k]), 0));
       last_channel_id = k;
     }
     flow_pad_push (FLOW_PAD (input_pad), packet);
@@ -97,4 +103,13 @@ test_run (void)
     expected_packets[i] = g_list_reverse (expected_packets[i]);
     check_user_adapter_packets (adapters[i], expected_packets[i]);
   }
+
+  g_free (buffer);
+}
+
+static void
+test_run (void)
+{
+  run_demux (dense_channel_ids);
+  run_demux (sparse_channel_ids);
 }
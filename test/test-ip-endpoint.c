@@ -0,0 +1,122 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* test-ip-endpoint.c - FlowIPEndpoint test.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+
+#define TEST_UNIT_NAME "FlowIPEndpoint"
+#define TEST_TIMEOUT_S 20
+
+#include "test-common.c"
+
+static void
+set_endpoint (FlowIPEndpoint *endpoint, const gchar *addr_str, gint port)
+{
+  FlowIPAddr *ip_addr;
+
+  ip_addr = flow_ip_addr_new ();
+
+  if (!flow_ip_addr_set_string (ip_addr, addr_str))
+    test_end (TEST_RESULT_FAILED, "could not parse address");
+
+  if (!flow_ip_endpoint_set_ip_addr (endpoint, ip_addr, port))
+    test_end (TEST_RESULT_FAILED, "could not set endpoint from address");
+
+  g_object_unref (ip_addr);
+}
+
+static void
+test_run (void)
+{
+  FlowIPEndpoint  a, b, c, d;
+  FlowIPService  *ip_service;
+  FlowIPAddr     *ip_addr;
+  GHashTable     *table;
+  gchar          *str;
+
+  set_endpoint (&a, "192.168.1.10", 5000);
+  set_endpoint (&b, "192.168.1.10", 5000);
+  set_endpoint (&c, "192.168.1.10", 5001);
+  set_endpoint (&d, "fe80::1", 5000);
+
+  /* Equality and ordering */
+
+  if (!flow_ip_endpoint_equal (&a, &b) || flow_ip_endpoint_compare (&a, &b) != 0)
+    test_end (TEST_RESULT_FAILED, "identical endpoints differ");
+
+  if (flow_ip_endpoint_hash (&a) != flow_ip_endpoint_hash (&b))
+    test_end (TEST_RESULT_FAILED, "identical endpoints hash differently");
+
+  if (flow_ip_endpoint_equal (&a, &c) || flow_ip_endpoint_compare (&a, &c) >= 0)
+    test_end (TEST_RESULT_FAILED, "port not compared");
+
+  if (!flow_ip_endpoint_addr_equal (&a, &c))
+    test_end (TEST_RESULT_FAILED, "addresses should match regardless of port");
+
+  if (flow_ip_endpoint_equal (&a, &d) || flow_ip_endpoint_compare (&a, &d) >= 0)
+    test_end (TEST_RESULT_FAILED, "family not compared");
+
+  /* Formatting */
+
+  str = flow_ip_endpoint_get_string (&a);
+  test_print ("%s\n", str);
+  if (strcmp (str, "192.168.1.10:5000"))
+    test_end (TEST_RESULT_FAILED, "bad IPv4 endpoint string");
+  g_free (str);
+
+  str = flow_ip_endpoint_get_string (&d);
+  test_print ("%s\n", str);
+  if (strncmp (str, "[", 1) || !g_str_has_suffix (str, "]:5000"))
+    test_end (TEST_RESULT_FAILED, "bad IPv6 endpoint string");
+  g_free (str);
+
+  /* Round trip through FlowIPService */
+
+  ip_service = flow_ip_endpoint_to_ip_service (&d);
+
+  if (flow_ip_service_get_port (ip_service) != 5000)
+    test_end (TEST_RESULT_FAILED, "wrong port in service");
+
+  ip_addr = flow_ip_service_get_nth_address (ip_service, 0);
+  if (!ip_addr || flow_ip_addr_get_family (ip_addr) != FLOW_IP_ADDR_IPV6)
+    test_end (TEST_RESULT_FAILED, "wrong address in service");
+  g_object_unref (ip_addr);
+
+  flow_ip_endpoint_clear (&b);
+  if (!flow_ip_endpoint_set_ip_service (&b, ip_service) || !flow_ip_endpoint_equal (&b, &d))
+    test_end (TEST_RESULT_FAILED, "service round trip changed endpoint");
+
+  g_object_unref (ip_service);
+
+  /* Use as hash key */
+
+  table = g_hash_table_new (flow_ip_endpoint_hash, flow_ip_endpoint_equal);
+  g_hash_table_insert (table, &a, GINT_TO_POINTER (1));
+  g_hash_table_insert (table, &c, GINT_TO_POINTER (2));
+  g_hash_table_insert (table, &d, GINT_TO_POINTER (3));
+
+  set_endpoint (&b, "192.168.1.10", 5001);
+  if (GPOINTER_TO_INT (g_hash_table_lookup (table, &b)) != 2)
+    test_end (TEST_RESULT_FAILED, "hash lookup failed");
+
+  g_hash_table_destroy (table);
+}
@@ -0,0 +1,174 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* test-ip-resolver-cache.c - FlowIPResolver cache test.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+#define TEST_UNIT_NAME "FlowIPResolver cache"
+#define TEST_TIMEOUT_S 20
+
+#include "test-common.c"
+
+/* Numeric names are resolved locally, so this works without a network */
+
+#define RESOLVE_NAME      "127.0.0.1"
+#define N_CONCURRENT      8
+
+static gint to_resolve;
+
+static void
+resolved (GList *addr_list, GList *name_list, GError *error, gpointer data)
+{
+  gchar *ip_addr_str;
+
+  if (error)
+    test_end (TEST_RESULT_FAILED, "lookup failed");
+
+  if (!addr_list || g_list_length (addr_list) != 1)
+    test_end (TEST_RESULT_FAILED, "wrong number of addresses");
+
+  ip_addr_str = flow_ip_addr_get_string (addr_list->data);
+  test_print ("%s -> %s\n", RESOLVE_NAME, ip_addr_str);
+
+  if (strcmp (ip_addr_str, RESOLVE_NAME))
+    test_end (TEST_RESULT_FAILED, "wrong address");
+
+  g_free (ip_addr_str);
+
+  if (--to_resolve == 0)
+    test_quit_main_loop ();
+}
+
+static void
+resolve_batch (FlowIPResolver *ip_resolver, gint n)
+{
+  gint i;
+
+  to_resolve = n;
+
+  for (i = 0; i < n; i++)
+    flow_ip_resolver_resolve_name (ip_resolver, RESOLVE_NAME, (FlowIPLookupFunc *) resolved, NULL);
+
+  test_run_main_loop ();
+}
+
+static const gchar *batch_names [] = { "127.0.0.1", "127.0.0.2", "127.0.0.3", "127.0.0.1", NULL };
+
+static void
+batch_resolved (gchar **names, GList **addr_lists, GError **errors, gpointer data)
+{
+  gint i;
+
+  for (i = 0; batch_names [i]; i++)
+  {
+    gchar *ip_addr_str;
+
+    if (!names [i] || strcmp (names [i], batch_names [i]))
+      test_end (TEST_RESULT_FAILED, "batch names out of order");
+
+    if (errors [i])
+      test_end (TEST_RESULT_FAILED, "batch lookup failed");
+
+    if (!addr_lists [i] || g_list_length (addr_lists [i]) != 1)
+      test_end (TEST_RESULT_FAILED, "wrong number of addresses in batch");
+
+    ip_addr_str = flow_ip_addr_get_string (addr_lists [i]->data);
+    test_print ("%s -> %s (batch)\n", names [i], ip_addr_str);
+
+    if (strcmp (ip_addr_str, names [i]))
+      test_end (TEST_RESULT_FAILED, "wrong address in batch");
+
+    g_free (ip_addr_str);
+  }
+
+  test_quit_main_loop ();
+}
+
+static void
+resolve_names (FlowIPResolver *ip_resolver, guint max_in_flight)
+{
+  flow_ip_resolver_resolve_names (ip_resolver, batch_names, max_in_flight,
+                                  (FlowIPBatchLookupFunc *) batch_resolved, NULL);
+  test_run_main_loop ();
+}
+
+static void
+check_stats (FlowIPResolver *ip_resolver, guint64 misses, guint64 hits_and_joined)
+{
+  FlowIPResolverCacheStats stats;
+
+  flow_ip_resolver_get_cache_stats (ip_resolver, &stats);
+
+  test_print ("Hits: %" G_GUINT64_FORMAT ", misses: %" G_GUINT64_FORMAT ", joined: %" G_GUINT64_FORMAT "\n",
+              stats.hits, stats.misses, stats.joined);
+
+  /* Whether a request joins a lookup in progress or hits the cache depends
+   * on thread timing, but it must be one or the other */
+
+  if (stats.misses != misses || stats.hits + stats.joined != hits_and_joined)
+    test_end (TEST_RESULT_FAILED, "unexpected cache statistics");
+}
+
+static void
+test_run (void)
+{
+  FlowIPResolver *ip_resolver;
+
+  ip_resolver = flow_ip_resolver_new ();
+
+  /* Concurrent lookups of one name should share a single resolution */
+
+  resolve_batch (ip_resolver, N_CONCURRENT);
+  check_stats (ip_resolver, 1, N_CONCURRENT - 1);
+
+  /* Now it's cached */
+
+  resolve_batch (ip_resolver, N_CONCURRENT);
+  check_stats (ip_resolver, 1, 2 * N_CONCURRENT - 1);
+
+  /* After clearing, we have to resolve again */
+
+  flow_ip_resolver_clear_cache (ip_resolver);
+  resolve_batch (ip_resolver, 1);
+  check_stats (ip_resolver, 2, 2 * N_CONCURRENT - 1);
+
+  /* With caching disabled, every sequential lookup is a miss */
+
+  g_object_set (ip_resolver, "cache-size", 0, NULL);
+  resolve_batch (ip_resolver, 1);
+  resolve_batch (ip_resolver, 1);
+  check_stats (ip_resolver, 4, 2 * N_CONCURRENT - 1);
+
+  g_object_unref (ip_resolver);
+
+  /* A batch resolves every name it's given, in order, and fills the cache
+   * for the next one */
+
+  ip_resolver = flow_ip_resolver_new ();
+
+  resolve_names (ip_resolver, 2);
+  check_stats (ip_resolver, 4, 0);
+
+  resolve_names (ip_resolver, 0);
+  check_stats (ip_resolver, 4, 4);
+
+  g_object_unref (ip_resolver);
+}
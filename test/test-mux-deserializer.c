@@ -27,6 +27,7 @@
 #include "test-common.c"
 
 #define N_CHANNELS 5
+#define VARINT_CHANNEL_BASE 100000
 #define BUFFER_SIZE 4096
 #define MAX_CHUNK_SIZE (1 << 16)
 #define ITERATIONS 500
@@ -48,7 +49,7 @@ add_chunk (GQueue *expected_chunks, guint channel_id, guint32 size)
 }
 
 static void
-test_run (void)
+run_with_ops (FlowMuxHeaderOps *ops, guint channel_base)
 {
   FlowMuxDeserializer *deserializer;
   FlowUserAdapter *adapter;
@@ -63,6 +64,7 @@ test_run (void)
   guint current_channel_id;
   
   deserializer = flow_mux_deserializer_new ();
+  flow_mux_deserializer_set_header_ops (deserializer, ops, NULL);
 
   adapter = flow_user_adapter_new ();
   flow_pad_connect (FLOW_PAD (flow_simplex_element_get_output_pad (
@@ -81,10 +83,9 @@ test_run (void)
     FlowPacket *header;
     guint hdr_size;
     
-    current_channel_id = g_random_int_range (0, N_CHANNELS);
+    current_channel_id = channel_base + g_random_int_range (0, N_CHANNELS);
     len = g_random_int_range (1, MAX_CHUNK_SIZE);
-    hdr_size = flow_mux_deserializer_get_header_size (deserializer);
-    flow_mux_deserializer_unparse_header (deserializer, buffer, current_channel_id, len);
+    hdr_size = flow_mux_deserializer_pack_header (deserializer, buffer, current_channel_id, len);
     header = flow_packet_new (FLOW_PACKET_FORMAT_BUFFER, buffer, hdr_size);
     flow_pad_push (input_pad, header);
     add_chunk (expected_chunks, current_channel_id, len);
@@ -140,3 +141,13 @@ test_run (void)
   g_queue_free (expected_chunks);
   g_free (buffer);
 }
+
+static void
+test_run (void)
+{
+  test_print ("Fixed-size headers\n");
+  run_with_ops (&flow_mux_serializer_default_ops, 0);
+
+  test_print ("Variable-length headers with large channel IDs\n");
+  run_with_ops (&flow_mux_serializer_varint_ops, VARINT_CHANNEL_BASE);
+}
@@ -27,6 +27,7 @@
 #include "test-common.c"
 
 #define N_CHANNELS 5
+#define VARINT_CHANNEL_BASE 100000
 #define BUFFER_SIZE 4096
 #define ITERATIONS 500
 #define BUFFER_PROPABILITY 5
@@ -47,7 +48,7 @@ add_chunk (GQueue *expected_chunks, guint channel_id, guint32 size)
 }
 
 static void
-test_run (void)
+run_with_ops (FlowMuxHeaderOps *ops, guint channel_base)
 {
   FlowMuxSerializer *serializer;
   FlowUserAdapter *adapter;
@@ -64,6 +65,7 @@ test_run (void)
   guint hdr_size;
   
   serializer = flow_mux_serializer_new ();
+  flow_mux_serializer_set_header_ops (serializer, ops, NULL);
 
   adapter = flow_user_adapter_new ();
   flow_pad_connect (FLOW_PAD (flow_simplex_element_get_output_pad (
@@ -74,7 +76,7 @@ test_run (void)
   
   buffer = g_malloc (BUFFER_SIZE);
 
-  current_channel_id = g_random_int_range (0, N_CHANNELS);
+  current_channel_id = channel_base + g_random_int_range (0, N_CHANNELS);
   flow_pad_push (input_pad, flow_packet_new_take_object (flow_mux_event_new (current_channel_id), 0));
   chunk_size = 0;
   expected_chunks = g_queue_new ();
@@ -90,7 +92,7 @@ test_run (void)
     }
     else
     {
-      guint channel_id = g_random_int_range (0, N_CHANNELS);
+      guint channel_id = channel_base + g_random_int_range (0, N_CHANNELS);
 
       add_chunk (expected_chunks, current_channel_id, chunk_size);
       
@@ -111,16 +113,22 @@ test_run (void)
 
   while ((chunk = g_queue_pop_head (expected_chunks)) != NULL)
   {
+    FlowPacketByteIter byte_iter;
+    const guchar *hdr_p = hdr_buffer;
     guint channel_id;
     guint32 size;
 
     while (!flow_packet_queue_peek_packet (input_packet_queue, NULL, NULL))
       flow_user_adapter_wait_for_input (adapter);
-    
-    if (!flow_packet_queue_pop_bytes_exact (input_packet_queue, hdr_buffer, hdr_size))
+
+    flow_packet_byte_iter_init (input_packet_queue, &byte_iter);
+    len = flow_packet_byte_iter_peek (&byte_iter, hdr_buffer, hdr_size);
+
+    if (!flow_mux_serializer_unpack_header (serializer, &hdr_p, hdr_buffer + len,
+                                            &channel_id, &size))
       test_end (TEST_RESULT_FAILED, "header corrupted");
-    
-    flow_mux_serializer_parse_header (serializer, hdr_buffer, &channel_id, &size);
+
+    flow_packet_queue_pop_bytes (input_packet_queue, NULL, hdr_p - hdr_buffer);
     if (chunk->channel_id != channel_id || chunk->size != size)
       test_end (TEST_RESULT_FAILED, "chunk corrupt");
 
@@ -140,3 +148,13 @@ test_run (void)
   g_queue_free (expected_chunks);
   g_free (buffer);
 }
+
+static void
+test_run (void)
+{
+  test_print ("Fixed-size headers\n");
+  run_with_ops (&flow_mux_serializer_default_ops, 0);
+
+  test_print ("Variable-length headers with large channel IDs\n");
+  run_with_ops (&flow_mux_serializer_varint_ops, VARINT_CHANNEL_BASE);
+}
@@ -111,6 +111,130 @@ test_pack_unpack (FlowPacketQueue *packet_queue)
     test_end (TEST_RESULT_FAILED, "byte iter bad remaining length (should be 0)");
 }
 
+#define ARRAY_LEN 1000
+
+/* Pushes data in small, uneven chunks, so values straddle packets */
+static void
+push_bytes_chunked (FlowPacketQueue *packet_queue, const guchar *buf, gint len)
+{
+  while (len > 0)
+  {
+    gint n = MIN (len, g_random_int_range (1, 40));
+
+    flow_packet_queue_push_bytes (packet_queue, buf, n);
+    buf += n;
+    len -= n;
+  }
+}
+
+static void
+test_pack_unpack_arrays (FlowPacketQueue *packet_queue)
+{
+  FlowPacketByteIter iter;
+  guint32 *a32, *b32;
+  guint64 *a64, *b64;
+  gchar *strings [16];
+  gchar *strings_out [16];
+  guchar *buf;
+  guchar *p;
+  const guchar *q;
+  gint i;
+
+  buf = g_malloc (ARRAY_LEN * FLOW_PACK_UINT64_MAX_SIZE);
+  a32 = g_new (guint32, ARRAY_LEN);
+  b32 = g_new (guint32, ARRAY_LEN);
+  a64 = g_new (guint64, ARRAY_LEN);
+  b64 = g_new (guint64, ARRAY_LEN);
+
+  /* Mostly small values, with occasional large ones breaking up the runs */
+
+  for (i = 0; i < ARRAY_LEN; i++)
+  {
+    a32 [i] = (i % 37 == 0) ? g_random_int () : (guint32) (i & 0x7f);
+    a64 [i] = (i % 41 == 0) ? ((guint64) g_random_int () << 32) | g_random_int () : (guint64) (i & 0x7f);
+  }
+
+  a32 [ARRAY_LEN - 1] = 0xffffffff;
+  a64 [ARRAY_LEN - 1] = 0xffffffffffffffff;
+
+  /* uint32, contiguous */
+
+  p = flow_pack_uint32_array (a32, ARRAY_LEN, buf);
+  q = buf;
+  if (flow_unpack_uint32_array (&q, p, b32, ARRAY_LEN) != ARRAY_LEN || q != p ||
+      memcmp (a32, b32, ARRAY_LEN * sizeof (guint32)))
+    test_end (TEST_RESULT_FAILED, "uint32 array mismatch");
+
+  /* Truncated input must stop at the last complete value */
+
+  q = buf;
+  if (flow_unpack_uint32_array (&q, p - 1, b32, ARRAY_LEN) != ARRAY_LEN - 1)
+    test_end (TEST_RESULT_FAILED, "truncated uint32 array unpacked wrong number of values");
+
+  /* uint32, through queue */
+
+  push_bytes_chunked (packet_queue, buf, p - buf);
+  memset (b32, 0, ARRAY_LEN * sizeof (guint32));
+
+  flow_packet_byte_iter_init (packet_queue, &iter);
+  if (flow_unpack_uint32_array_from_iter (&iter, b32, ARRAY_LEN) != ARRAY_LEN ||
+      memcmp (a32, b32, ARRAY_LEN * sizeof (guint32)))
+    test_end (TEST_RESULT_FAILED, "uint32 array from iter mismatch");
+
+  flow_packet_byte_iter_drop_preceding_data (&iter);
+  if (flow_packet_queue_get_length_bytes (packet_queue) != 0)
+    test_end (TEST_RESULT_FAILED, "uint32 array from iter left data behind");
+
+  /* uint64, contiguous */
+
+  p = flow_pack_uint64_array (a64, ARRAY_LEN, buf);
+  q = buf;
+  if (flow_unpack_uint64_array (&q, p, b64, ARRAY_LEN) != ARRAY_LEN || q != p ||
+      memcmp (a64, b64, ARRAY_LEN * sizeof (guint64)))
+    test_end (TEST_RESULT_FAILED, "uint64 array mismatch");
+
+  /* uint64, through queue */
+
+  push_bytes_chunked (packet_queue, buf, p - buf);
+  memset (b64, 0, ARRAY_LEN * sizeof (guint64));
+
+  flow_packet_byte_iter_init (packet_queue, &iter);
+  if (flow_unpack_uint64_array_from_iter (&iter, b64, ARRAY_LEN) != ARRAY_LEN ||
+      memcmp (a64, b64, ARRAY_LEN * sizeof (guint64)))
+    test_end (TEST_RESULT_FAILED, "uint64 array from iter mismatch");
+
+  flow_packet_byte_iter_drop_preceding_data (&iter);
+
+  /* Strings */
+
+  for (i = 0; i < 16; i++)
+    strings [i] = g_strnfill (i * 7, 'a' + i);
+
+  p = flow_pack_string_array ((const gchar * const *) strings, 16, buf);
+  push_bytes_chunked (packet_queue, buf, p - buf);
+
+  flow_packet_byte_iter_init (packet_queue, &iter);
+  if (flow_unpack_string_array_from_iter (&iter, strings_out, 16) != 16)
+    test_end (TEST_RESULT_FAILED, "string array from iter unpacked wrong number of values");
+
+  for (i = 0; i < 16; i++)
+  {
+    if (strcmp (strings [i], strings_out [i]))
+      test_end (TEST_RESULT_FAILED, "string array mismatch");
+
+    g_free (strings [i]);
+    g_free (strings_out [i]);
+  }
+
+  flow_packet_byte_iter_drop_preceding_data (&iter);
+
+  g_free (a32);
+  g_free (b32);
+  g_free (a64);
+  g_free (b64);
+  g_free (buf);
+}
+
 static void
 test_run (void)
 {
@@ -143,6 +267,7 @@ test_run (void)
   }
 
   test_pack_unpack (packet_queue);
+  test_pack_unpack_arrays (packet_queue);
 
   g_object_unref (packet_queue);
   g_free (packets);
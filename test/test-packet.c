@@ -34,8 +34,12 @@ static void
 test_run (void)
 {
   FlowPacket *packet;
+  FlowPacket *slice;
+  FlowPacket *copy;
   guchar     *buffer;
   guint       len;
+  guint       offset;
+  guint       base;
   gint        i;
 
   buffer = g_malloc (BUFFER_SIZE);
@@ -58,6 +62,41 @@ test_run (void)
 
     flow_packet_unref (packet);
 
+    /* Test slice of buffer, and slice of slice */
+
+    for (offset = 0; offset < len; offset++)
+      buffer [offset] = offset & 0xff;
+
+    packet = flow_packet_new (FLOW_PACKET_FORMAT_BUFFER, buffer, len);
+    offset = g_random_int_range (0, len);
+
+    slice = flow_packet_new_slice (packet, offset, len - offset);
+    flow_packet_unref (packet);
+
+    if (flow_packet_get_format (slice) != FLOW_PACKET_FORMAT_BUFFER)
+      test_end (TEST_RESULT_FAILED, "wrong format for slice");
+    if (flow_packet_get_size (slice) != len - offset)
+      test_end (TEST_RESULT_FAILED, "wrong size for slice");
+    if (memcmp (flow_packet_get_data (slice), buffer + offset, len - offset))
+      test_end (TEST_RESULT_FAILED, "bad data in slice");
+
+    packet = slice;
+    base = offset;
+    len -= offset;
+    offset = g_random_int_range (0, len);
+
+    slice = flow_packet_new_slice (packet, offset, len - offset);
+    copy = flow_packet_copy (slice);
+    flow_packet_unref (packet);
+    flow_packet_unref (slice);
+
+    if (flow_packet_get_size (copy) != len - offset)
+      test_end (TEST_RESULT_FAILED, "wrong size for copy of slice");
+    if (memcmp (flow_packet_get_data (copy), buffer + base + offset, len - offset))
+      test_end (TEST_RESULT_FAILED, "bad data in copy of slice");
+
+    flow_packet_unref (copy);
+
     /* TODO: Test object */
   }
 
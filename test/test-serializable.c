@@ -238,6 +238,169 @@ flow_foo_finalize (FlowFoo *foo)
 {
 }
 
+/* --- Test class using sink and source --- */
+
+#define FLOW_TYPE_BAR            (flow_bar_get_type ())
+#define FLOW_BAR(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), FLOW_TYPE_BAR, FlowBar))
+#define FLOW_IS_BAR(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), FLOW_TYPE_BAR))
+GType   flow_bar_get_type        (void) G_GNUC_CONST;
+
+typedef struct _FlowBar        FlowBar;
+typedef struct _FlowBarPrivate FlowBarPrivate;
+typedef struct _FlowBarClass   FlowBarClass;
+
+struct _FlowBar
+{
+  GObject     object;
+
+  /*< private >*/
+
+  FlowBarPrivate *priv;
+};
+
+struct _FlowBarClass
+{
+  GObjectClass parent_class;
+};
+
+struct _FlowBarPrivate
+{
+  guint32  test_int;
+  guint64  test_int64;
+  gchar   *test_string;
+};
+
+FLOW_GOBJECT_PROPERTIES_BEGIN (flow_bar)
+FLOW_GOBJECT_PROPERTIES_END   ()
+FLOW_GOBJECT_MAKE_IMPL (flow_bar, FlowBar, G_TYPE_OBJECT, 0)
+
+/* Writes one field per step, so the sink has to coalesce them */
+static gboolean
+flow_bar_serialize_to_sink (FlowBar *bar, FlowSerializeSink *sink, SerializeContext *context)
+{
+  FlowBarPrivate *priv = bar->priv;
+
+  switch (context->n++)
+  {
+    case 0:
+      flow_serialize_sink_write_uint32 (sink, priv->test_int);
+      return TRUE;
+    case 1:
+      flow_serialize_sink_write_uint64 (sink, priv->test_int64);
+      return TRUE;
+    case 2:
+      flow_serialize_sink_write_string (sink, priv->test_string);
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+typedef struct
+{
+  FlowBar *bar;
+  gint     n;
+}
+BarDeserializeContext;
+
+static gpointer
+flow_bar_create_deserialize_context (void)
+{
+  BarDeserializeContext *context = g_slice_new (BarDeserializeContext);
+  context->bar = g_object_new (FLOW_TYPE_BAR, NULL);
+  context->n = 0;
+  return context;
+}
+
+static void
+flow_bar_destroy_deserialize_context (BarDeserializeContext *context)
+{
+  if (context->bar)
+    g_object_unref (context->bar);
+  g_slice_free (BarDeserializeContext, context);
+}
+
+static gboolean
+flow_bar_deserialize_from_source (FlowDeserializeSource *source, BarDeserializeContext *context,
+                                  FlowSerializable **serializable_out, GError **error)
+{
+  FlowBarPrivate *priv = context->bar->priv;
+
+  if (context->n == 0 && flow_deserialize_source_read_uint32 (source, &priv->test_int))
+    context->n++;
+  if (context->n == 1 && flow_deserialize_source_read_uint64 (source, &priv->test_int64))
+    context->n++;
+  if (context->n == 2 && flow_deserialize_source_read_string (source, &priv->test_string))
+    context->n++;
+
+  if (context->n == 3)
+  {
+    *serializable_out = FLOW_SERIALIZABLE (context->bar);
+    context->bar = NULL;
+  }
+
+  return TRUE;
+}
+
+static void
+flow_bar_serializable_iface_init (gpointer g_iface, gpointer iface_data)
+{
+  FlowSerializableInterface *iface = g_iface;
+
+  iface->create_serialize_context = (gpointer (*) (FlowSerializable *))
+    flow_foo_create_serialize_context;
+  iface->destroy_serialize_context = (void (*) (FlowSerializable *, gpointer))
+    flow_foo_destroy_serialize_context;
+  iface->serialize_to_sink = (gboolean (*) (FlowSerializable *, FlowSerializeSink *, gpointer))
+    flow_bar_serialize_to_sink;
+
+  iface->create_deserialize_context = (gpointer (*) (void))
+    flow_bar_create_deserialize_context;
+  iface->destroy_deserialize_context = (void (*) (gpointer))
+    flow_bar_destroy_deserialize_context;
+  iface->deserialize_from_source = (gboolean (*) (FlowDeserializeSource *, gpointer, FlowSerializable **, GError **))
+    flow_bar_deserialize_from_source;
+}
+
+static void
+flow_bar_type_init (GType type)
+{
+  const GInterfaceInfo iface_info =
+  {
+    (GInterfaceInitFunc) flow_bar_serializable_iface_init,  /* interface_init */
+    NULL,  /* interface_finalize */
+    NULL   /* interface_data */
+  };
+
+  g_type_add_interface_static (type, FLOW_TYPE_SERIALIZABLE, &iface_info);
+}
+
+static void
+flow_bar_class_init (FlowBarClass *klass)
+{
+}
+
+static void
+flow_bar_init (FlowBar *bar)
+{
+}
+
+static void
+flow_bar_construct (FlowBar *bar)
+{
+}
+
+static void
+flow_bar_dispose (FlowBar *bar)
+{
+}
+
+static void
+flow_bar_finalize (FlowBar *bar)
+{
+  g_free (bar->priv->test_string);
+}
+
 /* --- Test main --- */
 
 static void
@@ -264,6 +427,148 @@ deserialize_and_check_one (FlowFoo *original_foo, FlowPacketQueue *packet_queue)
   g_object_unref (copy_foo);
 }
 
+static FlowBar *
+deserialize_bar (FlowPacketQueue *packet_queue)
+{
+  FlowBar *bar = NULL;
+  gpointer context;
+
+  context = flow_serializable_deserialize_begin (FLOW_TYPE_BAR);
+  if (!flow_serializable_deserialize_step (FLOW_TYPE_BAR, packet_queue, context,
+                                           (FlowSerializable **) &bar, NULL) || !bar)
+    test_end (TEST_RESULT_FAILED, "failed to deserialize from source");
+
+  return bar;
+}
+
+static void
+check_bar (FlowBar *original_bar, FlowBar *copy_bar)
+{
+  if (copy_bar->priv->test_int != original_bar->priv->test_int ||
+      copy_bar->priv->test_int64 != original_bar->priv->test_int64 ||
+      strcmp (copy_bar->priv->test_string, original_bar->priv->test_string))
+    test_end (TEST_RESULT_FAILED, "object deserialized from source does not correspond to original");
+}
+
+static void
+test_sink_and_source (FlowPad *input_pad, FlowPad *output_pad)
+{
+  FlowPacketQueue *output_queue = flow_pad_get_packet_queue (output_pad);
+  FlowPacketQueue *trickle_queue;
+  FlowBar *bar, *copy_bar;
+  FlowPacket *packet;
+  gpointer context;
+  gint i;
+
+  trickle_queue = flow_packet_queue_new ();
+
+  for (i = 0; i < 1000; i++)
+  {
+    guint8 *data;
+    guint size;
+    guint j;
+
+    bar = g_object_new (FLOW_TYPE_BAR, NULL);
+    bar->priv->test_int = i * 7919;
+    bar->priv->test_int64 = G_GUINT64_CONSTANT (1) << (i % 64);
+    bar->priv->test_string = g_strdup_printf ("bar %d", i);
+
+    /* All fields should be coalesced into a single packet */
+
+    flow_serializable_serialize_all (FLOW_SERIALIZABLE (bar), input_pad);
+    if (flow_packet_queue_get_length_packets (output_queue) != 1)
+      test_end (TEST_RESULT_FAILED, "sink did not coalesce fields into one packet");
+
+    copy_bar = deserialize_bar (output_queue);
+    check_bar (bar, copy_bar);
+    g_object_unref (copy_bar);
+
+    /* Feed the serialized form back one byte at a time, so every field
+     * spans packets */
+
+    flow_serializable_serialize_all (FLOW_SERIALIZABLE (bar), input_pad);
+    packet = flow_packet_queue_pop_packet (output_queue);
+    data = flow_packet_get_data (packet);
+    size = flow_packet_get_size (packet);
+
+    copy_bar = NULL;
+    context = flow_serializable_deserialize_begin (FLOW_TYPE_BAR);
+
+    for (j = 0; j < size; j++)
+    {
+      if (copy_bar)
+        test_end (TEST_RESULT_FAILED, "deserialized object before all data was available");
+
+      flow_packet_queue_push_bytes (trickle_queue, data + j, 1);
+      flow_serializable_deserialize_step (FLOW_TYPE_BAR, trickle_queue, context,
+                                          (FlowSerializable **) &copy_bar, NULL);
+    }
+
+    if (!copy_bar)
+      test_end (TEST_RESULT_FAILED, "failed to deserialize trickled data");
+
+    check_bar (bar, copy_bar);
+    g_object_unref (copy_bar);
+    flow_packet_unref (packet);
+    g_object_unref (bar);
+  }
+
+  /* Large writes bypass the buffer and must keep their position in the stream */
+
+  {
+    FlowSerializeSink sink;
+    guint8 *big_data = g_malloc0 (FLOW_SERIALIZE_SINK_FLUSH_SIZE * 2);
+    guint8 n;
+
+    flow_serialize_sink_init (&sink, trickle_queue);
+    flow_serialize_sink_write_uint32 (&sink, 1);
+    flow_serialize_sink_write (&sink, big_data, FLOW_SERIALIZE_SINK_FLUSH_SIZE * 2);
+    flow_serialize_sink_write_uint32 (&sink, 2);
+    flow_serialize_sink_finish (&sink);
+
+    if (flow_packet_queue_get_length_bytes (trickle_queue) != FLOW_SERIALIZE_SINK_FLUSH_SIZE * 2 + 2)
+      test_end (TEST_RESULT_FAILED, "sink lost data");
+
+    flow_packet_queue_pop_bytes_exact (trickle_queue, &n, 1);
+    if (n != 1)
+      test_end (TEST_RESULT_FAILED, "sink reordered data");
+
+    flow_packet_queue_pop_bytes_exact (trickle_queue, NULL, FLOW_SERIALIZE_SINK_FLUSH_SIZE * 2);
+    flow_packet_queue_pop_bytes_exact (trickle_queue, &n, 1);
+    if (n != 2)
+      test_end (TEST_RESULT_FAILED, "sink reordered data");
+
+    g_free (big_data);
+  }
+
+  /* An oversized string length split across packets must not be trusted */
+
+  {
+    FlowDeserializeSource source;
+    guchar buf [16];
+    guchar *p;
+    gchar *string = NULL;
+
+    p = flow_pack_uint32 (G_MAXUINT32, buf);
+    memcpy (p, "abcd", 4);
+    p += 4;
+
+    flow_packet_queue_push_bytes (trickle_queue, buf, 2);
+    flow_packet_queue_push_bytes (trickle_queue, buf + 2, p - buf - 2);
+
+    flow_deserialize_source_init (&source, trickle_queue);
+    if (flow_deserialize_source_read_string (&source, &string) || string)
+      test_end (TEST_RESULT_FAILED, "read string with oversized length");
+
+    if (flow_packet_queue_get_length_bytes (trickle_queue) != p - buf)
+      test_end (TEST_RESULT_FAILED, "oversized string length consumed data");
+
+    flow_packet_queue_clear (trickle_queue);
+  }
+
+  g_object_unref (trickle_queue);
+}
+
 static void
 test_run (void)
 {
@@ -300,5 +605,7 @@ test_run (void)
     g_object_unref (foo);
   }
 
+  test_sink_and_source (input_pad, output_pad);
+
   g_object_unref (controller);
 }
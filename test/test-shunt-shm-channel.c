@@ -0,0 +1,410 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* test-shunt-shm-channel.c - FlowShunt shared memory channel test.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+
+#define TEST_UNIT_NAME "FlowShunt (shared memory channel)"
+#define TEST_TIMEOUT_S 60
+
+/* Test variables; adjustable */
+
+#define BUFFER_SIZE            (3 * 1024 * 1024)  /* Several times the ring size */
+#define PACKET_MAX_SIZE        32768
+#define POLL_INTERVAL_MS       20
+
+#include "test-common.c"
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+typedef struct
+{
+  FlowShunt *shunt;
+  guchar    *src;
+  guint      src_index;
+  guchar    *expected;
+  guint      dest_index;
+  gboolean   finished_writing;
+  gboolean   finished_reading;
+}
+Endpoint;
+
+static Endpoint       endpoints [2];
+static volatile gint *child_done;
+
+static guchar *
+make_random_buffer (void)
+{
+  guchar *buf;
+  gint    i;
+
+  buf = g_malloc (BUFFER_SIZE);
+
+  for (i = 0; i < BUFFER_SIZE; i++)
+    buf [i] = (guchar) g_random_int ();
+
+  return buf;
+}
+
+static FlowPacket *
+next_data_packet (Endpoint *endpoint)
+{
+  FlowPacket *packet;
+  guint       len;
+
+  if (endpoint->src_index == BUFFER_SIZE)
+  {
+    endpoint->finished_writing = TRUE;
+    flow_shunt_block_writes (endpoint->shunt);
+    return flow_create_simple_event_packet (FLOW_STREAM_DOMAIN, FLOW_STREAM_END);
+  }
+
+  len = MIN (PACKET_MAX_SIZE, BUFFER_SIZE - endpoint->src_index);
+  packet = flow_packet_new (FLOW_PACKET_FORMAT_BUFFER, endpoint->src + endpoint->src_index, len);
+  endpoint->src_index += len;
+
+  return packet;
+}
+
+/* --- Transfer in both directions --- */
+
+static void
+transfer_read (FlowShunt *shunt, FlowPacket *packet, Endpoint *endpoint)
+{
+  gpointer packet_data = flow_packet_get_data (packet);
+
+  if (flow_packet_get_format (packet) == FLOW_PACKET_FORMAT_BUFFER)
+  {
+    guint packet_size = flow_packet_get_size (packet);
+
+    if (endpoint->finished_reading)
+      test_end (TEST_RESULT_FAILED, "got data after end of stream");
+
+    if (endpoint->dest_index + packet_size > BUFFER_SIZE)
+      test_end (TEST_RESULT_FAILED, "read too much data");
+
+    if (memcmp (packet_data, endpoint->expected + endpoint->dest_index, packet_size))
+      test_end (TEST_RESULT_FAILED, "output data did not match input");
+
+    endpoint->dest_index += packet_size;
+  }
+  else if (FLOW_IS_PROCESS_RESULT (packet_data))
+  {
+    test_end (TEST_RESULT_FAILED, "got a process result from a channel");
+  }
+  else if (FLOW_IS_DETAILED_EVENT (packet_data) &&
+           flow_detailed_event_matches (packet_data, FLOW_STREAM_DOMAIN, FLOW_STREAM_END))
+  {
+    test_print ("Read: End of stream after %d bytes\n", endpoint->dest_index);
+
+    if (endpoint->dest_index != BUFFER_SIZE)
+      test_end (TEST_RESULT_FAILED, "did not pass through all the data");
+
+    endpoint->finished_reading = TRUE;
+
+    if (endpoints [0].finished_reading && endpoints [1].finished_reading)
+      test_quit_main_loop ();
+  }
+  else if (FLOW_IS_DETAILED_EVENT (packet_data) &&
+           (flow_detailed_event_matches (packet_data, FLOW_STREAM_DOMAIN, FLOW_STREAM_ERROR) ||
+            flow_detailed_event_matches (packet_data, FLOW_STREAM_DOMAIN, FLOW_STREAM_END_CONVERSE)))
+  {
+    test_end (TEST_RESULT_FAILED, "got an error during transfer");
+  }
+
+  flow_packet_unref (packet);
+}
+
+static FlowPacket *
+transfer_write (FlowShunt *shunt, Endpoint *endpoint)
+{
+  if (endpoint->finished_writing)
+    test_end (TEST_RESULT_FAILED, "got write callback after sending end-of-stream");
+
+  return next_data_packet (endpoint);
+}
+
+static void
+test_transfer (void)
+{
+  FlowShunt *shunt;
+  gint       peer_fd = -1;
+  gint       i;
+
+  test_print ("Transferring data in both directions\n");
+
+  shunt = flow_create_shm_channel (&peer_fd);
+  if (peer_fd < 0)
+    test_end (TEST_RESULT_FAILED, "could not create channel");
+
+  endpoints [0].shunt = shunt;
+  endpoints [1].shunt = flow_open_shm_channel (peer_fd);
+
+  endpoints [0].src      = make_random_buffer ();
+  endpoints [1].src      = make_random_buffer ();
+  endpoints [0].expected = endpoints [1].src;
+  endpoints [1].expected = endpoints [0].src;
+
+  for (i = 0; i < 2; i++)
+  {
+    flow_shunt_set_read_func (endpoints [i].shunt, (FlowShuntReadFunc *) transfer_read, &endpoints [i]);
+    flow_shunt_set_write_func (endpoints [i].shunt, (FlowShuntWriteFunc *) transfer_write, &endpoints [i]);
+  }
+
+  test_run_main_loop ();
+
+  for (i = 0; i < 2; i++)
+  {
+    flow_shunt_destroy (endpoints [i].shunt);
+    g_free (endpoints [i].src);
+  }
+
+  memset (endpoints, 0, sizeof (endpoints));
+}
+
+/* --- Writing to a peer that went away --- */
+
+static void
+peer_death_read (FlowShunt *shunt, FlowPacket *packet, Endpoint *endpoint)
+{
+  gpointer packet_data = flow_packet_get_data (packet);
+
+  if (flow_packet_get_format (packet) == FLOW_PACKET_FORMAT_OBJECT &&
+      FLOW_IS_DETAILED_EVENT (packet_data) &&
+      flow_detailed_event_matches (packet_data, FLOW_STREAM_DOMAIN, FLOW_STREAM_END_CONVERSE))
+  {
+    test_print ("Read: Write failed after %d bytes\n", endpoint->src_index);
+    test_quit_main_loop ();
+  }
+
+  flow_packet_unref (packet);
+}
+
+static FlowPacket *
+peer_death_write (FlowShunt *shunt, Endpoint *endpoint)
+{
+  /* Keep writing until the write fails; we never send END */
+
+  if (endpoint->src_index == BUFFER_SIZE)
+    endpoint->src_index = 0;
+
+  return next_data_packet (endpoint);
+}
+
+static void
+test_peer_death (void)
+{
+  FlowShunt *peer_shunt;
+  gint       peer_fd = -1;
+
+  test_print ("Writing to a peer that goes away\n");
+
+  endpoints [0].shunt = flow_create_shm_channel (&peer_fd);
+  if (peer_fd < 0)
+    test_end (TEST_RESULT_FAILED, "could not create channel");
+
+  endpoints [0].src = make_random_buffer ();
+
+  /* The peer opens its end and immediately goes away without reading */
+
+  peer_shunt = flow_open_shm_channel (peer_fd);
+  flow_shunt_destroy (peer_shunt);
+
+  flow_shunt_set_read_func (endpoints [0].shunt, (FlowShuntReadFunc *) peer_death_read, &endpoints [0]);
+  flow_shunt_set_write_func (endpoints [0].shunt, (FlowShuntWriteFunc *) peer_death_write, &endpoints [0]);
+
+  test_run_main_loop ();
+
+  flow_shunt_destroy (endpoints [0].shunt);
+  g_free (endpoints [0].src);
+
+  memset (endpoints, 0, sizeof (endpoints));
+}
+
+/* --- Sync writer in a child after we stop reading --- */
+
+static void
+end_converse_worker (FlowSyncShunt *sync_shunt, gpointer user_data)
+{
+  guchar *buf;
+  gint    i;
+
+  buf = g_malloc0 (PACKET_MAX_SIZE);
+
+  /* Writes more than fits in the ring. This must return once the parent
+   * stops reading, rather than wait for space forever. */
+
+  for (i = 0; i < BUFFER_SIZE / PACKET_MAX_SIZE; i++)
+    flow_sync_shunt_write (sync_shunt, flow_packet_new (FLOW_PACKET_FORMAT_BUFFER, buf, PACKET_MAX_SIZE));
+
+  g_free (buf);
+  *child_done = 1;
+}
+
+static void
+end_converse_read (FlowShunt *shunt, FlowPacket *packet, gpointer data)
+{
+  flow_packet_unref (packet);
+}
+
+static FlowPacket *
+end_converse_write (FlowShunt *shunt, gpointer data)
+{
+  flow_shunt_block_writes (shunt);
+  return flow_create_simple_event_packet (FLOW_STREAM_DOMAIN, FLOW_STREAM_END_CONVERSE);
+}
+
+static gboolean
+check_child_done (gpointer data)
+{
+  if (!*child_done)
+    return TRUE;
+
+  test_print ("Child: Writes returned after we stopped reading\n");
+  test_quit_main_loop ();
+  return FALSE;
+}
+
+static void
+test_end_converse (void)
+{
+  FlowShunt *shunt;
+
+  test_print ("Stopping reads while a child is writing\n");
+
+  child_done = mmap (NULL, sizeof (gint), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (child_done == MAP_FAILED)
+    test_end (TEST_RESULT_SYSTEM_ERROR, "could not map shared flag");
+
+  shunt = flow_spawn_process_shm (end_converse_worker, NULL);
+
+  /* Don't read anything, so the child fills the ring and has to wait */
+
+  flow_shunt_block_reads (shunt);
+  flow_shunt_set_read_func (shunt, end_converse_read, NULL);
+  flow_shunt_set_write_func (shunt, end_converse_write, NULL);
+
+  g_timeout_add (POLL_INTERVAL_MS, check_child_done, NULL);
+
+  test_run_main_loop ();
+
+  flow_shunt_destroy (shunt);
+  munmap ((gpointer) child_done, sizeof (gint));
+}
+
+/* --- Opening a channel whose memfd isn't sealed --- */
+
+static void
+unsealed_read (FlowShunt *shunt, FlowPacket *packet, gpointer data)
+{
+  gpointer packet_data = flow_packet_get_data (packet);
+
+  if (flow_packet_get_format (packet) == FLOW_PACKET_FORMAT_BUFFER)
+    test_end (TEST_RESULT_FAILED, "got data from an unsealed channel");
+
+  if (FLOW_IS_DETAILED_EVENT (packet_data) &&
+      flow_detailed_event_matches (packet_data, FLOW_STREAM_DOMAIN, FLOW_STREAM_BEGIN))
+    test_end (TEST_RESULT_FAILED, "opened a channel with an unsealed memfd");
+
+  if (FLOW_IS_DETAILED_EVENT (packet_data) &&
+      flow_detailed_event_matches (packet_data, FLOW_STREAM_DOMAIN, FLOW_STREAM_DENIED))
+  {
+    test_print ("Read: Unsealed channel was refused\n");
+    test_quit_main_loop ();
+  }
+
+  flow_packet_unref (packet);
+}
+
+static void
+test_unsealed (void)
+{
+#ifdef HAVE_MEMFD_CREATE
+  FlowShunt      *shunt;
+  union
+  {
+    struct cmsghdr align;
+    guint8         buf [CMSG_SPACE (3 * sizeof (gint))];
+  }
+  control;
+  struct msghdr   msg;
+  struct iovec    iov;
+  struct cmsghdr *cmsg;
+  gint            fds [3];
+  gint            sv [2];
+  guint8          byte = 0;
+  gint            i;
+
+  test_print ("Opening a channel whose memfd can be resized\n");
+
+  /* Hand over what looks like a channel, but with a plain memfd that the
+   * creator could truncate at any time */
+
+  fds [0] = memfd_create ("test-shm", MFD_CLOEXEC);
+  if (fds [0] < 0 || ftruncate (fds [0], BUFFER_SIZE) < 0)
+    test_end (TEST_RESULT_SYSTEM_ERROR, "could not create memfd");
+
+  if (pipe (&fds [1]) < 0 ||
+      socketpair (AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+    test_end (TEST_RESULT_SYSTEM_ERROR, "could not create descriptors");
+
+  iov.iov_base = &byte;
+  iov.iov_len  = 1;
+
+  memset (&msg, 0, sizeof (msg));
+  msg.msg_iov        = &iov;
+  msg.msg_iovlen     = 1;
+  msg.msg_control    = control.buf;
+  msg.msg_controllen = CMSG_SPACE (sizeof (fds));
+
+  cmsg = CMSG_FIRSTHDR (&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type  = SCM_RIGHTS;
+  cmsg->cmsg_len   = CMSG_LEN (sizeof (fds));
+  memcpy (CMSG_DATA (cmsg), fds, sizeof (fds));
+
+  if (sendmsg (sv [0], &msg, 0) != 1)
+    test_end (TEST_RESULT_SYSTEM_ERROR, "could not send descriptors");
+
+  for (i = 0; i < 3; i++)
+    close (fds [i]);
+
+  shunt = flow_open_shm_channel (sv [1]);
+  flow_shunt_set_read_func (shunt, unsealed_read, NULL);
+
+  test_run_main_loop ();
+
+  flow_shunt_destroy (shunt);
+  close (sv [0]);
+#endif
+}
+
+static void
+test_run (void)
+{
+  g_random_set_seed (time (NULL));
+
+  test_transfer ();
+  test_peer_death ();
+  test_end_converse ();
+  test_unsealed ();
+}
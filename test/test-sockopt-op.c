@@ -0,0 +1,206 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* test-sockopt-op.c - Socket option request test.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+
+#define TEST_UNIT_NAME "FlowSockoptOp"
+#define TEST_TIMEOUT_S 60
+
+/* Test variables; adjustable */
+
+#define LOCAL_PORT    2537
+#define TRANSFER_SIZE 262144  /* Plaintext to send through the TLS pair */
+
+#include "test-common.c"
+#include "test-tls-common.c"
+
+static const guchar before [] = "Written before the options";
+static const guchar after  [] = "Written after the options";
+
+/* Returns the code of the next reply to a FlowSockoptOp, skipping
+ * anything else the socket tells us about */
+static gint
+read_options_reply (FlowIO *io)
+{
+  gpointer object;
+  gint     code = -1;
+
+  while (code < 0)
+  {
+    object = flow_io_sync_read_object (io, NULL);
+    if (!object)
+      test_end (TEST_RESULT_FAILED, "stream ended before options reply");
+
+    if (FLOW_IS_DETAILED_EVENT (object))
+    {
+      if (flow_detailed_event_matches (object, FLOW_SOCKET_DOMAIN, FLOW_SOCKET_OPTIONS_SET))
+        code = FLOW_SOCKET_OPTIONS_SET;
+      else if (flow_detailed_event_matches (object, FLOW_SOCKET_DOMAIN, FLOW_SOCKET_OPTIONS_FAILED))
+        code = FLOW_SOCKET_OPTIONS_FAILED;
+    }
+
+    g_object_unref (object);
+  }
+
+  return code;
+}
+
+/* The shunt replies to each op in order, and a rejected option doesn't
+ * disturb the data around it */
+static void
+test_shunt_replies (void)
+{
+  FlowIPService     *loopback_service;
+  FlowIPAddr        *ip_addr;
+  FlowTcpIOListener *tcp_listener;
+  FlowTcpIO         *client;
+  FlowTcpIO         *server;
+  FlowSockoptOp     *sockopt_op;
+  gint               on = 1;
+  guchar             buf [sizeof (before) + sizeof (after)];
+
+  loopback_service = flow_ip_service_new ();
+  flow_ip_service_set_port (loopback_service, LOCAL_PORT);
+
+  ip_addr = flow_ip_addr_new ();
+  flow_ip_addr_set_string (ip_addr, "127.0.0.1");
+  flow_ip_service_add_address (loopback_service, ip_addr);
+  g_object_unref (ip_addr);
+
+  tcp_listener = flow_tcp_io_listener_new ();
+  if (!flow_tcp_listener_set_local_service (FLOW_TCP_LISTENER (tcp_listener), loopback_service, NULL))
+    test_end (TEST_RESULT_FAILED, "could not bind listener");
+
+  client = flow_tcp_io_new ();
+  if (!flow_tcp_io_sync_connect (client, loopback_service, NULL))
+    test_end (TEST_RESULT_FAILED, "loopback connect failed");
+
+  server = flow_tcp_io_listener_sync_pop_connection (tcp_listener);
+  if (!server)
+    test_end (TEST_RESULT_FAILED, "missed connection on listener end");
+
+  flow_io_write (FLOW_IO (client), (gpointer) before, sizeof (before));
+
+  sockopt_op = flow_sockopt_op_new ();
+  flow_sockopt_op_add_option (sockopt_op, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof (on));
+  flow_io_write_object (FLOW_IO (client), sockopt_op);
+  g_object_unref (sockopt_op);
+
+  /* No such option; application stops here */
+
+  sockopt_op = flow_sockopt_op_new ();
+  flow_sockopt_op_add_option (sockopt_op, SOL_SOCKET, -1, &on, sizeof (on));
+  flow_sockopt_op_add_option (sockopt_op, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof (on));
+  flow_io_write_object (FLOW_IO (client), sockopt_op);
+  g_object_unref (sockopt_op);
+
+  flow_io_write (FLOW_IO (client), (gpointer) after, sizeof (after));
+  flow_io_flush (FLOW_IO (client));
+
+  if (read_options_reply (FLOW_IO (client)) != FLOW_SOCKET_OPTIONS_SET)
+    test_end (TEST_RESULT_FAILED, "valid option was not set");
+
+  if (read_options_reply (FLOW_IO (client)) != FLOW_SOCKET_OPTIONS_FAILED)
+    test_end (TEST_RESULT_FAILED, "invalid option did not fail");
+
+  if (!flow_io_sync_read_exact (FLOW_IO (server), buf, sizeof (buf), NULL) ||
+      memcmp (buf, before, sizeof (before)) ||
+      memcmp (buf + sizeof (before), after, sizeof (after)))
+    test_end (TEST_RESULT_FAILED, "data around options was disturbed");
+
+  test_print ("Shunt replied to both option requests\n");
+
+  flow_tcp_io_sync_disconnect (client, NULL);
+  flow_tcp_io_sync_disconnect (server, NULL);
+
+  g_object_unref (client);
+  g_object_unref (server);
+  g_object_unref (tcp_listener);
+  g_object_unref (loopback_service);
+}
+
+/* The pair turns down every offload request, so data must still flow
+ * with userspace encryption */
+static void
+test_tls_fallback (void)
+{
+  TestTlsFiles       *files;
+  FlowTlsCredentials *server_credentials;
+  FlowTlsCredentials *client_credentials;
+  TestTlsPair        *pair;
+  GError             *error = NULL;
+  guchar             *buffer;
+  gint                i;
+
+  files = test_tls_files_new (FALSE);
+
+  server_credentials = flow_tls_credentials_new ();
+  if (!flow_tls_credentials_add_key_pair (server_credentials, files->cert_path, files->key_path, &error))
+    test_end (TEST_RESULT_FAILED, error->message);
+
+  client_credentials = flow_tls_credentials_new ();
+  if (!flow_tls_credentials_add_trust_file (client_credentials, files->ca_path, &error))
+    test_end (TEST_RESULT_FAILED, error->message);
+
+  pair = test_tls_pair_new (client_credentials, server_credentials);
+  g_object_set (pair->client_tls, "kernel-offload", TRUE, NULL);
+  g_object_set (pair->server_tls, "kernel-offload", TRUE, NULL);
+
+  /* Plaintext is held until the offload requests have been answered */
+
+  test_tls_pair_start (pair);
+
+  buffer = g_malloc (TRANSFER_SIZE);
+  for (i = 0; i < TRANSFER_SIZE; i++)
+    buffer [i] = (guchar) g_random_int ();
+
+  test_tls_pair_send (pair->client_tls, buffer, TRANSFER_SIZE);
+  test_tls_pair_pump (pair, pair->server_app, TRANSFER_SIZE);
+  test_tls_pair_check (pair->server_app, buffer, TRANSFER_SIZE);
+
+  test_tls_pair_send (pair->server_tls, buffer, TRANSFER_SIZE);
+  test_tls_pair_pump (pair, pair->client_app, TRANSFER_SIZE);
+  test_tls_pair_check (pair->client_app, buffer, TRANSFER_SIZE);
+
+  /* Zero requests means the library was built without kernel TLS, or
+   * the cipher isn't one the kernel takes; userspace crypto either way */
+
+  test_print ("Turned down %d offload request(s)\n", pair->n_offload_requests);
+
+  if (pair->n_offload_requests > 2)
+    test_end (TEST_RESULT_FAILED, "offload was requested more than once per side");
+
+  test_tls_pair_free (pair);
+  g_object_unref (client_credentials);
+  g_object_unref (server_credentials);
+
+  g_free (buffer);
+  test_tls_files_free (files);
+}
+
+static void
+test_run (void)
+{
+  test_shunt_replies ();
+  test_tls_fallback ();
+}
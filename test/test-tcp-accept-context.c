@@ -0,0 +1,156 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* test-tcp-accept-context.c - Accepting connections into a worker context.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+
+#define TEST_UNIT_NAME "FlowTcpListener (accept context)"
+#define TEST_TIMEOUT_S 60
+
+/* Test variables; adjustable */
+
+#define LOCAL_PORT  2539
+#define N_CLIENTS   20
+#define MESSAGE_LEN 64
+
+#include "test-common.c"
+
+static FlowTcpIOListener *tcp_listener;
+static GMainContext      *worker_context;
+static GAsyncQueue       *handed_over;
+static gint               n_handed_over;
+
+/* Serves connections in the accept context, one at a time. Their shunts
+ * already dispatch here; the listener's thread must not have touched them. */
+static void
+worker_main (void)
+{
+  guchar buf [MESSAGE_LEN];
+  gint   i;
+
+  flow_set_main_context_for_current_thread (worker_context);
+
+  for (i = 0; i < N_CLIENTS; i++)
+  {
+    FlowTcpIO *tcp_io = g_async_queue_pop (handed_over);
+
+    if (!flow_io_sync_read_exact (FLOW_IO (tcp_io), buf, MESSAGE_LEN, NULL))
+      test_end (TEST_RESULT_FAILED, "worker could not read request");
+
+    if (!flow_io_sync_write (FLOW_IO (tcp_io), buf, MESSAGE_LEN, NULL) ||
+        !flow_io_sync_flush (FLOW_IO (tcp_io), NULL))
+      test_end (TEST_RESULT_FAILED, "worker could not write reply");
+
+    flow_tcp_io_sync_disconnect (tcp_io, NULL);
+    g_object_unref (tcp_io);
+  }
+
+  test_print ("Worker served %d connections\n", N_CLIENTS);
+}
+
+/* Runs in the listener's thread. Connections go straight to the worker. */
+static void
+new_connection (void)
+{
+  FlowTcpIO *tcp_ios [N_CLIENTS];
+  guint      n;
+  guint      i;
+
+  n = flow_tcp_io_listener_pop_connections (tcp_listener, tcp_ios, N_CLIENTS);
+
+  for (i = 0; i < n; i++)
+    g_async_queue_push (handed_over, tcp_ios [i]);
+
+  n_handed_over += n;
+}
+
+static void
+test_run (void)
+{
+  FlowIPService *loopback_service;
+  FlowIPAddr    *ip_addr;
+  FlowTcpIO     *clients [N_CLIENTS];
+  GThread       *worker_thread;
+  guchar         message [MESSAGE_LEN];
+  guchar         buf [MESSAGE_LEN];
+  gint           i;
+
+  loopback_service = flow_ip_service_new ();
+  flow_ip_service_set_port (loopback_service, LOCAL_PORT);
+
+  ip_addr = flow_ip_addr_new ();
+  flow_ip_addr_set_string (ip_addr, "127.0.0.1");
+  flow_ip_service_add_address (loopback_service, ip_addr);
+  g_object_unref (ip_addr);
+
+  worker_context = g_main_context_new ();
+  handed_over = g_async_queue_new ();
+
+  tcp_listener = flow_tcp_io_listener_new ();
+  g_object_set (tcp_listener, "pool-size", N_CLIENTS / 2, NULL);
+  flow_tcp_listener_set_accept_context (FLOW_TCP_LISTENER (tcp_listener), worker_context);
+  g_signal_connect (tcp_listener, "new-connection", (GCallback) new_connection, NULL);
+
+  if (!flow_tcp_listener_set_local_service (FLOW_TCP_LISTENER (tcp_listener), loopback_service, NULL))
+    test_end (TEST_RESULT_FAILED, "could not bind listener");
+
+  worker_thread = g_thread_new (NULL, (GThreadFunc) worker_main, NULL);
+
+  /* Connect them all first, so the listener gets them in bursts */
+
+  for (i = 0; i < N_CLIENTS; i++)
+  {
+    clients [i] = flow_tcp_io_new ();
+
+    if (!flow_tcp_io_sync_connect (clients [i], loopback_service, NULL))
+      test_end (TEST_RESULT_FAILED, "loopback connect failed");
+  }
+
+  for (i = 0; i < N_CLIENTS; i++)
+  {
+    memset (message, i, MESSAGE_LEN);
+    flow_io_write (FLOW_IO (clients [i]), message, MESSAGE_LEN);
+    flow_io_flush (FLOW_IO (clients [i]));
+  }
+
+  for (i = 0; i < N_CLIENTS; i++)
+  {
+    memset (message, i, MESSAGE_LEN);
+
+    if (!flow_io_sync_read_exact (FLOW_IO (clients [i]), buf, MESSAGE_LEN, NULL) ||
+        memcmp (buf, message, MESSAGE_LEN))
+      test_end (TEST_RESULT_FAILED, "bad reply from worker");
+
+    flow_tcp_io_sync_disconnect (clients [i], NULL);
+    g_object_unref (clients [i]);
+  }
+
+  g_thread_join (worker_thread);
+
+  if (n_handed_over != N_CLIENTS)
+    test_end (TEST_RESULT_FAILED, "wrong number of connections accepted");
+
+  g_object_unref (tcp_listener);
+  g_object_unref (loopback_service);
+  g_async_queue_unref (handed_over);
+  g_main_context_unref (worker_context);
+}
@@ -0,0 +1,212 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* test-tcp-auto-cork.c - TCP auto-cork test.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+
+#define TEST_UNIT_NAME "FlowTcpConnector (auto-cork)"
+#define TEST_TIMEOUT_S 60
+
+/* Test variables; adjustable */
+
+#define LOCAL_PORT       2540
+
+#define N_ROUNDS         20
+#define N_WRITES         16     /* Small writes per round, ending in a flush */
+#define WRITE_SIZE       7
+#define ROUND_SIZE       (N_WRITES * WRITE_SIZE)
+#define ROUND_MAX_MS     150    /* Well below the kernel's 200ms cork timeout */
+
+#define BULK_SIZE        4000000
+#define BULK_CHUNK_SIZE  1000
+#define BULK_WINDOW_SIZE 65536
+
+#include "test-common.c"
+
+static FlowIPService     *loopback_service = NULL;
+static FlowTcpIOListener *tcp_listener     = NULL;
+
+/* Echoes everything back, flushing after each read */
+static void
+echo_main (void)
+{
+  FlowTcpIO *tcp_io;
+  guchar     temp_buffer [4096];
+  gint       len;
+
+  tcp_io = flow_tcp_io_listener_sync_pop_connection (tcp_listener);
+  if (!tcp_io)
+    test_end (TEST_RESULT_FAILED, "missed connection on listener end");
+
+  while ((len = flow_io_sync_read (FLOW_IO (tcp_io), temp_buffer, sizeof (temp_buffer), NULL)) > 0)
+  {
+    flow_io_write (FLOW_IO (tcp_io), temp_buffer, len);
+    flow_io_flush (FLOW_IO (tcp_io));
+  }
+
+  flow_tcp_io_sync_disconnect (tcp_io, NULL);
+  g_object_unref (tcp_io);
+}
+
+/* Each round is a burst of small writes ending in a flush. If the flush
+ * didn't uncork the socket, the burst would sit in the kernel until the
+ * cork timed out, and the echo would take at least that long. */
+static void
+run_rounds (FlowTcpIO *tcp_io, const gchar *desc, gboolean check_latency)
+{
+  guchar  out_buffer [ROUND_SIZE];
+  guchar  in_buffer [ROUND_SIZE];
+  GTimer *timer;
+  gdouble slowest = 0.0;
+  gint    i, j;
+
+  timer = g_timer_new ();
+
+  for (i = 0; i < N_ROUNDS; i++)
+  {
+    gdouble elapsed;
+
+    for (j = 0; j < ROUND_SIZE; j++)
+      out_buffer [j] = (guchar) g_random_int ();
+
+    g_timer_start (timer);
+
+    for (j = 0; j < N_WRITES; j++)
+      flow_io_write (FLOW_IO (tcp_io), out_buffer + j * WRITE_SIZE, WRITE_SIZE);
+
+    flow_io_flush (FLOW_IO (tcp_io));
+
+    if (!flow_io_sync_read_exact (FLOW_IO (tcp_io), in_buffer, ROUND_SIZE, NULL))
+      test_end (TEST_RESULT_FAILED, "short read");
+
+    elapsed = g_timer_elapsed (timer, NULL);
+    slowest = MAX (slowest, elapsed);
+
+    if (memcmp (out_buffer, in_buffer, ROUND_SIZE))
+      test_end (TEST_RESULT_FAILED, "data mismatch");
+
+    if (check_latency && elapsed * 1000.0 >= ROUND_MAX_MS)
+      test_end (TEST_RESULT_FAILED, "flushed burst was held back");
+  }
+
+  test_print ("%s: %d rounds, slowest %.1fms\n", desc, N_ROUNDS, slowest * 1000.0);
+  g_timer_destroy (timer);
+}
+
+/* Corking must not reorder or lose anything in a sustained stream. Data
+ * goes out a window at a time, so neither end stalls on full buffers. */
+static void
+run_bulk (FlowTcpIO *tcp_io)
+{
+  guchar *out_buffer;
+  guchar *in_buffer;
+  gint    offset;
+  gint    i;
+
+  out_buffer = g_malloc (BULK_SIZE);
+  in_buffer  = g_malloc (BULK_SIZE);
+
+  for (i = 0; i < BULK_SIZE; i++)
+    out_buffer [i] = (guchar) g_random_int ();
+
+  for (offset = 0; offset < BULK_SIZE; offset += BULK_WINDOW_SIZE)
+  {
+    gint window_len = MIN (BULK_WINDOW_SIZE, BULK_SIZE - offset);
+
+    for (i = 0; i < window_len; i += BULK_CHUNK_SIZE)
+      flow_io_write (FLOW_IO (tcp_io), out_buffer + offset + i, MIN (BULK_CHUNK_SIZE, window_len - i));
+
+    flow_io_flush (FLOW_IO (tcp_io));
+
+    if (!flow_io_sync_read_exact (FLOW_IO (tcp_io), in_buffer + offset, window_len, NULL))
+      test_end (TEST_RESULT_FAILED, "short bulk read");
+  }
+
+  if (memcmp (out_buffer, in_buffer, BULK_SIZE))
+    test_end (TEST_RESULT_FAILED, "bulk data mismatch");
+
+  test_print ("Bulk transfer of %d bytes intact\n", BULK_SIZE);
+
+  g_free (out_buffer);
+  g_free (in_buffer);
+}
+
+static void
+test_run (void)
+{
+  FlowTcpIO        *tcp_io;
+  FlowTcpConnector *tcp_connector;
+  FlowIPAddr       *ip_addr;
+  GThread          *echo_thread;
+
+  g_random_set_seed (time (NULL));
+
+  loopback_service = flow_ip_service_new ();
+  flow_ip_service_set_port (loopback_service, LOCAL_PORT);
+
+  ip_addr = flow_ip_addr_new ();
+  flow_ip_addr_set_string (ip_addr, "127.0.0.1");
+  flow_ip_service_add_address (loopback_service, ip_addr);
+  g_object_unref (ip_addr);
+
+  tcp_listener = flow_tcp_io_listener_new ();
+  if (!flow_tcp_listener_set_local_service (FLOW_TCP_LISTENER (tcp_listener), loopback_service, NULL))
+    test_end (TEST_RESULT_FAILED, "could not bind listener");
+
+  echo_thread = g_thread_new (NULL, (GThreadFunc) echo_main, NULL);
+
+  tcp_io = flow_tcp_io_new ();
+  tcp_connector = flow_tcp_io_get_tcp_connector (tcp_io);
+  g_object_set (tcp_connector, "auto-cork", TRUE, NULL);
+
+  if (!flow_tcp_io_sync_connect (tcp_io, loopback_service, NULL))
+    test_end (TEST_RESULT_FAILED, "loopback connect failed");
+
+  run_rounds (tcp_io, "Auto-cork on", TRUE);
+  run_bulk (tcp_io);
+
+  /* Switching it off must leave the socket uncorked, with Nagle back as
+   * it was, so there's no latency bound. Switching it back on must cork
+   * and uncork as before. */
+
+  g_object_set (tcp_connector, "auto-cork", FALSE, NULL);
+  run_rounds (tcp_io, "Auto-cork off", FALSE);
+
+  g_object_set (tcp_connector, "auto-cork", TRUE, NULL);
+  g_object_set (tcp_connector, "auto-cork", TRUE, NULL);
+  run_rounds (tcp_io, "Auto-cork on again", TRUE);
+
+  g_object_set (tcp_connector, "auto-cork", FALSE, NULL);
+  run_bulk (tcp_io);
+
+  if (!flow_tcp_io_sync_disconnect (tcp_io, NULL))
+    test_end (TEST_RESULT_FAILED, "disconnect failed");
+
+  g_object_unref (tcp_io);
+  g_thread_join (echo_thread);
+
+  g_object_unref (tcp_listener);
+  tcp_listener = NULL;
+
+  g_object_unref (loopback_service);
+  loopback_service = NULL;
+}
@@ -0,0 +1,214 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* test-tcp-fast-open.c - TCP Fast Open and deferred accept test.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+
+#define TEST_UNIT_NAME "FlowTcpConnector (fast open)"
+#define TEST_TIMEOUT_S 60
+
+/* Test variables; adjustable */
+
+#define LOCAL_PORT     2543
+
+#define N_ROUNDS       8      /* The first gets a cookie; the rest may use it */
+#define REQUEST_SIZE   512    /* Fits in the SYN */
+#define RESPONSE_SIZE  4096
+#define DEFER_WAIT_MS  300    /* Well below the listener's defer timeout */
+
+#include "test-common.c"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+static guchar             buffer [RESPONSE_SIZE];
+static FlowIPService     *loopback_service = NULL;
+static FlowTcpIOListener *tcp_listener     = NULL;
+
+static FlowTcpIO *
+wait_for_connection (void)
+{
+  FlowTcpIO *tcp_io;
+
+  while (!(tcp_io = flow_tcp_io_listener_pop_connection (tcp_listener)))
+    g_main_context_iteration (NULL, TRUE);
+
+  return tcp_io;
+}
+
+static void
+check_read (FlowTcpIO *tcp_io, gint offset, gint len, const gchar *what)
+{
+  guchar *temp_buffer = g_alloca (len);
+
+  if (!flow_io_sync_read_exact (FLOW_IO (tcp_io), temp_buffer, len, NULL))
+    test_end (TEST_RESULT_FAILED, what);
+
+  if (memcmp (buffer + offset, temp_buffer, len))
+    test_end (TEST_RESULT_FAILED, what);
+}
+
+/* One short request/response exchange. With write_early, the request is
+ * written before the connection exists, so it can ride on the SYN. */
+static void
+run_exchange (gboolean write_early)
+{
+  FlowTcpIO *client_io;
+  FlowTcpIO *server_io;
+
+  client_io = flow_tcp_io_new ();
+  g_object_set (flow_tcp_io_get_tcp_connector (client_io), "fast-open", TRUE, NULL);
+
+  if (write_early)
+  {
+    flow_tcp_io_connect (client_io, loopback_service);
+    flow_io_write (FLOW_IO (client_io), buffer, REQUEST_SIZE);
+    flow_io_flush (FLOW_IO (client_io));
+  }
+  else
+  {
+    if (!flow_tcp_io_sync_connect (client_io, loopback_service, NULL))
+      test_end (TEST_RESULT_FAILED, "connect failed");
+
+    flow_io_write (FLOW_IO (client_io), buffer, REQUEST_SIZE);
+    flow_io_flush (FLOW_IO (client_io));
+  }
+
+  server_io = wait_for_connection ();
+  check_read (server_io, 0, REQUEST_SIZE, "request mismatch");
+
+  flow_io_write (FLOW_IO (server_io), buffer, RESPONSE_SIZE);
+  flow_io_flush (FLOW_IO (server_io));
+  check_read (client_io, 0, RESPONSE_SIZE, "response mismatch");
+
+  flow_tcp_io_sync_disconnect (client_io, NULL);
+  g_object_unref (client_io);
+
+  flow_tcp_io_sync_disconnect (server_io, NULL);
+  g_object_unref (server_io);
+}
+
+#ifdef TCP_DEFER_ACCEPT
+
+/* A client that connects but says nothing isn't handed to us until it
+ * does, or until the defer timeout runs out */
+static void
+check_defer_accept (void)
+{
+  struct sockaddr_in sa;
+  FlowTcpIO         *server_io;
+  GTimer            *timer;
+  gint               fd;
+
+  memset (&sa, 0, sizeof (sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port   = htons (LOCAL_PORT);
+  inet_pton (AF_INET, "127.0.0.1", &sa.sin_addr);
+
+  fd = socket (AF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+    test_end (TEST_RESULT_SYSTEM_ERROR, "could not create socket");
+
+  if (connect (fd, (struct sockaddr *) &sa, sizeof (sa)) < 0)
+    test_end (TEST_RESULT_FAILED, "silent client could not connect");
+
+  timer = g_timer_new ();
+
+  while (g_timer_elapsed (timer, NULL) * 1000.0 < DEFER_WAIT_MS)
+  {
+    g_main_context_iteration (NULL, FALSE);
+
+    server_io = flow_tcp_io_listener_pop_connection (tcp_listener);
+    if (server_io)
+      test_end (TEST_RESULT_FAILED, "accepted a client before it sent anything");
+
+    g_usleep (10000);
+  }
+
+  g_timer_destroy (timer);
+
+  if (write (fd, buffer, REQUEST_SIZE) != REQUEST_SIZE)
+    test_end (TEST_RESULT_FAILED, "silent client could not write");
+
+  server_io = wait_for_connection ();
+  check_read (server_io, 0, REQUEST_SIZE, "deferred request mismatch");
+
+  close (fd);
+  g_object_unref (server_io);
+
+  test_print ("Deferred accept until data arrived\n");
+}
+
+#endif
+
+static void
+test_run (void)
+{
+  FlowIPAddr *ip_addr;
+  gint        i;
+
+  for (i = 0; i < RESPONSE_SIZE; i++)
+    buffer [i] = (guchar) g_random_int ();
+
+  loopback_service = flow_ip_service_new ();
+  flow_ip_service_set_port (loopback_service, LOCAL_PORT);
+
+  ip_addr = flow_ip_addr_new ();
+  flow_ip_addr_set_string (ip_addr, "127.0.0.1");
+  flow_ip_service_add_address (loopback_service, ip_addr);
+  g_object_unref (ip_addr);
+
+  tcp_listener = flow_tcp_io_listener_new ();
+  g_object_set (tcp_listener,
+                "fast-open", TRUE,
+                "defer-accept", TRUE,
+                NULL);
+
+  if (!flow_tcp_listener_set_local_service (FLOW_TCP_LISTENER (tcp_listener), loopback_service, NULL))
+    test_end (TEST_RESULT_FAILED, "could not bind listener");
+
+  /* Whether or not the kernel lets the data into the SYN, it must arrive
+   * intact and ahead of anything written later */
+
+  for (i = 0; i < N_ROUNDS; i++)
+    run_exchange (TRUE);
+
+  test_print ("Completed %d exchanges with the request written early\n", N_ROUNDS);
+
+  /* With nothing queued at connect time, a plain connect is made */
+
+  run_exchange (FALSE);
+
+  test_print ("Completed exchange with the request written after connecting\n");
+
+#ifdef TCP_DEFER_ACCEPT
+  check_defer_accept ();
+#endif
+
+  g_object_unref (tcp_listener);
+  tcp_listener = NULL;
+
+  g_object_unref (loopback_service);
+  loopback_service = NULL;
+}
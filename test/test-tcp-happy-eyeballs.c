@@ -0,0 +1,251 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* test-tcp-happy-eyeballs.c - Parallel TCP connection attempt test.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+
+#define TEST_UNIT_NAME "FlowTcpConnector (parallel attempts)"
+#define TEST_TIMEOUT_S 60
+
+/* Test variables; adjustable */
+
+#define LOCAL_PORT        2541
+
+#define SERVER_ADDR       "127.0.0.1"  /* Accepts connections */
+#define STALLED_ADDR      "127.0.0.2"  /* Drops SYNs; full accept queue */
+#define REFUSED_ADDR      "127.0.0.3"  /* Nothing listening */
+#define REFUSED_ADDR_2    "127.0.0.4"
+
+#define N_FILLERS         2            /* Connections to fill the stalled queue */
+#define ATTEMPT_DELAY_MS  50
+#define MAX_CONNECT_MS    900          /* Below the first SYN retransmit */
+#define MESSAGE_SIZE      1024
+
+#include "test-common.c"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static guchar             buffer [MESSAGE_SIZE];
+static FlowTcpIOListener *tcp_listener = NULL;
+
+/* Echoes one message on each of n_connections connections */
+static void
+server_main (gpointer n_connections)
+{
+  gint i;
+
+  for (i = 0; i < GPOINTER_TO_INT (n_connections); i++)
+  {
+    FlowTcpIO *tcp_io;
+    guchar     temp_buffer [MESSAGE_SIZE];
+
+    tcp_io = flow_tcp_io_listener_sync_pop_connection (tcp_listener);
+    if (!tcp_io)
+      test_end (TEST_RESULT_FAILED, "missed connection on listener end");
+
+    if (!flow_io_sync_read_exact (FLOW_IO (tcp_io), temp_buffer, MESSAGE_SIZE, NULL))
+      test_end (TEST_RESULT_FAILED, "short read on listener end");
+
+    if (!flow_io_sync_write (FLOW_IO (tcp_io), temp_buffer, MESSAGE_SIZE, NULL))
+      test_end (TEST_RESULT_FAILED, "short write on listener end");
+
+    flow_tcp_io_sync_disconnect (tcp_io, NULL);
+    g_object_unref (tcp_io);
+  }
+}
+
+static FlowIPService *
+new_service (const gchar *first_addr, const gchar *second_addr)
+{
+  FlowIPService *ip_service;
+  FlowIPAddr    *ip_addr;
+
+  ip_service = flow_ip_service_new ();
+  flow_ip_service_set_port (ip_service, LOCAL_PORT);
+
+  ip_addr = flow_ip_addr_new ();
+  flow_ip_addr_set_string (ip_addr, first_addr);
+  flow_ip_service_add_address (ip_service, ip_addr);
+  g_object_unref (ip_addr);
+
+  if (second_addr)
+  {
+    ip_addr = flow_ip_addr_new ();
+    flow_ip_addr_set_string (ip_addr, second_addr);
+    flow_ip_service_add_address (ip_service, ip_addr);
+    g_object_unref (ip_addr);
+  }
+
+  return ip_service;
+}
+
+static gint
+new_socket (const gchar *addr, struct sockaddr_in *sa)
+{
+  gint fd;
+
+  memset (sa, 0, sizeof (*sa));
+  sa->sin_family = AF_INET;
+  sa->sin_port   = htons (LOCAL_PORT);
+  inet_pton (AF_INET, addr, &sa->sin_addr);
+
+  fd = socket (AF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+    test_end (TEST_RESULT_SYSTEM_ERROR, "could not create socket");
+
+  return fd;
+}
+
+/* Makes a listener that is never accepted from, and fills its queue so
+ * that further SYNs are dropped. Connecting to it hangs. */
+static void
+open_stalled_listener (gint *fds)
+{
+  struct sockaddr_in sa;
+  gint               on = 1;
+  gint               i;
+
+  fds [0] = new_socket (STALLED_ADDR, &sa);
+  setsockopt (fds [0], SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on));
+
+  if (bind (fds [0], (struct sockaddr *) &sa, sizeof (sa)) < 0 ||
+      listen (fds [0], 0) < 0)
+    test_end (TEST_RESULT_SYSTEM_ERROR, "could not set up stalled listener");
+
+  for (i = 1; i <= N_FILLERS; i++)
+  {
+    fds [i] = new_socket (STALLED_ADDR, &sa);
+    fcntl (fds [i], F_SETFL, O_NONBLOCK);
+    connect (fds [i], (struct sockaddr *) &sa, sizeof (sa));
+  }
+
+  /* Let the fillers' handshakes complete */
+
+  g_usleep (100000);
+}
+
+/* Connects to service, checks that we got through to the real server and
+ * returns the time it took in milliseconds */
+static gdouble
+connect_and_echo (FlowIPService *ip_service, guint attempt_delay)
+{
+  FlowTcpIO *tcp_io;
+  guchar     temp_buffer [MESSAGE_SIZE];
+  GTimer    *timer;
+  gdouble    elapsed;
+
+  tcp_io = flow_tcp_io_new ();
+  g_object_set (flow_tcp_io_get_tcp_connector (tcp_io), "connect-attempt-delay", attempt_delay, NULL);
+
+  timer = g_timer_new ();
+
+  if (!flow_tcp_io_sync_connect (tcp_io, ip_service, NULL))
+    test_end (TEST_RESULT_FAILED, "connect failed");
+
+  elapsed = g_timer_elapsed (timer, NULL) * 1000.0;
+  g_timer_destroy (timer);
+
+  flow_io_write (FLOW_IO (tcp_io), buffer, MESSAGE_SIZE);
+  flow_io_flush (FLOW_IO (tcp_io));
+
+  if (!flow_io_sync_read_exact (FLOW_IO (tcp_io), temp_buffer, MESSAGE_SIZE, NULL))
+    test_end (TEST_RESULT_FAILED, "no echo; connected to the wrong address");
+
+  if (memcmp (buffer, temp_buffer, MESSAGE_SIZE))
+    test_end (TEST_RESULT_FAILED, "echo mismatch");
+
+  flow_tcp_io_sync_disconnect (tcp_io, NULL);
+  g_object_unref (tcp_io);
+
+  return elapsed;
+}
+
+static void
+test_run (void)
+{
+  FlowIPService *server_service;
+  FlowIPService *ip_service;
+  FlowTcpIO     *tcp_io;
+  GThread       *server_thread;
+  gint           stalled_fds [N_FILLERS + 1];
+  gdouble        elapsed;
+  gint           i;
+
+  for (i = 0; i < MESSAGE_SIZE; i++)
+    buffer [i] = (guchar) g_random_int ();
+
+  server_service = new_service (SERVER_ADDR, NULL);
+
+  tcp_listener = flow_tcp_io_listener_new ();
+  if (!flow_tcp_listener_set_local_service (FLOW_TCP_LISTENER (tcp_listener), server_service, NULL))
+    test_end (TEST_RESULT_FAILED, "could not bind listener");
+
+  open_stalled_listener (stalled_fds);
+
+  server_thread = g_thread_new (NULL, (GThreadFunc) server_main, GINT_TO_POINTER (2));
+
+  /* A refused address is given up on at once, without waiting out the
+   * attempt delay */
+
+  ip_service = new_service (REFUSED_ADDR, SERVER_ADDR);
+  elapsed = connect_and_echo (ip_service, 2000);
+  g_object_unref (ip_service);
+
+  test_print ("Fell back from refused address in %.1fms\n", elapsed);
+  if (elapsed >= MAX_CONNECT_MS)
+    test_end (TEST_RESULT_FAILED, "fallback waited for the attempt delay");
+
+  /* An address that doesn't answer is raced by the next one, which wins */
+
+  ip_service = new_service (STALLED_ADDR, SERVER_ADDR);
+  elapsed = connect_and_echo (ip_service, ATTEMPT_DELAY_MS);
+  g_object_unref (ip_service);
+
+  test_print ("Bypassed stalled address in %.1fms\n", elapsed);
+  if (elapsed >= MAX_CONNECT_MS)
+    test_end (TEST_RESULT_FAILED, "waited for the stalled address");
+
+  g_thread_join (server_thread);
+
+  /* Failure is reported once every address has failed */
+
+  ip_service = new_service (REFUSED_ADDR, REFUSED_ADDR_2);
+  tcp_io = flow_tcp_io_new ();
+
+  if (flow_tcp_io_sync_connect (tcp_io, ip_service, NULL))
+    test_end (TEST_RESULT_FAILED, "connected with no server");
+
+  g_object_unref (tcp_io);
+  g_object_unref (ip_service);
+
+  test_print ("Failed after trying every address\n");
+
+  for (i = 0; i <= N_FILLERS; i++)
+    close (stalled_fds [i]);
+
+  g_object_unref (tcp_listener);
+  tcp_listener = NULL;
+
+  g_object_unref (server_service);
+}
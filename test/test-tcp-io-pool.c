@@ -0,0 +1,161 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* test-tcp-io-pool.c - FlowTcpIOPool test.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+#define TEST_UNIT_NAME "FlowTcpIOPool"
+#define TEST_TIMEOUT_S 30
+
+/* Test variables; adjustable */
+
+#define LOCAL_PORT 2534
+
+#include "test-common.c"
+
+static FlowIPService     *loopback_service = NULL;
+static FlowTcpIOListener *tcp_listener     = NULL;
+
+/* Sends a request from the client and a reply from the server, checking
+ * that both arrive intact */
+static void
+exchange (FlowTcpIO *client, FlowTcpIO *server)
+{
+  guchar request [4] = { 'p', 'i', 'n', 'g' };
+  guchar reply   [4] = { 'p', 'o', 'n', 'g' };
+  guchar buffer  [4];
+
+  flow_io_write (FLOW_IO (client), request, sizeof (request));
+
+  if (!flow_io_sync_read_exact (FLOW_IO (server), buffer, sizeof (buffer), NULL) ||
+      memcmp (buffer, request, sizeof (request)))
+    test_end (TEST_RESULT_FAILED, "request mismatch");
+
+  flow_io_write (FLOW_IO (server), reply, sizeof (reply));
+
+  if (!flow_io_sync_read_exact (FLOW_IO (client), buffer, sizeof (buffer), NULL) ||
+      memcmp (buffer, reply, sizeof (reply)))
+    test_end (TEST_RESULT_FAILED, "reply mismatch");
+}
+
+static void
+test_run (void)
+{
+  FlowTcpIOPool *tcp_io_pool;
+  FlowTcpIO     *client;
+  FlowTcpIO     *reused_client;
+  FlowTcpIO     *server;
+  FlowIPAddr    *ip_addr;
+  GError        *error = NULL;
+
+  loopback_service = flow_ip_service_new ();
+  flow_ip_service_set_port (loopback_service, LOCAL_PORT);
+
+  ip_addr = flow_ip_addr_new ();
+  flow_ip_addr_set_string (ip_addr, "127.0.0.1");
+  flow_ip_service_add_address (loopback_service, ip_addr);
+  g_object_unref (ip_addr);
+
+  tcp_listener = flow_tcp_io_listener_new ();
+  if (!flow_tcp_listener_set_local_service (FLOW_TCP_LISTENER (tcp_listener), loopback_service, NULL))
+    test_end (TEST_RESULT_FAILED, "could not bind listener");
+
+  tcp_io_pool = flow_tcp_io_pool_new ();
+
+  /* The first checkout makes a new connection */
+
+  client = flow_tcp_io_pool_sync_get (tcp_io_pool, loopback_service, NULL);
+  if (!client)
+    test_end (TEST_RESULT_FAILED, "could not connect through pool");
+
+  server = flow_tcp_io_listener_sync_pop_connection (tcp_listener);
+  if (!server)
+    test_end (TEST_RESULT_FAILED, "missed connection on listener end");
+
+  exchange (client, server);
+
+  flow_tcp_io_pool_release (tcp_io_pool, client);
+
+  if (flow_tcp_io_pool_get_n_idle (tcp_io_pool, loopback_service) != 1)
+    test_end (TEST_RESULT_FAILED, "released connection was not kept");
+
+  /* The second checkout gets the same connection back, and it still works */
+
+  reused_client = flow_tcp_io_pool_sync_get (tcp_io_pool, loopback_service, NULL);
+  if (reused_client != client)
+    test_end (TEST_RESULT_FAILED, "idle connection was not reused");
+
+  if (flow_tcp_io_pool_get_n_idle (tcp_io_pool, loopback_service) != 0)
+    test_end (TEST_RESULT_FAILED, "reused connection still counted as idle");
+
+  exchange (client, server);
+
+  /* With a cap of one, a second concurrent checkout must fail */
+
+  g_object_set (tcp_io_pool, "max-per-host", 1, NULL);
+
+  if (flow_tcp_io_pool_sync_get (tcp_io_pool, loopback_service, &error))
+    test_end (TEST_RESULT_FAILED, "per-host limit was not enforced");
+
+  if (!error)
+    test_end (TEST_RESULT_FAILED, "per-host limit did not set an error");
+
+  g_clear_error (&error);
+
+  /* Dropping a connection without releasing it frees its slot */
+
+  g_object_unref (client);
+  flow_tcp_io_sync_disconnect (server, NULL);
+  g_object_unref (server);
+
+  client = flow_tcp_io_pool_sync_get (tcp_io_pool, loopback_service, NULL);
+  if (!client)
+    test_end (TEST_RESULT_FAILED, "dropped connection did not free its slot");
+
+  server = flow_tcp_io_listener_sync_pop_connection (tcp_listener);
+  if (!server)
+    test_end (TEST_RESULT_FAILED, "missed second connection on listener end");
+
+  exchange (client, server);
+
+  /* Clearing the pool closes idle connections */
+
+  flow_tcp_io_pool_release (tcp_io_pool, client);
+
+  if (flow_tcp_io_pool_get_n_idle (tcp_io_pool, loopback_service) != 1)
+    test_end (TEST_RESULT_FAILED, "second released connection was not kept");
+
+  flow_tcp_io_pool_clear (tcp_io_pool);
+
+  if (flow_tcp_io_pool_get_n_idle (tcp_io_pool, loopback_service) != 0)
+    test_end (TEST_RESULT_FAILED, "clear left idle connections");
+
+  flow_tcp_io_sync_disconnect (server, NULL);
+  g_object_unref (server);
+
+  g_object_unref (tcp_io_pool);
+
+  g_object_unref (tcp_listener);
+  tcp_listener = NULL;
+
+  g_object_unref (loopback_service);
+  loopback_service = NULL;
+}
@@ -0,0 +1,202 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* test-tcp-reuse-port.c - Shared TCP listener port test.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+
+#define TEST_UNIT_NAME "FlowTcpListener (reuse-port)"
+#define TEST_TIMEOUT_S 60
+
+/* Test variables; adjustable */
+
+#define LOCAL_PORT  2542
+
+#define N_LISTENERS 2
+#define N_CLIENTS   100  /* Several accept batches' worth */
+
+#include "test-common.c"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static gint client_fds [N_CLIENTS];
+
+/* Connects all clients as fast as it can, so connections queue up on the
+ * listening sockets, then checks that each one got its own echo */
+static void
+client_main (void)
+{
+  struct sockaddr_in sa;
+  gint               i;
+
+  memset (&sa, 0, sizeof (sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port   = htons (LOCAL_PORT);
+  inet_pton (AF_INET, "127.0.0.1", &sa.sin_addr);
+
+  for (i = 0; i < N_CLIENTS; i++)
+  {
+    guint32 index = i;
+
+    client_fds [i] = socket (AF_INET, SOCK_STREAM, 0);
+    if (client_fds [i] < 0)
+      test_end (TEST_RESULT_SYSTEM_ERROR, "could not create socket");
+
+    if (connect (client_fds [i], (struct sockaddr *) &sa, sizeof (sa)) < 0)
+      test_end (TEST_RESULT_FAILED, "client connect failed");
+
+    if (write (client_fds [i], &index, sizeof (index)) != sizeof (index))
+      test_end (TEST_RESULT_FAILED, "client write failed");
+  }
+
+  for (i = 0; i < N_CLIENTS; i++)
+  {
+    guint32 index;
+    gint    len = 0;
+    gint    result;
+
+    while (len < (gint) sizeof (index) &&
+           (result = read (client_fds [i], (guchar *) &index + len, sizeof (index) - len)) > 0)
+      len += result;
+
+    if (len != sizeof (index) || index != (guint32) i)
+      test_end (TEST_RESULT_FAILED, "client got the wrong echo");
+  }
+}
+
+static void
+test_run (void)
+{
+  FlowIPService     *loopback_service;
+  FlowIPAddr        *ip_addr;
+  FlowTcpIOListener *tcp_listeners [N_LISTENERS];
+  FlowTcpIOListener *exclusive_listener;
+  FlowTcpIO         *tcp_ios [N_CLIENTS];
+  gboolean           seen [N_CLIENTS];
+  gint               n_accepted [N_LISTENERS];
+  gint               n_total = 0;
+  GThread           *client_thread;
+  gint               i;
+
+  loopback_service = flow_ip_service_new ();
+  flow_ip_service_set_port (loopback_service, LOCAL_PORT);
+
+  ip_addr = flow_ip_addr_new ();
+  flow_ip_addr_set_string (ip_addr, "127.0.0.1");
+  flow_ip_service_add_address (loopback_service, ip_addr);
+  g_object_unref (ip_addr);
+
+  /* Several listeners can share the port when they all ask to */
+
+  for (i = 0; i < N_LISTENERS; i++)
+  {
+    tcp_listeners [i] = flow_tcp_io_listener_new ();
+    g_object_set (tcp_listeners [i], "reuse-port", TRUE, NULL);
+
+    if (!flow_tcp_listener_set_local_service (FLOW_TCP_LISTENER (tcp_listeners [i]), loopback_service, NULL))
+      test_end (TEST_RESULT_FAILED, "could not bind shared listener");
+
+    n_accepted [i] = 0;
+  }
+
+  /* ...but one that doesn't ask can't take it */
+
+  exclusive_listener = flow_tcp_io_listener_new ();
+  if (flow_tcp_listener_set_local_service (FLOW_TCP_LISTENER (exclusive_listener), loopback_service, NULL))
+    test_end (TEST_RESULT_FAILED, "bound without reuse-port to a shared port");
+  g_object_unref (exclusive_listener);
+
+  memset (seen, 0, sizeof (seen));
+
+  client_thread = g_thread_new (NULL, (GThreadFunc) client_main, NULL);
+
+  while (n_total < N_CLIENTS)
+  {
+    gboolean got_any = FALSE;
+
+    for (i = 0; i < N_LISTENERS; i++)
+    {
+      FlowTcpIO *tcp_io;
+
+      while ((tcp_io = flow_tcp_io_listener_pop_connection (tcp_listeners [i])))
+      {
+        guint32 index;
+
+        got_any = TRUE;
+
+        if (n_total >= N_CLIENTS)
+          test_end (TEST_RESULT_FAILED, "too many connections");
+
+        if (!flow_io_sync_read_exact (FLOW_IO (tcp_io), &index, sizeof (index), NULL))
+          test_end (TEST_RESULT_FAILED, "short read on accepted connection");
+
+        if (index >= N_CLIENTS || seen [index])
+          test_end (TEST_RESULT_FAILED, "bad or duplicate client index");
+
+        seen [index] = TRUE;
+
+        flow_io_write (FLOW_IO (tcp_io), &index, sizeof (index));
+        flow_io_flush (FLOW_IO (tcp_io));
+
+        tcp_ios [n_total++] = tcp_io;
+        n_accepted [i]++;
+      }
+    }
+
+    if (!got_any)
+      g_main_context_iteration (NULL, TRUE);
+  }
+
+  /* Flush out the echoes while the client reads them */
+
+  for (i = 0; i < N_CLIENTS; i++)
+  {
+    if (!flow_io_sync_flush (FLOW_IO (tcp_ios [i]), NULL))
+      test_end (TEST_RESULT_FAILED, "could not flush echo");
+  }
+
+  g_thread_join (client_thread);
+
+  for (i = 0; i < N_LISTENERS; i++)
+    test_print ("Listener %d accepted %d connections\n", i, n_accepted [i]);
+
+  /* The kernel spreads connections by hash; with this many, each
+   * listener gets some */
+
+  for (i = 0; i < N_LISTENERS; i++)
+  {
+    if (n_accepted [i] == 0)
+      test_end (TEST_RESULT_FAILED, "connections were not spread across listeners");
+  }
+
+  for (i = 0; i < N_CLIENTS; i++)
+  {
+    close (client_fds [i]);
+    g_object_unref (tcp_ios [i]);
+  }
+
+  for (i = 0; i < N_LISTENERS; i++)
+    g_object_unref (tcp_listeners [i]);
+
+  g_object_unref (loopback_service);
+}
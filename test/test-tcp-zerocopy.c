@@ -0,0 +1,151 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* test-tcp-zerocopy.c - Zero-copy TCP send test.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+#define TEST_UNIT_NAME "FlowTcpConnector (zero-copy)"
+#define TEST_TIMEOUT_S 60
+
+/* Test variables; adjustable */
+
+#define LOCAL_PORT  2535
+
+#define BUFFER_SIZE 16000000  /* Amount of data to transfer */
+#define CHUNK_SIZE  65536     /* Write unit; large enough to be sent zero-copy */
+
+#include "test-common.c"
+
+static guchar            *buffer           = NULL;
+static FlowIPService     *loopback_service = NULL;
+static FlowTcpIOListener *tcp_listener     = NULL;
+
+/* Starts reading on the listener end late, so much of the data is still
+ * in flight when the sender closes. A packet released too early would
+ * show up as corrupted data. */
+static void
+reader_main (void)
+{
+  FlowTcpIO *tcp_io;
+  guchar    *temp_buffer;
+  gint       offset;
+
+  tcp_io = flow_tcp_io_listener_sync_pop_connection (tcp_listener);
+  if (!tcp_io)
+    test_end (TEST_RESULT_FAILED, "missed connection on listener end");
+
+  temp_buffer = g_malloc (CHUNK_SIZE);
+
+  /* Let the writer fill up the socket buffers */
+
+  g_usleep (500000);
+
+  for (offset = 0; offset < BUFFER_SIZE; offset += CHUNK_SIZE)
+  {
+    gint len = MIN (CHUNK_SIZE, BUFFER_SIZE - offset);
+
+    if (!flow_io_sync_read_exact (FLOW_IO (tcp_io), temp_buffer, len, NULL))
+      test_end (TEST_RESULT_FAILED, "short read");
+
+    if (memcmp (buffer + offset, temp_buffer, len))
+      test_end (TEST_RESULT_FAILED, "data mismatch");
+  }
+
+  test_print ("Reader got all %d bytes\n", BUFFER_SIZE);
+
+  flow_tcp_io_sync_disconnect (tcp_io, NULL);
+  g_object_unref (tcp_io);
+  g_free (temp_buffer);
+}
+
+static void
+test_run (void)
+{
+  FlowTcpIO  *tcp_io;
+  FlowIPAddr *ip_addr;
+  GThread    *reader_thread;
+  GSList     *scratch = NULL;
+  gint        offset;
+  gint        i;
+
+  g_random_set_seed (time (NULL));
+
+  buffer = g_malloc (BUFFER_SIZE);
+
+  for (i = 0; i < BUFFER_SIZE; i++)
+    buffer [i] = (guchar) g_random_int ();
+
+  loopback_service = flow_ip_service_new ();
+  flow_ip_service_set_port (loopback_service, LOCAL_PORT);
+
+  ip_addr = flow_ip_addr_new ();
+  flow_ip_addr_set_string (ip_addr, "127.0.0.1");
+  flow_ip_service_add_address (loopback_service, ip_addr);
+  g_object_unref (ip_addr);
+
+  tcp_listener = flow_tcp_io_listener_new ();
+  if (!flow_tcp_listener_set_local_service (FLOW_TCP_LISTENER (tcp_listener), loopback_service, NULL))
+    test_end (TEST_RESULT_FAILED, "could not bind listener");
+
+  reader_thread = g_thread_new (NULL, (GThreadFunc) reader_main, NULL);
+
+  tcp_io = flow_tcp_io_new ();
+  g_object_set (flow_tcp_io_get_tcp_connector (tcp_io), "zerocopy", TRUE, NULL);
+
+  if (!flow_tcp_io_sync_connect (tcp_io, loopback_service, NULL))
+    test_end (TEST_RESULT_FAILED, "loopback connect failed");
+
+  /* The reader isn't reading yet, so most of this is still in flight when
+   * we close. Zero-copy is refused where unsupported, and the kernel copies
+   * over loopback anyway, but either way the data must arrive intact. */
+
+  for (offset = 0; offset < BUFFER_SIZE; offset += CHUNK_SIZE)
+    flow_io_write (FLOW_IO (tcp_io), buffer + offset, MIN (CHUNK_SIZE, BUFFER_SIZE - offset));
+
+  /* This returns once everything has been handed to the kernel */
+
+  if (!flow_tcp_io_sync_disconnect (tcp_io, NULL))
+    test_end (TEST_RESULT_FAILED, "disconnect failed");
+
+  g_object_unref (tcp_io);
+
+  /* Churn the allocator, so released packet memory gets reused */
+
+  for (i = 0; i < 64; i++)
+  {
+    guchar *p = g_malloc (CHUNK_SIZE);
+
+    memset (p, 0xaa, CHUNK_SIZE);
+    scratch = g_slist_prepend (scratch, p);
+  }
+
+  g_thread_join (reader_thread);
+
+  g_slist_free_full (scratch, g_free);
+
+  g_object_unref (tcp_listener);
+  tcp_listener = NULL;
+
+  g_object_unref (loopback_service);
+  loopback_service = NULL;
+
+  g_free (buffer);
+}
@@ -0,0 +1,721 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* test-tls-common.c - Certificates and OCSP responses for TLS testing.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+
+/* This file should be included directly in TLS test programs, after
+ * test-common.c. It makes a throwaway CA and a server certificate for
+ * "localhost" and 127.0.0.1, and can sign OCSP responses for the latter. */
+
+#include <time.h>
+#include <glib/gstdio.h>
+#include <gnutls/gnutls.h>
+#include <gnutls/x509.h>
+#include <gnutls/x509-ext.h>
+#include <gnutls/abstract.h>
+#include <gnutls/crypto.h>
+
+#define TEST_TLS_SERVER_NAME "localhost"
+#define TEST_TLS_SERVER_ADDR "127.0.0.1"
+
+/* Clients only insist on a stapled OCSP response if the certificate asks
+ * for one (RFC 7633). Older GnuTLS can't make such certificates. */
+#if GNUTLS_VERSION_NUMBER >= 0x030501
+# define TEST_TLS_HAVE_MUST_STAPLE 1
+#endif
+
+/* TLS feature number for status_request */
+#define TLS_FEATURE_STATUS_REQUEST 5
+
+typedef struct
+{
+  gchar                 *dir;
+  gchar                 *ca_path;
+  gchar                 *cert_path;
+  gchar                 *key_path;
+
+  gnutls_x509_crt_t      ca_crt;
+  gnutls_x509_privkey_t  ca_key;
+  gnutls_x509_crt_t      server_crt;
+}
+TestTlsFiles;
+
+static const guint8 oid_sha1 []             = { 0x2b, 0x0e, 0x03, 0x02, 0x1a };
+static const guint8 oid_ecdsa_with_sha256 [] = { 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x04, 0x03, 0x02 };
+static const guint8 oid_ocsp_basic []       = { 0x2b, 0x06, 0x01, 0x05, 0x05, 0x07, 0x30, 0x01, 0x01 };
+
+#define DER_INTEGER          0x02
+#define DER_BIT_STRING       0x03
+#define DER_OCTET_STRING     0x04
+#define DER_NULL             0x05
+#define DER_OID              0x06
+#define DER_ENUMERATED       0x0a
+#define DER_GENERALIZED_TIME 0x18
+#define DER_SEQUENCE         0x30
+#define DER_CONTEXT(n)       (0xa0 | (n))  /* Constructed, explicit */
+#define DER_CONTEXT_PRIM(n)  (0x80 | (n))  /* Primitive, implicit */
+
+static void
+test_tls_check (gint result, const gchar *what)
+{
+  if (result < 0)
+  {
+    test_print ("%s: %s\n", what, gnutls_strerror (result));
+    test_end (TEST_RESULT_SYSTEM_ERROR, "could not generate test certificates");
+  }
+}
+
+/* --- Just enough DER to write an OCSP response --- */
+
+static void
+der_append (GByteArray *out, guint8 tag, gconstpointer data, gsize len)
+{
+  guint8 header [6];
+  gint   n = 0;
+
+  header [n++] = tag;
+
+  if (len < 0x80)
+  {
+    header [n++] = len;
+  }
+  else if (len < 0x100)
+  {
+    header [n++] = 0x81;
+    header [n++] = len;
+  }
+  else
+  {
+    g_assert (len < 0x10000);
+    header [n++] = 0x82;
+    header [n++] = len >> 8;
+    header [n++] = len & 0xff;
+  }
+
+  g_byte_array_append (out, header, n);
+  g_byte_array_append (out, data, len);
+}
+
+/* Appends inner wrapped in a tag, and frees inner */
+static void
+der_append_wrapped (GByteArray *out, guint8 tag, GByteArray *inner)
+{
+  der_append (out, tag, inner->data, inner->len);
+  g_byte_array_free (inner, TRUE);
+}
+
+static void
+der_append_time (GByteArray *out, time_t t)
+{
+  struct tm tm;
+  gchar     buf [32];
+
+  gmtime_r (&t, &tm);
+  strftime (buf, sizeof (buf), "%Y%m%d%H%M%SZ", &tm);
+  der_append (out, DER_GENERALIZED_TIME, buf, strlen (buf));
+}
+
+/* Reads a tag and length, and returns a pointer to the contents */
+static const guint8 *
+der_read_header (const guint8 *p, guint8 *tag, gsize *len)
+{
+  *tag = *p++;
+  *len = *p++;
+
+  if (*len & 0x80)
+  {
+    gint n = *len & 0x7f;
+
+    for (*len = 0; n > 0; n--)
+      *len = (*len << 8) | *p++;
+  }
+
+  return p;
+}
+
+/* The OCSP issuer key hash covers the bits of the issuer's public key,
+ * without the surrounding SubjectPublicKeyInfo */
+static void
+hash_issuer_key (gnutls_x509_crt_t issuer, guint8 *hash_out)
+{
+  gnutls_pubkey_t  pubkey;
+  gnutls_datum_t   spki;
+  const guint8    *p;
+  guint8           tag;
+  gsize            len;
+
+  test_tls_check (gnutls_pubkey_init (&pubkey), "gnutls_pubkey_init");
+  test_tls_check (gnutls_pubkey_import_x509 (pubkey, issuer, 0), "gnutls_pubkey_import_x509");
+  test_tls_check (gnutls_pubkey_export2 (pubkey, GNUTLS_X509_FMT_DER, &spki), "gnutls_pubkey_export2");
+
+  p = der_read_header (spki.data, &tag, &len);  /* SubjectPublicKeyInfo */
+  p = der_read_header (p, &tag, &len);          /* AlgorithmIdentifier */
+  p = der_read_header (p + len, &tag, &len);    /* subjectPublicKey */
+  g_assert (tag == DER_BIT_STRING);
+
+  /* Skip the unused bits count */
+  gnutls_hash_fast (GNUTLS_DIG_SHA1, p + 1, len - 1, hash_out);
+
+  gnutls_free (spki.data);
+  gnutls_pubkey_deinit (pubkey);
+}
+
+/* --- Certificates --- */
+
+static gnutls_x509_privkey_t
+generate_key (void)
+{
+  gnutls_x509_privkey_t key;
+
+  test_tls_check (gnutls_x509_privkey_init (&key), "gnutls_x509_privkey_init");
+  test_tls_check (gnutls_x509_privkey_generate (key, GNUTLS_PK_ECDSA,
+                                                GNUTLS_CURVE_TO_BITS (GNUTLS_ECC_CURVE_SECP256R1), 0),
+                  "gnutls_x509_privkey_generate");
+  return key;
+}
+
+static gnutls_x509_crt_t
+new_crt (gnutls_x509_privkey_t key, const gchar *dn, guint8 serial)
+{
+  gnutls_x509_crt_t crt;
+  time_t            now = time (NULL);
+
+  test_tls_check (gnutls_x509_crt_init (&crt), "gnutls_x509_crt_init");
+  test_tls_check (gnutls_x509_crt_set_version (crt, 3), "gnutls_x509_crt_set_version");
+  test_tls_check (gnutls_x509_crt_set_serial (crt, &serial, 1), "gnutls_x509_crt_set_serial");
+  test_tls_check (gnutls_x509_crt_set_activation_time (crt, now - 3600), "gnutls_x509_crt_set_activation_time");
+  test_tls_check (gnutls_x509_crt_set_expiration_time (crt, now + 86400), "gnutls_x509_crt_set_expiration_time");
+  test_tls_check (gnutls_x509_crt_set_dn (crt, dn, NULL), "gnutls_x509_crt_set_dn");
+  test_tls_check (gnutls_x509_crt_set_key (crt, key), "gnutls_x509_crt_set_key");
+  return crt;
+}
+
+static void
+write_datum (const gchar *path, gnutls_datum_t *datum)
+{
+  if (!g_file_set_contents (path, (const gchar *) datum->data, datum->size, NULL))
+    test_end (TEST_RESULT_SYSTEM_ERROR, "could not write test certificates");
+
+  gnutls_free (datum->data);
+}
+
+/* Makes the CA, and a server certificate signed by it. With must_staple,
+ * clients will insist on a stapled OCSP response, if GnuTLS supports it. */
+static TestTlsFiles *
+test_tls_files_new (gboolean must_staple)
+{
+  TestTlsFiles          *files;
+  gnutls_x509_privkey_t  server_key;
+  gnutls_datum_t         pem;
+  guint8                 addr [4] = { 127, 0, 0, 1 };
+
+  files = g_new0 (TestTlsFiles, 1);
+
+  files->dir = g_dir_make_tmp ("flow-tls-XXXXXX", NULL);
+  if (!files->dir)
+    test_end (TEST_RESULT_SYSTEM_ERROR, "could not make temporary directory");
+
+  files->ca_path   = g_build_filename (files->dir, "ca.pem", NULL);
+  files->cert_path = g_build_filename (files->dir, "server.pem", NULL);
+  files->key_path  = g_build_filename (files->dir, "server-key.pem", NULL);
+
+  /* Self-signed CA */
+
+  files->ca_key = generate_key ();
+  files->ca_crt = new_crt (files->ca_key, "CN=Flow Test CA", 1);
+
+  test_tls_check (gnutls_x509_crt_set_basic_constraints (files->ca_crt, 1, -1),
+                  "gnutls_x509_crt_set_basic_constraints");
+  test_tls_check (gnutls_x509_crt_set_key_usage (files->ca_crt, GNUTLS_KEY_KEY_CERT_SIGN | GNUTLS_KEY_CRL_SIGN),
+                  "gnutls_x509_crt_set_key_usage");
+  test_tls_check (gnutls_x509_crt_sign2 (files->ca_crt, files->ca_crt, files->ca_key, GNUTLS_DIG_SHA256, 0),
+                  "gnutls_x509_crt_sign2");
+
+  /* Server */
+
+  server_key = generate_key ();
+  files->server_crt = new_crt (server_key, "CN=" TEST_TLS_SERVER_NAME, 2);
+
+  test_tls_check (gnutls_x509_crt_set_basic_constraints (files->server_crt, 0, -1),
+                  "gnutls_x509_crt_set_basic_constraints");
+  test_tls_check (gnutls_x509_crt_set_key_usage (files->server_crt, GNUTLS_KEY_DIGITAL_SIGNATURE),
+                  "gnutls_x509_crt_set_key_usage");
+  test_tls_check (gnutls_x509_crt_set_key_purpose_oid (files->server_crt, GNUTLS_KP_TLS_WWW_SERVER, 0),
+                  "gnutls_x509_crt_set_key_purpose_oid");
+  test_tls_check (gnutls_x509_crt_set_subject_alt_name (files->server_crt, GNUTLS_SAN_DNSNAME,
+                                                        TEST_TLS_SERVER_NAME, strlen (TEST_TLS_SERVER_NAME),
+                                                        GNUTLS_FSAN_APPEND),
+                  "gnutls_x509_crt_set_subject_alt_name");
+  test_tls_check (gnutls_x509_crt_set_subject_alt_name (files->server_crt, GNUTLS_SAN_IPADDRESS,
+                                                        addr, sizeof (addr), GNUTLS_FSAN_APPEND),
+                  "gnutls_x509_crt_set_subject_alt_name");
+
+#ifdef TEST_TLS_HAVE_MUST_STAPLE
+  if (must_staple)
+  {
+    gnutls_x509_tlsfeatures_t features;
+
+    test_tls_check (gnutls_x509_tlsfeatures_init (&features), "gnutls_x509_tlsfeatures_init");
+    test_tls_check (gnutls_x509_tlsfeatures_add (features, TLS_FEATURE_STATUS_REQUEST),
+                    "gnutls_x509_tlsfeatures_add");
+    test_tls_check (gnutls_x509_crt_set_tlsfeatures (files->server_crt, features),
+                    "gnutls_x509_crt_set_tlsfeatures");
+    gnutls_x509_tlsfeatures_deinit (features);
+  }
+#endif
+
+  test_tls_check (gnutls_x509_crt_sign2 (files->server_crt, files->ca_crt, files->ca_key, GNUTLS_DIG_SHA256, 0),
+                  "gnutls_x509_crt_sign2");
+
+  test_tls_check (gnutls_x509_crt_export2 (files->ca_crt, GNUTLS_X509_FMT_PEM, &pem), "gnutls_x509_crt_export2");
+  write_datum (files->ca_path, &pem);
+  test_tls_check (gnutls_x509_crt_export2 (files->server_crt, GNUTLS_X509_FMT_PEM, &pem), "gnutls_x509_crt_export2");
+  write_datum (files->cert_path, &pem);
+  test_tls_check (gnutls_x509_privkey_export2 (server_key, GNUTLS_X509_FMT_PEM, &pem), "gnutls_x509_privkey_export2");
+  write_datum (files->key_path, &pem);
+
+  gnutls_x509_privkey_deinit (server_key);
+  return files;
+}
+
+/* Writes a DER-encoded OCSP response for the server certificate to a new
+ * file in the test directory, and returns its path. The response says the
+ * certificate is good, and expires next_update seconds from now. */
+G_GNUC_UNUSED static gchar *
+test_tls_files_write_ocsp_response (TestTlsFiles *files, const gchar *name, gint next_update)
+{
+  static const guint8  zero [] = { 0 };
+  GByteArray          *cert_id;
+  GByteArray          *single;
+  GByteArray          *responses;
+  GByteArray          *tbs;
+  GByteArray          *alg;
+  GByteArray          *basic;
+  GByteArray          *response_bytes;
+  GByteArray          *response;
+  GByteArray          *body;
+  gnutls_privkey_t     signer;
+  gnutls_datum_t       dn;
+  gnutls_datum_t       tbs_datum;
+  gnutls_datum_t       signature;
+  guint8               name_hash [20];
+  guint8               key_hash [20];
+  guint8               serial [8];
+  gsize                serial_len = sizeof (serial);
+  guint8               status = 0;  /* successful */
+  time_t               now = time (NULL);
+  gchar               *path;
+
+  /* CertID */
+
+  test_tls_check (gnutls_x509_crt_get_raw_dn (files->ca_crt, &dn), "gnutls_x509_crt_get_raw_dn");
+  gnutls_hash_fast (GNUTLS_DIG_SHA1, dn.data, dn.size, name_hash);
+  hash_issuer_key (files->ca_crt, key_hash);
+  test_tls_check (gnutls_x509_crt_get_serial (files->server_crt, serial, &serial_len),
+                  "gnutls_x509_crt_get_serial");
+
+  alg = g_byte_array_new ();
+  der_append (alg, DER_OID, oid_sha1, sizeof (oid_sha1));
+  der_append (alg, DER_NULL, NULL, 0);
+
+  cert_id = g_byte_array_new ();
+  der_append_wrapped (cert_id, DER_SEQUENCE, alg);
+  der_append (cert_id, DER_OCTET_STRING, name_hash, sizeof (name_hash));
+  der_append (cert_id, DER_OCTET_STRING, key_hash, sizeof (key_hash));
+  der_append (cert_id, DER_INTEGER, serial, serial_len);
+
+  /* SingleResponse */
+
+  single = g_byte_array_new ();
+  der_append_wrapped (single, DER_SEQUENCE, cert_id);
+  der_append (single, DER_CONTEXT_PRIM (0), NULL, 0);  /* good [0] IMPLICIT NULL */
+  der_append_time (single, now - 60);
+
+  body = g_byte_array_new ();
+  der_append_time (body, now + next_update);
+  der_append_wrapped (single, DER_CONTEXT (0), body);
+
+  responses = g_byte_array_new ();
+  der_append_wrapped (responses, DER_SEQUENCE, single);
+
+  /* ResponseData, with the CA responding by name */
+
+  tbs = g_byte_array_new ();
+  body = g_byte_array_new ();
+  g_byte_array_append (body, dn.data, dn.size);
+  der_append_wrapped (tbs, DER_CONTEXT (1), body);
+  der_append_time (tbs, now - 60);
+  der_append_wrapped (tbs, DER_SEQUENCE, responses);
+
+  body = g_byte_array_new ();
+  der_append_wrapped (body, DER_SEQUENCE, tbs);
+  tbs = body;
+
+  gnutls_free (dn.data);
+
+  /* Sign it */
+
+  test_tls_check (gnutls_privkey_init (&signer), "gnutls_privkey_init");
+  test_tls_check (gnutls_privkey_import_x509 (signer, files->ca_key, 0), "gnutls_privkey_import_x509");
+
+  tbs_datum.data = tbs->data;
+  tbs_datum.size = tbs->len;
+  test_tls_check (gnutls_privkey_sign_data (signer, GNUTLS_DIG_SHA256, 0, &tbs_datum, &signature),
+                  "gnutls_privkey_sign_data");
+  gnutls_privkey_deinit (signer);
+
+  /* BasicOCSPResponse */
+
+  basic = g_byte_array_new ();
+  g_byte_array_append (basic, tbs->data, tbs->len);
+  g_byte_array_free (tbs, TRUE);
+
+  alg = g_byte_array_new ();
+  der_append (alg, DER_OID, oid_ecdsa_with_sha256, sizeof (oid_ecdsa_with_sha256));
+  der_append_wrapped (basic, DER_SEQUENCE, alg);
+
+  body = g_byte_array_new ();
+  g_byte_array_append (body, zero, 1);  /* No unused bits */
+  g_byte_array_append (body, signature.data, signature.size);
+  der_append_wrapped (basic, DER_BIT_STRING, body);
+  gnutls_free (signature.data);
+
+  body = g_byte_array_new ();
+  der_append_wrapped (body, DER_SEQUENCE, basic);
+  basic = body;
+
+  /* OCSPResponse */
+
+  response_bytes = g_byte_array_new ();
+  der_append (response_bytes, DER_OID, oid_ocsp_basic, sizeof (oid_ocsp_basic));
+  der_append_wrapped (response_bytes, DER_OCTET_STRING, basic);
+
+  body = g_byte_array_new ();
+  der_append_wrapped (body, DER_SEQUENCE, response_bytes);
+
+  response = g_byte_array_new ();
+  der_append (response, DER_ENUMERATED, &status, 1);
+  der_append_wrapped (response, DER_CONTEXT (0), body);
+
+  body = g_byte_array_new ();
+  der_append_wrapped (body, DER_SEQUENCE, response);
+  response = body;
+
+  path = g_build_filename (files->dir, name, NULL);
+
+  if (!g_file_set_contents (path, (const gchar *) response->data, response->len, NULL))
+    test_end (TEST_RESULT_SYSTEM_ERROR, "could not write test OCSP response");
+
+  g_byte_array_free (response, TRUE);
+  return path;
+}
+
+static void
+test_tls_files_free (TestTlsFiles *files)
+{
+  GDir        *dir;
+  const gchar *name;
+
+  gnutls_x509_crt_deinit (files->server_crt);
+  gnutls_x509_crt_deinit (files->ca_crt);
+  gnutls_x509_privkey_deinit (files->ca_key);
+
+  dir = g_dir_open (files->dir, 0, NULL);
+
+  while (dir && (name = g_dir_read_name (dir)))
+  {
+    gchar *path = g_build_filename (files->dir, name, NULL);
+    g_unlink (path);
+    g_free (path);
+  }
+
+  if (dir)
+    g_dir_close (dir);
+
+  g_rmdir (files->dir);
+
+  g_free (files->ca_path);
+  g_free (files->cert_path);
+  g_free (files->key_path);
+  g_free (files->dir);
+  g_free (files);
+}
+
+/* --- Back-to-back protocol pair --- */
+
+/* A client and a server FlowTlsProtocol wired together through user
+ * adapters, standing in for the sockets. Ciphertext is moved across by
+ * test_tls_pair_pump (). Socket option requests are turned down the way
+ * a kernel without TLS support would. */
+
+#define TEST_TLS_PAIR_CHUNK_SIZE 8192
+
+typedef struct
+{
+  FlowTlsProtocol *client_tls;
+  FlowTlsProtocol *server_tls;
+  FlowUserAdapter *client_net;
+  FlowUserAdapter *server_net;
+  FlowUserAdapter *client_app;
+  FlowUserAdapter *server_app;
+
+  gint             n_offload_requests;
+}
+TestTlsPair;
+
+static FlowPad *
+test_tls_get_downstream_input (FlowTlsProtocol *tls_protocol)
+{
+  return FLOW_PAD (flow_duplex_element_get_downstream_input_pad (FLOW_DUPLEX_ELEMENT (tls_protocol)));
+}
+
+static FlowPad *
+test_tls_get_upstream_input (FlowTlsProtocol *tls_protocol)
+{
+  return FLOW_PAD (flow_duplex_element_get_upstream_input_pad (FLOW_DUPLEX_ELEMENT (tls_protocol)));
+}
+
+static FlowUserAdapter *
+test_tls_connect_adapter (FlowOutputPad *output_pad)
+{
+  FlowUserAdapter *user_adapter;
+
+  user_adapter = flow_user_adapter_new ();
+  flow_pad_connect (FLOW_PAD (output_pad),
+                    FLOW_PAD (flow_simplex_element_get_input_pad (FLOW_SIMPLEX_ELEMENT (user_adapter))));
+
+  return user_adapter;
+}
+
+/* Set properties on the protocols before calling test_tls_pair_start () */
+G_GNUC_UNUSED static TestTlsPair *
+test_tls_pair_new (FlowTlsCredentials *client_credentials, FlowTlsCredentials *server_credentials)
+{
+  TestTlsPair *pair;
+
+  pair = g_slice_new0 (TestTlsPair);
+
+  pair->client_tls = flow_tls_protocol_new (FLOW_AGENT_ROLE_CLIENT);
+  flow_tls_protocol_set_credentials (pair->client_tls, client_credentials);
+
+  pair->server_tls = flow_tls_protocol_new (FLOW_AGENT_ROLE_SERVER);
+  flow_tls_protocol_set_credentials (pair->server_tls, server_credentials);
+
+  pair->client_net = test_tls_connect_adapter (flow_duplex_element_get_downstream_output_pad (FLOW_DUPLEX_ELEMENT (pair->client_tls)));
+  pair->server_net = test_tls_connect_adapter (flow_duplex_element_get_downstream_output_pad (FLOW_DUPLEX_ELEMENT (pair->server_tls)));
+  pair->client_app = test_tls_connect_adapter (flow_duplex_element_get_upstream_output_pad (FLOW_DUPLEX_ELEMENT (pair->client_tls)));
+  pair->server_app = test_tls_connect_adapter (flow_duplex_element_get_upstream_output_pad (FLOW_DUPLEX_ELEMENT (pair->server_tls)));
+
+  return pair;
+}
+
+G_GNUC_UNUSED static void
+test_tls_pair_free (TestTlsPair *pair)
+{
+  g_object_unref (pair->client_tls);
+  g_object_unref (pair->server_tls);
+  g_object_unref (pair->client_net);
+  g_object_unref (pair->server_net);
+  g_object_unref (pair->client_app);
+  g_object_unref (pair->server_app);
+
+  g_slice_free (TestTlsPair, pair);
+}
+
+/* "Connects", telling the client who it's talking to so it can check the
+ * certificate. The handshake happens as the pair is pumped. */
+G_GNUC_UNUSED static void
+test_tls_pair_start (TestTlsPair *pair)
+{
+  FlowIPService *ip_service;
+  FlowIPAddr    *ip_addr;
+
+  ip_service = flow_ip_service_new ();
+  ip_addr = flow_ip_addr_new ();
+  flow_ip_addr_set_string (ip_addr, TEST_TLS_SERVER_ADDR);
+  flow_ip_service_add_address (ip_service, ip_addr);
+  flow_ip_service_set_name (ip_service, TEST_TLS_SERVER_NAME);
+  g_object_unref (ip_addr);
+
+  flow_pad_push (test_tls_get_upstream_input (pair->client_tls),
+                 flow_packet_new_take_object (flow_tcp_connect_op_new (ip_service, -1), 0));
+  g_object_unref (ip_service);
+
+  flow_pad_push (test_tls_get_downstream_input (pair->server_tls),
+                 flow_create_simple_event_packet (FLOW_STREAM_DOMAIN, FLOW_STREAM_BEGIN));
+  flow_pad_push (test_tls_get_downstream_input (pair->client_tls),
+                 flow_create_simple_event_packet (FLOW_STREAM_DOMAIN, FLOW_STREAM_BEGIN));
+}
+
+/* Returns TRUE if anything moved */
+static gboolean
+test_tls_pair_forward (TestTlsPair *pair, FlowUserAdapter *from, FlowTlsProtocol *from_tls,
+                       FlowTlsProtocol *to_tls)
+{
+  FlowPacketQueue *packet_queue = flow_user_adapter_get_input_queue (from);
+  FlowPacket      *packet;
+  gboolean         moved        = FALSE;
+
+  while ((packet = flow_packet_queue_pop_packet (packet_queue)))
+  {
+    moved = TRUE;
+
+    if (flow_packet_get_format (packet) != FLOW_PACKET_FORMAT_OBJECT)
+    {
+      flow_pad_push (test_tls_get_downstream_input (to_tls), packet);
+      continue;
+    }
+
+    /* Other objects are local to the socket, except for the end of the
+     * stream, which the peer sees as EOF */
+
+    if (FLOW_IS_SOCKOPT_OP (flow_packet_get_data (packet)))
+    {
+      pair->n_offload_requests++;
+      flow_pad_push (test_tls_get_downstream_input (from_tls),
+                     flow_create_simple_event_packet (FLOW_SOCKET_DOMAIN, FLOW_SOCKET_OPTIONS_FAILED));
+    }
+    else if (FLOW_IS_DETAILED_EVENT (flow_packet_get_data (packet)) &&
+             flow_detailed_event_matches (flow_packet_get_data (packet), FLOW_STREAM_DOMAIN, FLOW_STREAM_END))
+    {
+      flow_pad_push (test_tls_get_downstream_input (to_tls),
+                     flow_create_simple_event_packet (FLOW_STREAM_DOMAIN, FLOW_STREAM_END));
+    }
+
+    flow_packet_unref (packet);
+  }
+
+  return moved;
+}
+
+/* Moves ciphertext back and forth until app has received len bytes of
+ * plaintext. Runs the main loop when there's nothing to move, so crypto
+ * jobs can finish. A pair that stalls is caught by the test timeout. */
+G_GNUC_UNUSED static void
+test_tls_pair_pump (TestTlsPair *pair, FlowUserAdapter *app, gint len)
+{
+  FlowPacketQueue *packet_queue = flow_user_adapter_get_input_queue (app);
+
+  while (flow_packet_queue_get_length_data_bytes (packet_queue) < len)
+  {
+    gboolean moved;
+
+    moved  = test_tls_pair_forward (pair, pair->client_net, pair->client_tls, pair->server_tls);
+    moved |= test_tls_pair_forward (pair, pair->server_net, pair->server_tls, pair->client_tls);
+
+    if (!moved)
+      g_main_context_iteration (NULL, TRUE);
+  }
+}
+
+/* Pumps until app sees the end of the stream, with no more data before it */
+G_GNUC_UNUSED static void
+test_tls_pair_pump_to_end (TestTlsPair *pair, FlowUserAdapter *app)
+{
+  FlowPacketQueue *packet_queue = flow_user_adapter_get_input_queue (app);
+
+  for (;;)
+  {
+    FlowPacket *packet;
+    gboolean    moved;
+
+    while ((packet = flow_packet_queue_pop_packet (packet_queue)))
+    {
+      gboolean is_end;
+
+      if (flow_packet_get_format (packet) != FLOW_PACKET_FORMAT_OBJECT)
+        test_end (TEST_RESULT_FAILED, "unexpected plaintext before end of stream");
+
+      is_end = FLOW_IS_DETAILED_EVENT (flow_packet_get_data (packet)) &&
+               flow_detailed_event_matches (flow_packet_get_data (packet), FLOW_STREAM_DOMAIN, FLOW_STREAM_END);
+      flow_packet_unref (packet);
+
+      if (is_end)
+        return;
+    }
+
+    moved  = test_tls_pair_forward (pair, pair->client_net, pair->client_tls, pair->server_tls);
+    moved |= test_tls_pair_forward (pair, pair->server_net, pair->server_tls, pair->client_tls);
+
+    if (!moved)
+      g_main_context_iteration (NULL, TRUE);
+  }
+}
+
+G_GNUC_UNUSED static void
+test_tls_pair_send (FlowTlsProtocol *tls_protocol, const guchar *data, gint len)
+{
+  gint offset;
+
+  for (offset = 0; offset < len; offset += TEST_TLS_PAIR_CHUNK_SIZE)
+    flow_pad_push (test_tls_get_upstream_input (tls_protocol),
+                   flow_packet_new (FLOW_PACKET_FORMAT_BUFFER, (gpointer) (data + offset),
+                                    MIN (TEST_TLS_PAIR_CHUNK_SIZE, len - offset)));
+
+  flow_pad_push (test_tls_get_upstream_input (tls_protocol),
+                 flow_create_simple_event_packet (FLOW_STREAM_DOMAIN, FLOW_STREAM_FLUSH));
+}
+
+/* Checks and consumes everything app has received. Stream events are
+ * skipped; returns TRUE if one of them was FLOW_STREAM_END. */
+G_GNUC_UNUSED static gboolean
+test_tls_pair_check (FlowUserAdapter *app, const guchar *data, gint len)
+{
+  FlowPacketQueue *packet_queue = flow_user_adapter_get_input_queue (app);
+  FlowPacket      *packet;
+  guchar          *temp_buffer;
+  gint             offset       = 0;
+  gboolean         got_end      = FALSE;
+
+  temp_buffer = g_malloc (len);
+
+  while ((packet = flow_packet_queue_pop_packet (packet_queue)))
+  {
+    if (flow_packet_get_format (packet) == FLOW_PACKET_FORMAT_BUFFER)
+    {
+      gint size = flow_packet_get_size (packet);
+
+      if (offset + size > len)
+        test_end (TEST_RESULT_FAILED, "too much plaintext came through");
+
+      memcpy (temp_buffer + offset, flow_packet_get_data (packet), size);
+      offset += size;
+    }
+    else if (FLOW_IS_DETAILED_EVENT (flow_packet_get_data (packet)) &&
+             flow_detailed_event_matches (flow_packet_get_data (packet), FLOW_STREAM_DOMAIN, FLOW_STREAM_END))
+    {
+      got_end = TRUE;
+    }
+
+    flow_packet_unref (packet);
+  }
+
+  if (offset != len)
+    test_end (TEST_RESULT_FAILED, "too little plaintext came through");
+
+  if (memcmp (temp_buffer, data, len))
+    test_end (TEST_RESULT_FAILED, "plaintext mismatch");
+
+  g_free (temp_buffer);
+  return got_end;
+}
@@ -0,0 +1,252 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* test-tls-credentials.c - FlowTlsCredentials test.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+
+#define TEST_UNIT_NAME "FlowTlsCredentials"
+#define TEST_TIMEOUT_S 60
+
+/* Test variables; adjustable */
+
+#define TEST_PORT         2536
+#define OTHER_LOOPBACK    "127.0.0.2"  /* Not in the certificate */
+#define OCSP_REFRESH_S    1
+
+#include "test-common.c"
+#include "test-tls-common.c"
+
+static const guchar          greeting [] = "Hello, verified client";
+
+static TestTlsFiles         *files;
+static FlowTlsCredentials   *server_credentials;
+static FlowTlsCredentials   *client_credentials;
+static FlowTlsTcpIOListener *listener;
+static FlowTlsTcpIOListener *other_listener;
+
+static FlowIPService *
+make_service (const gchar *name, const gchar *addr)
+{
+  FlowIPService *ip_service;
+  FlowIPAddr    *ip_addr;
+
+  ip_service = flow_ip_service_new ();
+  ip_addr = flow_ip_addr_new ();
+  flow_ip_addr_set_string (ip_addr, addr);
+  flow_ip_service_set_port (ip_service, TEST_PORT);
+  flow_ip_service_add_address (ip_service, ip_addr);
+  g_object_unref (ip_addr);
+
+  if (name)
+    flow_ip_service_set_name (ip_service, name);
+
+  return ip_service;
+}
+
+static FlowTlsTcpIOListener *
+make_listener (const gchar *addr)
+{
+  FlowTlsTcpIOListener *tls_tcp_listener;
+  FlowIPService        *ip_service;
+
+  ip_service = make_service (NULL, addr);
+
+  tls_tcp_listener = flow_tls_tcp_io_listener_new ();
+  flow_tls_tcp_io_listener_set_credentials (tls_tcp_listener, server_credentials);
+
+  if (!flow_tcp_listener_set_local_service (FLOW_TCP_LISTENER (tls_tcp_listener), ip_service, NULL))
+  {
+    g_object_unref (tls_tcp_listener);
+    tls_tcp_listener = NULL;
+  }
+
+  g_object_unref (ip_service);
+  return tls_tcp_listener;
+}
+
+/* Connects to a listener as name/addr, and returns TRUE if the server's
+ * data made it through, i.e. the client accepted the certificate */
+static gboolean
+try_connection (FlowTlsTcpIOListener *tls_tcp_listener, const gchar *name, const gchar *addr)
+{
+  FlowIPService *ip_service;
+  FlowTlsTcpIO  *client;
+  FlowTlsTcpIO  *server;
+  guchar         buf [sizeof (greeting)];
+  gboolean       success;
+
+  test_print ("Connecting to %s as %s\n", addr, name ? name : "(no name)");
+
+  /* A resumed session would skip verification */
+
+  flow_tls_protocol_clear_session_cache ();
+
+  ip_service = make_service (name, addr);
+
+  client = flow_tls_tcp_io_new ();
+  flow_tls_protocol_set_credentials (flow_tls_tcp_io_get_tls_protocol (client), client_credentials);
+
+  if (!flow_tcp_io_sync_connect (FLOW_TCP_IO (client), ip_service, NULL))
+    test_end (TEST_RESULT_FAILED, "could not connect to listener");
+
+  server = flow_tls_tcp_io_listener_sync_pop_connection (tls_tcp_listener);
+  if (!server)
+    test_end (TEST_RESULT_FAILED, "missed connection on listener end");
+
+  flow_io_write (FLOW_IO (server), (gpointer) greeting, sizeof (greeting));
+  flow_io_flush (FLOW_IO (server));
+
+  success = flow_io_sync_read_exact (FLOW_IO (client), buf, sizeof (greeting), NULL) &&
+            !memcmp (buf, greeting, sizeof (greeting));
+
+  test_print ("Handshake %s\n", success ? "succeeded" : "failed");
+
+  flow_tcp_io_sync_disconnect (FLOW_TCP_IO (client), NULL);
+  flow_tcp_io_sync_disconnect (FLOW_TCP_IO (server), NULL);
+
+  g_object_unref (client);
+  g_object_unref (server);
+  g_object_unref (ip_service);
+
+  return success;
+}
+
+static void
+test_ocsp_loading (const gchar *good_path)
+{
+  gchar *stale_path;
+  gchar *late_path;
+  gchar *contents;
+  gsize  len;
+
+  test_print ("Loading OCSP responses\n");
+
+  flow_tls_credentials_set_ocsp_response_file (server_credentials, good_path, 0);
+  if (!flow_tls_credentials_has_ocsp_response (server_credentials))
+    test_end (TEST_RESULT_FAILED, "good OCSP response was not loaded");
+
+  flow_tls_credentials_set_ocsp_response_file (server_credentials, NULL, 0);
+  if (flow_tls_credentials_has_ocsp_response (server_credentials))
+    test_end (TEST_RESULT_FAILED, "OCSP response still present after disabling stapling");
+
+  stale_path = test_tls_files_write_ocsp_response (files, "stale.der", -30);
+  flow_tls_credentials_set_ocsp_response_file (server_credentials, stale_path, 0);
+  if (flow_tls_credentials_has_ocsp_response (server_credentials))
+    test_end (TEST_RESULT_FAILED, "stale OCSP response was loaded");
+
+  /* The refresh thread picks up a file that appears later */
+
+  late_path = g_build_filename (files->dir, "late.der", NULL);
+  flow_tls_credentials_set_ocsp_response_file (server_credentials, late_path, OCSP_REFRESH_S);
+  if (flow_tls_credentials_has_ocsp_response (server_credentials))
+    test_end (TEST_RESULT_FAILED, "missing OCSP response file was loaded");
+
+  if (!g_file_get_contents (good_path, &contents, &len, NULL) ||
+      !g_file_set_contents (late_path, contents, len, NULL))
+    test_end (TEST_RESULT_SYSTEM_ERROR, "could not copy OCSP response");
+
+  g_free (contents);
+  g_usleep ((OCSP_REFRESH_S * 2 + 1) * G_USEC_PER_SEC);
+
+  if (!flow_tls_credentials_has_ocsp_response (server_credentials))
+    test_end (TEST_RESULT_FAILED, "OCSP response was not refreshed");
+
+  g_free (stale_path);
+  g_free (late_path);
+}
+
+static void
+test_run (void)
+{
+  gchar  *ocsp_path;
+  GError *error = NULL;
+
+  files = test_tls_files_new (TRUE);
+  ocsp_path = test_tls_files_write_ocsp_response (files, "ocsp.der", 3600);
+
+  server_credentials = flow_tls_credentials_new ();
+  if (!flow_tls_credentials_add_key_pair (server_credentials, files->cert_path, files->key_path, &error))
+    test_end (TEST_RESULT_FAILED, error->message);
+
+  client_credentials = flow_tls_credentials_new ();
+  if (!flow_tls_credentials_add_trust_file (client_credentials, files->ca_path, &error))
+    test_end (TEST_RESULT_FAILED, error->message);
+
+  test_ocsp_loading (ocsp_path);
+
+  flow_tls_credentials_set_ocsp_response_file (server_credentials, ocsp_path, 0);
+
+  listener = make_listener (TEST_TLS_SERVER_ADDR);
+  if (!listener)
+    test_end (TEST_RESULT_FAILED, "could not bind listener");
+
+  /* Names and addresses the certificate lists */
+
+  if (!try_connection (listener, TEST_TLS_SERVER_NAME, TEST_TLS_SERVER_ADDR))
+    test_end (TEST_RESULT_FAILED, "rejected certificate for the right name");
+
+  if (!try_connection (listener, NULL, TEST_TLS_SERVER_ADDR))
+    test_end (TEST_RESULT_FAILED, "rejected certificate for the right address");
+
+  /* Ones it doesn't */
+
+  if (try_connection (listener, "wrong.example", TEST_TLS_SERVER_ADDR))
+    test_end (TEST_RESULT_FAILED, "accepted certificate for the wrong name");
+
+  other_listener = make_listener (OTHER_LOOPBACK);
+
+  if (other_listener)
+  {
+    if (try_connection (other_listener, NULL, OTHER_LOOPBACK))
+      test_end (TEST_RESULT_FAILED, "accepted certificate for the wrong address");
+
+    g_object_unref (other_listener);
+  }
+  else
+  {
+    test_print ("Could not bind to %s; skipping wrong address check\n", OTHER_LOOPBACK);
+  }
+
+#ifdef TEST_TLS_HAVE_MUST_STAPLE
+
+  /* The certificate demands a stapled response, so the client can only
+   * accept it if we sent one */
+
+  flow_tls_credentials_set_ocsp_response_file (server_credentials, NULL, 0);
+
+  if (try_connection (listener, TEST_TLS_SERVER_NAME, TEST_TLS_SERVER_ADDR))
+    test_end (TEST_RESULT_FAILED, "accepted must-staple certificate without OCSP response");
+
+  flow_tls_credentials_set_ocsp_response_file (server_credentials, ocsp_path, 0);
+
+  if (!try_connection (listener, TEST_TLS_SERVER_NAME, TEST_TLS_SERVER_ADDR))
+    test_end (TEST_RESULT_FAILED, "OCSP response was not stapled");
+
+#endif
+
+  g_object_unref (listener);
+  g_object_unref (client_credentials);
+  g_object_unref (server_credentials);
+
+  g_free (ocsp_path);
+  test_tls_files_free (files);
+}
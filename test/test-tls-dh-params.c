@@ -0,0 +1,124 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* test-tls-dh-params.c - TLS server DH parameter setup test.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+
+#define TEST_UNIT_NAME "FlowTlsProtocol (DH parameters)"
+#define TEST_TIMEOUT_S 120
+
+/* Test variables; adjustable */
+
+#define LOCAL_PORT 2538
+#define N_ROUNDS   3
+
+#include "test-common.c"
+#include <glib/gstdio.h>
+
+static const guchar greeting [] = "Hello, anonymous client";
+
+/* Anonymous server sessions can't handshake until the parameters are
+ * there, so getting the greeting through means they arrived */
+static void
+try_connection (FlowTlsTcpIOListener *tls_tcp_listener, FlowIPService *ip_service)
+{
+  FlowTlsTcpIO *client;
+  FlowTlsTcpIO *server;
+  guchar        buf [sizeof (greeting)];
+
+  client = flow_tls_tcp_io_new ();
+
+  if (!flow_tcp_io_sync_connect (FLOW_TCP_IO (client), ip_service, NULL))
+    test_end (TEST_RESULT_FAILED, "could not connect to listener");
+
+  server = flow_tls_tcp_io_listener_sync_pop_connection (tls_tcp_listener);
+  if (!server)
+    test_end (TEST_RESULT_FAILED, "missed connection on listener end");
+
+  flow_io_write (FLOW_IO (server), (gpointer) greeting, sizeof (greeting));
+  flow_io_flush (FLOW_IO (server));
+
+  if (!flow_io_sync_read_exact (FLOW_IO (client), buf, sizeof (greeting), NULL) ||
+      memcmp (buf, greeting, sizeof (greeting)))
+    test_end (TEST_RESULT_FAILED, "anonymous handshake did not complete");
+
+  flow_tcp_io_sync_disconnect (FLOW_TCP_IO (client), NULL);
+  flow_tcp_io_sync_disconnect (FLOW_TCP_IO (server), NULL);
+
+  g_object_unref (client);
+  g_object_unref (server);
+}
+
+static void
+test_run (void)
+{
+  FlowTlsTcpIOListener *tls_tcp_listener;
+  FlowIPService        *ip_service;
+  FlowIPAddr           *ip_addr;
+  gchar                *dir;
+  gchar                *path;
+  gint                  i;
+
+  dir = g_dir_make_tmp ("flow-test-XXXXXX", NULL);
+  if (!dir)
+    test_end (TEST_RESULT_SYSTEM_ERROR, "could not create temporary directory");
+
+  path = g_build_filename (dir, "dh.pem", NULL);
+  flow_tls_protocol_set_dh_params_file (path);
+
+  /* Nothing else holds on to GnuTLS yet, so the generator thread must
+   * keep it initialized by itself */
+
+  flow_tls_protocol_prepare_server_params ();
+
+  ip_service = flow_ip_service_new ();
+  ip_addr = flow_ip_addr_new ();
+  flow_ip_addr_set_string (ip_addr, "127.0.0.1");
+  flow_ip_service_add_address (ip_service, ip_addr);
+  flow_ip_service_set_port (ip_service, LOCAL_PORT);
+  g_object_unref (ip_addr);
+
+  tls_tcp_listener = flow_tls_tcp_io_listener_new ();
+  if (!flow_tcp_listener_set_local_service (FLOW_TCP_LISTENER (tls_tcp_listener), ip_service, NULL))
+    test_end (TEST_RESULT_FAILED, "could not bind listener");
+
+  /* The first connection will most likely have to wait for generation to
+   * finish. Later ones use the credentials the parameters were installed on. */
+
+  for (i = 0; i < N_ROUNDS; i++)
+  {
+    flow_tls_protocol_clear_session_cache ();
+    try_connection (tls_tcp_listener, ip_service);
+    test_print ("Connection %d handshaked\n", i);
+  }
+
+  if (!g_file_test (path, G_FILE_TEST_IS_REGULAR))
+    test_end (TEST_RESULT_FAILED, "generated parameters were not saved");
+
+  g_object_unref (tls_tcp_listener);
+  g_object_unref (ip_service);
+
+  g_unlink (path);
+  g_rmdir (dir);
+  g_free (path);
+  g_free (dir);
+}
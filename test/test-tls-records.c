@@ -0,0 +1,275 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* test-tls-records.c - TLS record coalescing test.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+
+#define TEST_UNIT_NAME "FlowTlsProtocol (record coalescing)"
+#define TEST_TIMEOUT_S 60
+
+/* Test variables; adjustable */
+
+#define N_SMALL_WRITES   200
+#define SMALL_WRITE_SIZE 5       /* Together less than one small record */
+#define RECORD_DELAY_MS  100
+#define CAP_RECORD_SIZE  512
+#define CAP_TRANSFER     65536
+#define RAMP_TRANSFER    2097152 /* Past the small-record ramp-up */
+#define RECORD_SMALL     1300    /* Matches FlowTlsProtocol */
+#define RECORD_OVERHEAD  64      /* Generous allowance for nonce, tag and padding */
+
+#define TLS_APPLICATION_DATA 23
+
+#include "test-common.c"
+#include "test-tls-common.c"
+
+typedef struct
+{
+  GByteArray *pending;
+  gint        n_records;
+  gint        first_len;
+  gint        max_len;
+}
+RecordStats;
+
+static guchar *buffer;
+
+static void
+record_stats_reset (RecordStats *stats)
+{
+  g_byte_array_set_size (stats->pending, 0);
+  stats->n_records = 0;
+  stats->first_len = 0;
+  stats->max_len   = 0;
+}
+
+/* Splits the client's ciphertext into TLS records and tallies the
+ * application data ones, passing it on to the server as it goes */
+static gboolean
+forward_counting (TestTlsPair *pair, RecordStats *stats)
+{
+  FlowPacketQueue *packet_queue = flow_user_adapter_get_input_queue (pair->client_net);
+  FlowPacket      *packet;
+  gboolean         moved        = FALSE;
+
+  while ((packet = flow_packet_queue_pop_packet (packet_queue)))
+  {
+    moved = TRUE;
+
+    if (flow_packet_get_format (packet) != FLOW_PACKET_FORMAT_BUFFER)
+    {
+      flow_packet_unref (packet);
+      continue;
+    }
+
+    g_byte_array_append (stats->pending, flow_packet_get_data (packet), flow_packet_get_size (packet));
+    flow_pad_push (test_tls_get_downstream_input (pair->server_tls), packet);
+
+    while (stats->pending->len >= 5)
+    {
+      const guint8 *p   = stats->pending->data;
+      gint          len = (p [3] << 8) | p [4];
+
+      if (stats->pending->len < (guint) (5 + len))
+        break;
+
+      if (p [0] == TLS_APPLICATION_DATA)
+      {
+        if (stats->n_records++ == 0)
+          stats->first_len = len;
+        stats->max_len = MAX (stats->max_len, len);
+      }
+
+      g_byte_array_remove_range (stats->pending, 0, 5 + len);
+    }
+  }
+
+  return moved;
+}
+
+static void
+pump_counting (TestTlsPair *pair, gint len, RecordStats *stats)
+{
+  FlowPacketQueue *packet_queue = flow_user_adapter_get_input_queue (pair->server_app);
+
+  while (flow_packet_queue_get_length_data_bytes (packet_queue) < len)
+  {
+    gboolean moved;
+
+    moved  = forward_counting (pair, stats);
+    moved |= test_tls_pair_forward (pair, pair->server_net, pair->server_tls, pair->client_tls);
+
+    if (!moved)
+      g_main_context_iteration (NULL, TRUE);
+  }
+}
+
+/* Completes the handshake and exchanges a greeting, so that later
+ * counts only see records carrying our data */
+static TestTlsPair *
+start_pair (FlowTlsCredentials *client_credentials, FlowTlsCredentials *server_credentials)
+{
+  TestTlsPair *pair;
+
+  pair = test_tls_pair_new (client_credentials, server_credentials);
+  test_tls_pair_start (pair);
+
+  test_tls_pair_send (pair->client_tls, buffer, 1);
+  test_tls_pair_pump (pair, pair->server_app, 1);
+  test_tls_pair_check (pair->server_app, buffer, 1);
+
+  test_tls_pair_send (pair->server_tls, buffer, 1);
+  test_tls_pair_pump (pair, pair->client_app, 1);
+  test_tls_pair_check (pair->client_app, buffer, 1);
+
+  while (test_tls_pair_forward (pair, pair->client_net, pair->client_tls, pair->server_tls) ||
+         test_tls_pair_forward (pair, pair->server_net, pair->server_tls, pair->client_tls) ||
+         g_main_context_iteration (NULL, FALSE))
+    ;
+
+  return pair;
+}
+
+static void
+push_small_writes (TestTlsPair *pair)
+{
+  gint i;
+
+  for (i = 0; i < N_SMALL_WRITES; i++)
+    flow_pad_push (test_tls_get_upstream_input (pair->client_tls),
+                   flow_packet_new (FLOW_PACKET_FORMAT_BUFFER, buffer + i * SMALL_WRITE_SIZE,
+                                    SMALL_WRITE_SIZE));
+}
+
+static void
+test_run (void)
+{
+  TestTlsFiles       *files;
+  FlowTlsCredentials *server_credentials;
+  FlowTlsCredentials *client_credentials;
+  TestTlsPair        *pair;
+  RecordStats         stats;
+  GTimer             *timer;
+  GError             *error = NULL;
+  gint                i;
+
+  files = test_tls_files_new (FALSE);
+
+  server_credentials = flow_tls_credentials_new ();
+  if (!flow_tls_credentials_add_key_pair (server_credentials, files->cert_path, files->key_path, &error))
+    test_end (TEST_RESULT_FAILED, error->message);
+
+  client_credentials = flow_tls_credentials_new ();
+  if (!flow_tls_credentials_add_trust_file (client_credentials, files->ca_path, &error))
+    test_end (TEST_RESULT_FAILED, error->message);
+
+  buffer = g_malloc (RAMP_TRANSFER);
+  for (i = 0; i < RAMP_TRANSFER; i++)
+    buffer [i] = (guchar) g_random_int ();
+
+  stats.pending = g_byte_array_new ();
+  timer = g_timer_new ();
+
+  /* With a record delay, a run of small writes goes out as one record
+   * when the delay expires */
+
+  pair = start_pair (client_credentials, server_credentials);
+  g_object_set (pair->client_tls, "record-delay", RECORD_DELAY_MS, NULL);
+  record_stats_reset (&stats);
+
+  push_small_writes (pair);
+  pump_counting (pair, N_SMALL_WRITES * SMALL_WRITE_SIZE, &stats);
+  test_tls_pair_check (pair->server_app, buffer, N_SMALL_WRITES * SMALL_WRITE_SIZE);
+
+  test_print ("Delayed: %d small writes in %d record(s)\n", N_SMALL_WRITES, stats.n_records);
+  if (stats.n_records != 1)
+    test_end (TEST_RESULT_FAILED, "small writes were not coalesced");
+
+  /* A flush sends the partial record right away, without waiting out
+   * the delay */
+
+  g_object_set (pair->client_tls, "record-delay", 1000, NULL);
+  record_stats_reset (&stats);
+  g_timer_start (timer);
+
+  push_small_writes (pair);
+  flow_pad_push (test_tls_get_upstream_input (pair->client_tls),
+                 flow_create_simple_event_packet (FLOW_STREAM_DOMAIN, FLOW_STREAM_FLUSH));
+  pump_counting (pair, N_SMALL_WRITES * SMALL_WRITE_SIZE, &stats);
+  test_tls_pair_check (pair->server_app, buffer, N_SMALL_WRITES * SMALL_WRITE_SIZE);
+
+  test_print ("Flushed: %d small writes in %d record(s) after %.1fms\n",
+              N_SMALL_WRITES, stats.n_records, g_timer_elapsed (timer, NULL) * 1000.0);
+  if (stats.n_records != 1)
+    test_end (TEST_RESULT_FAILED, "flushed small writes were not coalesced");
+  if (g_timer_elapsed (timer, NULL) >= 0.5)
+    test_end (TEST_RESULT_FAILED, "flush waited for the record delay");
+
+  test_tls_pair_free (pair);
+
+  /* Records never exceed max-record-size */
+
+  pair = start_pair (client_credentials, server_credentials);
+  g_object_set (pair->client_tls, "max-record-size", CAP_RECORD_SIZE, NULL);
+  record_stats_reset (&stats);
+
+  test_tls_pair_send (pair->client_tls, buffer, CAP_TRANSFER);
+  pump_counting (pair, CAP_TRANSFER, &stats);
+  test_tls_pair_check (pair->server_app, buffer, CAP_TRANSFER);
+
+  test_print ("Capped: %d bytes in %d records, largest %d bytes\n",
+              CAP_TRANSFER, stats.n_records, stats.max_len);
+  if (stats.max_len > CAP_RECORD_SIZE + RECORD_OVERHEAD)
+    test_end (TEST_RESULT_FAILED, "record exceeded max-record-size");
+  if (stats.n_records != CAP_TRANSFER / CAP_RECORD_SIZE)
+    test_end (TEST_RESULT_FAILED, "data was not sent in full-size records");
+
+  test_tls_pair_free (pair);
+
+  /* A fresh connection starts with records that fit one segment, and
+   * moves on to larger ones */
+
+  pair = start_pair (client_credentials, server_credentials);
+  record_stats_reset (&stats);
+
+  test_tls_pair_send (pair->client_tls, buffer, RAMP_TRANSFER);
+  pump_counting (pair, RAMP_TRANSFER, &stats);
+  test_tls_pair_check (pair->server_app, buffer, RAMP_TRANSFER);
+
+  test_print ("Ramp: %d bytes in %d records, first %d bytes, largest %d bytes\n",
+              RAMP_TRANSFER, stats.n_records, stats.first_len, stats.max_len);
+  if (stats.first_len > RECORD_SMALL + RECORD_OVERHEAD)
+    test_end (TEST_RESULT_FAILED, "first record was too large");
+  if (stats.max_len <= RECORD_SMALL + RECORD_OVERHEAD)
+    test_end (TEST_RESULT_FAILED, "records never grew");
+
+  test_tls_pair_free (pair);
+
+  g_timer_destroy (timer);
+  g_byte_array_free (stats.pending, TRUE);
+
+  g_object_unref (client_credentials);
+  g_object_unref (server_credentials);
+
+  g_free (buffer);
+  test_tls_files_free (files);
+}
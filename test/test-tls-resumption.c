@@ -0,0 +1,151 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* test-tls-resumption.c - TLS session resumption test.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+
+#define TEST_UNIT_NAME "FlowTlsProtocol (session resumption)"
+#define TEST_TIMEOUT_S 60
+
+/* Test variables; adjustable */
+
+#define TRANSFER_SIZE 4096  /* Plaintext to send each way per connection */
+
+#include "test-common.c"
+#include "test-tls-common.c"
+
+static guchar *buffer;
+
+/* Runs one connection to completion: a request, a response and a clean
+ * close from both ends. The response gets the client past any session
+ * ticket sent after the handshake, and freeing the pair lets the client
+ * store what it got. */
+static void
+run_connection (FlowTlsCredentials *client_credentials, FlowTlsCredentials *server_credentials)
+{
+  TestTlsPair *pair;
+
+  pair = test_tls_pair_new (client_credentials, server_credentials);
+  test_tls_pair_start (pair);
+
+  test_tls_pair_send (pair->client_tls, buffer, TRANSFER_SIZE);
+  test_tls_pair_pump (pair, pair->server_app, TRANSFER_SIZE);
+  test_tls_pair_check (pair->server_app, buffer, TRANSFER_SIZE);
+
+  test_tls_pair_send (pair->server_tls, buffer, TRANSFER_SIZE);
+  test_tls_pair_pump (pair, pair->client_app, TRANSFER_SIZE);
+  test_tls_pair_check (pair->client_app, buffer, TRANSFER_SIZE);
+
+  flow_pad_push (test_tls_get_upstream_input (pair->client_tls),
+                 flow_create_simple_event_packet (FLOW_STREAM_DOMAIN, FLOW_STREAM_END));
+  test_tls_pair_pump_to_end (pair, pair->server_app);
+
+  flow_pad_push (test_tls_get_upstream_input (pair->server_tls),
+                 flow_create_simple_event_packet (FLOW_STREAM_DOMAIN, FLOW_STREAM_END));
+  test_tls_pair_pump_to_end (pair, pair->client_app);
+
+  test_tls_pair_free (pair);
+}
+
+/* Stats are process-wide and never reset, so compare against a snapshot */
+static void
+check_stats (FlowTlsSessionCacheStats *before, gboolean expect_resumed, const gchar *desc)
+{
+  FlowTlsSessionCacheStats after;
+  guint64                  n_hits   = expect_resumed ? 1 : 0;
+  guint64                  n_misses = expect_resumed ? 0 : 1;
+
+  flow_tls_protocol_get_session_cache_stats (&after);
+
+  test_print ("%s: server %" G_GUINT64_FORMAT "/%" G_GUINT64_FORMAT
+              ", client %" G_GUINT64_FORMAT "/%" G_GUINT64_FORMAT " hits/misses\n",
+              desc,
+              after.server_hits - before->server_hits,
+              after.server_misses - before->server_misses,
+              after.client_hits - before->client_hits,
+              after.client_misses - before->client_misses);
+
+  if (after.server_hits - before->server_hits != n_hits ||
+      after.server_misses - before->server_misses != n_misses)
+    test_end (TEST_RESULT_FAILED, "unexpected server cache result");
+
+  if (after.client_hits - before->client_hits != n_hits ||
+      after.client_misses - before->client_misses != n_misses)
+    test_end (TEST_RESULT_FAILED, "unexpected client cache result");
+
+  *before = after;
+}
+
+static void
+test_run (void)
+{
+  TestTlsFiles             *files;
+  FlowTlsCredentials       *server_credentials;
+  FlowTlsCredentials       *client_credentials;
+  FlowTlsSessionCacheStats  stats;
+  GError                   *error = NULL;
+  gint                      i;
+
+  files = test_tls_files_new (FALSE);
+
+  server_credentials = flow_tls_credentials_new ();
+  if (!flow_tls_credentials_add_key_pair (server_credentials, files->cert_path, files->key_path, &error))
+    test_end (TEST_RESULT_FAILED, error->message);
+
+  client_credentials = flow_tls_credentials_new ();
+  if (!flow_tls_credentials_add_trust_file (client_credentials, files->ca_path, &error))
+    test_end (TEST_RESULT_FAILED, error->message);
+
+  buffer = g_malloc (TRANSFER_SIZE);
+  for (i = 0; i < TRANSFER_SIZE; i++)
+    buffer [i] = (guchar) g_random_int ();
+
+  flow_tls_protocol_clear_session_cache ();
+  flow_tls_protocol_get_session_cache_stats (&stats);
+
+  /* The first handshake is a full one; later ones resume it */
+
+  run_connection (client_credentials, server_credentials);
+  check_stats (&stats, FALSE, "First connection");
+
+  run_connection (client_credentials, server_credentials);
+  check_stats (&stats, TRUE, "Second connection");
+
+  run_connection (client_credentials, server_credentials);
+  check_stats (&stats, TRUE, "Third connection");
+
+  /* With the caches cleared, there's nothing to resume */
+
+  flow_tls_protocol_clear_session_cache ();
+
+  run_connection (client_credentials, server_credentials);
+  check_stats (&stats, FALSE, "After clearing caches");
+
+  run_connection (client_credentials, server_credentials);
+  check_stats (&stats, TRUE, "Reconnect after clearing");
+
+  g_object_unref (client_credentials);
+  g_object_unref (server_credentials);
+
+  g_free (buffer);
+  test_tls_files_free (files);
+}
@@ -0,0 +1,103 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* test-tls-threaded.c - Threaded TLS crypto test.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+
+#define TEST_UNIT_NAME "FlowTlsProtocol (threaded crypto)"
+#define TEST_TIMEOUT_S 60
+
+/* Test variables; adjustable */
+
+#define TRANSFER_SIZE 1048576  /* Plaintext to send each way */
+#define MAX_THREADS   2
+
+#include "test-common.c"
+#include "test-tls-common.c"
+
+static guchar *buffer;
+
+static void
+test_run (void)
+{
+  TestTlsFiles       *files;
+  FlowTlsCredentials *server_credentials;
+  FlowTlsCredentials *client_credentials;
+  TestTlsPair        *pair;
+  GError             *error = NULL;
+  gint                i;
+
+  files = test_tls_files_new (FALSE);
+
+  server_credentials = flow_tls_credentials_new ();
+  if (!flow_tls_credentials_add_key_pair (server_credentials, files->cert_path, files->key_path, &error))
+    test_end (TEST_RESULT_FAILED, error->message);
+
+  client_credentials = flow_tls_credentials_new ();
+  if (!flow_tls_credentials_add_trust_file (client_credentials, files->ca_path, &error))
+    test_end (TEST_RESULT_FAILED, error->message);
+
+  flow_tls_protocol_set_max_crypto_threads (MAX_THREADS);
+
+  pair = test_tls_pair_new (client_credentials, server_credentials);
+  g_object_set (pair->client_tls, "threaded-crypto", TRUE, NULL);
+  g_object_set (pair->server_tls, "threaded-crypto", TRUE, NULL);
+
+  test_tls_pair_start (pair);
+
+  buffer = g_malloc (TRANSFER_SIZE);
+  for (i = 0; i < TRANSFER_SIZE; i++)
+    buffer [i] = (guchar) g_random_int ();
+
+  /* Both ways at once, so jobs for the two sessions overlap */
+
+  test_tls_pair_send (pair->client_tls, buffer, TRANSFER_SIZE);
+  test_tls_pair_send (pair->server_tls, buffer, TRANSFER_SIZE);
+
+  test_tls_pair_pump (pair, pair->server_app, TRANSFER_SIZE);
+  test_tls_pair_pump (pair, pair->client_app, TRANSFER_SIZE);
+
+  test_tls_pair_check (pair->server_app, buffer, TRANSFER_SIZE);
+  test_tls_pair_check (pair->client_app, buffer, TRANSFER_SIZE);
+
+  test_print ("Transferred %d bytes each way\n", TRANSFER_SIZE);
+
+  /* Half-close: once the client is done sending, the server's downstream
+   * half is closed, but it must still be able to answer */
+
+  flow_pad_push (test_tls_get_upstream_input (pair->client_tls),
+                 flow_create_simple_event_packet (FLOW_STREAM_DOMAIN, FLOW_STREAM_END));
+  test_tls_pair_pump_to_end (pair, pair->server_app);
+
+  test_tls_pair_send (pair->server_tls, buffer, TRANSFER_SIZE);
+  test_tls_pair_pump (pair, pair->client_app, TRANSFER_SIZE);
+  test_tls_pair_check (pair->client_app, buffer, TRANSFER_SIZE);
+
+  test_print ("Server answered after client closed\n");
+
+  test_tls_pair_free (pair);
+  g_object_unref (client_credentials);
+  g_object_unref (server_credentials);
+
+  g_free (buffer);
+  test_tls_files_free (files);
+}
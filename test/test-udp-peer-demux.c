@@ -0,0 +1,160 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* test-udp-peer-demux.c - Tests for the UDP peer demultiplexer.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+#define TEST_UNIT_NAME "FlowUdpPeerDemux"
+#define TEST_TIMEOUT_S 20
+
+#include "test-common.c"
+#include "test-mux-common.c"
+#include <flow/flow-udp-peer-demux.h>
+
+#define N_PEERS     4
+#define BUFFER_SIZE 1500
+#define ITERATIONS  500
+
+static FlowUserAdapter *adapters [N_PEERS];
+static FlowIPEndpoint   peers [N_PEERS];
+static gboolean         late_peer_added;
+
+static void
+set_endpoint (FlowIPEndpoint *endpoint, const gchar *addr_str, gint port)
+{
+  FlowIPAddr *ip_addr;
+
+  ip_addr = flow_ip_addr_new ();
+
+  if (!flow_ip_addr_set_string (ip_addr, addr_str))
+    test_end (TEST_RESULT_FAILED, "could not parse address");
+
+  if (!flow_ip_endpoint_set_ip_addr (endpoint, ip_addr, port))
+    test_end (TEST_RESULT_FAILED, "could not set endpoint from address");
+
+  g_object_unref (ip_addr);
+}
+
+static void
+connect_peer_pad (FlowOutputPad *output_pad, gint i)
+{
+  adapters [i] = flow_user_adapter_new ();
+  flow_pad_connect (FLOW_PAD (output_pad),
+                    FLOW_PAD (flow_simplex_element_get_input_pad (FLOW_SIMPLEX_ELEMENT (adapters [i]))));
+}
+
+static void
+new_peer (FlowUdpPeerDemux *demux, const FlowIPEndpoint *peer)
+{
+  /* Only the last peer is accepted on demand; the stranger is ignored */
+
+  if (!flow_ip_endpoint_equal (peer, &peers [N_PEERS - 1]))
+    return;
+
+  if (late_peer_added)
+    test_end (TEST_RESULT_FAILED, "new-peer emitted twice for the same peer");
+
+  connect_peer_pad (flow_udp_peer_demux_add_peer (demux, peer), N_PEERS - 1);
+  late_peer_added = TRUE;
+}
+
+static void
+test_run (void)
+{
+  FlowUdpPeerDemux *demux;
+  FlowInputPad     *input_pad;
+  FlowIPEndpoint    stranger;
+  FlowIPEndpoint    peer_out;
+  GList            *expected_packets [N_PEERS];
+  guchar           *buffer;
+  FlowPacket       *packet;
+  gint              i, k, len;
+
+  buffer = g_malloc (BUFFER_SIZE);
+
+  set_endpoint (&peers [0], "10.0.0.1", 4000);
+  set_endpoint (&peers [1], "10.0.0.1", 4001);
+  set_endpoint (&peers [2], "fe80::1", 4000);
+  set_endpoint (&peers [3], "10.0.0.2", 4000);
+  set_endpoint (&stranger, "10.0.0.3", 4000);
+
+  demux = flow_udp_peer_demux_new ();
+  g_signal_connect (demux, "new-peer", G_CALLBACK (new_peer), NULL);
+
+  for (i = 0; i < N_PEERS - 1; i++)
+    connect_peer_pad (flow_udp_peer_demux_add_peer (demux, &peers [i]), i);
+
+  if (flow_udp_peer_demux_get_n_peers (demux) != N_PEERS - 1)
+    test_end (TEST_RESULT_FAILED, "wrong number of peers");
+
+  for (i = 0; i < N_PEERS; i++)
+    expected_packets [i] = NULL;
+
+  input_pad = flow_splitter_get_input_pad (FLOW_SPLITTER (demux));
+
+  for (i = 0; i < ITERATIONS; i++)
+  {
+    len = g_random_int_range (0, BUFFER_SIZE);
+    memset (buffer, i & 0xff, len);
+
+    k = g_random_int_range (0, N_PEERS + 1);
+
+    if (k == N_PEERS)
+    {
+      /* Datagram from a peer nobody wants; must be dropped */
+      flow_pad_push (FLOW_PAD (input_pad), flow_udp_peer_packet_new (&stranger, buffer, len));
+      continue;
+    }
+
+    packet = flow_udp_peer_packet_new (&peers [k], buffer, len);
+
+    if (!flow_udp_peer_packet_get_peer (packet, &peer_out) ||
+        !flow_ip_endpoint_equal (&peer_out, &peers [k]))
+      test_end (TEST_RESULT_FAILED, "peer tag did not round-trip");
+
+    flow_pad_push (FLOW_PAD (input_pad), packet);
+    expected_packets [k] = g_list_prepend (expected_packets [k],
+                                           flow_packet_new (FLOW_PACKET_FORMAT_BUFFER, buffer, len));
+  }
+
+  if (!late_peer_added)
+    test_end (TEST_RESULT_FAILED, "new-peer was not emitted");
+
+  flow_pad_push (FLOW_PAD (input_pad),
+                 flow_create_simple_event_packet (FLOW_STREAM_DOMAIN, FLOW_STREAM_END));
+
+  for (i = 0; i < N_PEERS; i++)
+  {
+    expected_packets [i] = g_list_prepend (expected_packets [i],
+                                           flow_create_simple_event_packet (FLOW_STREAM_DOMAIN,
+                                                                            FLOW_STREAM_END));
+    expected_packets [i] = g_list_reverse (expected_packets [i]);
+    check_user_adapter_packets (adapters [i], expected_packets [i]);
+  }
+
+  flow_udp_peer_demux_remove_peer (demux, &peers [0]);
+
+  if (flow_udp_peer_demux_get_n_peers (demux) != N_PEERS - 1 ||
+      flow_udp_peer_demux_lookup_peer (demux, &peers [0]))
+    test_end (TEST_RESULT_FAILED, "peer was not removed");
+
+  g_free (buffer);
+}
@@ -0,0 +1,148 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* test-unix-io.c - FlowUnixIO test.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+
+#define TEST_UNIT_NAME "FlowUnixIO"
+#define TEST_TIMEOUT_S 30
+
+/* Test variables; adjustable */
+
+#define SOCKET_PATH "/tmp/flow-test-unix-io.sock"
+
+#include "test-common.c"
+
+static FlowUnixIOListener *unix_listener = NULL;
+
+/* Sends a request from the client and a reply from the server, checking
+ * that both arrive intact */
+static void
+exchange (FlowUnixIO *client, FlowUnixIO *server)
+{
+  guchar request [4] = { 'p', 'i', 'n', 'g' };
+  guchar reply   [4] = { 'p', 'o', 'n', 'g' };
+  guchar buffer  [4];
+
+  flow_io_write (FLOW_IO (client), request, sizeof (request));
+
+  if (!flow_io_sync_read_exact (FLOW_IO (server), buffer, sizeof (buffer), NULL) ||
+      memcmp (buffer, request, sizeof (request)))
+    test_end (TEST_RESULT_FAILED, "request mismatch");
+
+  flow_io_write (FLOW_IO (server), reply, sizeof (reply));
+
+  if (!flow_io_sync_read_exact (FLOW_IO (client), buffer, sizeof (buffer), NULL) ||
+      memcmp (buffer, reply, sizeof (reply)))
+    test_end (TEST_RESULT_FAILED, "reply mismatch");
+}
+
+/* Hands the write end of a pipe from the client to the server, and checks
+ * that what the server writes to the received descriptor comes out of the
+ * client's read end */
+static void
+pass_fd (FlowUnixIO *client, FlowUnixIO *server)
+{
+  FlowUnixFds *unix_fds;
+  gpointer     object;
+  guchar       marker = 'm';
+  guchar       buffer [4];
+  gint         pipe_fds [2];
+  gint         received_fd;
+
+  if (pipe (pipe_fds) < 0)
+    test_end (TEST_RESULT_FAILED, "could not create pipe");
+
+  unix_fds = flow_unix_fds_new ();
+  flow_unix_fds_take_fd (unix_fds, pipe_fds [1]);
+
+  /* Descriptors travel with the first byte that follows them */
+
+  flow_io_write_object (FLOW_IO (client), unix_fds);
+  flow_io_write (FLOW_IO (client), &marker, 1);
+  g_object_unref (unix_fds);
+
+  object = flow_io_sync_read_object (FLOW_IO (server), NULL);
+  if (!FLOW_IS_UNIX_FDS (object))
+    test_end (TEST_RESULT_FAILED, "did not receive descriptors");
+
+  unix_fds = object;
+
+  if (flow_unix_fds_get_n_fds (unix_fds) != 1)
+    test_end (TEST_RESULT_FAILED, "received wrong number of descriptors");
+
+  received_fd = flow_unix_fds_steal_nth_fd (unix_fds, 0);
+  g_object_unref (unix_fds);
+
+  if (!flow_io_sync_read_exact (FLOW_IO (server), buffer, 1, NULL) || buffer [0] != marker)
+    test_end (TEST_RESULT_FAILED, "data after descriptors did not arrive");
+
+  if (write (received_fd, "fd", 2) != 2)
+    test_end (TEST_RESULT_FAILED, "could not write to received descriptor");
+
+  close (received_fd);
+
+  if (read (pipe_fds [0], buffer, 2) != 2 || memcmp (buffer, "fd", 2))
+    test_end (TEST_RESULT_FAILED, "received descriptor is not the one sent");
+
+  close (pipe_fds [0]);
+}
+
+static void
+test_run (void)
+{
+  FlowUnixIO *client;
+  FlowUnixIO *server;
+  GError     *error = NULL;
+
+  unlink (SOCKET_PATH);
+
+  unix_listener = flow_unix_io_listener_new ();
+  if (!flow_unix_listener_set_path (FLOW_UNIX_LISTENER (unix_listener), SOCKET_PATH, NULL))
+    test_end (TEST_RESULT_FAILED, "could not bind listener");
+
+  client = flow_unix_io_new ();
+  if (!flow_unix_io_sync_connect (client, SOCKET_PATH, FLOW_UNIX_SOCKET_STREAM, &error))
+    test_end (TEST_RESULT_FAILED, "could not connect");
+
+  server = flow_unix_io_listener_sync_pop_connection (unix_listener);
+  if (!server)
+    test_end (TEST_RESULT_FAILED, "missed connection on listener end");
+
+  exchange (client, server);
+  pass_fd (client, server);
+  exchange (client, server);
+
+  flow_unix_io_sync_disconnect (client, NULL);
+  flow_unix_io_sync_disconnect (server, NULL);
+
+  g_object_unref (client);
+  g_object_unref (server);
+
+  g_object_unref (unix_listener);
+  unix_listener = NULL;
+
+  /* The listener removes its socket file when it goes away */
+
+  if (access (SOCKET_PATH, F_OK) == 0)
+    test_end (TEST_RESULT_FAILED, "socket file was left behind");
+}
@@ -0,0 +1,307 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* test-unix-seqpacket.c - Unix domain seqpacket shunt test.
+ *
+ * Copyright (C) 2026 Hans Petter Jansson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Hans Petter Jansson <hpj@copyleft.no>
+ */
+
+
+#define TEST_UNIT_NAME "FlowShunt (Unix seqpacket)"
+#define TEST_TIMEOUT_S 30
+
+/* Test variables; adjustable */
+
+#define SOCKET_PATH    "/tmp/flow-test-unix-seqpacket.sock"
+#define IO_BUFFER_SIZE 4096
+#define MESSAGE_MAX    (IO_BUFFER_SIZE * 2)
+
+#include "test-common.c"
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static const gint read_sizes  [] = { 1, 100, 1000, 3000, IO_BUFFER_SIZE };
+static const gint write_sizes [] = { 7, 500, 2000, IO_BUFFER_SIZE };
+
+static guchar     buffer [MESSAGE_MAX];
+static GQueue     read_packets  = G_QUEUE_INIT;
+static GQueue     write_packets = G_QUEUE_INIT;
+static gint       peer_fd       = -1;
+
+static void
+read_from_shunt (FlowShunt *shunt, FlowPacket *packet, gpointer data)
+{
+  g_queue_push_tail (&read_packets, packet);
+}
+
+static FlowPacket *
+write_to_shunt (FlowShunt *shunt, gpointer data)
+{
+  FlowPacket *packet;
+
+  packet = g_queue_pop_head (&write_packets);
+  if (!packet)
+    flow_shunt_block_writes (shunt);
+
+  return packet;
+}
+
+/* Returns the next packet from the shunt, skipping stream and segment
+ * start markers */
+static FlowPacket *
+next_packet (void)
+{
+  for (;;)
+  {
+    FlowPacket *packet;
+    gpointer    object;
+
+    while (!(packet = g_queue_pop_head (&read_packets)))
+      g_main_context_iteration (NULL, TRUE);
+
+    if (flow_packet_get_format (packet) != FLOW_PACKET_FORMAT_OBJECT)
+      return packet;
+
+    object = flow_packet_get_data (packet);
+
+    if (!FLOW_IS_DETAILED_EVENT (object) ||
+        !(flow_detailed_event_matches (object, FLOW_STREAM_DOMAIN, FLOW_STREAM_BEGIN) ||
+          flow_detailed_event_matches (object, FLOW_STREAM_DOMAIN, FLOW_STREAM_SEGMENT_BEGIN)))
+      return packet;
+
+    flow_packet_unref (packet);
+  }
+}
+
+static void
+expect_message (gint len, const gchar *what)
+{
+  FlowPacket *packet = next_packet ();
+
+  if (flow_packet_get_format (packet) != FLOW_PACKET_FORMAT_BUFFER ||
+      flow_packet_get_size (packet) != (guint) len ||
+      memcmp (flow_packet_get_data (packet), buffer, len))
+    test_end (TEST_RESULT_FAILED, what);
+
+  flow_packet_unref (packet);
+}
+
+/* Sends one message from the peer, optionally passing a descriptor */
+static void
+send_message (gint len, gint fd_to_pass)
+{
+  union
+  {
+    struct cmsghdr align;
+    guint8         buf [CMSG_SPACE (sizeof (gint))];
+  }
+  control;
+  struct msghdr   msg;
+  struct iovec    iov;
+  struct cmsghdr *cmsg;
+
+  iov.iov_base = buffer;
+  iov.iov_len  = len;
+
+  memset (&msg, 0, sizeof (msg));
+  msg.msg_iov    = &iov;
+  msg.msg_iovlen = 1;
+
+  if (fd_to_pass >= 0)
+  {
+    msg.msg_control    = control.buf;
+    msg.msg_controllen = sizeof (control.buf);
+
+    cmsg = CMSG_FIRSTHDR (&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_RIGHTS;
+    cmsg->cmsg_len   = CMSG_LEN (sizeof (gint));
+    memcpy (CMSG_DATA (cmsg), &fd_to_pass, sizeof (gint));
+  }
+
+  if (sendmsg (peer_fd, &msg, 0) != len)
+    test_end (TEST_RESULT_FAILED, "peer could not send message");
+}
+
+/* Receives one message on the peer, running the main loop so the shunt
+ * can write meanwhile */
+static gint
+recv_message (guchar *dest, gint max_len)
+{
+  for (;;)
+  {
+    gint result = recv (peer_fd, dest, max_len, MSG_DONTWAIT);
+
+    if (result >= 0)
+      return result;
+
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+      test_end (TEST_RESULT_FAILED, "peer could not receive message");
+
+    g_main_context_iteration (NULL, FALSE);
+    g_usleep (1000);
+  }
+}
+
+static void
+check_boundaries (FlowShunt *shunt)
+{
+  guchar temp_buffer [MESSAGE_MAX];
+  guint  i;
+
+  /* Each message the peer sends is one packet, however they queue up */
+
+  for (i = 0; i < G_N_ELEMENTS (read_sizes); i++)
+    send_message (read_sizes [i], -1);
+
+  for (i = 0; i < G_N_ELEMENTS (read_sizes); i++)
+    expect_message (read_sizes [i], "read message boundary lost");
+
+  /* Each packet we write is one message */
+
+  for (i = 0; i < G_N_ELEMENTS (write_sizes); i++)
+    g_queue_push_tail (&write_packets, flow_packet_new (FLOW_PACKET_FORMAT_BUFFER, buffer, write_sizes [i]));
+
+  flow_shunt_unblock_writes (shunt);
+
+  for (i = 0; i < G_N_ELEMENTS (write_sizes); i++)
+  {
+    if (recv_message (temp_buffer, sizeof (temp_buffer)) != write_sizes [i] ||
+        memcmp (temp_buffer, buffer, write_sizes [i]))
+      test_end (TEST_RESULT_FAILED, "written message boundary lost");
+  }
+
+  test_print ("Message boundaries kept both ways\n");
+}
+
+/* A descriptor passed with a message that fits is delivered ahead of it */
+static void
+check_passed_fd (void)
+{
+  FlowPacket *packet;
+  gint        pipe_fds [2];
+
+  if (pipe (pipe_fds) < 0)
+    test_end (TEST_RESULT_SYSTEM_ERROR, "could not create pipe");
+
+  send_message (5, pipe_fds [1]);
+  close (pipe_fds [1]);
+
+  packet = next_packet ();
+  if (flow_packet_get_format (packet) != FLOW_PACKET_FORMAT_OBJECT ||
+      !FLOW_IS_UNIX_FDS (flow_packet_get_data (packet)) ||
+      flow_unix_fds_get_n_fds (flow_packet_get_data (packet)) != 1)
+    test_end (TEST_RESULT_FAILED, "descriptor did not arrive");
+  flow_packet_unref (packet);
+
+  expect_message (5, "message after descriptor lost");
+  close (pipe_fds [0]);
+
+  test_print ("Descriptor arrived with its message\n");
+}
+
+/* A message too big for the buffer is reported and dropped, and so is
+ * anything passed with it. The stream carries on. */
+static void
+check_oversized (void)
+{
+  FlowPacket *packet;
+  gpointer    object;
+  gint        pipe_fds [2];
+  gchar       c;
+
+  if (pipe (pipe_fds) < 0)
+    test_end (TEST_RESULT_SYSTEM_ERROR, "could not create pipe");
+
+  send_message (MESSAGE_MAX, pipe_fds [1]);
+  close (pipe_fds [1]);
+  send_message (10, -1);
+
+  packet = next_packet ();
+  object = flow_packet_get_data (packet);
+
+  if (flow_packet_get_format (packet) != FLOW_PACKET_FORMAT_OBJECT || !FLOW_IS_DETAILED_EVENT (object))
+    test_end (TEST_RESULT_FAILED, "oversized message was not reported first");
+
+  if (!flow_detailed_event_matches (object, FLOW_SOCKET_DOMAIN, FLOW_SOCKET_OVERSIZED_PACKET))
+    test_end (TEST_RESULT_FAILED, "oversized message reported with wrong event");
+
+  flow_packet_unref (packet);
+
+  expect_message (10, "message after oversized one lost");
+
+  /* Our copy of the write end was the last one besides the dropped
+   * message's, so once that's closed, the pipe reads as EOF */
+
+  fcntl (pipe_fds [0], F_SETFL, O_NONBLOCK);
+  if (read (pipe_fds [0], &c, 1) != 0)
+    test_end (TEST_RESULT_FAILED, "descriptor from dropped message was leaked");
+
+  close (pipe_fds [0]);
+
+  test_print ("Oversized message and its descriptor dropped\n");
+}
+
+static void
+test_run (void)
+{
+  struct sockaddr_un sun;
+  FlowShunt         *shunt;
+  gint               listen_fd;
+  gint               i;
+
+  for (i = 0; i < MESSAGE_MAX; i++)
+    buffer [i] = (guchar) g_random_int ();
+
+  unlink (SOCKET_PATH);
+
+  memset (&sun, 0, sizeof (sun));
+  sun.sun_family = AF_UNIX;
+  strcpy (sun.sun_path, SOCKET_PATH);
+
+  listen_fd = socket (AF_UNIX, SOCK_SEQPACKET, 0);
+  if (listen_fd < 0 ||
+      bind (listen_fd, (struct sockaddr *) &sun, sizeof (sun)) < 0 ||
+      listen (listen_fd, 1) < 0)
+    test_end (TEST_RESULT_SYSTEM_ERROR, "could not set up seqpacket listener");
+
+  shunt = flow_connect_to_unix (SOCKET_PATH, FLOW_UNIX_SOCKET_SEQPACKET);
+  flow_shunt_set_io_buffer_size (shunt, IO_BUFFER_SIZE);
+  flow_shunt_set_read_func (shunt, read_from_shunt, NULL);
+  flow_shunt_set_write_func (shunt, write_to_shunt, NULL);
+
+  peer_fd = accept (listen_fd, NULL, NULL);
+  if (peer_fd < 0)
+    test_end (TEST_RESULT_FAILED, "shunt did not connect");
+
+  check_boundaries (shunt);
+  check_passed_fd ();
+  check_oversized ();
+
+  flow_shunt_destroy (shunt);
+
+  while (!g_queue_is_empty (&read_packets))
+    flow_packet_unref (g_queue_pop_head (&read_packets));
+
+  close (peer_fd);
+  close (listen_fd);
+  unlink (SOCKET_PATH);
+}